@@ -49,7 +49,9 @@ static const hydrogenL_Reg loadedlibs[] = {
   {HYDROGEN_STRLIBNAME, hydrogenopen_string},
   {HYDROGEN_MATHLIBNAME, hydrogenopen_math},
   {HYDROGEN_UTF8LIBNAME, hydrogenopen_utf8},
+  {HYDROGEN_REGEXLIBNAME, hydrogenopen_regex},
   {HYDROGEN_DBLIBNAME, hydrogenopen_debug},
+  {HYDROGEN_JITLIBNAME, hydrogenopen_jit},
   {NULL, NULL}
 };
 
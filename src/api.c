@@ -21,6 +21,7 @@
 #include "do.h"
 #include "function.h"
 #include "garbageCollection.h"
+#include "jit.h"
 #include "memory.h"
 #include "object.h"
 #include "state.h"
@@ -313,7 +314,7 @@ HYDROGEN_API int hydrogen_isinteger (hydrogen_State *L, int idx) {
 HYDROGEN_API int hydrogen_isnumber (hydrogen_State *L, int idx) {
   hydrogen_Number n;
   const TValue *o = index2value(L, idx);
-  return tonumber(o, &n);
+  return tonumber(L, o, &n);
 }
 
 
@@ -383,7 +384,7 @@ HYDROGEN_API size_t hydrogen_stringtonumber (hydrogen_State *L, const char *s) {
 HYDROGEN_API hydrogen_Number hydrogen_tonumberx (hydrogen_State *L, int idx, int *pisnum) {
   hydrogen_Number n = 0;
   const TValue *o = index2value(L, idx);
-  int isnum = tonumber(o, &n);
+  int isnum = tonumber(L, o, &n);
   if (pisnum)
     *pisnum = isnum;
   return n;
@@ -393,7 +394,7 @@ HYDROGEN_API hydrogen_Number hydrogen_tonumberx (hydrogen_State *L, int idx, int
 HYDROGEN_API hydrogen_Integer hydrogen_tointegerx (hydrogen_State *L, int idx, int *pisnum) {
   hydrogen_Integer res = 0;
   const TValue *o = index2value(L, idx);
-  int isnum = tointeger(o, &res);
+  int isnum = tointeger(L, o, &res);
   if (pisnum)
     *pisnum = isnum;
   return res;
@@ -406,14 +407,15 @@ HYDROGEN_API int hydrogen_toboolean (hydrogen_State *L, int idx) {
 }
 
 
-HYDROGEN_API const char *hydrogen_tolstring (hydrogen_State *L, int idx, size_t *len) {
-  TValue *o;
-  hydrogen_lock(L);
-  o = index2value(L, idx);
+/*
+** Get the string at 'idx', converting a number in place; return NULL
+** if the value is neither.
+*/
+static TValue *tostringobj (hydrogen_State *L, int idx, size_t *len) {
+  TValue *o = index2value(L, idx);
   if (!ttisstring(o)) {
     if (!cvt2str(o)) {  /* not convertible? */
       if (len != NULL) *len = 0;
-      hydrogen_unlock(L);
       return NULL;
     }
     hydrogenO_tostring(L, o);
@@ -422,8 +424,39 @@ HYDROGEN_API const char *hydrogen_tolstring (hydrogen_State *L, int idx, size_t
   }
   if (len != NULL)
     *len = vslen(o);
+  return o;
+}
+
+
+/*
+** The bytes of a string that is a view may not be followed by a '\0'
+** (see 'isview'). 'hydrogen_tolstring' must return a terminated string,
+** so it replaces such a view at 'idx' by an equal string with a copy of
+** the bytes (which may raise a memory error), as it replaces numbers by
+** strings; the copy lives only while that slot holds it.
+** 'hydrogen_tobytes' returns the bytes as they are, with no final '\0'
+** guaranteed, and never copies them; functions that only need the
+** bytes and their length should prefer it.
+*/
+HYDROGEN_API const char *hydrogen_tolstring (hydrogen_State *L, int idx, size_t *len) {
+  TValue *o;
+  const char *s;
+  hydrogen_lock(L);
+  o = tostringobj(L, idx, len);
+  s = (o != NULL) ? hydrogenS_tocstr(L, o) : NULL;
   hydrogen_unlock(L);
-  return svalue(o);
+  return s;
+}
+
+
+HYDROGEN_API const char *hydrogen_tobytes (hydrogen_State *L, int idx, size_t *len) {
+  TValue *o;
+  const char *s;
+  hydrogen_lock(L);
+  o = tostringobj(L, idx, len);
+  s = (o != NULL) ? svalue(o) : NULL;
+  hydrogen_unlock(L);
+  return s;
 }
 
 
@@ -539,6 +572,27 @@ HYDROGEN_API const char *hydrogen_pushlstring (hydrogen_State *L, const char *s,
 }
 
 
+/*
+** Push the substring of the string at 'idx' with the 'l' bytes from
+** (0-based) position 'i'. The result may share the bytes of the
+** original string (see 'hydrogenS_newsub').
+*/
+HYDROGEN_API void hydrogen_pushsubstring (hydrogen_State *L, int idx, size_t i,
+                                                          size_t l) {
+  const TValue *o;
+  TString *ts;
+  hydrogen_lock(L);
+  o = index2value(L, idx);
+  api_check(L, ttisstring(o), "string expected");
+  api_check(L, i <= vslen(o) && l <= vslen(o) - i, "invalid substring");
+  ts = hydrogenS_newsub(L, tsvalue(o), i, l);
+  setsvalue2s(L, L->top, ts);
+  api_incr_top(L);
+  hydrogenC_checkGC(L);
+  hydrogen_unlock(L);
+}
+
+
 HYDROGEN_API const char *hydrogen_pushstring (hydrogen_State *L, const char *s) {
   hydrogen_lock(L);
   if (s == NULL)
@@ -661,17 +715,18 @@ l_sinline int auxgetstr (hydrogen_State *L, const TValue *t, const char *k) {
 ** Get the global table in the registry. Since all predefined
 ** indices in the registry were inserted right when the registry
 ** was created and never removed, they must always be in the array
-** part of the registry.
+** part of the registry. (The table is copied to 'o', as entries of the
+** array part are not TValues.)
 */
-#define getGtable(L)  \
-	(&hvalue(&G(L)->l_registry)->array[HYDROGEN_RIDX_GLOBALS - 1])
+#define getGtable(L,o)  \
+	arrgetobj(hvalue(&G(L)->l_registry), HYDROGEN_RIDX_GLOBALS - 1, o)
 
 
 HYDROGEN_API int hydrogen_getglobal (hydrogen_State *L, const char *name) {
-  const TValue *G;
+  TValue G;
   hydrogen_lock(L);
-  G = getGtable(L);
-  return auxgetstr(L, G, name);
+  getGtable(L, &G);
+  return auxgetstr(L, &G, name);
 }
 
 
@@ -680,10 +735,7 @@ HYDROGEN_API int hydrogen_gettable (hydrogen_State *L, int idx) {
   TValue *t;
   hydrogen_lock(L);
   t = index2value(L, idx);
-  if (hydrogenV_fastget(L, t, s2v(L->top - 1), slot, hydrogenH_get)) {
-    setobj2s(L, L->top - 1, slot);
-  }
-  else
+  if (!hydrogenV_fastgetv(L, t, s2v(L->top - 1), s2v(L->top - 1), slot))
     hydrogenV_finishget(L, t, s2v(L->top - 1), L->top - 1, slot);
   hydrogen_unlock(L);
   return ttype(s2v(L->top - 1));
@@ -701,10 +753,7 @@ HYDROGEN_API int hydrogen_geti (hydrogen_State *L, int idx, hydrogen_Integer n)
   const TValue *slot;
   hydrogen_lock(L);
   t = index2value(L, idx);
-  if (hydrogenV_fastgeti(L, t, n, slot)) {
-    setobj2s(L, L->top, slot);
-  }
-  else {
+  if (!hydrogenV_fastgeti(L, t, n, s2v(L->top), slot)) {
     TValue aux;
     setivalue(&aux, n);
     hydrogenV_finishget(L, t, &aux, L->top, slot);
@@ -715,11 +764,13 @@ HYDROGEN_API int hydrogen_geti (hydrogen_State *L, int idx, hydrogen_Integer n)
 }
 
 
-l_sinline int finishrawget (hydrogen_State *L, const TValue *val) {
-  if (isempty(val))  /* avoid copying empty items to the stack */
+/*
+** Finish a raw get, whose result is already at the top if it was found
+** (raw gets copy their results; see 'hydrogenH_get').
+*/
+l_sinline int finishrawget (hydrogen_State *L, int found) {
+  if (!found)  /* avoid leaving empty items in the stack */
     setnilvalue(s2v(L->top));
-  else
-    setobj2s(L, L->top, val);
   api_incr_top(L);
   hydrogen_unlock(L);
   return ttype(s2v(L->top - 1));
@@ -735,13 +786,13 @@ static Table *gettable (hydrogen_State *L, int idx) {
 
 HYDROGEN_API int hydrogen_rawget (hydrogen_State *L, int idx) {
   Table *t;
-  const TValue *val;
+  int found;
   hydrogen_lock(L);
   api_checknelems(L, 1);
   t = gettable(L, idx);
-  val = hydrogenH_get(t, s2v(L->top - 1));
-  L->top--;  /* remove key */
-  return finishrawget(L, val);
+  found = hydrogenH_get(t, s2v(L->top - 1), s2v(L->top - 1));
+  L->top--;  /* remove key (or the result that replaced it) */
+  return finishrawget(L, found);
 }
 
 
@@ -749,7 +800,7 @@ HYDROGEN_API int hydrogen_rawgeti (hydrogen_State *L, int idx, hydrogen_Integer
   Table *t;
   hydrogen_lock(L);
   t = gettable(L, idx);
-  return finishrawget(L, hydrogenH_getint(t, n));
+  return finishrawget(L, hydrogenH_getint(t, n, s2v(L->top)));
 }
 
 
@@ -759,7 +810,7 @@ HYDROGEN_API int hydrogen_rawgetp (hydrogen_State *L, int idx, const void *p) {
   hydrogen_lock(L);
   t = gettable(L, idx);
   setpvalue(&k, cast_voidp(p));
-  return finishrawget(L, hydrogenH_get(t, &k));
+  return finishrawget(L, hydrogenH_get(t, &k, s2v(L->top)));
 }
 
 
@@ -849,10 +900,10 @@ static void auxsetstr (hydrogen_State *L, const TValue *t, const char *k) {
 
 
 HYDROGEN_API void hydrogen_setglobal (hydrogen_State *L, const char *name) {
-  const TValue *G;
+  TValue G;
   hydrogen_lock(L);  /* unlock done in 'auxsetstr' */
-  G = getGtable(L);
-  auxsetstr(L, G, name);
+  getGtable(L, &G);
+  auxsetstr(L, &G, name);
 }
 
 
@@ -862,10 +913,7 @@ HYDROGEN_API void hydrogen_settable (hydrogen_State *L, int idx) {
   hydrogen_lock(L);
   api_checknelems(L, 2);
   t = index2value(L, idx);
-  if (hydrogenV_fastget(L, t, s2v(L->top - 2), slot, hydrogenH_get)) {
-    hydrogenV_finishfastset(L, t, slot, s2v(L->top - 1));
-  }
-  else
+  if (!hydrogenV_fastset(L, t, s2v(L->top - 2), s2v(L->top - 1), slot))
     hydrogenV_finishset(L, t, s2v(L->top - 2), s2v(L->top - 1), slot);
   L->top -= 2;  /* pop index and value */
   hydrogen_unlock(L);
@@ -884,10 +932,7 @@ HYDROGEN_API void hydrogen_seti (hydrogen_State *L, int idx, hydrogen_Integer n)
   hydrogen_lock(L);
   api_checknelems(L, 1);
   t = index2value(L, idx);
-  if (hydrogenV_fastgeti(L, t, n, slot)) {
-    hydrogenV_finishfastset(L, t, slot, s2v(L->top - 1));
-  }
-  else {
+  if (!hydrogenV_fastseti(L, t, n, s2v(L->top - 1), slot)) {
     TValue aux;
     setivalue(&aux, n);
     hydrogenV_finishset(L, t, &aux, s2v(L->top - 1), slot);
@@ -1099,10 +1144,11 @@ HYDROGEN_API int hydrogen_load (hydrogen_State *L, hydrogen_Reader reader, void
     LClosure *f = clLvalue(s2v(L->top - 1));  /* get newly created function */
     if (f->nupvalues >= 1) {  /* does it have an upvalue? */
       /* get global table from registry */
-      const TValue *gt = getGtable(L);
+      TValue gt;
+      getGtable(L, &gt);
       /* set global table as 1st upvalue of 'f' (may be HYDROGEN_ENV) */
-      setobj(L, f->upvals[0]->v, gt);
-      hydrogenC_barrier(L, f->upvals[0], gt);
+      setobj(L, f->upvals[0]->v, &gt);
+      hydrogenC_barrier(L, f->upvals[0], &gt);
     }
   }
   hydrogen_unlock(L);
@@ -1164,6 +1210,14 @@ HYDROGEN_API int hydrogen_gc (hydrogen_State *L, int what, ...) {
       res = cast_int(gettotalbytes(g) & 0x3ff);
       break;
     }
+    case HYDROGEN_GCSTRRESIZE: {
+      res = g->strt.nresize;
+      break;
+    }
+    case HYDROGEN_GCSTRSIZE: {
+      res = g->strt.size;
+      break;
+    }
     case HYDROGEN_GCSTEP: {
       int data = va_arg(argp, int);
       l_mem debt = 1;  /* =1 to signal that it did an actual step */
@@ -1232,6 +1286,73 @@ HYDROGEN_API int hydrogen_gc (hydrogen_State *L, int what, ...) {
 }
 
 
+/* counters of the trace compiler saturate at MAX_INT */
+#define jitcounter(c)	((c) < cast(lu_mem, MAX_INT) ? cast_int(c) : MAX_INT)
+
+
+/*
+** JIT-compiler function. Without a JIT compiler in the build, all
+** options are invalid.
+*/
+HYDROGEN_API int hydrogen_jit (hydrogen_State *L, int what, ...) {
+#if defined(HYDROGEN_USE_JIT)
+  va_list argp;
+  int res = 0;
+  global_State *g = G(L);
+  hydrogen_lock(L);
+  va_start(argp, what);
+  switch (what) {
+    case HYDROGEN_JITOFF: {
+      g->jiton = 0;
+      break;
+    }
+    case HYDROGEN_JITON: {
+      g->jiton = 1;
+      break;
+    }
+    case HYDROGEN_JITISON: {
+      res = g->jiton;
+      break;
+    }
+    case HYDROGEN_JITSETTHRESHOLD: {
+      int data = va_arg(argp, int);
+      res = g->jitthreshold;
+      if (data > 0)  /* (otherwise, only query the threshold) */
+        g->jitthreshold = data;
+      break;
+    }
+    case HYDROGEN_JITCOUNT: {
+      res = g->jitcount;
+      break;
+    }
+    case HYDROGEN_JITTRACES: {
+      res = g->jittraces;
+      break;
+    }
+    case HYDROGEN_JITABORTS: {
+      res = jitcounter(g->jitaborts);
+      break;
+    }
+    case HYDROGEN_JITENTRIES: {
+      res = jitcounter(g->jitentries);
+      break;
+    }
+    case HYDROGEN_JITEXITS: {
+      res = jitcounter(g->jitexits);
+      break;
+    }
+    default: res = -1;  /* invalid option */
+  }
+  va_end(argp);
+  hydrogen_unlock(L);
+  return res;
+#else
+  UNUSED(L); UNUSED(what);
+  return -1;
+#endif
+}
+
+
 
 /*
 ** miscellaneous functions
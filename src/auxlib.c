@@ -406,6 +406,17 @@ HYDROGENLIB_API const char *hydrogenL_checklstring (hydrogen_State *L, int arg,
 }
 
 
+/*
+** Like 'hydrogenL_checklstring', but the bytes may not be followed by
+** a '\0' (see 'hydrogen_tobytes').
+*/
+HYDROGENLIB_API const char *hydrogenL_checkbytes (hydrogen_State *L, int arg, size_t *len) {
+  const char *s = hydrogen_tobytes(L, arg, len);
+  if (l_unlikely(!s)) tag_error(L, arg, HYDROGEN_TSTRING);
+  return s;
+}
+
+
 HYDROGENLIB_API const char *hydrogenL_optlstring (hydrogen_State *L, int arg,
                                         const char *def, size_t *len) {
   if (hydrogen_isnoneornil(L, arg)) {
@@ -498,7 +509,8 @@ static const hydrogenL_Reg boxmt[] = {  /* box metamethods */
 };
 
 
-static void newbox (hydrogen_State *L) {
+/* push a new (empty) box */
+HYDROGENLIB_API void hydrogenL_newbox (hydrogen_State *L) {
   UBox *box = (UBox *)hydrogen_newuserdatauv(L, sizeof(UBox), 0);
   box->box = NULL;
   box->bsize = 0;
@@ -556,7 +568,7 @@ static char *prepbuffsize (hydrogenL_Buffer *B, size_t sz, int boxidx) {
       newbuff = (char *)resizebox(L, boxidx, newsize);  /* resize it */
     else {  /* no box yet */
       hydrogen_remove(L, boxidx);  /* remove placeholder */
-      newbox(L);  /* create a new box */
+      hydrogenL_newbox(L);  /* create a new box */
       hydrogen_insert(L, boxidx);  /* move box to its intended position */
       hydrogen_toclose(L, boxidx);
       newbuff = (char *)resizebox(L, boxidx, newsize);
@@ -618,7 +630,7 @@ HYDROGENLIB_API void hydrogenL_pushresultsize (hydrogenL_Buffer *B, size_t sz) {
 HYDROGENLIB_API void hydrogenL_addvalue (hydrogenL_Buffer *B) {
   hydrogen_State *L = B->L;
   size_t len;
-  const char *s = hydrogen_tolstring(L, -1, &len);
+  const char *s = hydrogen_tobytes(L, -1, &len);
   char *b = prepbuffsize(B, len, -2);
   memcpy(b, s, len * sizeof(char));
   hydrogenL_addsize(B, len);
@@ -640,6 +652,44 @@ HYDROGENLIB_API char *hydrogenL_buffinitsize (hydrogen_State *L, hydrogenL_Buffe
   return prepbuffsize(B, sz, -1);
 }
 
+
+/*
+** Initialize a buffer over the box on the top of the stack, whose first
+** 'n' bytes are in use. The box outlives the buffer, so the buffer must
+** not be finished with 'hydrogenL_pushresult'; it is done when the box
+** leaves the top of the stack.
+*/
+HYDROGENLIB_API void hydrogenL_buffinitbox (hydrogen_State *L, hydrogenL_Buffer *B,
+                                       size_t n) {
+  UBox *box = (UBox *)hydrogen_touserdata(L, -1);
+  hydrogen_assert(box != NULL && n <= box->bsize);
+  B->L = L;
+  B->b = (char *)box->box;  /* (not 'B->init.b', even if NULL) */
+  B->n = n;
+  B->size = box->bsize;
+}
+
+
+/*
+** If the value at 'idx' is a string buffer, return its contents (and
+** their length in '*len'); otherwise return NULL. The contents stay
+** valid until the buffer is changed.
+*/
+HYDROGENLIB_API const char *hydrogenL_tostrbuf (hydrogen_State *L, int idx,
+                                           size_t *len) {
+  hydrogenL_StrBuf *sb;
+  const UBox *box;
+  sb = (hydrogenL_StrBuf *)hydrogenL_testudata(L, idx, HYDROGEN_STRBUFHANDLE);
+  if (sb == NULL)
+    return NULL;
+  hydrogen_getiuservalue(L, idx, 1);
+  box = (const UBox *)hydrogen_touserdata(L, -1);
+  hydrogen_pop(L, 1);  /* (box is kept by the buffer) */
+  if (len != NULL)
+    *len = sb->n - sb->off;
+  return (box->box == NULL) ? "" : (const char *)box->box + sb->off;
+}
+
 /* }====================================================== */
 
 
@@ -880,7 +930,10 @@ HYDROGENLIB_API hydrogen_Integer hydrogenL_len (hydrogen_State *L, int idx) {
 }
 
 
-HYDROGENLIB_API const char *hydrogenL_tolstring (hydrogen_State *L, int idx, size_t *len) {
+/*
+** Push the string form of the value at 'idx', as 'tostring' gives it.
+*/
+static void pushtostring (hydrogen_State *L, int idx) {
   idx = hydrogen_absindex(L,idx);
   if (hydrogenL_callmeta(L, idx, "__tostring")) {  /* metafield? */
     if (!hydrogen_isstring(L, -1))
@@ -915,10 +968,25 @@ HYDROGENLIB_API const char *hydrogenL_tolstring (hydrogen_State *L, int idx, siz
       }
     }
   }
+}
+
+
+HYDROGENLIB_API const char *hydrogenL_tolstring (hydrogen_State *L, int idx, size_t *len) {
+  pushtostring(L, idx);
   return hydrogen_tolstring(L, -1, len);
 }
 
 
+/*
+** Like 'hydrogenL_tolstring', but the bytes may not be followed by a
+** '\0' (see 'hydrogen_tobytes').
+*/
+HYDROGENLIB_API const char *hydrogenL_tobytes (hydrogen_State *L, int idx, size_t *len) {
+  pushtostring(L, idx);
+  return hydrogen_tobytes(L, -1, len);
+}
+
+
 /*
 ** set functions from list 'l' into table at top - 'nup'; each
 ** function gets the 'nup' elements at the top as upvalues.
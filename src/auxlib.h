@@ -35,6 +35,13 @@ typedef struct hydrogenL_Buffer hydrogenL_Buffer;
 #define HYDROGEN_PRELOAD_TABLE	"_PRELOAD"
 
 
+/* key, in the registry, for function that flushes the string pattern cache */
+#define HYDROGEN_PATCACHE_KEY	"_PATCACHE"
+
+/* key, in the registry, for function that flushes the regex cache */
+#define HYDROGEN_RXCACHE_KEY	"_RXCACHE"
+
+
 typedef struct hydrogenL_Reg {
   const char *name;
   hydrogen_CFunction func;
@@ -50,12 +57,15 @@ HYDROGENLIB_API void (hydrogenL_checkversion_) (hydrogen_State *L, hydrogen_Numb
 HYDROGENLIB_API int (hydrogenL_getmetafield) (hydrogen_State *L, int obj, const char *e);
 HYDROGENLIB_API int (hydrogenL_callmeta) (hydrogen_State *L, int obj, const char *e);
 HYDROGENLIB_API const char *(hydrogenL_tolstring) (hydrogen_State *L, int idx, size_t *len);
+HYDROGENLIB_API const char *(hydrogenL_tobytes) (hydrogen_State *L, int idx, size_t *len);
 HYDROGENLIB_API int (hydrogenL_argerror) (hydrogen_State *L, int arg, const char *extramsg);
 HYDROGENLIB_API int (hydrogenL_typeerror) (hydrogen_State *L, int arg, const char *tname);
 HYDROGENLIB_API const char *(hydrogenL_checklstring) (hydrogen_State *L, int arg,
                                                           size_t *l);
 HYDROGENLIB_API const char *(hydrogenL_optlstring) (hydrogen_State *L, int arg,
                                           const char *def, size_t *l);
+HYDROGENLIB_API const char *(hydrogenL_checkbytes) (hydrogen_State *L, int arg,
+                                                          size_t *l);
 HYDROGENLIB_API hydrogen_Number (hydrogenL_checknumber) (hydrogen_State *L, int arg);
 HYDROGENLIB_API hydrogen_Number (hydrogenL_optnumber) (hydrogen_State *L, int arg, hydrogen_Number def);
 
@@ -220,6 +230,9 @@ HYDROGENLIB_API void (hydrogenL_addvalue) (hydrogenL_Buffer *B);
 HYDROGENLIB_API void (hydrogenL_pushresult) (hydrogenL_Buffer *B);
 HYDROGENLIB_API void (hydrogenL_pushresultsize) (hydrogenL_Buffer *B, size_t sz);
 HYDROGENLIB_API char *(hydrogenL_buffinitsize) (hydrogen_State *L, hydrogenL_Buffer *B, size_t sz);
+HYDROGENLIB_API void (hydrogenL_newbox) (hydrogen_State *L);
+HYDROGENLIB_API void (hydrogenL_buffinitbox) (hydrogen_State *L, hydrogenL_Buffer *B,
+                                         size_t n);
 
 #define hydrogenL_prepbuffer(B)	hydrogenL_prepbuffsize(B, HYDROGENL_BUFFERSIZE)
 
@@ -227,6 +240,34 @@ HYDROGENLIB_API char *(hydrogenL_buffinitsize) (hydrogen_State *L, hydrogenL_Buf
 
 
 
+/*
+** {======================================================
+** String buffers ('string.buffer')
+** =======================================================
+*/
+
+/*
+** A string buffer is a userdata with metatable 'HYDROGEN_STRBUFHANDLE'
+** and structure 'hydrogenL_StrBuf'. Its first user value is a box (see
+** 'hydrogenL_newbox') whose bytes from 'off' to 'n' are its contents.
+*/
+
+#define HYDROGEN_STRBUFHANDLE        "STRBUF*"
+
+
+typedef struct hydrogenL_StrBuf {
+  size_t n;  /* end of the contents in the box */
+  size_t off;  /* start of the contents (bytes before it were read) */
+} hydrogenL_StrBuf;
+
+
+HYDROGENLIB_API const char *(hydrogenL_tostrbuf) (hydrogen_State *L, int idx,
+                                             size_t *len);
+
+/* }====================================================== */
+
+
+
 /*
 ** {======================================================
 ** File handles for IO library
@@ -25,7 +25,7 @@ static int hydrogenB_print (hydrogen_State *L) {
   int i;
   for (i = 1; i <= n; i++) {  /* for each argument */
     size_t l;
-    const char *s = hydrogenL_tolstring(L, i, &l);  /* convert it to string */
+    const char *s = hydrogenL_tobytes(L, i, &l);  /* convert it to string */
     if (i > 1)  /* not the first element? */
       hydrogen_writestring("\t", 1);  /* add a tab before it */
     hydrogen_writestring(s, l);  /* print it */
@@ -198,10 +198,10 @@ static int pushmode (hydrogen_State *L, int oldmode) {
 static int hydrogenB_collectgarbage (hydrogen_State *L) {
   static const char *const opts[] = {"stop", "restart", "collect",
     "count", "step", "setpause", "setstepmul",
-    "isrunning", "generational", "incremental", NULL};
+    "isrunning", "generational", "incremental", "strtab", NULL};
   static const int optsnum[] = {HYDROGEN_GCSTOP, HYDROGEN_GCRESTART, HYDROGEN_GCCOLLECT,
     HYDROGEN_GCCOUNT, HYDROGEN_GCSTEP, HYDROGEN_GCSETPAUSE, HYDROGEN_GCSETSTEPMUL,
-    HYDROGEN_GCISRUNNING, HYDROGEN_GCGEN, HYDROGEN_GCINC};
+    HYDROGEN_GCISRUNNING, HYDROGEN_GCGEN, HYDROGEN_GCINC, HYDROGEN_GCSTRRESIZE};
   int o = optsnum[hydrogenL_checkoption(L, 1, "collect", opts)];
   switch (o) {
     case HYDROGEN_GCCOUNT: {
@@ -211,6 +211,14 @@ static int hydrogenB_collectgarbage (hydrogen_State *L) {
       hydrogen_pushnumber(L, (hydrogen_Number)k + ((hydrogen_Number)b/1024));
       return 1;
     }
+    case HYDROGEN_GCSTRRESIZE: {  /* resizes and size of string table */
+      int n = hydrogen_gc(L, o);
+      int size = hydrogen_gc(L, HYDROGEN_GCSTRSIZE);
+      checkvalres(n);
+      hydrogen_pushinteger(L, n);
+      hydrogen_pushinteger(L, size);
+      return 2;
+    }
     case HYDROGEN_GCSTEP: {
       int step = (int)hydrogenL_optinteger(L, 2, 0);
       int res = hydrogen_gc(L, o, step);
@@ -497,7 +505,7 @@ static int hydrogenB_xpcall (hydrogen_State *L) {
 
 static int hydrogenB_tostring (hydrogen_State *L) {
   hydrogenL_checkany(L, 1);
-  hydrogenL_tolstring(L, 1, NULL);
+  hydrogenL_tobytes(L, 1, NULL);
   return 1;
 }
 
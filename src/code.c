@@ -20,6 +20,7 @@
 #include "code.h"
 #include "debug.h"
 #include "do.h"
+#include "function.h"
 #include "garbageCollection.h"
 #include "lexer.h"
 #include "memory.h"
@@ -541,13 +542,13 @@ static void freeexps (FuncState *fs, expdesc *e1, expdesc *e2) {
 ** a function can make some indices wrong.
 */
 static int addk (FuncState *fs, TValue *key, TValue *v) {
-  TValue val;
+  TValue val, idx;
   hydrogen_State *L = fs->ls->L;
   Proto *f = fs->f;
-  const TValue *idx = hydrogenH_get(fs->ls->h, key);  /* query scanner table */
   int k, oldsize;
-  if (ttisinteger(idx)) {  /* is there an index there? */
-    k = cast_int(ivalue(idx));
+  if (hydrogenH_get(fs->ls->h, key, &idx) &&  /* query scanner table */
+      ttisinteger(&idx)) {  /* is there an index there? */
+    k = cast_int(ivalue(&idx));
     /* correct value? (warning: must distinguish floats from integers!) */
     if (k < fs->nk && ttypetag(&f->k[k]) == ttypetag(v) &&
                       hydrogenV_rawequalobj(&f->k[k], v))
@@ -559,7 +560,7 @@ static int addk (FuncState *fs, TValue *key, TValue *v) {
   /* numerical value does not need GC barrier;
      table has no metatable, so it does not need to invalidate cache */
   setivalue(&val, k);
-  hydrogenH_finishset(L, fs->ls->h, key, idx, &val);
+  hydrogenH_set(L, fs->ls->h, key, &val);
   hydrogenM_growvector(L, f->k, k, f->sizek, TValue, MAXARG_Ax, "constants");
   while (oldsize < f->sizek) setnilvalue(&f->k[oldsize++]);
   setobj(L, &f->k[k], v);
@@ -1804,6 +1805,7 @@ static int finaltarget (Instruction *code, int i) {
 void hydrogenK_finish (FuncState *fs) {
   int i;
   Proto *p = fs->f;
+  hydrogenF_fusecode(p->code, fs->pc);
   for (i = 0; i < fs->pc; i++) {
     Instruction *pc = &p->code[i];
     hydrogen_assert(i == 0 || isOT(*(pc - 1)) == isIT(*pc));
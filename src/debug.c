@@ -21,6 +21,7 @@
 #include "debug.h"
 #include "do.h"
 #include "function.h"
+#include "jit.h"
 #include "object.h"
 #include "opcodes.h"
 #include "state.h"
@@ -470,7 +471,7 @@ static int findsetreg (const Proto *p, int lastpc, int reg) {
     lastpc--;  /* previous instruction was not actually executed */
   for (pc = 0; pc < lastpc; pc++) {
     Instruction i = p->code[pc];
-    OpCode op = GET_OPCODE(i);
+    OpCode op = GET_GENERICOP(i);
     int a = GETARG_A(i);
     int change;  /* true if current instruction changed 'reg' */
     switch (op) {
@@ -533,7 +534,7 @@ static const char *getobjname (const Proto *p, int lastpc, int reg,
   pc = findsetreg(p, lastpc, reg);
   if (pc != -1) {  /* could find instruction? */
     Instruction i = p->code[pc];
-    OpCode op = GET_OPCODE(i);
+    OpCode op = GET_GENERICOP(i);
     switch (op) {
       case OP_MOVE: {
         int b = GETARG_B(i);  /* move from 'b' to 'a' */
@@ -595,7 +596,7 @@ static const char *funcnamefromcode (hydrogen_State *L, const Proto *p,
                                      int pc, const char **name) {
   TMS tm = (TMS)0;  /* (initial value avoids warnings) */
   Instruction i = p->code[pc];  /* calling instruction */
-  switch (GET_OPCODE(i)) {
+  switch (GET_GENERICOP(i)) {
     case OP_CALL:
     case OP_TAILCALL:
       return getobjname(p, pc, GETARG_A(i), name);  /* get function name */
@@ -876,6 +877,10 @@ int hydrogenG_traceexec (hydrogen_State *L, const Instruction *pc) {
   lu_byte mask = L->hookmask;
   const Proto *p = ci_func(ci)->p;
   int counthook;
+#if defined(HYDROGEN_USE_JIT)
+  if (G(L)->jitrec != NULL && hydrogenJ_record(L, pc))
+    return 1;  /* recording a trace; keep 'trap' on */
+#endif
   if (!(mask & (HYDROGEN_MASKLINE | HYDROGEN_MASKCOUNT))) {  /* no hooks? */
     ci->u.l.trap = 0;  /* don't need to stop again */
     return 0;  /* turn off 'trap' */
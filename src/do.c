@@ -192,7 +192,7 @@ int hydrogenD_reallocstack (hydrogen_State *L, int newsize, int raiseerror) {
   int oldsize = stacksize(L);
   int i;
   StkId newstack = hydrogenM_reallocvector(L, NULL, 0,
-                                      newsize + EXTRA_STACK, StackValue);
+                               stackalloc(newsize + EXTRA_STACK), StackValue);
   hydrogen_assert(newsize <= HYDROGENI_MAXSTACK || newsize == ERRORSTACKSIZE);
   if (l_unlikely(newstack == NULL)) {  /* reallocation failed? */
     if (raiseerror)
@@ -202,10 +202,14 @@ int hydrogenD_reallocstack (hydrogen_State *L, int newsize, int raiseerror) {
   /* number of elements to be copied to the new stack */
   i = ((oldsize <= newsize) ? oldsize : newsize) + EXTRA_STACK;
   memcpy(newstack, L->stack, i * sizeof(StackValue));
+#if defined(HYDROGEN_NANBOXING)
+  memcpy(newstack + newsize + EXTRA_STACK, tbcdeltas(L),
+         i * sizeof(unsigned short));
+#endif
   for (; i < newsize + EXTRA_STACK; i++)
     setnilvalue(s2v(newstack + i)); /* erase new segment */
   correctstack(L, L->stack, newstack);
-  hydrogenM_freearray(L, L->stack, oldsize + EXTRA_STACK);
+  hydrogenM_freearray(L, L->stack, stackalloc(oldsize + EXTRA_STACK));
   L->stack = newstack;
   L->stack_last = L->stack + newsize;
   return 1;
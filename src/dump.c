@@ -15,6 +15,7 @@
 #include "hydrogen.h"
 
 #include "object.h"
+#include "opcodes.h"
 #include "state.h"
 #include "undump.h"
 
@@ -97,9 +98,26 @@ static void dumpString (DumpState *D, const TString *s) {
 }
 
 
+/*
+** Code is dumped in blocks of at most CODEBUFF instructions, with
+** fused and quickened opcodes turned back into their generic forms, so
+** that dumps keep the standard format ('undump' fuses the code again).
+*/
+#define CODEBUFF	64
+
 static void dumpCode (DumpState *D, const Proto *f) {
+  Instruction buff[CODEBUFF];
+  int pc = 0;
   dumpInt(D, f->sizecode);
-  dumpVector(D, f->code, f->sizecode);
+  while (pc < f->sizecode) {
+    int n = 0;
+    while (n < CODEBUFF && pc < f->sizecode) {
+      Instruction i = f->code[pc++];
+      SET_OPCODE(i, GET_GENERICOP(i));
+      buff[n++] = i;
+    }
+    dumpVector(D, buff, n);
+  }
 }
 
 
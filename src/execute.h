@@ -0,0 +1,325 @@
+/*
+** $Id: execute.h $
+** Macros shared by 'hydrogenV_execute' and by the code that
+** 'hydrogenc -C' compiles ahead of time (see 'aot.h')
+** See Copyright Notice in hydrogen.h
+*/
+
+#ifndef execute_h
+#define execute_h
+
+#include "debug.h"
+#include "garbageCollection.h"
+#include "object.h"
+#include "opcodes.h"
+#include "state.h"
+#include "table.h"
+#include "tagMethods.h"
+#include "virtualMachine.h"
+
+
+/*
+** These macros run in the scope of an interpreter loop, which must
+** have the following local variables: 'L', 'ci', 'cl' (the running
+** closure), 'k' (its constants), 'base', 'pc' (already pointing to the
+** next instruction), 'i' (the current instruction), 'ra' (its A
+** register), and 'trap'.
+*/
+
+
+/*
+** {==================================================================
+** Common tasks
+** ===================================================================
+*/
+
+#define RA(i)	(base+GETARG_A(i))
+#define RB(i)	(base+GETARG_B(i))
+#define vRB(i)	s2v(RB(i))
+#define KB(i)	(k+GETARG_B(i))
+#define RC(i)	(base+GETARG_C(i))
+#define vRC(i)	s2v(RC(i))
+#define KC(i)	(k+GETARG_C(i))
+#define RKC(i)	((TESTARG_k(i)) ? k + GETARG_C(i) : s2v(base + GETARG_C(i)))
+
+/* inline cache of the current instruction */
+#define IC(pc)	(cl->p->icache + pcRel(pc, cl->p))
+
+
+#define updatetrap(ci)  (trap = ci->u.l.trap)
+
+#define updatebase(ci)	(base = ci->func + 1)
+
+
+#define updatestack(ci)  \
+	{ if (l_unlikely(trap)) { updatebase(ci); ra = RA(i); } }
+
+
+/*
+** Execute a jump instruction. The 'updatetrap' allows signals to stop
+** tight loops. (Without it, the local copy of 'trap' could never change.)
+*/
+#define dojump(ci,i,e)	{ pc += GETARG_sJ(i) + e; updatetrap(ci); }
+
+
+/* for test instructions, execute the jump instruction that follows it */
+#define donextjump(ci)	{ Instruction ni = *pc; dojump(ci, ni, 1); }
+
+/*
+** do a conditional jump: skip next instruction if 'cond' is not what
+** was expected (parameter 'k'), else do next instruction, which must
+** be a jump.
+*/
+#define docondjump()	if (cond != GETARG_k(i)) pc++; else donextjump(ci);
+
+
+/*
+** Correct global 'pc'.
+*/
+#define savepc(L)	(ci->u.l.savedpc = pc)
+
+
+/*
+** Whenever code can raise errors, the global 'pc' and the global
+** 'top' must be correct to report occasional errors.
+*/
+#define savestate(L,ci)		(savepc(L), L->top = ci->top)
+
+
+/*
+** Protect code that, in general, can raise errors, reallocate the
+** stack, and change the hooks.
+*/
+#define Protect(exp)  (savestate(L,ci), (exp), updatetrap(ci))
+
+/* special version that does not change the top */
+#define ProtectNT(exp)  (savepc(L), (exp), updatetrap(ci))
+
+/*
+** Protect code that can only raise errors. (That is, it cannot change
+** the stack or hooks.)
+*/
+#define halfProtect(exp)  (savestate(L,ci), (exp))
+
+/* 'c' is the limit of live values in the stack */
+#define checkGC(L,c)  \
+	{ hydrogenC_condGC(L, (savepc(L), L->top = (c)), \
+                         updatetrap(ci)); \
+           hydrogeni_threadyield(L); }
+
+/* }================================================================== */
+
+
+/*
+** {==================================================================
+** Arithmetic/bitwise/comparison opcodes
+** ===================================================================
+*/
+
+#define l_addi(L,a,b)	intop(+, a, b)
+#define l_subi(L,a,b)	intop(-, a, b)
+#define l_muli(L,a,b)	intop(*, a, b)
+#define l_band(a,b)	intop(&, a, b)
+#define l_bor(a,b)	intop(|, a, b)
+#define l_bxor(a,b)	intop(^, a, b)
+
+#define l_lti(a,b)	(a < b)
+#define l_lei(a,b)	(a <= b)
+#define l_gti(a,b)	(a > b)
+#define l_gei(a,b)	(a >= b)
+
+
+/*
+** Arithmetic operations with immediate operands. 'iop' is the integer
+** operation, 'fop' is the float operation.
+*/
+#define op_arithI(L,iop,fop) {  \
+  TValue *v1 = vRB(i);  \
+  int imm = GETARG_sC(i);  \
+  if (ttisinteger(v1)) {  \
+    hydrogen_Integer iv1 = ivalue(v1);  \
+    pc++; setivalue(s2v(ra), iop(L, iv1, imm));  \
+  }  \
+  else if (ttisfloat(v1)) {  \
+    hydrogen_Number nb = fltvalue(v1);  \
+    hydrogen_Number fimm = cast_num(imm);  \
+    pc++; setfltvalue(s2v(ra), fop(L, nb, fimm)); \
+  }}
+
+
+/*
+** Auxiliary function for arithmetic operations over floats and others
+** with two register operands.
+*/
+#define op_arithf_aux(L,v1,v2,fop) {  \
+  hydrogen_Number n1; hydrogen_Number n2;  \
+  if (tonumberns(v1, n1) && tonumberns(v2, n2)) {  \
+    pc++; setfltvalue(s2v(ra), fop(L, n1, n2));  \
+  }}
+
+
+/*
+** Arithmetic operations over floats and others with register operands.
+*/
+#define op_arithf(L,fop) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = vRC(i);  \
+  op_arithf_aux(L, v1, v2, fop); }
+
+
+/*
+** Arithmetic operations with K operands for floats.
+*/
+#define op_arithfK(L,fop) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = KC(i); hydrogen_assert(ttisnumber(v2));  \
+  op_arithf_aux(L, v1, v2, fop); }
+
+
+/*
+** Arithmetic operations over integers and floats.
+*/
+#define op_arith_aux(L,v1,v2,iop,fop) {  \
+  if (ttisinteger(v1) && ttisinteger(v2)) {  \
+    hydrogen_Integer i1 = ivalue(v1); hydrogen_Integer i2 = ivalue(v2);  \
+    pc++; setivalue(s2v(ra), iop(L, i1, i2));  \
+  }  \
+  else op_arithf_aux(L, v1, v2, fop); }
+
+
+/*
+** Arithmetic operations with register operands.
+*/
+#define op_arith(L,iop,fop) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = vRC(i);  \
+  op_arith_aux(L, v1, v2, iop, fop); }
+
+
+/*
+** Arithmetic operations with K operands.
+*/
+#define op_arithK(L,iop,fop) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = KC(i); hydrogen_assert(ttisnumber(v2));  \
+  op_arith_aux(L, v1, v2, iop, fop); }
+
+
+/*
+** Bitwise operations with constant operand.
+*/
+#define op_bitwiseK(L,op) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = KC(i);  \
+  hydrogen_Integer i1;  \
+  hydrogen_Integer i2 = ivalue(v2);  \
+  if (tointegerns(v1, &i1)) {  \
+    pc++; setivalue(s2v(ra), op(i1, i2));  \
+  }}
+
+
+/*
+** Bitwise operations with register operands.
+*/
+#define op_bitwise(L,op) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = vRC(i);  \
+  hydrogen_Integer i1; hydrogen_Integer i2;  \
+  if (tointegerns(v1, &i1) && tointegerns(v2, &i2)) {  \
+    pc++; setivalue(s2v(ra), op(i1, i2));  \
+  }}
+
+
+/*
+** Order operations with register operands. 'opn' actually works
+** for all numbers, but the fast track improves performance for
+** integers.
+*/
+#define op_order(L,opi,opn,other) {  \
+        int cond;  \
+        TValue *rb = vRB(i);  \
+        if (ttisinteger(s2v(ra)) && ttisinteger(rb)) {  \
+          hydrogen_Integer ia = ivalue(s2v(ra));  \
+          hydrogen_Integer ib = ivalue(rb);  \
+          cond = opi(ia, ib);  \
+        }  \
+        else if (ttisnumber(s2v(ra)) && ttisnumber(rb))  \
+          cond = opn(s2v(ra), rb);  \
+        else  \
+          Protect(cond = other(L, s2v(ra), rb));  \
+        docondjump(); }
+
+
+/*
+** Order operations with immediate operand. (Immediate operand is
+** always small enough to have an exact representation as a float.)
+*/
+#define op_orderI(L,opi,opf,inv,tm) {  \
+        int cond;  \
+        int im = GETARG_sB(i);  \
+        if (ttisinteger(s2v(ra)))  \
+          cond = opi(ivalue(s2v(ra)), im);  \
+        else if (ttisfloat(s2v(ra))) {  \
+          hydrogen_Number fa = fltvalue(s2v(ra));  \
+          hydrogen_Number fim = cast_num(im);  \
+          cond = opf(fa, fim);  \
+        }  \
+        else {  \
+          int isf = GETARG_C(i);  \
+          Protect(cond = hydrogenT_callorderiTM(L, s2v(ra), im, inv, isf, tm));  \
+        }  \
+        docondjump(); }
+
+/* }================================================================== */
+
+
+/*
+** Bodies of the instructions that look up a constant key through the
+** inline cache of the instruction.
+*/
+#define op_gettabup() {  \
+  const TValue *slot;  \
+  TValue *upval = cl->upvals[GETARG_B(i)]->v;  \
+  TValue *rc = KC(i);  \
+  TString *key = tsvalue(rc);  /* key must be a string */  \
+  ICache *ic = IC(pc);  \
+  if (hydrogenV_fastgetcached(L, upval, key, slot, &ic->field.slot)) {  \
+    setobj2s(L, ra, slot);  \
+  }  \
+  else  \
+    Protect(hydrogenV_finishgetcached(L, upval, rc, ra, slot, &ic->field.islot)); }
+
+#define op_getfield() {  \
+  const TValue *slot;  \
+  TValue *rb = vRB(i);  \
+  TValue *rc = KC(i);  \
+  TString *key = tsvalue(rc);  /* key must be a string */  \
+  ICache *ic = IC(pc);  \
+  if (hydrogenV_fastgetcached(L, rb, key, slot, &ic->field.slot)) {  \
+    setobj2s(L, ra, slot);  \
+  }  \
+  else  \
+    Protect(hydrogenV_finishgetcached(L, rb, rc, ra, slot, &ic->field.islot)); }
+
+#define op_self() {  \
+  const TValue *slot;  \
+  TValue *rb = vRB(i);  \
+  TValue *rc = RKC(i);  \
+  TString *key = tsvalue(rc);  /* key must be a string */  \
+  setobj2s(L, ra + 1, rb);  \
+  if (l_likely(key->tt == HYDROGEN_VSHRSTR)) {  /* usual case */  \
+    ICache *ic = IC(pc);  \
+    if (hydrogenV_fastgetcached(L, rb, key, slot, &ic->field.slot)) {  \
+      setobj2s(L, ra, slot);  \
+    }  \
+    else  \
+      Protect(hydrogenV_finishgetcached(L, rb, rc, ra, slot, &ic->field.islot));  \
+  }  \
+  else if (hydrogenV_fastget(L, rb, key, slot, hydrogenH_getstr)) {  \
+    setobj2s(L, ra, slot);  \
+  }  \
+  else  \
+    Protect(hydrogenV_finishget(L, rb, rc, ra, slot)); }
+
+
+#endif
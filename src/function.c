@@ -14,12 +14,15 @@
 
 #include "hydrogen.h"
 
+#include "aot.h"
 #include "debug.h"
 #include "do.h"
 #include "function.h"
 #include "garbageCollection.h"
+#include "jit.h"
 #include "memory.h"
 #include "object.h"
+#include "opcodes.h"
 #include "state.h"
 
 
@@ -160,7 +163,7 @@ static void prepcallclosemth (hydrogen_State *L, StkId level, int status, int yy
 ** is used.)
 */
 #define MAXDELTA  \
-	((256ul << ((sizeof(L->stack->tbclist.delta) - 1) * 8)) - 1)
+	((256ul << ((sizeof(tbcdelta(L, L->stack)) - 1) * 8)) - 1)
 
 
 /*
@@ -173,9 +176,9 @@ void hydrogenF_newtbhydrogenval (hydrogen_State *L, StkId level) {
   checkclosemth(L, level);  /* value must have a close method */
   while (cast_uint(level - L->tbclist) > MAXDELTA) {
     L->tbclist += MAXDELTA;  /* create a dummy node at maximum delta */
-    L->tbclist->tbclist.delta = 0;
+    tbcdelta(L, L->tbclist) = 0;
   }
-  level->tbclist.delta = cast(unsigned short, level - L->tbclist);
+  tbcdelta(L, level) = cast(unsigned short, level - L->tbclist);
   L->tbclist = level;
 }
 
@@ -213,9 +216,9 @@ void hydrogenF_closeupval (hydrogen_State *L, StkId level) {
 */
 static void poptbclist (hydrogen_State *L) {
   StkId tbc = L->tbclist;
-  hydrogen_assert(tbc->tbclist.delta > 0);  /* first element cannot be dummy */
-  tbc -= tbc->tbclist.delta;
-  while (tbc > L->stack && tbc->tbclist.delta == 0)
+  hydrogen_assert(tbcdelta(L, tbc) > 0);  /* first element cannot be dummy */
+  tbc -= tbcdelta(L, tbc);
+  while (tbc > L->stack && tbcdelta(L, tbc) == 0)
     tbc -= MAXDELTA;  /* remove dummy nodes */
   L->tbclist = tbc;
 }
@@ -246,6 +249,8 @@ Proto *hydrogenF_newproto (hydrogen_State *L) {
   f->sizep = 0;
   f->code = NULL;
   f->sizecode = 0;
+  f->icache = NULL;
+  f->dcode = NULL;
   f->lineinfo = NULL;
   f->sizelineinfo = 0;
   f->abslineinfo = NULL;
@@ -260,11 +265,108 @@ Proto *hydrogenF_newproto (hydrogen_State *L) {
   f->linedefined = 0;
   f->lastlinedefined = 0;
   f->source = NULL;
+#if defined(HYDROGEN_USE_JIT)
+  f->hotcount = 0;
+  f->jit = NULL;
+  f->trace = NULL;
+#endif
+#if defined(HYDROGEN_USE_AOT)
+  f->aot = NULL;
+#endif
   return f;
 }
 
 
+/*
+** Create the inline caches for a prototype whose code is complete.
+** All hints start at node 0; a wrong hint only costs a normal lookup.
+*/
+void hydrogenF_newicache (hydrogen_State *L, Proto *f) {
+  int i;
+  hydrogen_assert(f->icache == NULL);
+  f->icache = hydrogenM_newvector(L, f->sizecode, ICache);
+  for (i = 0; i < f->sizecode; i++)
+    f->icache[i].field.slot = f->icache[i].field.islot = 0;
+}
+
+
+/*
+** Peephole pass over complete code: fuse an instruction with the OP_CALL
+** that follows it when the call uses the value the instruction has just
+** produced (see the notes about fused opcodes in 'opcodes.h'). Run for
+** new functions and again for loaded ones, as dumps carry no fused
+** opcodes.
+*/
+void hydrogenF_fusecode (Instruction *code, int n) {
+  int i;
+  for (i = 0; i + 1 < n; i++) {
+    Instruction next = code[i + 1];
+    OpCode fused;
+    if (GET_OPCODE(next) != OP_CALL || GETARG_B(next) == 0 ||
+        GETARG_A(next) != GETARG_A(code[i]))
+      continue;  /* not a call of the value built here */
+    switch (GET_OPCODE(code[i])) {
+      case OP_GETTABUP: fused = OP_GETTABUP_CALL; break;
+      case OP_GETFIELD: fused = OP_GETFIELD_CALL; break;
+      case OP_SELF: fused = OP_SELF_CALL; break;
+      default: continue;
+    }
+    SET_OPCODE(code[i], fused);
+    i++;  /* the call cannot start another fusion */
+  }
+}
+
+
+#if defined(HYDROGEN_USE_AOT)
+
+/*
+** Give the compiled functions in 'f' to 'p' and to the functions nested
+** in it, in the order used by 'hydrogenc -C': each function comes before
+** the functions nested in it. Returns the number of functions used (-1
+** if 'f' does not have enough of them).
+*/
+static int installaot (Proto *p, const AOTFunction *f, int n) {
+  int used = 1;
+  int i;
+  if (n < 1)
+    return -1;
+  p->aot = f[0];
+  for (i = 0; i < p->sizep; i++) {
+    int u = installaot(p->p[i], f + used, n - used);
+    if (u < 0)
+      return -1;
+    used += u;
+  }
+  return used;
+}
+
+
+/*
+** Install the 'n' compiled functions in 'f' in the Hydrogen function on
+** the top of the stack, which must be the chunk they were compiled from.
+** 'signature' is the value of AOT_SIGNATURE in the compiled module.
+*/
+void hydrogenF_installaot (hydrogen_State *L, const AOTFunction *f, int n,
+                                              unsigned int signature) {
+  const TValue *o = s2v(L->top - 1);
+  if (signature != AOT_SIGNATURE)
+    hydrogenG_runerror(L, "compiled module does not match the "
+                          "configuration of this Hydrogen");
+  if (!ttisLclosure(o) || installaot(clLvalue(o)->p, f, n) != n)
+    hydrogenG_runerror(L, "compiled module does not match its bytecode");
+}
+
+#endif
+
+
 void hydrogenF_freeproto (hydrogen_State *L, Proto *f) {
+#if defined(HYDROGEN_USE_JIT)
+  hydrogenJ_free(L, f);  /* native code and traces */
+#endif
+  if (f->icache != NULL)  /* prototype may be incomplete (e.g., errors) */
+    hydrogenM_freearray(L, f->icache, f->sizecode);
+  if (f->dcode != NULL)  /* prototype has run? */
+    hydrogenM_freearray(L, f->dcode, f->sizecode);
   hydrogenM_freearray(L, f->code, f->sizecode);
   hydrogenM_freearray(L, f->p, f->sizep);
   hydrogenM_freearray(L, f->k, f->sizek);
@@ -56,9 +56,16 @@ HYDROGENI_FUNC void hydrogenF_newtbhydrogenval (hydrogen_State *L, StkId level);
 HYDROGENI_FUNC void hydrogenF_closeupval (hydrogen_State *L, StkId level);
 HYDROGENI_FUNC void hydrogenF_close (hydrogen_State *L, StkId level, int status, int yy);
 HYDROGENI_FUNC void hydrogenF_unlinkupval (UpVal *uv);
+HYDROGENI_FUNC void hydrogenF_newicache (hydrogen_State *L, Proto *f);
+HYDROGENI_FUNC void hydrogenF_fusecode (Instruction *code, int n);
 HYDROGENI_FUNC void hydrogenF_freeproto (hydrogen_State *L, Proto *f);
 HYDROGENI_FUNC const char *hydrogenF_getlocalname (const Proto *func, int local_number,
                                          int pc);
+#if defined(HYDROGEN_USE_AOT)
+HYDROGENI_FUNC void hydrogenF_installaot (hydrogen_State *L,
+                                         const AOTFunction *f, int n,
+                                         unsigned int signature);
+#endif
 
 
 #endif
@@ -39,6 +39,12 @@
 */
 #define GCFINMAX	10
 
+/*
+** Number of lists of a growing string table to split in each basic
+** step (see 'hydrogenS_growstep').
+*/
+#define GCSTRSPLIT	256
+
 
 /*
 ** Cost of calling one finalizer.
@@ -292,7 +298,10 @@ static void reallymarkobject (global_State *g, GCObject *o) {
   switch (o->tt) {
     case HYDROGEN_VSHRSTR:
     case HYDROGEN_VLNGSTR: {
-      set2black(o);  /* nothing to visit */
+      TString *ts = gco2ts(o);
+      set2black(o);
+      if (isview(ts))  /* mark the string holding its bytes */
+        markobjectN(g, getview(ts)->parent);
       break;
     }
     case HYDROGEN_VUPVAL: {
@@ -431,6 +440,30 @@ static void genlink (global_State *g, GCObject *o) {
 }
 
 
+/*
+** Get the nodes of part 'p' of the hash of 'h', from the returned one
+** up to '*limit': part 0 is the hash part and part 1 is the old hash
+** part of a table being resized incrementally, whose entries not moved
+** yet still belong to the table. Return NULL if there is no such part.
+** (The collector does not finish such a resize, as that could take
+** long and would change the table behind the back of its users.)
+*/
+static Node *hashpart (Table *h, int p, Node **limit) {
+  Node *n;
+  unsigned int size;
+  if (p == 0) {
+    *limit = gnodelast(h);
+    return gnode(h, 0);
+  }
+  else if (p == 1 && (n = hydrogenH_oldpart(h, &size)) != NULL) {
+    *limit = n + size;
+    return n;
+  }
+  else
+    return NULL;
+}
+
+
 /*
 ** Traverse a table with weak values and link it to proper list. During
 ** propagate phase, keep it in 'grayagain' list, to be revisited in the
@@ -438,18 +471,21 @@ static void genlink (global_State *g, GCObject *o) {
 ** put it in 'weak' list, to be cleared.
 */
 static void traverseweakvalue (global_State *g, Table *h) {
-  Node *n, *limit = gnodelast(h);
+  Node *n, *limit;
+  int p;
   /* if there is array part, assume it may have white values (it is not
      worth traversing it now just to check) */
   int hasclears = (h->alimit > 0);
-  for (n = gnode(h, 0); n < limit; n++) {  /* traverse hash part */
-    if (isempty(gval(n)))  /* entry is empty? */
-      clearkey(n);  /* clear its key */
-    else {
-      hydrogen_assert(!keyisnil(n));
-      markkey(g, n);
-      if (!hasclears && iscleared(g, gcvalueN(gval(n))))  /* a white value? */
-        hasclears = 1;  /* table will have to be cleared */
+  for (p = 0; (n = hashpart(h, p, &limit)) != NULL; p++) {
+    for (; n < limit; n++) {  /* traverse hash part */
+      if (isempty(gval(n)))  /* entry is empty? */
+        clearkey(n);  /* clear its key */
+      else {
+        hydrogen_assert(!keyisnil(n));
+        markkey(g, n);
+        if (!hasclears && iscleared(g, gcvalueN(gval(n))))  /* white value? */
+          hasclears = 1;  /* table will have to be cleared */
+      }
     }
   }
   if (g->gcstate == GCSatomic && hasclears)
@@ -477,28 +513,33 @@ static int traverseephemeron (global_State *g, Table *h, int inv) {
   int hasww = 0;  /* true if table has entry "white-key -> white-value" */
   unsigned int i;
   unsigned int asize = hydrogenH_realasize(h);
-  unsigned int nsize = sizenode(h);
+  Node *first, *limit;
+  int p;
   /* traverse array part */
   for (i = 0; i < asize; i++) {
-    if (valiswhite(&h->array[i])) {
+    GCObject *o = arrgcvalue(h, i);
+    if (o != NULL && iswhite(o)) {
       marked = 1;
-      reallymarkobject(g, gcvalue(&h->array[i]));
+      reallymarkobject(g, o);
     }
   }
   /* traverse hash part; if 'inv', traverse descending
      (see 'convergeephemerons') */
-  for (i = 0; i < nsize; i++) {
-    Node *n = inv ? gnode(h, nsize - 1 - i) : gnode(h, i);
-    if (isempty(gval(n)))  /* entry is empty? */
-      clearkey(n);  /* clear its key */
-    else if (iscleared(g, gckeyN(n))) {  /* key is not marked (yet)? */
-      hasclears = 1;  /* table must be cleared */
-      if (valiswhite(gval(n)))  /* value not marked yet? */
-        hasww = 1;  /* white-white entry */
-    }
-    else if (valiswhite(gval(n))) {  /* value not marked yet? */
-      marked = 1;
-      reallymarkobject(g, gcvalue(gval(n)));  /* mark it now */
+  for (p = 0; (first = hashpart(h, p, &limit)) != NULL; p++) {
+    unsigned int nsize = cast_uint(limit - first);
+    for (i = 0; i < nsize; i++) {
+      Node *n = inv ? first + (nsize - 1 - i) : first + i;
+      if (isempty(gval(n)))  /* entry is empty? */
+        clearkey(n);  /* clear its key */
+      else if (iscleared(g, gckeyN(n))) {  /* key is not marked (yet)? */
+        hasclears = 1;  /* table must be cleared */
+        if (valiswhite(gval(n)))  /* value not marked yet? */
+          hasww = 1;  /* white-white entry */
+      }
+      else if (valiswhite(gval(n))) {  /* value not marked yet? */
+        marked = 1;
+        reallymarkobject(g, gcvalue(gval(n)));  /* mark it now */
+      }
     }
   }
   /* link table into proper list */
@@ -515,31 +556,51 @@ static int traverseephemeron (global_State *g, Table *h, int inv) {
 
 
 static void traversestrongtable (global_State *g, Table *h) {
-  Node *n, *limit = gnodelast(h);
+  Node *n, *limit;
   unsigned int i;
   unsigned int asize = hydrogenH_realasize(h);
+  int p;
   for (i = 0; i < asize; i++)  /* traverse array part */
-    markvalue(g, &h->array[i]);
-  for (n = gnode(h, 0); n < limit; n++) {  /* traverse hash part */
-    if (isempty(gval(n)))  /* entry is empty? */
-      clearkey(n);  /* clear its key */
-    else {
-      hydrogen_assert(!keyisnil(n));
-      markkey(g, n);
-      markvalue(g, gval(n));
+    markobjectN(g, arrgcvalue(h, i));
+  for (p = 0; (n = hashpart(h, p, &limit)) != NULL; p++) {
+    for (; n < limit; n++) {  /* traverse hash part */
+      if (isempty(gval(n)))  /* entry is empty? */
+        clearkey(n);  /* clear its key */
+      else {
+        hydrogen_assert(!keyisnil(n));
+        markkey(g, n);
+        markvalue(g, gval(n));
+      }
     }
   }
   genlink(g, obj2gco(h));
 }
 
 
+/*
+** Check whether the weak mode 'mode' has option 'c'. As with 'strchr',
+** only the bytes before a '\0' count; but the bytes of a view may not
+** be followed by one (see 'isview'), so the search is bounded by the
+** length of the string.
+*/
+static int hasmode (TString *mode, int c) {
+  const char *s = getstr(mode);
+  size_t l = tsslen(mode);
+  const char *z = cast_charp(memchr(s, '\0', l));
+  if (z != NULL)  /* stop at an embedded '\0' */
+    l = cast_sizet(z - s);
+  return (memchr(s, c, l) != NULL);
+}
+
+
 static lu_mem traversetable (global_State *g, Table *h) {
-  const char *weakkey, *weakvalue;
+  int weakkey, weakvalue;
   const TValue *mode = gfasttm(g, h->metatable, TM_MODE);
+  unsigned int oldsize = 0;
   markobjectN(g, h->metatable);
   if (mode && ttisstring(mode) &&  /* is there a weak mode? */
-      (cast_void(weakkey = strchr(svalue(mode), 'k')),
-       cast_void(weakvalue = strchr(svalue(mode), 'v')),
+      (cast_void(weakkey = hasmode(tsvalue(mode), 'k')),
+       cast_void(weakvalue = hasmode(tsvalue(mode), 'v')),
        (weakkey || weakvalue))) {  /* is really weak? */
     if (!weakkey)  /* strong keys? */
       traverseweakvalue(g, h);
@@ -550,7 +611,8 @@ static lu_mem traversetable (global_State *g, Table *h) {
   }
   else  /* not weak */
     traversestrongtable(g, h);
-  return 1 + h->alimit + 2 * allocsizenode(h);
+  hydrogenH_oldpart(h, &oldsize);
+  return 1 + h->alimit + 2 * (allocsizenode(h) + oldsize);
 }
 
 
@@ -717,13 +779,15 @@ static void convergeephemerons (global_State *g) {
 static void clearbykeys (global_State *g, GCObject *l) {
   for (; l; l = gco2t(l)->gclist) {
     Table *h = gco2t(l);
-    Node *limit = gnodelast(h);
-    Node *n;
-    for (n = gnode(h, 0); n < limit; n++) {
-      if (iscleared(g, gckeyN(n)))  /* unmarked key? */
-        setempty(gval(n));  /* remove entry */
-      if (isempty(gval(n)))  /* is entry empty? */
-        clearkey(n);  /* clear its key */
+    Node *limit, *n;
+    int p;
+    for (p = 0; (n = hashpart(h, p, &limit)) != NULL; p++) {
+      for (; n < limit; n++) {
+        if (iscleared(g, gckeyN(n)))  /* unmarked key? */
+          setempty(gval(n));  /* remove entry */
+        if (isempty(gval(n)))  /* is entry empty? */
+          clearkey(n);  /* clear its key */
+      }
     }
   }
 }
@@ -736,19 +800,21 @@ static void clearbykeys (global_State *g, GCObject *l) {
 static void clearbyvalues (global_State *g, GCObject *l, GCObject *f) {
   for (; l != f; l = gco2t(l)->gclist) {
     Table *h = gco2t(l);
-    Node *n, *limit = gnodelast(h);
+    Node *n, *limit;
     unsigned int i;
     unsigned int asize = hydrogenH_realasize(h);
+    int p;
     for (i = 0; i < asize; i++) {
-      TValue *o = &h->array[i];
-      if (iscleared(g, gcvalueN(o)))  /* value was collected? */
-        setempty(o);  /* remove entry */
+      if (iscleared(g, arrgcvalue(h, i)))  /* value was collected? */
+        arrsetempty(h, i);  /* remove entry */
     }
-    for (n = gnode(h, 0); n < limit; n++) {
-      if (iscleared(g, gcvalueN(gval(n))))  /* unmarked value? */
-        setempty(gval(n));  /* remove entry */
-      if (isempty(gval(n)))  /* is entry empty? */
-        clearkey(n);  /* clear its key */
+    for (p = 0; (n = hashpart(h, p, &limit)) != NULL; p++) {
+      for (; n < limit; n++) {
+        if (iscleared(g, gcvalueN(gval(n))))  /* unmarked value? */
+          setempty(gval(n));  /* remove entry */
+        if (isempty(gval(n)))  /* is entry empty? */
+          clearkey(n);  /* clear its key */
+      }
     }
   }
 }
@@ -798,7 +864,10 @@ static void freeobj (hydrogen_State *L, GCObject *o) {
     }
     case HYDROGEN_VLNGSTR: {
       TString *ts = gco2ts(o);
-      hydrogenM_freemem(L, ts, sizestring(ts->u.lnglen));
+      if (!isview(ts))
+        hydrogenM_freemem(L, ts, sizestring(ts->u.lnglen));
+      else
+        hydrogenM_freemem(L, ts, sizeview(getview(ts)->size));
       break;
     }
     default: hydrogen_assert(0);
@@ -1682,6 +1751,8 @@ void hydrogenC_step (hydrogen_State *L) {
   global_State *g = G(L);
   hydrogen_assert(!g->gcemergency);
   if (gcrunning(g)) {  /* running? */
+    if (hydrogenS_isgrowing(g))
+      hydrogenS_growstep(g, GCSTRSPLIT);
     if(isdecGCmodegen(g))
       genstep(L, g);
     else
@@ -185,6 +185,7 @@ HYDROGEN_API hydrogen_Number      (hydrogen_tonumberx) (hydrogen_State *L, int i
 HYDROGEN_API hydrogen_Integer     (hydrogen_tointegerx) (hydrogen_State *L, int idx, int *isnum);
 HYDROGEN_API int             (hydrogen_toboolean) (hydrogen_State *L, int idx);
 HYDROGEN_API const char     *(hydrogen_tolstring) (hydrogen_State *L, int idx, size_t *len);
+HYDROGEN_API const char     *(hydrogen_tobytes) (hydrogen_State *L, int idx, size_t *len);
 HYDROGEN_API hydrogen_Unsigned    (hydrogen_rawlen) (hydrogen_State *L, int idx);
 HYDROGEN_API hydrogen_CFunction   (hydrogen_tocfunction) (hydrogen_State *L, int idx);
 HYDROGEN_API void	       *(hydrogen_touserdata) (hydrogen_State *L, int idx);
@@ -228,6 +229,8 @@ HYDROGEN_API void        (hydrogen_pushnil) (hydrogen_State *L);
 HYDROGEN_API void        (hydrogen_pushnumber) (hydrogen_State *L, hydrogen_Number n);
 HYDROGEN_API void        (hydrogen_pushinteger) (hydrogen_State *L, hydrogen_Integer n);
 HYDROGEN_API const char *(hydrogen_pushlstring) (hydrogen_State *L, const char *s, size_t len);
+HYDROGEN_API void        (hydrogen_pushsubstring) (hydrogen_State *L, int idx,
+                                                   size_t i, size_t l);
 HYDROGEN_API const char *(hydrogen_pushstring) (hydrogen_State *L, const char *s);
 HYDROGEN_API const char *(hydrogen_pushvfstring) (hydrogen_State *L, const char *fmt,
                                                       va_list argp);
@@ -321,10 +324,29 @@ HYDROGEN_API void (hydrogen_warning)  (hydrogen_State *L, const char *msg, int t
 #define HYDROGEN_GCISRUNNING		9
 #define HYDROGEN_GCGEN		10
 #define HYDROGEN_GCINC		11
+#define HYDROGEN_GCSTRRESIZE	12
+#define HYDROGEN_GCSTRSIZE		13
 
 HYDROGEN_API int (hydrogen_gc) (hydrogen_State *L, int what, ...);
 
 
+/*
+** JIT-compiler function and options
+*/
+
+#define HYDROGEN_JITOFF		0
+#define HYDROGEN_JITON		1
+#define HYDROGEN_JITISON		2
+#define HYDROGEN_JITSETTHRESHOLD	3
+#define HYDROGEN_JITCOUNT		4
+#define HYDROGEN_JITTRACES		5
+#define HYDROGEN_JITABORTS		6
+#define HYDROGEN_JITENTRIES		7
+#define HYDROGEN_JITEXITS		8
+
+HYDROGEN_API int (hydrogen_jit) (hydrogen_State *L, int what, ...);
+
+
 /*
 ** miscellaneous functions
 */
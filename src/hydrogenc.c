@@ -17,6 +17,7 @@
 
 #include "hydrogen.h"
 #include "auxlib.h"
+#include "hydrogenlib.h"
 
 #include "debug.h"
 #include "object.h"
@@ -27,6 +28,8 @@
 
 static void PrintFunction(const Proto* f, int full);
 #define hydrogenU_print	PrintFunction
+static void CompileChunk(hydrogen_State* L, const Proto* f, FILE* D);
+#define hydrogenU_compile	CompileChunk
 
 #define PROGNAME	"hydrogenc"		/* default program name */
 #define OUTPUT		PROGNAME ".out"	/* default output file */
@@ -34,6 +37,8 @@ static void PrintFunction(const Proto* f, int full);
 static int listing=0;			/* list bytecodes? */
 static int dumping=1;			/* dump bytecodes? */
 static int stripping=0;			/* strip debug information? */
+static int running=0;			/* run chunks before listing? */
+static int compiling=0;			/* output C instead of bytecodes? */
 static char Output[]={ OUTPUT };	/* default output file name */
 static const char* output=Output;	/* actual output file name */
 static const char* progname=PROGNAME;	/* actual program name */
@@ -79,9 +84,11 @@ static void usage(const char* message)
 "\x1b[0m"
   "usage: %s [options] [filenames]\n"
   "Available options are:\n"
+  "  -C       output a C module with the chunks compiled to C\n"
   "  -l       list (use -l -l for full listing)\n"
   "  -o name  output to file 'name' (default is \"%s\")\n"
   "  -p       parse only\n"
+  "  -r       run chunks first (list shows quickened instructions)\n"
   "  -s       strip debug information\n"
   "  -v       show version information\n"
   "  --       stop handling options\n"
@@ -110,6 +117,8 @@ static int doargs(int argc, char* argv[])
   }
   else if (IS("-"))			/* end of options; use stdin */
    break;
+  else if (IS("-C"))			/* compile to C */
+   compiling=1;
   else if (IS("-l"))			/* list */
    ++listing;
   else if (IS("-o"))			/* output file */
@@ -121,6 +130,8 @@ static int doargs(int argc, char* argv[])
   }
   else if (IS("-p"))			/* parse only */
    dumping=0;
+  else if (IS("-r"))			/* run chunks */
+   running=1;
   else if (IS("-s"))			/* strip debug information */
    stripping=1;
   else if (IS("-v"))			/* show version */
@@ -194,20 +205,29 @@ static int pmain(hydrogen_State* L)
  const Proto* f;
  int i;
  tmname=G(L)->tmname;
- if (!hydrogen_checkstack(L,argc)) fatal("too many input files");
+ if (!hydrogen_checkstack(L,argc+1)) fatal("too many input files");
+ if (running) hydrogenL_openlibs(L);
  for (i=0; i<argc; i++)
  {
   const char* filename=IS("-") ? NULL : argv[i];
   if (hydrogenL_loadfile(L,filename)!=HYDROGEN_OK) fatal(hydrogen_tostring(L,-1));
+  if (running)
+  {
+   hydrogen_pushvalue(L,-1);
+   if (hydrogen_pcall(L,0,0,0)!=HYDROGEN_OK) fatal(hydrogen_tostring(L,-1));
+  }
  }
  f=combine(L,argc);
  if (listing) hydrogenU_print(f,listing>1);
  if (dumping)
  {
-  FILE* D= (output==NULL) ? stdout : fopen(output,"wb");
+  FILE* D= (output==NULL) ? stdout : fopen(output,compiling ? "w" : "wb");
   if (D==NULL) cannot("open");
   hydrogen_lock(L);
-  hydrogenU_dump(L,f,writer,D,stripping);
+  if (compiling)
+   hydrogenU_compile(L,f,D);
+  else
+   hydrogenU_dump(L,f,writer,D,stripping);
   hydrogen_unlock(L);
   if (ferror(D)) cannot("write");
   if (fclose(D)) cannot("close");
@@ -415,17 +435,21 @@ static void PrintCode(const Proto* f)
 	printf(COMMENT "%s",UPVALNAME(b));
 	break;
    case OP_GETTABUP:
+   case OP_GETTABUP_CALL:
 	printf("%d %d %d",a,b,c);
 	printf(COMMENT "%s",UPVALNAME(b));
 	printf(" "); PrintConstant(f,c);
 	break;
    case OP_GETTABLE:
+   case OP_GETTABLE_ARRAY:
 	printf("%d %d %d",a,b,c);
 	break;
    case OP_GETI:
+   case OP_GETI_ARRAY:
 	printf("%d %d %d",a,b,c);
 	break;
    case OP_GETFIELD:
+   case OP_GETFIELD_CALL:
 	printf("%d %d %d",a,b,c);
 	printf(COMMENT); PrintConstant(f,c);
 	break;
@@ -436,10 +460,12 @@ static void PrintCode(const Proto* f)
 	if (isk) { printf(" "); PrintConstant(f,c); }
 	break;
    case OP_SETTABLE:
+   case OP_SETTABLE_ARRAY:
 	printf("%d %d %d%s",a,b,c,ISK);
 	if (isk) { printf(COMMENT); PrintConstant(f,c); }
 	break;
    case OP_SETI:
+   case OP_SETI_ARRAY:
 	printf("%d %d %d%s",a,b,c,ISK);
 	if (isk) { printf(COMMENT); PrintConstant(f,c); }
 	break;
@@ -453,6 +479,7 @@ static void PrintCode(const Proto* f)
 	printf(COMMENT "%d",c+EXTRAARGC);
 	break;
    case OP_SELF:
+   case OP_SELF_CALL:
 	printf("%d %d %d%s",a,b,c,ISK);
 	if (isk) { printf(COMMENT); PrintConstant(f,c); }
 	break;
@@ -506,12 +533,18 @@ static void PrintCode(const Proto* f)
 	printf("%d %d %d",a,b,sc);
 	break;
    case OP_ADD:
+   case OP_ADD_II:
+   case OP_ADD_FF:
 	printf("%d %d %d",a,b,c);
 	break;
    case OP_SUB:
+   case OP_SUB_II:
+   case OP_SUB_FF:
 	printf("%d %d %d",a,b,c);
 	break;
    case OP_MUL:
+   case OP_MUL_II:
+   case OP_MUL_FF:
 	printf("%d %d %d",a,b,c);
 	break;
    case OP_MOD:
@@ -581,12 +614,15 @@ static void PrintCode(const Proto* f)
 	printf(COMMENT "to %d",GETARG_sJ(i)+pc+2);
 	break;
    case OP_EQ:
+   case OP_EQ_II:
 	printf("%d %d %d",a,b,isk);
 	break;
    case OP_LT:
+   case OP_LT_II:
 	printf("%d %d %d",a,b,isk);
 	break;
    case OP_LE:
+   case OP_LE_II:
 	printf("%d %d %d",a,b,isk);
 	break;
    case OP_EQK:
@@ -743,3 +779,560 @@ static void PrintFunction(const Proto* f, int full)
  if (full) PrintDebug(f);
  for (i=0; i<n; i++) PrintFunction(f->p[i],full);
 }
+
+/*
+** compile bytecodes to C (see aot.h)
+*/
+
+static const char* CompileBody(OpCode o)
+{
+ switch (o)
+ {
+  case OP_MOVE:
+	return "setobjs2s(L, ra, RB(i));\n";
+  case OP_LOADI:
+	return "setivalue(s2v(ra), GETARG_sBx(i));\n";
+  case OP_LOADF:
+	return "setfltvalue(s2v(ra), cast_num(GETARG_sBx(i)));\n";
+  case OP_LOADK:
+	return "setobj2s(L, ra, k + GETARG_Bx(i));\n";
+  case OP_LOADKX:
+	return "setobj2s(L, ra, k + GETARG_Ax(*pc));\n"
+	       "pc++;\n";
+  case OP_LOADFALSE:
+	return "setbfvalue(s2v(ra));\n";
+  case OP_LFALSESKIP:
+	return "setbfvalue(s2v(ra));\n"
+	       "pc++;\n";
+  case OP_LOADTRUE:
+	return "setbtvalue(s2v(ra));\n";
+  case OP_LOADNIL:
+	return "int b = GETARG_B(i);\n"
+	       "do {\n"
+	       "  setnilvalue(s2v(ra++));\n"
+	       "} while (b--);\n";
+  case OP_GETUPVAL:
+	return "setobj2s(L, ra, cl->upvals[GETARG_B(i)]->v);\n";
+  case OP_SETUPVAL:
+	return "UpVal *uv = cl->upvals[GETARG_B(i)];\n"
+	       "setobj(L, uv->v, s2v(ra));\n"
+	       "hydrogenC_barrier(L, uv, s2v(ra));\n";
+  case OP_GETTABUP:
+	return "op_gettabup();\n";
+  case OP_GETTABLE:
+	return "const TValue *slot;\n"
+	       "TValue *rb = vRB(i);\n"
+	       "TValue *rc = vRC(i);\n"
+	       "if (!(ttisinteger(rc)\n"
+	       "      ? hydrogenV_fastgeti(L, rb, ivalue(rc), s2v(ra), slot)\n"
+	       "      : hydrogenV_fastgetv(L, rb, rc, s2v(ra), slot)))\n"
+	       "  Protect(hydrogenV_finishget(L, rb, rc, ra, slot));\n";
+  case OP_GETI:
+	return "const TValue *slot;\n"
+	       "TValue *rb = vRB(i);\n"
+	       "int c = GETARG_C(i);\n"
+	       "if (!hydrogenV_fastgeti(L, rb, c, s2v(ra), slot)) {\n"
+	       "  TValue key;\n"
+	       "  setivalue(&key, c);\n"
+	       "  Protect(hydrogenV_finishget(L, rb, &key, ra, slot));\n"
+	       "}\n";
+  case OP_GETFIELD:
+	return "op_getfield();\n";
+  case OP_SETTABUP:
+	return "const TValue *slot;\n"
+	       "TValue *upval = cl->upvals[GETARG_A(i)]->v;\n"
+	       "TValue *rb = KB(i);\n"
+	       "TValue *rc = RKC(i);\n"
+	       "TString *key = tsvalue(rb);\n"
+	       "if (hydrogenV_fastgetcached(L, upval, key, slot, &IC(pc)->field.slot)) {\n"
+	       "  hydrogenV_finishfastset(L, upval, slot, rc);\n"
+	       "}\n"
+	       "else\n"
+	       "  Protect(hydrogenV_finishset(L, upval, rb, rc, slot));\n";
+  case OP_SETTABLE:
+	return "const TValue *slot;\n"
+	       "TValue *rb = vRB(i);\n"
+	       "TValue *rc = RKC(i);\n"
+	       "hydrogen_Unsigned n;\n"
+	       "if (!(ttisinteger(rb)\n"
+	       "      ? (cast_void(n = ivalue(rb)),\n"
+	       "         hydrogenV_fastseti(L, s2v(ra), n, rc, slot))\n"
+	       "      : hydrogenV_fastset(L, s2v(ra), rb, rc, slot)))\n"
+	       "  Protect(hydrogenV_finishset(L, s2v(ra), rb, rc, slot));\n";
+  case OP_SETI:
+	return "const TValue *slot;\n"
+	       "int c = GETARG_B(i);\n"
+	       "TValue *rc = RKC(i);\n"
+	       "if (!hydrogenV_fastseti(L, s2v(ra), c, rc, slot)) {\n"
+	       "  TValue key;\n"
+	       "  setivalue(&key, c);\n"
+	       "  Protect(hydrogenV_finishset(L, s2v(ra), &key, rc, slot));\n"
+	       "}\n";
+  case OP_SETFIELD:
+	return "const TValue *slot;\n"
+	       "TValue *rb = KB(i);\n"
+	       "TValue *rc = RKC(i);\n"
+	       "TString *key = tsvalue(rb);\n"
+	       "if (hydrogenV_fastgetcached(L, s2v(ra), key, slot, &IC(pc)->field.slot)) {\n"
+	       "  hydrogenV_finishfastset(L, s2v(ra), slot, rc);\n"
+	       "}\n"
+	       "else\n"
+	       "  Protect(hydrogenV_finishset(L, s2v(ra), rb, rc, slot));\n";
+  case OP_NEWTABLE:
+	return "int b = GETARG_B(i);\n"
+	       "int c = GETARG_C(i);\n"
+	       "Table *t;\n"
+	       "if (b > 0)\n"
+	       "  b = 1 << (b - 1);\n"
+	       "if (TESTARG_k(i))\n"
+	       "  c += GETARG_Ax(*pc) * (MAXARG_C + 1);\n"
+	       "pc++;\n"
+	       "L->top = ra + 1;\n"
+	       "t = hydrogenH_new(L);\n"
+	       "sethvalue2s(L, ra, t);\n"
+	       "if (b != 0 || c != 0)\n"
+	       "  hydrogenH_resize(L, t, c, b);\n"
+	       "checkGC(L, ra + 1);\n";
+  case OP_SELF:
+	return "op_self();\n";
+  case OP_ADDI:
+	return "op_arithI(L, l_addi, hydrogeni_numadd);\n";
+  case OP_ADDK:
+	return "op_arithK(L, l_addi, hydrogeni_numadd);\n";
+  case OP_SUBK:
+	return "op_arithK(L, l_subi, hydrogeni_numsub);\n";
+  case OP_MULK:
+	return "op_arithK(L, l_muli, hydrogeni_nummul);\n";
+  case OP_MODK:
+	return "op_arithK(L, hydrogenV_mod, hydrogenV_modf);\n";
+  case OP_POWK:
+	return "op_arithfK(L, hydrogeni_numpow);\n";
+  case OP_DIVK:
+	return "op_arithfK(L, hydrogeni_numdiv);\n";
+  case OP_IDIVK:
+	return "op_arithK(L, hydrogenV_idiv, hydrogeni_numidiv);\n";
+  case OP_BANDK:
+	return "op_bitwiseK(L, l_band);\n";
+  case OP_BORK:
+	return "op_bitwiseK(L, l_bor);\n";
+  case OP_BXORK:
+	return "op_bitwiseK(L, l_bxor);\n";
+  case OP_SHRI:
+	return "TValue *rb = vRB(i);\n"
+	       "int ic = GETARG_sC(i);\n"
+	       "hydrogen_Integer ib;\n"
+	       "if (tointegerns(rb, &ib)) {\n"
+	       "  pc++; setivalue(s2v(ra), hydrogenV_shiftl(ib, -ic));\n"
+	       "}\n";
+  case OP_SHLI:
+	return "TValue *rb = vRB(i);\n"
+	       "int ic = GETARG_sC(i);\n"
+	       "hydrogen_Integer ib;\n"
+	       "if (tointegerns(rb, &ib)) {\n"
+	       "  pc++; setivalue(s2v(ra), hydrogenV_shiftl(ic, ib));\n"
+	       "}\n";
+  case OP_ADD:
+	return "op_arith(L, l_addi, hydrogeni_numadd);\n";
+  case OP_SUB:
+	return "op_arith(L, l_subi, hydrogeni_numsub);\n";
+  case OP_MUL:
+	return "op_arith(L, l_muli, hydrogeni_nummul);\n";
+  case OP_MOD:
+	return "op_arith(L, hydrogenV_mod, hydrogenV_modf);\n";
+  case OP_POW:
+	return "op_arithf(L, hydrogeni_numpow);\n";
+  case OP_DIV:
+	return "op_arithf(L, hydrogeni_numdiv);\n";
+  case OP_IDIV:
+	return "op_arith(L, hydrogenV_idiv, hydrogeni_numidiv);\n";
+  case OP_BAND:
+	return "op_bitwise(L, l_band);\n";
+  case OP_BOR:
+	return "op_bitwise(L, l_bor);\n";
+  case OP_BXOR:
+	return "op_bitwise(L, l_bxor);\n";
+  case OP_SHR:
+	return "op_bitwise(L, hydrogenV_shiftr);\n";
+  case OP_SHL:
+	return "op_bitwise(L, hydrogenV_shiftl);\n";
+  case OP_MMBIN:
+	return "Instruction pi = *(pc - 2);\n"
+	       "TValue *rb = vRB(i);\n"
+	       "TMS tm = (TMS)GETARG_C(i);\n"
+	       "StkId result = RA(pi);\n"
+	       "Protect(hydrogenT_trybinTM(L, s2v(ra), rb, result, tm));\n";
+  case OP_MMBINI:
+	return "Instruction pi = *(pc - 2);\n"
+	       "int imm = GETARG_sB(i);\n"
+	       "TMS tm = (TMS)GETARG_C(i);\n"
+	       "int flip = GETARG_k(i);\n"
+	       "StkId result = RA(pi);\n"
+	       "Protect(hydrogenT_trybiniTM(L, s2v(ra), imm, flip, result, tm));\n";
+  case OP_MMBINK:
+	return "Instruction pi = *(pc - 2);\n"
+	       "TValue *imm = KB(i);\n"
+	       "TMS tm = (TMS)GETARG_C(i);\n"
+	       "int flip = GETARG_k(i);\n"
+	       "StkId result = RA(pi);\n"
+	       "Protect(hydrogenT_trybinassocTM(L, s2v(ra), imm, flip, result, tm));\n";
+  case OP_UNM:
+	return "TValue *rb = vRB(i);\n"
+	       "hydrogen_Number nb;\n"
+	       "if (ttisinteger(rb)) {\n"
+	       "  hydrogen_Integer ib = ivalue(rb);\n"
+	       "  setivalue(s2v(ra), intop(-, 0, ib));\n"
+	       "}\n"
+	       "else if (tonumberns(rb, nb)) {\n"
+	       "  setfltvalue(s2v(ra), hydrogeni_numunm(L, nb));\n"
+	       "}\n"
+	       "else\n"
+	       "  Protect(hydrogenT_trybinTM(L, rb, rb, ra, TM_UNM));\n";
+  case OP_BNOT:
+	return "TValue *rb = vRB(i);\n"
+	       "hydrogen_Integer ib;\n"
+	       "if (tointegerns(rb, &ib)) {\n"
+	       "  setivalue(s2v(ra), intop(^, ~l_castS2U(0), ib));\n"
+	       "}\n"
+	       "else\n"
+	       "  Protect(hydrogenT_trybinTM(L, rb, rb, ra, TM_BNOT));\n";
+  case OP_NOT:
+	return "if (l_isfalse(vRB(i)))\n"
+	       "  setbtvalue(s2v(ra));\n"
+	       "else\n"
+	       "  setbfvalue(s2v(ra));\n";
+  case OP_LEN:
+	return "Protect(hydrogenV_objlen(L, ra, vRB(i)));\n";
+  case OP_CONCAT:
+	return "int n = GETARG_B(i);\n"
+	       "L->top = ra + n;\n"
+	       "ProtectNT(hydrogenV_concat(L, n));\n"
+	       "checkGC(L, L->top);\n";
+  case OP_CLOSE:
+	return "Protect(hydrogenF_close(L, ra, HYDROGEN_OK, 1));\n";
+  case OP_TBC:
+	return "halfProtect(hydrogenF_newtbhydrogenval(L, ra));\n";
+  case OP_JMP:
+	return "dojump(ci, i, 0);\n";
+  case OP_EQ:
+	return "int cond;\n"
+	       "Protect(cond = hydrogenV_equalobj(L, s2v(ra), vRB(i)));\n"
+	       "docondjump();\n";
+  case OP_LT:
+	return "op_order(L, l_lti, aot_LTnum, hydrogenV_lessthan);\n";
+  case OP_LE:
+	return "op_order(L, l_lei, aot_LEnum, hydrogenV_lessequal);\n";
+  case OP_EQK:
+	return "int cond = hydrogenV_rawequalobj(s2v(ra), KB(i));\n"
+	       "docondjump();\n";
+  case OP_EQI:
+	return "int cond;\n"
+	       "int im = GETARG_sB(i);\n"
+	       "if (ttisinteger(s2v(ra)))\n"
+	       "  cond = (ivalue(s2v(ra)) == im);\n"
+	       "else if (ttisfloat(s2v(ra)))\n"
+	       "  cond = hydrogeni_numeq(fltvalue(s2v(ra)), cast_num(im));\n"
+	       "else\n"
+	       "  cond = 0;\n"
+	       "docondjump();\n";
+  case OP_LTI:
+	return "op_orderI(L, l_lti, hydrogeni_numlt, 0, TM_LT);\n";
+  case OP_LEI:
+	return "op_orderI(L, l_lei, hydrogeni_numle, 0, TM_LE);\n";
+  case OP_GTI:
+	return "op_orderI(L, l_gti, hydrogeni_numgt, 1, TM_LT);\n";
+  case OP_GEI:
+	return "op_orderI(L, l_gei, hydrogeni_numge, 1, TM_LE);\n";
+  case OP_TEST:
+	return "int cond = !l_isfalse(s2v(ra));\n"
+	       "docondjump();\n";
+  case OP_TESTSET:
+	return "TValue *rb = vRB(i);\n"
+	       "if (l_isfalse(rb) == GETARG_k(i))\n"
+	       "  pc++;\n"
+	       "else {\n"
+	       "  setobj2s(L, ra, rb);\n"
+	       "  donextjump(ci);\n"
+	       "}\n";
+  case OP_CALL:
+	return "aot_call();\n";
+  case OP_TAILCALL:
+	return "int b = GETARG_B(i);\n"
+	       "int n;\n"
+	       "int nparams1 = GETARG_C(i);\n"
+	       "int delta = (nparams1) ? ci->u.l.nextraargs + nparams1 : 0;\n"
+	       "aot_hookret();\n"
+	       "if (b != 0)\n"
+	       "  L->top = ra + b;\n"
+	       "else\n"
+	       "  b = cast_int(L->top - ra);\n"
+	       "savepc(ci);\n"
+	       "if (TESTARG_k(i))\n"
+	       "  hydrogenF_closeupval(L, base);\n"
+	       "if ((n = hydrogenD_pretailcall(L, ci, ra, b, delta)) < 0)\n"
+	       "  return AOT_CALL;\n"
+	       "ci->func -= delta;\n"
+	       "hydrogenD_poscall(L, ci, n);\n"
+	       "return AOT_RETURN;\n";
+  case OP_RETURN:
+	return "int n = GETARG_B(i) - 1;\n"
+	       "int nparams1 = GETARG_C(i);\n"
+	       "aot_hookret();\n"
+	       "if (n < 0)\n"
+	       "  n = cast_int(L->top - ra);\n"
+	       "savepc(ci);\n"
+	       "if (TESTARG_k(i)) {\n"
+	       "  ci->u2.nres = n;\n"
+	       "  if (L->top < ci->top)\n"
+	       "    L->top = ci->top;\n"
+	       "  hydrogenF_close(L, base, CLOSEKTOP, 1);\n"
+	       "  updatetrap(ci);\n"
+	       "  updatestack(ci);\n"
+	       "}\n"
+	       "if (nparams1)\n"
+	       "  ci->func -= ci->u.l.nextraargs + nparams1;\n"
+	       "L->top = ra + n;\n"
+	       "hydrogenD_poscall(L, ci, n);\n"
+	       "return AOT_RETURN;\n";
+  case OP_RETURN0:
+	return "int nres;\n"
+	       "aot_hookret();\n"
+	       "L->ci = ci->previous;\n"
+	       "L->top = base - 1;\n"
+	       "for (nres = ci->nresults; l_unlikely(nres > 0); nres--)\n"
+	       "  setnilvalue(s2v(L->top++));\n"
+	       "return AOT_RETURN;\n";
+  case OP_RETURN1:
+	return "int nres = ci->nresults;\n"
+	       "aot_hookret();\n"
+	       "L->ci = ci->previous;\n"
+	       "if (nres == 0)\n"
+	       "  L->top = base - 1;\n"
+	       "else {\n"
+	       "  setobjs2s(L, base - 1, ra);\n"
+	       "  L->top = base;\n"
+	       "  for (; l_unlikely(nres > 1); nres--)\n"
+	       "    setnilvalue(s2v(L->top++));\n"
+	       "}\n"
+	       "return AOT_RETURN;\n";
+  case OP_FORLOOP:
+	return "if (ttisinteger(s2v(ra + 2))) {\n"
+	       "  hydrogen_Unsigned count = l_castS2U(ivalue(s2v(ra + 1)));\n"
+	       "  if (count > 0) {\n"
+	       "    hydrogen_Integer step = ivalue(s2v(ra + 2));\n"
+	       "    hydrogen_Integer idx = ivalue(s2v(ra));\n"
+	       "    chgivalue(s2v(ra + 1), count - 1);\n"
+	       "    idx = intop(+, idx, step);\n"
+	       "    chgivalue(s2v(ra), idx);\n"
+	       "    setivalue(s2v(ra + 3), idx);\n"
+	       "    pc -= GETARG_Bx(i);\n"
+	       "  }\n"
+	       "}\n"
+	       "else if (hydrogenV_floatforloop(ra))\n"
+	       "  pc -= GETARG_Bx(i);\n"
+	       "updatetrap(ci);\n";
+  case OP_FORPREP:
+	return "savestate(L, ci);\n"
+	       "if (hydrogenV_forprep(L, ra))\n"
+	       "  pc += GETARG_Bx(i) + 1;\n";
+  case OP_TFORPREP:
+	return "halfProtect(hydrogenF_newtbhydrogenval(L, ra + 3));\n"
+	       "pc += GETARG_Bx(i);\n";
+  case OP_TFORCALL:
+	return "setobjs2s(L, ra + 4, ra);\n"
+	       "setobjs2s(L, ra + 5, ra + 1);\n"
+	       "setobjs2s(L, ra + 6, ra + 2);\n"
+	       "L->top = ra + 4 + 3;\n"
+	       "ProtectNT(hydrogenD_call(L, ra + 4, GETARG_C(i)));\n"
+	       "updatestack(ci);\n";
+  case OP_TFORLOOP:
+	return "if (!ttisnil(s2v(ra + 4))) {\n"
+	       "  setobjs2s(L, ra + 2, ra + 4);\n"
+	       "  pc -= GETARG_Bx(i);\n"
+	       "}\n";
+  case OP_SETLIST:
+	return "int n = GETARG_B(i);\n"
+	       "unsigned int last = GETARG_C(i);\n"
+	       "Table *h = hvalue(s2v(ra));\n"
+	       "if (n == 0)\n"
+	       "  n = cast_int(L->top - ra) - 1;\n"
+	       "else\n"
+	       "  L->top = ci->top;\n"
+	       "last += n;\n"
+	       "if (TESTARG_k(i)) {\n"
+	       "  last += GETARG_Ax(*pc) * (MAXARG_C + 1);\n"
+	       "  pc++;\n"
+	       "}\n"
+	       "if (last > hydrogenH_realasize(h))\n"
+	       "  hydrogenH_resizearray(L, h, last);\n"
+	       "for (; n > 0; n--) {\n"
+	       "  TValue *val = s2v(ra + n);\n"
+	       "  arrsetobj(h, last - 1, val);\n"
+	       "  last--;\n"
+	       "  hydrogenC_barrierback(L, obj2gco(h), val);\n"
+	       "}\n";
+  case OP_CLOSURE:
+	return "Proto *p = cl->p->p[GETARG_Bx(i)];\n"
+	       "halfProtect(hydrogenV_pushclosure(L, p, cl->upvals, base, ra));\n"
+	       "checkGC(L, ra + 1);\n";
+  case OP_VARARG:
+	return "Protect(hydrogenT_getvarargs(L, ci, ra, GETARG_C(i) - 1));\n";
+  case OP_VARARGPREP:
+	return "ProtectNT(hydrogenT_adjustvarargs(L, GETARG_A(i), ci, cl->p));\n"
+	       "if (l_unlikely(trap)) {\n"
+	       "  hydrogenD_hookcall(L, ci);\n"
+	       "  L->oldpc = 1;\n"
+	       "}\n"
+	       "updatebase(ci);\n";
+  default:				/* OP_EXTRAARG is never run */
+	return "hydrogen_assert(0);\n";
+ }
+}
+
+/* instruction 'pc' may skip the next one */
+static int CompileSkips(const Proto* f, int pc)
+{
+ Instruction i=f->code[pc];
+ switch (GET_GENERICOP(i))
+ {
+  case OP_ADDI: case OP_ADDK: case OP_SUBK: case OP_MULK: case OP_MODK:
+  case OP_POWK: case OP_DIVK: case OP_IDIVK: case OP_BANDK: case OP_BORK:
+  case OP_BXORK: case OP_SHRI: case OP_SHLI: case OP_ADD: case OP_SUB:
+  case OP_MUL: case OP_MOD: case OP_POW: case OP_DIV: case OP_IDIV:
+  case OP_BAND: case OP_BOR: case OP_BXOR: case OP_SHL: case OP_SHR:
+  case OP_LOADKX: case OP_LFALSESKIP: case OP_NEWTABLE:
+	return 1;
+  case OP_SETLIST:
+	return GETARG_k(i);
+  default:
+	return testTMode(GET_GENERICOP(i));
+ }
+}
+
+/* instruction 'pc' may jump to 'pc+1+jump'; returns 0 otherwise */
+static int CompileJump(const Proto* f, int pc, int* jump)
+{
+ Instruction i=f->code[pc];
+ switch (GET_GENERICOP(i))
+ {
+  case OP_JMP:
+	*jump=GETARG_sJ(i);
+	return 1;
+  case OP_FORLOOP: case OP_TFORLOOP:
+	*jump=-GETARG_Bx(i);
+	return 1;
+  case OP_FORPREP:
+	*jump=GETARG_Bx(i)+1;
+	return 1;
+  case OP_TFORPREP:
+	*jump=GETARG_Bx(i);
+	return 1;
+  default:
+	if (testTMode(GET_GENERICOP(i)))	/* test jumps with the next jump */
+	{
+	 *jump=1+GETARG_sJ(f->code[pc+1]);
+	 return 1;
+	}
+	return 0;
+ }
+}
+
+static void CompileGoto(FILE* D, int pc, int target)
+{
+ if (target!=pc+1) fprintf(D,"  aot_goto(%d)\n",target);
+}
+
+static int CompileFunction(FILE* D, const Proto* f, int n)
+{
+ int pc,i,next=n+1;
+ fprintf(D,"\n/* function <%s:%d> */\n",
+	(f->source) ? getstr(f->source) : "=?",f->linedefined);
+ fprintf(D,"static int aot_%d (hydrogen_State *L, CallInfo *ci) {\n",n);
+ fprintf(D,"  LClosure *cl = clLvalue(s2v(ci->func));\n"
+	   "  TValue *k = cl->p->k;\n"
+	   "  const Instruction *code = cl->p->code;\n"
+	   "  const Instruction *pc;\n"
+	   "  StkId base = ci->func + 1;\n"
+	   "  StkId ra;\n"
+	   "  Instruction i;\n"
+	   "  int trap = ci->u.l.trap;\n"
+	   "  UNUSED(k);\n"
+	   "  switch (ci->u.l.savedpc - code) {\n");
+ for (pc=0; pc<f->sizecode; pc++) fprintf(D,"    case %d: goto L_%d;\n",pc,pc);
+ fprintf(D,"    default: return AOT_EXIT;\n  }\n");
+ for (pc=0; pc<f->sizecode; pc++)
+ {
+  Instruction ins=f->code[pc];
+  OpCode o=GET_GENERICOP(ins);
+  const char* s;
+  int jump;
+  SET_OPCODE(ins,o);
+  fprintf(D," L_%d:  /* %s */\n",pc,opnames[o]);
+  fprintf(D,"  aot_fetch(%d, 0x%08lxu);\n  {\n",pc,(unsigned long)ins);
+  for (s=CompileBody(o); *s!=0; )
+  {
+   const char* e=strchr(s,'\n');
+   fprintf(D,"    %.*s\n",(int)(e-s),s);
+   s=e+1;
+  }
+  fprintf(D,"  }\n");
+  if (CompileSkips(f,pc)) CompileGoto(D,pc,pc+2);
+  if (CompileJump(f,pc,&jump)) CompileGoto(D,pc,pc+1+jump);
+ }
+ fprintf(D,"}\n");
+ for (i=0; i<f->sizep; i++) next=CompileFunction(D,f->p[i],next);
+ return next;
+}
+
+static size_t nbytes;			/* bytes of bytecode written so far */
+
+static int cwriter(hydrogen_State* L, const void* p, size_t size, void* u)
+{
+ const unsigned char* b=(const unsigned char*)p;
+ size_t i;
+ UNUSED(L);
+ for (i=0; i<size; i++)
+  fprintf((FILE*)u,"%s%u,",(nbytes++%16==0) ? "\n  " : "",(unsigned)b[i]);
+ return 0;
+}
+
+static void CompileChunk(hydrogen_State* L, const Proto* f, FILE* D)
+{
+ char name[64];
+ const char* base=(output==NULL) ? PROGNAME : output;
+ const char* s;
+ int i,n;
+ for (s=base; *s; s++) if (*s=='/' || *s=='\\') base=s+1;
+ for (i=0; base[i]!=0 && base[i]!='.' && i<(int)sizeof(name)-1; i++)
+  name[i]=isalnum((unsigned char)base[i]) ? base[i] : '_';
+ name[i]=0;
+ fprintf(D,"/* compiled by %s from %s; do not edit */\n\n",
+	progname,(f->source) ? getstr(f->source) : "=?");
+ fprintf(D,"#define HYDROGEN_CORE\n\n"
+	"#include \"prefix.h\"\n\n"
+	"#include \"hydrogen.h\"\n"
+	"#include \"auxlib.h\"\n\n"
+	"#include \"aot.h\"\n"
+	"#include \"do.h\"\n"
+	"#include \"execute.h\"\n"
+	"#include \"function.h\"\n\n"
+	"#if !defined(HYDROGEN_USE_AOT)\n"
+	"#error \"Hydrogen must be built with HYDROGEN_USE_AOT\"\n"
+	"#endif\n");
+ n=CompileFunction(D,f,0);
+ fprintf(D,"\nstatic const AOTFunction aot_functions[%d] = {",n);
+ for (i=0; i<n; i++) fprintf(D,"%s aot_%d,",(i%8==0) ? "\n " : "",i);
+ fprintf(D,"\n};\n\nstatic const unsigned char aot_code[] = {");
+ nbytes=0;
+ hydrogenU_dump(L,f,cwriter,D,stripping);
+ fprintf(D,"\n};\n\n");
+ fprintf(D,"HYDROGENMOD_API int hydrogenopen_%s (hydrogen_State *L) {\n"
+	"  int nargs = hydrogen_gettop(L);\n"
+	"  if (hydrogenL_loadbufferx(L, (const char *)aot_code, sizeof(aot_code),\n"
+	"                            \"=%s\", \"b\") != HYDROGEN_OK)\n"
+	"    return hydrogen_error(L);\n"
+	"  hydrogenF_installaot(L, aot_functions, %d, AOT_SIGNATURE);\n"
+	"  hydrogen_insert(L, 1);\n"
+	"  hydrogen_call(L, nargs, 1);\n"
+	"  return 1;\n"
+	"}\n",name,name,n);
+}
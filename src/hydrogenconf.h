@@ -131,6 +131,19 @@
 #endif
 
 
+/*
+@@ HYDROGEN_NANBOXING makes each value a single 8-byte word (see
+** 'object.h'), which halves the size of stacks, array parts, and
+** upvalues: floats are stored as themselves and all other values go in
+** the space of NaNs. Pointers must fit in 48 bits, and so do integers:
+** HYDROGEN_MAXINTEGER becomes 2^47 - 1 and integer arithmetic wraps
+** around modulo 2^48. (The C API still sees integers as HYDROGEN_INTEGER;
+** values outside that range are wrapped when they enter Hydrogen.) It
+** needs the default number types.
+*/
+/* #define HYDROGEN_NANBOXING */
+
+
 #if HYDROGEN_32BITS		/* { */
 /*
 ** 32-bit integers and 'float'
@@ -303,10 +316,12 @@
 ** this attribute. Unfortunately, gcc does not offer a way to check
 ** whether the target offers that support, and those without support
 ** give a warning about it. To avoid these warnings, change to the
-** default definition.
+** default definition. Code compiled ahead of time (see HYDROGEN_USE_AOT)
+** lives in outside modules and calls these functions, so they are not
+** hidden in that case.
 */
 #if defined(__GNUC__) && ((__GNUC__*100 + __GNUC_MINOR__) >= 302) && \
-    defined(__ELF__)		/* { */
+    defined(__ELF__) && !defined(HYDROGEN_USE_AOT)	/* { */
 #define HYDROGENI_FUNC	__attribute__((visibility("internal"))) extern
 #else				/* }{ */
 #define HYDROGENI_FUNC	extern
@@ -565,6 +580,22 @@
 
 #endif				/* } */
 
+
+#if defined(HYDROGEN_NANBOXING)		/* { */
+
+#if HYDROGEN_INT_TYPE != HYDROGEN_INT_LONGLONG || \
+    HYDROGEN_FLOAT_TYPE != HYDROGEN_FLOAT_DOUBLE
+#error "HYDROGEN_NANBOXING needs 'long long' integers and 'double' floats"
+#endif
+
+/* NaN-boxed integers have 48 bits */
+#undef HYDROGEN_MAXINTEGER
+#undef HYDROGEN_MININTEGER
+#define HYDROGEN_MAXINTEGER		0x7FFFFFFFFFFFLL
+#define HYDROGEN_MININTEGER		(-HYDROGEN_MAXINTEGER - 1)
+
+#endif					/* } */
+
 /* }================================================================== */
 
 
@@ -712,6 +743,46 @@
 #define hydrogeni_apicheck(l,e)	assert(e)
 #endif
 
+
+/*
+@@ HYDROGEN_USE_JIT turns on the baseline compiler of hot functions to
+** native code (see 'jit.c'). The Makefile defines it by default. The
+** compiler only knows x86-64, the default number types and 'mmap', so
+** it is turned off for other configurations. It is also off when
+** compiling Hydrogen as C++, because C++ exceptions cannot unwind
+** through native frames, and with HYDROGEN_NANBOXING, whose values
+** native code does not know.
+*/
+#if defined(HYDROGEN_USE_JIT)
+#if !defined(__x86_64__) || defined(__cplusplus) || defined(HYDROGEN_USE_C89) \
+    || defined(HYDROGEN_NANBOXING) \
+    || HYDROGEN_FLOAT_TYPE != HYDROGEN_FLOAT_DOUBLE \
+    || HYDROGEN_INT_TYPE == HYDROGEN_INT_INT \
+    || !(defined(__linux__) || defined(__APPLE__))
+#undef HYDROGEN_USE_JIT
+#endif
+#endif
+
+
+/*
+@@ HYDROGEN_USE_AOT lets Hydrogen run functions that 'hydrogenc -C'
+** compiled ahead of time to C (see 'aot.h'). The compiled code comes as
+** a C module, which must be compiled with the same configuration as
+** Hydrogen itself (the module checks that when it is loaded); the
+** Hydrogen executable must export its symbols (e.g., '-Wl,-E') so that
+** the module can use the internal functions of the interpreter. The
+** Makefile defines it by default.
+*/
+
+
+/*
+@@ HYDROGEN_COMPACTHASH keeps the hash part of tables as a dense vector
+** of entries in insertion order plus an index of small integers (see
+** 'table.c'). Traversals ('next', 'pairs') then visit the entries of
+** the hash part in the order they were inserted.
+*/
+/* #define HYDROGEN_COMPACTHASH */
+
 /* }================================================================== */
 
 
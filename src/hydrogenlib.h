@@ -44,6 +44,12 @@ HYDROGENMOD_API int (hydrogenopen_debug) (hydrogen_State *L);
 #define HYDROGEN_LOADLIBNAME	"package"
 HYDROGENMOD_API int (hydrogenopen_package) (hydrogen_State *L);
 
+#define HYDROGEN_REGEXLIBNAME	"regex"
+HYDROGENMOD_API int (hydrogenopen_regex) (hydrogen_State *L);
+
+#define HYDROGEN_JITLIBNAME	"jit"
+HYDROGENMOD_API int (hydrogenopen_jit) (hydrogen_State *L);
+
 
 /* open all previous libraries */
 HYDROGENLIB_API void (hydrogenL_openlibs) (hydrogen_State *L);
@@ -673,7 +673,9 @@ static int g_write (hydrogen_State *L, FILE *f, int arg) {
     }
     else {
       size_t l;
-      const char *s = hydrogenL_checklstring(L, arg, &l);
+      const char *s = hydrogenL_tostrbuf(L, arg, &l);  /* string buffer? */
+      if (s == NULL)
+        s = hydrogenL_checkbytes(L, arg, &l);
       status = status && (fwrite(s, sizeof(char), l, f) == l);
     }
   }
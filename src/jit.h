@@ -0,0 +1,94 @@
+/*
+** $Id: jit.h $
+** Compiler of hot functions and loops to native code
+** See Copyright Notice in hydrogen.h
+*/
+
+#ifndef jit_h
+#define jit_h
+
+#include "object.h"
+#include "state.h"
+
+
+#if defined(HYDROGEN_USE_JIT)
+
+/*
+** Results of running native code ('hydrogenJ_run'). Native code stops
+** at calls to Hydrogen functions and at returns, so that the interpreter
+** can go on running the callee (or the caller) in its own C frame.
+*/
+#define JIT_EXIT	0	/* hooks are on: continue interpreting at 'savedpc' */
+#define JIT_CALL	1	/* 'L->ci' is a new Hydrogen call ready to run */
+#define JIT_RETURN	2	/* the function returned ('hydrogenD_poscall' done) */
+
+
+/* default number of calls and loop iterations that make a function hot */
+#if !defined(JITTHRESHOLD)
+#define JITTHRESHOLD	200
+#endif
+
+
+/*
+** Count a hot event for 'p' and compile it when it crosses the
+** threshold; true if 'p' has native code. A negative count marks a
+** function that could not be compiled.
+*/
+#define hydrogenJ_hot(L,p)  \
+	((p)->hotcount >= 0 && ++(p)->hotcount >= G(L)->jitthreshold &&  \
+	 hydrogenJ_compile(L, p))
+
+
+/*
+** True if the function running in 'ci' has (or has just got) native
+** code. Only fresh calls ('savedpc' at the first instruction) count as
+** hot events.
+*/
+#define hydrogenJ_ready(L,p,ci)  \
+	(G(L)->jiton && ((p)->jit != NULL ||  \
+	   ((ci)->u.l.savedpc == (p)->code && hydrogenJ_hot(L, p))))
+
+
+/* true if a loop in 'p' should go on in native code */
+#define hydrogenJ_loop(L,p)  \
+	(G(L)->jiton && ((p)->jit != NULL || hydrogenJ_hot(L, p)))
+
+
+/*
+** State of a loop for the trace compiler, kept in 'loop.flags' of the
+** inline cache of its loop instruction (OP_FORLOOP or OP_TFORLOOP);
+** 'loop.count' counts its iterations.
+*/
+#define JIT_LOOPABORTS	0x0f	/* mask for the number of failed traces */
+#define JIT_LOOPNOBCE	0x10	/* trace must check bounds at each access */
+#define JIT_LOOPTRACED	0x20	/* loop has a trace */
+#define JIT_LOOPDEAD	0x40	/* loop will not be traced */
+
+
+/* failed recordings (or discarded traces) that make a loop dead */
+#if !defined(JITMAXABORTS)
+#define JITMAXABORTS	4
+#endif
+
+
+/* iterations of a loop that make it hot (a quarter of the threshold) */
+#define hydrogenJ_hotloop(g)	((g)->jitthreshold / 4 + 1)
+
+
+/* true if the loop with inline cache 'ic' may run (or record) a trace */
+#define hydrogenJ_traceable(L,ic)  \
+	(G(L)->jiton && !((ic)->loop.flags & JIT_LOOPDEAD))
+
+
+HYDROGENI_FUNC int hydrogenJ_compile (hydrogen_State *L, Proto *p);
+HYDROGENI_FUNC int hydrogenJ_run (hydrogen_State *L, CallInfo *ci);
+HYDROGENI_FUNC const Instruction *hydrogenJ_backedge (hydrogen_State *L,
+                                                     CallInfo *ci,
+                                                     const Instruction *lpc);
+HYDROGENI_FUNC int hydrogenJ_record (hydrogen_State *L,
+                                    const Instruction *pc);
+HYDROGENI_FUNC void hydrogenJ_free (hydrogen_State *L, Proto *p);
+
+#endif
+
+#endif
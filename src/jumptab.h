@@ -9,7 +9,13 @@
 #undef vmcase
 #undef vmbreak
 
+#if HYDROGEN_USE_DIRECTTHREADING
+/* handlers are predecoded in 'd' as offsets from this one */
+#define HANDLERBASE	cast(const char *, &&L_OP_MOVE)
+#define vmdispatch(x)     goto *(HANDLERBASE + d->handler);  /* 'x' predecoded */
+#else
 #define vmdispatch(x)     goto *disptab[x];
+#endif
 
 #define vmcase(l)     L_##l:
 
@@ -107,6 +113,22 @@ static const void *const disptab[NUM_OPCODES] = {
 &&L_OP_CLOSURE,
 &&L_OP_VARARG,
 &&L_OP_VARARGPREP,
-&&L_OP_EXTRAARG
+&&L_OP_EXTRAARG,
+&&L_OP_GETTABUP_CALL,
+&&L_OP_GETFIELD_CALL,
+&&L_OP_SELF_CALL,
+&&L_OP_ADD_II,
+&&L_OP_ADD_FF,
+&&L_OP_SUB_II,
+&&L_OP_SUB_FF,
+&&L_OP_MUL_II,
+&&L_OP_MUL_FF,
+&&L_OP_EQ_II,
+&&L_OP_LT_II,
+&&L_OP_LE_II,
+&&L_OP_GETTABLE_ARRAY,
+&&L_OP_GETI_ARRAY,
+&&L_OP_SETTABLE_ARRAY,
+&&L_OP_SETI_ARRAY
 
 };
@@ -204,6 +204,30 @@ typedef l_uint32 Instruction;
 #endif
 
 
+/*
+** Minimum length of a substring to be a view of the string holding
+** it (see 'hydrogenS_newsub'), and maximum ratio between the length of
+** that string and the length of the view, so that a small view does not
+** keep alive a large string.
+*/
+#if !defined(HYDROGENI_MINVIEW)
+#define HYDROGENI_MINVIEW	128
+#endif
+
+#if !defined(HYDROGENI_VIEWRATIO)
+#define HYDROGENI_VIEWRATIO	8
+#endif
+
+
+/*
+** Minimum length of a concatenation to be built in a block where later
+** concatenations can append to it (see 'hydrogenS_newcat').
+*/
+#if !defined(HYDROGENI_MINAPPEND)
+#define HYDROGENI_MINAPPEND	128
+#endif
+
+
 /*
 ** Initial size for the string table (must be power of 2).
 ** The Hydrogen core alone registers ~50 strings (reserved words +
@@ -0,0 +1,115 @@
+/*
+** $Id: aot.h $
+** Functions compiled ahead of time to C ('hydrogenc -C')
+** See Copyright Notice in hydrogen.h
+*/
+
+#ifndef aot_h
+#define aot_h
+
+#include "object.h"
+#include "state.h"
+#include "table.h"
+
+
+#if defined(HYDROGEN_USE_AOT)
+
+/*
+** 'hydrogenc -C' translates each function of a chunk to a C function
+** that runs its instructions with the same code as the interpreter
+** (see 'execute.h'), and writes them in a C module together with the
+** bytecode of the chunk. When loaded, the module loads the bytecode and
+** gives each prototype its compiled function (field 'aot'), which
+** 'hydrogenV_execute' then runs instead of interpreting the prototype.
+**
+** As native code from the JIT compiler (see 'jit.h'), a compiled
+** function stops at calls to Hydrogen functions and at returns, so that
+** the interpreter can go on running the callee (or the caller) in its
+** own C frame; the interpreter resumes the compiled function at the
+** instruction pointed by 'savedpc'. So, every instruction is an entry
+** point, which also lets coroutines yield and resume in the middle of a
+** compiled function. Compiled code does not call hooks: when line or
+** count hooks are on, it leaves the rest of the call to the interpreter.
+*/
+
+
+/* results of running a compiled function */
+#define AOT_EXIT	0	/* hooks are on: continue interpreting at 'savedpc' */
+#define AOT_CALL	1	/* 'L->ci' is a new Hydrogen call ready to run */
+#define AOT_RETURN	2	/* the function returned ('hydrogenD_poscall' done) */
+
+
+/*
+** Signature of the layout of the structures used by compiled code. A
+** module compiled with a different configuration from the one of the
+** running Hydrogen is refused when it is loaded.
+*/
+#define AOT_SIGNATURE  \
+	((cast_uint(HYDROGEN_VERSION_NUM) << 20) ^  \
+	 (cast_uint(sizeof(Proto)) << 12) ^ (cast_uint(sizeof(CallInfo)) << 6) ^  \
+	 cast_uint(sizeof(TValue)) ^ (cast_uint(sizeof(Instruction)) << 3) ^  \
+	 (cast_uint(arrcellsize) << 16) ^ (cast_uint(sizeof(global_State)) << 24))
+
+
+/*
+** {==================================================================
+** Macros for the code generated by 'hydrogenc -C'. Each instruction
+** 'n' of a function is a label 'L_n' in its C function; the bodies of
+** the instructions are those of 'hydrogenV_execute', written with the
+** macros in 'execute.h'.
+** ===================================================================
+*/
+
+/* leave the function; the interpreter goes on at instruction 'n' */
+#define aot_exit(n)	{ ci->u.l.savedpc = code + (n); return AOT_EXIT; }
+
+
+/*
+** Prepare the execution of instruction 'n', which is 'inst'. As in
+** 'vmfetch', a 'trap' means hooks or a stack reallocation; compiled
+** code only handles the second case.
+*/
+#define aot_fetch(n,inst)	{ \
+  if (l_unlikely(trap)) {  /* stack reallocation or hooks? */ \
+    if (L->hookmask & (HYDROGEN_MASKLINE | HYDROGEN_MASKCOUNT)) \
+      aot_exit(n);  /* let the interpreter call the hooks */ \
+    trap = ci->u.l.trap = 0; \
+    updatebase(ci);  /* correct stack */ \
+  } \
+  i = (inst); \
+  pc = code + (n) + 1; \
+  ra = RA(i); \
+}
+
+
+/* continue at instruction 'n' if the last instruction jumped there */
+#define aot_goto(n)	if (pc == code + (n)) goto L_##n;
+
+
+/* returns with hooks on are left to the interpreter */
+#define aot_hookret()	\
+	{ if (l_unlikely(L->hookmask)) aot_exit(pcRel(pc, cl->p)); }
+
+
+/* OP_CALL; the interpreter runs the called Hydrogen functions */
+#define aot_call() {  \
+  int b = GETARG_B(i);  \
+  int nresults = GETARG_C(i) - 1;  \
+  if (b != 0)  /* fixed number of arguments? */  \
+    L->top = ra + b;  /* top signals number of arguments */  \
+  /* else previous instruction set top */  \
+  savepc(L);  /* in case of errors */  \
+  if (hydrogenD_precall(L, ra, nresults) != NULL)  \
+    return AOT_CALL;  /* Hydrogen call */  \
+  updatetrap(ci);  /* C call; nothing else to be done */ }
+
+
+/* comparisons of numbers (for 'op_order') */
+#define aot_LTnum(l,r)	hydrogenV_lessthan(L, l, r)
+#define aot_LEnum(l,r)	hydrogenV_lessequal(L, l, r)
+
+/* }================================================================== */
+
+#endif
+
+#endif
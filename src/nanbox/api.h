@@ -0,0 +1,49 @@
+/*
+** $Id: lapi.h $
+** Auxiliary functions from Hydrogen API
+** See Copyright Notice in hydrogen.h
+*/
+
+#ifndef api_h
+#define api_h
+
+
+#include "limits.h"
+#include "state.h"
+
+
+/* Increments 'L->top', checking for stack overflows */
+#define api_incr_top(L)   {L->top++; api_check(L, L->top <= L->ci->top, \
+				"stack overflow");}
+
+
+/*
+** If a call returns too many multiple returns, the callee may not have
+** stack space to accommodate all results. In this case, this macro
+** increases its stack space ('L->ci->top').
+*/
+#define adjustresults(L,nres) \
+    { if ((nres) <= HYDROGEN_MULTRET && L->ci->top < L->top) L->ci->top = L->top; }
+
+
+/* Ensure the stack has at least 'n' elements */
+#define api_checknelems(L,n)	api_check(L, (n) < (L->top - L->ci->func), \
+				  "not enough elements in the stack")
+
+
+/*
+** To reduce the overhead of returning from C functions, the presence of
+** to-be-closed variables in these functions is coded in the CallInfo's
+** field 'nresults', in a way that functions with no to-be-closed variables
+** with zero, one, or "all" wanted results have no overhead. Functions
+** with other number of wanted results, as well as functions with
+** variables to be closed, have an extra check.
+*/
+
+#define hastocloseCfunc(n)	((n) < HYDROGEN_MULTRET)
+
+/* Map [-1, inf) (range of 'nresults') into (-inf, -2] */
+#define codeNresults(n)		(-(n) - 3)
+#define decodeNresults(n)	(-(n) - 3)
+
+#endif
\ No newline at end of file
@@ -0,0 +1,396 @@
+/*
+** $Id: function.c $
+** Auxiliary functions to manipulate prototypes and closures
+** See Copyright Notice in hydrogen.h
+*/
+
+#define function_c
+#define HYDROGEN_CORE
+
+#include "prefix.h"
+
+
+#include <stddef.h>
+
+#include "hydrogen.h"
+
+#include "aot.h"
+#include "debug.h"
+#include "do.h"
+#include "function.h"
+#include "garbageCollection.h"
+#include "jit.h"
+#include "memory.h"
+#include "object.h"
+#include "opcodes.h"
+#include "state.h"
+
+
+
+CClosure *hydrogenF_newCclosure (hydrogen_State *L, int nupvals) {
+  GCObject *o = hydrogenC_newobj(L, HYDROGEN_VCCL, sizeCclosure(nupvals));
+  CClosure *c = gco2ccl(o);
+  c->nupvalues = cast_byte(nupvals);
+  return c;
+}
+
+
+LClosure *hydrogenF_newLclosure (hydrogen_State *L, int nupvals) {
+  GCObject *o = hydrogenC_newobj(L, HYDROGEN_VLCL, sizeLclosure(nupvals));
+  LClosure *c = gco2lcl(o);
+  c->p = NULL;
+  c->nupvalues = cast_byte(nupvals);
+  while (nupvals--) c->upvals[nupvals] = NULL;
+  return c;
+}
+
+
+/*
+** fill a closure with new closed upvalues
+*/
+void hydrogenF_initupvals (hydrogen_State *L, LClosure *cl) {
+  int i;
+  for (i = 0; i < cl->nupvalues; i++) {
+    GCObject *o = hydrogenC_newobj(L, HYDROGEN_VUPVAL, sizeof(UpVal));
+    UpVal *uv = gco2upv(o);
+    uv->v = &uv->u.value;  /* make it closed */
+    setnilvalue(uv->v);
+    cl->upvals[i] = uv;
+    hydrogenC_objbarrier(L, cl, uv);
+  }
+}
+
+
+/*
+** Create a new upvalue at the given level, and link it to the list of
+** open upvalues of 'L' after entry 'prev'.
+**/
+static UpVal *newupval (hydrogen_State *L, int tbc, StkId level, UpVal **prev) {
+  GCObject *o = hydrogenC_newobj(L, HYDROGEN_VUPVAL, sizeof(UpVal));
+  UpVal *uv = gco2upv(o);
+  UpVal *next = *prev;
+  uv->v = s2v(level);  /* current value lives in the stack */
+  uv->tbc = tbc;
+  uv->u.open.next = next;  /* link it to list of open upvalues */
+  uv->u.open.previous = prev;
+  if (next)
+    next->u.open.previous = &uv->u.open.next;
+  *prev = uv;
+  if (!isintwups(L)) {  /* thread not in list of threads with upvalues? */
+    L->twups = G(L)->twups;  /* link it to the list */
+    G(L)->twups = L;
+  }
+  return uv;
+}
+
+
+/*
+** Find and reuse, or create if it does not exist, an upvalue
+** at the given level.
+*/
+UpVal *hydrogenF_findupval (hydrogen_State *L, StkId level) {
+  UpVal **pp = &L->openupval;
+  UpVal *p;
+  hydrogen_assert(isintwups(L) || L->openupval == NULL);
+  while ((p = *pp) != NULL && uplevel(p) >= level) {  /* search for it */
+    hydrogen_assert(!isdead(G(L), p));
+    if (uplevel(p) == level)  /* corresponding upvalue? */
+      return p;  /* return it */
+    pp = &p->u.open.next;
+  }
+  /* not found: create a new upvalue after 'pp' */
+  return newupval(L, 0, level, pp);
+}
+
+
+/*
+** Call closing method for object 'obj' with error message 'err'. The
+** boolean 'yy' controls whether the call is yieldable.
+** (This function assumes EXTRA_STACK.)
+*/
+static void callclosemethod (hydrogen_State *L, TValue *obj, TValue *err, int yy) {
+  StkId top = L->top;
+  const TValue *tm = hydrogenT_gettmbyobj(L, obj, TM_CLOSE);
+  setobj2s(L, top, tm);  /* will call metamethod... */
+  setobj2s(L, top + 1, obj);  /* with 'self' as the 1st argument */
+  setobj2s(L, top + 2, err);  /* and error msg. as 2nd argument */
+  L->top = top + 3;  /* add function and arguments */
+  if (yy)
+    hydrogenD_call(L, top, 0);
+  else
+    hydrogenD_callnoyield(L, top, 0);
+}
+
+
+/*
+** Check whether object at given level has a close metamethod and raise
+** an error if not.
+*/
+static void checkclosemth (hydrogen_State *L, StkId level) {
+  const TValue *tm = hydrogenT_gettmbyobj(L, s2v(level), TM_CLOSE);
+  if (ttisnil(tm)) {  /* no metamethod? */
+    int idx = cast_int(level - L->ci->func);  /* variable index */
+    const char *vname = hydrogenG_findlocal(L, L->ci, idx, NULL);
+    if (vname == NULL) vname = "?";
+    hydrogenG_runerror(L, "variable '%s' Hydrogent a non-closable value", vname);
+  }
+}
+
+
+/*
+** Prepare and call a closing method.
+** If status is CLOSEKTOP, the call to the closing method will be pushed
+** at the top of the stack. Otherwise, values can be pushed right after
+** the 'level' of the upvalue being closed, as everything after that
+** won't be used again.
+*/
+static void prepcallclosemth (hydrogen_State *L, StkId level, int status, int yy) {
+  TValue *uv = s2v(level);  /* value being closed */
+  TValue *errobj;
+  if (status == CLOSEKTOP)
+    errobj = &G(L)->nilvalue;  /* error object is nil */
+  else {  /* 'hydrogenD_seterrorobj' will set top to level + 2 */
+    errobj = s2v(level + 1);  /* error object Hydrogenes after 'uv' */
+    hydrogenD_seterrorobj(L, status, level + 1);  /* set error object */
+  }
+  callclosemethod(L, uv, errobj, yy);
+}
+
+
+/*
+** Maximum value for deltas in 'tbclist', dependent on the type
+** of delta. (This macro assumes that an 'L' is in scope where it
+** is used.)
+*/
+#define MAXDELTA  \
+	((256ul << ((sizeof(tbcdelta(L, L->stack)) - 1) * 8)) - 1)
+
+
+/*
+** Insert a variable in the list of to-be-closed variables.
+*/
+void hydrogenF_newtbhydrogenval (hydrogen_State *L, StkId level) {
+  hydrogen_assert(level > L->tbclist);
+  if (l_isfalse(s2v(level)))
+    return;  /* false doesn't need to be closed */
+  checkclosemth(L, level);  /* value must have a close method */
+  while (cast_uint(level - L->tbclist) > MAXDELTA) {
+    L->tbclist += MAXDELTA;  /* create a dummy node at maximum delta */
+    tbcdelta(L, L->tbclist) = 0;
+  }
+  tbcdelta(L, level) = cast(unsigned short, level - L->tbclist);
+  L->tbclist = level;
+}
+
+
+void hydrogenF_unlinkupval (UpVal *uv) {
+  hydrogen_assert(upisopen(uv));
+  *uv->u.open.previous = uv->u.open.next;
+  if (uv->u.open.next)
+    uv->u.open.next->u.open.previous = uv->u.open.previous;
+}
+
+
+/*
+** Close all upvalues up to the given stack level.
+*/
+void hydrogenF_closeupval (hydrogen_State *L, StkId level) {
+  UpVal *uv;
+  StkId upl;  /* stack index pointed by 'uv' */
+  while ((uv = L->openupval) != NULL && (upl = uplevel(uv)) >= level) {
+    TValue *slot = &uv->u.value;  /* new position for value */
+    hydrogen_assert(uplevel(uv) < L->top);
+    hydrogenF_unlinkupval(uv);  /* remove upvalue from 'openupval' list */
+    setobj(L, slot, uv->v);  /* move value to upvalue slot */
+    uv->v = slot;  /* now current value lives here */
+    if (!iswhite(uv)) {  /* neither white nor dead? */
+      nw2black(uv);  /* closed upvalues cannot be gray */
+      hydrogenC_barrier(L, uv, slot);
+    }
+  }
+}
+
+
+/*
+** Remove firt element from the tbclist plus its dummy nodes.
+*/
+static void poptbclist (hydrogen_State *L) {
+  StkId tbc = L->tbclist;
+  hydrogen_assert(tbcdelta(L, tbc) > 0);  /* first element cannot be dummy */
+  tbc -= tbcdelta(L, tbc);
+  while (tbc > L->stack && tbcdelta(L, tbc) == 0)
+    tbc -= MAXDELTA;  /* remove dummy nodes */
+  L->tbclist = tbc;
+}
+
+
+/*
+** Close all upvalues and to-be-closed variables up to the given stack
+** level.
+*/
+void hydrogenF_close (hydrogen_State *L, StkId level, int status, int yy) {
+  ptrdiff_t levelrel = savestack(L, level);
+  hydrogenF_closeupval(L, level);  /* first, close the upvalues */
+  while (L->tbclist >= level) {  /* traverse tbc's down to that level */
+    StkId tbc = L->tbclist;  /* get variable index */
+    poptbclist(L);  /* remove it from list */
+    prepcallclosemth(L, tbc, status, yy);  /* close variable */
+    level = restorestack(L, levelrel);
+  }
+}
+
+
+Proto *hydrogenF_newproto (hydrogen_State *L) {
+  GCObject *o = hydrogenC_newobj(L, HYDROGEN_VPROTO, sizeof(Proto));
+  Proto *f = gco2p(o);
+  f->k = NULL;
+  f->sizek = 0;
+  f->p = NULL;
+  f->sizep = 0;
+  f->code = NULL;
+  f->sizecode = 0;
+  f->icache = NULL;
+  f->dcode = NULL;
+  f->lineinfo = NULL;
+  f->sizelineinfo = 0;
+  f->abslineinfo = NULL;
+  f->sizeabslineinfo = 0;
+  f->upvalues = NULL;
+  f->sizeupvalues = 0;
+  f->numparams = 0;
+  f->is_vararg = 0;
+  f->maxstacksize = 0;
+  f->locvars = NULL;
+  f->sizelocvars = 0;
+  f->linedefined = 0;
+  f->lastlinedefined = 0;
+  f->source = NULL;
+#if defined(HYDROGEN_USE_JIT)
+  f->hotcount = 0;
+  f->jit = NULL;
+  f->trace = NULL;
+#endif
+#if defined(HYDROGEN_USE_AOT)
+  f->aot = NULL;
+#endif
+  return f;
+}
+
+
+/*
+** Create the inline caches for a prototype whose code is complete.
+** All hints start at node 0; a wrong hint only costs a normal lookup.
+*/
+void hydrogenF_newicache (hydrogen_State *L, Proto *f) {
+  int i;
+  hydrogen_assert(f->icache == NULL);
+  f->icache = hydrogenM_newvector(L, f->sizecode, ICache);
+  for (i = 0; i < f->sizecode; i++)
+    f->icache[i].field.slot = f->icache[i].field.islot = 0;
+}
+
+
+/*
+** Peephole pass over complete code: fuse an instruction with the OP_CALL
+** that follows it when the call uses the value the instruction has just
+** produced (see the notes about fused opcodes in 'opcodes.h'). Run for
+** new functions and again for loaded ones, as dumps carry no fused
+** opcodes.
+*/
+void hydrogenF_fusecode (Instruction *code, int n) {
+  int i;
+  for (i = 0; i + 1 < n; i++) {
+    Instruction next = code[i + 1];
+    OpCode fused;
+    if (GET_OPCODE(next) != OP_CALL || GETARG_B(next) == 0 ||
+        GETARG_A(next) != GETARG_A(code[i]))
+      continue;  /* not a call of the value built here */
+    switch (GET_OPCODE(code[i])) {
+      case OP_GETTABUP: fused = OP_GETTABUP_CALL; break;
+      case OP_GETFIELD: fused = OP_GETFIELD_CALL; break;
+      case OP_SELF: fused = OP_SELF_CALL; break;
+      default: continue;
+    }
+    SET_OPCODE(code[i], fused);
+    i++;  /* the call cannot start another fusion */
+  }
+}
+
+
+#if defined(HYDROGEN_USE_AOT)
+
+/*
+** Give the compiled functions in 'f' to 'p' and to the functions nested
+** in it, in the order used by 'hydrogenc -C': each function comes before
+** the functions nested in it. Returns the number of functions used (-1
+** if 'f' does not have enough of them).
+*/
+static int installaot (Proto *p, const AOTFunction *f, int n) {
+  int used = 1;
+  int i;
+  if (n < 1)
+    return -1;
+  p->aot = f[0];
+  for (i = 0; i < p->sizep; i++) {
+    int u = installaot(p->p[i], f + used, n - used);
+    if (u < 0)
+      return -1;
+    used += u;
+  }
+  return used;
+}
+
+
+/*
+** Install the 'n' compiled functions in 'f' in the Hydrogen function on
+** the top of the stack, which must be the chunk they were compiled from.
+** 'signature' is the value of AOT_SIGNATURE in the compiled module.
+*/
+void hydrogenF_installaot (hydrogen_State *L, const AOTFunction *f, int n,
+                                              unsigned int signature) {
+  const TValue *o = s2v(L->top - 1);
+  if (signature != AOT_SIGNATURE)
+    hydrogenG_runerror(L, "compiled module does not match the "
+                          "configuration of this Hydrogen");
+  if (!ttisLclosure(o) || installaot(clLvalue(o)->p, f, n) != n)
+    hydrogenG_runerror(L, "compiled module does not match its bytecode");
+}
+
+#endif
+
+
+void hydrogenF_freeproto (hydrogen_State *L, Proto *f) {
+#if defined(HYDROGEN_USE_JIT)
+  hydrogenJ_free(L, f);  /* native code and traces */
+#endif
+  if (f->icache != NULL)  /* prototype may be incomplete (e.g., errors) */
+    hydrogenM_freearray(L, f->icache, f->sizecode);
+  if (f->dcode != NULL)  /* prototype has run? */
+    hydrogenM_freearray(L, f->dcode, f->sizecode);
+  hydrogenM_freearray(L, f->code, f->sizecode);
+  hydrogenM_freearray(L, f->p, f->sizep);
+  hydrogenM_freearray(L, f->k, f->sizek);
+  hydrogenM_freearray(L, f->lineinfo, f->sizelineinfo);
+  hydrogenM_freearray(L, f->abslineinfo, f->sizeabslineinfo);
+  hydrogenM_freearray(L, f->locvars, f->sizelocvars);
+  hydrogenM_freearray(L, f->upvalues, f->sizeupvalues);
+  hydrogenM_free(L, f);
+}
+
+
+/*
+** Look for n-th local variable at line 'line' in function 'func'.
+** Returns NULL if not found.
+*/
+const char *hydrogenF_getlocalname (const Proto *f, int local_number, int pc) {
+  int i;
+  for (i = 0; i<f->sizelocvars && f->locvars[i].startpc <= pc; i++) {
+    if (pc < f->locvars[i].endpc) {  /* is variable active? */
+      local_number--;
+      if (local_number == 0)
+        return getstr(f->locvars[i].varname);
+    }
+  }
+  return NULL;  /* not found */
+}
+
@@ -0,0 +1,664 @@
+/*
+** $Id: hydrogen.c $
+** Hydrogen stand-alone interpreter
+** See Copyright Notice in hydrogen.h
+*/
+
+#define hydrogen_c
+
+#include "prefix.h"
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <signal.h>
+
+#include "hydrogen.h"
+
+#include "auxlib.h"
+#include "hydrogenlib.h"
+
+
+#if !defined(HYDROGEN_PROGNAME)
+#define HYDROGEN_PROGNAME		"hydrogen"
+#endif
+
+#if !defined(HYDROGEN_INIT_VAR)
+#define HYDROGEN_INIT_VAR		"HYDROGEN_INIT"
+#endif
+
+#define HYDROGEN_INITVARVERSION	HYDROGEN_INIT_VAR HYDROGEN_VERSUFFIX
+
+
+static hydrogen_State *globalL = NULL;
+
+static const char *progname = HYDROGEN_PROGNAME;
+
+
+#if defined(HYDROGEN_USE_POSIX)   /* { */
+
+/*
+** Use 'sigaction' when available.
+*/
+static void setsignal (int sig, void (*handler)(int)) {
+  struct sigaction sa;
+  sa.sa_handler = handler;
+  sa.sa_flags = 0;
+  sigemptyset(&sa.sa_mask);  /* do not mask any signal */
+  sigaction(sig, &sa, NULL);
+}
+
+#else           /* }{ */
+
+#define setsignal            signal
+
+#endif                               /* } */
+
+
+/*
+** Hook set by signal function to stop the interpreter.
+*/
+static void lstop (hydrogen_State *L, hydrogen_Debug *ar) {
+  (void)ar;  /* unused arg. */
+  hydrogen_sethook(L, NULL, 0, 0);  /* reset hook */
+  hydrogenL_error(L, "interrupted!");
+}
+
+
+/*
+** Function to be called at a C signal. Because a C signal cannot
+** just change a Hydrogen state (as there is no proper synchronization),
+** this function only sets a hook that, when called, will stop the
+** interpreter.
+*/
+static void laction (int i) {
+  int flag = HYDROGEN_MASKCALL | HYDROGEN_MASKRET | HYDROGEN_MASKLINE | HYDROGEN_MASKCOUNT;
+  setsignal(i, SIG_DFL); /* if another SIGINT happens, terminate process */
+  hydrogen_sethook(globalL, lstop, flag, 1);
+}
+
+
+static void print_usage (const char *badoption) {
+  hydrogen_writestringerror("%s: ", progname);
+  if (badoption[1] == 'e' || badoption[1] == 'l')
+    hydrogen_writestringerror("'%s' needs argument\n", badoption);
+  else
+    hydrogen_writestringerror("unrecognized option '%s'\n", badoption);
+  hydrogen_writestringerror(
+  "usage: %s [options] [script [args]]\n"
+  "Available options are:\n"
+  "  -e stat   execute string 'stat'\n"
+  "  -i        enter interactive mode after executing 'script'\n"
+  "  -l mod    require library 'mod' into global 'mod'\n"
+  "  -l g=mod  require library 'mod' into global 'g'\n"
+  "  -v        show version information\n"
+  "  -E        ignore environment variables\n"
+  "  -W        turn warnings on\n"
+  "  --        stop handling options\n"
+  "  -         stop handling options and execute stdin\n"
+  ,
+  progname);
+}
+
+
+/*
+** Prints an error message, adding the program name in front of it
+** (if present)
+*/
+static void l_message (const char *pname, const char *msg) {
+  if (pname) hydrogen_writestringerror("%s: ", pname);
+  hydrogen_writestringerror("%s\n", msg);
+}
+
+
+/*
+** Check whether 'status' is not OK and, if so, prints the error
+** message on the top of the stack. It assumes that the error object
+** is a string, as it was either generated by Hydrogen or by 'msghandler'.
+*/
+static int report (hydrogen_State *L, int status) {
+  if (status != HYDROGEN_OK) {
+    const char *msg = hydrogen_tostring(L, -1);
+    l_message(progname, msg);
+    hydrogen_pop(L, 1);  /* remove message */
+  }
+  return status;
+}
+
+
+/*
+** Message handler used to run all chunks
+*/
+static int msghandler (hydrogen_State *L) {
+  const char *msg = hydrogen_tostring(L, 1);
+  if (msg == NULL) {  /* is error object not a string? */
+    if (hydrogenL_callmeta(L, 1, "__tostring") &&  /* does it have a metamethod */
+        hydrogen_type(L, -1) == HYDROGEN_TSTRING)  /* that produces a string? */
+      return 1;  /* that is the message */
+    else
+      msg = hydrogen_pushfstring(L, "(error object is a %s value)",
+                               hydrogenL_typename(L, 1));
+  }
+  hydrogenL_traceback(L, L, msg, 1);  /* append a standard traceback */
+  return 1;  /* return the traceback */
+}
+
+
+/*
+** Interface to 'hydrogen_pcall', which sets appropriate message function
+** and C-signal handler. Used to run all chunks.
+*/
+static int docall (hydrogen_State *L, int narg, int nres) {
+  int status;
+  int base = hydrogen_gettop(L) - narg;  /* function index */
+  hydrogen_pushcfunction(L, msghandler);  /* push message handler */
+  hydrogen_insert(L, base);  /* put it under function and args */
+  globalL = L;  /* to be available to 'laction' */
+  setsignal(SIGINT, laction);  /* set C-signal handler */
+  status = hydrogen_pcall(L, narg, nres, base);
+  setsignal(SIGINT, SIG_DFL); /* reset C-signal handler */
+  hydrogen_remove(L, base);  /* remove message handler from the stack */
+  return status;
+}
+
+
+static void print_version (void) {
+  hydrogen_writestring(HYDROGEN_COPYRIGHT, strlen(HYDROGEN_COPYRIGHT));
+  hydrogen_writeline();
+}
+
+
+/*
+** Create the 'arg' table, which stores all arguments from the
+** command line ('argv'). It should be aligned so that, at index 0,
+** it has 'argv[script]', which is the script name. The arguments
+** to the script (everything after 'script') Hydrogen to positive indices;
+** other arguments (before the script name) Hydrogen to negative indices.
+** If there is no script name, assume interpreter's name as base.
+*/
+static void createargtable (hydrogen_State *L, char **argv, int argc, int script) {
+  int i, narg;
+  if (script == argc) script = 0;  /* no script name? */
+  narg = argc - (script + 1);  /* number of positive indices */
+  hydrogen_createtable(L, narg, script + 1);
+  for (i = 0; i < argc; i++) {
+    hydrogen_pushstring(L, argv[i]);
+    hydrogen_rawseti(L, -2, i - script);
+  }
+  hydrogen_setglobal(L, "arg");
+}
+
+
+static int dochunk (hydrogen_State *L, int status) {
+  if (status == HYDROGEN_OK) status = docall(L, 0, 0);
+  return report(L, status);
+}
+
+
+static int dofile (hydrogen_State *L, const char *name) {
+  return dochunk(L, hydrogenL_loadfile(L, name));
+}
+
+
+static int dostring (hydrogen_State *L, const char *s, const char *name) {
+  return dochunk(L, hydrogenL_loadbuffer(L, s, strlen(s), name));
+}
+
+
+/*
+** Receives 'globname[=modname]' and runs 'globname = require(modname)'.
+*/
+static int dolibrary (hydrogen_State *L, char *globname) {
+  int status;
+  char *modname = strchr(globname, '=');
+  if (modname == NULL)  /* no explicit name? */
+    modname = globname;  /* module name is equal to global name */
+  else {
+    *modname = '\0';  /* global name ends here */
+    modname++;  /* module name starts after the '=' */
+  }
+  hydrogen_getglobal(L, "require");
+  hydrogen_pushstring(L, modname);
+  status = docall(L, 1, 1);  /* call 'require(modname)' */
+  if (status == HYDROGEN_OK)
+    hydrogen_setglobal(L, globname);  /* globname = require(modname) */
+  return report(L, status);
+}
+
+
+/*
+** Push on the stack the contents of table 'arg' from 1 to #arg
+*/
+static int pushargs (hydrogen_State *L) {
+  int i, n;
+  if (hydrogen_getglobal(L, "arg") != HYDROGEN_TTABLE)
+    hydrogenL_error(L, "'arg' is not a table");
+  n = (int)hydrogenL_len(L, -1);
+  hydrogenL_checkstack(L, n + 3, "too many arguments to script");
+  for (i = 1; i <= n; i++)
+    hydrogen_rawgeti(L, -i, i);
+  hydrogen_remove(L, -i);  /* remove table from the stack */
+  return n;
+}
+
+
+static int handle_script (hydrogen_State *L, char **argv) {
+  int status;
+  const char *fname = argv[0];
+  if (strcmp(fname, "-") == 0 && strcmp(argv[-1], "--") != 0)
+    fname = NULL;  /* stdin */
+  status = hydrogenL_loadfile(L, fname);
+  if (status == HYDROGEN_OK) {
+    int n = pushargs(L);  /* push arguments to script */
+    status = docall(L, n, HYDROGEN_MULTRET);
+  }
+  return report(L, status);
+}
+
+
+/* bits of various argument indicators in 'args' */
+#define has_error	1	/* bad option */
+#define has_i		2	/* -i */
+#define has_v		4	/* -v */
+#define has_e		8	/* -e */
+#define has_E		16	/* -E */
+
+
+/*
+** Traverses all arguments from 'argv', returning a mask with those
+** needed before running any Hydrogen code (or an error code if it finds
+** any invalid argument). 'first' returns the first not-handled argument
+** (either the script name or a bad argument in case of error).
+*/
+static int collectargs (char **argv, int *first) {
+  int args = 0;
+  int i;
+  for (i = 1; argv[i] != NULL; i++) {
+    *first = i;
+    if (argv[i][0] != '-')  /* not an option? */
+        return args;  /* stop handling options */
+    switch (argv[i][1]) {  /* else check option */
+      case '-':  /* '--' */
+        if (argv[i][2] != '\0')  /* extra characters after '--'? */
+          return has_error;  /* invalid option */
+        *first = i + 1;
+        return args;
+      case '\0':  /* '-' */
+        return args;  /* script "name" is '-' */
+      case 'E':
+        if (argv[i][2] != '\0')  /* extra characters? */
+          return has_error;  /* invalid option */
+        args |= has_E;
+        break;
+      case 'W':
+        if (argv[i][2] != '\0')  /* extra characters? */
+          return has_error;  /* invalid option */
+        break;
+      case 'i':
+        args |= has_i;  /* (-i implies -v) *//* FALLTHROUGH */
+      case 'v':
+        if (argv[i][2] != '\0')  /* extra characters? */
+          return has_error;  /* invalid option */
+        args |= has_v;
+        break;
+      case 'e':
+        args |= has_e;  /* FALLTHROUGH */
+      case 'l':  /* both options need an argument */
+        if (argv[i][2] == '\0') {  /* no concatenated argument? */
+          i++;  /* try next 'argv' */
+          if (argv[i] == NULL || argv[i][0] == '-')
+            return has_error;  /* no next argument or it is another option */
+        }
+        break;
+      default:  /* invalid option */
+        return has_error;
+    }
+  }
+  *first = i;  /* no script name */
+  return args;
+}
+
+
+/*
+** Processes options 'e' and 'l', which involve running Hydrogen code, and
+** 'W', which also affects the state.
+** Returns 0 if some code raises an error.
+*/
+static int runargs (hydrogen_State *L, char **argv, int n) {
+  int i;
+  for (i = 1; i < n; i++) {
+    int option = argv[i][1];
+    hydrogen_assert(argv[i][0] == '-');  /* already checked */
+    switch (option) {
+      case 'e':  case 'l': {
+        int status;
+        char *extra = argv[i] + 2;  /* both options need an argument */
+        if (*extra == '\0') extra = argv[++i];
+        hydrogen_assert(extra != NULL);
+        status = (option == 'e')
+                 ? dostring(L, extra, "=(command line)")
+                 : dolibrary(L, extra);
+        if (status != HYDROGEN_OK) return 0;
+        break;
+      }
+      case 'W':
+        hydrogen_warning(L, "@on", 0);  /* warnings on */
+        break;
+    }
+  }
+  return 1;
+}
+
+
+static int handle_hydrogeninit (hydrogen_State *L) {
+  const char *name = "=" HYDROGEN_INITVARVERSION;
+  const char *init = getenv(name + 1);
+  if (init == NULL) {
+    name = "=" HYDROGEN_INIT_VAR;
+    init = getenv(name + 1);  /* try alternative name */
+  }
+  if (init == NULL) return HYDROGEN_OK;
+  else if (init[0] == '@')
+    return dofile(L, init+1);
+  else
+    return dostring(L, init, name);
+}
+
+
+/*
+** {==================================================================
+** Read-Eval-Print Loop (REPL)
+** ===================================================================
+*/
+
+#if !defined(HYDROGEN_PROMPT)
+#define HYDROGEN_PROMPT		"\x1b[34m💧 ==> \x1b[0m"
+#define HYDROGEN_PROMPT2		"\x1b[34m⚛️ ==>> \x1b[0m"
+#endif
+
+#if !defined(HYDROGEN_MAXINPUT)
+#define HYDROGEN_MAXINPUT		512
+#endif
+
+/*
+** hydrogen_stdin_is_tty detects whether the standard input is a 'tty' (that
+** is, whether we're running hydrogen interactively).
+*/
+#if !defined(hydrogen_stdin_is_tty)	/* { */
+
+#if defined(HYDROGEN_USE_POSIX)	/* { */
+
+#include <unistd.h>
+#define hydrogen_stdin_is_tty()	isatty(0)
+
+#elif defined(HYDROGEN_USE_WINDOWS)	/* }{ */
+
+#include <io.h>
+#include <windows.h>
+
+#define hydrogen_stdin_is_tty()	_isatty(_fileno(stdin))
+
+#else				/* }{ */
+
+/* ISO C definition */
+#define hydrogen_stdin_is_tty()	1  /* assume stdin is a tty */
+
+#endif				/* } */
+
+#endif				/* } */
+
+
+/*
+** hydrogen_readline defines how to show a prompt and then read a line from
+** the standard input.
+** hydrogen_saveline defines how to "save" a read line in a "history".
+** hydrogen_freeline defines how to free a line read by hydrogen_readline.
+*/
+#if !defined(hydrogen_readline)	/* { */
+
+#if defined(HYDROGEN_USE_READLINE)	/* { */
+
+#include <readline/readline.h>
+#include <readline/history.h>
+#define hydrogen_initreadline(L)	((void)L, rl_readline_name="hydrogen")
+#define hydrogen_readline(L,b,p)	((void)L, ((b)=readline(p)) != NULL)
+#define hydrogen_saveline(L,line)	((void)L, add_history(line))
+#define hydrogen_freeline(L,b)	((void)L, free(b))
+
+#else				/* }{ */
+
+#define hydrogen_initreadline(L)  ((void)L)
+#define hydrogen_readline(L,b,p) \
+        ((void)L, fputs(p, stdout), fflush(stdout),  /* show prompt */ \
+        fgets(b, HYDROGEN_MAXINPUT, stdin) != NULL)  /* get line */
+#define hydrogen_saveline(L,line)	{ (void)L; (void)line; }
+#define hydrogen_freeline(L,b)	{ (void)L; (void)b; }
+
+#endif				/* } */
+
+#endif				/* } */
+
+
+/*
+** Return the string to be used as a prompt by the interpreter. Leave
+** the string (or nil, if using the default value) on the stack, to keep
+** it anchored.
+*/
+static const char *get_prompt (hydrogen_State *L, int firstline) {
+  if (hydrogen_getglobal(L, firstline ? "_PROMPT" : "_PROMPT2") == HYDROGEN_TNIL)
+    return (firstline ? HYDROGEN_PROMPT : HYDROGEN_PROMPT2);  /* use the default */
+  else {  /* apply 'tostring' over the value */
+    const char *p = hydrogenL_tolstring(L, -1, NULL);
+    hydrogen_remove(L, -2);  /* remove original value */
+    return p;
+  }
+}
+
+/* mark in error messages for incomplete statements */
+#define EOFMARK		"<eof>"
+#define marklen		(sizeof(EOFMARK)/sizeof(char) - 1)
+
+
+/*
+** Check whether 'status' signals a syntax error and the error
+** message at the top of the stack ends with the above mark for
+** incomplete statements.
+*/
+static int incomplete (hydrogen_State *L, int status) {
+  if (status == HYDROGEN_ERRSYNTAX) {
+    size_t lmsg;
+    const char *msg = hydrogen_tolstring(L, -1, &lmsg);
+    if (lmsg >= marklen && strcmp(msg + lmsg - marklen, EOFMARK) == 0) {
+      hydrogen_pop(L, 1);
+      return 1;
+    }
+  }
+  return 0;  /* else... */
+}
+
+
+/*
+** Prompt the user, read a line, and push it into the Hydrogen stack.
+*/
+static int pushline (hydrogen_State *L, int firstline) {
+  char buffer[HYDROGEN_MAXINPUT];
+  char *b = buffer;
+  size_t l;
+  const char *prmt = get_prompt(L, firstline);
+  int readstatus = hydrogen_readline(L, b, prmt);
+  if (readstatus == 0)
+    return 0;  /* no input (prompt will be popped by caller) */
+  hydrogen_pop(L, 1);  /* remove prompt */
+  l = strlen(b);
+  if (l > 0 && b[l-1] == '\n')  /* line ends with newline? */
+    b[--l] = '\0';  /* remove it */
+  if (firstline && b[0] == '=')  /* for compatibility with 5.2, ... */
+    hydrogen_pushfstring(L, "return %s", b + 1);  /* change '=' to 'return' */
+  else
+    hydrogen_pushlstring(L, b, l);
+  hydrogen_freeline(L, b);
+  return 1;
+}
+
+
+/*
+** Try to compile line on the stack as 'return <line>;'; on return, stack
+** has either compiled chunk or original line (if compilation failed).
+*/
+static int addreturn (hydrogen_State *L) {
+  const char *line = hydrogen_tostring(L, -1);  /* original line */
+  const char *retline = hydrogen_pushfstring(L, "return %s;", line);
+  int status = hydrogenL_loadbuffer(L, retline, strlen(retline), "=stdin");
+  if (status == HYDROGEN_OK) {
+    hydrogen_remove(L, -2);  /* remove modified line */
+    if (line[0] != '\0')  /* non empty? */
+      hydrogen_saveline(L, line);  /* keep history */
+  }
+  else
+    hydrogen_pop(L, 2);  /* pop result from 'hydrogenL_loadbuffer' and modified line */
+  return status;
+}
+
+
+/*
+** Read multiple lines until a complete Hydrogen statement
+*/
+static int multiline (hydrogen_State *L) {
+  for (;;) {  /* repeat until gets a complete statement */
+    size_t len;
+    const char *line = hydrogen_tolstring(L, 1, &len);  /* get what it has */
+    int status = hydrogenL_loadbuffer(L, line, len, "=stdin");  /* try it */
+    if (!incomplete(L, status) || !pushline(L, 0)) {
+      hydrogen_saveline(L, line);  /* keep history */
+      return status;  /* cannot or should not try to add continuation line */
+    }
+    hydrogen_pushliteral(L, "\n");  /* add newline... */
+    hydrogen_insert(L, -2);  /* ...between the two lines */
+    hydrogen_concat(L, 3);  /* join them */
+  }
+}
+
+
+/*
+** Read a line and try to load (compile) it first as an expression (by
+** adding "return " in front of it) and second as a statement. Return
+** the final status of load/call with the resulting function (if any)
+** in the top of the stack.
+*/
+static int loadline (hydrogen_State *L) {
+  int status;
+  hydrogen_settop(L, 0);
+  if (!pushline(L, 1))
+    return -1;  /* no input */
+  if ((status = addreturn(L)) != HYDROGEN_OK)  /* 'return ...' did not work? */
+    status = multiline(L);  /* try as command, maybe with continuation lines */
+  hydrogen_remove(L, 1);  /* remove line from the stack */
+  hydrogen_assert(hydrogen_gettop(L) == 1);
+  return status;
+}
+
+
+/*
+** Prints (calling the Hydrogen 'print' function) any values on the stack
+*/
+static void l_print (hydrogen_State *L) {
+  int n = hydrogen_gettop(L);
+  if (n > 0) {  /* any result to be printed? */
+    hydrogenL_checkstack(L, HYDROGEN_MINSTACK, "too many results to print");
+    hydrogen_getglobal(L, "print");
+    hydrogen_insert(L, 1);
+    if (hydrogen_pcall(L, n, 0, 0) != HYDROGEN_OK)
+      l_message(progname, hydrogen_pushfstring(L, "error calling 'print' (%s)",
+                                             hydrogen_tostring(L, -1)));
+  }
+}
+
+
+/*
+** Do the REPL: repeatedly read (load) a line, evahydrogente (call) it, and
+** print any results.
+*/
+static void doREPL (hydrogen_State *L) {
+  int status;
+  const char *oldprogname = progname;
+  progname = NULL;  /* no 'progname' on errors in interactive mode */
+  hydrogen_initreadline(L);
+  while ((status = loadline(L)) != -1) {
+    if (status == HYDROGEN_OK)
+      status = docall(L, 0, HYDROGEN_MULTRET);
+    if (status == HYDROGEN_OK) l_print(L);
+    else report(L, status);
+  }
+  hydrogen_settop(L, 0);  /* clear stack */
+  hydrogen_writeline();
+  progname = oldprogname;
+}
+
+/* }================================================================== */
+
+
+/*
+** Main body of stand-alone interpreter (to be called in protected mode).
+** Reads the options and handles them all.
+*/
+static int pmain (hydrogen_State *L) {
+  int argc = (int)hydrogen_tointeger(L, 1);
+  char **argv = (char **)hydrogen_touserdata(L, 2);
+  int script;
+  int args = collectargs(argv, &script);
+  hydrogenL_checkversion(L);  /* check that interpreter has correct version */
+  if (argv[0] && argv[0][0]) progname = argv[0];
+  if (args == has_error) {  /* bad arg? */
+    print_usage(argv[script]);  /* 'script' has index of bad arg. */
+    return 0;
+  }
+  if (args & has_v)  /* option '-v'? */
+    print_version();
+  if (args & has_E) {  /* option '-E'? */
+    hydrogen_pushboolean(L, 1);  /* signal for libraries to ignore env. vars. */
+    hydrogen_setfield(L, HYDROGEN_REGISTRYINDEX, "HYDROGEN_NOENV");
+  }
+  hydrogenL_openlibs(L);  /* open standard libraries */
+  createargtable(L, argv, argc, script);  /* create table 'arg' */
+  hydrogen_gc(L, HYDROGEN_GCGEN, 0, 0);  /* GC in generational mode */
+  if (!(args & has_E)) {  /* no option '-E'? */
+    if (handle_hydrogeninit(L) != HYDROGEN_OK)  /* run HYDROGEN_INIT */
+      return 0;  /* error running HYDROGEN_INIT */
+  }
+  if (!runargs(L, argv, script))  /* execute arguments -e and -l */
+    return 0;  /* something failed */
+  if (script < argc &&  /* execute main script (if there is one) */
+      handle_script(L, argv + script) != HYDROGEN_OK)
+    return 0;
+  if (args & has_i)  /* -i option? */
+    doREPL(L);  /* do read-eval-print loop */
+  else if (script == argc && !(args & (has_e | has_v))) {  /* no arguments? */
+    if (hydrogen_stdin_is_tty()) {  /* running in interactive mode? */
+      print_version();
+      doREPL(L);  /* do read-eval-print loop */
+    }
+    else dofile(L, NULL);  /* executes stdin as a file */
+  }
+  hydrogen_pushboolean(L, 1);  /* signal no errors */
+  return 1;
+}
+
+
+int main (int argc, char **argv) {
+  int status, result;
+  hydrogen_State *L = hydrogenL_newstate();  /* create state */
+  if (L == NULL) {
+    l_message(argv[0], "cannot create state: not enough memory");
+    return EXIT_FAILURE;
+  }
+  hydrogen_pushcfunction(L, &pmain);  /* to call 'pmain' in protected mode */
+  hydrogen_pushinteger(L, argc);  /* 1st argument */
+  hydrogen_pushlightuserdata(L, argv); /* 2nd argument */
+  status = hydrogen_pcall(L, 2, 1, 0);  /* do the call */
+  result = hydrogen_toboolean(L, -1);  /* get result */
+  report(L, status);
+  hydrogen_close(L);
+  return (result && status == HYDROGEN_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
\ No newline at end of file
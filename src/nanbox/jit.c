@@ -0,0 +1,3232 @@
+/*
+** $Id: jit.c $
+** Compiler of hot functions and loops to native code
+** See Copyright Notice in hydrogen.h
+*/
+
+#define jit_c
+#define HYDROGEN_CORE
+
+/* 'MAP_ANONYMOUS' is not part of the XSI interface asked by 'prefix.h' */
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+
+#include "prefix.h"
+
+
+#include <limits.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "hydrogen.h"
+
+#include "debug.h"
+#include "do.h"
+#include "function.h"
+#include "garbageCollection.h"
+#include "jit.h"
+#include "object.h"
+#include "opcodes.h"
+#include "state.h"
+#include "table.h"
+#include "tagMethods.h"
+#include "virtualMachine.h"
+
+
+#if defined(HYDROGEN_USE_JIT)
+
+#include <sys/mman.h>
+
+#if !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS	MAP_ANON
+#endif
+
+
+/*
+** The compiler translates each instruction of a hot function into a
+** fixed template of x86-64 code, in the order of the bytecode. Simple
+** instructions (moves, loads, jumps, tests, numeric 'for' loops) and
+** the integer and float cases of the most common arithmetic and
+** comparison instructions are done inline; everything else calls the
+** helpers below, which run the same code as the interpreter.
+**
+** Native code keeps 'L' in rbx, 'ci' in r12, 'base' in r13 and the
+** running closure in r14. It never calls Hydrogen functions itself: a
+** call (or a return) leaves native code with JIT_CALL (or JIT_RETURN),
+** so that the interpreter runs the callee in its own C frame, exactly
+** as it does with its own calls. When it gets back to a function with
+** native code, the interpreter resumes that code at the instruction
+** pointed by 'savedpc'; so, every instruction is also an entry point.
+**
+** Native code does not know about hooks. It checks 'L->hookmask'
+** after calls and at backward jumps; when hooks are on, it saves the
+** next instruction in 'savedpc' and returns JIT_EXIT, and the
+** interpreter runs the rest of the call.
+*/
+
+
+typedef int (*JitFunction) (hydrogen_State *L, CallInfo *ci,
+                            const void *entry);
+
+
+typedef struct JitCode {
+  unsigned char *mcode;  /* executable memory */
+  size_t msize;  /* size of 'mcode' */
+  size_t size;  /* size of this structure */
+  unsigned int entry[1];  /* offset in 'mcode' of each instruction */
+} JitCode;
+
+
+/* a jump whose 32-bit displacement ends at 'pos' goes to 'target' */
+typedef struct Fixup {
+  size_t pos;
+  int target;  /* instruction index, or one of the targets below */
+} Fixup;
+
+#define TEPILOGUE	(-1)	/* common exit (status already in eax) */
+
+/* exit to the interpreter at instruction 'n' */
+#define exitto(n)	(-2 - (n))
+#define isexit(t)	((t) <= -2)
+#define exitpc(t)	(-2 - (t))
+
+
+typedef struct JitState {
+  hydrogen_State *L;
+  Proto *p;
+  JitCode *jc;  /* code being built */
+  unsigned char *code;  /* buffer for the native code */
+  size_t ncode;  /* number of bytes in 'code' */
+  size_t sizecode;  /* size of 'code' */
+  Fixup *fix;  /* list of jumps to be resolved */
+  int nfix;  /* number of elements in 'fix' */
+  int sizefix;  /* size of 'fix' */
+  size_t epilogue;  /* offset of the common exit */
+  int failed;  /* true if an allocation failed */
+} JitState;
+
+
+/*
+** Allocations of the compiler go straight to the allocation function,
+** so that a failure just abandons the compilation (the function goes
+** on being interpreted) instead of raising an error.
+*/
+static void *jitrealloc (hydrogen_State *L, void *block, size_t osize,
+                                                         size_t nsize) {
+  global_State *g = G(L);
+  return (*g->frealloc)(g->ud, block, osize, nsize);
+}
+
+
+
+/*
+** {==================================================================
+** Helpers: out-of-line parts of instructions, called from native code
+** as 'h(L, ci, pc)', where 'pc' points to the next instruction. They
+** mirror the corresponding code in 'hydrogenV_execute'. Native code
+** reloads 'base' after each call.
+** ===================================================================
+*/
+
+#define RA(i)	(base+GETARG_A(i))
+#define RB(i)	(base+GETARG_B(i))
+#define vRB(i)	s2v(RB(i))
+#define KB(i)	(cl->p->k+GETARG_B(i))
+#define RC(i)	(base+GETARG_C(i))
+#define vRC(i)	s2v(RC(i))
+#define KC(i)	(cl->p->k+GETARG_C(i))
+#define RKC(i)	((TESTARG_k(i)) ? KC(i) : vRC(i))
+
+/* instruction being executed and its register A */
+#define decode(ci,pc)  \
+	Instruction i = *((pc) - 1);  \
+	StkId base = (ci)->func + 1;  \
+	StkId ra = RA(i)
+
+#define savepc(ci,pc)	((ci)->u.l.savedpc = (pc))
+
+#define savestate(ci,pc)	(savepc(ci,pc), L->top = (ci)->top)
+
+/* closure running in 'ci' */
+#define cicl(ci)	clLvalue(s2v((ci)->func))
+
+
+static void h_setupval (hydrogen_State *L, CallInfo *ci,
+                        const Instruction *pc) {
+  decode(ci, pc);
+  UpVal *uv = cicl(ci)->upvals[GETARG_B(i)];
+  setobj(L, uv->v, s2v(ra));
+  hydrogenC_barrier(L, uv, s2v(ra));
+}
+
+
+/* OP_GETTABUP, OP_GETTABLE, OP_GETI, OP_GETFIELD, and OP_SELF */
+static void h_get (hydrogen_State *L, CallInfo *ci, const Instruction *pc) {
+  decode(ci, pc);
+  LClosure *cl = cicl(ci);
+  ICache *ic = cl->p->icache + (pc - 1 - cl->p->code);
+  const TValue *slot;
+  TValue *t;
+  TValue *key;
+  TValue ikey;
+  savestate(ci, pc);
+  switch (GET_GENERICOP(i)) {
+    case OP_GETTABUP: case OP_GETFIELD: {
+      t = (GET_GENERICOP(i) == OP_GETTABUP) ? cl->upvals[GETARG_B(i)]->v
+                                             : vRB(i);
+      key = KC(i);
+      if (hydrogenV_fastgetcached(L, t, tsvalue(key), slot, &ic->field.slot)) {
+        setobj2s(L, ra, slot);
+      }
+      else
+        hydrogenV_finishgetcached(L, t, key, ra, slot, &ic->field.islot);
+      return;
+    }
+    case OP_SELF: {
+      t = vRB(i);
+      key = RKC(i);
+      setobj2s(L, ra + 1, t);
+      if (tsvalue(key)->tt == HYDROGEN_VSHRSTR) {
+        if (hydrogenV_fastgetcached(L, t, tsvalue(key), slot, &ic->field.slot)) {
+          setobj2s(L, ra, slot);
+        }
+        else
+          hydrogenV_finishgetcached(L, t, key, ra, slot, &ic->field.islot);
+        return;
+      }
+      break;
+    }
+    case OP_GETI: {
+      t = vRB(i);
+      setivalue(&ikey, GETARG_C(i));
+      key = &ikey;
+      break;
+    }
+    default: {  /* OP_GETTABLE */
+      t = vRB(i);
+      key = vRC(i);
+      break;
+    }
+  }
+  if (!(ttisinteger(key)
+        ? hydrogenV_fastgeti(L, t, ivalue(key), s2v(ra), slot)
+        : hydrogenV_fastgetv(L, t, key, s2v(ra), slot)))
+    hydrogenV_finishget(L, t, key, ra, slot);
+}
+
+
+/* OP_SETTABUP, OP_SETTABLE, OP_SETI, and OP_SETFIELD */
+static void h_set (hydrogen_State *L, CallInfo *ci, const Instruction *pc) {
+  decode(ci, pc);
+  LClosure *cl = cicl(ci);
+  const TValue *slot;
+  TValue *t;
+  TValue *key;
+  TValue *val = RKC(i);
+  TValue ikey;
+  savestate(ci, pc);
+  switch (GET_GENERICOP(i)) {
+    case OP_SETTABUP: case OP_SETFIELD: {
+      ICache *ic = cl->p->icache + (pc - 1 - cl->p->code);
+      t = (GET_GENERICOP(i) == OP_SETTABUP) ? cl->upvals[GETARG_A(i)]->v
+                                             : s2v(ra);
+      key = KB(i);
+      if (hydrogenV_fastgetcached(L, t, tsvalue(key), slot, &ic->field.slot)) {
+        hydrogenV_finishfastset(L, t, slot, val);
+      }
+      else
+        hydrogenV_finishset(L, t, key, val, slot);
+      return;
+    }
+    case OP_SETI: {
+      setivalue(&ikey, GETARG_B(i));
+      key = &ikey;
+      break;
+    }
+    default: {  /* OP_SETTABLE */
+      key = vRB(i);
+      break;
+    }
+  }
+  t = s2v(ra);
+  if (!(ttisinteger(key)
+        ? hydrogenV_fastseti(L, t, ivalue(key), val, slot)
+        : hydrogenV_fastset(L, t, key, val, slot)))
+    hydrogenV_finishset(L, t, key, val, slot);
+}
+
+
+static void h_newtable (hydrogen_State *L, CallInfo *ci,
+                        const Instruction *pc) {
+  decode(ci, pc);
+  int b = GETARG_B(i);  /* log2(hash size) + 1 */
+  int c = GETARG_C(i);  /* array size */
+  Table *t;
+  if (b > 0)
+    b = 1 << (b - 1);  /* size is 2^(b - 1) */
+  if (TESTARG_k(i))  /* non-zero extra argument? */
+    c += GETARG_Ax(*pc) * (MAXARG_C + 1);  /* add it to size */
+  savepc(ci, pc + 1);  /* skip extra argument */
+  L->top = ra + 1;  /* correct top in case of emergency GC */
+  t = hydrogenH_new(L);  /* memory allocation */
+  sethvalue2s(L, ra, t);
+  if (b != 0 || c != 0)
+    hydrogenH_resize(L, t, c, b);  /* idem */
+  hydrogenC_checkGC(L);
+  hydrogeni_threadyield(L);
+}
+
+
+/*
+** Arithmetic and bitwise instructions (but for the cases done inline).
+** Returns true if the operation was done; otherwise, the following
+** OP_MMBIN* instruction will try a metamethod.
+*/
+static int h_arith (hydrogen_State *L, CallInfo *ci, const Instruction *pc) {
+  decode(ci, pc);
+  LClosure *cl = cicl(ci);
+  OpCode op = GET_GENERICOP(i);
+  const TValue *v1 = vRB(i);
+  const TValue *v2;
+  TValue imm;
+  int aop;
+  savestate(ci, pc);  /* in case of division by 0 */
+  switch (op) {
+    case OP_ADDI: case OP_SHRI: {
+      setivalue(&imm, GETARG_sC(i));
+      v2 = &imm;
+      aop = (op == OP_ADDI) ? HYDROGEN_OPADD : HYDROGEN_OPSHR;
+      break;
+    }
+    case OP_SHLI: {  /* immediate is the first operand */
+      setivalue(&imm, GETARG_sC(i));
+      v2 = v1;
+      v1 = &imm;
+      aop = HYDROGEN_OPSHL;
+      break;
+    }
+    default: {  /* ORDER OP: the same order as arithmetic operators */
+      if (OP_ADDK <= op && op <= OP_BXORK) {
+        v2 = KC(i);
+        aop = cast_int(op - OP_ADDK) + HYDROGEN_OPADD;
+      }
+      else {
+        v2 = vRC(i);
+        aop = cast_int(op - OP_ADD) + HYDROGEN_OPADD;
+      }
+      break;
+    }
+  }
+  return hydrogenO_rawarith(L, aop, v1, v2, s2v(ra));
+}
+
+
+static void h_mmbin (hydrogen_State *L, CallInfo *ci, const Instruction *pc) {
+  decode(ci, pc);
+  LClosure *cl = cicl(ci);
+  Instruction pi = *(pc - 2);  /* original arith. expression */
+  StkId result = base + GETARG_A(pi);
+  TMS tm = (TMS)GETARG_C(i);
+  savestate(ci, pc);
+  switch (GET_GENERICOP(i)) {
+    case OP_MMBIN:
+      hydrogenT_trybinTM(L, s2v(ra), vRB(i), result, tm);
+      break;
+    case OP_MMBINI:
+      hydrogenT_trybiniTM(L, s2v(ra), GETARG_sB(i), GETARG_k(i), result, tm);
+      break;
+    default:  /* OP_MMBINK */
+      hydrogenT_trybinassocTM(L, s2v(ra), KB(i), GETARG_k(i), result, tm);
+      break;
+  }
+}
+
+
+/* OP_UNM, OP_BNOT, and OP_LEN */
+static void h_unary (hydrogen_State *L, CallInfo *ci, const Instruction *pc) {
+  decode(ci, pc);
+  TValue *rb = vRB(i);
+  savestate(ci, pc);
+  switch (GET_GENERICOP(i)) {
+    case OP_UNM: hydrogenO_arith(L, HYDROGEN_OPUNM, rb, rb, ra); break;
+    case OP_BNOT: hydrogenO_arith(L, HYDROGEN_OPBNOT, rb, rb, ra); break;
+    default: hydrogenV_objlen(L, ra, rb); break;  /* OP_LEN */
+  }
+}
+
+
+static void h_concat (hydrogen_State *L, CallInfo *ci,
+                      const Instruction *pc) {
+  decode(ci, pc);
+  int n = GETARG_B(i);  /* number of elements to concatenate */
+  L->top = ra + n;  /* mark the end of concat operands */
+  savepc(ci, pc);
+  hydrogenV_concat(L, n);
+  hydrogenC_checkGC(L);  /* 'hydrogenV_concat' ensures correct top */
+  hydrogeni_threadyield(L);
+}
+
+
+static void h_close (hydrogen_State *L, CallInfo *ci, const Instruction *pc) {
+  decode(ci, pc);
+  savestate(ci, pc);
+  hydrogenF_close(L, ra, HYDROGEN_OK, 1);
+}
+
+
+static void h_tbc (hydrogen_State *L, CallInfo *ci, const Instruction *pc) {
+  decode(ci, pc);
+  savestate(ci, pc);
+  hydrogenF_newtbhydrogenval(L, ra);  /* create new to-be-closed upvalue */
+}
+
+
+/*
+** Comparisons (but for the cases done inline). Returns the result of
+** the comparison; native code does the conditional jump.
+*/
+static int h_compare (hydrogen_State *L, CallInfo *ci,
+                      const Instruction *pc) {
+  decode(ci, pc);
+  LClosure *cl = cicl(ci);
+  TValue *va = s2v(ra);
+  int im = GETARG_sB(i);
+  savestate(ci, pc);
+  switch (GET_GENERICOP(i)) {
+    case OP_EQ: return hydrogenV_equalobj(L, va, vRB(i));
+    case OP_LT: return hydrogenV_lessthan(L, va, vRB(i));
+    case OP_LE: return hydrogenV_lessequal(L, va, vRB(i));
+    case OP_EQK: return hydrogenV_rawequalobj(va, KB(i));
+    case OP_EQI: {
+      if (ttisinteger(va))
+        return (ivalue(va) == im);
+      else if (ttisfloat(va))
+        return hydrogeni_numeq(fltvalue(va), cast_num(im));
+      else
+        return 0;  /* other types cannot be equal to a number */
+    }
+    default: {  /* OP_LTI, OP_LEI, OP_GTI, OP_GEI */
+      OpCode op = GET_GENERICOP(i);
+      if (ttisinteger(va)) {
+        hydrogen_Integer ia = ivalue(va);
+        switch (op) {
+          case OP_LTI: return (ia < im);
+          case OP_LEI: return (ia <= im);
+          case OP_GTI: return (ia > im);
+          default: return (ia >= im);
+        }
+      }
+      else if (ttisfloat(va)) {
+        hydrogen_Number fa = fltvalue(va);
+        hydrogen_Number fim = cast_num(im);
+        switch (op) {
+          case OP_LTI: return hydrogeni_numlt(fa, fim);
+          case OP_LEI: return hydrogeni_numle(fa, fim);
+          case OP_GTI: return hydrogeni_numgt(fa, fim);
+          default: return hydrogeni_numge(fa, fim);
+        }
+      }
+      else {
+        int inv = (op == OP_GTI || op == OP_GEI);
+        TMS tm = (op == OP_LTI || op == OP_GTI) ? TM_LT : TM_LE;
+        return hydrogenT_callorderiTM(L, va, im, inv, GETARG_C(i), tm);
+      }
+    }
+  }
+}
+
+
+/* returns JIT_CALL for calls to Hydrogen functions, 0 otherwise */
+static int h_call (hydrogen_State *L, CallInfo *ci, const Instruction *pc) {
+  decode(ci, pc);
+  int b = GETARG_B(i);
+  int nresults = GETARG_C(i) - 1;
+  if (b != 0)  /* fixed number of arguments? */
+    L->top = ra + b;  /* top signals number of arguments */
+  /* else previous instruction set top */
+  savepc(ci, pc);  /* in case of errors */
+  return (hydrogenD_precall(L, ra, nresults) == NULL) ? 0 : JIT_CALL;
+}
+
+
+static int h_tailcall (hydrogen_State *L, CallInfo *ci,
+                       const Instruction *pc) {
+  decode(ci, pc);
+  int b = GETARG_B(i);  /* number of arguments + 1 (function) */
+  int n;  /* number of results when calling a C function */
+  int nparams1 = GETARG_C(i);
+  /* delta is virtual 'func' - real 'func' (vararg functions) */
+  int delta = (nparams1) ? ci->u.l.nextraargs + nparams1 : 0;
+  if (b != 0)
+    L->top = ra + b;
+  else  /* previous instruction set top */
+    b = cast_int(L->top - ra);
+  savepc(ci, pc);  /* several calls here can raise errors */
+  if (TESTARG_k(i))
+    hydrogenF_closeupval(L, base);  /* close upvalues from current call */
+  if ((n = hydrogenD_pretailcall(L, ci, ra, b, delta)) < 0)
+    return JIT_CALL;  /* Hydrogen function: 'ci' now runs the callee */
+  ci->func -= delta;  /* restore 'func' (if vararg) */
+  hydrogenD_poscall(L, ci, n);  /* finish caller */
+  return JIT_RETURN;
+}
+
+
+/* OP_RETURN, OP_RETURN0, and OP_RETURN1 */
+static int h_return (hydrogen_State *L, CallInfo *ci,
+                     const Instruction *pc) {
+  decode(ci, pc);
+  int n;  /* number of results */
+  savepc(ci, pc);
+  switch (GET_GENERICOP(i)) {
+    case OP_RETURN0: n = 0; break;
+    case OP_RETURN1: n = 1; break;
+    default: {
+      int nparams1 = GETARG_C(i);
+      n = GETARG_B(i) - 1;
+      if (n < 0)  /* not fixed? */
+        n = cast_int(L->top - ra);  /* get what is available */
+      if (TESTARG_k(i)) {  /* may there be open upvalues? */
+        ci->u2.nres = n;  /* save number of returns */
+        if (L->top < ci->top)
+          L->top = ci->top;
+        hydrogenF_close(L, base, CLOSEKTOP, 1);
+        base = ci->func + 1;  /* stack may have moved */
+        ra = RA(i);
+      }
+      if (nparams1)  /* vararg function? */
+        ci->func -= ci->u.l.nextraargs + nparams1;
+      break;
+    }
+  }
+  L->top = ra + n;  /* set call for 'hydrogenD_poscall' */
+  hydrogenD_poscall(L, ci, n);
+  return JIT_RETURN;
+}
+
+
+/* returns true to skip the loop */
+static int h_forprep (hydrogen_State *L, CallInfo *ci,
+                      const Instruction *pc) {
+  decode(ci, pc);
+  savestate(ci, pc);  /* in case of errors */
+  return hydrogenV_forprep(L, ra);
+}
+
+
+/* returns true to jump back */
+static int h_floatforloop (hydrogen_State *L, CallInfo *ci,
+                           const Instruction *pc) {
+  decode(ci, pc);
+  UNUSED(L);
+  return hydrogenV_floatforloop(ra);
+}
+
+
+static void h_tforprep (hydrogen_State *L, CallInfo *ci,
+                        const Instruction *pc) {
+  decode(ci, pc);
+  savestate(ci, pc);
+  hydrogenF_newtbhydrogenval(L, ra + 3);  /* to-be-closed variable */
+}
+
+
+static void h_tforcall (hydrogen_State *L, CallInfo *ci,
+                        const Instruction *pc) {
+  decode(ci, pc);
+  /* push function, state, and control variable */
+  memcpy(ra + 4, ra, 3 * sizeof(*ra));
+  L->top = ra + 4 + 3;
+  savepc(ci, pc);
+  hydrogenD_call(L, ra + 4, GETARG_C(i));  /* do the call */
+}
+
+
+static void h_setlist (hydrogen_State *L, CallInfo *ci,
+                       const Instruction *pc) {
+  decode(ci, pc);
+  int n = GETARG_B(i);
+  unsigned int last = GETARG_C(i);
+  Table *h = hvalue(s2v(ra));
+  if (n == 0)
+    n = cast_int(L->top - ra) - 1;  /* get up to the top */
+  else
+    L->top = ci->top;  /* correct top in case of emergency GC */
+  last += n;
+  if (TESTARG_k(i))
+    last += GETARG_Ax(*pc) * (MAXARG_C + 1);
+  savepc(ci, pc);
+  if (last > hydrogenH_realasize(h))  /* needs more space? */
+    hydrogenH_resizearray(L, h, last);  /* preallocate it at once */
+  for (; n > 0; n--) {
+    TValue *val = s2v(ra + n);
+    arrsetobj(h, last - 1, val);
+    last--;
+    hydrogenC_barrierback(L, obj2gco(h), val);
+  }
+}
+
+
+static void h_closure (hydrogen_State *L, CallInfo *ci,
+                       const Instruction *pc) {
+  decode(ci, pc);
+  LClosure *cl = cicl(ci);
+  Proto *p = cl->p->p[GETARG_Bx(i)];
+  savestate(ci, pc);
+  hydrogenV_pushclosure(L, p, cl->upvals, base, ra);
+  hydrogenC_condGC(L, L->top = ra + 1, (void)0);
+  hydrogeni_threadyield(L);
+}
+
+
+static void h_vararg (hydrogen_State *L, CallInfo *ci,
+                      const Instruction *pc) {
+  decode(ci, pc);
+  savestate(ci, pc);
+  hydrogenT_getvarargs(L, ci, ra, GETARG_C(i) - 1);
+}
+
+
+static void h_varargprep (hydrogen_State *L, CallInfo *ci,
+                          const Instruction *pc) {
+  decode(ci, pc);
+  UNUSED(ra);
+  savepc(ci, pc);
+  hydrogenT_adjustvarargs(L, GETARG_A(i), ci, cicl(ci)->p);
+}
+
+/*
+** Backward jump of a loop that may have a trace (see 'loopback').
+** Returns the native code where to go on, or NULL if the interpreter
+** must go on from 'savedpc' (to record a trace of the loop).
+*/
+static const void *h_loop (hydrogen_State *L, CallInfo *ci,
+                           const Instruction *pc) {
+  Proto *p = cicl(ci)->p;
+  const Instruction *npc = pc - GETARG_Bx(*(pc - 1));  /* jump back */
+  if (G(L)->jiton) {
+    npc = hydrogenJ_backedge(L, ci, pc - 1);
+    if (G(L)->jitrec != NULL)  /* started recording? */
+      return NULL;
+  }
+  return p->jit->mcode + p->jit->entry[npc - p->code];
+}
+
+/* }================================================================== */
+
+
+
+/*
+** {==================================================================
+** x86-64 code emission
+** ===================================================================
+*/
+
+#define RAX	0
+#define RCX	1
+#define RDX	2
+#define RBX	3
+#define RSP	4
+#define RBP	5
+#define RSI	6
+#define RDI	7
+#define R8	8
+#define R9	9
+#define R10	10
+#define R11	11
+#define R12	12
+#define R13	13
+#define R14	14
+#define R15	15
+
+#define XMM0	0
+#define XMM1	1
+#define XMM14	14
+#define XMM15	15
+
+/* registers holding the state of the VM */
+#define RL	RBX	/* 'L' */
+#define RCI	R12	/* 'ci' */
+#define RBASE	R13	/* 'base' */
+#define RCL	R14	/* running closure */
+
+/* condition codes */
+#define CC_B	0x2
+#define CC_AE	0x3
+#define CC_E	0x4
+#define CC_NE	0x5
+#define CC_BE	0x6
+#define CC_A	0x7
+#define CC_S	0x8
+#define CC_NS	0x9
+#define CC_P	0xA
+#define CC_L	0xC
+#define CC_GE	0xD
+#define CC_LE	0xE
+#define CC_G	0xF
+#define CC_ALWAYS	(-1)
+
+/* negation of a condition code */
+#define ccnot(cc)	((cc) ^ 1)
+
+/* opcodes of some instructions */
+#define X_ADD	0x03	/* add r, r/m */
+#define X_SUB	0x2B	/* sub r, r/m */
+#define X_CMP	0x3B	/* cmp r, r/m */
+#define X_IMUL	0x0FAF	/* imul r, r/m */
+#define X_MOVST	0x89	/* mov r/m, r */
+#define X_MOVLD	0x8B	/* mov r, r/m */
+#define X_MOVST8	0x88	/* mov r/m8, r8 */
+#define X_MOVZX8	0x0FB6	/* movzx r32, r/m8 */
+#define X_ADDSD	0x58
+#define X_MULSD	0x59
+#define X_SUBSD	0x5C
+
+/* displacements of the value and the tag of register 'r' from 'base' */
+#define vdisp(r)	(cast_int(r) * cast_int(sizeof(StackValue)))
+#define tdisp(r)	(vdisp(r) + cast_int(offsetof(TValue, tt_)))
+
+#define fieldof(t,f)	cast_int(offsetof(t, f))
+
+
+static void emit (JitState *J, int b) {
+  if (l_unlikely(J->ncode >= J->sizecode)) {
+    size_t newsize = J->sizecode * 2;
+    unsigned char *newcode;
+    newcode = cast(unsigned char *,
+                   jitrealloc(J->L, J->code, J->sizecode, newsize));
+    if (newcode == NULL) {  /* no more memory? */
+      J->failed = 1;
+      J->ncode = 0;  /* keep emitting over the same bytes */
+    }
+    else {
+      J->code = newcode;
+      J->sizecode = newsize;
+    }
+  }
+  J->code[J->ncode++] = cast_byte(b);
+}
+
+
+static void emit32 (JitState *J, unsigned int v) {
+  int n;
+  for (n = 0; n < 4; n++, v >>= 8)
+    emit(J, cast_int(v & 0xff));
+}
+
+
+static void emit64 (JitState *J, size_t v) {
+  int n;
+  for (n = 0; n < 8; n++, v >>= 8)
+    emit(J, cast_int(v & 0xff));
+}
+
+
+/* REX prefix for register (or opcode extension) 'r' and base 'b' */
+static void rex (JitState *J, int w, int r, int b) {
+  int x = 0x40 | (w << 3) | ((r & 8) >> 1) | ((b & 8) >> 3);
+  if (x != 0x40)
+    emit(J, x);
+}
+
+
+static void opcode (JitState *J, int op) {
+  if (op > 0xff)  /* two-byte opcode? */
+    emit(J, op >> 8);
+  emit(J, op & 0xff);
+}
+
+
+/* 'op' with register 'r' and operand '[b + disp]' */
+static void opmem (JitState *J, int w, int op, int r, int b, int disp) {
+  rex(J, w, r, b);
+  opcode(J, op);
+  if (-128 <= disp && disp <= 127) {
+    emit(J, 0x40 | ((r & 7) << 3) | (b & 7));  /* 8-bit displacement */
+    if ((b & 7) == RSP) emit(J, 0x24);  /* SIB for rsp/r12 */
+    emit(J, disp & 0xff);
+  }
+  else {
+    emit(J, 0x80 | ((r & 7) << 3) | (b & 7));  /* 32-bit displacement */
+    if ((b & 7) == RSP) emit(J, 0x24);
+    emit32(J, cast_uint(disp));
+  }
+}
+
+
+/* 'op' with register 'r' and register operand 'b' */
+static void opreg (JitState *J, int w, int op, int r, int b) {
+  rex(J, w, r, b);
+  opcode(J, op);
+  emit(J, 0xC0 | ((r & 7) << 3) | (b & 7));
+}
+
+
+/* scalar double 'op' with register 'x' and operand '[b + disp]' */
+static void ssemem (JitState *J, int prefix, int op, int x, int b, int disp) {
+  emit(J, prefix);
+  opmem(J, 0, 0x0F00 | op, x, b, disp);
+}
+
+
+static void movimm (JitState *J, int r, size_t v) {
+  rex(J, 1, 0, r);
+  emit(J, 0xB8 + (r & 7));
+  emit64(J, v);
+}
+
+
+/* 64-bit ALU operation 'ext' (0 = add, 5 = sub, 7 = cmp) with 'imm' */
+static void aluimm (JitState *J, int ext, int r, int imm) {
+  if (-128 <= imm && imm <= 127) {
+    opreg(J, 1, 0x83, ext, r);
+    emit(J, imm & 0xff);
+  }
+  else {
+    opreg(J, 1, 0x81, ext, r);
+    emit32(J, cast_uint(imm));
+  }
+}
+
+
+/* reload 'base' from 'ci->func' */
+static void loadbase (JitState *J) {
+  opmem(J, 1, X_MOVLD, RBASE, RCI, fieldof(CallInfo, func));
+  aluimm(J, 0, RBASE, cast_int(sizeof(StackValue)));
+}
+
+
+static void addfixup (JitState *J, size_t pos, int target) {
+  if (J->nfix >= J->sizefix) {
+    int newsize = (J->sizefix == 0) ? 32 : J->sizefix * 2;
+    Fixup *newfix = cast(Fixup *, jitrealloc(J->L, J->fix,
+                                             J->sizefix * sizeof(Fixup),
+                                             newsize * sizeof(Fixup)));
+    if (newfix == NULL) {
+      J->failed = 1;
+      return;
+    }
+    J->fix = newfix;
+    J->sizefix = newsize;
+  }
+  J->fix[J->nfix].pos = pos;
+  J->fix[J->nfix].target = target;
+  J->nfix++;
+}
+
+
+/*
+** Emit a jump with condition 'cc' and a displacement to be filled
+** later; returns the position after the displacement.
+*/
+static size_t jump (JitState *J, int cc) {
+  if (cc == CC_ALWAYS)
+    emit(J, 0xE9);
+  else {
+    emit(J, 0x0F);
+    emit(J, 0x80 | cc);
+  }
+  emit32(J, 0);
+  return J->ncode;
+}
+
+
+static void patch (JitState *J, size_t pos, size_t dest) {
+  unsigned int disp = cast_uint(dest - pos);  /* (two's complement) */
+  int n;
+  if (J->failed) return;
+  for (n = 0; n < 4; n++, disp >>= 8)
+    J->code[pos - 4 + n] = cast_byte(disp & 0xff);
+}
+
+
+/* make the jump at 'pos' go to the current position */
+#define patchhere(J,pos)	patch(J, pos, (J)->ncode)
+
+
+/* jump to instruction 'target' (or to a special target) */
+static void jumpto (JitState *J, int cc, int target) {
+  size_t pos = jump(J, cc);
+  addfixup(J, pos, target);
+}
+
+
+/* copy the value at '[b + disp]' to register 'a' (keeping its 'delta') */
+static void copyvalue (JitState *J, int a, int b, int disp) {
+  opmem(J, 1, X_MOVLD, RAX, b, disp);
+  opmem(J, 0, X_MOVZX8, RCX, b, disp + fieldof(TValue, tt_));
+  opmem(J, 1, X_MOVST, RAX, RBASE, vdisp(a));
+  opmem(J, 0, X_MOVST8, RCX, RBASE, tdisp(a));
+}
+
+
+static void settag (JitState *J, int a, int tag) {
+  opmem(J, 0, 0xC6, 0, RBASE, tdisp(a));
+  emit(J, tag);
+}
+
+
+/* jump (to be patched) if register 'a' does not have tag 'tag' */
+static size_t guardtag (JitState *J, int a, int tag) {
+  opmem(J, 0, 0x80, 7, RBASE, tdisp(a));
+  emit(J, tag);
+  return jump(J, CC_NE);
+}
+
+
+/* jump to 'target' if the tag in 'al' is a false value */
+static void jumpiffalse (JitState *J, int target) {
+  emit(J, 0x3C); emit(J, HYDROGEN_VFALSE);  /* cmp al, VFALSE */
+  jumpto(J, CC_E, target);
+  emit(J, 0xA8); emit(J, 0x0F);  /* test al, 0x0F (nil variants) */
+  jumpto(J, CC_E, target);
+}
+
+
+/* call helper 'f(L, ci, pc)' for instruction 'n' */
+static void callhelper (JitState *J, size_t f, int n) {
+  opreg(J, 1, X_MOVST, RL, RDI);
+  opreg(J, 1, X_MOVST, RCI, RSI);
+  movimm(J, RDX, cast_sizet(J->p->code + n + 1));
+  movimm(J, RAX, f);
+  opreg(J, 0, 0xFF, 2, RAX);  /* call rax */
+  loadbase(J);
+}
+
+#define helper(f)	cast_sizet(f)
+
+
+/* test the result of a helper (in eax) */
+#define testresult(J)	opreg(J, 0, 0x85, RAX, RAX)
+
+
+/* leave native code at instruction 'target' if hooks were turned on */
+static void checkhooks (JitState *J, int target) {
+  opmem(J, 0, 0x83, 7, RL, fieldof(hydrogen_State, hookmask));
+  emit(J, 0);
+  jumpto(J, CC_NE, exitto(target));
+}
+
+
+static size_t numbits (hydrogen_Number x) {
+  size_t u;
+  memcpy(&u, &x, sizeof(u));
+  return u;
+}
+
+/* }================================================================== */
+
+
+
+/*
+** {==================================================================
+** Templates
+** ===================================================================
+*/
+
+/*
+** Conditional jump of comparison instruction 'n' when condition 'cc'
+** holds: go to the jump that follows the instruction if the result is
+** 'k', otherwise skip it.
+*/
+static void condjump (JitState *J, int n, int cc, int k) {
+  jumpto(J, k ? cc : ccnot(cc), n + 1);
+  jumpto(J, CC_ALWAYS, n + 2);
+}
+
+
+/* conditional jump with the result of helper 'h_compare' */
+static void comparehelper (JitState *J, int n, int k) {
+  callhelper(J, helper(h_compare), n);
+  testresult(J);
+  condjump(J, n, CC_NE, k);
+}
+
+
+/*
+** R[A] := R[B] op R[C] for two integers or two floats; other operands
+** go to the helper. A successful operation skips the OP_MMBIN that
+** follows it.
+*/
+static void arithRR (JitState *J, int n, Instruction i, int iop, int fop) {
+  int a = GETARG_A(i), b = GETARG_B(i), c = GETARG_C(i);
+  size_t notint, notint2, notflt, notflt2;
+  notint = guardtag(J, b, HYDROGEN_VNUMINT);
+  notint2 = guardtag(J, c, HYDROGEN_VNUMINT);
+  opmem(J, 1, X_MOVLD, RAX, RBASE, vdisp(b));
+  opmem(J, 1, iop, RAX, RBASE, vdisp(c));
+  opmem(J, 1, X_MOVST, RAX, RBASE, vdisp(a));
+  settag(J, a, HYDROGEN_VNUMINT);
+  jumpto(J, CC_ALWAYS, n + 2);
+  patchhere(J, notint);
+  notflt = guardtag(J, b, HYDROGEN_VNUMFLT);
+  notflt2 = guardtag(J, c, HYDROGEN_VNUMFLT);
+  ssemem(J, 0xF2, 0x10, XMM0, RBASE, vdisp(b));  /* movsd xmm0, R[B] */
+  ssemem(J, 0xF2, fop, XMM0, RBASE, vdisp(c));
+  ssemem(J, 0xF2, 0x11, XMM0, RBASE, vdisp(a));  /* movsd R[A], xmm0 */
+  settag(J, a, HYDROGEN_VNUMFLT);
+  jumpto(J, CC_ALWAYS, n + 2);
+  patchhere(J, notint2);
+  patchhere(J, notflt);
+  patchhere(J, notflt2);
+  callhelper(J, helper(h_arith), n);
+  testresult(J);
+  jumpto(J, CC_NE, n + 2);
+}
+
+
+/*
+** R[A] := R[B] op k, for a numeric constant 'kv' (OP_ADDI, OP_ADDK,
+** OP_SUBK, and OP_MULK). An integer constant is done inline for
+** integer and float operands; a float constant only for floats.
+*/
+static void arithRK (JitState *J, int n, Instruction i, const TValue *kv,
+                     int iop, int fop) {
+  int a = GETARG_A(i), b = GETARG_B(i);
+  size_t notint = 0, notflt;
+  hydrogen_Number fk;
+  if (ttisinteger(kv)) {
+    notint = guardtag(J, b, HYDROGEN_VNUMINT);
+    opmem(J, 1, X_MOVLD, RAX, RBASE, vdisp(b));
+    movimm(J, RCX, l_castS2U(ivalue(kv)));
+    opreg(J, 1, iop, RAX, RCX);
+    opmem(J, 1, X_MOVST, RAX, RBASE, vdisp(a));
+    settag(J, a, HYDROGEN_VNUMINT);
+    jumpto(J, CC_ALWAYS, n + 2);
+    patchhere(J, notint);
+    fk = cast_num(ivalue(kv));
+  }
+  else
+    fk = fltvalue(kv);
+  notflt = guardtag(J, b, HYDROGEN_VNUMFLT);
+  ssemem(J, 0xF2, 0x10, XMM0, RBASE, vdisp(b));  /* movsd xmm0, R[B] */
+  movimm(J, RAX, numbits(fk));
+  emit(J, 0x66); opreg(J, 1, 0x0F6E, XMM1, RAX);  /* movq xmm1, rax */
+  emit(J, 0xF2); opreg(J, 0, 0x0F00 | fop, XMM0, XMM1);
+  ssemem(J, 0xF2, 0x11, XMM0, RBASE, vdisp(a));  /* movsd R[A], xmm0 */
+  settag(J, a, HYDROGEN_VNUMFLT);
+  jumpto(J, CC_ALWAYS, n + 2);
+  patchhere(J, notflt);
+  callhelper(J, helper(h_arith), n);
+  testresult(J);
+  jumpto(J, CC_NE, n + 2);
+}
+
+
+/* arithmetic with the helper only */
+static void arithhelper (JitState *J, int n) {
+  callhelper(J, helper(h_arith), n);
+  testresult(J);
+  jumpto(J, CC_NE, n + 2);
+}
+
+
+/*
+** OP_LT/OP_LE: integers and floats inline. For floats, 'a < b' is
+** computed as 'b > a' ('ucomisd b, a' + "above"), which is false when
+** any of them is a NaN.
+*/
+static void orderRR (JitState *J, int n, Instruction i, int icc, int fcc) {
+  int a = GETARG_A(i), b = GETARG_B(i), k = GETARG_k(i);
+  size_t notint, notint2, notflt, notflt2;
+  notint = guardtag(J, a, HYDROGEN_VNUMINT);
+  notint2 = guardtag(J, b, HYDROGEN_VNUMINT);
+  opmem(J, 1, X_MOVLD, RAX, RBASE, vdisp(a));
+  opmem(J, 1, X_CMP, RAX, RBASE, vdisp(b));
+  condjump(J, n, icc, k);
+  patchhere(J, notint);
+  notflt = guardtag(J, a, HYDROGEN_VNUMFLT);
+  notflt2 = guardtag(J, b, HYDROGEN_VNUMFLT);
+  ssemem(J, 0xF2, 0x10, XMM0, RBASE, vdisp(b));  /* movsd xmm0, R[B] */
+  ssemem(J, 0x66, 0x2E, XMM0, RBASE, vdisp(a));  /* ucomisd xmm0, R[A] */
+  condjump(J, n, fcc, k);
+  patchhere(J, notint2);
+  patchhere(J, notflt);
+  patchhere(J, notflt2);
+  comparehelper(J, n, k);
+}
+
+
+/* OP_EQ: integers inline */
+static void equalRR (JitState *J, int n, Instruction i) {
+  int a = GETARG_A(i), b = GETARG_B(i), k = GETARG_k(i);
+  size_t notint, notint2;
+  notint = guardtag(J, a, HYDROGEN_VNUMINT);
+  notint2 = guardtag(J, b, HYDROGEN_VNUMINT);
+  opmem(J, 1, X_MOVLD, RAX, RBASE, vdisp(a));
+  opmem(J, 1, X_CMP, RAX, RBASE, vdisp(b));
+  condjump(J, n, CC_E, k);
+  patchhere(J, notint);
+  patchhere(J, notint2);
+  comparehelper(J, n, k);
+}
+
+
+/* OP_EQI, OP_LTI, OP_LEI, OP_GTI, OP_GEI: integers inline */
+static void orderI (JitState *J, int n, Instruction i, int cc) {
+  int a = GETARG_A(i), k = GETARG_k(i);
+  size_t notint = guardtag(J, a, HYDROGEN_VNUMINT);
+  opmem(J, 1, 0x81, 7, RBASE, vdisp(a));  /* cmp R[A], imm32 */
+  emit32(J, cast_uint(GETARG_sB(i)));
+  condjump(J, n, cc, k);
+  patchhere(J, notint);
+  comparehelper(J, n, k);
+}
+
+
+/*
+** Backward jump of loop instruction 'n' to 'target'. Unless the loop
+** is dead for the trace compiler, 'h_loop' runs its trace (or counts
+** the iteration) and gives the native code where to go on.
+*/
+static void loopback (JitState *J, int n, int target) {
+  checkhooks(J, target);
+  movimm(J, RAX, cast_sizet(&J->p->icache[n].loop.flags));
+  opmem(J, 0, 0xF7, 0, RAX, 0);  /* test dword [rax], JIT_LOOPDEAD */
+  emit32(J, JIT_LOOPDEAD);
+  jumpto(J, CC_NE, target);
+  callhelper(J, helper(h_loop), n);
+  opreg(J, 1, 0x85, RAX, RAX);
+  jumpto(J, CC_E, exitto(target));  /* go on in the interpreter? */
+  opreg(J, 0, 0xFF, 4, RAX);  /* jmp rax */
+}
+
+
+static void forloop (JitState *J, int n, Instruction i) {
+  int a = GETARG_A(i);
+  int target = n + 1 - GETARG_Bx(i);
+  size_t notint, done, done2;
+  notint = guardtag(J, a + 2, HYDROGEN_VNUMINT);
+  opmem(J, 1, X_MOVLD, RAX, RBASE, vdisp(a + 1));  /* count */
+  opreg(J, 1, 0x85, RAX, RAX);
+  done = jump(J, CC_E);  /* no more iterations? */
+  aluimm(J, 5, RAX, 1);
+  opmem(J, 1, X_MOVST, RAX, RBASE, vdisp(a + 1));  /* update counter */
+  opmem(J, 1, X_MOVLD, RAX, RBASE, vdisp(a));
+  opmem(J, 1, X_ADD, RAX, RBASE, vdisp(a + 2));  /* add step to index */
+  opmem(J, 1, X_MOVST, RAX, RBASE, vdisp(a));  /* update internal index */
+  opmem(J, 1, X_MOVST, RAX, RBASE, vdisp(a + 3));  /* and control var. */
+  settag(J, a + 3, HYDROGEN_VNUMINT);
+  loopback(J, n, target);
+  patchhere(J, notint);
+  callhelper(J, helper(h_floatforloop), n);
+  testresult(J);
+  done2 = jump(J, CC_E);
+  loopback(J, n, target);
+  patchhere(J, done);
+  patchhere(J, done2);
+}
+
+
+static void tforloop (JitState *J, int n, Instruction i) {
+  int a = GETARG_A(i);
+  int target = n + 1 - GETARG_Bx(i);
+  size_t done;
+  opmem(J, 0, X_MOVZX8, RAX, RBASE, tdisp(a + 4));
+  emit(J, 0xA8); emit(J, 0x0F);  /* test al, 0x0F */
+  done = jump(J, CC_E);  /* nil ends the loop */
+  copyvalue(J, a + 2, RBASE, vdisp(a + 4));  /* save control variable */
+  loopback(J, n, target);
+  patchhere(J, done);
+}
+
+
+static void instruction (JitState *J, int n) {
+  Proto *p = J->p;
+  Instruction i = p->code[n];
+  int a = GETARG_A(i);
+  switch (GET_GENERICOP(i)) {
+    case OP_MOVE: {
+      copyvalue(J, a, RBASE, vdisp(GETARG_B(i)));
+      break;
+    }
+    case OP_LOADI: {
+      movimm(J, RAX, l_castS2U(cast(hydrogen_Integer, GETARG_sBx(i))));
+      opmem(J, 1, X_MOVST, RAX, RBASE, vdisp(a));
+      settag(J, a, HYDROGEN_VNUMINT);
+      break;
+    }
+    case OP_LOADF: {
+      movimm(J, RAX, numbits(cast_num(GETARG_sBx(i))));
+      opmem(J, 1, X_MOVST, RAX, RBASE, vdisp(a));
+      settag(J, a, HYDROGEN_VNUMFLT);
+      break;
+    }
+    case OP_LOADK: case OP_LOADKX: {
+      int bx = (GET_OPCODE(i) == OP_LOADK) ? GETARG_Bx(i)
+                                           : GETARG_Ax(p->code[n + 1]);
+      movimm(J, RDX, cast_sizet(p->k + bx));
+      copyvalue(J, a, RDX, 0);
+      break;  /* OP_EXTRAARG that follows OP_LOADKX has no code */
+    }
+    case OP_LOADFALSE: {
+      settag(J, a, HYDROGEN_VFALSE);
+      break;
+    }
+    case OP_LFALSESKIP: {
+      settag(J, a, HYDROGEN_VFALSE);
+      jumpto(J, CC_ALWAYS, n + 2);  /* skip next instruction */
+      break;
+    }
+    case OP_LOADTRUE: {
+      settag(J, a, HYDROGEN_VTRUE);
+      break;
+    }
+    case OP_LOADNIL: {
+      int b = GETARG_B(i);
+      do {
+        settag(J, a++, HYDROGEN_VNIL);
+      } while (b--);
+      break;
+    }
+    case OP_GETUPVAL: {
+      opmem(J, 1, X_MOVLD, RDX, RCL, fieldof(LClosure, upvals) +
+                                     GETARG_B(i) * cast_int(sizeof(UpVal *)));
+      opmem(J, 1, X_MOVLD, RDX, RDX, fieldof(UpVal, v));
+      copyvalue(J, a, RDX, 0);
+      break;
+    }
+    case OP_SETUPVAL: {
+      callhelper(J, helper(h_setupval), n);
+      break;
+    }
+    case OP_GETTABUP: case OP_GETTABLE: case OP_GETI: case OP_GETFIELD:
+    case OP_SELF: {
+      callhelper(J, helper(h_get), n);
+      break;
+    }
+    case OP_SETTABUP: case OP_SETTABLE: case OP_SETI: case OP_SETFIELD: {
+      callhelper(J, helper(h_set), n);
+      break;
+    }
+    case OP_NEWTABLE: {
+      callhelper(J, helper(h_newtable), n);
+      break;  /* OP_EXTRAARG that follows it has no code */
+    }
+    case OP_ADDI: {
+      TValue imm;
+      setivalue(&imm, GETARG_sC(i));
+      arithRK(J, n, i, &imm, X_ADD, X_ADDSD);
+      break;
+    }
+    case OP_ADDK: {
+      arithRK(J, n, i, p->k + GETARG_C(i), X_ADD, X_ADDSD);
+      break;
+    }
+    case OP_SUBK: {
+      arithRK(J, n, i, p->k + GETARG_C(i), X_SUB, X_SUBSD);
+      break;
+    }
+    case OP_MULK: {
+      arithRK(J, n, i, p->k + GETARG_C(i), X_IMUL, X_MULSD);
+      break;
+    }
+    case OP_ADD: {
+      arithRR(J, n, i, X_ADD, X_ADDSD);
+      break;
+    }
+    case OP_SUB: {
+      arithRR(J, n, i, X_SUB, X_SUBSD);
+      break;
+    }
+    case OP_MUL: {
+      arithRR(J, n, i, X_IMUL, X_MULSD);
+      break;
+    }
+    case OP_MODK: case OP_POWK: case OP_DIVK: case OP_IDIVK:
+    case OP_BANDK: case OP_BORK: case OP_BXORK: case OP_SHRI: case OP_SHLI:
+    case OP_MOD: case OP_POW: case OP_DIV: case OP_IDIV:
+    case OP_BAND: case OP_BOR: case OP_BXOR: case OP_SHL: case OP_SHR: {
+      arithhelper(J, n);
+      break;
+    }
+    case OP_MMBIN: case OP_MMBINI: case OP_MMBINK: {
+      callhelper(J, helper(h_mmbin), n);
+      break;
+    }
+    case OP_UNM: case OP_BNOT: case OP_LEN: {
+      callhelper(J, helper(h_unary), n);
+      break;
+    }
+    case OP_NOT: {
+      size_t isfalse, done;
+      opmem(J, 0, X_MOVZX8, RAX, RBASE, tdisp(GETARG_B(i)));
+      emit(J, 0x3C); emit(J, HYDROGEN_VFALSE);  /* cmp al, VFALSE */
+      isfalse = jump(J, CC_E);
+      emit(J, 0xA8); emit(J, 0x0F);  /* test al, 0x0F (nil variants) */
+      done = jump(J, CC_NE);
+      patchhere(J, isfalse);
+      settag(J, a, HYDROGEN_VTRUE);
+      jumpto(J, CC_ALWAYS, n + 1);
+      patchhere(J, done);
+      settag(J, a, HYDROGEN_VFALSE);
+      break;
+    }
+    case OP_CONCAT: {
+      callhelper(J, helper(h_concat), n);
+      break;
+    }
+    case OP_CLOSE: {
+      callhelper(J, helper(h_close), n);
+      break;
+    }
+    case OP_TBC: {
+      callhelper(J, helper(h_tbc), n);
+      break;
+    }
+    case OP_JMP: {
+      int target = n + 1 + GETARG_sJ(i);
+      if (target <= n)  /* backward jump? */
+        checkhooks(J, target);
+      jumpto(J, CC_ALWAYS, target);
+      break;
+    }
+    case OP_EQ: {
+      equalRR(J, n, i);
+      break;
+    }
+    case OP_LT: {
+      orderRR(J, n, i, CC_L, CC_A);
+      break;
+    }
+    case OP_LE: {
+      orderRR(J, n, i, CC_LE, CC_AE);
+      break;
+    }
+    case OP_EQK: {
+      comparehelper(J, n, GETARG_k(i));
+      break;
+    }
+    case OP_EQI: {
+      orderI(J, n, i, CC_E);
+      break;
+    }
+    case OP_LTI: {
+      orderI(J, n, i, CC_L);
+      break;
+    }
+    case OP_LEI: {
+      orderI(J, n, i, CC_LE);
+      break;
+    }
+    case OP_GTI: {
+      orderI(J, n, i, CC_G);
+      break;
+    }
+    case OP_GEI: {
+      orderI(J, n, i, CC_GE);
+      break;
+    }
+    case OP_TEST: {  /* jump (to 'n + 1') if truth of R[A] is 'k' */
+      int k = GETARG_k(i);
+      opmem(J, 0, X_MOVZX8, RAX, RBASE, tdisp(a));
+      jumpiffalse(J, k ? n + 2 : n + 1);
+      jumpto(J, CC_ALWAYS, k ? n + 1 : n + 2);
+      break;
+    }
+    case OP_TESTSET: {
+      int k = GETARG_k(i);
+      size_t isfalse;
+      opmem(J, 0, X_MOVZX8, RAX, RBASE, tdisp(GETARG_B(i)));
+      emit(J, 0x3C); emit(J, HYDROGEN_VFALSE);  /* cmp al, VFALSE */
+      isfalse = jump(J, CC_E);
+      emit(J, 0xA8); emit(J, 0x0F);  /* test al, 0x0F (nil variants) */
+      if (k) {  /* true value: copy and jump; false: skip the jump */
+        jumpto(J, CC_E, n + 2);
+        copyvalue(J, a, RBASE, vdisp(GETARG_B(i)));
+        jumpto(J, CC_ALWAYS, n + 1);
+        patchhere(J, isfalse);
+        jumpto(J, CC_ALWAYS, n + 2);
+      }
+      else {  /* false value: copy and jump; true: skip the jump */
+        size_t istrue = jump(J, CC_NE);
+        patchhere(J, isfalse);
+        copyvalue(J, a, RBASE, vdisp(GETARG_B(i)));
+        jumpto(J, CC_ALWAYS, n + 1);
+        patchhere(J, istrue);
+        jumpto(J, CC_ALWAYS, n + 2);
+      }
+      break;
+    }
+    case OP_CALL: {
+      callhelper(J, helper(h_call), n);
+      testresult(J);
+      jumpto(J, CC_NE, TEPILOGUE);  /* JIT_CALL */
+      checkhooks(J, n + 1);
+      break;
+    }
+    case OP_TAILCALL: {
+      callhelper(J, helper(h_tailcall), n);
+      jumpto(J, CC_ALWAYS, TEPILOGUE);
+      break;
+    }
+    case OP_RETURN: case OP_RETURN0: case OP_RETURN1: {
+      callhelper(J, helper(h_return), n);
+      jumpto(J, CC_ALWAYS, TEPILOGUE);
+      break;
+    }
+    case OP_FORLOOP: {
+      forloop(J, n, i);
+      break;
+    }
+    case OP_FORPREP: {
+      callhelper(J, helper(h_forprep), n);
+      testresult(J);
+      jumpto(J, CC_NE, n + 2 + GETARG_Bx(i));  /* skip the loop */
+      break;
+    }
+    case OP_TFORPREP: {
+      callhelper(J, helper(h_tforprep), n);
+      jumpto(J, CC_ALWAYS, n + 1 + GETARG_Bx(i));  /* go to OP_TFORCALL */
+      break;
+    }
+    case OP_TFORCALL: {
+      callhelper(J, helper(h_tforcall), n);
+      checkhooks(J, n + 1);
+      break;  /* go on to OP_TFORLOOP */
+    }
+    case OP_TFORLOOP: {
+      tforloop(J, n, i);
+      break;
+    }
+    case OP_SETLIST: {
+      callhelper(J, helper(h_setlist), n);
+      break;  /* OP_EXTRAARG that may follow it has no code */
+    }
+    case OP_CLOSURE: {
+      callhelper(J, helper(h_closure), n);
+      break;
+    }
+    case OP_VARARG: {
+      callhelper(J, helper(h_vararg), n);
+      break;
+    }
+    case OP_VARARGPREP: {
+      callhelper(J, helper(h_varargprep), n);
+      break;
+    }
+    case OP_EXTRAARG: {
+      break;  /* argument of the previous instruction */
+    }
+    default: {
+      J->failed = 1;  /* unknown instruction */
+      break;
+    }
+  }
+}
+
+
+/*
+** Prologue: save callee-saved registers (keeping the stack aligned),
+** load the VM state, and jump to the entry point (third argument).
+*/
+static void prologue (JitState *J) {
+  rex(J, 0, 0, RBX); emit(J, 0x50 + RBX);  /* push rbx */
+  rex(J, 0, 0, R12); emit(J, 0x50 + (R12 & 7));
+  rex(J, 0, 0, R13); emit(J, 0x50 + (R13 & 7));
+  rex(J, 0, 0, R14); emit(J, 0x50 + (R14 & 7));
+  aluimm(J, 5, RSP, 8);
+  opreg(J, 1, X_MOVST, RDI, RL);
+  opreg(J, 1, X_MOVST, RSI, RCI);
+  loadbase(J);
+  opmem(J, 1, X_MOVLD, RCL, RBASE, -vdisp(1));  /* closure from 'func' */
+  opreg(J, 0, 0xFF, 4, RDX);  /* jmp rdx */
+}
+
+
+static void epilogue (JitState *J) {
+  J->epilogue = J->ncode;
+  aluimm(J, 0, RSP, 8);
+  rex(J, 0, 0, R14); emit(J, 0x58 + (R14 & 7));  /* pop r14 */
+  rex(J, 0, 0, R13); emit(J, 0x58 + (R13 & 7));
+  rex(J, 0, 0, R12); emit(J, 0x58 + (R12 & 7));
+  rex(J, 0, 0, RBX); emit(J, 0x58 + RBX);
+  emit(J, 0xC3);  /* ret */
+}
+
+
+/*
+** Resolve all jumps. Exits to the interpreter get a stub that saves
+** the instruction where the interpreter must go on.
+*/
+static void resolve (JitState *J) {
+  int f;
+  int nfix = J->nfix;  /* (stubs do not add fixups) */
+  for (f = 0; f < nfix && !J->failed; f++) {
+    Fixup *fx = &J->fix[f];
+    int t = fx->target;
+    if (t == TEPILOGUE)
+      patch(J, fx->pos, J->epilogue);
+    else if (isexit(t)) {
+      size_t pos = fx->pos;
+      patch(J, pos, J->ncode);
+      movimm(J, RAX, cast_sizet(J->p->code + exitpc(t)));
+      opmem(J, 1, X_MOVST, RAX, RCI, fieldof(CallInfo, u.l.savedpc));
+      opreg(J, 0, 0x31, RAX, RAX);  /* xor eax, eax (JIT_EXIT) */
+      pos = jump(J, CC_ALWAYS);
+      patch(J, pos, J->epilogue);
+    }
+    else if (t < J->p->sizecode)
+      patch(J, fx->pos, J->jc->entry[t]);
+    else
+      J->failed = 1;  /* jump out of the function? */
+  }
+}
+
+/* }================================================================== */
+
+
+
+static void freestate (JitState *J) {
+  if (J->code != NULL)
+    jitrealloc(J->L, J->code, J->sizecode, 0);
+  if (J->fix != NULL)
+    jitrealloc(J->L, J->fix, J->sizefix * sizeof(Fixup), 0);
+}
+
+
+/* copy the native code to executable memory; returns NULL on failure */
+static unsigned char *mapcode (JitState *J) {
+  void *m = mmap(NULL, J->ncode, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (m == MAP_FAILED)
+    return NULL;
+  memcpy(m, J->code, J->ncode);
+  if (mprotect(m, J->ncode, PROT_READ | PROT_EXEC) != 0) {
+    munmap(m, J->ncode);
+    return NULL;
+  }
+  return cast(unsigned char *, m);
+}
+
+
+/*
+** Compile function 'p' to native code. Returns true on success; on
+** failure, mark 'p' so that it is not tried again.
+*/
+int hydrogenJ_compile (hydrogen_State *L, Proto *p) {
+  JitState J;
+  JitCode *jc;
+  size_t size = offsetof(JitCode, entry) + p->sizecode * sizeof(unsigned int);
+  int n;
+  p->hotcount = -1;  /* in case of failures */
+  J.L = L;
+  J.p = p;
+  J.ncode = 0;
+  J.sizecode = 64 + cast_sizet(p->sizecode) * 32;
+  J.fix = NULL;
+  J.nfix = J.sizefix = 0;
+  J.epilogue = 0;
+  J.failed = 0;
+  J.code = cast(unsigned char *, jitrealloc(L, NULL, 0, J.sizecode));
+  jc = J.jc = cast(JitCode *, jitrealloc(L, NULL, 0, size));
+  if (J.code == NULL || jc == NULL) {
+    if (jc != NULL) jitrealloc(L, jc, size, 0);
+    J.failed = 1;
+    freestate(&J);
+    return 0;
+  }
+  jc->size = size;
+  prologue(&J);
+  for (n = 0; n < p->sizecode; n++) {
+    jc->entry[n] = cast_uint(J.ncode);
+    instruction(&J, n);
+  }
+  epilogue(&J);
+  resolve(&J);
+  if (!J.failed && (jc->mcode = mapcode(&J)) != NULL) {
+    jc->msize = J.ncode;
+    p->jit = jc;
+    G(L)->jitcount++;
+  }
+  freestate(&J);
+  if (p->jit == NULL) {
+    jitrealloc(L, jc, size, 0);
+    return 0;
+  }
+  return 1;
+}
+
+
+/*
+** Run the native code of the function running in 'ci', from the
+** instruction pointed by 'savedpc'.
+*/
+int hydrogenJ_run (hydrogen_State *L, CallInfo *ci) {
+  Proto *p = clLvalue(s2v(ci->func))->p;
+  JitCode *jc = p->jit;
+  JitFunction f = (JitFunction)jc->mcode;
+  return f(L, ci, jc->mcode + jc->entry[ci->u.l.savedpc - p->code]);
+}
+
+
+
+/*
+** {==================================================================
+** Traces
+** ===================================================================
+*/
+
+/*
+** A trace is native code for the body of a hot loop, specialized for
+** the path and the types seen in one iteration. The recorder follows
+** the interpreter along that iteration ('hydrogenJ_record' runs before
+** each instruction, as a line hook would) and translates each
+** instruction to a small SSA intermediate representation (IR), with
+** guards for the types and the branches it found. The optimizer then
+** moves loop-invariant instructions (and their guards) to a pre-header,
+** which runs once per entry in the trace, replaces the bounds checks of
+** arrays indexed by the control variable with a check of the whole
+** range of the loop, and removes dead stores and instructions.
+**
+** The trace of a numeric 'for' loop runs the whole loop; the trace of
+** a generic 'for' loop runs its body once, up to the call of the
+** iterator. Traces store each register that they change as they go,
+** so that a guard that fails (a side exit) just returns the number of
+** an exit, which gives the instruction where the interpreter must go
+** on. Traces do not call functions, do not allocate memory, and cannot
+** raise errors.
+*/
+
+
+/* IR instructions ('a', 'b', and 'c' are references, unless noted) */
+enum {
+  IR_KINT, IR_KNUM,  /* constants (in 'k') */
+  IR_SLOAD,  /* register 'a' (a number), type checked at entry */
+  IR_ULOAD,  /* upvalue 'a' (a number) */
+  IR_TARR,  /* array part of table 'a' */
+  IR_TSIZE,  /* size of the array part of table 'a' */
+  IR_ALOAD,  /* element 'b' of array part 'a' */
+  IR_CONV,  /* integer 'a' converted to a float */
+  IR_ADD, IR_SUB, IR_MUL, IR_DIV, IR_MOD, IR_IDIV,
+  IR_BAND, IR_BOR, IR_BXOR,
+  IR_SHL, IR_SHR,  /* 'a' shifted by constant 'c' (a number) */
+  IR_NEG, IR_BNOT,
+  IR_LT, IR_LE, IR_EQ,  /* guard that 'a' op 'b' is 'c' (a number) */
+  IR_NOMT,  /* guard that table 'a' has no metatable */
+  IR_ABOUND,  /* guard that 1 <= 'a' <= 'b' */
+  IR_SSTORE,  /* register 'a' (a number) := 'b' */
+  IR_ASTORE  /* element 'b' of array part 'a' := 'c' */
+};
+
+
+/* types of IR values */
+#define IRT_NONE	0
+#define IRT_INT		1
+#define IRT_NUM		2
+#define IRT_TAB		3
+#define IRT_PTR		4	/* pointer to an array part */
+
+
+/* marks set by the optimizer */
+#define IRM_DEAD	1	/* not emitted */
+#define IRM_INV		2	/* loop invariant: goes to the pre-header */
+#define IRM_RANGE	4	/* bounds check done for the whole loop */
+#define IRM_KEEP	8	/* guard needed even if the value is not */
+#define IRM_NOTEMPTY	16	/* store needs a non-empty element */
+
+
+#define RNONE		0xff	/* no machine register */
+
+
+typedef struct IRIns {
+  lu_byte op;
+  lu_byte t;  /* type of the result */
+  lu_byte mark;
+  lu_byte r;  /* machine register holding the result */
+  int a, b, c;
+  int pc;  /* instruction where a failing guard goes on */
+  union {
+    hydrogen_Integer i;
+    hydrogen_Number n;
+  } k;
+} IRIns;
+
+
+/* limit for the size of a trace */
+#define MAXTRACEIR	1000
+
+
+/* number of registers of a function ('maxstacksize' is a byte) */
+#define MAXTREGS	256
+
+
+typedef struct TraceRecorder {
+  hydrogen_State *L;
+  CallInfo *ci;  /* call being recorded */
+  Proto *p;
+  int start;  /* first instruction of the loop body */
+  int loop;  /* loop instruction */
+  int end;  /* instruction where the trace ends */
+  int next;  /* instruction expected to run next */
+  int cur;  /* instruction being recorded */
+  int lbase;  /* register A of a numeric loop (-1 for other loops) */
+  int nobce;  /* true to keep bounds checks */
+  IRIns *ir;  /* IR (reference 0 is not used) */
+  int nir;
+  int sizeir;
+  int ref[MAXTREGS];  /* current value of each register (0 if unknown) */
+  int sload[MAXTREGS];  /* value of each register at the start */
+  lu_byte written[MAXTREGS];  /* true for registers written in the loop */
+} TraceRecorder;
+
+
+/* exits with fixed numbers */
+#define TEXIT_HEAD	0	/* failed in the pre-header (or hooks) */
+#define TEXIT_END	1	/* loop (or body) ended */
+
+
+typedef struct JitTrace {
+  struct JitTrace *next;  /* other traces of the same function */
+  unsigned char *mcode;  /* executable memory */
+  size_t msize;  /* size of 'mcode' */
+  size_t size;  /* size of this structure */
+  int loop;  /* loop instruction */
+  lu_mem entries;  /* number of runs */
+  lu_mem headexits;  /* runs that did not get past the pre-header */
+  int nexits;
+  int exitpc[1];  /* instruction where each exit goes on */
+} JitTrace;
+
+
+typedef int (*TraceFunction) (hydrogen_State *L, StkId base);
+
+
+/* run a trace at least this many times before judging its exits */
+#define MINTRACERUNS	32
+
+
+
+/*
+** {======================================================
+** Recorder
+** =======================================================
+*/
+
+#define regvalue(R,r)	s2v((R)->ci->func + 1 + (r))
+
+
+static void freerecorder (hydrogen_State *L, TraceRecorder *R) {
+  if (R->ir != NULL)
+    jitrealloc(L, R->ir, R->sizeir * sizeof(IRIns), 0);
+  jitrealloc(L, R, sizeof(TraceRecorder), 0);
+}
+
+
+/* emit an IR instruction; returns its reference, or 0 on failure */
+static int emitir (TraceRecorder *R, int op, int t, int a, int b, int c) {
+  IRIns *ins;
+  if (R->nir >= R->sizeir) {
+    int newsize = R->sizeir * 2;
+    IRIns *newir;
+    if (newsize > MAXTRACEIR)
+      return 0;  /* trace too long */
+    newir = cast(IRIns *, jitrealloc(R->L, R->ir, R->sizeir * sizeof(IRIns),
+                                     newsize * sizeof(IRIns)));
+    if (newir == NULL)
+      return 0;
+    R->ir = newir;
+    R->sizeir = newsize;
+  }
+  ins = &R->ir[R->nir];
+  ins->op = cast_byte(op);
+  ins->t = cast_byte(t);
+  ins->mark = 0;
+  ins->r = RNONE;
+  ins->a = a; ins->b = b; ins->c = c;
+  ins->pc = R->cur;
+  ins->k.i = 0;
+  return R->nir++;
+}
+
+
+/*
+** Emit an instruction without side effects, reusing an equal previous
+** one. A load from an array cannot reuse a load before a store.
+*/
+static int cse (TraceRecorder *R, int op, int t, int a, int b, int c) {
+  int ref;
+  if (a == 0 || (b == 0 && op >= IR_ADD && op <= IR_BXOR))
+    return 0;  /* some operand failed */
+  for (ref = R->nir - 1; ref > 0; ref--) {
+    IRIns *ins = &R->ir[ref];
+    if (ins->op == op && ins->t == t && ins->a == a && ins->b == b &&
+        ins->c == c)
+      return ref;
+    if (ins->op == IR_ASTORE && op == IR_ALOAD)
+      break;
+  }
+  return emitir(R, op, t, a, b, c);
+}
+
+
+static int kint (TraceRecorder *R, hydrogen_Integer i) {
+  int ref;
+  for (ref = 1; ref < R->nir; ref++) {
+    if (R->ir[ref].op == IR_KINT && R->ir[ref].k.i == i)
+      return ref;
+  }
+  ref = emitir(R, IR_KINT, IRT_INT, 0, 0, 0);
+  if (ref != 0)
+    R->ir[ref].k.i = i;
+  return ref;
+}
+
+
+static int knum (TraceRecorder *R, hydrogen_Number n) {
+  int ref;
+  for (ref = 1; ref < R->nir; ref++) {  /* (compare bits: -0.0, NaN) */
+    if (R->ir[ref].op == IR_KNUM && numbits(R->ir[ref].k.n) == numbits(n))
+      return ref;
+  }
+  ref = emitir(R, IR_KNUM, IRT_NUM, 0, 0, 0);
+  if (ref != 0)
+    R->ir[ref].k.n = n;
+  return ref;
+}
+
+
+/* constant 'o' (only numbers) */
+static int kvalue (TraceRecorder *R, const TValue *o) {
+  if (ttisinteger(o))
+    return kint(R, ivalue(o));
+  else if (ttisfloat(o))
+    return knum(R, fltvalue(o));
+  else
+    return 0;  /* not yet implemented */
+}
+
+
+static int irtype (const TValue *o) {
+  if (ttisinteger(o))
+    return IRT_INT;
+  else if (ttisfloat(o))
+    return IRT_NUM;
+  else if (ttistable(o))
+    return IRT_TAB;
+  else
+    return IRT_NONE;
+}
+
+
+/* current value of register 'r' */
+static int getreg (TraceRecorder *R, int r) {
+  if (R->ref[r] == 0) {  /* not used yet? */
+    int t = irtype(regvalue(R, r));
+    if (t == IRT_NONE)
+      return 0;  /* not yet implemented */
+    R->ref[r] = R->sload[r] = emitir(R, IR_SLOAD, t, r, 0, 0);
+  }
+  return R->ref[r];
+}
+
+
+static int setreg (TraceRecorder *R, int r, int v) {
+  if (v == 0)
+    return 0;
+  R->ref[r] = v;
+  R->written[r] = 1;
+  return emitir(R, IR_SSTORE, IRT_NONE, r, v, 0) != 0;
+}
+
+
+static int isnumber (TraceRecorder *R, int x) {
+  return (R->ir[x].t == IRT_INT || R->ir[x].t == IRT_NUM);
+}
+
+
+/* value 'x' (a number) as a float */
+static int tonum (TraceRecorder *R, int x) {
+  IRIns *ins = &R->ir[x];
+  if (ins->t == IRT_NUM)
+    return x;
+  else if (ins->op == IR_KINT)
+    return knum(R, cast_num(ins->k.i));
+  else
+    return cse(R, IR_CONV, IRT_NUM, x, 0, 0);
+}
+
+
+/* arithmetic operation 'op' over numbers 'x' and 'y' */
+static int arith (TraceRecorder *R, int op, int x, int y) {
+  if (x == 0 || y == 0 || !isnumber(R, x) || !isnumber(R, y))
+    return 0;  /* metamethods are not yet implemented */
+  if (R->ir[x].t == IRT_INT && R->ir[y].t == IRT_INT && op != IR_DIV)
+    return cse(R, op, IRT_INT, x, y, 0);
+  else if (op == IR_ADD || op == IR_SUB || op == IR_MUL || op == IR_DIV) {
+    x = tonum(R, x);
+    y = tonum(R, y);
+    return cse(R, op, IRT_NUM, x, y, 0);
+  }
+  else
+    return 0;  /* float modulo, floor division, and bitwise: NYI */
+}
+
+
+/* true if integer divisor 'o' makes 'op' raise an error or need care */
+static int baddivisor (const TValue *o) {
+  return (!ttisinteger(o) || l_castS2U(ivalue(o)) + 1u <= 1u);
+}
+
+
+/* register 'a' := 'x' ^ 'y', only for a constant 2 */
+static int power (TraceRecorder *R, int a, int x, const TValue *y) {
+  if (x == 0 || !isnumber(R, x) ||
+      !(ttisnumber(y) && nvalue(y) == cast_num(2)))
+    return 0;
+  x = tonum(R, x);
+  return setreg(R, a, cse(R, IR_MUL, IRT_NUM, x, x, 0));
+}
+
+
+/* number of bits in an integer */
+#define NBITS	cast_int(sizeof(hydrogen_Integer) * CHAR_BIT)
+
+/* register 'a' := 'x' shifted left by constant 'n' (right if negative) */
+static int shift (TraceRecorder *R, int a, int x, int n) {
+  if (x == 0 || R->ir[x].t != IRT_INT)
+    return 0;
+  if (n <= -NBITS || n >= NBITS)
+    x = kint(R, 0);
+  else if (n > 0)
+    x = cse(R, IR_SHL, IRT_INT, x, 0, n);
+  else if (n < 0)
+    x = cse(R, IR_SHR, IRT_INT, x, 0, -n);
+  return setreg(R, a, x);
+}
+
+
+/*
+** Array part of table 'h' (value 'tr') with the bounds check for key
+** 'key', whose value is 'ik'.
+*/
+static int element (TraceRecorder *R, Table *h, int tr, int key,
+                    hydrogen_Integer ik) {
+  int arr, size;
+  if (tr == 0 || key == 0 || R->ir[key].t != IRT_INT)
+    return 0;
+  if (!(l_castS2U(ik) - 1u < h->alimit))
+    return 0;  /* hash part: not yet implemented */
+  arr = cse(R, IR_TARR, IRT_PTR, tr, 0, 0);
+  size = cse(R, IR_TSIZE, IRT_INT, tr, 0, 0);
+  if (arr == 0 || size == 0 || cse(R, IR_ABOUND, IRT_NONE, key, size, 0) == 0)
+    return 0;
+  return arr;
+}
+
+
+/* table in register 'r' */
+static int tabreg (TraceRecorder *R, int r) {
+  int t = getreg(R, r);
+  if (t == 0 || R->ir[t].t != IRT_TAB)
+    return 0;
+  return t;
+}
+
+
+/* register 'a' := table in register 'b' indexed by 'key' */
+static int getarray (TraceRecorder *R, int a, int b, int key,
+                     hydrogen_Integer ik) {
+  int tr = tabreg(R, b);
+  Table *h = (tr != 0) ? hvalue(regvalue(R, b)) : NULL;
+  int arr = element(R, h, tr, key, ik);
+  TValue v;
+  int t;
+  if (arr == 0)
+    return 0;
+  arrgetobj(h, ik - 1, &v);
+  t = irtype(&v);
+  if (t == IRT_NONE || t == IRT_TAB)
+    return 0;  /* not yet implemented */
+  return setreg(R, a, cse(R, IR_ALOAD, t, arr, key, 0));
+}
+
+
+/* table in register 'a' indexed by 'key' := 'v' */
+static int setarray (TraceRecorder *R, int a, int key, hydrogen_Integer ik,
+                     int v) {
+  int tr = tabreg(R, a);
+  Table *h = (tr != 0) ? hvalue(regvalue(R, a)) : NULL;
+  int arr = element(R, h, tr, key, ik);
+  int st;
+  if (arr == 0 || v == 0 || !isnumber(R, v))
+    return 0;  /* other values need a barrier */
+  if (h->metatable == NULL) {
+    if (cse(R, IR_NOMT, IRT_NONE, tr, 0, 0) == 0)
+      return 0;
+  }
+  else if (arrisempty(h, ik - 1))
+    return 0;  /* may need '__newindex' */
+  st = emitir(R, IR_ASTORE, IRT_NONE, arr, key, v);
+  if (st == 0)
+    return 0;
+  if (h->metatable != NULL)
+    R->ir[st].mark |= IRM_NOTEMPTY;
+  return 1;
+}
+
+
+/*
+** Compare numbers 'x' and 'y' with 'op' (integers or floats, not mixed);
+** 'res' is the result found by the recorder. Emit a guard for that
+** result, with an exit to the other branch of comparison 'n'.
+*/
+static int branch (TraceRecorder *R, int n, int op, int x, int y, int res) {
+  Instruction i = R->p->code[n];
+  int g;
+  if (x == 0 || y == 0 || !isnumber(R, x) || R->ir[x].t != R->ir[y].t)
+    return 0;
+  g = emitir(R, op, IRT_NONE, x, y, res);
+  if (g == 0)
+    return 0;
+  if (res == GETARG_k(i)) {  /* interpreter will take the jump? */
+    R->next = n + 2 + GETARG_sJ(R->p->code[n + 1]);
+    R->ir[g].pc = n + 2;
+  }
+  else {
+    R->next = n + 2;
+    R->ir[g].pc = n + 1;  /* the jump */
+  }
+  return 1;
+}
+
+
+/* result of 'op' over two numbers of the same type (or -1) */
+static int numcompare (int op, const TValue *x, const TValue *y) {
+  if (ttisinteger(x) && ttisinteger(y)) {
+    hydrogen_Integer a = ivalue(x), b = ivalue(y);
+    return (op == IR_LT) ? a < b : (op == IR_LE) ? a <= b : a == b;
+  }
+  else if (ttisfloat(x) && ttisfloat(y)) {
+    hydrogen_Number a = fltvalue(x), b = fltvalue(y);
+    return (op == IR_LT) ? hydrogeni_numlt(a, b) :
+           (op == IR_LE) ? hydrogeni_numle(a, b) : hydrogeni_numeq(a, b);
+  }
+  else
+    return -1;
+}
+
+
+/*
+** Comparison 'n' of register A with immediate sB: 'op' with the
+** register on the left, or on the right if 'swap'.
+*/
+static int comparei (TraceRecorder *R, int n, int op, int swap) {
+  Instruction i = R->p->code[n];
+  const TValue *v = regvalue(R, GETARG_A(i));
+  TValue im;
+  int x, y;
+  if (ttisinteger(v)) {
+    setivalue(&im, GETARG_sB(i));
+    y = kint(R, GETARG_sB(i));
+  }
+  else if (ttisfloat(v)) {
+    setfltvalue(&im, cast_num(GETARG_sB(i)));
+    y = knum(R, cast_num(GETARG_sB(i)));
+  }
+  else
+    return 0;
+  x = getreg(R, GETARG_A(i));
+  if (swap)
+    return branch(R, n, op, y, x, numcompare(op, &im, v));
+  else
+    return branch(R, n, op, x, y, numcompare(op, v, &im));
+}
+
+
+/* comparison 'n' of register A with value 'w' (in register 'y') */
+static int compare (TraceRecorder *R, int n, int op, int y, const TValue *w) {
+  int a = GETARG_A(R->p->code[n]);
+  int res = numcompare(op, regvalue(R, a), w);
+  if (res < 0)
+    return 0;  /* other values (or mixed numbers) not yet implemented */
+  return branch(R, n, op, getreg(R, a), y, res);
+}
+
+
+/* next instruction after the conditional jump of a test of 'n' */
+static void condnext (TraceRecorder *R, int n, int res) {
+  if (res != GETARG_k(R->p->code[n]))
+    R->next = n + 2;  /* skip the jump */
+  else
+    R->next = n + 2 + GETARG_sJ(R->p->code[n + 1]);
+}
+
+
+/*
+** Record instruction 'n'. Returns false if the instruction (or the
+** values it has) is not yet implemented; then, recording stops.
+*/
+static int recordins (TraceRecorder *R, int n) {
+  Proto *p = R->p;
+  Instruction i = p->code[n];
+  int a = GETARG_A(i);
+  TValue *k = p->k;
+  R->cur = n;
+  R->next = n + 1;
+  switch (GET_GENERICOP(i)) {
+    case OP_MOVE:
+      return setreg(R, a, getreg(R, GETARG_B(i)));
+    case OP_LOADI:
+      return setreg(R, a, kint(R, GETARG_sBx(i)));
+    case OP_LOADF:
+      return setreg(R, a, knum(R, cast_num(GETARG_sBx(i))));
+    case OP_LOADK:
+      return setreg(R, a, kvalue(R, k + GETARG_Bx(i)));
+    case OP_GETUPVAL: {
+      int t = irtype(cicl(R->ci)->upvals[GETARG_B(i)]->v);
+      if (t != IRT_INT && t != IRT_NUM)
+        return 0;
+      return setreg(R, a, cse(R, IR_ULOAD, t, GETARG_B(i), 0, 0));
+    }
+    case OP_GETTABLE: {
+      const TValue *key = regvalue(R, GETARG_C(i));
+      if (!ttisinteger(key))
+        return 0;
+      return getarray(R, a, GETARG_B(i), getreg(R, GETARG_C(i)),
+                         ivalue(key));
+    }
+    case OP_GETI:
+      return getarray(R, a, GETARG_B(i), kint(R, GETARG_C(i)), GETARG_C(i));
+    case OP_SETTABLE: case OP_SETI: {
+      int v = TESTARG_k(i) ? kvalue(R, k + GETARG_C(i))
+                           : getreg(R, GETARG_C(i));
+      if (GET_GENERICOP(i) == OP_SETI)
+        return setarray(R, a, kint(R, GETARG_B(i)), GETARG_B(i), v);
+      else {
+        const TValue *key = regvalue(R, GETARG_B(i));
+        if (!ttisinteger(key))
+          return 0;
+        return setarray(R, a, getreg(R, GETARG_B(i)), ivalue(key), v);
+      }
+    }
+    case OP_ADDI: {
+      R->next = n + 2;  /* skip OP_MMBINI */
+      return setreg(R, a, arith(R, IR_ADD, getreg(R, GETARG_B(i)),
+                                   kint(R, GETARG_sC(i))));
+    }
+    case OP_ADDK: case OP_SUBK: case OP_MULK: case OP_DIVK:
+    case OP_MODK: case OP_IDIVK: case OP_BANDK: case OP_BORK:
+    case OP_BXORK: case OP_POWK: {
+      static const lu_byte kops[] = {IR_ADD, IR_SUB, IR_MUL, IR_MOD, 0,
+                                     IR_DIV, IR_IDIV, IR_BAND, IR_BOR,
+                                     IR_BXOR};
+      TValue *kc = k + GETARG_C(i);
+      int op = kops[GET_GENERICOP(i) - OP_ADDK];
+      R->next = n + 2;  /* skip OP_MMBINK */
+      if (GET_GENERICOP(i) == OP_POWK)
+        return power(R, a, getreg(R, GETARG_B(i)), kc);
+      if ((op == IR_MOD || op == IR_IDIV) && baddivisor(kc))
+        return 0;
+      return setreg(R, a, arith(R, op, getreg(R, GETARG_B(i)),
+                                   kvalue(R, kc)));
+    }
+    case OP_SHRI: {
+      R->next = n + 2;  /* skip OP_MMBINI */
+      return shift(R, a, getreg(R, GETARG_B(i)), -GETARG_sC(i));
+    }
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_MOD: case OP_POW:
+    case OP_DIV: case OP_IDIV: case OP_BAND: case OP_BOR: case OP_BXOR: {
+      static const lu_byte rops[] = {IR_ADD, IR_SUB, IR_MUL, IR_MOD, 0,
+                                     IR_DIV, IR_IDIV, IR_BAND, IR_BOR,
+                                     IR_BXOR};
+      int op = rops[GET_GENERICOP(i) - OP_ADD];
+      R->next = n + 2;  /* skip OP_MMBIN */
+      if (GET_GENERICOP(i) == OP_POW)
+        return 0;  /* only constant exponents */
+      if ((op == IR_MOD || op == IR_IDIV) &&
+          baddivisor(regvalue(R, GETARG_C(i))))
+        return 0;
+      return setreg(R, a, arith(R, op, getreg(R, GETARG_B(i)),
+                                   getreg(R, GETARG_C(i))));
+    }
+    case OP_UNM: case OP_BNOT: {
+      int x = getreg(R, GETARG_B(i));
+      if (x == 0 || !isnumber(R, x) ||
+          (GET_GENERICOP(i) == OP_BNOT && R->ir[x].t != IRT_INT))
+        return 0;
+      return setreg(R, a, cse(R, (GET_GENERICOP(i) == OP_UNM) ? IR_NEG
+                                                               : IR_BNOT,
+                                 R->ir[x].t, x, 0, 0));
+    }
+    case OP_JMP: {
+      R->next = n + 1 + GETARG_sJ(i);
+      return (R->next > n);  /* inner loops are not yet implemented */
+    }
+    case OP_EQ: case OP_LT: case OP_LE: {
+      int op = (GET_GENERICOP(i) == OP_EQ) ? IR_EQ
+             : (GET_GENERICOP(i) == OP_LT) ? IR_LT : IR_LE;
+      return compare(R, n, op, getreg(R, GETARG_B(i)),
+                        regvalue(R, GETARG_B(i)));
+    }
+    case OP_EQK: {
+      TValue *kb = k + GETARG_B(i);
+      return compare(R, n, IR_EQ, kvalue(R, kb), kb);
+    }
+    case OP_EQI: return comparei(R, n, IR_EQ, 0);
+    case OP_LTI: return comparei(R, n, IR_LT, 0);
+    case OP_LEI: return comparei(R, n, IR_LE, 0);
+    case OP_GTI: return comparei(R, n, IR_LT, 1);
+    case OP_GEI: return comparei(R, n, IR_LE, 1);
+    case OP_TEST: {  /* numbers and tables are true */
+      int x = getreg(R, a);
+      if (x == 0)
+        return 0;
+      R->ir[x].mark |= IRM_KEEP;  /* its type guard decides the test */
+      condnext(R, n, 1);
+      return 1;
+    }
+    default:
+      return 0;  /* not yet implemented */
+  }
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Optimizer
+** =======================================================
+*/
+
+/* references used by an instruction; returns how many */
+static int operands (const IRIns *ins, int *ops) {
+  switch (ins->op) {
+    case IR_KINT: case IR_KNUM: case IR_SLOAD: case IR_ULOAD:
+      return 0;
+    case IR_TARR: case IR_TSIZE: case IR_CONV: case IR_NEG: case IR_BNOT:
+    case IR_SHL: case IR_SHR: case IR_NOMT:
+      ops[0] = ins->a;
+      return 1;
+    case IR_SSTORE:
+      ops[0] = ins->b;
+      return 1;
+    case IR_ABOUND:
+      if (ins->mark & IRM_RANGE) {  /* index is not used */
+        ops[0] = ins->b;
+        return 1;
+      }
+      /* FALLTHROUGH */
+    case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_MOD:
+    case IR_IDIV: case IR_BAND: case IR_BOR: case IR_BXOR: case IR_ALOAD:
+    case IR_LT: case IR_LE: case IR_EQ:
+      ops[0] = ins->a; ops[1] = ins->b;
+      return 2;
+    default:  /* IR_ASTORE */
+      ops[0] = ins->a; ops[1] = ins->b; ops[2] = ins->c;
+      return 3;
+  }
+}
+
+
+/* true if the divisor of a division must be checked */
+#define checkdiv(R,ins)  \
+	(((ins)->op == IR_MOD || (ins)->op == IR_IDIV) &&  \
+	 (R)->ir[(ins)->b].op != IR_KINT)
+
+
+/* true if instruction 'ins' in the loop body may leave the trace */
+static int canexit (TraceRecorder *R, const IRIns *ins) {
+  switch (ins->op) {
+    case IR_ULOAD: case IR_ALOAD: case IR_LT: case IR_LE: case IR_EQ:
+    case IR_NOMT: case IR_ABOUND:
+      return 1;
+    case IR_ASTORE:
+      return (ins->mark & IRM_NOTEMPTY);
+    default:
+      return checkdiv(R, ins);
+  }
+}
+
+
+/* true if instruction 'ins' must be emitted even if its value is unused */
+static int isroot (TraceRecorder *R, const IRIns *ins) {
+  switch (ins->op) {
+    case IR_SSTORE: case IR_ASTORE: case IR_ALOAD: case IR_LT: case IR_LE:
+    case IR_EQ: case IR_NOMT: case IR_ABOUND:
+      return 1;
+    default:  /* division by zero must raise its error */
+      return (ins->mark & IRM_KEEP) || checkdiv(R, ins);
+  }
+}
+
+
+/*
+** In a numeric loop, each register read before being written must
+** have the same type when the iteration ends, because the type guards
+** of these values run only once, in the pre-header.
+*/
+static int stabletypes (TraceRecorder *R) {
+  int r;
+  for (r = 0; r < R->p->maxstacksize; r++) {
+    int s = R->sload[r];
+    if (s != 0 && R->written[r] && r != R->lbase + 3 &&
+        R->ir[R->ref[r]].t != R->ir[s].t)
+      return 0;
+  }
+  return 1;
+}
+
+
+/* mark the loop-invariant instructions */
+static void hoist (TraceRecorder *R) {
+  IRIns *ir = R->ir;
+  int stores = 0;
+  int ref;
+  for (ref = 1; ref < R->nir; ref++)
+    stores |= (ir[ref].op == IR_ASTORE);
+  for (ref = 1; ref < R->nir; ref++) {
+    IRIns *ins = &ir[ref];
+    int ops[3];
+    int n, inv;
+    switch (ins->op) {
+      case IR_SLOAD: inv = !R->written[ins->a]; break;
+      case IR_SSTORE: case IR_ASTORE: inv = 0; break;
+      case IR_ALOAD: inv = !stores; break;
+      default: inv = 1;  /* constants, upvalues, and pure instructions */
+    }
+    for (n = operands(ins, ops); inv && n > 0; n--)
+      inv = (ir[ops[n - 1]].mark & IRM_INV);
+    if (inv)
+      ins->mark |= IRM_INV;
+  }
+}
+
+
+/* true if 'x' is the control variable plus a constant (in 'off') */
+static int affine (TraceRecorder *R, int x, int *off) {
+  int iv = R->sload[R->lbase + 3];
+  IRIns *ins = &R->ir[x];
+  int y;
+  if (x == iv && iv != 0) {
+    *off = 0;
+    return 1;
+  }
+  if (iv == 0 || (ins->op != IR_ADD && ins->op != IR_SUB) ||
+      ins->t != IRT_INT)
+    return 0;
+  if (ins->a == iv)
+    y = ins->b;
+  else if (ins->b == iv && ins->op == IR_ADD)
+    y = ins->a;
+  else
+    return 0;
+  if (R->ir[y].op != IR_KINT ||
+      !(-MAXARG_sJ <= R->ir[y].k.i && R->ir[y].k.i <= MAXARG_sJ))
+    return 0;
+  *off = cast_int(R->ir[y].k.i);
+  if (ins->op == IR_SUB)
+    *off = -*off;
+  return 1;
+}
+
+
+/*
+** Bounds checks of an invariant array indexed by the control variable
+** (plus a constant) are done once, for all the iterations that remain,
+** in the pre-header.
+*/
+static void rangechecks (TraceRecorder *R) {
+  int ref, off;
+  for (ref = 1; ref < R->nir; ref++) {
+    IRIns *ins = &R->ir[ref];
+    if (ins->op == IR_ABOUND && !(ins->mark & IRM_INV) &&
+        (R->ir[ins->b].mark & IRM_INV) && affine(R, ins->a, &off)) {
+      ins->mark |= IRM_RANGE;
+      ins->c = off;
+    }
+  }
+}
+
+
+/*
+** Remove stores to registers written again before any exit from the
+** loop body, and then all instructions whose values are not used.
+*/
+static void deadcode (TraceRecorder *R) {
+  lu_byte stored[MAXTREGS];
+  lu_byte used[MAXTRACEIR];
+  int ref;
+  memset(stored, 0, sizeof(stored));
+  for (ref = R->nir - 1; ref > 0; ref--) {
+    IRIns *ins = &R->ir[ref];
+    if (ins->mark & (IRM_INV | IRM_RANGE))
+      continue;  /* not in the loop body */
+    if (ins->op == IR_SSTORE) {
+      if (stored[ins->a])
+        ins->mark |= IRM_DEAD;
+      stored[ins->a] = 1;
+    }
+    else if (canexit(R, ins))
+      memset(stored, 0, sizeof(stored));
+  }
+  memset(used, 0, sizeof(used));
+  for (ref = R->nir - 1; ref > 0; ref--) {
+    IRIns *ins = &R->ir[ref];
+    if (!(ins->mark & IRM_DEAD) && (used[ref] || isroot(R, ins))) {
+      int ops[3];
+      int n;
+      for (n = operands(ins, ops); n > 0; n--)
+        used[ops[n - 1]] = 1;
+    }
+    else
+      ins->mark |= IRM_DEAD;
+  }
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Assembler
+** =======================================================
+*/
+
+/* registers of traces */
+#define TBASE	RBX	/* 'base' */
+#define TL	RBP	/* 'L' */
+
+/* registers available for values (the others are scratch) */
+#define GPRSET	((1 << RCX) | (1 << RSI) | (1 << RDI) | (1 << R8) |  \
+		 (1 << R9) | (1 << R10) | (1 << R12) | (1 << R13) |  \
+		 (1 << R14) | (1 << R15))
+#define XMMSET	0x3fff	/* xmm0-xmm13 */
+
+
+#define X_MOVAPS	0x28
+#define X_UCOMISD	0x2E
+#define X_DIVSD		0x5E
+#define X_XORPS		0x57
+
+
+/* last use of a value computed in the pre-header and used in the loop */
+#define PINNED		MAXTRACEIR
+
+
+typedef struct TraceAsm {
+  JitState J;
+  TraceRecorder *R;
+  int *lastuse;  /* last instruction that uses each value */
+  int *exitpc;  /* instruction where each exit goes on */
+  int nexits;
+  int gprs;  /* free general-purpose registers */
+  int xmms;  /* free SSE registers */
+  int header;  /* true while assembling the pre-header */
+} TraceAsm;
+
+
+/* true if instruction 'ins' goes to the pre-header */
+#define inheader(ins)	((ins)->mark & (IRM_INV | IRM_RANGE))
+
+
+/* tag of values of type 't' */
+static int irtag (int t) {
+  switch (t) {
+    case IRT_INT: return HYDROGEN_VNUMINT;
+    case IRT_NUM: return HYDROGEN_VNUMFLT;
+    default: return ctb(HYDROGEN_VTABLE);
+  }
+}
+
+
+/* SSE 'op' with registers 'x' and 'y' (with an optional prefix) */
+static void ssereg (JitState *J, int prefix, int w, int op, int x, int y) {
+  if (prefix != 0)
+    emit(J, prefix);
+  rex(J, w, x, y);
+  emit(J, 0x0F);
+  emit(J, op);
+  emit(J, 0xC0 | ((x & 7) << 3) | (y & 7));
+}
+
+
+/* number of the exit to instruction 'pc' */
+static int exitno (TraceAsm *A, int pc) {
+  int e;
+  if (A->header)
+    return TEXIT_HEAD;
+  for (e = TEXIT_END + 1; e < A->nexits; e++) {
+    if (A->exitpc[e] == pc)
+      return e;
+  }
+  A->exitpc[A->nexits] = pc;
+  return A->nexits++;
+}
+
+
+/* leave the trace (at instruction 'pc') on condition 'cc' */
+static void guard (TraceAsm *A, int cc, int pc) {
+  size_t pos = jump(&A->J, cc);
+  addfixup(&A->J, pos, exitno(A, pc));
+}
+
+
+static int allocreg (TraceAsm *A, int ref) {
+  IRIns *ins = &A->R->ir[ref];
+  int *set = (ins->t == IRT_NUM) ? &A->xmms : &A->gprs;
+  int r;
+  for (r = 0; r < 16; r++) {
+    if (*set & (1 << r)) {
+      *set &= ~(1 << r);
+      ins->r = cast_byte(r);
+      return r;
+    }
+  }
+  A->J.failed = 1;  /* out of registers: spills are not yet implemented */
+  return (ins->t == IRT_NUM) ? XMM15 : R11;
+}
+
+
+static void freereg (TraceAsm *A, int ref) {
+  IRIns *ins = &A->R->ir[ref];
+  if (ins->r != RNONE) {
+    if (ins->t == IRT_NUM)
+      A->xmms |= 1 << ins->r;
+    else
+      A->gprs |= 1 << ins->r;
+    ins->r = RNONE;
+  }
+}
+
+
+/* register with integer (or pointer) 'ref'; constants go to 'scratch' */
+static int gpr (TraceAsm *A, int ref, int scratch) {
+  IRIns *ins = &A->R->ir[ref];
+  if (ins->op == IR_KINT) {
+    movimm(&A->J, scratch, cast_sizet(l_castS2U(ins->k.i)));
+    return scratch;
+  }
+  else if (ins->r == RNONE) {  /* should not happen */
+    A->J.failed = 1;
+    return scratch;
+  }
+  return ins->r;
+}
+
+
+/* register with float 'ref'; constants go to 'scratch' */
+static int xmm (TraceAsm *A, int ref, int scratch) {
+  IRIns *ins = &A->R->ir[ref];
+  if (ins->op == IR_KNUM) {
+    movimm(&A->J, RAX, numbits(ins->k.n));
+    ssereg(&A->J, 0x66, 1, 0x6E, scratch, RAX);  /* movq scratch, rax */
+    return scratch;
+  }
+  else if (ins->r == RNONE) {
+    A->J.failed = 1;
+    return scratch;
+  }
+  return ins->r;
+}
+
+
+/* integer 'ref' to register 'r' */
+static void movgpr (TraceAsm *A, int r, int ref) {
+  int s = gpr(A, ref, r);
+  if (s != r)
+    opreg(&A->J, 1, X_MOVLD, r, s);
+}
+
+
+/* float 'ref' to register 'x' */
+static void movxmm (TraceAsm *A, int x, int ref) {
+  int s = xmm(A, ref, x);
+  if (s != x)
+    ssereg(&A->J, 0, 0, X_MOVAPS, x, s);
+}
+
+
+/* store the value (not the tag) of 'ref' at '[b + disp]' */
+static void storeraw (TraceAsm *A, int ref, int b, int disp) {
+  JitState *J = &A->J;
+  IRIns *ins = &A->R->ir[ref];
+  if (ins->op == IR_KNUM) {
+    movimm(J, R11, numbits(ins->k.n));
+    opmem(J, 1, X_MOVST, R11, b, disp);
+  }
+  else if (ins->t == IRT_NUM)
+    ssemem(J, 0xF2, 0x11, xmm(A, ref, XMM15), b, disp);
+  else
+    opmem(J, 1, X_MOVST, gpr(A, ref, R11), b, disp);
+}
+
+
+/* store value 'ref' (of type 't') at '[b + disp]', with its tag */
+static void storevalue (TraceAsm *A, int ref, int b, int disp) {
+  JitState *J = &A->J;
+  storeraw(A, ref, b, disp);
+  opmem(J, 0, 0xC6, 0, b, disp + fieldof(TValue, tt_));
+  emit(J, irtag(A->R->ir[ref].t));
+}
+
+
+/*
+** Addresses in the array part 'arr' (see 'arrval' in 'table.h'): the
+** value of element 'key' (from 1) is at 'arr - key * sizeof(Value)',
+** and its tag is at 'arr + key - 1'.
+*/
+
+/* rax := address of the value of element 'key' of array part 'arr' */
+static void valaddr (TraceAsm *A, int arr, int key) {
+  JitState *J = &A->J;
+  opreg(J, 1, 0x69, RAX, gpr(A, key, R11));  /* imul rax, key, -size */
+  emit32(J, cast_uint(-cast_int(sizeof(Value))));
+  opreg(J, 1, X_ADD, RAX, gpr(A, arr, R11));
+}
+
+
+/* rax := address just after the tag of element 'key' of array part 'arr' */
+static void tagaddr (TraceAsm *A, int arr, int key) {
+  movgpr(A, RAX, key);
+  opreg(&A->J, 1, X_ADD, RAX, gpr(A, arr, R11));
+}
+
+
+/* integer binary operation 'ins' into register 'r' */
+static void intarith (TraceAsm *A, IRIns *ins, int r) {
+  static const int ext[] = {0, 5, -1, -1, -1, -1, 4, 1, 6};
+  static const int ops[] = {X_ADD, X_SUB, X_IMUL, 0, 0, 0, 0x23, 0x0B, 0x33};
+  JitState *J = &A->J;
+  IRIns *b = &A->R->ir[ins->b];
+  int op = ins->op - IR_ADD;
+  movgpr(A, r, ins->a);
+  if (b->op == IR_KINT && ext[op] >= 0 &&
+      -0x7fffffff <= b->k.i && b->k.i <= 0x7fffffff)
+    aluimm(J, ext[op], r, cast_int(b->k.i));
+  else
+    opreg(J, 1, ops[op], r, gpr(A, ins->b, R11));
+}
+
+
+/* integer floor division or modulo 'ins' into register 'r' */
+static void intdiv (TraceAsm *A, IRIns *ins, int r) {
+  JitState *J = &A->J;
+  size_t done, done2;
+  movgpr(A, R11, ins->b);
+  if (A->R->ir[ins->b].op != IR_KINT) {  /* check for 0 and -1 */
+    opmem(J, 1, 0x8D, RAX, R11, 1);  /* lea rax, [r11 + 1] */
+    aluimm(J, 7, RAX, 1);
+    guard(A, CC_BE, ins->pc);
+  }
+  movgpr(A, RAX, ins->a);
+  emit(J, 0x48); emit(J, 0x99);  /* cqo */
+  opreg(J, 1, 0xF7, 7, R11);  /* idiv r11 */
+  opreg(J, 1, 0x85, RDX, RDX);
+  done = jump(J, CC_E);  /* exact? */
+  if (ins->op == IR_IDIV) {  /* quotient rounds to minus infinity */
+    opreg(J, 1, 0x33, RDX, R11);
+    done2 = jump(J, CC_NS);  /* same signs? */
+    aluimm(J, 5, RAX, 1);
+  }
+  else {  /* remainder takes the sign of the divisor */
+    opreg(J, 1, X_MOVLD, RAX, RDX);
+    opreg(J, 1, 0x33, RAX, R11);
+    done2 = jump(J, CC_NS);
+    opreg(J, 1, X_ADD, RDX, R11);
+  }
+  patchhere(J, done);
+  patchhere(J, done2);
+  opreg(J, 1, X_MOVLD, r, (ins->op == IR_IDIV) ? RAX : RDX);
+}
+
+
+/* guard for comparison 'ins' */
+static void compareguard (TraceAsm *A, IRIns *ins) {
+  JitState *J = &A->J;
+  int cc;
+  if (A->R->ir[ins->a].t == IRT_INT) {
+    int ra = gpr(A, ins->a, R11);
+    opreg(J, 1, X_CMP, ra, gpr(A, ins->b, RAX));
+    cc = (ins->op == IR_LT) ? CC_L : (ins->op == IR_LE) ? CC_LE : CC_E;
+  }
+  else {
+    int xa = xmm(A, ins->a, XMM14);
+    int xb = xmm(A, ins->b, XMM15);
+    if (ins->op == IR_EQ) {
+      ssereg(J, 0x66, 0, X_UCOMISD, xa, xb);
+      if (ins->c) {  /* leave if not equal or unordered */
+        guard(A, CC_NE, ins->pc);
+        guard(A, CC_P, ins->pc);
+      }
+      else {  /* leave if equal and ordered */
+        size_t unordered = jump(J, CC_P);
+        guard(A, CC_E, ins->pc);
+        patchhere(J, unordered);
+      }
+      return;
+    }
+    ssereg(J, 0x66, 0, X_UCOMISD, xb, xa);  /* (false when unordered) */
+    cc = (ins->op == IR_LT) ? CC_A : CC_AE;
+  }
+  guard(A, ins->c ? ccnot(cc) : cc, ins->pc);
+}
+
+
+/*
+** Bounds check of array accesses 'ins' (with key 'idx + off') for all
+** the iterations of the loop that remain: the first and the last keys
+** must be in the array. (The loop preparation ensures that the last
+** index does not overflow.)
+*/
+static void rangecheck (TraceAsm *A, IRIns *ins) {
+  JitState *J = &A->J;
+  int lbase = A->R->lbase;
+  int size = gpr(A, ins->b, R11);
+  opmem(J, 1, X_MOVLD, RAX, TBASE, vdisp(lbase));  /* first index */
+  aluimm(J, 0, RAX, ins->c - 1);
+  opreg(J, 1, X_CMP, RAX, size);
+  guard(A, CC_AE, ins->pc);
+  opmem(J, 1, X_MOVLD, RAX, TBASE, vdisp(lbase + 1));  /* count */
+  opmem(J, 1, X_IMUL, RAX, TBASE, vdisp(lbase + 2));  /* times step */
+  opmem(J, 1, X_ADD, RAX, TBASE, vdisp(lbase));  /* plus index */
+  aluimm(J, 0, RAX, ins->c - 1);
+  opreg(J, 1, X_CMP, RAX, size);
+  guard(A, CC_AE, ins->pc);
+}
+
+
+/* assemble instruction 'ref' */
+static void asmins (TraceAsm *A, int ref) {
+  JitState *J = &A->J;
+  IRIns *ins = &A->R->ir[ref];
+  int r;
+  switch (ins->op) {
+    case IR_KINT: case IR_KNUM:  /* loaded at each use */
+      return;
+    case IR_SLOAD: {  /* (tag checked at entry) */
+      r = allocreg(A, ref);
+      if (ins->t == IRT_NUM)
+        ssemem(J, 0xF2, 0x10, r, TBASE, vdisp(ins->a));
+      else
+        opmem(J, 1, X_MOVLD, r, TBASE, vdisp(ins->a));
+      break;
+    }
+    case IR_ULOAD: {
+      opmem(J, 1, X_MOVLD, RAX, TBASE, -vdisp(1));  /* closure */
+      opmem(J, 1, X_MOVLD, RAX, RAX, fieldof(LClosure, upvals) +
+                                     ins->a * cast_int(sizeof(UpVal *)));
+      opmem(J, 1, X_MOVLD, RAX, RAX, fieldof(UpVal, v));
+      opmem(J, 0, 0x80, 7, RAX, fieldof(TValue, tt_));
+      emit(J, irtag(ins->t));
+      guard(A, CC_NE, ins->pc);
+      r = allocreg(A, ref);
+      if (ins->t == IRT_NUM)
+        ssemem(J, 0xF2, 0x10, r, RAX, 0);
+      else
+        opmem(J, 1, X_MOVLD, r, RAX, 0);
+      break;
+    }
+    case IR_TARR: {
+      r = allocreg(A, ref);
+      opmem(J, 1, X_MOVLD, r, gpr(A, ins->a, R11), fieldof(Table, array));
+      break;
+    }
+    case IR_TSIZE: {  /* (32-bit load clears the upper half) */
+      r = allocreg(A, ref);
+      opmem(J, 0, X_MOVLD, r, gpr(A, ins->a, R11), fieldof(Table, alimit));
+      break;
+    }
+    case IR_ALOAD: {
+      tagaddr(A, ins->a, ins->b);
+      opmem(J, 0, 0x80, 7, RAX, -1);
+      emit(J, irtag(ins->t));
+      guard(A, CC_NE, ins->pc);
+      valaddr(A, ins->a, ins->b);
+      r = allocreg(A, ref);
+      if (ins->t == IRT_NUM)
+        ssemem(J, 0xF2, 0x10, r, RAX, 0);
+      else
+        opmem(J, 1, X_MOVLD, r, RAX, 0);
+      break;
+    }
+    case IR_CONV: {
+      r = allocreg(A, ref);
+      ssereg(J, 0, 0, X_XORPS, r, r);  /* break dependency */
+      ssereg(J, 0xF2, 1, 0x2A, r, gpr(A, ins->a, R11));  /* cvtsi2sd */
+      break;
+    }
+    case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV:
+    case IR_BAND: case IR_BOR: case IR_BXOR: {
+      r = allocreg(A, ref);
+      if (ins->t == IRT_INT)
+        intarith(A, ins, r);
+      else {
+        static const int fops[] = {X_ADDSD, X_SUBSD, X_MULSD, X_DIVSD};
+        int op = (ins->op == IR_DIV) ? X_DIVSD : fops[ins->op - IR_ADD];
+        movxmm(A, r, ins->a);
+        ssereg(J, 0xF2, 0, op, r, xmm(A, ins->b, XMM15));
+      }
+      break;
+    }
+    case IR_MOD: case IR_IDIV: {
+      r = allocreg(A, ref);
+      intdiv(A, ins, r);
+      break;
+    }
+    case IR_SHL: case IR_SHR: {
+      r = allocreg(A, ref);
+      movgpr(A, r, ins->a);
+      opreg(J, 1, 0xC1, (ins->op == IR_SHL) ? 4 : 5, r);
+      emit(J, ins->c);
+      break;
+    }
+    case IR_NEG: case IR_BNOT: {
+      r = allocreg(A, ref);
+      if (ins->t == IRT_INT) {
+        movgpr(A, r, ins->a);
+        opreg(J, 1, 0xF7, (ins->op == IR_NEG) ? 3 : 2, r);
+      }
+      else {  /* flip the sign bit */
+        movxmm(A, r, ins->a);
+        movimm(J, RAX, cast_sizet(1) << 63);
+        ssereg(J, 0x66, 1, 0x6E, XMM15, RAX);
+        ssereg(J, 0x66, 0, X_XORPS, r, XMM15);  /* xorpd */
+      }
+      break;
+    }
+    case IR_LT: case IR_LE: case IR_EQ:
+      compareguard(A, ins);
+      break;
+    case IR_NOMT: {
+      opmem(J, 1, 0x83, 7, gpr(A, ins->a, R11), fieldof(Table, metatable));
+      emit(J, 0);
+      guard(A, CC_NE, ins->pc);
+      break;
+    }
+    case IR_ABOUND: {  /* unsigned 'key - 1 < size' */
+      if (ins->mark & IRM_RANGE) {
+        rangecheck(A, ins);
+        break;
+      }
+      opmem(J, 1, 0x8D, RAX, gpr(A, ins->a, R11), -1);
+      opreg(J, 1, X_CMP, RAX, gpr(A, ins->b, R11));
+      guard(A, CC_AE, ins->pc);
+      break;
+    }
+    case IR_SSTORE:
+      storevalue(A, ins->b, TBASE, vdisp(ins->a));
+      break;
+    case IR_ASTORE: {
+      tagaddr(A, ins->a, ins->b);
+      if (ins->mark & IRM_NOTEMPTY) {  /* an empty slot may need '__newindex' */
+        opmem(J, 0, 0xF6, 0, RAX, -1);
+        emit(J, 0x0F);  /* test byte [...], 0x0F */
+        guard(A, CC_E, ins->pc);
+      }
+      opmem(J, 0, 0xC6, 0, RAX, -1);  /* mov byte [...], tag */
+      emit(J, irtag(A->R->ir[ins->c].t));
+      valaddr(A, ins->a, ins->b);
+      storeraw(A, ins->c, RAX, 0);
+      break;
+    }
+  }
+}
+
+
+/* assemble instruction 'ref' and free the registers it does not need */
+static void asmfree (TraceAsm *A, int ref) {
+  int ops[3];
+  int n;
+  asmins(A, ref);
+  for (n = operands(&A->R->ir[ref], ops); n > 0; n--) {
+    if (A->lastuse[ops[n - 1]] == ref)
+      freereg(A, ops[n - 1]);
+  }
+  if (A->lastuse[ref] == 0)  /* value not used? */
+    freereg(A, ref);
+}
+
+
+/* numeric loop: update the loop variables and go back to 'top' */
+static void loopclose (TraceAsm *A, size_t top) {
+  JitState *J = &A->J;
+  int lbase = A->R->lbase;
+  opmem(J, 1, X_MOVLD, RAX, TBASE, vdisp(lbase + 1));  /* count */
+  opreg(J, 1, 0x85, RAX, RAX);
+  addfixup(J, jump(J, CC_E), TEXIT_END);  /* no more iterations? */
+  aluimm(J, 5, RAX, 1);
+  opmem(J, 1, X_MOVST, RAX, TBASE, vdisp(lbase + 1));  /* update counter */
+  opmem(J, 1, X_MOVLD, RAX, TBASE, vdisp(lbase));
+  opmem(J, 1, X_ADD, RAX, TBASE, vdisp(lbase + 2));  /* add step to index */
+  opmem(J, 1, X_MOVST, RAX, TBASE, vdisp(lbase));  /* update internal index */
+  opmem(J, 1, X_MOVST, RAX, TBASE, vdisp(lbase + 3));  /* and control var. */
+  opmem(J, 0, 0xC6, 0, TBASE, tdisp(lbase + 3));
+  emit(J, HYDROGEN_VNUMINT);
+  opmem(J, 0, 0x83, 7, TL, fieldof(hydrogen_State, hookmask));
+  emit(J, 0);
+  addfixup(J, jump(J, CC_NE), TEXIT_HEAD);  /* hooks: back to the start */
+  patch(J, jump(J, CC_ALWAYS), top);
+}
+
+
+/* callee-saved registers used by traces */
+static const lu_byte savedregs[] = {RBX, RBP, R12, R13, R14, R15};
+
+
+/* trace(L, base) */
+static void traceprologue (JitState *J) {
+  int n;
+  for (n = 0; n < 6; n++) {
+    rex(J, 0, 0, savedregs[n]);
+    emit(J, 0x50 + (savedregs[n] & 7));  /* push */
+  }
+  opreg(J, 1, X_MOVST, RDI, TL);
+  opreg(J, 1, X_MOVST, RSI, TBASE);
+}
+
+
+static void traceepilogue (JitState *J) {
+  int n;
+  J->epilogue = J->ncode;
+  for (n = 5; n >= 0; n--) {
+    rex(J, 0, 0, savedregs[n]);
+    emit(J, 0x58 + (savedregs[n] & 7));  /* pop */
+  }
+  emit(J, 0xC3);  /* ret */
+}
+
+
+/* last use of each value */
+static void lastuses (TraceAsm *A) {
+  TraceRecorder *R = A->R;
+  int ref;
+  for (ref = 1; ref < R->nir; ref++) {
+    IRIns *ins = &R->ir[ref];
+    int ops[3];
+    int n;
+    if (ins->mark & IRM_DEAD)
+      continue;
+    for (n = operands(ins, ops); n > 0; n--) {
+      int o = ops[n - 1];
+      if (inheader(&R->ir[o]) && !inheader(ins))
+        A->lastuse[o] = PINNED;  /* keep it for all the iterations */
+      else if (A->lastuse[o] < ref)
+        A->lastuse[o] = ref;
+    }
+  }
+}
+
+
+/* assemble the pre-header of the trace */
+static void asmheader (TraceAsm *A) {
+  JitState *J = &A->J;
+  TraceRecorder *R = A->R;
+  int ref;
+  A->header = 1;
+  if (R->lbase >= 0) {  /* only integer loops */
+    opmem(J, 0, 0x80, 7, TBASE, tdisp(R->lbase + 2));
+    emit(J, HYDROGEN_VNUMINT);
+    guard(A, CC_NE, R->start);
+  }
+  for (ref = 1; ref < R->nir; ref++) {  /* types of the registers */
+    IRIns *ins = &R->ir[ref];
+    if (ins->op == IR_SLOAD && !(ins->mark & IRM_DEAD)) {
+      opmem(J, 0, 0x80, 7, TBASE, tdisp(ins->a));
+      emit(J, irtag(ins->t));
+      guard(A, CC_NE, R->start);
+    }
+  }
+  for (ref = 1; ref < R->nir; ref++) {
+    IRIns *ins = &R->ir[ref];
+    if (!(ins->mark & IRM_DEAD) && inheader(ins))
+      asmfree(A, ref);
+  }
+  A->header = 0;
+}
+
+
+/* assemble the trace of recorder 'R'; returns NULL on failure */
+static JitTrace *assemble (TraceAsm *A) {
+  JitState *J = &A->J;
+  TraceRecorder *R = A->R;
+  JitTrace *t = NULL;
+  size_t top, size;
+  int ref, f;
+  traceprologue(J);
+  asmheader(A);
+  top = J->ncode;
+  for (ref = 1; ref < R->nir; ref++) {
+    if (!(R->ir[ref].mark & (IRM_DEAD | IRM_INV | IRM_RANGE)))
+      asmfree(A, ref);
+  }
+  if (R->lbase >= 0)
+    loopclose(A, top);
+  else  /* body of a generic loop: go on with the call to the iterator */
+    addfixup(J, jump(J, CC_ALWAYS), TEXIT_END);
+  traceepilogue(J);
+  for (f = 0; f < J->nfix && !J->failed; f++) {  /* exit stubs */
+    patch(J, J->fix[f].pos, J->ncode);
+    emit(J, 0xB8);  /* mov eax, exit */
+    emit32(J, cast_uint(J->fix[f].target));
+    patch(J, jump(J, CC_ALWAYS), J->epilogue);
+  }
+  if (J->failed)
+    return NULL;
+  size = offsetof(JitTrace, exitpc) + A->nexits * sizeof(int);
+  t = cast(JitTrace *, jitrealloc(J->L, NULL, 0, size));
+  if (t == NULL)
+    return NULL;
+  t->mcode = mapcode(J);
+  if (t->mcode == NULL) {
+    jitrealloc(J->L, t, size, 0);
+    return NULL;
+  }
+  t->msize = J->ncode;
+  t->size = size;
+  t->loop = R->loop;
+  t->entries = t->headexits = 0;
+  t->nexits = A->nexits;
+  memcpy(t->exitpc, A->exitpc, A->nexits * sizeof(int));
+  return t;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Running traces
+** =======================================================
+*/
+
+static void freetrace (hydrogen_State *L, JitTrace *t) {
+  munmap(t->mcode, t->msize);
+  jitrealloc(L, t, t->size, 0);
+  G(L)->jittraces--;
+}
+
+
+/*
+** A recording failed (or a trace was discarded): the loop must get
+** hot again before another try, and too many failures make it dead.
+*/
+static void loopfailed (hydrogen_State *L, ICache *ic) {
+  unsigned int aborts = (ic->loop.flags & JIT_LOOPABORTS) + 1;
+  G(L)->jitaborts++;
+  ic->loop.count = 0;
+  ic->loop.flags = (ic->loop.flags & ~JIT_LOOPABORTS) | aborts;
+  if (aborts >= JITMAXABORTS)
+    ic->loop.flags |= JIT_LOOPDEAD;
+}
+
+
+/* optimize and assemble the recorded trace */
+static int buildtrace (hydrogen_State *L, TraceRecorder *R) {
+  TraceAsm A;
+  JitTrace *t;
+  if (R->lbase >= 0) {
+    if (!stabletypes(R))
+      return 0;
+    hoist(R);
+    if (!R->nobce)
+      rangechecks(R);
+  }
+  deadcode(R);
+  A.R = R;
+  A.J.L = L;
+  A.J.p = R->p;
+  A.J.jc = NULL;
+  A.J.ncode = 0;
+  A.J.sizecode = 256;
+  A.J.fix = NULL;
+  A.J.nfix = A.J.sizefix = 0;
+  A.J.epilogue = 0;
+  A.J.failed = 0;
+  A.J.code = cast(unsigned char *, jitrealloc(L, NULL, 0, A.J.sizecode));
+  A.lastuse = cast(int *, jitrealloc(L, NULL, 0, R->nir * sizeof(int)));
+  A.exitpc = cast(int *, jitrealloc(L, NULL, 0, (R->nir + 2) * sizeof(int)));
+  t = NULL;
+  if (A.J.code != NULL && A.lastuse != NULL && A.exitpc != NULL) {
+    A.exitpc[TEXIT_HEAD] = R->start;
+    A.exitpc[TEXIT_END] = (R->lbase >= 0) ? R->loop + 1 : R->end;
+    A.nexits = TEXIT_END + 1;
+    A.gprs = GPRSET;
+    A.xmms = XMMSET;
+    A.header = 0;
+    memset(A.lastuse, 0, R->nir * sizeof(int));
+    lastuses(&A);
+    t = assemble(&A);
+  }
+  else
+    A.J.failed = 1;
+  freestate(&A.J);
+  if (A.lastuse != NULL)
+    jitrealloc(L, A.lastuse, R->nir * sizeof(int), 0);
+  if (A.exitpc != NULL)
+    jitrealloc(L, A.exitpc, (R->nir + 2) * sizeof(int), 0);
+  if (t == NULL)
+    return 0;
+  t->next = R->p->trace;
+  R->p->trace = t;
+  R->p->icache[R->loop].loop.flags |= JIT_LOOPTRACED;
+  G(L)->jittraces++;
+  return 1;
+}
+
+
+/* stop the current recording, building its trace if 'ok' */
+static void endrecording (hydrogen_State *L, int ok) {
+  TraceRecorder *R = G(L)->jitrec;
+  G(L)->jitrec = NULL;
+  if (!ok || !buildtrace(L, R))
+    loopfailed(L, &R->p->icache[R->loop]);
+  freerecorder(L, R);
+}
+
+
+/* start recording the next iteration of loop 'loop' */
+static void startrecording (hydrogen_State *L, CallInfo *ci, Proto *p,
+                            int loop) {
+  Instruction i = p->code[loop];
+  int isfor = (GET_GENERICOP(i) == OP_FORLOOP);
+  TraceRecorder *R;
+  if (G(L)->jitrec != NULL)  /* another recording did not finish? */
+    endrecording(L, 0);
+  if (isfor && !ttisinteger(s2v(ci->func + 1 + GETARG_A(i) + 2))) {
+    loopfailed(L, &p->icache[loop]);  /* float loops are not yet traced */
+    return;
+  }
+  R = cast(TraceRecorder *, jitrealloc(L, NULL, 0, sizeof(TraceRecorder)));
+  if (R == NULL)
+    return;
+  R->sizeir = 64;
+  R->ir = cast(IRIns *, jitrealloc(L, NULL, 0, R->sizeir * sizeof(IRIns)));
+  if (R->ir == NULL) {
+    jitrealloc(L, R, sizeof(TraceRecorder), 0);
+    return;
+  }
+  memset(R->ir, 0, sizeof(IRIns));  /* reference 0 is not used */
+  R->nir = 1;
+  R->L = L;
+  R->ci = ci;
+  R->p = p;
+  R->loop = loop;
+  R->start = loop + 1 - GETARG_Bx(i);
+  R->end = isfor ? loop : loop - 1;  /* (generic loops end at OP_TFORCALL) */
+  R->next = R->cur = R->start;
+  R->lbase = isfor ? GETARG_A(i) : -1;
+  R->nobce = (p->icache[loop].loop.flags & JIT_LOOPNOBCE) != 0;
+  memset(R->ref, 0, sizeof(R->ref));
+  memset(R->sload, 0, sizeof(R->sload));
+  memset(R->written, 0, sizeof(R->written));
+  if (isfor)  /* loop variables change at each iteration */
+    R->written[R->lbase] = R->written[R->lbase + 1] =
+        R->written[R->lbase + 3] = 1;
+  G(L)->jitrec = R;
+  ci->u.l.trap = 1;  /* record from the next instruction */
+}
+
+
+/*
+** Run the trace of loop 'loop'. Returns the instruction where the
+** interpreter must go on. A trace that keeps failing in its pre-header
+** (maybe because of the bounds check of its whole range) is discarded;
+** the next one will check bounds at each access.
+*/
+static const Instruction *runtrace (hydrogen_State *L, CallInfo *ci,
+                                    Proto *p, int loop) {
+  global_State *g = G(L);
+  JitTrace **pt = &p->trace;
+  JitTrace *t;
+  TraceFunction f;
+  int e, exitpc;
+  while ((*pt)->loop != loop)
+    pt = &(*pt)->next;
+  t = *pt;
+  f = (TraceFunction)t->mcode;
+  e = f(L, ci->func + 1);
+  hydrogen_assert(0 <= e && e < t->nexits);
+  exitpc = t->exitpc[e];
+  t->entries++;
+  g->jitentries++;
+  if (e > TEXIT_END)
+    g->jitexits++;
+  else if (e == TEXIT_HEAD && ++t->headexits * 2 > t->entries &&
+           t->entries >= MINTRACERUNS) {
+    ICache *ic = &p->icache[loop];
+    *pt = t->next;
+    freetrace(L, t);
+    ic->loop.flags = (ic->loop.flags & ~JIT_LOOPTRACED) | JIT_LOOPNOBCE;
+    loopfailed(L, ic);
+    return p->code + exitpc;
+  }
+  return p->code + exitpc;
+}
+
+
+/*
+** Called at the backward jump of loop instruction 'lpc'. Runs the
+** trace of the loop, if it has one, or counts the iteration and starts
+** recording a trace when the loop gets hot. Returns the instruction
+** where the interpreter must go on.
+*/
+const Instruction *hydrogenJ_backedge (hydrogen_State *L, CallInfo *ci,
+                                       const Instruction *lpc) {
+  Proto *p = cicl(ci)->p;
+  int loop = cast_int(lpc - p->code);
+  ICache *ic = &p->icache[loop];
+  if (ic->loop.flags & JIT_LOOPTRACED)
+    return runtrace(L, ci, p, loop);
+  else if (++ic->loop.count >= cast_uint(hydrogenJ_hotloop(G(L))) &&
+           !L->hookmask)
+    startrecording(L, ci, p, loop);
+  return lpc + 1 - GETARG_Bx(*lpc);
+}
+
+
+/*
+** Called before the interpreter runs instruction 'pc' while a trace
+** is being recorded. Returns true if it recorded the instruction;
+** false if the recording ended (or belongs to another thread).
+*/
+int hydrogenJ_record (hydrogen_State *L, const Instruction *pc) {
+  TraceRecorder *R = G(L)->jitrec;
+  CallInfo *ci = L->ci;
+  int n;
+  if (R->L != L)
+    return 0;
+  n = cast_int(pc - R->p->code);
+  if (ci != R->ci || ci_func(ci)->p != R->p || n != R->next ||
+      L->hookmask || !G(L)->jiton)
+    endrecording(L, 0);  /* left the loop (or hooks are on) */
+  else if (n == R->end)
+    endrecording(L, 1);  /* iteration complete */
+  else if (n < R->start || n > R->end || !recordins(R, n))
+    endrecording(L, 0);
+  else
+    return 1;
+  return 0;
+}
+
+/* }====================================================== */
+
+/* }================================================================== */
+
+
+/* free the native code and the traces of 'p' */
+void hydrogenJ_free (hydrogen_State *L, Proto *p) {
+  global_State *g = G(L);
+  JitCode *jc = p->jit;
+  if (g->jitrec != NULL && g->jitrec->p == p) {  /* recording 'p'? */
+    freerecorder(L, g->jitrec);
+    g->jitrec = NULL;
+  }
+  while (p->trace != NULL) {
+    JitTrace *t = p->trace;
+    p->trace = t->next;
+    freetrace(L, t);
+  }
+  if (jc != NULL) {
+    munmap(jc->mcode, jc->msize);
+    jitrealloc(L, jc, jc->size, 0);
+    p->jit = NULL;
+    g->jitcount--;
+  }
+}
+
+#endif
@@ -0,0 +1,105 @@
+/*
+** $Id: jitlib.c $
+** Library to control the JIT compiler
+** See Copyright Notice in hydrogen.h
+*/
+
+#define jitlib_c
+#define HYDROGEN_LIB
+
+#include "prefix.h"
+
+
+#include <limits.h>
+
+#include "hydrogen.h"
+
+#include "auxlib.h"
+#include "hydrogenlib.h"
+
+
+/*
+** 'hydrogen_jit' returns -1 for all options when Hydrogen was built
+** without a JIT compiler; then, the library only reports that.
+*/
+
+
+static int jit_on (hydrogen_State *L) {
+  hydrogen_pushboolean(L, hydrogen_jit(L, HYDROGEN_JITON) == 0);
+  return 1;
+}
+
+
+static int jit_off (hydrogen_State *L) {
+  hydrogen_jit(L, HYDROGEN_JITOFF);
+  return 0;
+}
+
+
+/*
+** returns whether the compiler is on, how many functions it compiled,
+** and how many loops have traces
+*/
+static int jit_status (hydrogen_State *L) {
+  int on = hydrogen_jit(L, HYDROGEN_JITISON);
+  hydrogen_pushboolean(L, on > 0);
+  hydrogen_pushinteger(L, (on < 0) ? 0 : hydrogen_jit(L, HYDROGEN_JITCOUNT));
+  hydrogen_pushinteger(L, (on < 0) ? 0 : hydrogen_jit(L, HYDROGEN_JITTRACES));
+  return 3;
+}
+
+
+/* counters of the trace compiler */
+static int jit_stats (hydrogen_State *L) {
+  static const struct {
+    const char *name;
+    int what;
+  } counters[] = {
+    {"traces", HYDROGEN_JITTRACES}, {"aborts", HYDROGEN_JITABORTS},
+    {"entries", HYDROGEN_JITENTRIES}, {"exits", HYDROGEN_JITEXITS}
+  };
+  int entries = hydrogen_jit(L, HYDROGEN_JITENTRIES);
+  int exits = hydrogen_jit(L, HYDROGEN_JITEXITS);
+  int n;
+  hydrogen_createtable(L, 0, 5);
+  for (n = 0; n < 4; n++) {
+    int v = hydrogen_jit(L, counters[n].what);
+    hydrogen_pushinteger(L, (v < 0) ? 0 : v);
+    hydrogen_setfield(L, -2, counters[n].name);
+  }
+  /* fraction of the runs of traces that left them at a guard */
+  hydrogen_pushnumber(L, (entries > 0) ? (hydrogen_Number)exits / entries : 0);
+  hydrogen_setfield(L, -2, "exitrate");
+  return 1;
+}
+
+
+/* number of calls or loop iterations that make a function hot */
+static int jit_threshold (hydrogen_State *L) {
+  hydrogen_Integer n = hydrogenL_optinteger(L, 1, 0);
+  int res;
+  hydrogenL_argcheck(L, 0 <= n && n <= INT_MAX, 1, "value out of range");
+  res = hydrogen_jit(L, HYDROGEN_JITSETTHRESHOLD, (int)n);
+  if (res < 0)
+    hydrogenL_pushfail(L);  /* no JIT compiler */
+  else
+    hydrogen_pushinteger(L, res);
+  return 1;
+}
+
+
+static const hydrogenL_Reg jit_funcs[] = {
+  {"on", jit_on},
+  {"off", jit_off},
+  {"status", jit_status},
+  {"stats", jit_stats},
+  {"threshold", jit_threshold},
+  {NULL, NULL}
+};
+
+
+HYDROGENMOD_API int hydrogenopen_jit (hydrogen_State *L) {
+  hydrogenL_newlib(L, jit_funcs);
+  return 1;
+}
+
@@ -0,0 +1,1123 @@
+/*
+** $Id: object.h $
+** Type definitions for Hydrogen objects
+** See Copyright Notice in hydrogen.h
+*/
+
+
+#ifndef object_h
+#define object_h
+
+
+#include <stdarg.h>
+
+
+#include "limits.h"
+#include "hydrogen.h"
+
+
+/*
+** Extra types for collectable non-values
+*/
+#define HYDROGEN_TUPVAL	HYDROGEN_NUMTYPES  /* upvalues */
+#define HYDROGEN_TPROTO	(HYDROGEN_NUMTYPES+1)  /* function prototypes */
+#define HYDROGEN_TDEADKEY	(HYDROGEN_NUMTYPES+2)  /* removed keys in tables */
+
+
+
+/*
+** number of all possible types (including HYDROGEN_TNONE but excluding DEADKEY)
+*/
+#define HYDROGEN_TOTALTYPES		(HYDROGEN_TPROTO + 2)
+
+
+/*
+** tags for Tagged Values have the following use of bits:
+** bits 0-3: actual tag (a HYDROGEN_T* constant)
+** bits 4-5: variant bits
+** bit 6: whether value is collectable
+*/
+
+/* add variant bits to a type */
+#define makevariant(t,v)	((t) | ((v) << 4))
+
+
+
+/*
+** Union of all Hydrogen values
+*/
+typedef union Value {
+  struct GCObject *gc;    /* collectable objects */
+  void *p;         /* light userdata */
+  hydrogen_CFunction f; /* light C functions */
+  hydrogen_Integer i;   /* integer numbers */
+  hydrogen_Number n;    /* float numbers */
+} Value;
+
+
+#if !defined(HYDROGEN_NANBOXING)	/* { */
+
+/*
+** Tagged Values. This is the basic representation of values in Hydrogen:
+** an actual value plus a tag with its type.
+*/
+
+#define TValuefields	Value value_; lu_byte tt_
+
+typedef struct TValue {
+  TValuefields;
+} TValue;
+
+
+#define val_(o)		((o)->value_)
+#define valraw(o)	(val_(o))
+
+
+/* raw type tag of a TValue */
+#define rawtt(o)	((o)->tt_)
+
+
+/* Macros to test type */
+#define checktag(o,t)		(rawtt(o) == (t))
+#define checktype(o,t)		(ttype(o) == (t))
+
+
+/* value of a TValue, by kind */
+#define valgc_(o)	(val_(o).gc)
+#define valp_(o)	(val_(o).p)
+#define valf_(o)	(val_(o).f)
+#define vali_(o)	(val_(o).i)
+#define valn_(o)	(val_(o).n)
+
+
+/* set a value's tag */
+#define settt_(o,t)	((o)->tt_=(t))
+
+/* set the value of a TValue, by kind ('t' is the tag of a collectable) */
+#define setvalgc_(o,x,t)	{ val_(o).gc = (x); settt_(o, t); }
+#define setvalp_(o,x)	{ val_(o).p = (x); settt_(o, HYDROGEN_VLIGHTUSERDATA); }
+#define setvalf_(o,x)	{ val_(o).f = (x); settt_(o, HYDROGEN_VLCF); }
+#define setvali_(o,x)	{ val_(o).i = (x); settt_(o, HYDROGEN_VNUMINT); }
+#define setvaln_(o,x)	{ val_(o).n = (x); settt_(o, HYDROGEN_VNUMFLT); }
+
+/* change the value of a number, keeping its tag */
+#define chgvali_(o,x)	(val_(o).i = (x))
+#define chgvaln_(o,x)	(val_(o).n = (x))
+
+/* copy a TValue */
+#define copyval_(o1,o2)	\
+	{ (o1)->value_ = (o2)->value_; settt_(o1, (o2)->tt_); }
+
+#else					/* }{ */
+
+/*
+** NaN-boxed values (see HYDROGEN_NANBOXING in hydrogenconf.h). A TValue
+** is the bit pattern of a double: floats are stored as themselves, with
+** all NaNs in the single form 'NBNAN', and all other values are
+** negative NaNs above -inf. The high 16 bits of those give their variant
+** ('NB_*' codes, in 0xFFF1-0xFFFF) and their low 48 bits hold a pointer,
+** an integer (in two's complement), or nothing. Collectable variants
+** have the highest codes.
+*/
+
+#define TValuefields	hydrogen_Unsigned nb_
+
+typedef struct TValue {
+  TValuefields;
+} TValue;
+
+
+/* variant codes */
+#define NB_NIL		1
+#define NB_EMPTY	2
+#define NB_ABSTKEY	3
+#define NB_FALSE	4
+#define NB_TRUE		5
+#define NB_INT		6
+#define NB_LIGHTUD	7
+#define NB_LCF		8
+#define NB_LCL		9	/* first collectable variant */
+#define NB_CCL		10
+#define NB_SHRSTR	11
+#define NB_LNGSTR	12
+#define NB_TABLE	13
+#define NB_USERDATA	14
+#define NB_THREAD	15
+
+/* variant code of tag 't' (16 if 't' is not the tag of a value) */
+#define nbcode(t) \
+	((t) == HYDROGEN_VNIL ? NB_NIL : (t) == HYDROGEN_VEMPTY ? NB_EMPTY : \
+	 (t) == HYDROGEN_VABSTKEY ? NB_ABSTKEY : \
+	 (t) == HYDROGEN_VFALSE ? NB_FALSE : (t) == HYDROGEN_VTRUE ? NB_TRUE : \
+	 (t) == HYDROGEN_VNUMINT ? NB_INT : \
+	 (t) == HYDROGEN_VLIGHTUSERDATA ? NB_LIGHTUD : \
+	 (t) == HYDROGEN_VLCF ? NB_LCF : (t) == ctb(HYDROGEN_VLCL) ? NB_LCL : \
+	 (t) == ctb(HYDROGEN_VCCL) ? NB_CCL : \
+	 (t) == ctb(HYDROGEN_VSHRSTR) ? NB_SHRSTR : \
+	 (t) == ctb(HYDROGEN_VLNGSTR) ? NB_LNGSTR : \
+	 (t) == ctb(HYDROGEN_VTABLE) ? NB_TABLE : \
+	 (t) == ctb(HYDROGEN_VUSERDATA) ? NB_USERDATA : \
+	 (t) == ctb(HYDROGEN_VTHREAD) ? NB_THREAD : 16)
+
+/* first and last variant codes of type 't' (other than numbers) */
+#define nbfirst(t) \
+	((t) == HYDROGEN_TNIL ? NB_NIL : (t) == HYDROGEN_TBOOLEAN ? NB_FALSE : \
+	 (t) == HYDROGEN_TLIGHTUSERDATA ? NB_LIGHTUD : \
+	 (t) == HYDROGEN_TFUNCTION ? NB_LCF : (t) == HYDROGEN_TSTRING ? NB_SHRSTR : \
+	 (t) == HYDROGEN_TTABLE ? NB_TABLE : \
+	 (t) == HYDROGEN_TUSERDATA ? NB_USERDATA : NB_THREAD)
+#define nblast(t) \
+	((t) == HYDROGEN_TNIL ? NB_ABSTKEY : (t) == HYDROGEN_TBOOLEAN ? NB_TRUE : \
+	 (t) == HYDROGEN_TFUNCTION ? NB_CCL : (t) == HYDROGEN_TSTRING ? NB_LNGSTR : \
+	 nbfirst(t))
+
+
+/* number of bits of integers and pointers */
+#define NBINTBITS	48
+
+#define NBPAYLOAD	((l_castS2U(1) << NBINTBITS) - 1)
+#define NBSIGN		(l_castS2U(1) << (NBINTBITS - 1))
+
+/* word with variant code 'c' and payload 'p' */
+#define nbbox(c,p)	((l_castS2U(0xFFF0 + (c)) << NBINTBITS) | (p))
+
+/* high 16 bits of a TValue */
+#define nbhigh(o)	cast_int((o)->nb_ >> NBINTBITS)
+
+/* all words below this one are floats */
+#define NBBOXED		nbbox(NB_NIL, 0)
+
+/* the only NaN stored as a float */
+#define NBNAN		(l_castS2U(0x7FF8) << NBINTBITS)
+
+/* payload of a TValue as a pointer */
+#define nbpointer(o)	cast_voidp(cast_sizet((o)->nb_ & NBPAYLOAD))
+
+/* payload for pointer 'p' */
+#define nbfrompointer(p)	l_castS2U(cast_sizet(p))
+
+#define nbfitspointer(p)	((nbfrompointer(p) & ~NBPAYLOAD) == 0)
+
+
+l_sinline hydrogen_Number nbtonum (hydrogen_Unsigned u) {
+  union { hydrogen_Unsigned u; hydrogen_Number n; } c;
+  c.u = u;
+  return c.n;
+}
+
+
+l_sinline hydrogen_Unsigned nbfromnum (hydrogen_Number n) {
+  union { hydrogen_Unsigned u; hydrogen_Number n; } c;
+  if (l_unlikely(n != n))  /* NaN? */
+    return NBNAN;  /* keep it out of the boxed values */
+  c.n = n;
+  return c.u;
+}
+
+
+/* raw type tag of a TValue */
+#define rawtt(o)  \
+	hydrogenO_nbtags[(o)->nb_ < NBBOXED ? 0 : nbhigh(o) & 0xF]
+
+HYDROGENI_DDEC(const lu_byte hydrogenO_nbtags[16];)
+
+
+/* Macros to test type */
+#define checktag(o,t)  \
+	((t) == HYDROGEN_VNUMFLT ? (o)->nb_ < NBBOXED  \
+	                         : nbhigh(o) == 0xFFF0 + nbcode(t))
+#define checktype(o,t)  \
+	((t) == HYDROGEN_TNUMBER  \
+	  ? ((o)->nb_ < NBBOXED || nbhigh(o) == 0xFFF0 + NB_INT)  \
+	  : cast_uint(nbhigh(o) - (0xFFF0 + nbfirst(t))) <=  \
+	    cast_uint(nblast(t) - nbfirst(t)))
+
+
+/* value of a TValue, by kind */
+#define valgc_(o)	cast(struct GCObject *, nbpointer(o))
+#define valp_(o)	nbpointer(o)
+#define valf_(o)	cast(hydrogen_CFunction, cast_sizet((o)->nb_ & NBPAYLOAD))
+#define vali_(o)  \
+	(l_castU2S(((o)->nb_ & NBPAYLOAD) ^ NBSIGN) - l_castU2S(NBSIGN))
+#define valn_(o)	nbtonum((o)->nb_)
+
+
+/* set a value's tag (for values without payload) */
+#define settt_(o,t)	((o)->nb_ = nbbox(nbcode(t), 0))
+
+/* set the value of a TValue, by kind ('t' is the tag of a collectable) */
+#define setvalgc_(o,x,t)  \
+	{ hydrogen_assert(nbfitspointer(x));  \
+	  (o)->nb_ = nbbox(nbcode(t), nbfrompointer(x)); }
+#define setvalp_(o,x)  \
+	{ hydrogen_assert(nbfitspointer(x));  \
+	  (o)->nb_ = nbbox(NB_LIGHTUD, nbfrompointer(x)); }
+#define setvalf_(o,x)  \
+	{ hydrogen_assert(nbfitspointer(x));  \
+	  (o)->nb_ = nbbox(NB_LCF, nbfrompointer(x)); }
+#define setvali_(o,x)	((o)->nb_ = nbbox(NB_INT, l_castS2U(x) & NBPAYLOAD))
+#define setvaln_(o,x)	((o)->nb_ = nbfromnum(x))
+
+/* change the value of a number (which must be set as a whole) */
+#define chgvali_(o,x)	setvali_(o,x)
+#define chgvaln_(o,x)	setvaln_(o,x)
+
+/* copy a TValue */
+#define copyval_(o1,o2)	((o1)->nb_ = (o2)->nb_)
+
+#endif					/* } */
+
+
+/* tag with no variants (bits 0-3) */
+#define novariant(t)	((t) & 0x0F)
+
+/* type tag of a TValue (bits 0-3 for tags + variant bits 4-5) */
+#define withvariant(t)	((t) & 0x3F)
+#define ttypetag(o)	withvariant(rawtt(o))
+
+/* type of a TValue */
+#define ttype(o)	(novariant(rawtt(o)))
+
+
+/* Macros for internal tests */
+
+/* collectable object has the same tag as the original value */
+#define righttt(obj)		(ttypetag(obj) == gcvalue(obj)->tt)
+
+/*
+** Any value being manipulated by the program either is non
+** collectable, or the collectable object has the right tag
+** and it is not dead. The option 'L == NULL' allows other
+** macros using this one to be used where L is not available.
+*/
+#define checkliveness(L,obj) \
+	((void)L, hydrogen_longassert(!iscollectable(obj) || \
+		(righttt(obj) && (L == NULL || !isdead(G(L),gcvalue(obj))))))
+
+
+/* Macros to set values */
+
+/* main macro to copy values (from 'obj2' to 'obj1') */
+#define setobj(L,obj1,obj2) \
+	{ TValue *io1=(obj1); const TValue *io2=(obj2); \
+          copyval_(io1, io2); \
+	  checkliveness(L,io1); hydrogen_assert(!isnonstrictnil(io1)); }
+
+/*
+** Different types of assignments, according to source and destination.
+** (They are mostly equal now, but may be different in the future.)
+*/
+
+/* from stack to stack */
+#define setobjs2s(L,o1,o2)	setobj(L,s2v(o1),s2v(o2))
+/* to stack (not from same stack) */
+#define setobj2s(L,o1,o2)	setobj(L,s2v(o1),o2)
+/* from table to same table */
+#define setobjt2t	setobj
+/* to new object */
+#define setobj2n	setobj
+/* to table */
+#define setobj2t	setobj
+
+
+/*
+** Entries in a Hydrogen stack. Field 'tbclist' forms a list of all
+** to-be-closed variables active in this stack. Dummy entries are
+** used when the distance between two tbc variables does not fit
+** in an unsigned short. They are represented by delta==0, and
+** their real delta is always the maximum value that fits in
+** that field. (With NaN boxing, the deltas are kept apart, in
+** 'tbcdelta'; see 'state.h'.)
+*/
+typedef union StackValue {
+  TValue val;
+#if !defined(HYDROGEN_NANBOXING)
+  struct {
+    TValuefields;
+    unsigned short delta;
+  } tbclist;
+#endif
+} StackValue;
+
+
+/* index to stack elements */
+typedef StackValue *StkId;
+
+/* convert a 'StackValue' to a 'TValue' */
+#define s2v(o)	(&(o)->val)
+
+
+
+/*
+** {==================================================================
+** Nil
+** ===================================================================
+*/
+
+/* Standard nil */
+#define HYDROGEN_VNIL	makevariant(HYDROGEN_TNIL, 0)
+
+/* Empty slot (which might be different from a slot containing nil) */
+#define HYDROGEN_VEMPTY	makevariant(HYDROGEN_TNIL, 1)
+
+/* Value returned for a key not found in a table (absent key) */
+#define HYDROGEN_VABSTKEY	makevariant(HYDROGEN_TNIL, 2)
+
+
+/* macro to test for (any kind of) nil */
+#define ttisnil(v)		checktype((v), HYDROGEN_TNIL)
+
+
+/* macro to test for a standard nil */
+#define ttisstrictnil(o)	checktag((o), HYDROGEN_VNIL)
+
+
+#define setnilvalue(obj) settt_(obj, HYDROGEN_VNIL)
+
+
+#define isabstkey(v)		checktag((v), HYDROGEN_VABSTKEY)
+
+
+/*
+** macro to detect non-standard nils (used only in assertions)
+*/
+#define isnonstrictnil(v)	(ttisnil(v) && !ttisstrictnil(v))
+
+
+/*
+** By default, entries with any kind of nil are considered empty.
+** (In any definition, values associated with absent keys must also
+** be accepted as empty.)
+*/
+#define isempty(v)		ttisnil(v)
+
+
+/* macros defining a value corresponding to an absent key and an empty slot */
+#if !defined(HYDROGEN_NANBOXING)
+#define ABSTKEYCONSTANT		{NULL}, HYDROGEN_VABSTKEY
+#define EMPTYCONSTANT		{NULL}, HYDROGEN_VEMPTY
+#else
+#define ABSTKEYCONSTANT		nbbox(NB_ABSTKEY, 0)
+#define EMPTYCONSTANT		nbbox(NB_EMPTY, 0)
+#endif
+
+
+/* mark an entry as empty */
+#define setempty(v)		settt_(v, HYDROGEN_VEMPTY)
+
+
+
+/* }================================================================== */
+
+
+/*
+** {==================================================================
+** Booleans
+** ===================================================================
+*/
+
+
+#define HYDROGEN_VFALSE	makevariant(HYDROGEN_TBOOLEAN, 0)
+#define HYDROGEN_VTRUE	makevariant(HYDROGEN_TBOOLEAN, 1)
+
+#define ttisboolean(o)		checktype((o), HYDROGEN_TBOOLEAN)
+#define ttisfalse(o)		checktag((o), HYDROGEN_VFALSE)
+#define ttistrue(o)		checktag((o), HYDROGEN_VTRUE)
+
+
+#define l_isfalse(o)	(ttisfalse(o) || ttisnil(o))
+
+
+#define setbfvalue(obj)		settt_(obj, HYDROGEN_VFALSE)
+#define setbtvalue(obj)		settt_(obj, HYDROGEN_VTRUE)
+
+/* }================================================================== */
+
+
+/*
+** {==================================================================
+** Threads
+** ===================================================================
+*/
+
+#define HYDROGEN_VTHREAD		makevariant(HYDROGEN_TTHREAD, 0)
+
+#define ttisthread(o)		checktag((o), ctb(HYDROGEN_VTHREAD))
+
+#define thvalue(o)	check_exp(ttisthread(o), gco2th(valgc_(o)))
+
+#define setthvalue(L,obj,x) \
+  { TValue *io = (obj); hydrogen_State *x_ = (x); \
+    setvalgc_(io, obj2gco(x_), ctb(HYDROGEN_VTHREAD)); \
+    checkliveness(L,io); }
+
+#define setthvalue2s(L,o,t)	setthvalue(L,s2v(o),t)
+
+/* }================================================================== */
+
+
+/*
+** {==================================================================
+** Collectable Objects
+** ===================================================================
+*/
+
+/*
+** Common Header for all collectable objects (in macro form, to be
+** included in other objects)
+*/
+#define CommonHeader	struct GCObject *next; lu_byte tt; lu_byte marked
+
+
+/* Common type for all collectable objects */
+typedef struct GCObject {
+  CommonHeader;
+} GCObject;
+
+
+/* Bit mark for collectable types */
+#define BIT_ISCOLLECTABLE	(1 << 6)
+
+#if !defined(HYDROGEN_NANBOXING)
+#define iscollectable(o)	(rawtt(o) & BIT_ISCOLLECTABLE)
+#else
+#define iscollectable(o)	((o)->nb_ >= nbbox(NB_LCL, 0))
+#endif
+
+/* mark a tag as collectable */
+#define ctb(t)			((t) | BIT_ISCOLLECTABLE)
+
+#define gcvalue(o)	check_exp(iscollectable(o), valgc_(o))
+
+#define gcvalueraw(v)	((v).gc)
+
+#define setgcovalue(L,obj,x) \
+  { TValue *io = (obj); GCObject *i_g=(x); \
+    setvalgc_(io, i_g, ctb(i_g->tt)); }
+
+/* }================================================================== */
+
+
+/*
+** {==================================================================
+** Numbers
+** ===================================================================
+*/
+
+/* Variant tags for numbers */
+#define HYDROGEN_VNUMINT	makevariant(HYDROGEN_TNUMBER, 0)  /* integer numbers */
+#define HYDROGEN_VNUMFLT	makevariant(HYDROGEN_TNUMBER, 1)  /* float numbers */
+
+#define ttisnumber(o)		checktype((o), HYDROGEN_TNUMBER)
+#define ttisfloat(o)		checktag((o), HYDROGEN_VNUMFLT)
+#define ttisinteger(o)		checktag((o), HYDROGEN_VNUMINT)
+
+#define nvalue(o)	check_exp(ttisnumber(o), \
+	(ttisinteger(o) ? cast_num(ivalue(o)) : fltvalue(o)))
+#define fltvalue(o)	check_exp(ttisfloat(o), valn_(o))
+#define ivalue(o)	check_exp(ttisinteger(o), vali_(o))
+
+#define fltvalueraw(v)	((v).n)
+#define ivalueraw(v)	((v).i)
+
+#define setfltvalue(obj,x) \
+  { TValue *io=(obj); setvaln_(io, x); }
+
+#define chgfltvalue(obj,x) \
+  { TValue *io=(obj); hydrogen_assert(ttisfloat(io)); chgvaln_(io, x); }
+
+#define setivalue(obj,x) \
+  { TValue *io=(obj); setvali_(io, x); }
+
+#define chgivalue(obj,x) \
+  { TValue *io=(obj); hydrogen_assert(ttisinteger(io)); chgvali_(io, x); }
+
+/* }================================================================== */
+
+
+/*
+** {==================================================================
+** Strings
+** ===================================================================
+*/
+
+/* Variant tags for strings */
+#define HYDROGEN_VSHRSTR	makevariant(HYDROGEN_TSTRING, 0)  /* short strings */
+#define HYDROGEN_VLNGSTR	makevariant(HYDROGEN_TSTRING, 1)  /* long strings */
+
+#define ttisstring(o)		checktype((o), HYDROGEN_TSTRING)
+#define ttisshrstring(o)	checktag((o), ctb(HYDROGEN_VSHRSTR))
+#define ttislngstring(o)	checktag((o), ctb(HYDROGEN_VLNGSTR))
+
+#define tsvalueraw(v)	(gco2ts((v).gc))
+
+#define tsvalue(o)	check_exp(ttisstring(o), gco2ts(valgc_(o)))
+
+#define setsvalue(L,obj,x) \
+  { TValue *io = (obj); TString *x_ = (x); \
+    setvalgc_(io, obj2gco(x_), ctb(x_->tt)); \
+    checkliveness(L,io); }
+
+/* set a string to the stack */
+#define setsvalue2s(L,o,s)	setsvalue(L,s2v(o),s)
+
+/* set a string to a new object */
+#define setsvalue2n	setsvalue
+
+
+/*
+** Header for a string value.
+*/
+typedef struct TString {
+  CommonHeader;
+  lu_byte extra;  /* reserved words for short strings; "has hash" for longs */
+  lu_byte shrlen;  /* length for short strings; VIEWMARK for views */
+  unsigned int hash;
+  union {
+    size_t lnglen;  /* length for long strings */
+    struct TString *hnext;  /* linked list for hash table */
+  } u;
+  char contents[1];
+} TString;
+
+
+
+/*
+** A long string may be a view: its bytes are not in the object, whose
+** 'contents' hold a 'StrView' instead. The bytes are either a slice of
+** another long string ('parent'), which the view keeps alive, or owned
+** by the view ('parent' == NULL), in a block of 'size' bytes following
+** the 'StrView', where later concatenations may append (see
+** 'hydrogenS_newcat'). The bytes of a view may not be followed by a
+** '\0', so code reading them must use their length; 'hydrogenS_tocstr'
+** gives a C string a temporary terminated copy when needed. The bytes
+** themselves never move, so pointers to them stay valid while the view
+** is alive.
+*/
+typedef struct StrView {
+  char *data;  /* the bytes of the string */
+  struct TString *parent;  /* string holding them (NULL if owned) */
+  size_t size;  /* size of the block after the 'StrView' */
+  size_t used;  /* number of bytes in use in that block */
+} StrView;
+
+#define VIEWMARK	cast_byte(~0)
+
+#define isview(ts)	((ts)->shrlen == VIEWMARK)
+#define getview(ts)	cast(StrView *, (ts)->contents)
+
+
+/*
+** Get the actual string (array of bytes) from a 'TString'.
+*/
+#define getstr(ts)  (isview(ts) ? getview(ts)->data : (ts)->contents)
+
+
+/* get the actual string (array of bytes) from a Hydrogen value */
+#define svalue(o)       getstr(tsvalue(o))
+
+/* get string length from 'TString *s' */
+#define tsslen(s)	((s)->tt == HYDROGEN_VSHRSTR ? (s)->shrlen : (s)->u.lnglen)
+
+/* get string length from 'TValue *o' */
+#define vslen(o)	tsslen(tsvalue(o))
+
+/* }================================================================== */
+
+
+/*
+** {==================================================================
+** Userdata
+** ===================================================================
+*/
+
+
+/*
+** Light userdata should be a variant of userdata, but for compatibility
+** reasons they are also different types.
+*/
+#define HYDROGEN_VLIGHTUSERDATA	makevariant(HYDROGEN_TLIGHTUSERDATA, 0)
+
+#define HYDROGEN_VUSERDATA		makevariant(HYDROGEN_TUSERDATA, 0)
+
+#define ttislightuserdata(o)	checktag((o), HYDROGEN_VLIGHTUSERDATA)
+#define ttisfulluserdata(o)	checktag((o), ctb(HYDROGEN_VUSERDATA))
+
+#define pvalue(o)	check_exp(ttislightuserdata(o), valp_(o))
+#define uvalue(o)	check_exp(ttisfulluserdata(o), gco2u(valgc_(o)))
+
+#define pvalueraw(v)	((v).p)
+
+#define setpvalue(obj,x) \
+  { TValue *io=(obj); setvalp_(io, x); }
+
+#define setuvalue(L,obj,x) \
+  { TValue *io = (obj); Udata *x_ = (x); \
+    setvalgc_(io, obj2gco(x_), ctb(HYDROGEN_VUSERDATA)); \
+    checkliveness(L,io); }
+
+
+/* Ensures that addresses after this type are always fully aligned. */
+typedef union UValue {
+  TValue uv;
+  HYDROGENI_MAXALIGN;  /* ensures maximum alignment for udata bytes */
+} UValue;
+
+
+/*
+** Header for userdata with user values;
+** memory area follows the end of this structure.
+*/
+typedef struct Udata {
+  CommonHeader;
+  unsigned short nuvalue;  /* number of user values */
+  size_t len;  /* number of bytes */
+  struct Table *metatable;
+  GCObject *gclist;
+  UValue uv[1];  /* user values */
+} Udata;
+
+
+/*
+** Header for userdata with no user values. These userdata do not need
+** to be gray during GC, and therefore do not need a 'gclist' field.
+** To simplify, the code always use 'Udata' for both kinds of userdata,
+** making sure it never accesses 'gclist' on userdata with no user values.
+** This structure here is used only to compute the correct size for
+** this representation. (The 'bindata' field in its end ensures correct
+** alignment for binary data following this header.)
+*/
+typedef struct Udata0 {
+  CommonHeader;
+  unsigned short nuvalue;  /* number of user values */
+  size_t len;  /* number of bytes */
+  struct Table *metatable;
+  union {HYDROGENI_MAXALIGN;} bindata;
+} Udata0;
+
+
+/* compute the offset of the memory area of a userdata */
+#define udatamemoffset(nuv) \
+	((nuv) == 0 ? offsetof(Udata0, bindata)  \
+                    : offsetof(Udata, uv) + (sizeof(UValue) * (nuv)))
+
+/* get the address of the memory block inside 'Udata' */
+#define getudatamem(u)	(cast_charp(u) + udatamemoffset((u)->nuvalue))
+
+/* compute the size of a userdata */
+#define sizeudata(nuv,nb)	(udatamemoffset(nuv) + (nb))
+
+/* }================================================================== */
+
+
+/*
+** {==================================================================
+** Prototypes
+** ===================================================================
+*/
+
+#define HYDROGEN_VPROTO	makevariant(HYDROGEN_TPROTO, 0)
+
+
+/*
+** Description of an upvalue for function prototypes
+*/
+typedef struct Upvaldesc {
+  TString *name;  /* upvalue name (for debug information) */
+  lu_byte instack;  /* whether it is in stack (register) */
+  lu_byte idx;  /* index of upvalue (in stack or in outer function's list) */
+  lu_byte kind;  /* kind of corresponding variable */
+} Upvaldesc;
+
+
+/*
+** Description of a local variable for function prototypes
+** (used for debug information)
+*/
+typedef struct LocVar {
+  TString *varname;
+  int startpc;  /* first point where variable is active */
+  int endpc;    /* first point where variable is dead */
+} LocVar;
+
+
+/*
+** Associates the absolute line source for a given instruction ('pc').
+** The array 'lineinfo' gives, for each instruction, the difference in
+** lines from the previous instruction. When that difference does not
+** fit into a byte, Hydrogen saves the absolute line for that instruction.
+** (Hydrogen also saves the absolute line periodically, to speed up the
+** computation of a line number: we can use binary search in the
+** absolute-line array, but we must traverse the 'lineinfo' array
+** linearly to compute a line.)
+*/
+typedef struct AbsLineInfo {
+  int pc;
+  int line;
+} AbsLineInfo;
+
+/*
+** Inline cache of an instruction; which part is in use depends on the
+** instruction. For an instruction that indexes a table with a constant
+** short-string key (OP_GETTABUP, OP_GETFIELD, OP_SELF, OP_SETTABUP, and
+** OP_SETFIELD), 'field.slot' is the node index where the key was last
+** found in the indexed table; 'field.islot' is the same for the table
+** reached through its '__index' metafield. Both are only hints: they
+** are checked against the current node vector before being used.
+** Instructions that can be quickened keep their quickening state in
+** 'quick' (see 'observe' in virtualMachine.c), and loop instructions
+** keep the state of their traces in 'loop' (see 'jit.h'). All parts
+** start zeroed.
+*/
+typedef union ICache {
+  struct {
+    unsigned int slot;
+    unsigned int islot;
+  } field;
+  struct {
+    unsigned int state;  /* candidate opcode and its runs in a row */
+    unsigned int unstable;  /* times it changed candidate or deoptimized */
+  } quick;
+  struct {
+    unsigned int count;  /* iterations since the loop last got hot */
+    unsigned int flags;  /* state for the trace compiler ('JIT_LOOP*') */
+  } loop;
+} ICache;
+
+
+/*
+** Predecoded instruction for the direct-threaded interpreter loop:
+** 'handler' is the offset of the code for its opcode in
+** 'hydrogenV_execute' (from that of OP_MOVE), and 'a', 'b', 'c', and
+** 'k' are its operands, already extracted. The loop reads the other
+** operands from the instruction in 'code', which is still the source
+** of truth; the predecoded copy is built before the first run of a
+** prototype and kept in sync when the interpreter rewrites an
+** instruction.
+*/
+typedef struct DecodedInstruction {
+  int handler;
+  lu_byte a, b, c, k;
+} DecodedInstruction;
+
+
+#if defined(HYDROGEN_USE_AOT)
+struct CallInfo;
+
+/* function compiled ahead of time by 'hydrogenc -C' (see 'aot.h') */
+typedef int (*AOTFunction) (hydrogen_State *L, struct CallInfo *ci);
+#endif
+
+
+/*
+** Function Prototypes
+*/
+typedef struct Proto {
+  CommonHeader;
+  lu_byte numparams;  /* number of fixed (named) parameters */
+  lu_byte is_vararg;
+  lu_byte maxstacksize;  /* number of registers needed by this function */
+  int sizeupvalues;  /* size of 'upvalues' */
+  int sizek;  /* size of 'k' */
+  int sizecode;
+  int sizelineinfo;
+  int sizep;  /* size of 'p' */
+  int sizelocvars;
+  int sizeabslineinfo;  /* size of 'abslineinfo' */
+  int linedefined;  /* debug information  */
+  int lastlinedefined;  /* debug information  */
+  TValue *k;  /* constants used by the function */
+  Instruction *code;  /* opcodes */
+  ICache *icache;  /* inline caches (one per instruction, 'sizecode') */
+  DecodedInstruction *dcode;  /* predecoded 'code' (or NULL) */
+  struct Proto **p;  /* functions defined inside the function */
+  Upvaldesc *upvalues;  /* upvalue information */
+  ls_byte *lineinfo;  /* information about source lines (debug information) */
+  AbsLineInfo *abslineinfo;  /* idem */
+  LocVar *locvars;  /* information about local variables (debug information) */
+  TString  *source;  /* used for debug information */
+  GCObject *gclist;
+#if defined(HYDROGEN_USE_JIT)
+  int hotcount;  /* calls and loop iterations (-1: not compilable) */
+  struct JitCode *jit;  /* native code (see 'jit.c') */
+  struct JitTrace *trace;  /* native code of its hot loops */
+#endif
+#if defined(HYDROGEN_USE_AOT)
+  AOTFunction aot;  /* code compiled ahead of time (or NULL) */
+#endif
+} Proto;
+
+/* }================================================================== */
+
+
+/*
+** {==================================================================
+** Functions
+** ===================================================================
+*/
+
+#define HYDROGEN_VUPVAL	makevariant(HYDROGEN_TUPVAL, 0)
+
+
+/* Variant tags for functions */
+#define HYDROGEN_VLCL	makevariant(HYDROGEN_TFUNCTION, 0)  /* Hydrogen closure */
+#define HYDROGEN_VLCF	makevariant(HYDROGEN_TFUNCTION, 1)  /* light C function */
+#define HYDROGEN_VCCL	makevariant(HYDROGEN_TFUNCTION, 2)  /* C closure */
+
+#define ttisfunction(o)		checktype(o, HYDROGEN_TFUNCTION)
+#define ttisLclosure(o)		checktag((o), ctb(HYDROGEN_VLCL))
+#define ttislcf(o)		checktag((o), HYDROGEN_VLCF)
+#define ttisCclosure(o)		checktag((o), ctb(HYDROGEN_VCCL))
+#define ttisclosure(o)         (ttisLclosure(o) || ttisCclosure(o))
+
+
+#define isfunctiontion(o)	ttisLclosure(o)
+
+#define clvalue(o)	check_exp(ttisclosure(o), gco2cl(valgc_(o)))
+#define clLvalue(o)	check_exp(ttisLclosure(o), gco2lcl(valgc_(o)))
+#define fvalue(o)	check_exp(ttislcf(o), valf_(o))
+#define clCvalue(o)	check_exp(ttisCclosure(o), gco2ccl(valgc_(o)))
+
+#define fvalueraw(v)	((v).f)
+
+#define setclLvalue(L,obj,x) \
+  { TValue *io = (obj); LClosure *x_ = (x); \
+    setvalgc_(io, obj2gco(x_), ctb(HYDROGEN_VLCL)); \
+    checkliveness(L,io); }
+
+#define setclLvalue2s(L,o,cl)	setclLvalue(L,s2v(o),cl)
+
+#define setfvalue(obj,x) \
+  { TValue *io=(obj); setvalf_(io, x); }
+
+#define setclCvalue(L,obj,x) \
+  { TValue *io = (obj); CClosure *x_ = (x); \
+    setvalgc_(io, obj2gco(x_), ctb(HYDROGEN_VCCL)); \
+    checkliveness(L,io); }
+
+
+/*
+** Upvalues for Hydrogen closures
+*/
+typedef struct UpVal {
+  CommonHeader;
+  lu_byte tbc;  /* true if it represents a to-be-closed variable */
+  TValue *v;  /* points to stack or to its own value */
+  union {
+    struct {  /* (when open) */
+      struct UpVal *next;  /* linked list */
+      struct UpVal **previous;
+    } open;
+    TValue value;  /* the value (when closed) */
+  } u;
+} UpVal;
+
+
+
+#define ClosureHeader \
+	CommonHeader; lu_byte nupvalues; GCObject *gclist
+
+typedef struct CClosure {
+  ClosureHeader;
+  hydrogen_CFunction f;
+  TValue upvalue[1];  /* list of upvalues */
+} CClosure;
+
+
+typedef struct LClosure {
+  ClosureHeader;
+  struct Proto *p;
+  UpVal *upvals[1];  /* list of upvalues */
+} LClosure;
+
+
+typedef union Closure {
+  CClosure c;
+  LClosure l;
+} Closure;
+
+
+#define getproto(o)	(clLvalue(o)->p)
+
+/* }================================================================== */
+
+
+/*
+** {==================================================================
+** Tables
+** ===================================================================
+*/
+
+#define HYDROGEN_VTABLE	makevariant(HYDROGEN_TTABLE, 0)
+
+#define ttistable(o)		checktag((o), ctb(HYDROGEN_VTABLE))
+
+#define hvalue(o)	check_exp(ttistable(o), gco2t(valgc_(o)))
+
+#define sethvalue(L,obj,x) \
+  { TValue *io = (obj); Table *x_ = (x); \
+    setvalgc_(io, obj2gco(x_), ctb(HYDROGEN_VTABLE)); \
+    checkliveness(L,io); }
+
+#define sethvalue2s(L,o,h)	sethvalue(L,s2v(o),h)
+
+
+/*
+** Nodes for Hash tables: A pack of two TValue's (key-value pairs).
+** The distribution of the key's fields ('key_tt' and 'key_val') not
+** forming a proper 'TValue' allows for a smaller size for 'Node' both
+** in 4-byte and 8-byte alignments.
+*/
+typedef union Node {
+  struct NodeKey {
+    TValuefields;  /* fields for value */
+    lu_byte key_tt;  /* key type */
+    Value key_val;  /* key value */
+  } u;
+  TValue i_val;  /* direct access to node's value as a proper 'TValue' */
+} Node;
+
+
+#if !defined(HYDROGEN_NANBOXING)
+
+/* copy a value into a key */
+#define setnodekey(L,node,obj) \
+	{ Node *n_=(node); const TValue *io_=(obj); \
+	  n_->u.key_val = io_->value_; n_->u.key_tt = io_->tt_; \
+	  checkliveness(L,io_); }
+
+
+/* copy a value from a key */
+#define getnodekey(L,obj,node) \
+	{ TValue *io_=(obj); const Node *n_=(node); \
+	  io_->value_ = n_->u.key_val; io_->tt_ = n_->u.key_tt; \
+	  checkliveness(L,io_); }
+
+#else
+
+/*
+** With NaN boxing, keys keep their usual tag-and-value form, which
+** costs no space in a 'Node' and keeps the key code unchanged.
+*/
+
+/* copy a value into a key */
+#define setnodekey(L,node,obj) \
+	{ Node *n_=(node); const TValue *io_=(obj); \
+	  hydrogenO_nbunbox(io_, &n_->u.key_tt, &n_->u.key_val); \
+	  checkliveness(L,io_); }
+
+
+/* copy a value from a key */
+#define getnodekey(L,obj,node) \
+	{ TValue *io_=(obj); const Node *n_=(node); \
+	  hydrogenO_nbbox(io_, n_->u.key_tt, &n_->u.key_val); \
+	  checkliveness(L,io_); }
+
+#endif
+
+
+/*
+** About 'alimit': if 'isrealasize(t)' is true, then 'alimit' is the
+** real size of 'array'. Otherwise, the real size of 'array' is the
+** smallest power of two not smaller than 'alimit' (or zero iff 'alimit'
+** is zero); 'alimit' is then used as a hint for #t.
+*/
+
+#define BITRAS		(1 << 7)
+#define isrealasize(t)		(!((t)->flags & BITRAS))
+#define setrealasize(t)		((t)->flags &= cast_byte(~BITRAS))
+#define setnorealasize(t)	((t)->flags |= BITRAS)
+
+
+/*
+** 'BITMIGR' means that the block of the hash part of a table ends with
+** the state of an incremental resize (see 'Migration' in 'table.c').
+*/
+#define BITMIGR		(1 << 6)
+
+
+typedef struct Table {
+  CommonHeader;
+  lu_byte flags;  /* 1<<p means tagmethod(p) is not present */
+  lu_byte lsizenode;  /* log2 of size of 'node' array */
+  unsigned int alimit;  /* "limit" of 'array' array */
+#if defined(HYDROGEN_NANBOXING)
+  TValue *array;  /* array part */
+#else
+  Value *array;  /* array part (values and tags; see 'arrval') */
+#endif
+  Node *node;
+  unsigned int growthleft;  /* number of free nodes that can be used */
+  struct Table *metatable;
+  GCObject *gclist;
+} Table;
+
+
+/*
+** Macros to manipulate keys inserted in nodes
+*/
+#define keytt(node)		((node)->u.key_tt)
+#define keyval(node)		((node)->u.key_val)
+
+#define keyisnil(node)		(keytt(node) == HYDROGEN_TNIL)
+#define keyisinteger(node)	(keytt(node) == HYDROGEN_VNUMINT)
+#define keyival(node)		(keyval(node).i)
+#define keyisshrstr(node)	(keytt(node) == ctb(HYDROGEN_VSHRSTR))
+#define keystrval(node)		(gco2ts(keyval(node).gc))
+
+#define setnilkey(node)		(keytt(node) = HYDROGEN_TNIL)
+
+#define keyiscollectable(n)	(keytt(n) & BIT_ISCOLLECTABLE)
+
+#define gckey(n)	(keyval(n).gc)
+#define gckeyN(n)	(keyiscollectable(n) ? gckey(n) : NULL)
+
+
+/*
+** Dead keys in tables have the tag DEADKEY but keep their original
+** gcvalue. This distinguishes them from regular keys but allows them to
+** be found when searched in a special way. ('next' needs that to find
+** keys removed from a table during a traversal.)
+*/
+#define setdeadkey(node)	(keytt(node) = HYDROGEN_TDEADKEY)
+#define keyisdead(node)		(keytt(node) == HYDROGEN_TDEADKEY)
+
+/* }================================================================== */
+
+
+
+/*
+** 'module' operation for hashing (size is always a power of 2)
+*/
+#define lmod(s,size) \
+	(check_exp((size&(size-1))==0, (cast_int((s) & ((size)-1)))))
+
+
+#define twoto(x)	(1<<(x))
+#define sizenode(t)	(twoto((t)->lsizenode))
+
+
+/* size of buffer for 'hydrogenO_utf8esc' function */
+#define UTF8BUFFSZ	8
+
+HYDROGENI_FUNC int hydrogenO_utf8esc (char *buff, unsigned long x);
+HYDROGENI_FUNC int hydrogenO_ceillog2 (unsigned int x);
+HYDROGENI_FUNC int hydrogenO_rawarith (hydrogen_State *L, int op, const TValue *p1,
+                             const TValue *p2, TValue *res);
+HYDROGENI_FUNC void hydrogenO_arith (hydrogen_State *L, int op, const TValue *p1,
+                           const TValue *p2, StkId res);
+HYDROGENI_FUNC size_t hydrogenO_str2num (const char *s, TValue *o);
+HYDROGENI_FUNC int hydrogenO_hexavalue (int c);
+HYDROGENI_FUNC void hydrogenO_tostring (hydrogen_State *L, TValue *obj);
+HYDROGENI_FUNC const char *hydrogenO_pushvfstring (hydrogen_State *L, const char *fmt,
+                                                       va_list argp);
+HYDROGENI_FUNC const char *hydrogenO_pushfstring (hydrogen_State *L, const char *fmt, ...);
+HYDROGENI_FUNC void hydrogenO_chunkid (char *out, const char *source, size_t srclen);
+#if defined(HYDROGEN_NANBOXING)
+HYDROGENI_FUNC void hydrogenO_nbunbox (const TValue *o, lu_byte *tt, Value *v);
+HYDROGENI_FUNC void hydrogenO_nbbox (TValue *o, int tt, const Value *v);
+#endif
+
+
+#endif
+
@@ -0,0 +1,119 @@
+/*
+** $Id: opnames.h $
+** Opcode names
+** See Copyright Notice in hydrogen.h
+*/
+
+#if !defined(opnames_h)
+#define opnames_h
+
+#include <stddef.h>
+
+
+/* ORDER OP */
+
+static const char *const opnames[] = {
+  "MOVE",
+  "LOADI",
+  "LOADF",
+  "LOADK",
+  "LOADKX",
+  "LOADFALSE",
+  "LFALSESKIP",
+  "LOADTRUE",
+  "LOADNIL",
+  "GETUPVAL",
+  "SETUPVAL",
+  "GETTABUP",
+  "GETTABLE",
+  "GETI",
+  "GETFIELD",
+  "SETTABUP",
+  "SETTABLE",
+  "SETI",
+  "SETFIELD",
+  "NEWTABLE",
+  "SELF",
+  "ADDI",
+  "ADDK",
+  "SUBK",
+  "MULK",
+  "MODK",
+  "POWK",
+  "DIVK",
+  "IDIVK",
+  "BANDK",
+  "BORK",
+  "BXORK",
+  "SHRI",
+  "SHLI",
+  "ADD",
+  "SUB",
+  "MUL",
+  "MOD",
+  "POW",
+  "DIV",
+  "IDIV",
+  "BAND",
+  "BOR",
+  "BXOR",
+  "SHL",
+  "SHR",
+  "MMBIN",
+  "MMBINI",
+  "MMBINK",
+  "UNM",
+  "BNOT",
+  "NOT",
+  "LEN",
+  "CONCAT",
+  "CLOSE",
+  "TBC",
+  "JMP",
+  "EQ",
+  "LT",
+  "LE",
+  "EQK",
+  "EQI",
+  "LTI",
+  "LEI",
+  "GTI",
+  "GEI",
+  "TEST",
+  "TESTSET",
+  "CALL",
+  "TAILCALL",
+  "RETURN",
+  "RETURN0",
+  "RETURN1",
+  "FORLOOP",
+  "FORPREP",
+  "TFORPREP",
+  "TFORCALL",
+  "TFORLOOP",
+  "SETLIST",
+  "CLOSURE",
+  "VARARG",
+  "VARARGPREP",
+  "EXTRAARG",
+  "GETTABUP_CALL",
+  "GETFIELD_CALL",
+  "SELF_CALL",
+  "ADD_II",
+  "ADD_FF",
+  "SUB_II",
+  "SUB_FF",
+  "MUL_II",
+  "MUL_FF",
+  "EQ_II",
+  "LT_II",
+  "LE_II",
+  "GETTABLE_ARRAY",
+  "GETI_ARRAY",
+  "SETTABLE_ARRAY",
+  "SETI_ARRAY",
+  NULL
+};
+
+#endif
+
@@ -0,0 +1,573 @@
+/*
+** $Id: string.c $
+** String table (keeps all strings handled by Hydrogen)
+** See Copyright Notice in hydrogen.h
+*/
+
+#define string_c
+#define HYDROGEN_CORE
+
+#include "prefix.h"
+
+
+#include <string.h>
+
+#include "hydrogen.h"
+
+#include "debug.h"
+#include "do.h"
+#include "memory.h"
+#include "object.h"
+#include "state.h"
+#include "string.h"
+
+
+/*
+** Maximum size for string table.
+*/
+#define MAXSTRTB	cast_int(hydrogenM_limitN(MAX_INT, TString*))
+
+
+/*
+** Number of lists of the string table split for each new string while
+** the table grows. (It must be at least 1, so that the growth is over
+** before the table is full again.)
+*/
+#if !defined(STRGROWSTEP)
+#define STRGROWSTEP	4
+#endif
+
+
+/*
+** equality for long strings
+*/
+int hydrogenS_eqlngstr (TString *a, TString *b) {
+  size_t len = a->u.lnglen;
+  hydrogen_assert(a->tt == HYDROGEN_VLNGSTR && b->tt == HYDROGEN_VLNGSTR);
+  return (a == b) ||  /* same instance or... */
+    ((len == b->u.lnglen) &&  /* equal length and ... */
+     (memcmp(getstr(a), getstr(b), len) == 0));  /* equal contents */
+}
+
+
+/*
+** Hash of a string. With 64-bit integers available, it goes through
+** the string 8 bytes at a time (read with 'memcpy', which compiles to
+** one unaligned load), mixing each word into the state with a 64x64
+** -> 128-bit multiplication whose two halves are folded ('mum'), as
+** wyhash does. The words are masked with a secret derived from the
+** seed, so that collisions cannot be built without knowing it. The
+** last 1 to 8 bytes are read as one word, with loads that may overlap.
+*/
+#if defined(LLONG_MAX) && !defined(HYDROGEN_BYTEHASH)	/* { */
+
+typedef unsigned long long Hword;
+
+#define HASHK0	0xa0761d6478bd642fULL
+#define HASHK1	0xe7037ed1a0b428dbULL
+#define HASHK2	0x8ebc6af09c88c6e3ULL
+
+
+#if defined(__SIZEOF_INT128__)
+
+l_sinline Hword mum (Hword a, Hword b) {
+  unsigned __int128 r = (unsigned __int128)a * b;
+  return cast(Hword, r) ^ cast(Hword, r >> 64);
+}
+
+#else
+
+l_sinline Hword mum (Hword a, Hword b) {
+  Hword ha = a >> 32, la = a & 0xffffffffu;
+  Hword hb = b >> 32, lb = b & 0xffffffffu;
+  Hword m0 = ha * lb, m1 = la * hb;
+  Hword lo = la * lb;
+  Hword t = lo + (m0 << 32);
+  Hword hi = ha * hb + (m0 >> 32) + (m1 >> 32) + (t < lo);
+  lo = t + (m1 << 32);
+  hi += (lo < t);
+  return lo ^ hi;
+}
+
+#endif
+
+
+l_sinline Hword read8 (const char *p) {
+  Hword w;
+  memcpy(&w, p, sizeof(w));
+  return w;
+}
+
+
+l_sinline Hword read4 (const char *p) {
+  l_uint32 w;
+  memcpy(&w, p, sizeof(w));
+  return w;
+}
+
+
+unsigned int hydrogenS_hash (const char *str, size_t l, unsigned int seed) {
+  Hword secret = (seed ^ HASHK0) * HASHK1;
+  Hword h = secret ^ l;
+  Hword w;
+  for (; l > 8; l -= 8, str += 8)  /* all words but the last one */
+    h = mum(read8(str) ^ secret, h ^ HASHK2);
+  if (l >= 4)  /* 4 to 8 bytes left? */
+    w = (read4(str) << 32) | read4(str + l - 4);
+  else if (l > 0)  /* 1 to 3 bytes left */
+    w = (cast(Hword, cast_byte(str[0])) << 16) |
+        (cast(Hword, cast_byte(str[l >> 1])) << 8) | cast_byte(str[l - 1]);
+  else
+    w = 0;
+  h = mum(w ^ secret, h ^ HASHK1);
+  return cast_uint(h ^ (h >> 32));
+}
+
+#else						/* }{ */
+
+unsigned int hydrogenS_hash (const char *str, size_t l, unsigned int seed) {
+  unsigned int h = seed ^ cast_uint(l);
+  for (; l > 0; l--)
+    h ^= ((h<<5) + (h>>2) + cast_byte(str[l - 1]));
+  return h;
+}
+
+#endif						/* } */
+
+
+unsigned int hydrogenS_hashlongstr (TString *ts) {
+  hydrogen_assert(ts->tt == HYDROGEN_VLNGSTR);
+  if (ts->extra == 0) {  /* no hash? */
+    size_t len = ts->u.lnglen;
+    ts->hash = hydrogenS_hash(getstr(ts), len, ts->hash);
+    ts->extra = 1;  /* now it has its hash */
+  }
+  return ts->hash;
+}
+
+
+static void tablerehash (TString **vect, int osize, int nsize) {
+  int i;
+  for (i = osize; i < nsize; i++)  /* clear new elements */
+    vect[i] = NULL;
+  for (i = 0; i < osize; i++) {  /* rehash old part of the array */
+    TString *p = vect[i];
+    vect[i] = NULL;
+    while (p) {  /* for each string in the list */
+      TString *hnext = p->u.hnext;  /* save next */
+      unsigned int h = lmod(p->hash, nsize);  /* new position */
+      p->u.hnext = vect[h];  /* chain it into array */
+      vect[h] = p;
+      p = hnext;
+    }
+  }
+}
+
+
+/*
+** The string table grows incrementally: its vector doubles at once,
+** but the list at each position 'i' of the old part keeps also the
+** strings that go to position 'i + oldsize', until it is split. The
+** lists are split in order, a few for each new string ('internshrstr')
+** and for each step of the collector.
+*/
+
+/* list of the strings with hash 'h' */
+l_sinline TString **strlist (stringtable *tb, unsigned int h) {
+  int i = lmod(h, tb->oldsize);
+  if (i < tb->nsplit)  /* list already split? */
+    i = lmod(h, tb->size);
+  return &tb->hash[i];
+}
+
+
+/*
+** Split the next 'n' lists of the old part of the string table, if it
+** is growing.
+*/
+void hydrogenS_growstep (global_State *g, int n) {
+  stringtable *tb = &g->strt;
+  if (!hydrogenS_isgrowing(g))
+    return;
+  for (; n > 0 && tb->nsplit < tb->oldsize; n--) {
+    TString **p = &tb->hash[tb->nsplit];
+    TString **q = &tb->hash[tb->nsplit + tb->oldsize];
+    while (*p != NULL) {
+      TString *ts = *p;
+      if (lmod(ts->hash, tb->size) != tb->nsplit) {  /* goes to new part? */
+        *p = ts->u.hnext;  /* remove it from old list */
+        ts->u.hnext = *q;  /* and chain it into new one */
+        *q = ts;
+      }
+      else
+        p = &ts->u.hnext;
+    }
+    tb->nsplit++;
+  }
+  if (tb->nsplit == tb->oldsize) {  /* all lists split? */
+    tb->oldsize = tb->size;  /* growth is over */
+    tb->nsplit = 0;
+  }
+}
+
+
+/*
+** Start to grow the string table to twice its size. If allocation fails,
+** keep the current size.
+*/
+static void startgrowth (hydrogen_State *L, stringtable *tb) {
+  int osize = tb->size;
+  TString **newvect = hydrogenM_reallocvector(L, tb->hash, osize, osize * 2,
+                                                           TString*);
+  if (l_likely(newvect != NULL)) {
+    int i;
+    for (i = osize; i < osize * 2; i++)  /* clear new part */
+      newvect[i] = NULL;
+    tb->hash = newvect;
+    tb->size = osize * 2;
+    tb->oldsize = osize;
+    tb->nsplit = 0;
+    tb->nresize++;
+  }
+}
+
+
+/*
+** Resize the string table at once. If allocation fails, keep the
+** current size. (This can degrade performance, but any non-zero size
+** should work correctly.)
+*/
+void hydrogenS_resize (hydrogen_State *L, int nsize) {
+  stringtable *tb = &G(L)->strt;
+  int osize;
+  TString **newvect;
+  hydrogenS_growstep(G(L), tb->oldsize);  /* finish any growth */
+  osize = tb->size;
+  if (nsize < osize)  /* shrinking table? */
+    tablerehash(tb->hash, osize, nsize);  /* depopulate shrinking part */
+  newvect = hydrogenM_reallocvector(L, tb->hash, osize, nsize, TString*);
+  if (l_unlikely(newvect == NULL)) {  /* reallocation failed? */
+    if (nsize < osize)  /* was it shrinking table? */
+      tablerehash(tb->hash, nsize, osize);  /* restore to original size */
+    /* leave table as it was */
+  }
+  else {  /* allocation succeeded */
+    tb->hash = newvect;
+    tb->size = tb->oldsize = nsize;
+    tb->nresize++;
+    if (nsize > osize)
+      tablerehash(newvect, osize, nsize);  /* rehash for new size */
+  }
+}
+
+
+/*
+** Clear API string cache. (Entries cannot be empty, so fill them with
+** a non-collectable string.)
+*/
+void hydrogenS_clearcache (global_State *g) {
+  int i, j;
+  for (i = 0; i < STRCACHE_N; i++)
+    for (j = 0; j < STRCACHE_M; j++) {
+      if (iswhite(g->strcache[i][j]))  /* will entry be collected? */
+        g->strcache[i][j] = g->memerrmsg;  /* replace it with something fixed */
+    }
+}
+
+
+/*
+** Initialize the string table and the string cache
+*/
+void hydrogenS_init (hydrogen_State *L) {
+  global_State *g = G(L);
+  int i, j;
+  stringtable *tb = &G(L)->strt;
+  tb->hash = hydrogenM_newvector(L, MINSTRTABSIZE, TString*);
+  tablerehash(tb->hash, 0, MINSTRTABSIZE);  /* clear array */
+  tb->size = tb->oldsize = MINSTRTABSIZE;
+  /* pre-create memory-error message */
+  g->memerrmsg = hydrogenS_newliteral(L, MEMERRMSG);
+  hydrogenC_fix(L, obj2gco(g->memerrmsg));  /* it should never be collected */
+  for (i = 0; i < STRCACHE_N; i++)  /* fill cache with valid strings */
+    for (j = 0; j < STRCACHE_M; j++)
+      g->strcache[i][j] = g->memerrmsg;
+}
+
+
+
+/*
+** creates a new string object
+*/
+static TString *createstrobj (hydrogen_State *L, size_t l, int tag, unsigned int h) {
+  TString *ts;
+  GCObject *o;
+  size_t totalsize;  /* total size of TString object */
+  totalsize = sizestring(l);
+  o = hydrogenC_newobj(L, tag, totalsize);
+  ts = gco2ts(o);
+  ts->hash = h;
+  ts->extra = 0;
+  ts->shrlen = 0;  /* not a view */
+  getstr(ts)[l] = '\0';  /* ending 0 */
+  return ts;
+}
+
+
+TString *hydrogenS_createlngstrobj (hydrogen_State *L, size_t l) {
+  TString *ts = createstrobj(L, l, HYDROGEN_VLNGSTR, G(L)->seed);
+  ts->u.lnglen = l;
+  return ts;
+}
+
+
+void hydrogenS_remove (hydrogen_State *L, TString *ts) {
+  stringtable *tb = &G(L)->strt;
+  TString **p = strlist(tb, ts->hash);
+  while (*p != ts)  /* find previous element */
+    p = &(*p)->u.hnext;
+  *p = (*p)->u.hnext;  /* remove element from its list */
+  tb->nuse--;
+}
+
+
+static void growstrtab (hydrogen_State *L, stringtable *tb) {
+  if (l_unlikely(tb->nuse == MAX_INT)) {  /* too many strings? */
+    hydrogenC_fulgarbageCollection(L, 1);  /* try to free some... */
+    if (tb->nuse == MAX_INT)  /* still too many? */
+      hydrogenM_error(L);  /* cannot even create a message... */
+  }
+  hydrogenS_growstep(G(L), tb->oldsize);  /* finish any growth */
+  if (tb->size <= MAXSTRTB / 2)  /* can grow string table? */
+    startgrowth(L, tb);
+}
+
+
+/*
+** Checks whether short string exists and reuses it or creates a new one.
+*/
+static TString *internshrstr (hydrogen_State *L, const char *str, size_t l) {
+  TString *ts;
+  global_State *g = G(L);
+  stringtable *tb = &g->strt;
+  unsigned int h = hydrogenS_hash(str, l, g->seed);
+  TString **list = strlist(tb, h);
+  hydrogen_assert(str != NULL);  /* otherwise 'memcmp'/'memcpy' are undefined */
+  for (ts = *list; ts != NULL; ts = ts->u.hnext) {
+    if (l == ts->shrlen && (memcmp(str, getstr(ts), l * sizeof(char)) == 0)) {
+      /* found! */
+      if (isdead(g, ts))  /* dead (but not collected yet)? */
+        changewhite(ts);  /* resurrect it */
+      return ts;
+    }
+  }
+  /* else must create a new string */
+  if (tb->nuse >= tb->size)  /* need to grow string table? */
+    growstrtab(L, tb);
+  if (hydrogenS_isgrowing(g))
+    hydrogenS_growstep(g, STRGROWSTEP);  /* go on with the growth */
+  list = strlist(tb, h);  /* lists may have changed */
+  ts = createstrobj(L, l, HYDROGEN_VSHRSTR, h);
+  memcpy(getstr(ts), str, l * sizeof(char));
+  ts->shrlen = cast_byte(l);
+  ts->u.hnext = *list;
+  *list = ts;
+  tb->nuse++;
+  return ts;
+}
+
+
+/*
+** new string (with explicit length)
+*/
+TString *hydrogenS_newlstr (hydrogen_State *L, const char *str, size_t l) {
+  if (l <= HYDROGENI_MAXSHORTLEN)  /* short string? */
+    return internshrstr(L, str, l);
+  else {
+    TString *ts;
+    if (l_unlikely(l >= (MAX_SIZE - sizeof(TString))/sizeof(char)))
+      hydrogenM_toobig(L);
+    ts = hydrogenS_createlngstrobj(L, l);
+    memcpy(getstr(ts), str, l * sizeof(char));
+    return ts;
+  }
+}
+
+
+/*
+** Create a view of length 'l' with a block of 'size' bytes. Its bytes
+** are those at 'data' in string 'parent', or the block if 'parent' is
+** NULL.
+*/
+static TString *newview (hydrogen_State *L, char *data, TString *parent,
+                         size_t l, size_t size) {
+  GCObject *o;
+  TString *ts;
+  if (l_unlikely(size >= MAX_SIZE - sizeview(0)))
+    hydrogenM_toobig(L);
+  o = hydrogenC_newobj(L, HYDROGEN_VLNGSTR, sizeview(size));
+  ts = gco2ts(o);
+  ts->hash = G(L)->seed;
+  ts->extra = 0;
+  ts->shrlen = VIEWMARK;
+  ts->u.lnglen = l;
+  getview(ts)->data = (parent != NULL) ? data : viewblock(ts);
+  getview(ts)->parent = parent;
+  getview(ts)->size = size;
+  getview(ts)->used = (parent != NULL) ? 0 : l;
+  return ts;
+}
+
+
+/*
+** Number of bytes kept alive by long string 'ts'.
+*/
+static size_t heldbytes (TString *ts) {
+  return ts->u.lnglen + (isview(ts) ? getview(ts)->size : 0);
+}
+
+
+/*
+** New string with the 'l' bytes of string 'ts' starting at position
+** 'i'. A long enough result is a view of the string holding the bytes
+** of 'ts', unless that string is too large for it (see
+** HYDROGENI_VIEWRATIO); other results are copies.
+*/
+TString *hydrogenS_newsub (hydrogen_State *L, TString *ts, size_t i,
+                                                         size_t l) {
+  hydrogen_assert(i + l <= tsslen(ts));
+  if (i == 0 && l == tsslen(ts))  /* whole string? */
+    return ts;
+  else if (l >= HYDROGENI_MINVIEW) {  /* ('ts' is a long string) */
+    TString *p = (isview(ts) && getview(ts)->parent != NULL)
+               ? getview(ts)->parent  /* share the bytes of 'ts' */
+               : ts;
+    if (l >= heldbytes(p) / HYDROGENI_VIEWRATIO)
+      return newview(L, getstr(ts) + i, p, l, 0);
+  }
+  return hydrogenS_newlstr(L, getstr(ts) + i, l);
+}
+
+
+/*
+** Check whether the bytes of string 'ts' are followed by a '\0', as
+** a C string needs; only a view may lack it. A view ending at the top
+** of a block keeps that '\0', so no later concatenation can append
+** over it.
+*/
+int hydrogenS_isterminated (TString *ts) {
+  if (isview(ts)) {
+    StrView *v = getview(ts);
+    size_t l = ts->u.lnglen;
+    TString *b = (v->parent != NULL) ? v->parent : ts;
+    if (v->data[l] != '\0')
+      return 0;
+    else if (isview(b) && v->data + l == viewblock(b) + getview(b)->used)
+      getview(b)->used++;  /* keep that '\0' */
+  }
+  return 1;
+}
+
+
+/*
+** Return the bytes of the string in 'o' followed by a '\0'; this is
+** the only safe way to hand them out as a C string. A view whose bytes
+** are not so followed is replaced in 'o' by an equal string holding a
+** terminated copy of them (so this can raise a memory error); the copy
+** lives only while 'o' keeps it. When 'o' is not a stack slot, the
+** caller must apply the barrier it needs.
+*/
+const char *hydrogenS_tocstr (hydrogen_State *L, TValue *o) {
+  TString *ts = tsvalue(o);
+  if (!hydrogenS_isterminated(ts)) {
+    ts = hydrogenS_newlstr(L, getstr(ts), ts->u.lnglen);
+    setsvalue(L, o, ts);
+  }
+  return getstr(ts);
+}
+
+
+/*
+** Create a long string of length 'l' whose first bytes are those of
+** string 'a' and return in '*rest' where to write the other ones. A
+** long enough result is built in a block; if the bytes of 'a' end at
+** the top of a block with room for the rest, the result extends them
+** in place, so that repeated appends to a string ('s = s .. x') take
+** linear time. A new block for such an append gets room to spare.
+** Appending in place writes over the '\0' that followed 'a', so a C
+** string may only be taken from a string in a block after
+** 'hydrogenS_isterminated', which keeps that '\0' for good.
+*/
+TString *hydrogenS_newcat (hydrogen_State *L, TString *a, size_t l,
+                                                  char **rest) {
+  size_t la = tsslen(a);
+  TString *ts;
+  hydrogen_assert(la <= l && l > HYDROGENI_MAXSHORTLEN);
+  if (l < HYDROGENI_MINAPPEND) {
+    ts = hydrogenS_createlngstrobj(L, l);
+    memcpy(getstr(ts), getstr(a), la * sizeof(char));
+  }
+  else {
+    TString *b = NULL;  /* view holding the block with 'a' */
+    if (isview(a)) {
+      b = (getview(a)->parent != NULL) ? getview(a)->parent : a;
+      if (!isview(b) || getview(b)->size == 0)
+        b = NULL;  /* 'a' is not in a block */
+    }
+    if (b != NULL && getstr(a) + la == viewblock(b) + getview(b)->used &&
+        l - la < getview(b)->size - getview(b)->used) {
+      ts = newview(L, getstr(a), b, l, 0);  /* append in place */
+      getview(b)->used += l - la;
+    }
+    else {
+      size_t size = l + 1;  /* room for the bytes and a '\0' */
+      if (b != NULL)  /* appending? */
+        size += (l < MAX_SIZE / 2) ? l / 2 : 0;  /* room to spare */
+      ts = newview(L, NULL, NULL, l, size);
+      memcpy(getstr(ts), getstr(a), la * sizeof(char));
+    }
+    getstr(ts)[l] = '\0';
+  }
+  *rest = getstr(ts) + la;
+  return ts;
+}
+
+
+/*
+** Create or reuse a zero-terminated string, first checking in the
+** cache (using the string address as a key). The cache can contain
+** only zero-terminated strings, so it is safe to use 'strcmp' to
+** check hits.
+*/
+TString *hydrogenS_new (hydrogen_State *L, const char *str) {
+  unsigned int i = point2uint(str) % STRCACHE_N;  /* hash */
+  int j;
+  TString **p = G(L)->strcache[i];
+  for (j = 0; j < STRCACHE_M; j++) {
+    if (strcmp(str, getstr(p[j])) == 0)  /* hit? */
+      return p[j];  /* that is it */
+  }
+  /* normal route */
+  for (j = STRCACHE_M - 1; j > 0; j--)
+    p[j] = p[j - 1];  /* move out last element */
+  /* new element is first in the list */
+  p[0] = hydrogenS_newlstr(L, str, strlen(str));
+  return p[0];
+}
+
+
+Udata *hydrogenS_newudata (hydrogen_State *L, size_t s, int nuvalue) {
+  Udata *u;
+  int i;
+  GCObject *o;
+  if (l_unlikely(s > MAX_SIZE - udatamemoffset(nuvalue)))
+    hydrogenM_toobig(L);
+  o = hydrogenC_newobj(L, HYDROGEN_VUSERDATA, sizeudata(nuvalue, s));
+  u = gco2u(o);
+  u->len = s;
+  u->nuvalue = nuvalue;
+  u->metatable = NULL;
+  for (i = 0; i < nuvalue; i++)
+    setnilvalue(&u->uv[i].uv);
+  return u;
+}
+
@@ -0,0 +1,4287 @@
+/*
+** $Id: strlib.c $
+** Standard library for string operations and pattern-matching
+** See Copyright Notice in hydrogen.h
+*/
+
+#define strlib_c
+#define HYDROGEN_LIB
+
+#include "prefix.h"
+
+
+#include <ctype.h>
+#include <float.h>
+#include <limits.h>
+#include <locale.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "hydrogen.h"
+
+#include "auxlib.h"
+#include "hydrogenlib.h"
+
+#include "state.h"  /* for 'string.bytes', which fills a table in place */
+#include "table.h"
+
+
+/*
+** maximum number of captures that a pattern can do during
+** pattern-matching. This limit is arbitrary, but must fit in
+** an unsigned char.
+*/
+#if !defined(HYDROGEN_MAXCAPTURES)
+#define HYDROGEN_MAXCAPTURES		32
+#endif
+
+
+/* macro to 'unsign' a character */
+#define uchar(c)	((unsigned char)(c))
+
+
+/*
+** Some sizes are better limited to fit in 'int', but must also fit in
+** 'size_t'. (We assume that 'hydrogen_Integer' cannot be smaller than 'int'.)
+*/
+#define MAX_SIZET	((size_t)(~(size_t)0))
+
+#define MAXSIZE  \
+	(sizeof(size_t) < sizeof(int) ? MAX_SIZET : (size_t)(INT_MAX))
+
+
+
+
+/*
+** Get the length of the string argument 'arg' (converting a number in
+** place), without asking for its bytes.
+*/
+static size_t checklen (hydrogen_State *L, int arg) {
+  size_t l;
+  if (hydrogen_type(L, arg) == HYDROGEN_TSTRING)
+    return (size_t)hydrogen_rawlen(L, arg);
+  hydrogenL_checkbytes(L, arg, &l);
+  return l;
+}
+
+
+static int str_len (hydrogen_State *L) {
+  hydrogen_pushinteger(L, (hydrogen_Integer)checklen(L, 1));
+  return 1;
+}
+
+
+/*
+** translate a relative initial string position
+** (negative means back from end): clip result to [1, inf).
+** The length of any string in Hydrogen must fit in a hydrogen_Integer,
+** so there are no overflows in the casts.
+** The inverted comparison avoids a possible overflow
+** computing '-pos'.
+*/
+static size_t posrelatI (hydrogen_Integer pos, size_t len) {
+  if (pos > 0)
+    return (size_t)pos;
+  else if (pos == 0)
+    return 1;
+  else if (pos < -(hydrogen_Integer)len)  /* inverted comparison */
+    return 1;  /* clip to 1 */
+  else return len + (size_t)pos + 1;
+}
+
+
+/*
+** Gets an optional ending string position from argument 'arg',
+** with default value 'def'.
+** Negative means back from end: clip result to [0, len]
+*/
+static size_t getendpos (hydrogen_State *L, int arg, hydrogen_Integer def,
+                         size_t len) {
+  hydrogen_Integer pos = hydrogenL_optinteger(L, arg, def);
+  if (pos > (hydrogen_Integer)len)
+    return len;
+  else if (pos >= 0)
+    return (size_t)pos;
+  else if (pos < -(hydrogen_Integer)len)
+    return 0;
+  else return len + (size_t)pos + 1;
+}
+
+
+static int str_sub (hydrogen_State *L) {
+  size_t l = checklen(L, 1);
+  size_t start = posrelatI(hydrogenL_checkinteger(L, 2), l);
+  size_t end = getendpos(L, 3, -1, l);
+  if (start <= end)
+    hydrogen_pushsubstring(L, 1, start - 1, (end - start) + 1);
+  else hydrogen_pushliteral(L, "");
+  return 1;
+}
+
+
+#if defined(__SSE2__)
+
+/* reverse the 16 bytes of 'v' */
+static __m128i reverse16 (__m128i v) {
+  v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+  v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+  v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+  return _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+#endif
+
+
+static int str_reverse (hydrogen_State *L) {
+  size_t l, i = 0;
+  hydrogenL_Buffer b;
+  const char *s = hydrogenL_checkbytes(L, 1, &l);
+  char *p = hydrogenL_buffinitsize(L, &b, l);
+#if defined(__SSE2__)
+  for (; i + 16 <= l; i += 16) {  /* reverse 16 bytes at a time */
+    __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+    _mm_storeu_si128((__m128i *)(p + l - i - 16), reverse16(v));
+  }
+#endif
+  for (; i < l; i++)
+    p[l - i - 1] = s[i];
+  hydrogenL_pushresultsize(&b, l);
+  return 1;
+}
+
+
+/*
+** Case conversion. Bytes are converted one by one with 'tolower' or
+** 'toupper', except in strings with at least CASEMINVECTOR bytes when
+** the current locale changes ASCII letters in the usual way (as it does
+** in practically all locales): there, blocks of 16 ASCII bytes are
+** converted at once with SSE2. (Checking the locale costs about as much
+** as converting 100 bytes, so it is done only when the first such block
+** shows up.)
+*/
+#if !defined(CASEMINVECTOR)
+#define CASEMINVECTOR	128
+#endif
+
+#if defined(__SSE2__)
+
+/*
+** Check whether the case conversion of the current locale changes ASCII
+** letters in the usual way and leaves other ASCII bytes alone.
+*/
+static int usualcase (int upper) {
+  int c;
+  if (upper) {
+    for (c = 0; c < 0x80; c++)
+      if (toupper(c) != (('a' <= c && c <= 'z') ? c ^ 0x20 : c)) return 0;
+  }
+  else {
+    for (c = 0; c < 0x80; c++)
+      if (tolower(c) != (('A' <= c && c <= 'Z') ? c ^ 0x20 : c)) return 0;
+  }
+  return 1;
+}
+
+#endif
+
+
+/* convert 's' into 'p' to upper case ('upper' true) or to lower case */
+static void changecase (char *p, const char *s, size_t l, int upper) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  if (l >= CASEMINVECTOR) {
+    int usual = -1;  /* locale not checked yet */
+    int first = upper ? 'a' : 'A';
+    __m128i lo = _mm_set1_epi8((char)(first - 1));
+    __m128i hi = _mm_set1_epi8((char)(first + 26));
+    __m128i flip = _mm_set1_epi8(0x20);
+    for (; i + 16 <= l; i += 16) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+      if (_mm_movemask_epi8(v) == 0 &&  /* only ASCII bytes? */
+          (usual < 0 ? (usual = usualcase(upper)) : usual)) {
+        /* signed comparisons are right, as all bytes are positive */
+        __m128i m = _mm_and_si128(_mm_cmpgt_epi8(v, lo),
+                                  _mm_cmplt_epi8(v, hi));
+        v = _mm_xor_si128(v, _mm_and_si128(m, flip));
+        _mm_storeu_si128((__m128i *)(p + i), v);
+      }
+      else if (upper) {
+        int k;
+        for (k = 0; k < 16; k++) p[i + k] = (char)toupper(uchar(s[i + k]));
+      }
+      else {
+        int k;
+        for (k = 0; k < 16; k++) p[i + k] = (char)tolower(uchar(s[i + k]));
+      }
+    }
+  }
+#endif
+  if (upper)
+    for (; i < l; i++) p[i] = (char)toupper(uchar(s[i]));
+  else
+    for (; i < l; i++) p[i] = (char)tolower(uchar(s[i]));
+}
+
+
+static int str_lower (hydrogen_State *L) {
+  size_t l;
+  hydrogenL_Buffer b;
+  const char *s = hydrogenL_checkbytes(L, 1, &l);
+  char *p = hydrogenL_buffinitsize(L, &b, l);
+  changecase(p, s, l, 0);
+  hydrogenL_pushresultsize(&b, l);
+  return 1;
+}
+
+
+static int str_upper (hydrogen_State *L) {
+  size_t l;
+  hydrogenL_Buffer b;
+  const char *s = hydrogenL_checkbytes(L, 1, &l);
+  char *p = hydrogenL_buffinitsize(L, &b, l);
+  changecase(p, s, l, 1);
+  hydrogenL_pushresultsize(&b, l);
+  return 1;
+}
+
+
+/*
+** 'rep' writes the first copy of the string (and its separator) and
+** then doubles the part already written until it fills the result,
+** so it needs only a logarithmic number of 'memcpy's. (The result is
+** periodic and what is written always ends at a whole period.)
+*/
+static int str_rep (hydrogen_State *L) {
+  size_t l, lsep;
+  const char *s = hydrogenL_checkbytes(L, 1, &l);
+  hydrogen_Integer n = hydrogenL_checkinteger(L, 2);
+  const char *sep = hydrogenL_optlstring(L, 3, "", &lsep);
+  if (n <= 0)
+    hydrogen_pushliteral(L, "");
+  else if (l_unlikely(l + lsep < l || l + lsep > MAXSIZE / n))
+    return hydrogenL_error(L, "resulting string too large");
+  else {
+    size_t totallen = (size_t)n * l + (size_t)(n - 1) * lsep;
+    size_t done;
+    hydrogenL_Buffer b;
+    char *p = hydrogenL_buffinitsize(L, &b, totallen);
+    memcpy(p, s, l * sizeof(char));  /* first copy */
+    done = l;
+    if (n > 1 && lsep > 0) {  /* first separator */
+      memcpy(p + done, sep, lsep * sizeof(char));
+      done += lsep;
+    }
+    if (done > 0) {
+      while (done < totallen) {  /* double what is already there */
+        size_t len = (done <= totallen - done) ? done : totallen - done;
+        memcpy(p + done, p, len * sizeof(char));
+        done += len;
+      }
+    }
+    hydrogenL_pushresultsize(&b, totallen);
+  }
+  return 1;
+}
+
+
+static int str_byte (hydrogen_State *L) {
+  size_t l;
+  const char *s = hydrogenL_checkbytes(L, 1, &l);
+  hydrogen_Integer pi = hydrogenL_optinteger(L, 2, 1);
+  size_t posi = posrelatI(pi, l);
+  size_t pose = getendpos(L, 3, pi, l);
+  int n, i;
+  if (posi > pose) return 0;  /* empty interval; return no values */
+  if (l_unlikely(pose - posi >= (size_t)INT_MAX))  /* arithmetic overflow? */
+    return hydrogenL_error(L, "string slice too long");
+  n = (int)(pose -  posi) + 1;
+  hydrogenL_checkstack(L, n, "string slice too long");
+  for (i=0; i<n; i++)
+    hydrogen_pushinteger(L, uchar(s[posi+i-1]));
+  return n;
+}
+
+
+/*
+** bytes(s [, i [, j]]): the bytes of 's' from 'i' (default 1) to 'j'
+** (default -1) in a new array, written straight into its array part.
+*/
+static int str_bytes (hydrogen_State *L) {
+  size_t l;
+  const char *s = hydrogenL_checkbytes(L, 1, &l);
+  size_t posi = posrelatI(hydrogenL_optinteger(L, 2, 1), l);
+  size_t pose = getendpos(L, 3, -1, l);
+  int n;
+  if (posi > pose) n = 0;  /* empty interval */
+  else if (l_unlikely(pose - posi >= (size_t)INT_MAX))  /* overflow? */
+    return hydrogenL_error(L, "string slice too long");
+  else n = (int)(pose - posi) + 1;
+  hydrogen_createtable(L, n, 0);
+  hydrogenH_setbytes(hvalue(s2v(L->top - 1)), 0, s + posi - 1, cast_uint(n));
+  return 1;
+}
+
+
+static int str_char (hydrogen_State *L) {
+  int n = hydrogen_gettop(L);  /* number of arguments */
+  int i;
+  hydrogenL_Buffer b;
+  char *p = hydrogenL_buffinitsize(L, &b, n);
+  for (i=1; i<=n; i++) {
+    hydrogen_Unsigned c = (hydrogen_Unsigned)hydrogenL_checkinteger(L, i);
+    hydrogenL_argcheck(L, c <= (hydrogen_Unsigned)UCHAR_MAX, i, "value out of range");
+    p[i - 1] = uchar(c);
+  }
+  hydrogenL_pushresultsize(&b, n);
+  return 1;
+}
+
+
+/*
+** Buffer to store the result of 'string.dump'. It must be initialized
+** after the call to 'hydrogen_dump', to ensure that the function is on the
+** top of the stack when 'hydrogen_dump' is called. ('hydrogenL_buffinit' might
+** push stuff.)
+*/
+struct str_Writer {
+  int init;  /* true iff buffer has been initialized */
+  hydrogenL_Buffer B;
+};
+
+
+static int writer (hydrogen_State *L, const void *b, size_t size, void *ud) {
+  struct str_Writer *state = (struct str_Writer *)ud;
+  if (!state->init) {
+    state->init = 1;
+    hydrogenL_buffinit(L, &state->B);
+  }
+  hydrogenL_addlstring(&state->B, (const char *)b, size);
+  return 0;
+}
+
+
+static int str_dump (hydrogen_State *L) {
+  struct str_Writer state;
+  int strip = hydrogen_toboolean(L, 2);
+  hydrogenL_checktype(L, 1, HYDROGEN_TFUNCTION);
+  hydrogen_settop(L, 1);  /* ensure function is on the top of the stack */
+  state.init = 0;
+  if (l_unlikely(hydrogen_dump(L, writer, &state, strip) != 0))
+    return hydrogenL_error(L, "unable to dump given function");
+  hydrogenL_pushresult(&state.B);
+  return 1;
+}
+
+
+
+/*
+** {======================================================
+** METAMETHODS
+** =======================================================
+*/
+
+#if defined(HYDROGEN_NOCVTS2N)	/* { */
+
+/* no coercion from strings to numbers */
+
+static const hydrogenL_Reg stringmetamethods[] = {
+  {"__index", NULL},  /* placeholder */
+  {NULL, NULL}
+};
+
+#else		/* }{ */
+
+static int tonum (hydrogen_State *L, int arg) {
+  if (hydrogen_type(L, arg) == HYDROGEN_TNUMBER) {  /* already a number? */
+    hydrogen_pushvalue(L, arg);
+    return 1;
+  }
+  else {  /* check whether it is a numerical string */
+    size_t len;
+    const char *s = hydrogen_tolstring(L, arg, &len);
+    return (s != NULL && hydrogen_stringtonumber(L, s) == len + 1);
+  }
+}
+
+
+static void trymt (hydrogen_State *L, const char *mtname) {
+  hydrogen_settop(L, 2);  /* back to the original arguments */
+  if (l_unlikely(hydrogen_type(L, 2) == HYDROGEN_TSTRING ||
+                 !hydrogenL_getmetafield(L, 2, mtname)))
+    hydrogenL_error(L, "attempt to %s a '%s' with a '%s'", mtname + 2,
+                  hydrogenL_typename(L, -2), hydrogenL_typename(L, -1));
+  hydrogen_insert(L, -3);  /* put metamethod before arguments */
+  hydrogen_call(L, 2, 1);  /* call metamethod */
+}
+
+
+static int arith (hydrogen_State *L, int op, const char *mtname) {
+  if (tonum(L, 1) && tonum(L, 2))
+    hydrogen_arith(L, op);  /* result will be on the top */
+  else
+    trymt(L, mtname);
+  return 1;
+}
+
+
+static int arith_add (hydrogen_State *L) {
+  return arith(L, HYDROGEN_OPADD, "__add");
+}
+
+static int arith_sub (hydrogen_State *L) {
+  return arith(L, HYDROGEN_OPSUB, "__sub");
+}
+
+static int arith_mul (hydrogen_State *L) {
+  return arith(L, HYDROGEN_OPMUL, "__mul");
+}
+
+static int arith_mod (hydrogen_State *L) {
+  return arith(L, HYDROGEN_OPMOD, "__mod");
+}
+
+static int arith_pow (hydrogen_State *L) {
+  return arith(L, HYDROGEN_OPPOW, "__pow");
+}
+
+static int arith_div (hydrogen_State *L) {
+  return arith(L, HYDROGEN_OPDIV, "__div");
+}
+
+static int arith_idiv (hydrogen_State *L) {
+  return arith(L, HYDROGEN_OPIDIV, "__idiv");
+}
+
+static int arith_unm (hydrogen_State *L) {
+  return arith(L, HYDROGEN_OPUNM, "__unm");
+}
+
+
+static const hydrogenL_Reg stringmetamethods[] = {
+  {"__add", arith_add},
+  {"__sub", arith_sub},
+  {"__mul", arith_mul},
+  {"__mod", arith_mod},
+  {"__pow", arith_pow},
+  {"__div", arith_div},
+  {"__idiv", arith_idiv},
+  {"__unm", arith_unm},
+  {"__index", NULL},  /* placeholder */
+  {NULL, NULL}
+};
+
+#endif		/* } */
+
+/* }====================================================== */
+
+/*
+** {======================================================
+** PATTERN MATCHING
+** =======================================================
+*/
+
+
+#define CAP_UNFINISHED	(-1)
+#define CAP_POSITION	(-2)
+
+
+/* maximum recursion depth for 'match' */
+#if !defined(MAXCCALLS)
+#define MAXCCALLS	200
+#endif
+
+
+/* number of compiled patterns kept in the per-state cache */
+#if !defined(PATCACHESIZE)
+#define PATCACHESIZE	32
+#endif
+
+
+#define L_ESC		'%'
+#define SPECIALS	"^$*+?.([%-"
+
+
+#define PATTERNHANDLE	"PATTERN*"
+
+
+/*
+** Patterns are compiled into an array of items. Single-character
+** classes ('.', '%a', '[...]', etc.) become a bitmap of the characters
+** they accept, and runs of plain characters become one literal item.
+*/
+
+/* item operations */
+#define PAT_END		0	/* end of pattern */
+#define PAT_LIT		1	/* literal run 'lits[arg..arg+len)' */
+#define PAT_CHAR	2	/* single character 'x' (with a suffix) */
+#define PAT_ANY		3	/* '.' */
+#define PAT_SET		4	/* character set 'sets[arg]' */
+#define PAT_OPEN	5	/* '(' */
+#define PAT_POSITION	6	/* '()' */
+#define PAT_CLOSE	7	/* ')' */
+#define PAT_BALANCE	8	/* '%bxy' */
+#define PAT_FRONTIER	9	/* '%f[set]' (set in 'sets[arg]') */
+#define PAT_BACKREF	10	/* '%x' (x is a digit) */
+#define PAT_ENDANCHOR	11	/* '$' at the end of the pattern */
+#define PAT_ERROR	12	/* malformed rest of the pattern ('paterrors[x]') */
+
+
+/*
+** A malformed pattern is an error only when the matcher reaches the
+** malformed part (as when patterns were interpreted), so it compiles
+** into an item that raises the error. Only 'string.compile' reports it
+** up front.
+*/
+static const char *const paterrors[] = {
+  "malformed pattern (ends with '%')",
+  "malformed pattern (missing ']')",
+  "malformed pattern (missing arguments to '%b')",
+  "missing '[' after '%f' in pattern"
+};
+
+
+/* size of a character-set bitmap */
+#define SETSIZE		(UCHAR_MAX / CHAR_BIT + 1)
+
+#define testset(set,c)	((set)[(c) / CHAR_BIT] & (1u << ((c) % CHAR_BIT)))
+
+
+typedef struct PatItem {
+  unsigned char op;  /* operation */
+  unsigned char rep;  /* suffix ('*', '+', '-', '?' or '\0') */
+  unsigned char x, y;  /* character arguments */
+  size_t arg;  /* offset of literal run or character set */
+  size_t len;  /* length of literal run */
+} PatItem;
+
+
+/*
+** A compiled pattern is a userdata with metatable 'PATTERNHANDLE'.
+** Its items, sets, and literals follow the header in the same block,
+** and its first user value is the pattern source.
+*/
+typedef struct Pattern {
+  size_t nitems;  /* number of items (including the final PAT_END) */
+  int anchor;  /* pattern started with '^' */
+  int plain;  /* pattern has no special characters */
+  const PatItem *first;  /* item that any match must start with (or NULL) */
+  PatItem *items;
+  unsigned char *sets;
+  char *lits;
+} Pattern;
+
+
+/* sizes of the parts of a compiled pattern */
+typedef struct PatSize {
+  size_t nitems;
+  size_t nsets;
+  size_t nlits;
+} PatSize;
+
+
+typedef struct MatchState {
+  const char *src_init;  /* init of source string */
+  const char *src_end;  /* end ('\0') of source string */
+  const unsigned char *sets;  /* character sets of the pattern */
+  const char *lits;  /* literal runs of the pattern */
+  hydrogen_State *L;
+  int srcidx;  /* stack index of source string */
+  int matchdepth;  /* control for recursive depth (to avoid C stack overflow) */
+  unsigned char level;  /* total number of captures (finished or unfinished) */
+  struct {
+    const char *init;
+    ptrdiff_t len;
+  } capture[HYDROGEN_MAXCAPTURES];
+} MatchState;
+
+
+/* recursive function */
+static const char *match (MatchState *ms, const char *s, const PatItem *p);
+
+
+static int check_capture (MatchState *ms, int l) {
+  l -= '1';
+  if (l_unlikely(l < 0 || l >= ms->level ||
+                 ms->capture[l].len == CAP_UNFINISHED))
+    return hydrogenL_error(ms->L, "invalid capture index %%%d", l + 1);
+  return l;
+}
+
+
+static int capture_to_close (MatchState *ms) {
+  int level = ms->level;
+  for (level--; level>=0; level--)
+    if (ms->capture[level].len == CAP_UNFINISHED) return level;
+  return hydrogenL_error(ms->L, "invalid pattern capture");
+}
+
+
+/*
+** Return the end of the class at 'p', or NULL if it is malformed, with
+** the index of its error in 'paterrors' in '*err'.
+*/
+static const char *classend (const char *p, const char *p_end, int *err) {
+  switch (*p++) {
+    case L_ESC: {
+      if (l_unlikely(p == p_end)) {
+        *err = 0;  /* ends with '%' */
+        return NULL;
+      }
+      return p+1;
+    }
+    case '[': {
+      if (*p == '^') p++;
+      do {  /* look for a ']' */
+        if (l_unlikely(p == p_end)) {
+          *err = 1;  /* missing ']' */
+          return NULL;
+        }
+        if (*(p++) == L_ESC && p < p_end)
+          p++;  /* skip escapes (e.g. '%]') */
+      } while (*p != ']');
+      return p+1;
+    }
+    default: {
+      return p;
+    }
+  }
+}
+
+
+static int match_class (int c, int cl) {
+  int res;
+  switch (tolower(cl)) {
+    case 'a' : res = isalpha(c); break;
+    case 'c' : res = iscntrl(c); break;
+    case 'd' : res = isdigit(c); break;
+    case 'g' : res = isgraph(c); break;
+    case 'l' : res = islower(c); break;
+    case 'p' : res = ispunct(c); break;
+    case 's' : res = isspace(c); break;
+    case 'u' : res = isupper(c); break;
+    case 'w' : res = isalnum(c); break;
+    case 'x' : res = isxdigit(c); break;
+    case 'z' : res = (c == 0); break;  /* deprecated option */
+    default: return (cl == c);
+  }
+  return (islower(cl) ? res : !res);
+}
+
+
+static int matchbracketclass (int c, const char *p, const char *ec) {
+  int sig = 1;
+  if (*(p+1) == '^') {
+    sig = 0;
+    p++;  /* skip the '^' */
+  }
+  while (++p < ec) {
+    if (*p == L_ESC) {
+      p++;
+      if (match_class(c, uchar(*p)))
+        return sig;
+    }
+    else if ((*(p+1) == '-') && (p+2 < ec)) {
+      p+=2;
+      if (uchar(*(p-2)) <= c && c <= uchar(*p))
+        return sig;
+    }
+    else if (uchar(*p) == c) return sig;
+  }
+  return !sig;
+}
+
+
+static int classmatch (int c, const char *p, const char *ep) {
+  switch (*p) {
+    case '.': return 1;  /* matches any char */
+    case L_ESC: return match_class(c, uchar(*(p+1)));
+    case '[': return matchbracketclass(c, p, ep-1);
+    default:  return (uchar(*p) == c);
+  }
+}
+
+
+/*
+** Fill 'set' with the characters accepted by the class 'p'..'ep'.
+** Return how many characters it accepts; when there is only one,
+** put it in '*single'.
+*/
+static int buildset (unsigned char *set, const char *p, const char *ep,
+                     int *single) {
+  int c;
+  int n = 0;
+  memset(set, 0, SETSIZE);
+  for (c = 0; c <= UCHAR_MAX; c++) {
+    if (classmatch(c, p, ep)) {
+      set[c / CHAR_BIT] |= uchar(1u << (c % CHAR_BIT));
+      *single = c;
+      n++;
+    }
+  }
+  return n;
+}
+
+
+/*
+** Compile pattern 'p'..'p_end'. With 'pt' NULL, only compute the sizes
+** of the parts of the result into 'sz'; otherwise, fill 'pt' (whose
+** parts must have those sizes). When 'gm' is true, a leading '^' is an
+** ordinary character (as in 'gmatch'), not an anchor.
+*/
+static void compilepattern (const char *p, const char *p_end, int gm,
+                            Pattern *pt, PatSize *sz) {
+  unsigned char set[SETSIZE];
+  int inlit = 0;  /* last item is a literal run that can be extended? */
+  int anchor = (!gm && p < p_end && *p == '^');
+  sz->nitems = sz->nsets = sz->nlits = 0;
+  if (anchor)
+    p++;  /* skip anchor character */
+  for (;;) {
+    PatItem it;
+    it.rep = '\0'; it.x = it.y = 0; it.arg = it.len = 0;
+    if (p == p_end)
+      it.op = PAT_END;
+    else switch (*p) {
+      case '(': {  /* start capture */
+        if (*(p + 1) == ')') {  /* position capture? */
+          it.op = PAT_POSITION; p += 2;
+        }
+        else {
+          it.op = PAT_OPEN; p++;
+        }
+        break;
+      }
+      case ')': {  /* end capture */
+        it.op = PAT_CLOSE; p++;
+        break;
+      }
+      case '$': {
+        if ((p + 1) != p_end)  /* is the '$' the last char in pattern? */
+          goto dflt;  /* no; go to default */
+        it.op = PAT_ENDANCHOR; p++;
+        break;
+      }
+      case L_ESC: {  /* escaped sequences not in the format class[*+?-]? */
+        switch (*(p + 1)) {
+          case 'b': {  /* balanced string? */
+            if (l_unlikely(p + 2 >= p_end - 1)) {
+              it.x = 2;  /* missing arguments to '%b' */
+              goto error;
+            }
+            it.op = PAT_BALANCE;
+            it.x = uchar(*(p + 2)); it.y = uchar(*(p + 3));
+            p += 4;
+            break;
+          }
+          case 'f': {  /* frontier? */
+            const char *ep; int c, err;
+            if (l_unlikely(*(p + 2) != '[')) {
+              it.x = 3;  /* missing '[' after '%f' */
+              goto error;
+            }
+            p += 2;
+            ep = classend(p, p_end, &err);  /* points to what is next */
+            if (l_unlikely(ep == NULL)) {
+              it.x = uchar(err);
+              goto error;
+            }
+            buildset(set, p, ep, &c);
+            it.op = PAT_FRONTIER;
+            it.arg = sz->nsets++ * SETSIZE;
+            if (pt) memcpy(pt->sets + it.arg, set, SETSIZE);
+            p = ep;
+            break;
+          }
+          case '0': case '1': case '2': case '3':
+          case '4': case '5': case '6': case '7':
+          case '8': case '9': {  /* capture results (%0-%9)? */
+            it.op = PAT_BACKREF; it.x = uchar(*(p + 1));
+            p += 2;
+            break;
+          }
+          default: goto dflt;
+        }
+        break;
+      }
+      default: dflt: {  /* pattern class plus optional suffix */
+        int c = 0, n, err;
+        const char *ep = classend(p, p_end, &err);  /* points to optional suffix */
+        if (l_unlikely(ep == NULL)) {
+          it.x = uchar(err);
+          goto error;
+        }
+        n = buildset(set, p, ep, &c);
+        if (ep < p_end &&
+            (*ep == '*' || *ep == '+' || *ep == '-' || *ep == '?'))
+          it.rep = uchar(*ep++);
+        p = ep;
+        if (n == 1 && it.rep == '\0') {  /* a plain character? */
+          if (pt) pt->lits[sz->nlits] = (char)c;
+          if (inlit) {  /* extend current literal run */
+            if (pt) pt->items[sz->nitems - 1].len++;
+            sz->nlits++;
+            continue;
+          }
+          it.op = PAT_LIT; it.arg = sz->nlits++; it.len = 1;
+          if (pt) pt->items[sz->nitems] = it;
+          sz->nitems++;
+          inlit = 1;
+          continue;
+        }
+        else if (n == 1) {
+          it.op = PAT_CHAR; it.x = uchar(c);
+        }
+        else if (n == UCHAR_MAX + 1)
+          it.op = PAT_ANY;
+        else {
+          it.op = PAT_SET;
+          it.arg = sz->nsets++ * SETSIZE;
+          if (pt) memcpy(pt->sets + it.arg, set, SETSIZE);
+        }
+        break;
+      }
+      error: {  /* malformed rest of the pattern (error in 'it.x') */
+        it.op = PAT_ERROR;
+        p = p_end;  /* the matcher cannot go past this item */
+        break;
+      }
+    }
+    if (pt) pt->items[sz->nitems] = it;
+    sz->nitems++;
+    inlit = 0;
+    if (it.op == PAT_END) break;
+  }
+  if (pt) {
+    const PatItem *f = pt->items;
+    pt->anchor = anchor;
+    while (f->op == PAT_OPEN || f->op == PAT_POSITION)
+      f++;  /* captures do not consume characters */
+    if (!anchor && (f->op == PAT_LIT || f->op == PAT_BALANCE ||
+                    ((f->op == PAT_CHAR || f->op == PAT_SET) &&
+                     (f->rep == '\0' || f->rep == '+'))))
+      pt->first = f;  /* a match must start with this item */
+    else
+      pt->first = NULL;
+  }
+}
+
+
+/* check whether pattern has no special characters */
+static int nospecials (const char *p, size_t l) {
+  size_t upto = 0;
+  do {
+    if (strpbrk(p + upto, SPECIALS))
+      return 0;  /* pattern has a special character */
+    upto += strlen(p + upto) + 1;  /* may have more after \0 */
+  } while (upto <= l);
+  return 1;  /* no special chars found */
+}
+
+
+/*
+** Functions that handle compiled patterns have the cache of compiled
+** patterns as their first upvalue and the metatable of compiled
+** patterns as their second one.
+*/
+#define PATCACHE	hydrogen_upvalueindex(1)
+#define PATMETA		hydrogen_upvalueindex(2)
+
+
+/*
+** Return the compiled pattern at index 'arg', or NULL if that value
+** is not a compiled pattern.
+*/
+static Pattern *topattern (hydrogen_State *L, int arg) {
+  Pattern *pt = (Pattern *)hydrogen_touserdata(L, arg);
+  if (pt != NULL && hydrogen_getmetatable(L, arg)) {
+    if (!hydrogen_rawequal(L, -1, PATMETA))
+      pt = NULL;  /* some other userdata */
+    hydrogen_pop(L, 1);
+    return pt;
+  }
+  return NULL;
+}
+
+
+/*
+** Create a compiled pattern (on the top of the stack) from the
+** pattern string at index 'arg'.
+*/
+static Pattern *newpattern (hydrogen_State *L, int arg, int gm) {
+  size_t lp;
+  const char *p;
+  PatSize sz;
+  Pattern *pt;
+  hydrogen_pushvalue(L, arg);
+  p = hydrogen_tolstring(L, -1, &lp);  /* (a copy if 'arg' is a view) */
+  compilepattern(p, p + lp, gm, NULL, &sz);
+  pt = (Pattern *)hydrogen_newuserdatauv(L, sizeof(Pattern) +
+                                    sz.nitems * sizeof(PatItem) +
+                                    sz.nsets * SETSIZE + sz.nlits, 1);
+  pt->nitems = sz.nitems;
+  pt->items = (PatItem *)(pt + 1);
+  pt->sets = (unsigned char *)(pt->items + sz.nitems);
+  pt->lits = (char *)(pt->sets + sz.nsets * SETSIZE);
+  compilepattern(p, p + lp, gm, pt, &sz);
+  pt->plain = nospecials(p, lp);
+  hydrogen_remove(L, -2);  /* remove the terminated string */
+  hydrogen_pushvalue(L, arg);
+  hydrogen_setiuservalue(L, -2, 1);  /* keep the source */
+  hydrogen_pushvalue(L, PATMETA);
+  hydrogen_setmetatable(L, -2);
+  return pt;
+}
+
+
+/*
+** The cache of compiled patterns is a userdata, shared as an upvalue
+** by the pattern-matching functions, whose user values are the
+** compiled patterns. Entries are keyed by the address of the source
+** string, which the compiled pattern keeps alive, and by the meaning
+** of a leading '^'.
+*/
+typedef struct PatCache {
+  const void *key[PATCACHESIZE];
+  Pattern *pat[PATCACHESIZE];
+  unsigned char gm[PATCACHESIZE];
+  unsigned long stamp[PATCACHESIZE];  /* time of last use */
+  unsigned long clock;
+} PatCache;
+
+
+static Pattern *cachedpattern (hydrogen_State *L, int arg, int gm,
+                                                         int keep) {
+  const void *key = hydrogen_topointer(L, arg);
+  PatCache *c = (PatCache *)hydrogen_touserdata(L, PATCACHE);
+  Pattern *pt;
+  int i, slot = 0;
+  for (i = 0; i < PATCACHESIZE; i++) {
+    if (c->key[i] == key && c->gm[i] == gm) {  /* hit? */
+      c->stamp[i] = ++c->clock;
+      if (keep) {
+        hydrogen_getiuservalue(L, PATCACHE, i + 1);
+        hydrogen_replace(L, arg);  /* compiled pattern replaces its source */
+      }
+      return c->pat[i];
+    }
+  }
+  for (i = 1; i < PATCACHESIZE; i++) {  /* find least recently used entry */
+    if (c->stamp[i] < c->stamp[slot])
+      slot = i;
+  }
+  pt = newpattern(L, arg, gm);
+  c->key[slot] = key;
+  c->pat[slot] = pt;
+  c->gm[slot] = uchar(gm);
+  c->stamp[slot] = ++c->clock;
+  hydrogen_pushvalue(L, -1);
+  hydrogen_setiuservalue(L, PATCACHE, slot + 1);
+  hydrogen_replace(L, arg);  /* compiled pattern replaces its source */
+  return pt;
+}
+
+
+/*
+** Empty the cache (when the locale changes, as character classes
+** depend on it).
+*/
+static int flushpatterns (hydrogen_State *L) {
+  PatCache *c = (PatCache *)hydrogen_touserdata(L, PATCACHE);
+  int i;
+  for (i = 0; i < PATCACHESIZE; i++) {
+    hydrogen_pushnil(L);
+    hydrogen_setiuservalue(L, PATCACHE, i + 1);
+  }
+  memset(c, 0, sizeof(PatCache));
+  return 0;
+}
+
+
+/*
+** Get the compiled form of the pattern at index 'arg' (a string or a
+** compiled pattern). With 'keep', the compiled form is left at that
+** index, so that it stays alive; otherwise, a pattern from the cache
+** is alive only while no code runs that could evict it (no memory
+** allocation or calls).
+*/
+static const Pattern *getpattern (hydrogen_State *L, int arg, int gm,
+                                                         int keep) {
+  Pattern *pt = topattern(L, arg);
+  if (pt != NULL) {
+    if (!(gm && pt->anchor))
+      return pt;
+    /* 'gmatch' reads a leading '^' as a plain character */
+    hydrogen_getiuservalue(L, arg, 1);
+    hydrogen_replace(L, arg);
+  }
+  hydrogenL_checkbytes(L, arg, NULL);
+  return cachedpattern(L, arg, gm, keep);
+}
+
+
+static int singlematch (MatchState *ms, const char *s, const PatItem *p) {
+  if (s >= ms->src_end)
+    return 0;
+  else {
+    int c = uchar(*s);
+    switch (p->op) {
+      case PAT_ANY: return 1;
+      case PAT_CHAR: return (p->x == c);
+      default: return testset(ms->sets + p->arg, c);
+    }
+  }
+}
+
+
+static const char *matchbalance (MatchState *ms, const char *s,
+                                   const PatItem *p) {
+  if (s >= ms->src_end || uchar(*s) != p->x) return NULL;
+  else {
+    int b = p->x;
+    int e = p->y;
+    int cont = 1;
+    while (++s < ms->src_end) {
+      if (uchar(*s) == e) {
+        if (--cont == 0) return s+1;
+      }
+      else if (uchar(*s) == b) cont++;
+    }
+  }
+  return NULL;  /* string ends out of balance */
+}
+
+
+static const char *max_expand (MatchState *ms, const char *s,
+                                 const PatItem *p) {
+  ptrdiff_t i = 0;  /* counts maximum expand for item */
+  if (p->op == PAT_ANY)
+    i = ms->src_end - s;
+  else {
+    while (singlematch(ms, s + i, p))
+      i++;
+  }
+  /* keeps trying to match with the maximum repetitions */
+  while (i>=0) {
+    const char *res = match(ms, (s+i), p+1);
+    if (res) return res;
+    i--;  /* else didn't match; reduce 1 repetition to try again */
+  }
+  return NULL;
+}
+
+
+static const char *min_expand (MatchState *ms, const char *s,
+                                 const PatItem *p) {
+  for (;;) {
+    const char *res = match(ms, s, p+1);
+    if (res != NULL)
+      return res;
+    else if (singlematch(ms, s, p))
+      s++;  /* try with one more repetition */
+    else return NULL;
+  }
+}
+
+
+static const char *start_capture (MatchState *ms, const char *s,
+                                    const PatItem *p, int what) {
+  const char *res;
+  int level = ms->level;
+  if (level >= HYDROGEN_MAXCAPTURES) hydrogenL_error(ms->L, "too many captures");
+  ms->capture[level].init = s;
+  ms->capture[level].len = what;
+  ms->level = level+1;
+  if ((res=match(ms, s, p)) == NULL)  /* match failed? */
+    ms->level--;  /* undo capture */
+  return res;
+}
+
+
+static const char *end_capture (MatchState *ms, const char *s,
+                                  const PatItem *p) {
+  int l = capture_to_close(ms);
+  const char *res;
+  ms->capture[l].len = s - ms->capture[l].init;  /* close capture */
+  if ((res = match(ms, s, p)) == NULL)  /* match failed? */
+    ms->capture[l].len = CAP_UNFINISHED;  /* undo capture */
+  return res;
+}
+
+
+static const char *match_capture (MatchState *ms, const char *s, int l) {
+  size_t len;
+  l = check_capture(ms, l);
+  len = ms->capture[l].len;
+  if ((size_t)(ms->src_end-s) >= len &&
+      memcmp(ms->capture[l].init, s, len) == 0)
+    return s+len;
+  else return NULL;
+}
+
+
+static const char *match (MatchState *ms, const char *s, const PatItem *p) {
+  if (l_unlikely(ms->matchdepth-- == 0))
+    hydrogenL_error(ms->L, "pattern too complex");
+  init: /* using goto's to optimize tail recursion */
+  switch (p->op) {
+    case PAT_END: break;  /* end of pattern */
+    case PAT_LIT: {
+      if ((size_t)(ms->src_end - s) >= p->len &&
+          memcmp(s, ms->lits + p->arg, p->len) == 0) {
+        s += p->len; p++; goto init;  /* return match(ms, s + len, p + 1); */
+      }
+      s = NULL;  /* match failed */
+      break;
+    }
+    case PAT_OPEN: {  /* start capture */
+      s = start_capture(ms, s, p + 1, CAP_UNFINISHED);
+      break;
+    }
+    case PAT_POSITION: {  /* position capture */
+      s = start_capture(ms, s, p + 1, CAP_POSITION);
+      break;
+    }
+    case PAT_CLOSE: {  /* end capture */
+      s = end_capture(ms, s, p + 1);
+      break;
+    }
+    case PAT_ENDANCHOR: {
+      s = (s == ms->src_end) ? s : NULL;  /* check end of string */
+      break;
+    }
+    case PAT_BALANCE: {  /* balanced string? */
+      s = matchbalance(ms, s, p);
+      if (s != NULL) {
+        p++; goto init;  /* return match(ms, s, p + 1); */
+      }  /* else fail (s == NULL) */
+      break;
+    }
+    case PAT_FRONTIER: {  /* frontier? */
+      int previous = (s == ms->src_init) ? '\0' : uchar(*(s - 1));
+      int current = (s < ms->src_end) ? uchar(*s) : '\0';
+      const unsigned char *set = ms->sets + p->arg;
+      if (!testset(set, previous) && testset(set, current)) {
+        p++; goto init;  /* return match(ms, s, p + 1); */
+      }
+      s = NULL;  /* match failed */
+      break;
+    }
+    case PAT_BACKREF: {  /* capture results (%0-%9)? */
+      s = match_capture(ms, s, p->x);
+      if (s != NULL) {
+        p++; goto init;  /* return match(ms, s, p + 1) */
+      }
+      break;
+    }
+    case PAT_ERROR: {  /* reached a malformed part of the pattern */
+      hydrogenL_error(ms->L, "%s", paterrors[p->x]);
+      break;
+    }
+    default: {  /* pattern class plus optional suffix */
+      /* does not match at least once? */
+      if (!singlematch(ms, s, p)) {
+        if (p->rep == '*' || p->rep == '?' || p->rep == '-') {  /* accept empty? */
+          p++; goto init;  /* return match(ms, s, p + 1); */
+        }
+        else  /* '+' or no suffix */
+          s = NULL;  /* fail */
+      }
+      else {  /* matched once */
+        switch (p->rep) {  /* handle optional suffix */
+          case '?': {  /* optional */
+            const char *res;
+            if ((res = match(ms, s + 1, p + 1)) != NULL)
+              s = res;
+            else {
+              p++; goto init;  /* else return match(ms, s, p + 1); */
+            }
+            break;
+          }
+          case '+':  /* 1 or more repetitions */
+            s++;  /* 1 match already done */
+            /* FALLTHROUGH */
+          case '*':  /* 0 or more repetitions */
+            s = max_expand(ms, s, p);
+            break;
+          case '-':  /* 0 or more repetitions (minimum) */
+            s = min_expand(ms, s, p);
+            break;
+          default:  /* no suffix */
+            s++; p++; goto init;  /* return match(ms, s + 1, p + 1); */
+        }
+      }
+      break;
+    }
+  }
+  ms->matchdepth++;
+  return s;
+}
+
+
+
+/*
+** Return the start of the maximal suffix of 'n' (with length 'l'),
+** minus 1, for the usual order of characters or, with 'rev', for the
+** reverse order. Its period goes to '*period'.
+*/
+static size_t maxsuffix (const unsigned char *n, size_t l, int rev,
+                         size_t *period) {
+  size_t ip = (size_t)-1;  /* candidate suffix (minus 1) */
+  size_t jp = 0;
+  size_t k = 1;
+  size_t p = 1;
+  while (jp + k < l) {
+    int a = n[ip + k];
+    int b = n[jp + k];
+    if (a == b) {
+      if (k == p) {  /* went through a whole period? */
+        jp += p; k = 1;
+      }
+      else k++;
+    }
+    else if (rev ? a < b : a > b) {  /* suffix at 'jp' is smaller */
+      jp += k; k = 1;
+      p = jp - ip;
+    }
+    else {  /* suffix at 'jp' is larger; it is the new candidate */
+      ip = jp++;
+      k = p = 1;
+    }
+  }
+  *period = p;
+  return ip;
+}
+
+
+/*
+** Two-Way string matching (Crochemore and Perrin): search 's2' (with
+** length 'l2' >= 2) in 's1' in linear time and constant space.
+*/
+static const char *twoway (const char *s1, size_t l1,
+                           const char *s2, size_t l2) {
+  const unsigned char *h = (const unsigned char *)s1;
+  const unsigned char *n = (const unsigned char *)s2;
+  size_t i, k, p, p2, mem, mem0;
+  size_t ms, ms2;
+  if (l2 > l1) return NULL;
+  ms = maxsuffix(n, l2, 0, &p);  /* critical factorization */
+  ms2 = maxsuffix(n, l2, 1, &p2);
+  if (ms2 + 1 > ms + 1) {
+    ms = ms2; p = p2;
+  }
+  if (memcmp(n, n + p, ms + 1) != 0) {  /* needle is not periodic? */
+    mem0 = 0;
+    p = ((ms > l2 - ms - 1) ? ms : l2 - ms - 1) + 1;
+  }
+  else
+    mem0 = l2 - p;  /* prefix known to match after a shift by 'p' */
+  mem = 0;
+  i = 0;
+  while (i <= l1 - l2) {
+    /* compare right half */
+    for (k = (ms + 1 > mem) ? ms + 1 : mem; k < l2 && n[k] == h[i + k]; k++)
+      ;
+    if (k < l2) {
+      i += k - ms;
+      mem = 0;
+      continue;
+    }
+    /* compare left half */
+    for (k = ms + 1; k > mem && n[k - 1] == h[i + k - 1]; k--)
+      ;
+    if (k <= mem)
+      return s1 + i;
+    i += p;
+    mem = mem0;
+  }
+  return NULL;  /* not found */
+}
+
+
+/*
+** 'filterfind' looks for 's2' first at the positions where both its
+** first and last characters match, and checks its other characters
+** only there. When those checks do much more work than the search
+** has advanced (as with "aa...ab" in "aaa...a"), it goes on with
+** 'twoway', so the search stays linear.
+*/
+#define toomuchwork(work,done,l2)	((work) > 4 * (done) + 16 * (l2))
+
+
+#if defined(__SSE2__)
+
+/* index of the lowest bit set in 'm' (which is not zero) */
+#if defined(__GNUC__) && !defined(HYDROGEN_NOBUILTIN)
+#define firstbit(m)	((unsigned int)__builtin_ctz(m))
+#else
+static unsigned int firstbit (unsigned int m) {
+  unsigned int i = 0;
+  while (!(m & 1u)) {
+    m >>= 1;
+    i++;
+  }
+  return i;
+}
+#endif
+
+
+/* test 16 positions at a time */
+static const char *filterfind (const char *s1, size_t l1,
+                               const char *s2, size_t l2) {
+  size_t npos = l1 - l2 + 1;  /* number of positions where 's2' fits */
+  size_t i, work = 0;
+  __m128i first = _mm_set1_epi8(s2[0]);
+  __m128i last = _mm_set1_epi8(s2[l2 - 1]);
+  for (i = 0; i + 16 <= npos; i += 16) {
+    __m128i f = _mm_loadu_si128((const __m128i *)(s1 + i));
+    __m128i l = _mm_loadu_si128((const __m128i *)(s1 + i + l2 - 1));
+    unsigned int m = (unsigned int)_mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(f, first), _mm_cmpeq_epi8(l, last)));
+    while (m != 0) {  /* check each candidate */
+      size_t pos = i + firstbit(m);
+      if (memcmp(s1 + pos + 1, s2 + 1, l2 - 2) == 0)
+        return s1 + pos;
+      work += l2;
+      if (toomuchwork(work, pos, l2))
+        return twoway(s1 + pos + 1, l1 - pos - 1, s2, l2);
+      m &= m - 1;  /* clear lowest bit */
+    }
+  }
+  for (; i < npos; i++) {  /* last (less than 16) positions */
+    if (s1[i] == s2[0] && s1[i + l2 - 1] == s2[l2 - 1] &&
+        memcmp(s1 + i + 1, s2 + 1, l2 - 2) == 0)
+      return s1 + i;
+  }
+  return NULL;  /* not found */
+}
+
+#else
+
+/* find candidates with 'memchr' */
+static const char *filterfind (const char *s1, size_t l1,
+                               const char *s2, size_t l2) {
+  const char *end = s1 + (l1 - l2 + 1);  /* end of positions where 's2' fits */
+  const char *init = s1;
+  size_t work = 0;
+  while ((init = (const char *)memchr(init, *s2, end - init)) != NULL) {
+    if (init[l2 - 1] == s2[l2 - 1]) {
+      if (memcmp(init + 1, s2 + 1, l2 - 2) == 0)
+        return init;
+      work += l2;
+      if (toomuchwork(work, (size_t)(init - s1), l2))
+        return twoway(init + 1, l1 - (init - s1) - 1, s2, l2);
+    }
+    init++;
+  }
+  return NULL;  /* not found */
+}
+
+#endif
+
+
+static const char *lmemfind (const char *s1, size_t l1,
+                               const char *s2, size_t l2) {
+  if (l2 == 0) return s1;  /* empty strings are everywhere */
+  else if (l2 > l1) return NULL;  /* avoids a negative 'l1' */
+  else if (l2 == 1) return (const char *)memchr(s1, *s2, l1);
+  else return filterfind(s1, l1, s2, l2);
+}
+
+
+/*
+** Return the first position from 's' where a match can start, given
+** that it must start with item 'f', or NULL if there is none.
+*/
+static const char *nextcandidate (MatchState *ms, const char *s,
+                                  const PatItem *f) {
+  size_t l = ms->src_end - s;
+  switch (f->op) {
+    case PAT_LIT:
+      return lmemfind(s, l, ms->lits + f->arg, f->len);
+    case PAT_CHAR: case PAT_BALANCE:
+      return (const char *)memchr(s, f->x, l);
+    default: {  /* PAT_SET */
+      const unsigned char *set = ms->sets + f->arg;
+      for (; s < ms->src_end; s++) {
+        if (testset(set, uchar(*s)))
+          return s;
+      }
+      return NULL;
+    }
+  }
+}
+
+
+/*
+** get information about the i-th capture. If there are no captures
+** and 'i==0', return information about the whole match, which
+** is the range 's'..'e'. If the capture is a string, return
+** its length and put its address in '*cap'. If it is an integer
+** (a position), push it on the stack and return CAP_POSITION.
+*/
+static size_t get_onecapture (MatchState *ms, int i, const char *s,
+                              const char *e, const char **cap) {
+  if (i >= ms->level) {
+    if (l_unlikely(i != 0))
+      hydrogenL_error(ms->L, "invalid capture index %%%d", i + 1);
+    *cap = s;
+    return e - s;
+  }
+  else {
+    ptrdiff_t capl = ms->capture[i].len;
+    *cap = ms->capture[i].init;
+    if (l_unlikely(capl == CAP_UNFINISHED))
+      hydrogenL_error(ms->L, "unfinished capture");
+    else if (capl == CAP_POSITION)
+      hydrogen_pushinteger(ms->L, (ms->capture[i].init - ms->src_init) + 1);
+    return capl;
+  }
+}
+
+
+/*
+** Push the i-th capture on the stack (as a substring of the source,
+** so that long captures need no copy).
+*/
+static void push_onecapture (MatchState *ms, int i, const char *s,
+                                                    const char *e) {
+  const char *cap;
+  ptrdiff_t l = get_onecapture(ms, i, s, e, &cap);
+  if (l != CAP_POSITION)
+    hydrogen_pushsubstring(ms->L, ms->srcidx, cap - ms->src_init, l);
+  /* else position was already pushed */
+}
+
+
+static int push_captures (MatchState *ms, const char *s, const char *e) {
+  int i;
+  int nlevels = (ms->level == 0 && s) ? 1 : ms->level;
+  hydrogenL_checkstack(ms->L, nlevels, "too many captures");
+  for (i = 0; i < nlevels; i++)
+    push_onecapture(ms, i, s, e);
+  return nlevels;  /* number of strings pushed */
+}
+
+
+/*
+** If the search with the pattern at index 'arg' can be done as a
+** plain search, return the pattern string (and its length in '*lp').
+*/
+static const char *plainpattern (hydrogen_State *L, int arg, int plain,
+                                 size_t *lp) {
+  const char *p;
+  Pattern *pt = topattern(L, arg);
+  if (pt != NULL) {
+    if (!plain && !pt->plain)
+      return NULL;
+    hydrogen_getiuservalue(L, arg, 1);  /* search for its source */
+    hydrogen_replace(L, arg);
+  }
+  p = hydrogenL_checkbytes(L, arg, lp);
+  return (plain || nospecials(p, *lp)) ? p : NULL;
+}
+
+
+static void prepstate (MatchState *ms, hydrogen_State *L, int srcidx,
+                       const char *s, size_t ls, const Pattern *pt) {
+  ms->L = L;
+  ms->srcidx = srcidx;
+  ms->matchdepth = MAXCCALLS;
+  ms->src_init = s;
+  ms->src_end = s + ls;
+  ms->sets = pt->sets;
+  ms->lits = pt->lits;
+}
+
+
+static void reprepstate (MatchState *ms) {
+  ms->level = 0;
+  hydrogen_assert(ms->matchdepth == MAXCCALLS);
+}
+
+
+/*
+** Subject and pattern are arguments 'sarg' and '3 - sarg' (the
+** methods of compiled patterns take the pattern first).
+*/
+static int str_find_aux (hydrogen_State *L, int find, int sarg) {
+  size_t ls, lp;
+  const char *s = hydrogenL_checkbytes(L, sarg, &ls);
+  const char *p;
+  size_t init = posrelatI(hydrogenL_optinteger(L, 3, 1), ls) - 1;
+  if (init > ls) {  /* start after string's end? */
+    hydrogenL_pushfail(L);  /* cannot find anything */
+    return 1;
+  }
+  /* explicit request or no special characters? */
+  if (find && (p = plainpattern(L, 3 - sarg, hydrogen_toboolean(L, 4), &lp))) {
+    /* do a plain search */
+    const char *s2 = lmemfind(s + init, ls - init, p, lp);
+    if (s2) {
+      hydrogen_pushinteger(L, (s2 - s) + 1);
+      hydrogen_pushinteger(L, (s2 - s) + lp);
+      return 2;
+    }
+  }
+  else {
+    MatchState ms;
+    const char *s1 = s + init;
+    /* the match allocates nothing until the pattern is no longer used */
+    const Pattern *pt = getpattern(L, 3 - sarg, 0, 0);
+    prepstate(&ms, L, sarg, s, ls, pt);
+    do {
+      const char *res;
+      if (pt->first && (s1 = nextcandidate(&ms, s1, pt->first)) == NULL)
+        break;  /* no more places where a match can start */
+      reprepstate(&ms);
+      if ((res=match(&ms, s1, pt->items)) != NULL) {
+        if (find) {
+          hydrogen_pushinteger(L, (s1 - s) + 1);  /* start */
+          hydrogen_pushinteger(L, res - s);   /* end */
+          return push_captures(&ms, NULL, 0) + 2;
+        }
+        else
+          return push_captures(&ms, s1, res);
+      }
+    } while (s1++ < ms.src_end && !pt->anchor);
+  }
+  hydrogenL_pushfail(L);  /* not found */
+  return 1;
+}
+
+
+static int str_find (hydrogen_State *L) {
+  return str_find_aux(L, 1, 1);
+}
+
+
+static int str_match (hydrogen_State *L) {
+  return str_find_aux(L, 0, 1);
+}
+
+
+/* state for 'gmatch' */
+typedef struct GMatchState {
+  const char *src;  /* current position */
+  const Pattern *pt;  /* pattern */
+  const char *lastmatch;  /* end of last match */
+  MatchState ms;  /* match state */
+} GMatchState;
+
+
+static int gmatch_aux (hydrogen_State *L) {
+  GMatchState *gm = (GMatchState *)hydrogen_touserdata(L, hydrogen_upvalueindex(3));
+  const PatItem *first = gm->pt->first;
+  const char *src;
+  gm->ms.L = L;
+  for (src = gm->src; src <= gm->ms.src_end; src++) {
+    const char *e;
+    if (first && (src = nextcandidate(&gm->ms, src, first)) == NULL)
+      break;  /* no more places where a match can start */
+    reprepstate(&gm->ms);
+    if ((e = match(&gm->ms, src, gm->pt->items)) != NULL &&
+        e != gm->lastmatch) {
+      gm->src = gm->lastmatch = e;
+      return push_captures(&gm->ms, src, e);
+    }
+  }
+  return 0;  /* not found */
+}
+
+
+static int creategmatch (hydrogen_State *L, int sarg) {
+  size_t ls;
+  const char *s = hydrogenL_checkbytes(L, sarg, &ls);
+  const Pattern *pt = getpattern(L, 3 - sarg, 1, 1);
+  size_t init = posrelatI(hydrogenL_optinteger(L, 3, 1), ls) - 1;
+  GMatchState *gm;
+  hydrogen_settop(L, 2);  /* keep subject and pattern on closure */
+  gm = (GMatchState *)hydrogen_newuserdatauv(L, sizeof(GMatchState), 0);
+  if (init > ls)  /* start after string's end? */
+    init = ls + 1;  /* avoid overflows in 's + init' */
+  prepstate(&gm->ms, L, hydrogen_upvalueindex(sarg), s, ls, pt);
+  gm->src = s + init; gm->pt = pt; gm->lastmatch = NULL;
+  hydrogen_pushcclosure(L, gmatch_aux, 3);
+  return 1;
+}
+
+
+static int gmatch (hydrogen_State *L) {
+  return creategmatch(L, 1);
+}
+
+
+static void add_s (MatchState *ms, hydrogenL_Buffer *b, const char *s,
+                                                   const char *e) {
+  size_t l;
+  hydrogen_State *L = ms->L;
+  const char *news = hydrogen_tolstring(L, 3, &l);
+  const char *p;
+  while ((p = (char *)memchr(news, L_ESC, l)) != NULL) {
+    hydrogenL_addlstring(b, news, p - news);
+    p++;  /* skip ESC */
+    if (*p == L_ESC)  /* '%%' */
+      hydrogenL_addchar(b, *p);
+    else if (*p == '0')  /* '%0' */
+        hydrogenL_addlstring(b, s, e - s);
+    else if (isdigit(uchar(*p))) {  /* '%n' */
+      const char *cap;
+      ptrdiff_t resl = get_onecapture(ms, *p - '1', s, e, &cap);
+      if (resl == CAP_POSITION)
+        hydrogenL_addvalue(b);  /* add position to accumulated result */
+      else
+        hydrogenL_addlstring(b, cap, resl);
+    }
+    else
+      hydrogenL_error(L, "invalid use of '%c' in replacement string", L_ESC);
+    l -= p + 1 - news;
+    news = p + 1;
+  }
+  hydrogenL_addlstring(b, news, l);
+}
+
+
+/*
+** Add the replacement value to the string buffer 'b'.
+** Return true if the original string was changed. (Function calls and
+** table indexing resulting in nil or false do not change the subject.)
+*/
+static int add_value (MatchState *ms, hydrogenL_Buffer *b, const char *s,
+                                      const char *e, int tr) {
+  hydrogen_State *L = ms->L;
+  switch (tr) {
+    case HYDROGEN_TFUNCTION: {  /* call the function */
+      int n;
+      hydrogen_pushvalue(L, 3);  /* push the function */
+      n = push_captures(ms, s, e);  /* all captures as arguments */
+      hydrogen_call(L, n, 1);  /* call it */
+      break;
+    }
+    case HYDROGEN_TTABLE: {  /* index the table */
+      push_onecapture(ms, 0, s, e);  /* first capture is the index */
+      hydrogen_gettable(L, 3);
+      break;
+    }
+    default: {  /* HYDROGEN_TNUMBER or HYDROGEN_TSTRING */
+      add_s(ms, b, s, e);  /* add value to the buffer */
+      return 1;  /* something changed */
+    }
+  }
+  if (!hydrogen_toboolean(L, -1)) {  /* nil or false? */
+    hydrogen_pop(L, 1);  /* remove value */
+    hydrogenL_addlstring(b, s, e - s);  /* keep original text */
+    return 0;  /* no changes */
+  }
+  else if (l_unlikely(!hydrogen_isstring(L, -1)))
+    return hydrogenL_error(L, "invalid replacement value (a %s)",
+                         hydrogenL_typename(L, -1));
+  else {
+    hydrogenL_addvalue(b);  /* add result to accumulator */
+    return 1;  /* something changed */
+  }
+}
+
+
+static int str_gsub_aux (hydrogen_State *L, int sarg) {
+  size_t srcl;
+  const char *src = hydrogenL_checkbytes(L, sarg, &srcl);  /* subject */
+  const Pattern *pt = getpattern(L, 3 - sarg, 0, 1);  /* pattern */
+  const char *lastmatch = NULL;  /* end of last match */
+  int tr = hydrogen_type(L, 3);  /* replacement type */
+  hydrogen_Integer max_s = hydrogenL_optinteger(L, 4, srcl + 1);  /* max replacements */
+  hydrogen_Integer n = 0;  /* replacement count */
+  int changed = 0;  /* change flag */
+  MatchState ms;
+  hydrogenL_Buffer b;
+  hydrogenL_argexpected(L, tr == HYDROGEN_TNUMBER || tr == HYDROGEN_TSTRING ||
+                   tr == HYDROGEN_TFUNCTION || tr == HYDROGEN_TTABLE, 3,
+                      "string/function/table");
+  hydrogenL_buffinit(L, &b);
+  prepstate(&ms, L, sarg, src, srcl, pt);
+  while (n < max_s) {
+    const char *e;
+    if (pt->first) {  /* skip to the next place where a match can start */
+      const char *c = nextcandidate(&ms, src, pt->first);
+      if (c == NULL) break;  /* no more matches */
+      hydrogenL_addlstring(&b, src, c - src);
+      src = c;
+    }
+    reprepstate(&ms);  /* (re)prepare state for new match */
+    if ((e = match(&ms, src, pt->items)) != NULL && e != lastmatch) {  /* match? */
+      n++;
+      changed = add_value(&ms, &b, src, e, tr) | changed;
+      src = lastmatch = e;
+    }
+    else if (src < ms.src_end)  /* otherwise, skip one character */
+      hydrogenL_addchar(&b, *src++);
+    else break;  /* end of subject */
+    if (pt->anchor) break;
+  }
+  if (!changed)  /* no changes? */
+    hydrogen_pushvalue(L, sarg);  /* return original string */
+  else {  /* something changed */
+    hydrogenL_addlstring(&b, src, ms.src_end-src);
+    hydrogenL_pushresult(&b);  /* create and return new string */
+  }
+  hydrogen_pushinteger(L, n);  /* number of substitutions */
+  return 2;
+}
+
+
+static int str_gsub (hydrogen_State *L) {
+  return str_gsub_aux(L, 1);
+}
+
+
+/*
+** {======================================================
+** Compiled patterns
+** =======================================================
+*/
+
+
+static int str_compile (hydrogen_State *L) {
+  if (topattern(L, 1) == NULL) {
+    Pattern *pt;
+    hydrogenL_checkbytes(L, 1, NULL);
+    pt = newpattern(L, 1, 0);
+    if (pt->nitems > 1) {  /* an error item comes just before PAT_END */
+      const PatItem *it = &pt->items[pt->nitems - 2];
+      if (l_unlikely(it->op == PAT_ERROR))  /* report it up front */
+        return hydrogenL_error(L, "%s", paterrors[it->x]);
+    }
+  }
+  else
+    hydrogen_settop(L, 1);  /* already compiled */
+  return 1;
+}
+
+
+static void checkpattern (hydrogen_State *L) {
+  if (l_unlikely(topattern(L, 1) == NULL))
+    hydrogenL_typeerror(L, 1, PATTERNHANDLE);
+}
+
+
+static int pat_find (hydrogen_State *L) {
+  checkpattern(L);
+  return str_find_aux(L, 1, 2);
+}
+
+
+static int pat_match (hydrogen_State *L) {
+  checkpattern(L);
+  return str_find_aux(L, 0, 2);
+}
+
+
+static int pat_gmatch (hydrogen_State *L) {
+  checkpattern(L);
+  return creategmatch(L, 2);
+}
+
+
+static int pat_gsub (hydrogen_State *L) {
+  checkpattern(L);
+  return str_gsub_aux(L, 2);
+}
+
+
+static int pat_tostring (hydrogen_State *L) {
+  hydrogenL_checkudata(L, 1, PATTERNHANDLE);
+  hydrogen_getiuservalue(L, 1, 1);
+  return 1;
+}
+
+
+/*
+** methods for compiled patterns
+*/
+static const hydrogenL_Reg patmeth[] = {
+  {"find", pat_find},
+  {"match", pat_match},
+  {"gmatch", pat_gmatch},
+  {"gsub", pat_gsub},
+  {NULL, NULL}
+};
+
+
+/*
+** metamethods for compiled patterns
+*/
+static const hydrogenL_Reg patmetameth[] = {
+  {"__index", NULL},  /* place holder */
+  {"__tostring", pat_tostring},
+  {NULL, NULL}
+};
+
+
+/*
+** functions for pattern matching (see 'PATCACHE' and 'PATMETA')
+*/
+static const hydrogenL_Reg patlib[] = {
+  {"compile", str_compile},
+  {"find", str_find},
+  {"gmatch", gmatch},
+  {"gsub", str_gsub},
+  {"match", str_match},
+  {NULL, NULL}
+};
+
+
+/*
+** Add the pattern-matching functions to the string library (on the
+** top of the stack) and create the metatable for compiled patterns.
+*/
+static void createpatmeta (hydrogen_State *L) {
+  PatCache *c = (PatCache *)hydrogen_newuserdatauv(L, sizeof(PatCache),
+                                                  PATCACHESIZE);
+  memset(c, 0, sizeof(PatCache));
+  hydrogen_pushvalue(L, -1);
+  hydrogen_pushcclosure(L, flushpatterns, 1);
+  hydrogen_setfield(L, HYDROGEN_REGISTRYINDEX, HYDROGEN_PATCACHE_KEY);
+  hydrogenL_newmetatable(L, PATTERNHANDLE);  /* metatable for patterns */
+  hydrogenL_setfuncs(L, patmetameth, 0);  /* add metamethods to new metatable */
+  hydrogenL_newlibtable(L, patmeth);  /* create method table */
+  hydrogen_pushvalue(L, -3);  /* cache */
+  hydrogen_pushvalue(L, -3);  /* metatable */
+  hydrogenL_setfuncs(L, patmeth, 2);  /* add pattern methods to method table */
+  hydrogen_setfield(L, -2, "__index");  /* metatable.__index = method table */
+  hydrogenL_setfuncs(L, patlib, 2);  /* add functions to string library */
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** STRING FORMAT
+** =======================================================
+*/
+
+#if !defined(hydrogen_number2strx)	/* { */
+
+/*
+** Hexadecimal floating-point formatter
+*/
+
+#define SIZELENMOD	(sizeof(HYDROGEN_NUMBER_FRMLEN)/sizeof(char))
+
+
+/*
+** Number of bits that Hydrogenes into the first digit. It can be any value
+** between 1 and 4; the following definition tries to align the number
+** to nibble boundaries by making what is left after that first digit a
+** multiple of 4.
+*/
+#define L_NBFD		((l_floatatt(MANT_DIG) - 1)%4 + 1)
+
+
+/*
+** Add integer part of 'x' to buffer and return new 'x'
+*/
+static hydrogen_Number adddigit (char *buff, int n, hydrogen_Number x) {
+  hydrogen_Number dd = l_mathop(floor)(x);  /* get integer part from 'x' */
+  int d = (int)dd;
+  buff[n] = (d < 10 ? d + '0' : d - 10 + 'a');  /* add to buffer */
+  return x - dd;  /* return what is left */
+}
+
+
+static int num2straux (char *buff, int sz, hydrogen_Number x) {
+  /* if 'inf' or 'NaN', format it like '%g' */
+  if (x != x || x == (hydrogen_Number)HUGE_VAL || x == -(hydrogen_Number)HUGE_VAL)
+    return l_sprintf(buff, sz, HYDROGEN_NUMBER_FMT, (HYDROGENI_UACNUMBER)x);
+  else if (x == 0) {  /* can be -0... */
+    /* create "0" or "-0" followed by exponent */
+    return l_sprintf(buff, sz, HYDROGEN_NUMBER_FMT "x0p+0", (HYDROGENI_UACNUMBER)x);
+  }
+  else {
+    int e;
+    hydrogen_Number m = l_mathop(frexp)(x, &e);  /* 'x' fraction and exponent */
+    int n = 0;  /* character count */
+    if (m < 0) {  /* is number negative? */
+      buff[n++] = '-';  /* add sign */
+      m = -m;  /* make it positive */
+    }
+    buff[n++] = '0'; buff[n++] = 'x';  /* add "0x" */
+    m = adddigit(buff, n++, m * (1 << L_NBFD));  /* add first digit */
+    e -= L_NBFD;  /* this digit Hydrogenes before the radix point */
+    if (m > 0) {  /* more digits? */
+      buff[n++] = hydrogen_getlocaledecpoint();  /* add radix point */
+      do {  /* add as many digits as needed */
+        m = adddigit(buff, n++, m * 16);
+      } while (m > 0);
+    }
+    n += l_sprintf(buff + n, sz - n, "p%+d", e);  /* add exponent */
+    hydrogen_assert(n < sz);
+    return n;
+  }
+}
+
+
+static int hydrogen_number2strx (hydrogen_State *L, char *buff, int sz,
+                            const char *fmt, hydrogen_Number x) {
+  int n = num2straux(buff, sz, x);
+  if (fmt[SIZELENMOD] == 'A') {
+    int i;
+    for (i = 0; i < n; i++)
+      buff[i] = toupper(uchar(buff[i]));
+  }
+  else if (l_unlikely(fmt[SIZELENMOD] != 'a'))
+    return hydrogenL_error(L, "modifiers for format '%%a'/'%%A' not implemented");
+  return n;
+}
+
+#endif				/* } */
+
+
+/*
+** Maximum size for items formatted with '%f'. This size is produced
+** by format('%.99f', -maxfloat), and is equal to 99 + 3 ('-', '.',
+** and '\0') + number of decimal digits to represent maxfloat (which
+** is maximum exponent + 1). (99+3+1, adding some extra, 110)
+*/
+#define MAX_ITEMF	(110 + l_floatatt(MAX_10_EXP))
+
+
+/*
+** All formats except '%f' do not need that large limit.  The other
+** float formats use exponents, so that they fit in the 99 limit for
+** significant digits; 's' for large strings and 'q' add items directly
+** to the buffer; all integer formats also fit in the 99 limit.  The
+** worst case are floats: they may need 99 significant digits, plus
+** '0x', '-', '.', 'e+XXXX', and '\0'. Adding some extra, 120.
+*/
+#define MAX_ITEM	120
+
+
+/* valid flags in a format specification */
+#if !defined(L_FMTFLAGSF)
+
+/* valid flags for a, A, e, E, f, F, g, and G conversions */
+#define L_FMTFLAGSF	"-+#0 "
+
+/* valid flags for o, x, and X conversions */
+#define L_FMTFLAGSX	"-#0"
+
+/* valid flags for d and i conversions */
+#define L_FMTFLAGSI	"-+0 "
+
+/* valid flags for u conversions */
+#define L_FMTFLAGSU	"-0"
+
+/* valid flags for c, p, and s conversions */
+#define L_FMTFLAGSC	"-"
+
+#endif
+
+
+/*
+** Maximum size of each format specification (such as "%-099.99d"):
+** Initial '%', flags (up to 5), width (2), period, precision (2),
+** length modifier (8), conversion specifier, and final '\0', plus some
+** extra.
+*/
+#define MAX_FORMAT	32
+
+
+static void addquoted (hydrogenL_Buffer *b, const char *s, size_t len) {
+  hydrogenL_addchar(b, '"');
+  while (len--) {
+    if (*s == '"' || *s == '\\' || *s == '\n') {
+      hydrogenL_addchar(b, '\\');
+      hydrogenL_addchar(b, *s);
+    }
+    else if (iscntrl(uchar(*s))) {
+      char buff[10];
+      if (!isdigit(uchar(*(s+1))))
+        l_sprintf(buff, sizeof(buff), "\\%d", (int)uchar(*s));
+      else
+        l_sprintf(buff, sizeof(buff), "\\%03d", (int)uchar(*s));
+      hydrogenL_addstring(b, buff);
+    }
+    else
+      hydrogenL_addchar(b, *s);
+    s++;
+  }
+  hydrogenL_addchar(b, '"');
+}
+
+
+/*
+** Serialize a floating-point number in such a way that it can be
+** scanned back by Hydrogen. Use hexadecimal format for "common" numbers
+** (to preserve precision); inf, -inf, and NaN are handled separately.
+** (NaN cannot be expressed as a numeral, so we write '(0/0)' for it.)
+*/
+static int quotefloat (hydrogen_State *L, char *buff, hydrogen_Number n) {
+  const char *s;  /* for the fixed representations */
+  if (n == (hydrogen_Number)HUGE_VAL)  /* inf? */
+    s = "1e9999";
+  else if (n == -(hydrogen_Number)HUGE_VAL)  /* -inf? */
+    s = "-1e9999";
+  else if (n != n)  /* NaN? */
+    s = "(0/0)";
+  else {  /* format number as hexadecimal */
+    int  nb = hydrogen_number2strx(L, buff, MAX_ITEM,
+                                 "%" HYDROGEN_NUMBER_FRMLEN "a", n);
+    /* ensures that 'buff' string uses a dot as the radix character */
+    if (memchr(buff, '.', nb) == NULL) {  /* no dot? */
+      char point = hydrogen_getlocaledecpoint();  /* try locale point */
+      char *ppoint = (char *)memchr(buff, point, nb);
+      if (ppoint) *ppoint = '.';  /* change it to a dot */
+    }
+    return nb;
+  }
+  /* for the fixed representations */
+  return l_sprintf(buff, MAX_ITEM, "%s", s);
+}
+
+
+static void addliteral (hydrogen_State *L, hydrogenL_Buffer *b, int arg) {
+  switch (hydrogen_type(L, arg)) {
+    case HYDROGEN_TSTRING: {
+      size_t len;
+      const char *s = hydrogen_tobytes(L, arg, &len);
+      addquoted(b, s, len);
+      break;
+    }
+    case HYDROGEN_TNUMBER: {
+      char *buff = hydrogenL_prepbuffsize(b, MAX_ITEM);
+      int nb;
+      if (!hydrogen_isinteger(L, arg))  /* float? */
+        nb = quotefloat(L, buff, hydrogen_tonumber(L, arg));
+      else {  /* integers */
+        hydrogen_Integer n = hydrogen_tointeger(L, arg);
+        const char *format = (n == HYDROGEN_MININTEGER)  /* corner case? */
+                           ? "0x%" HYDROGEN_INTEGER_FRMLEN "x"  /* use hex */
+                           : HYDROGEN_INTEGER_FMT;  /* else use default format */
+        nb = l_sprintf(buff, MAX_ITEM, format, (HYDROGENI_UACINT)n);
+      }
+      hydrogenL_addsize(b, nb);
+      break;
+    }
+    case HYDROGEN_TNIL: case HYDROGEN_TBOOLEAN: {
+      hydrogenL_tolstring(L, arg, NULL);
+      hydrogenL_addvalue(b);
+      break;
+    }
+    default: {
+      hydrogenL_argerror(L, arg, "value has no literal form");
+    }
+  }
+}
+
+
+static const char *get2digits (const char *s) {
+  if (isdigit(uchar(*s))) {
+    s++;
+    if (isdigit(uchar(*s))) s++;  /* (2 digits at most) */
+  }
+  return s;
+}
+
+
+/*
+** Check whether a conversion specification is valid. When called,
+** first character in 'form' must be '%' and last character must
+** be a valid conversion specifier. 'flags' are the accepted flags;
+** 'precision' signals whether to accept a precision.
+*/
+static int validformat (const char *form, const char *flags, int precision) {
+  const char *spec = form + 1;  /* skip '%' */
+  spec += strspn(spec, flags);  /* skip flags */
+  if (*spec != '0') {  /* a width cannot start with '0' */
+    spec = get2digits(spec);  /* skip width */
+    if (*spec == '.' && precision) {
+      spec++;
+      spec = get2digits(spec);  /* skip precision */
+    }
+  }
+  return isalpha(uchar(*spec));  /* did it get to the end? */
+}
+
+
+/*
+** add length modifier into formats
+*/
+static void addlenmod (char *form, const char *lenmod) {
+  size_t l = strlen(form);
+  size_t lm = strlen(lenmod);
+  char spec = form[l - 1];
+  strcpy(form + l - 1, lenmod);
+  form[l + lm - 1] = spec;
+  form[l + lm] = '\0';
+}
+
+
+/*
+** Add to buffer 'b' the contents of the string buffer at 'arg', which
+** may be the one under 'b': its contents are fetched only after 'b'
+** has room for them.
+*/
+static void addstrbuf (hydrogenL_Buffer *b, int arg, size_t l) {
+  char *p = hydrogenL_prepbuffsize(b, l);
+  memcpy(p, hydrogenL_tostrbuf(b->L, arg, NULL), l * sizeof(char));
+  hydrogenL_addsize(b, l);
+}
+
+
+/* number of parsed formats kept in the per-state cache */
+#if !defined(FMTCACHESIZE)
+#define FMTCACHESIZE	32
+#endif
+
+
+#define FORMATHANDLE	"FORMAT*"
+
+
+/*
+** Format strings are parsed into a list of items: runs of literal
+** text and conversions. The most common conversions get their own
+** kinds, formatted without 'snprintf'; the others keep the format
+** for 'snprintf' ('form', with the length modifier already added).
+** An invalid conversion becomes an item that raises its error when
+** reached, so that errors come in the same order as values.
+*/
+
+/* kinds of format items */
+#define FMT_LIT		0	/* literal run 'lits[off..off+len)' */
+#define FMT_GENERIC	1	/* conversion done by 'snprintf' */
+#define FMT_INT		2	/* '%d' or '%i' */
+#define FMT_HEX		3	/* '%x' */
+#define FMT_HEXUP	4	/* '%X' */
+#define FMT_STR		5	/* '%s' */
+#define FMT_FIXED	6	/* '%.Nf' (with N in 'aux') */
+#define FMT_QUOTED	7	/* '%q' */
+#define FMT_BAD		8	/* invalid conversion (error in 'aux') */
+
+/* errors for invalid conversions */
+#define FMT_ETOOLONG	0
+#define FMT_ESPEC	1
+#define FMT_ECONV	2
+#define FMT_EQUOTED	3
+
+
+/* maximum precision handled by 'FMT_FIXED' */
+#define FMT_MAXFIXED	15
+
+
+typedef struct FmtItem {
+  unsigned char kind;
+  unsigned char aux;  /* precision for FMT_FIXED, error for FMT_BAD */
+  char conv;  /* conversion specifier */
+  size_t off, len;  /* literal run */
+  char form[MAX_FORMAT];  /* format for 'snprintf' */
+} FmtItem;
+
+
+/*
+** A parsed format is a userdata with metatable 'FORMATHANDLE'. Its
+** items and a copy of the format string (for the literal runs) follow
+** the header in the same block, and its first user value is the format
+** string.
+*/
+typedef struct Format {
+  int nitems;
+  FmtItem *items;
+  char *lits;
+} Format;
+
+
+/*
+** Fill item 'it' (when not NULL) for the conversion specification
+** after the '%' at 'strfrmt', returning the position after it. After
+** an invalid one, '*stop' is set, as nothing after it can run.
+*/
+static const char *parseconv (const char *strfrmt, FmtItem *it, int *stop) {
+  FmtItem dummy;
+  const char *flags = NULL;
+  char *form;
+  /* spans flags, width, and precision ('0' is included as a flag) */
+  size_t len = strspn(strfrmt, L_FMTFLAGSF "123456789.");
+  len++;  /* adds following character (should be the specifier) */
+  if (it == NULL) it = &dummy;
+  form = it->form;
+  it->kind = FMT_GENERIC;
+  it->aux = 0;
+  /* still needs space for '%', '\0', plus a length modifier */
+  if (len >= MAX_FORMAT - 10) {
+    it->kind = FMT_BAD;
+    it->aux = FMT_ETOOLONG;
+    *stop = 1;
+    return strfrmt;
+  }
+  *(form++) = '%';
+  memcpy(form, strfrmt, len * sizeof(char));
+  *(form + len) = '\0';
+  form = it->form;
+  it->conv = strfrmt[len - 1];
+  switch (it->conv) {
+    case 'c': case 'p':
+      if (!validformat(form, L_FMTFLAGSC, 0))
+        goto badspec;
+      break;
+    case 'd': case 'i':
+      flags = L_FMTFLAGSI;
+      goto intcase;
+    case 'u':
+      flags = L_FMTFLAGSU;
+      goto intcase;
+    case 'o': case 'x': case 'X':
+      flags = L_FMTFLAGSX;
+     intcase:
+      if (!validformat(form, flags, 1))
+        goto badspec;
+      if (form[2] == '\0' && it->conv != 'u' && it->conv != 'o')
+        it->kind = (it->conv == 'x') ? FMT_HEX
+                 : (it->conv == 'X') ? FMT_HEXUP : FMT_INT;
+      addlenmod(form, HYDROGEN_INTEGER_FRMLEN);
+      break;
+    case 'f':
+      if (form[1] == '.' && len <= 4 &&  /* only a precision? */
+          strspn(form + 2, "0123456789") == len - 2) {
+        int prec = 0;
+        size_t i;
+        for (i = 2; i < len; i++)
+          prec = prec * 10 + (form[i] - '0');
+        if (prec <= FMT_MAXFIXED) {
+          it->kind = FMT_FIXED;
+          it->aux = uchar(prec);
+        }
+      }
+      /* FALLTHROUGH */
+    case 'a': case 'A': case 'e': case 'E': case 'g': case 'G':
+      if (!validformat(form, L_FMTFLAGSF, 1))
+        goto badspec;
+      addlenmod(form, HYDROGEN_NUMBER_FRMLEN);
+      break;
+    case 'q':
+      if (form[2] != '\0') {  /* modifiers? */
+        it->kind = FMT_BAD;
+        it->aux = FMT_EQUOTED;
+        *stop = 1;
+      }
+      else
+        it->kind = FMT_QUOTED;
+      break;
+    case 's':
+      if (form[2] == '\0')  /* no modifiers? */
+        it->kind = FMT_STR;
+      else if (!validformat(form, L_FMTFLAGSC, 1))
+        goto badspec;
+      break;
+    default:  /* also treat cases 'pnLlh' */
+      it->kind = FMT_BAD;
+      it->aux = FMT_ECONV;
+      *stop = 1;
+      break;
+  }
+  return strfrmt + len;
+ badspec:
+  it->kind = FMT_BAD;
+  it->aux = FMT_ESPEC;
+  *stop = 1;
+  return strfrmt + len;
+}
+
+
+/*
+** Parse format 'strfrmt' into 'items' (when not NULL), returning the
+** number of items. ('strfrmt' is a Hydrogen string, so it is safe to
+** look at the character after its last one.)
+*/
+static int parseformat (const char *strfrmt, size_t sfl, FmtItem *items) {
+  const char *p = strfrmt;
+  const char *strfrmt_end = strfrmt + sfl;
+  int n = 0;
+  int stop = 0;
+  while (p < strfrmt_end && !stop) {
+    if (*p == L_ESC && p[1] != L_ESC)  /* conversion? */
+      p = parseconv(p + 1, (items != NULL) ? &items[n] : NULL, &stop);
+    else {  /* literal run, ending before a '%' or including a '%%' */
+      const char *start = p;
+      const char *e;
+      if (*p == L_ESC)  /* '%%'? */
+        e = p + 1;
+      else {
+        e = (const char *)memchr(p, L_ESC, strfrmt_end - p);
+        if (e == NULL) e = strfrmt_end;
+        else if (e[1] == L_ESC) e++;  /* keep one '%' of a '%%' */
+      }
+      p = (*(e - 1) == L_ESC) ? e + 1 : e;  /* skip second '%' of '%%' */
+      if (items != NULL) {
+        items[n].kind = FMT_LIT;
+        items[n].off = start - strfrmt;
+        items[n].len = e - start;
+      }
+    }
+    n++;
+  }
+  return n;
+}
+
+
+#define FMTCACHE	hydrogen_upvalueindex(1)
+
+
+/*
+** The cache of parsed formats is a userdata, shared as an upvalue by
+** the functions that format values, whose user values are the parsed
+** formats. Entries are keyed as in 'PatCache' (without the meaning of
+** a leading '^').
+*/
+typedef struct FmtCache {
+  const void *key[FMTCACHESIZE];
+  Format *fmt[FMTCACHESIZE];
+  unsigned long stamp[FMTCACHESIZE];  /* time of last use */
+  unsigned long clock;
+} FmtCache;
+
+
+/*
+** Create a parsed format (on the top of the stack) from the format
+** string at index 'arg'.
+*/
+static Format *newformat (hydrogen_State *L, int arg) {
+  size_t sfl;
+  const char *strfrmt;
+  int n;
+  Format *f;
+  hydrogen_pushvalue(L, arg);
+  strfrmt = hydrogen_tolstring(L, -1, &sfl);  /* (a copy if 'arg' is a view) */
+  n = parseformat(strfrmt, sfl, NULL);
+  f = (Format *)hydrogen_newuserdatauv(L, sizeof(Format) +
+                                       n * sizeof(FmtItem) + sfl, 1);
+  f->nitems = n;
+  f->items = (FmtItem *)(f + 1);
+  f->lits = (char *)(f->items + n);
+  parseformat(strfrmt, sfl, f->items);
+  memcpy(f->lits, strfrmt, sfl * sizeof(char));
+  hydrogen_remove(L, -2);  /* remove the terminated string */
+  hydrogen_pushvalue(L, arg);
+  hydrogen_setiuservalue(L, -2, 1);  /* keep the source */
+  hydrogenL_setmetatable(L, FORMATHANDLE);
+  return f;
+}
+
+
+/*
+** Get the parsed form of the format string at index 'arg', through
+** the cache. The parsed format replaces the string at that index, so
+** that it stays alive while the values are formatted (which may run
+** metamethods that use the cache).
+*/
+static const Format *checkfmt (hydrogen_State *L, int arg) {
+  FmtCache *c = (FmtCache *)hydrogen_touserdata(L, FMTCACHE);
+  const void *key;
+  Format *f;
+  int i, slot = 0;
+  hydrogenL_checkbytes(L, arg, NULL);
+  key = hydrogen_topointer(L, arg);
+  for (i = 0; i < FMTCACHESIZE; i++) {
+    if (c->key[i] == key) {  /* hit? */
+      c->stamp[i] = ++c->clock;
+      hydrogen_getiuservalue(L, FMTCACHE, i + 1);
+      hydrogen_replace(L, arg);
+      return c->fmt[i];
+    }
+  }
+  for (i = 1; i < FMTCACHESIZE; i++) {  /* find least recently used entry */
+    if (c->stamp[i] < c->stamp[slot])
+      slot = i;
+  }
+  f = newformat(L, arg);
+  c->key[slot] = key;
+  c->fmt[slot] = f;
+  c->stamp[slot] = ++c->clock;
+  hydrogen_pushvalue(L, -1);
+  hydrogen_setiuservalue(L, FMTCACHE, slot + 1);
+  hydrogen_replace(L, arg);
+  return f;
+}
+
+
+/* add to buffer 'b' the decimal numeral for 'n' ('%d') */
+static void addint (hydrogenL_Buffer *b, hydrogen_Integer n) {
+  char buff[MAX_ITEM];
+  char *p = buff + MAX_ITEM;
+  hydrogen_Unsigned u = (hydrogen_Unsigned)n;
+  if (n < 0) u = 0u - u;
+  do {
+    *--p = (char)('0' + u % 10);
+    u /= 10;
+  } while (u != 0);
+  if (n < 0) *--p = '-';
+  hydrogenL_addlstring(b, p, buff + MAX_ITEM - p);
+}
+
+
+/* add to buffer 'b' the hexadecimal numeral for 'n' ('%x' or '%X') */
+static void addhex (hydrogenL_Buffer *b, hydrogen_Integer n,
+                    const char *digits) {
+  char buff[MAX_ITEM];
+  char *p = buff + MAX_ITEM;
+  hydrogen_Unsigned u = (hydrogen_Unsigned)n;
+  do {
+    *--p = digits[u & 0xf];
+    u >>= 4;
+  } while (u != 0);
+  hydrogenL_addlstring(b, p, buff + MAX_ITEM - p);
+}
+
+
+#if !defined(HYDROGEN_USE_C89) && HYDROGEN_FLOAT_TYPE == HYDROGEN_FLOAT_DOUBLE
+
+/*
+** Format 'x' as '%.Nf' (N = 'prec') into 'buff' without 'snprintf'.
+** 'x * 10^N' is rounded to the nearest integer, using 'fma' to get
+** the exact error of that product. Exact ties, whose rounding depends
+** on the C library, and numbers too large are left to 'snprintf'.
+** Returns the length of the result, or 0 if 'x' was not handled.
+*/
+static int fmtfixed (char *buff, double x, int prec) {
+  static const double pow10[FMT_MAXFIXED + 1] = {1e0, 1e1, 1e2, 1e3,
+    1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15};
+  double ax = fabs(x);
+  double y = ax * pow10[prec];
+  double r, d;
+  unsigned long long u;
+  char digits[2 * FMT_MAXFIXED + 2];
+  char *p = digits + sizeof(digits);
+  char *q = buff;
+  int i;
+  if (!(y < 4503599627370496.0))  /* 2^52 (also rejects inf and NaN) */
+    return 0;
+  r = floor(y);
+  /* 'y - r' is exact, and so is the sign of the sum */
+  d = ((y - r) - 0.5) + fma(ax, pow10[prec], -y);
+  if (d == 0)  /* exact tie? */
+    return 0;
+  u = (unsigned long long)r + (d > 0);
+  for (i = 0; i < prec; i++) {  /* fractional digits */
+    *--p = (char)('0' + u % 10);
+    u /= 10;
+  }
+  if (prec > 0)
+    *--p = hydrogen_getlocaledecpoint();
+  do {  /* integer digits */
+    *--p = (char)('0' + u % 10);
+    u /= 10;
+  } while (u != 0);
+  if (signbit(x))
+    *q++ = '-';
+  memcpy(q, p, digits + sizeof(digits) - p);
+  return (int)(q - buff) + (int)(digits + sizeof(digits) - p);
+}
+
+#else
+
+static int fmtfixed (char *buff, hydrogen_Number x, int prec) {
+  (void)buff; (void)x; (void)prec;
+  return 0;  /* always use 'snprintf' */
+}
+
+#endif
+
+
+/* raise the error for the invalid conversion 'it' */
+static int badconv (hydrogen_State *L, const FmtItem *it) {
+  switch (it->aux) {
+    case FMT_ETOOLONG:
+      return hydrogenL_error(L, "invalid format (too long)");
+    case FMT_ESPEC:
+      return hydrogenL_error(L, "invalid conversion specification: '%s'",
+                                it->form);
+    case FMT_EQUOTED:
+      return hydrogenL_error(L, "specifier '%%q' cannot have modifiers");
+    default:
+      return hydrogenL_error(L, "invalid conversion '%s' to 'format'",
+                                it->form);
+  }
+}
+
+
+/*
+** Raise the error for an invalid conversion with the value at 'arg'.
+** Some conversions check their value before their specification, and
+** so do these errors.
+*/
+static int fmterror (hydrogen_State *L, const FmtItem *it, int arg) {
+  if (it->aux == FMT_ESPEC) {
+    if (strchr("diuoxX", it->conv))
+      hydrogenL_checkinteger(L, arg);
+    else if (strchr("eEfgG", it->conv))
+      hydrogenL_checknumber(L, arg);
+    else if (it->conv == 's') {
+      size_t l;
+      const char *s = hydrogenL_tobytes(L, arg, &l);
+      hydrogenL_argcheck(L, memchr(s, '\0', l) == NULL, arg,
+                            "string contains zeros");
+    }
+  }
+  return badconv(L, it);
+}
+
+
+/* add to buffer 'b' the value at 'arg' formatted by 'snprintf' */
+static void addgeneric (hydrogen_State *L, hydrogenL_Buffer *b,
+                        const FmtItem *it, int arg) {
+  int maxitem = (it->conv == 'f') ? MAX_ITEMF : MAX_ITEM;
+  char *buff = hydrogenL_prepbuffsize(b, maxitem);  /* to put result */
+  int nb = 0;  /* number of bytes in result */
+  switch (it->conv) {
+    case 'c': {
+      nb = l_sprintf(buff, maxitem, it->form,
+                     (int)hydrogenL_checkinteger(L, arg));
+      break;
+    }
+    case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': {
+      hydrogen_Integer n = hydrogenL_checkinteger(L, arg);
+      nb = l_sprintf(buff, maxitem, it->form, (HYDROGENI_UACINT)n);
+      break;
+    }
+    case 'a': case 'A':
+      nb = hydrogen_number2strx(L, buff, maxitem, it->form,
+                                  hydrogenL_checknumber(L, arg));
+      break;
+    case 'p': {
+      const void *p = hydrogen_topointer(L, arg);
+      if (p == NULL) {  /* avoid calling 'printf' with argument NULL */
+        char form[MAX_FORMAT];
+        strcpy(form, it->form);
+        form[strlen(form) - 1] = 's';  /* format it as a string */
+        nb = l_sprintf(buff, maxitem, form, "(null)");
+      }
+      else
+        nb = l_sprintf(buff, maxitem, it->form, p);
+      break;
+    }
+    case 's': {  /* with modifiers */
+      size_t l;
+      const char *s = hydrogenL_tobytes(L, arg, &l);
+      hydrogenL_argcheck(L, memchr(s, '\0', l) == NULL, arg,
+                            "string contains zeros");
+      if (strchr(it->form, '.') == NULL && l >= 100) {
+        /* no precision and string is too long to be formatted */
+        hydrogenL_addvalue(b);  /* keep entire string */
+      }
+      else {  /* format the string into 'buff' */
+        s = hydrogen_tostring(L, -1);  /* 'sprintf' needs a '\0' after it */
+        nb = l_sprintf(buff, maxitem, it->form, s);
+        hydrogen_pop(L, 1);  /* remove result from 'hydrogenL_tolstring' */
+      }
+      break;
+    }
+    default: {  /* 'e', 'E', 'f', 'g', 'G' */
+      hydrogen_Number n = hydrogenL_checknumber(L, arg);
+      nb = l_sprintf(buff, maxitem, it->form, (HYDROGENI_UACNUMBER)n);
+      break;
+    }
+  }
+  hydrogen_assert(nb < maxitem);
+  hydrogenL_addsize(b, nb);
+}
+
+
+/*
+** Add to buffer 'b' the result of formatting the values after 'arg'
+** up to 'top' with the parsed format 'f'.
+*/
+static void addformat (hydrogen_State *L, hydrogenL_Buffer *b,
+                       const Format *f, int arg, int top) {
+  int i;
+  for (i = 0; i < f->nitems; i++) {
+    const FmtItem *it = &f->items[i];
+    if (it->kind == FMT_LIT) {
+      hydrogenL_addlstring(b, f->lits + it->off, it->len);
+      continue;
+    }
+    if (++arg > top)
+      hydrogenL_argerror(L, arg, "no value");
+    switch (it->kind) {
+      case FMT_INT:
+        addint(b, hydrogenL_checkinteger(L, arg));
+        break;
+      case FMT_HEX:
+        addhex(b, hydrogenL_checkinteger(L, arg), "0123456789abcdef");
+        break;
+      case FMT_HEXUP:
+        addhex(b, hydrogenL_checkinteger(L, arg), "0123456789ABCDEF");
+        break;
+      case FMT_STR: {
+        size_t l;
+        if (hydrogenL_tostrbuf(L, arg, &l) != NULL)
+          addstrbuf(b, arg, l);  /* add contents of string buffer */
+        else {
+          hydrogenL_tobytes(L, arg, NULL);
+          hydrogenL_addvalue(b);  /* keep entire string */
+        }
+        break;
+      }
+      case FMT_FIXED: {
+        hydrogen_Number n = hydrogenL_checknumber(L, arg);
+        char *buff = hydrogenL_prepbuffsize(b, MAX_ITEM);
+        int nb = fmtfixed(buff, n, it->aux);
+        if (nb > 0)
+          hydrogenL_addsize(b, nb);
+        else
+          addgeneric(L, b, it, arg);
+        break;
+      }
+      case FMT_QUOTED:
+        addliteral(L, b, arg);
+        break;
+      case FMT_BAD:
+        fmterror(L, it, arg);
+        break;
+      default:  /* FMT_GENERIC */
+        addgeneric(L, b, it, arg);
+        break;
+    }
+  }
+}
+
+
+static int str_format (hydrogen_State *L) {
+  hydrogenL_Buffer b;
+  int top = hydrogen_gettop(L);
+  const Format *f = checkfmt(L, 1);
+  hydrogenL_buffinit(L, &b);
+  addformat(L, &b, f, 1, top);
+  hydrogenL_pushresult(&b);
+  return 1;
+}
+
+
+/*
+** A formatter reports an invalid conversion when it is created, not
+** when it is called. (Parsing stops at an invalid conversion, so it
+** can only be the last item.)
+*/
+static int str_formatter (hydrogen_State *L) {
+  if (hydrogenL_testudata(L, 1, FORMATHANDLE) == NULL) {  /* not parsed? */
+    const Format *f = checkfmt(L, 1);
+    if (f->nitems > 0 && f->items[f->nitems - 1].kind == FMT_BAD)
+      return badconv(L, &f->items[f->nitems - 1]);
+  }
+  hydrogen_settop(L, 1);
+  return 1;
+}
+
+
+/*
+** The formatter goes to the top of the stack (where it stays alive),
+** so that the values are arguments 1, 2, ... in error messages, as
+** they are for the caller.
+*/
+static int fmt_call (hydrogen_State *L) {
+  hydrogenL_Buffer b;
+  int top = hydrogen_gettop(L);
+  const Format *f = (const Format *)hydrogenL_checkudata(L, 1, FORMATHANDLE);
+  hydrogen_rotate(L, 1, -1);
+  hydrogenL_buffinit(L, &b);
+  addformat(L, &b, f, 0, top - 1);
+  hydrogenL_pushresult(&b);
+  return 1;
+}
+
+
+static int fmt_tostring (hydrogen_State *L) {
+  hydrogenL_checkudata(L, 1, FORMATHANDLE);
+  hydrogen_getiuservalue(L, 1, 1);
+  return 1;
+}
+
+
+/*
+** metamethods for parsed formats
+*/
+static const hydrogenL_Reg fmtmetameth[] = {
+  {"__call", fmt_call},
+  {"__tostring", fmt_tostring},
+  {NULL, NULL}
+};
+
+
+/*
+** functions for formatting (see 'FMTCACHE')
+*/
+static const hydrogenL_Reg fmtlib[] = {
+  {"format", str_format},
+  {"formatter", str_formatter},
+  {NULL, NULL}
+};
+
+
+/*
+** Add the formatting functions to the string library (on the top of
+** the stack) and create the metatable for parsed formats. Leaves the
+** cache of parsed formats on the stack, to be shared by the methods of
+** string buffers.
+*/
+static void createfmtmeta (hydrogen_State *L) {
+  FmtCache *c = (FmtCache *)hydrogen_newuserdatauv(L, sizeof(FmtCache),
+                                                  FMTCACHESIZE);
+  memset(c, 0, sizeof(FmtCache));
+  hydrogenL_newmetatable(L, FORMATHANDLE);  /* metatable for formats */
+  hydrogenL_setfuncs(L, fmtmetameth, 0);  /* add metamethods */
+  hydrogen_pop(L, 1);  /* pop metatable */
+  hydrogen_pushvalue(L, -2);  /* string library */
+  hydrogen_pushvalue(L, -2);  /* cache */
+  hydrogenL_setfuncs(L, fmtlib, 1);  /* add functions to string library */
+  hydrogen_pop(L, 1);  /* pop string library */
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** STRING BUFFERS
+** =======================================================
+*/
+
+
+#define checkstrbuf(L) \
+  ((hydrogenL_StrBuf *)hydrogenL_checkudata(L, 1, HYDROGEN_STRBUFHANDLE))
+
+
+/*
+** Push the box of the string buffer at index 1 and initialize 'b'
+** over it, to add to its contents. Contents already read are dropped
+** when they are at least half of the bytes in use.
+*/
+static hydrogenL_StrBuf *bindstrbuf (hydrogen_State *L, hydrogenL_Buffer *b) {
+  hydrogenL_StrBuf *sb = checkstrbuf(L);
+  hydrogen_getiuservalue(L, 1, 1);
+  if (sb->off > 0 && sb->off >= sb->n - sb->off) {  /* compact it? */
+    hydrogenL_buffinitbox(L, b, 0);
+    memmove(b->b, b->b + sb->off, (sb->n - sb->off) * sizeof(char));
+    sb->n -= sb->off;
+    sb->off = 0;
+  }
+  hydrogenL_buffinitbox(L, b, sb->n);
+  return sb;
+}
+
+
+/* finish adding to string buffer 'sb' through 'b' */
+static void unbindstrbuf (hydrogenL_StrBuf *sb, hydrogenL_Buffer *b) {
+  sb->n = hydrogenL_bufflen(b);
+  hydrogen_pop(b->L, 1);  /* remove box */
+}
+
+
+/* consume the first 'l' bytes of the contents of 'sb' */
+static void skipstrbuf (hydrogenL_StrBuf *sb, size_t l) {
+  sb->off += l;
+  if (sb->off == sb->n)  /* empty? */
+    sb->n = sb->off = 0;
+}
+
+
+/*
+** Add to 'b' number at 'arg' as 'tostring' would convert it, without
+** creating a string.
+*/
+static void addnumber (hydrogenL_Buffer *b, int arg) {
+  hydrogen_State *L = b->L;
+  char *buff = hydrogenL_prepbuffsize(b, MAX_ITEM);
+  int len;
+  if (hydrogen_isinteger(L, arg))
+    len = hydrogen_integer2str(buff, MAX_ITEM, hydrogen_tointeger(L, arg));
+  else {
+    len = hydrogen_number2str(buff, MAX_ITEM, hydrogen_tonumber(L, arg));
+    if (buff[strspn(buff, "-0123456789")] == '\0') {  /* looks like an int? */
+      buff[len++] = hydrogen_getlocaledecpoint();
+      buff[len++] = '0';  /* adds '.0' to result */
+    }
+  }
+  hydrogenL_addsize(b, len);
+}
+
+
+static int buf_put (hydrogen_State *L) {
+  hydrogenL_Buffer b;
+  int top = hydrogen_gettop(L);
+  int arg;
+  hydrogenL_StrBuf *sb = bindstrbuf(L, &b);
+  for (arg = 2; arg <= top; arg++) {
+    size_t l;
+    if (hydrogen_type(L, arg) == HYDROGEN_TNUMBER)
+      addnumber(&b, arg);
+    else if (hydrogen_type(L, arg) == HYDROGEN_TSTRING) {
+      const char *s = hydrogen_tobytes(L, arg, &l);
+      hydrogenL_addlstring(&b, s, l);
+    }
+    else if (hydrogenL_tostrbuf(L, arg, &l) != NULL)
+      addstrbuf(&b, arg, l);
+    else {
+      hydrogenL_tobytes(L, arg, NULL);  /* use its '__tostring' */
+      hydrogenL_addvalue(&b);
+    }
+  }
+  unbindstrbuf(sb, &b);
+  hydrogen_settop(L, 1);
+  return 1;  /* return buffer */
+}
+
+
+static int buf_putf (hydrogen_State *L) {
+  hydrogenL_Buffer b;
+  int top = hydrogen_gettop(L);
+  hydrogenL_StrBuf *sb = bindstrbuf(L, &b);
+  addformat(L, &b, checkfmt(L, 2), 2, top);
+  unbindstrbuf(sb, &b);
+  hydrogen_settop(L, 1);
+  return 1;  /* return buffer */
+}
+
+
+static int buf_reserve (hydrogen_State *L) {
+  hydrogenL_Buffer b;
+  hydrogen_Integer sz = hydrogenL_checkinteger(L, 2);
+  hydrogenL_StrBuf *sb;
+  hydrogenL_argcheck(L, sz >= 0, 2, "negative size");
+  sb = bindstrbuf(L, &b);
+  hydrogenL_prepbuffsize(&b, (size_t)sz);
+  unbindstrbuf(sb, &b);
+  hydrogen_settop(L, 1);
+  return 1;  /* return buffer */
+}
+
+
+static int buf_reset (hydrogen_State *L) {
+  hydrogenL_StrBuf *sb = checkstrbuf(L);
+  sb->n = sb->off = 0;  /* keep its box */
+  hydrogen_settop(L, 1);
+  return 1;  /* return buffer */
+}
+
+
+static int buf_tostring (hydrogen_State *L) {
+  size_t l;
+  const char *s;
+  checkstrbuf(L);
+  s = hydrogenL_tostrbuf(L, 1, &l);
+  hydrogen_pushlstring(L, s, l);
+  return 1;
+}
+
+
+static int buf_len (hydrogen_State *L) {
+  hydrogenL_StrBuf *sb = checkstrbuf(L);
+  hydrogen_pushinteger(L, (hydrogen_Integer)(sb->n - sb->off));
+  return 1;
+}
+
+
+static int buf_skip (hydrogen_State *L) {
+  hydrogenL_StrBuf *sb = checkstrbuf(L);
+  hydrogen_Integer l = hydrogenL_checkinteger(L, 2);
+  hydrogenL_argcheck(L, l >= 0, 2, "negative count");
+  skipstrbuf(sb, ((size_t)l < sb->n - sb->off) ? (size_t)l : sb->n - sb->off);
+  hydrogen_settop(L, 1);
+  return 1;  /* return buffer */
+}
+
+
+static int buf_get (hydrogen_State *L) {
+  hydrogenL_StrBuf *sb = checkstrbuf(L);
+  size_t len = sb->n - sb->off;
+  hydrogen_Integer l = hydrogenL_optinteger(L, 2, (hydrogen_Integer)len);
+  const char *s = hydrogenL_tostrbuf(L, 1, NULL);
+  hydrogenL_argcheck(L, l >= 0, 2, "negative count");
+  if ((size_t)l < len)
+    len = (size_t)l;
+  hydrogen_pushlstring(L, s, len);
+  skipstrbuf(sb, len);
+  return 1;
+}
+
+
+static int str_buffer (hydrogen_State *L) {
+  hydrogen_Integer sz = hydrogenL_optinteger(L, 1, 0);
+  hydrogenL_StrBuf *sb;
+  hydrogenL_argcheck(L, sz >= 0, 1, "negative size");
+  sb = (hydrogenL_StrBuf *)hydrogen_newuserdatauv(L, sizeof(hydrogenL_StrBuf), 1);
+  sb->n = sb->off = 0;
+  hydrogenL_setmetatable(L, HYDROGEN_STRBUFHANDLE);
+  hydrogenL_newbox(L);
+  if (sz > 0) {  /* preallocate its box? */
+    hydrogenL_Buffer b;
+    hydrogenL_buffinitbox(L, &b, 0);
+    hydrogenL_prepbuffsize(&b, (size_t)sz);
+  }
+  hydrogen_setiuservalue(L, -2, 1);
+  return 1;
+}
+
+
+/*
+** methods for string buffers
+*/
+static const hydrogenL_Reg bufmeth[] = {
+  {"put", buf_put},
+  {"putf", buf_putf},
+  {"reserve", buf_reserve},
+  {"reset", buf_reset},
+  {"tostring", buf_tostring},
+  {"len", buf_len},
+  {"skip", buf_skip},
+  {"get", buf_get},
+  {NULL, NULL}
+};
+
+
+/*
+** metamethods for string buffers
+*/
+static const hydrogenL_Reg bufmetameth[] = {
+  {"__index", NULL},  /* place holder */
+  {"__tostring", buf_tostring},
+  {"__len", buf_len},
+  {NULL, NULL}
+};
+
+
+/*
+** Create the metatable for string buffers. Their methods share the
+** cache of parsed formats (on the top of the stack) as their upvalue,
+** for 'putf'.
+*/
+static void createbufmeta (hydrogen_State *L) {
+  hydrogenL_newmetatable(L, HYDROGEN_STRBUFHANDLE);  /* metatable for buffers */
+  hydrogenL_setfuncs(L, bufmetameth, 0);  /* add metamethods to new metatable */
+  hydrogenL_newlibtable(L, bufmeth);  /* create method table */
+  hydrogen_pushvalue(L, -3);  /* cache of parsed formats */
+  hydrogenL_setfuncs(L, bufmeth, 1);  /* add buffer methods to method table */
+  hydrogen_setfield(L, -2, "__index");  /* metatable.__index = method table */
+  hydrogen_pop(L, 2);  /* pop metatable and cache */
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** MULTIPLE STRING SEARCH
+** =======================================================
+*/
+
+
+#define MSEARCHHANDLE	"MULTISEARCH*"
+
+
+/*
+** A multisearch object is an Aho-Corasick automaton for a list of
+** needles, a userdata with metatable 'MSEARCHHANDLE'. Bytes are mapped
+** to classes, where all bytes that appear in no needle share class 0
+** (so there may be 257 classes, when the needles use every byte),
+** and the transitions form a flat table with one row of 'ncls' entries
+** per state. The table is completed with the failure links, so the
+** search does one lookup per subject byte. Entries are row offsets
+** (state * 'ncls'), and states that recognize a needle are numbered
+** last, so that an offset not below 'firstout' signals a match.
+** 'out[s]' is the index of the longest needle ending at state 's'.
+*/
+typedef struct MultiSearch {
+  int nstates;
+  int ncls;  /* number of byte classes */
+  int nneedles;
+  int firstout;  /* offset of the first state with an output */
+  unsigned short cls[UCHAR_MAX + 1];  /* class of each byte (up to 256) */
+  size_t *len;  /* length of each needle (indices start at 1) */
+  int *trans;  /* transition table */
+  int *out;  /* needle recognized at each state */
+} MultiSearch;
+
+
+#define checkmsearch(L) \
+  ((MultiSearch *)hydrogenL_checkudata(L, 1, MSEARCHHANDLE))
+
+
+/*
+** Build the trie of the needles in the table at index 1 into 'trans'
+** (0 meaning no edge, as no edge goes back to the root), marking in
+** 'out' the state where each needle ends. Returns the number of states.
+*/
+static int buildtrie (hydrogen_State *L, MultiSearch *ms, int *trans,
+                      int *out) {
+  int nstates = 1;
+  int i;
+  for (i = 1; i <= ms->nneedles; i++) {
+    size_t l, j;
+    const char *s;
+    int st = 0;
+    hydrogen_rawgeti(L, 1, i);
+    s = hydrogen_tobytes(L, -1, &l);
+    for (j = 0; j < l; j++) {
+      int *t = &trans[st * ms->ncls + ms->cls[uchar(s[j])]];
+      if (*t == 0) {  /* no edge yet? */
+        *t = nstates;
+        out[nstates++] = 0;
+      }
+      st = *t;
+    }
+    if (out[st] == 0)  /* repeated needles keep their first index */
+      out[st] = i;
+    hydrogen_pop(L, 1);
+  }
+  return nstates;
+}
+
+
+/*
+** Complete the trie into an automaton, visiting the states in
+** breadth-first order ('queue') to compute their failure links
+** ('fail'): missing edges take the transition of the failure state,
+** and states with no needle of their own inherit its output.
+*/
+static void buildlinks (MultiSearch *ms, int *trans, int *out,
+                        int *fail, int *queue) {
+  int ncls = ms->ncls;
+  int head = 0, tail = 0;
+  int c;
+  for (c = 0; c < ncls; c++) {
+    int v = trans[c];
+    if (v != 0) {
+      fail[v] = 0;
+      queue[tail++] = v;
+    }
+  }
+  while (head < tail) {
+    int u = queue[head++];
+    for (c = 0; c < ncls; c++) {
+      int v = trans[u * ncls + c];
+      int f = trans[fail[u] * ncls + c];
+      if (v != 0) {  /* trie edge? */
+        fail[v] = f;
+        if (out[v] == 0) out[v] = out[f];
+        queue[tail++] = v;
+      }
+      else
+        trans[u * ncls + c] = f;
+    }
+  }
+}
+
+
+static int str_multisearch (hydrogen_State *L) {
+  hydrogen_Integer n, i;
+  size_t total = 0;
+  int ncls = 1;
+  int nstates, nout, c;
+  MultiSearch tmp;
+  MultiSearch *ms;
+  int *trans, *out, *fail, *renum;
+  hydrogenL_checktype(L, 1, HYDROGEN_TTABLE);
+  n = (hydrogen_Integer)hydrogen_rawlen(L, 1);
+  hydrogenL_argcheck(L, 0 < n && n < INT_MAX, 1, "no needles");
+  memset(tmp.cls, 0, sizeof(tmp.cls));
+  for (i = 1; i <= n; i++) {  /* check needles and collect byte classes */
+    size_t l, j;
+    const char *s;
+    if (hydrogen_rawgeti(L, 1, i) != HYDROGEN_TSTRING)
+      return hydrogenL_error(L, "needle %I is not a string",
+                                (HYDROGENI_UACINT)i);
+    s = hydrogen_tobytes(L, -1, &l);
+    if (l == 0)
+      return hydrogenL_error(L, "needle %I is empty", (HYDROGENI_UACINT)i);
+    for (j = 0; j < l; j++) {
+      if (tmp.cls[uchar(s[j])] == 0)
+        tmp.cls[uchar(s[j])] = (unsigned short)(ncls++);
+    }
+    total += l;
+    hydrogen_pop(L, 1);
+  }
+  if (total >= (size_t)(INT_MAX / 2) / (size_t)ncls)
+    return hydrogenL_error(L, "needles too long");
+  tmp.ncls = ncls;
+  tmp.nneedles = (int)n;
+  /* work area: trie, outputs, failure links, queue, and renumbering */
+  trans = (int *)hydrogen_newuserdatauv(L,
+                   (total + 1) * (ncls + 4) * sizeof(int), 0);
+  memset(trans, 0, (total + 1) * ncls * sizeof(int));
+  out = trans + (total + 1) * ncls;
+  fail = out + (total + 1);
+  renum = fail + (total + 1);
+  out[0] = 0;
+  nstates = buildtrie(L, &tmp, trans, out);
+  buildlinks(&tmp, trans, out, fail, renum + (total + 1));
+  nout = 0;
+  for (c = 0; c < nstates; c++)  /* states with outputs go last */
+    if (out[c] != 0) nout++;
+  ms = (MultiSearch *)hydrogen_newuserdatauv(L, sizeof(MultiSearch) +
+          (n + 1) * sizeof(size_t) + (size_t)nstates * (ncls + 1) * sizeof(int),
+          0);
+  *ms = tmp;
+  ms->nstates = nstates;
+  ms->firstout = (nstates - nout) * ncls;
+  ms->len = (size_t *)(ms + 1);
+  ms->trans = (int *)(ms->len + n + 1);
+  ms->out = ms->trans + (size_t)nstates * ncls;
+  {
+    int plain = 0, without = nstates - nout;
+    for (c = 0; c < nstates; c++)
+      renum[c] = (out[c] != 0) ? without++ : plain++;
+  }
+  for (c = 0; c < nstates; c++) {
+    int *row = ms->trans + renum[c] * ncls;
+    int k;
+    for (k = 0; k < ncls; k++)
+      row[k] = renum[trans[c * ncls + k]] * ncls;
+    ms->out[renum[c]] = out[c];
+  }
+  ms->len[0] = 0;
+  for (i = 1; i <= n; i++) {
+    hydrogen_rawgeti(L, 1, i);
+    ms->len[i] = hydrogen_rawlen(L, -1);
+    hydrogen_pop(L, 1);
+  }
+  hydrogenL_setmetatable(L, MSEARCHHANDLE);
+  return 1;
+}
+
+
+/*
+** Scan 's' from position 'init' for the first occurrence of a needle
+** to end (the longest one, if several end at the same place). Returns
+** the index of that needle, setting '*e' to its end, or 0 if none.
+*/
+static int msearch (const MultiSearch *ms, const char *s, size_t init,
+                    size_t len, size_t *e) {
+  const int *trans = ms->trans;
+  const unsigned short *cls = ms->cls;
+  int firstout = ms->firstout;
+  int st = 0;
+  size_t i;
+  for (i = init; i < len; i++) {
+    st = trans[st + cls[uchar(s[i])]];
+    if (st >= firstout) {
+      *e = i + 1;
+      return ms->out[st / ms->ncls];
+    }
+  }
+  return 0;
+}
+
+
+/* get the initial position (argument 3) for a search in a subject */
+static size_t msinit (hydrogen_State *L, size_t ls) {
+  return posrelatI(hydrogenL_optinteger(L, 3, 1), ls) - 1;
+}
+
+
+static int ms_find (hydrogen_State *L) {
+  const MultiSearch *ms = checkmsearch(L);
+  size_t ls, e;
+  const char *s = hydrogenL_checkbytes(L, 2, &ls);
+  size_t init = msinit(L, ls);
+  int idx;
+  if (init <= ls && (idx = msearch(ms, s, init, ls, &e)) != 0) {
+    hydrogen_pushinteger(L, (hydrogen_Integer)(e - ms->len[idx]) + 1);
+    hydrogen_pushinteger(L, (hydrogen_Integer)e);
+    hydrogen_pushinteger(L, idx);
+    return 3;
+  }
+  hydrogenL_pushfail(L);  /* not found */
+  return 1;
+}
+
+
+static int ms_count (hydrogen_State *L) {
+  const MultiSearch *ms = checkmsearch(L);
+  size_t ls, e;
+  const char *s = hydrogenL_checkbytes(L, 2, &ls);
+  size_t init = msinit(L, ls);
+  hydrogen_Integer n = 0;
+  while (init < ls && msearch(ms, s, init, ls, &e) != 0) {
+    n++;
+    init = e;  /* matches do not overlap */
+  }
+  hydrogen_pushinteger(L, n);
+  return 1;
+}
+
+
+static int ms_gmatch_aux (hydrogen_State *L) {
+  const MultiSearch *ms =
+      (const MultiSearch *)hydrogen_touserdata(L, hydrogen_upvalueindex(1));
+  size_t ls, e;
+  const char *s = hydrogen_tobytes(L, hydrogen_upvalueindex(2), &ls);
+  size_t init = (size_t)hydrogen_tointeger(L, hydrogen_upvalueindex(3));
+  int idx;
+  if (init >= ls || (idx = msearch(ms, s, init, ls, &e)) == 0)
+    return 0;  /* no more matches */
+  hydrogen_pushinteger(L, (hydrogen_Integer)e);
+  hydrogen_replace(L, hydrogen_upvalueindex(3));  /* go on after the match */
+  hydrogen_pushinteger(L, (hydrogen_Integer)(e - ms->len[idx]) + 1);
+  hydrogen_pushinteger(L, (hydrogen_Integer)e);
+  hydrogen_pushinteger(L, idx);
+  return 3;
+}
+
+
+static int ms_gmatch (hydrogen_State *L) {
+  size_t ls;
+  size_t init;
+  checkmsearch(L);
+  hydrogenL_checkbytes(L, 2, &ls);
+  init = msinit(L, ls);
+  hydrogen_settop(L, 2);
+  hydrogen_pushinteger(L, (hydrogen_Integer)init);
+  hydrogen_pushcclosure(L, ms_gmatch_aux, 3);
+  return 1;
+}
+
+
+/*
+** Add to 'b' the replacement (argument 3) for needle 'idx', found at
+** 's[ms..e)' in the subject at index 2.
+*/
+static void ms_addvalue (hydrogen_State *L, hydrogenL_Buffer *b, int tr,
+                         const char *s, size_t ms, size_t e, int idx) {
+  if (tr == HYDROGEN_TFUNCTION) {
+    hydrogen_pushvalue(L, 3);
+    hydrogen_pushsubstring(L, 2, ms, e - ms);
+    hydrogen_pushinteger(L, idx);
+    hydrogen_call(L, 2, 1);
+  }
+  else if (tr == HYDROGEN_TTABLE) {
+    hydrogen_pushsubstring(L, 2, ms, e - ms);
+    hydrogen_gettable(L, 3);
+  }
+  else {  /* string or number: used as is */
+    size_t l;
+    const char *news = hydrogen_tobytes(L, 3, &l);
+    hydrogenL_addlstring(b, news, l);
+    return;
+  }
+  if (!hydrogen_toboolean(L, -1)) {  /* nil or false? */
+    hydrogen_pop(L, 1);  /* remove value */
+    hydrogenL_addlstring(b, s + ms, e - ms);  /* keep original text */
+  }
+  else if (l_unlikely(!hydrogen_isstring(L, -1)))
+    hydrogenL_error(L, "invalid replacement value (a %s)",
+                       hydrogenL_typename(L, -1));
+  else
+    hydrogenL_addvalue(b);  /* add result to accumulator */
+}
+
+
+static int ms_gsub (hydrogen_State *L) {
+  const MultiSearch *ms = checkmsearch(L);
+  size_t ls, e;
+  const char *s = hydrogenL_checkbytes(L, 2, &ls);
+  int tr = hydrogen_type(L, 3);
+  hydrogen_Integer max_s = hydrogenL_optinteger(L, 4, (hydrogen_Integer)ls);
+  hydrogen_Integer n = 0;  /* replacement count */
+  size_t src = 0;
+  int idx;
+  hydrogenL_Buffer b;
+  hydrogenL_argexpected(L, tr == HYDROGEN_TNUMBER || tr == HYDROGEN_TSTRING ||
+                   tr == HYDROGEN_TFUNCTION || tr == HYDROGEN_TTABLE, 3,
+                      "string/function/table");
+  hydrogen_settop(L, 3);
+  hydrogenL_buffinit(L, &b);
+  while (n < max_s && (idx = msearch(ms, s, src, ls, &e)) != 0) {
+    size_t start = e - ms->len[idx];
+    hydrogenL_addlstring(&b, s + src, start - src);  /* text before match */
+    ms_addvalue(L, &b, tr, s, start, e, idx);
+    src = e;
+    n++;
+  }
+  if (n == 0)  /* no changes? */
+    hydrogen_pushvalue(L, 2);  /* return original string */
+  else {
+    hydrogenL_addlstring(&b, s + src, ls - src);
+    hydrogenL_pushresult(&b);  /* create and return new string */
+  }
+  hydrogen_pushinteger(L, n);  /* number of substitutions */
+  return 2;
+}
+
+
+/*
+** methods for multisearch objects
+*/
+static const hydrogenL_Reg msmeth[] = {
+  {"find", ms_find},
+  {"gmatch", ms_gmatch},
+  {"count", ms_count},
+  {"gsub", ms_gsub},
+  {NULL, NULL}
+};
+
+
+static void createmsmeta (hydrogen_State *L) {
+  hydrogenL_newmetatable(L, MSEARCHHANDLE);  /* metatable for multisearch */
+  hydrogenL_newlibtable(L, msmeth);  /* create method table */
+  hydrogenL_setfuncs(L, msmeth, 0);  /* add methods to method table */
+  hydrogen_setfield(L, -2, "__index");  /* metatable.__index = method table */
+  hydrogen_pop(L, 1);  /* pop metatable */
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** PACK/UNPACK
+** =======================================================
+*/
+
+
+/* value used for padding */
+#if !defined(HYDROGENL_PACKPADBYTE)
+#define HYDROGENL_PACKPADBYTE		0x00
+#endif
+
+/* maximum size for the binary representation of an integer */
+#define MAXINTSIZE	16
+
+/* number of bits in a character */
+#define NB	CHAR_BIT
+
+/* mask for one character (NB 1's) */
+#define MC	((1 << NB) - 1)
+
+/* size of a hydrogen_Integer */
+#define SZINT	((int)sizeof(hydrogen_Integer))
+
+
+/* dummy union to get native endianness */
+static const union {
+  int dummy;
+  char little;  /* true iff machine is little endian */
+} nativeendian = {1};
+
+
+/*
+** information to pack/unpack stuff
+*/
+typedef struct Header {
+  hydrogen_State *L;
+  int islittle;
+  int maxalign;
+} Header;
+
+
+/*
+** options for pack/unpack
+*/
+typedef enum KOption {
+  Kint,		/* signed integers */
+  Kuint,	/* unsigned integers */
+  Kfloat,	/* single-precision floating-point numbers */
+  Knumber,	/* Hydrogen "native" floating-point numbers */
+  Kdouble,	/* double-precision floating-point numbers */
+  Kchar,	/* fixed-length strings */
+  Kstring,	/* strings with prefixed length */
+  Kzstr,	/* zero-terminated strings */
+  Kpadding,	/* padding */
+  Kpaddalign,	/* padding for alignment */
+  Knop		/* no-op (configuration or spaces) */
+} KOption;
+
+
+/*
+** Read an integer numeral from string 'fmt' or return 'df' if
+** there is no numeral
+*/
+static int digit (int c) { return '0' <= c && c <= '9'; }
+
+static int getnum (const char **fmt, int df) {
+  if (!digit(**fmt))  /* no number? */
+    return df;  /* return default value */
+  else {
+    int a = 0;
+    do {
+      a = a*10 + (*((*fmt)++) - '0');
+    } while (digit(**fmt) && a <= ((int)MAXSIZE - 9)/10);
+    return a;
+  }
+}
+
+
+/*
+** Read an integer numeral and raises an error if it is larger
+** than the maximum size for integers.
+*/
+static int getnumlimit (Header *h, const char **fmt, int df) {
+  int sz = getnum(fmt, df);
+  if (l_unlikely(sz > MAXINTSIZE || sz <= 0))
+    return hydrogenL_error(h->L, "integral size (%d) out of limits [1,%d]",
+                            sz, MAXINTSIZE);
+  return sz;
+}
+
+
+/*
+** Initialize Header
+*/
+static void initheader (hydrogen_State *L, Header *h) {
+  h->L = L;
+  h->islittle = nativeendian.little;
+  h->maxalign = 1;
+}
+
+
+/*
+** Read and classify next option. 'size' is filled with option's size.
+*/
+static KOption getoption (Header *h, const char **fmt, int *size) {
+  /* dummy structure to get native alignment requirements */
+  struct cD { char c; union { HYDROGENI_MAXALIGN; } u; };
+  int opt = *((*fmt)++);
+  *size = 0;  /* default */
+  switch (opt) {
+    case 'b': *size = sizeof(char); return Kint;
+    case 'B': *size = sizeof(char); return Kuint;
+    case 'h': *size = sizeof(short); return Kint;
+    case 'H': *size = sizeof(short); return Kuint;
+    case 'l': *size = sizeof(long); return Kint;
+    case 'L': *size = sizeof(long); return Kuint;
+    case 'j': *size = sizeof(hydrogen_Integer); return Kint;
+    case 'J': *size = sizeof(hydrogen_Integer); return Kuint;
+    case 'T': *size = sizeof(size_t); return Kuint;
+    case 'f': *size = sizeof(float); return Kfloat;
+    case 'n': *size = sizeof(hydrogen_Number); return Knumber;
+    case 'd': *size = sizeof(double); return Kdouble;
+    case 'i': *size = getnumlimit(h, fmt, sizeof(int)); return Kint;
+    case 'I': *size = getnumlimit(h, fmt, sizeof(int)); return Kuint;
+    case 's': *size = getnumlimit(h, fmt, sizeof(size_t)); return Kstring;
+    case 'c':
+      *size = getnum(fmt, -1);
+      if (l_unlikely(*size == -1))
+        hydrogenL_error(h->L, "missing size for format option 'c'");
+      return Kchar;
+    case 'z': return Kzstr;
+    case 'x': *size = 1; return Kpadding;
+    case 'X': return Kpaddalign;
+    case ' ': break;
+    case '<': h->islittle = 1; break;
+    case '>': h->islittle = 0; break;
+    case '=': h->islittle = nativeendian.little; break;
+    case '!': {
+      const int maxalign = offsetof(struct cD, u);
+      h->maxalign = getnumlimit(h, fmt, maxalign);
+      break;
+    }
+    default: hydrogenL_error(h->L, "invalid format option '%c'", opt);
+  }
+  return Knop;
+}
+
+
+/*
+** Read, classify, and fill other details about the next option.
+** 'psize' is filled with option's size, 'palign' with its alignment
+** (0 if it needs none).
+** Local variable 'align' gets the size to be aligned. (Kpadal option
+** always gets its full alignment, other options are limited by
+** the maximum alignment ('maxalign'). Kchar option needs no alignment
+** despite its size.
+*/
+static KOption getalign (Header *h, const char **fmt, int *psize,
+                                                      int *palign) {
+  KOption opt = getoption(h, fmt, psize);
+  int align = *psize;  /* usually, alignment follows size */
+  if (opt == Kpaddalign) {  /* 'X' gets alignment from following option */
+    if (**fmt == '\0' || getoption(h, fmt, &align) == Kchar || align == 0)
+      hydrogenL_argerror(h->L, 1, "invalid next option for option 'X'");
+  }
+  if (align <= 1 || opt == Kchar)  /* need no alignment? */
+    *palign = 0;
+  else {
+    if (align > h->maxalign)  /* enforce maximum alignment */
+      align = h->maxalign;
+    if (l_unlikely((align & (align - 1)) != 0))  /* not a power of 2? */
+      hydrogenL_argerror(h->L, 1, "format asks for alignment not power of 2");
+    *palign = align;
+  }
+  return opt;
+}
+
+
+/* padding needed at position 'pos' for alignment 'align' */
+#define padding(pos,align)  \
+	((align) == 0 ? 0 : ((align) - (int)((pos) & ((align) - 1))) & ((align) - 1))
+
+
+/*
+** Read the next option, as 'getalign', filling 'ntoalign' with the
+** padding it needs after 'totalsize' bytes.
+*/
+static KOption getdetails (Header *h, size_t totalsize,
+                           const char **fmt, int *psize, int *ntoalign) {
+  int align;
+  KOption opt = getalign(h, fmt, psize, &align);
+  *ntoalign = padding(totalsize, align);
+  return opt;
+}
+
+
+/*
+** Pack integer 'n' with 'size' bytes and 'islittle' endianness.
+** The final 'if' handles the case when 'size' is larger than
+** the size of a Hydrogen integer, correcting the extra sign-extension
+** bytes if necessary (by default they would be zeros).
+*/
+static void packint (hydrogenL_Buffer *b, hydrogen_Unsigned n,
+                     int islittle, int size, int neg) {
+  char *buff = hydrogenL_prepbuffsize(b, size);
+  int i;
+  buff[islittle ? 0 : size - 1] = (char)(n & MC);  /* first byte */
+  for (i = 1; i < size; i++) {
+    n >>= NB;
+    buff[islittle ? i : size - 1 - i] = (char)(n & MC);
+  }
+  if (neg && size > SZINT) {  /* negative number need sign extension? */
+    for (i = SZINT; i < size; i++)  /* correct extra bytes */
+      buff[islittle ? i : size - 1 - i] = (char)MC;
+  }
+  hydrogenL_addsize(b, size);  /* add result to buffer */
+}
+
+
+/*
+** Copy 'size' bytes from 'src' to 'dest', correcting endianness if
+** given 'islittle' is different from native endianness.
+*/
+static void copywithendian (char *dest, const char *src,
+                            int size, int islittle) {
+  if (islittle == nativeendian.little)
+    memcpy(dest, src, size);
+  else {
+    dest += size - 1;
+    while (size-- != 0)
+      *(dest--) = *(src++);
+  }
+}
+
+
+static int str_pack (hydrogen_State *L) {
+  hydrogenL_Buffer b;
+  Header h;
+  const char *fmt = hydrogenL_checkstring(L, 1);  /* format string */
+  int arg = 1;  /* current argument to pack */
+  size_t totalsize = 0;  /* accumulate total size of result */
+  initheader(L, &h);
+  hydrogen_pushnil(L);  /* mark to separate arguments from string buffer */
+  hydrogenL_buffinit(L, &b);
+  while (*fmt != '\0') {
+    int size, ntoalign;
+    KOption opt = getdetails(&h, totalsize, &fmt, &size, &ntoalign);
+    totalsize += ntoalign + size;
+    while (ntoalign-- > 0)
+     hydrogenL_addchar(&b, HYDROGENL_PACKPADBYTE);  /* fill alignment */
+    arg++;
+    switch (opt) {
+      case Kint: {  /* signed integers */
+        hydrogen_Integer n = hydrogenL_checkinteger(L, arg);
+        if (size < SZINT) {  /* need overflow check? */
+          hydrogen_Integer lim = (hydrogen_Integer)1 << ((size * NB) - 1);
+          hydrogenL_argcheck(L, -lim <= n && n < lim, arg, "integer overflow");
+        }
+        packint(&b, (hydrogen_Unsigned)n, h.islittle, size, (n < 0));
+        break;
+      }
+      case Kuint: {  /* unsigned integers */
+        hydrogen_Integer n = hydrogenL_checkinteger(L, arg);
+        if (size < SZINT)  /* need overflow check? */
+          hydrogenL_argcheck(L, (hydrogen_Unsigned)n < ((hydrogen_Unsigned)1 << (size * NB)),
+                           arg, "unsigned overflow");
+        packint(&b, (hydrogen_Unsigned)n, h.islittle, size, 0);
+        break;
+      }
+      case Kfloat: {  /* C float */
+        float f = (float)hydrogenL_checknumber(L, arg);  /* get argument */
+        char *buff = hydrogenL_prepbuffsize(&b, sizeof(f));
+        /* move 'f' to final result, correcting endianness if needed */
+        copywithendian(buff, (char *)&f, sizeof(f), h.islittle);
+        hydrogenL_addsize(&b, size);
+        break;
+      }
+      case Knumber: {  /* Hydrogen float */
+        hydrogen_Number f = hydrogenL_checknumber(L, arg);  /* get argument */
+        char *buff = hydrogenL_prepbuffsize(&b, sizeof(f));
+        /* move 'f' to final result, correcting endianness if needed */
+        copywithendian(buff, (char *)&f, sizeof(f), h.islittle);
+        hydrogenL_addsize(&b, size);
+        break;
+      }
+      case Kdouble: {  /* C double */
+        double f = (double)hydrogenL_checknumber(L, arg);  /* get argument */
+        char *buff = hydrogenL_prepbuffsize(&b, sizeof(f));
+        /* move 'f' to final result, correcting endianness if needed */
+        copywithendian(buff, (char *)&f, sizeof(f), h.islittle);
+        hydrogenL_addsize(&b, size);
+        break;
+      }
+      case Kchar: {  /* fixed-size string */
+        size_t len;
+        const char *s = hydrogenL_checkbytes(L, arg, &len);
+        hydrogenL_argcheck(L, len <= (size_t)size, arg,
+                         "string longer than given size");
+        hydrogenL_addlstring(&b, s, len);  /* add string */
+        while (len++ < (size_t)size)  /* pad extra space */
+          hydrogenL_addchar(&b, HYDROGENL_PACKPADBYTE);
+        break;
+      }
+      case Kstring: {  /* strings with length count */
+        size_t len;
+        const char *s = hydrogenL_checkbytes(L, arg, &len);
+        hydrogenL_argcheck(L, size >= (int)sizeof(size_t) ||
+                         len < ((size_t)1 << (size * NB)),
+                         arg, "string length does not fit in given size");
+        packint(&b, (hydrogen_Unsigned)len, h.islittle, size, 0);  /* pack length */
+        hydrogenL_addlstring(&b, s, len);
+        totalsize += len;
+        break;
+      }
+      case Kzstr: {  /* zero-terminated string */
+        size_t len;
+        const char *s = hydrogenL_checkbytes(L, arg, &len);
+        hydrogenL_argcheck(L, memchr(s, '\0', len) == NULL, arg,
+                              "string contains zeros");
+        hydrogenL_addlstring(&b, s, len);
+        hydrogenL_addchar(&b, '\0');  /* add zero at the end */
+        totalsize += len + 1;
+        break;
+      }
+      case Kpadding: hydrogenL_addchar(&b, HYDROGENL_PACKPADBYTE);  /* FALLTHROUGH */
+      case Kpaddalign: case Knop:
+        arg--;  /* undo increment */
+        break;
+    }
+  }
+  hydrogenL_pushresult(&b);
+  return 1;
+}
+
+
+static int str_packsize (hydrogen_State *L) {
+  Header h;
+  const char *fmt = hydrogenL_checkstring(L, 1);  /* format string */
+  size_t totalsize = 0;  /* accumulate total size of result */
+  initheader(L, &h);
+  while (*fmt != '\0') {
+    int size, ntoalign;
+    KOption opt = getdetails(&h, totalsize, &fmt, &size, &ntoalign);
+    hydrogenL_argcheck(L, opt != Kstring && opt != Kzstr, 1,
+                     "variable-length format");
+    size += ntoalign;  /* total space used by option */
+    hydrogenL_argcheck(L, totalsize <= MAXSIZE - size, 1,
+                     "format result too large");
+    totalsize += size;
+  }
+  hydrogen_pushinteger(L, (hydrogen_Integer)totalsize);
+  return 1;
+}
+
+
+/*
+** Unpack an integer with 'size' bytes and 'islittle' endianness.
+** If size is smaller than the size of a Hydrogen integer and integer
+** is signed, must do sign extension (propagating the sign to the
+** higher bits); if size is larger than the size of a Hydrogen integer,
+** it must check the unread bytes to see whether they do not cause an
+** overflow.
+*/
+static hydrogen_Integer unpackint (hydrogen_State *L, const char *str,
+                              int islittle, int size, int issigned) {
+  hydrogen_Unsigned res = 0;
+  int i;
+  int limit = (size  <= SZINT) ? size : SZINT;
+  for (i = limit - 1; i >= 0; i--) {
+    res <<= NB;
+    res |= (hydrogen_Unsigned)(unsigned char)str[islittle ? i : size - 1 - i];
+  }
+  if (size < SZINT) {  /* real size smaller than hydrogen_Integer? */
+    if (issigned) {  /* needs sign extension? */
+      hydrogen_Unsigned mask = (hydrogen_Unsigned)1 << (size*NB - 1);
+      res = ((res ^ mask) - mask);  /* do sign extension */
+    }
+  }
+  else if (size > SZINT) {  /* must check unread bytes */
+    int mask = (!issigned || (hydrogen_Integer)res >= 0) ? 0 : MC;
+    for (i = limit; i < size; i++) {
+      if (l_unlikely((unsigned char)str[islittle ? i : size - 1 - i] != mask))
+        hydrogenL_error(L, "%d-byte integer does not fit into Hydrogen Integer", size);
+    }
+  }
+  return (hydrogen_Integer)res;
+}
+
+
+static int str_unpack (hydrogen_State *L) {
+  Header h;
+  const char *fmt = hydrogenL_checkstring(L, 1);
+  size_t ld;
+  const char *data = hydrogenL_checkbytes(L, 2, &ld);
+  size_t pos = posrelatI(hydrogenL_optinteger(L, 3, 1), ld) - 1;
+  int n = 0;  /* number of results */
+  hydrogenL_argcheck(L, pos <= ld, 3, "initial position out of string");
+  initheader(L, &h);
+  while (*fmt != '\0') {
+    int size, ntoalign;
+    KOption opt = getdetails(&h, pos, &fmt, &size, &ntoalign);
+    hydrogenL_argcheck(L, (size_t)ntoalign + size <= ld - pos, 2,
+                    "data string too short");
+    pos += ntoalign;  /* skip alignment */
+    /* stack space for item + next position */
+    hydrogenL_checkstack(L, 2, "too many results");
+    n++;
+    switch (opt) {
+      case Kint:
+      case Kuint: {
+        hydrogen_Integer res = unpackint(L, data + pos, h.islittle, size,
+                                       (opt == Kint));
+        hydrogen_pushinteger(L, res);
+        break;
+      }
+      case Kfloat: {
+        float f;
+        copywithendian((char *)&f, data + pos, sizeof(f), h.islittle);
+        hydrogen_pushnumber(L, (hydrogen_Number)f);
+        break;
+      }
+      case Knumber: {
+        hydrogen_Number f;
+        copywithendian((char *)&f, data + pos, sizeof(f), h.islittle);
+        hydrogen_pushnumber(L, f);
+        break;
+      }
+      case Kdouble: {
+        double f;
+        copywithendian((char *)&f, data + pos, sizeof(f), h.islittle);
+        hydrogen_pushnumber(L, (hydrogen_Number)f);
+        break;
+      }
+      case Kchar: {
+        hydrogen_pushlstring(L, data + pos, size);
+        break;
+      }
+      case Kstring: {
+        size_t len = (size_t)unpackint(L, data + pos, h.islittle, size, 0);
+        hydrogenL_argcheck(L, len <= ld - pos - size, 2, "data string too short");
+        hydrogen_pushlstring(L, data + pos + size, len);
+        pos += len;  /* skip string */
+        break;
+      }
+      case Kzstr: {  /* (the data may not be followed by a '\0') */
+        const char *z = (const char *)memchr(data + pos, '\0', ld - pos);
+        size_t len;
+        hydrogenL_argcheck(L, z != NULL, 2,
+                         "unfinished string for format 'z'");
+        len = (size_t)(z - (data + pos));
+        hydrogen_pushlstring(L, data + pos, len);
+        pos += len + 1;  /* skip string plus final '\0' */
+        break;
+      }
+      case Kpaddalign: case Kpadding: case Knop:
+        n--;  /* undo increment */
+        break;
+    }
+    pos += size;
+  }
+  hydrogen_pushinteger(L, pos + 1);  /* next position */
+  return n + 1;
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** COMPILED STRUCT LAYOUTS
+** =======================================================
+*/
+
+
+#define STRUCTHANDLE	"STRUCT*"
+
+
+/*
+** How a field moves between a Hydrogen value and its bytes. Integers
+** with native endianness and the size of a C type, and floats with
+** native endianness, are copied directly into a variable of that type;
+** all others go through 'packint'/'unpackint'/'copywithendian'.
+*/
+#define MOVEGENERIC	0
+#define MOVECHAR	1  /* 1-byte integer */
+#define MOVESHORT	2  /* C short */
+#define MOVEINT		3  /* C int */
+#define MOVEINTEGER	4  /* hydrogen_Integer */
+#define MOVENATIVE	5  /* float with native endianness */
+
+
+typedef struct StructField {
+  unsigned char opt;  /* kind of option (a 'KOption') */
+  unsigned char move;  /* how to move the field ('MOVE*') */
+  unsigned char islittle;  /* endianness of the field */
+  int size;  /* size of the field */
+  int align;  /* its alignment (0 if none) */
+} StructField;
+
+
+/*
+** A format compiled into its list of fields, leaving out the options
+** that only configure the following ones. Alignment is still computed
+** from the actual position of each field, so that a layout behaves
+** exactly as 'string.pack'/'string.unpack' with its format.
+*/
+typedef struct Struct {
+  int nfields;  /* number of fields */
+  int nvalues;  /* number of fields that correspond to values */
+  StructField fields[1];  /* fields (actual size is 'nfields') */
+} Struct;
+
+
+static int movekind (const Header *h, KOption opt, int size) {
+  if (h->islittle != nativeendian.little && size > 1)
+    return MOVEGENERIC;
+  switch (opt) {
+    case Kint: case Kuint:
+      if (size == SZINT) return MOVEINTEGER;
+      else if (size == (int)sizeof(int)) return MOVEINT;
+      else if (size == (int)sizeof(short)) return MOVESHORT;
+      else if (size == 1) return MOVECHAR;
+      else return MOVEGENERIC;
+    case Kfloat: case Knumber: case Kdouble:
+      return MOVENATIVE;
+    default:
+      return MOVEGENERIC;
+  }
+}
+
+
+static int str_struct (hydrogen_State *L) {
+  Header h;
+  const char *fmt = hydrogenL_checkstring(L, 1);
+  const char *p = fmt;
+  Struct *st;
+  int n = 0;
+  initheader(L, &h);
+  while (*p != '\0') {  /* count fields (and check the format) */
+    int size, align;
+    if (getalign(&h, &p, &size, &align) != Knop)
+      n++;
+  }
+  st = (Struct *)hydrogen_newuserdatauv(L, sizeof(Struct) +
+                                   n * sizeof(StructField), 1);
+  st->nfields = n;
+  st->nvalues = 0;
+  initheader(L, &h);
+  for (p = fmt, n = 0; *p != '\0'; ) {
+    int size, align;
+    KOption opt = getalign(&h, &p, &size, &align);
+    if (opt != Knop) {
+      StructField *f = &st->fields[n++];
+      f->opt = (unsigned char)opt;
+      f->move = (unsigned char)movekind(&h, opt, size);
+      f->islittle = (unsigned char)h.islittle;
+      f->size = size;
+      f->align = align;
+      if (opt != Kpadding && opt != Kpaddalign)
+        st->nvalues++;
+    }
+  }
+  hydrogen_pushvalue(L, 1);
+  hydrogen_setiuservalue(L, -2, 1);  /* keep the format */
+  hydrogenL_setmetatable(L, STRUCTHANDLE);
+  return 1;
+}
+
+
+/*
+** Check the integer at 'arg' fits in field 'f', as 'str_pack' does.
+*/
+static hydrogen_Integer checkintfield (hydrogen_State *L,
+                                       const StructField *f, int arg) {
+  hydrogen_Integer n = hydrogenL_checkinteger(L, arg);
+  if (f->size < SZINT) {  /* need overflow check? */
+    if (f->opt == Kint) {
+      hydrogen_Integer lim = (hydrogen_Integer)1 << ((f->size * NB) - 1);
+      hydrogenL_argcheck(L, -lim <= n && n < lim, arg, "integer overflow");
+    }
+    else
+      hydrogenL_argcheck(L, (hydrogen_Unsigned)n <
+                           ((hydrogen_Unsigned)1 << (f->size * NB)),
+                           arg, "unsigned overflow");
+  }
+  return n;
+}
+
+
+/*
+** Add to 'b' the fixed-size number field 'f' with the value at 'arg'.
+*/
+static void packfield (hydrogen_State *L, hydrogenL_Buffer *b,
+                       const StructField *f, int arg) {
+  char *buff;
+  if (f->opt == Kint || f->opt == Kuint) {
+    hydrogen_Integer n = checkintfield(L, f, arg);
+    buff = hydrogenL_prepbuffsize(b, f->size);
+    switch (f->move) {
+      case MOVECHAR: *buff = (char)(n & MC); break;
+      case MOVESHORT: {
+        unsigned short v = (unsigned short)n;
+        memcpy(buff, &v, sizeof(v));
+        break;
+      }
+      case MOVEINT: {
+        unsigned int v = (unsigned int)n;
+        memcpy(buff, &v, sizeof(v));
+        break;
+      }
+      case MOVEINTEGER: memcpy(buff, &n, sizeof(n)); break;
+      default: {
+        packint(b, (hydrogen_Unsigned)n, f->islittle, f->size,
+                   (f->opt == Kint && n < 0));
+        return;  /* 'packint' already added the bytes */
+      }
+    }
+  }
+  else {
+    hydrogen_Number n = hydrogenL_checknumber(L, arg);
+    int little = (f->move == MOVENATIVE) ? nativeendian.little : f->islittle;
+    buff = hydrogenL_prepbuffsize(b, f->size);
+    if (f->opt == Kfloat) {
+      float v = (float)n;
+      copywithendian(buff, (char *)&v, sizeof(v), little);
+    }
+    else if (f->opt == Kdouble) {
+      double v = (double)n;
+      copywithendian(buff, (char *)&v, sizeof(v), little);
+    }
+    else
+      copywithendian(buff, (char *)&n, sizeof(n), little);
+  }
+  hydrogenL_addsize(b, f->size);
+}
+
+
+static int struct_pack (hydrogen_State *L) {
+  hydrogenL_Buffer b;
+  const Struct *st = (const Struct *)hydrogenL_checkudata(L, 1, STRUCTHANDLE);
+  int arg = 1;  /* current argument to pack */
+  size_t totalsize = 0;  /* accumulate total size of result */
+  int i;
+  hydrogen_pushnil(L);  /* mark to separate arguments from string buffer */
+  hydrogenL_buffinit(L, &b);
+  for (i = 0; i < st->nfields; i++) {
+    const StructField *f = &st->fields[i];
+    int ntoalign = padding(totalsize, f->align);
+    totalsize += ntoalign + f->size;
+    while (ntoalign-- > 0)
+     hydrogenL_addchar(&b, HYDROGENL_PACKPADBYTE);  /* fill alignment */
+    switch (f->opt) {
+      case Kint: case Kuint: case Kfloat: case Knumber: case Kdouble:
+        packfield(L, &b, f, ++arg);
+        break;
+      case Kchar: {  /* fixed-size string */
+        size_t len;
+        const char *s = hydrogenL_checkbytes(L, ++arg, &len);
+        hydrogenL_argcheck(L, len <= (size_t)f->size, arg,
+                         "string longer than given size");
+        hydrogenL_addlstring(&b, s, len);  /* add string */
+        while (len++ < (size_t)f->size)  /* pad extra space */
+          hydrogenL_addchar(&b, HYDROGENL_PACKPADBYTE);
+        break;
+      }
+      case Kstring: {  /* strings with length count */
+        size_t len;
+        const char *s = hydrogenL_checkbytes(L, ++arg, &len);
+        hydrogenL_argcheck(L, f->size >= (int)sizeof(size_t) ||
+                         len < ((size_t)1 << (f->size * NB)),
+                         arg, "string length does not fit in given size");
+        packint(&b, (hydrogen_Unsigned)len, f->islittle, f->size, 0);
+        hydrogenL_addlstring(&b, s, len);
+        totalsize += len;
+        break;
+      }
+      case Kzstr: {  /* zero-terminated string */
+        size_t len;
+        const char *s = hydrogenL_checkbytes(L, ++arg, &len);
+        hydrogenL_argcheck(L, memchr(s, '\0', len) == NULL, arg,
+                              "string contains zeros");
+        hydrogenL_addlstring(&b, s, len);
+        hydrogenL_addchar(&b, '\0');  /* add zero at the end */
+        totalsize += len + 1;
+        break;
+      }
+      case Kpadding: hydrogenL_addchar(&b, HYDROGENL_PACKPADBYTE); break;
+      default: break;  /* Kpaddalign */
+    }
+  }
+  hydrogenL_pushresult(&b);
+  return 1;
+}
+
+
+/*
+** Push the fixed-size number field 'f' stored at 'p'.
+*/
+static void unpackfield (hydrogen_State *L, const StructField *f,
+                         const char *p) {
+  int issigned = (f->opt == Kint);
+  switch (f->move) {
+    case MOVECHAR: {
+      hydrogen_pushinteger(L, issigned ? (hydrogen_Integer)(signed char)*p
+                                       : (hydrogen_Integer)(unsigned char)*p);
+      break;
+    }
+    case MOVESHORT: {
+      unsigned short v;
+      memcpy(&v, p, sizeof(v));
+      hydrogen_pushinteger(L, issigned ? (hydrogen_Integer)(short)v
+                                       : (hydrogen_Integer)v);
+      break;
+    }
+    case MOVEINT: {
+      unsigned int v;
+      memcpy(&v, p, sizeof(v));
+      hydrogen_pushinteger(L, issigned ? (hydrogen_Integer)(int)v
+                                       : (hydrogen_Integer)v);
+      break;
+    }
+    case MOVEINTEGER: {
+      hydrogen_Integer v;
+      memcpy(&v, p, sizeof(v));
+      hydrogen_pushinteger(L, v);
+      break;
+    }
+    default: {
+      int little = (f->move == MOVENATIVE) ? nativeendian.little
+                                           : f->islittle;
+      if (f->opt == Kfloat) {
+        float v;
+        copywithendian((char *)&v, p, sizeof(v), little);
+        hydrogen_pushnumber(L, (hydrogen_Number)v);
+      }
+      else if (f->opt == Kdouble) {
+        double v;
+        copywithendian((char *)&v, p, sizeof(v), little);
+        hydrogen_pushnumber(L, (hydrogen_Number)v);
+      }
+      else if (f->opt == Knumber) {
+        hydrogen_Number v;
+        copywithendian((char *)&v, p, sizeof(v), little);
+        hydrogen_pushnumber(L, v);
+      }
+      else
+        hydrogen_pushinteger(L, unpackint(L, p, f->islittle, f->size,
+                                             issigned));
+      break;
+    }
+  }
+}
+
+
+/*
+** Push the values of one record of 'st' stored in 'data' at '*ppos',
+** advancing '*ppos' past it. (The caller must ensure stack space for
+** 'st->nvalues' values.)
+*/
+static void unpackrecord (hydrogen_State *L, const Struct *st,
+                          const char *data, size_t ld, size_t *ppos) {
+  size_t pos = *ppos;
+  int i;
+  for (i = 0; i < st->nfields; i++) {
+    const StructField *f = &st->fields[i];
+    int ntoalign = padding(pos, f->align);
+    hydrogenL_argcheck(L, (size_t)ntoalign + f->size <= ld - pos, 2,
+                    "data string too short");
+    pos += ntoalign;  /* skip alignment */
+    switch (f->opt) {
+      case Kint: case Kuint: case Kfloat: case Knumber: case Kdouble:
+        unpackfield(L, f, data + pos);
+        break;
+      case Kchar:
+        hydrogen_pushlstring(L, data + pos, f->size);
+        break;
+      case Kstring: {
+        size_t len = (size_t)unpackint(L, data + pos, f->islittle,
+                                       f->size, 0);
+        hydrogenL_argcheck(L, len <= ld - pos - f->size, 2,
+                         "data string too short");
+        hydrogen_pushlstring(L, data + pos + f->size, len);
+        pos += len;  /* skip string */
+        break;
+      }
+      case Kzstr: {  /* (the data may not be followed by a '\0') */
+        const char *z = (const char *)memchr(data + pos, '\0', ld - pos);
+        size_t len;
+        hydrogenL_argcheck(L, z != NULL, 2,
+                         "unfinished string for format 'z'");
+        len = (size_t)(z - (data + pos));
+        hydrogen_pushlstring(L, data + pos, len);
+        pos += len + 1;  /* skip string plus final '\0' */
+        break;
+      }
+      default: break;  /* Kpaddalign, Kpadding */
+    }
+    pos += f->size;
+  }
+  *ppos = pos;
+}
+
+
+static int struct_unpack (hydrogen_State *L) {
+  const Struct *st = (const Struct *)hydrogenL_checkudata(L, 1, STRUCTHANDLE);
+  size_t ld;
+  const char *data = hydrogenL_checkbytes(L, 2, &ld);
+  size_t pos = posrelatI(hydrogenL_optinteger(L, 3, 1), ld) - 1;
+  hydrogenL_argcheck(L, pos <= ld, 3, "initial position out of string");
+  hydrogenL_checkstack(L, st->nvalues + 1, "too many results");
+  unpackrecord(L, st, data, ld, &pos);
+  hydrogen_pushinteger(L, pos + 1);  /* next position */
+  return st->nvalues + 1;
+}
+
+
+/*
+** unpackmany(s [, n [, pos [, columns]]]): unpack 'n' consecutive
+** records (or all records up to the end of 's') into a table. Each
+** record is a table with its values, unless 'columns' is true; then
+** the result has one array for each value of the layout.
+*/
+static int struct_unpackmany (hydrogen_State *L) {
+  const Struct *st = (const Struct *)hydrogenL_checkudata(L, 1, STRUCTHANDLE);
+  size_t ld;
+  const char *data = hydrogenL_checkbytes(L, 2, &ld);
+  hydrogen_Integer n = hydrogenL_optinteger(L, 3, -1);  /* -1: up to the end */
+  size_t pos = posrelatI(hydrogenL_optinteger(L, 4, 1), ld) - 1;
+  int columns = hydrogen_toboolean(L, 5);
+  int nv = st->nvalues;
+  int hint, res, i;
+  hydrogen_Integer k;
+  hydrogenL_argcheck(L, pos <= ld, 4, "initial position out of string");
+  /* each record uses at least one byte; do not trust 'n' beyond that */
+  hint = (n >= 0 && (size_t)n <= ld - pos && n < INT_MAX) ? (int)n : 0;
+  hydrogen_settop(L, 2);
+  hydrogenL_checkstack(L, nv + 3, "too many results");
+  hydrogen_createtable(L, columns ? nv : hint, 0);  /* result */
+  res = hydrogen_gettop(L);
+  if (columns) {  /* create one array for each value */
+    for (i = 1; i <= nv; i++) {
+      hydrogen_createtable(L, hint, 0);
+      hydrogen_pushvalue(L, -1);
+      hydrogen_rawseti(L, res, i);
+    }
+  }
+  for (k = 1; (n < 0) ? pos < ld : k <= n; k++) {
+    size_t start = pos;
+    if (columns) {
+      unpackrecord(L, st, data, ld, &pos);
+      for (i = nv; i >= 1; i--)  /* move values to their columns */
+        hydrogen_rawseti(L, res + i, k);
+    }
+    else {
+      hydrogen_createtable(L, nv, 0);
+      unpackrecord(L, st, data, ld, &pos);
+      for (i = nv; i >= 1; i--)  /* move values to the record */
+        hydrogen_rawseti(L, res + 1, i);
+      hydrogen_rawseti(L, res, k);
+    }
+    if (n < 0 && pos == start)  /* empty record would loop forever */
+      break;
+  }
+  hydrogen_settop(L, res);
+  hydrogen_pushinteger(L, pos + 1);  /* next position */
+  return 2;
+}
+
+
+static int struct_tostring (hydrogen_State *L) {
+  hydrogenL_checkudata(L, 1, STRUCTHANDLE);
+  hydrogen_getiuservalue(L, 1, 1);
+  return 1;
+}
+
+
+/*
+** methods for compiled layouts
+*/
+static const hydrogenL_Reg structmeth[] = {
+  {"pack", struct_pack},
+  {"unpack", struct_unpack},
+  {"unpackmany", struct_unpackmany},
+  {NULL, NULL}
+};
+
+
+static void createstructmeta (hydrogen_State *L) {
+  hydrogenL_newmetatable(L, STRUCTHANDLE);  /* metatable for layouts */
+  hydrogen_pushcfunction(L, struct_tostring);
+  hydrogen_setfield(L, -2, "__tostring");
+  hydrogenL_newlibtable(L, structmeth);  /* create method table */
+  hydrogenL_setfuncs(L, structmeth, 0);  /* add methods to method table */
+  hydrogen_setfield(L, -2, "__index");  /* metatable.__index = method table */
+  hydrogen_pop(L, 1);  /* pop metatable */
+}
+
+/* }====================================================== */
+
+
+static const hydrogenL_Reg strlib[] = {
+  {"buffer", str_buffer},
+  {"byte", str_byte},
+  {"bytes", str_bytes},
+  {"char", str_char},
+  {"dump", str_dump},
+  {"len", str_len},
+  {"lower", str_lower},
+  {"multisearch", str_multisearch},
+  {"rep", str_rep},
+  {"reverse", str_reverse},
+  {"struct", str_struct},
+  {"sub", str_sub},
+  {"upper", str_upper},
+  {"pack", str_pack},
+  {"packsize", str_packsize},
+  {"unpack", str_unpack},
+  {NULL, NULL}
+};
+
+
+static void createmetatable (hydrogen_State *L) {
+  /* table to be metatable for strings */
+  hydrogenL_newlibtable(L, stringmetamethods);
+  hydrogenL_setfuncs(L, stringmetamethods, 0);
+  hydrogen_pushliteral(L, "");  /* dummy string */
+  hydrogen_pushvalue(L, -2);  /* copy table */
+  hydrogen_setmetatable(L, -2);  /* set table as metatable for strings */
+  hydrogen_pop(L, 1);  /* pop dummy string */
+  hydrogen_pushvalue(L, -2);  /* get string library */
+  hydrogen_setfield(L, -2, "__index");  /* metatable.__index = string */
+  hydrogen_pop(L, 1);  /* pop metatable */
+}
+
+
+/*
+** Open string library
+*/
+HYDROGENMOD_API int hydrogenopen_string (hydrogen_State *L) {
+  hydrogenL_newlib(L, strlib);
+  createmetatable(L);
+  createfmtmeta(L);
+  createbufmeta(L);
+  createmsmeta(L);
+  createstructmeta(L);
+  createpatmeta(L);
+  return 1;
+}
\ No newline at end of file
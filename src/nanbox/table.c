@@ -0,0 +1,1627 @@
+/*
+** $Id: table.c $
+** Hydrogen tables (hash)
+** See Copyright Notice in hydrogen.h
+*/
+
+#define table_c
+#define HYDROGEN_CORE
+
+#include "prefix.h"
+
+
+/*
+** Implementation of tables (aka arrays, objects, or hash tables).
+** Tables keep its elements in two parts: an array part and a hash part.
+** Non-negative integer keys are all candidates to be kept in the array
+** part. The actual size of the array is the largest 'n' such that
+** more than half the slots between 1 and n are in use.
+** Hash uses open addressing with a vector of control bytes, one per
+** node, that is searched a group of nodes at a time (see 'ctrlbyte').
+** With HYDROGEN_COMPACTHASH, the nodes are instead kept in insertion
+** order and found through an index (see 'getindex').
+*/
+
+#include <math.h>
+#include <limits.h>
+#include <string.h>
+
+#include "hydrogen.h"
+
+#include "debug.h"
+#include "do.h"
+#include "garbageCollection.h"
+#include "memory.h"
+#include "object.h"
+#include "state.h"
+#include "string.h"
+#include "table.h"
+#include "virtualMachine.h"
+
+
+/*
+** MAXABITS is the largest integer such that MAXASIZE fits in an
+** unsigned int.
+*/
+#define MAXABITS	cast_int(sizeof(int) * CHAR_BIT - 1)
+
+
+/*
+** MAXASIZE is the maximum size of the array part. It is the minimum
+** between 2^MAXABITS and the maximum size that, measured in bytes,
+** fits in a 'size_t'.
+*/
+#define MAXASIZE	hydrogenM_limitN(1u << MAXABITS, TValue)
+
+/*
+** MAXHBITS is the largest integer such that 2^MAXHBITS fits in a
+** signed int.
+*/
+#define MAXHBITS	(MAXABITS - 1)
+
+
+/*
+** {======================================================
+** Layout of the hash part
+** =======================================================
+*/
+
+#if !defined(HYDROGEN_COMPACTHASH)		/* { */
+
+/*
+** Each node of the hash part has a control byte, kept after the nodes
+** in the same block ('getctrl'): it is CTRLEMPTY for a node that was
+** never used, or the 7 low bits of the hash of its key with the high
+** bit set ('ctrlbyte'). A search for
+** a key compares its control byte with a group of GROUPSIZE control
+** bytes at once (with SSE2, in one instruction) and only compares the
+** keys of the nodes that match. As the probe sequence of a key goes
+** through the nodes that may hold it group by group, the search stops
+** at the first group with a free node. The groups are probed with
+** increasing strides (GROUPSIZE, 2*GROUPSIZE, ...), which visits
+** all groups of a table whose size is a power of 2.
+** A hit through the control bytes reads them and then a node, two
+** cache misses in a large table where a chained hash has one. So each
+** key has a home node in its first group ('homepos'), which a new key
+** takes when it is free, and a search prefetches the home node while
+** it matches the control bytes; most keys are found at home, and the
+** two misses overlap. Misses and inserts read only control bytes. The
+** price is in hits on integer keys with a regular stride: the modulo
+** hash of a chained table puts each of them in its own main position,
+** while the mixed hash here leaves about a quarter of them away from
+** home, so those hits stay up to ~25% slower in tables that do not
+** fit in the cache (tests/bench/tables.hy). A table smaller
+** than a group has GROUPSIZE control bytes anyway; the extra ones stay
+** free, and as they come after the ones of the real nodes, they are
+** never taken for a new key.
+**
+** Nodes are never freed: a removed entry keeps its key with an empty
+** value, so that 'next' finds it (also when it becomes a dead key).
+** Its node can only be reused by its own key or, when the table runs
+** out of free nodes, by a new key that passes through it. Otherwise,
+** running out of free nodes triggers a rehash. 'growthleft' counts the
+** free nodes that may still be used, so that at least 1/8 of a table
+** with more than 8 nodes is always free (see 'sizegrowth').
+*/
+
+#define CTRLEMPTY	0
+
+/* control byte of a key with hash 'h' */
+#define ctrlbyte(h)	cast_byte(0x80 | ((h) & 0x7F))
+
+/* first group of the probe sequence of a key with hash 'h' */
+#define probestart(h,mask)  \
+	(((h) >> 7) & (mask) & ~cast_uint(GROUPSIZE - 1))
+
+/* home node of a key with hash 'h', in the group at 'probestart' */
+#define homepos(h,mask)		(((h) >> 7) & (mask))
+
+#if defined(__GNUC__) && !defined(HYDROGEN_NOBUILTIN)
+#define prefetchnode(n)		__builtin_prefetch(n)
+#else
+#define prefetchnode(n)		((void)(n))
+#endif
+
+
+#if defined(__SSE2__)
+
+#include <emmintrin.h>
+
+#define GROUPSIZE	16
+
+typedef __m128i Group;
+
+#define loadgroup(p)	_mm_loadu_si128(cast(const __m128i *, (p)))
+
+/* bit 'i' of the result is set iff byte 'i' of group 'g' is 'c' */
+#define matchctrl(g,c)  cast_uint(_mm_movemask_epi8( \
+	_mm_cmpeq_epi8(g, _mm_set1_epi8(cast(char, c)))))
+
+#else
+
+#define GROUPSIZE	8
+
+typedef const lu_byte *Group;
+
+#define loadgroup(p)	(p)
+
+static unsigned int matchctrl (Group g, int c) {
+  unsigned int m = 0;
+  int i;
+  for (i = 0; i < GROUPSIZE; i++) {
+    if (g[i] == c)
+      m |= 1u << i;
+  }
+  return m;
+}
+
+#endif
+
+
+/* index of the lowest bit set in 'm' (which is not zero) */
+#if defined(__GNUC__) && !defined(HYDROGEN_NOBUILTIN)
+#define firstbit(m)	cast_uint(__builtin_ctz(m))
+#else
+static unsigned int firstbit (unsigned int m) {
+  unsigned int i = 0;
+  while (!(m & 1u)) {
+    m >>= 1;
+    i++;
+  }
+  return i;
+}
+#endif
+
+
+/* number of entries that a hash part with 'n' nodes can hold */
+#define sizegrowth(n)	((n) - (n) / 8)
+
+/* control bytes of the vector of 2^lsz nodes 'nd' */
+#define nodectrl(nd,lsz)	cast(lu_byte *, (nd) + twoto(lsz))
+
+/* control bytes of the nodes of 't' */
+#define getctrl(t)	nodectrl((t)->node, (t)->lsizenode)
+
+/* number of control bytes for 'n' nodes */
+#define ctrlsize(n)	((n) < GROUPSIZE ? GROUPSIZE : (n))
+
+/* size of the block with 'n' nodes and their control bytes */
+#define nodeblocksize(n)	(cast_sizet(n) * sizeof(Node) + ctrlsize(n))
+
+
+/*
+** Go to the next group in the probe sequence that started at '*pos'
+** with mask 'mask'; return false if the search ends at group 'g' (it
+** has a free node, or all groups have been searched).
+*/
+l_sinline int nextgroup (Group g, unsigned int *pos, unsigned int *step,
+                                  unsigned int mask) {
+  if (matchctrl(g, CTRLEMPTY) != 0 || *step > mask)
+    return 0;
+  *step += GROUPSIZE;
+  *pos = (*pos + *step) & mask;
+  return 1;
+}
+
+
+/*
+** Search the probe sequence of a key with hash 'h' in the vector of
+** 2^lsz nodes 'nd' for a node 'n' that satisfies 'cond' (that is, that
+** holds the key); return its value if there is one.
+*/
+#define searchnode(nd,lsz,h,n,cond) {  \
+  unsigned int mask_ = twoto(lsz) - 1;  \
+  unsigned int pos_ = probestart(h, mask_);  \
+  unsigned int step_ = 0;  \
+  Group g_;  \
+  prefetchnode((nd) + homepos(h, mask_));  \
+  g_ = loadgroup(nodectrl(nd, lsz) + pos_);  \
+  for (;;) {  \
+    unsigned int m_;  \
+    for (m_ = matchctrl(g_, ctrlbyte(h)); m_ != 0; m_ &= m_ - 1) {  \
+      Node *n = (nd) + pos_ + firstbit(m_);  \
+      if (cond) return gval(n);  \
+    }  \
+    if (!nextgroup(g_, &pos_, &step_, mask_))  \
+      break;  \
+    g_ = loadgroup(nodectrl(nd, lsz) + pos_);  \
+  } }
+
+
+/* number of nodes of 't' that may have entries */
+#define usednodes(t)	sizenode(t)
+
+#else						/* }{ */
+
+/*
+** A compact hash part keeps its entries in the nodes in the order they
+** were inserted, so a traversal goes through them in that order and
+** never sees a free node. A new key always takes the first free node.
+** The nodes are found through an index with twice their number of
+** slots, kept after the nodes in the same block: each slot holds 0 or
+** 1 + the position of a node. A key is searched by linear probing from
+** slot 'h & (2 * size - 1)' (where 'h' is its hash) up to a free slot,
+** of which there is always at least one half. Slots take 1, 2, or 4
+** bytes, the smallest size that fits the positions of the nodes.
+**
+** As in the default layout, nodes are never freed: a removed entry
+** keeps its key with an empty value (which 'next' may need), and its
+** node can only be reused by its own key. A rehash drops removed
+** entries. 'growthleft' counts the free nodes at the end.
+*/
+
+/* size of a slot of the index for 'n' nodes */
+#define slotsize(n)  \
+	((n) <= 128 ? 1 : (n) <= 32768 ? 2 : cast_int(sizeof(l_uint32)))
+
+/* the index takes the place of the control bytes */
+#define ctrlsize(n)	(2 * cast_sizet(n) * slotsize(n))
+
+/* size of the block with 'n' nodes and their index */
+#define nodeblocksize(n)	(cast_sizet(n) * sizeof(Node) + ctrlsize(n))
+
+/* number of entries that a hash part with 'n' nodes can hold */
+#define sizegrowth(n)	(n)
+
+/* first bytes of the index of the vector of 2^lsz nodes 'nd' */
+#define nodectrl(nd,lsz)	cast(void *, (nd) + twoto(lsz))
+
+/* first bytes of the index of 't' */
+#define getctrl(t)	nodectrl((t)->node, (t)->lsizenode)
+
+
+/* contents of slot 'i' of the index of the 2^lsz nodes 'nd' */
+l_sinline unsigned int nodeindex (const Node *nd, int lsz, unsigned int i) {
+  if (lsz < 8)
+    return cast(const lu_byte *, nodectrl(nd, lsz))[i];
+  else if (lsz < 16)
+    return cast(const unsigned short *, nodectrl(nd, lsz))[i];
+  else
+    return cast(const l_uint32 *, nodectrl(nd, lsz))[i];
+}
+
+
+/* contents of slot 'i' of the index of 't' */
+#define getindex(t,i)	nodeindex((t)->node, (t)->lsizenode, i)
+
+
+static void setindex (Table *t, unsigned int i, unsigned int v) {
+  if (t->lsizenode < 8)
+    cast(lu_byte *, getctrl(t))[i] = cast_byte(v);
+  else if (t->lsizenode < 16)
+    cast(unsigned short *, getctrl(t))[i] = cast(unsigned short, v);
+  else
+    cast(l_uint32 *, getctrl(t))[i] = cast(l_uint32, v);
+}
+
+
+/* see 'searchnode' above */
+#define searchnode(nd,lsz,h,n,cond) {  \
+  unsigned int mask_ = 2 * twoto(lsz) - 1;  \
+  unsigned int i_ = (h) & mask_;  \
+  unsigned int ix_;  \
+  while ((ix_ = nodeindex(nd, lsz, i_)) != 0) {  \
+    Node *n = (nd) + ix_ - 1;  \
+    if (cond) return gval(n);  \
+    i_ = (i_ + 1) & mask_;  \
+  } }
+
+
+/* number of nodes of 't' that may have entries */
+#define usednodes(t)	(sizenode(t) - (t)->growthleft)
+
+#endif						/* } */
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Incremental resize
+** =======================================================
+*/
+
+/*
+** When the hash part of a table with at least HYDROGENI_MINMIGRATION
+** nodes has to grow (and its array part does not change), its entries
+** are not all moved at once: the new hash part takes the place of the
+** old one, which is kept in a 'Migration' record after the control
+** bytes (or the index) of the new block (flag BITMIGR). Each new key
+** then moves the entries of HYDROGENI_MIGRATESTEP old nodes, and a
+** search that fails in the new part goes on in the old one. A moved
+** node gets a nil key, so that it is not found again. A key is never
+** in both parts: a new key is only inserted after a search in both.
+** Searches do not move entries, as their callers may keep the slot
+** they return. A traversal and any other resize move the remaining
+** entries at once ('hydrogenH_settle'); the collector goes over both
+** parts ('hydrogenH_oldpart').
+*/
+
+#if !defined(HYDROGENI_MINMIGRATION)
+#define HYDROGENI_MINMIGRATION	(1u << 16)
+#endif
+
+#if !defined(HYDROGENI_MIGRATESTEP)
+#define HYDROGENI_MIGRATESTEP	64
+#endif
+
+
+typedef struct Migration {
+  Node *node;  /* old hash part (NULL after all its entries were moved) */
+  size_t blocksize;  /* size of its block */
+  unsigned int next;  /* first old node not yet moved */
+  unsigned int reserve;  /* free nodes kept for the entries not moved */
+  lu_byte lsizenode;  /* log2 of the size of the old hash part */
+} Migration;
+
+
+/* position of the migration record in a block with 'n' nodes */
+#define migroffset(n)  \
+	((nodeblocksize(n) + sizeof(Node) - 1) / sizeof(Node) * sizeof(Node))
+
+/* size of the block of the hash part of 't' */
+#define blocksize(t)  (((t)->flags & BITMIGR)  \
+	? migroffset(sizenode(t)) + sizeof(Migration)  \
+	: nodeblocksize(sizenode(t)))
+
+#define getmigr(t)  \
+	cast(Migration *, cast(char *, (t)->node) + migroffset(sizenode(t)))
+
+/* true if the old hash part of 't' still has entries to move */
+#define ismigrating(t)	(((t)->flags & BITMIGR) && getmigr(t)->node != NULL)
+
+
+/*
+** Search the hash part of 't' (and then its old hash part, if any)
+** for a node 'n' that satisfies 'cond'; return its value, or the
+** absent key if there is none.
+*/
+#define searchhash(t,h,n,cond) {  \
+  searchnode((t)->node, (t)->lsizenode, h, n, cond);  \
+  if (l_unlikely(ismigrating(t))) {  \
+    const Migration *mg_ = getmigr(t);  \
+    searchnode(mg_->node, mg_->lsizenode, h, n, cond);  \
+  }  \
+  return &hydrogenH_absentkey; }
+
+/* }====================================================== */
+
+
+/*
+** MAXHSIZE is the maximum size of the hash part. It is the minimum
+** between 2^MAXHBITS and the maximum size such that, measured in bytes
+** (with the at most 8 bytes per node and 16 per table that follow the
+** nodes), it fits in a 'size_t'.
+*/
+#define MAXHSIZE  \
+  ((cast_sizet(1u << MAXHBITS) <= (MAX_SIZET - 16) / (sizeof(Node) + 8)) \
+    ? (1u << MAXHBITS) : cast_uint((MAX_SIZET - 16) / (sizeof(Node) + 8)))
+
+
+/*
+** The dummy node is followed by another node that only provides its
+** control bytes (or its index), all free. (A node is not smaller than
+** a group.)
+*/
+#define dummynode		(&hydrogenH_dummynode[0])
+
+HYDROGENI_DDEF const Node hydrogenH_dummynode[2] = {
+  {{EMPTYCONSTANT,  /* value's value and type */
+    HYDROGEN_VNIL, {NULL}}}  /* key type and key value */
+};
+
+
+HYDROGENI_DDEF const TValue hydrogenH_absentkey = {ABSTKEYCONSTANT};
+
+
+/*
+** Mix the bits of a hash value, so that both the control byte and the
+** probe start of a key depend on all of them. (String hashes are
+** already good enough.)
+*/
+l_sinline unsigned int mixhash (unsigned int h) {
+  h ^= h >> 16;
+  h *= 0x45d9f3bu;
+  h ^= h >> 16;
+  return h;
+}
+
+
+/*
+** Hash for integers. Both halves of the integer are folded into an
+** unsigned int.
+*/
+l_sinline unsigned int hashint (hydrogen_Integer i) {
+  hydrogen_Unsigned ui = l_castS2U(i);
+  return mixhash(cast_uint(ui ^ (ui >> (sizeof(ui) * CHAR_BIT / 2))));
+}
+
+
+/*
+** Hash for floating-point numbers.
+** The main computation should be just
+**     n = frexp(n, &i); return (n * INT_MAX) + i
+** but there are some numerical subtleties.
+** In a two-complement representation, INT_MAX does not has an exact
+** representation as a float, but INT_MIN does; because the absolute
+** value of 'frexp' is smaller than 1 (unless 'n' is inf/NaN), the
+** absolute value of the product 'frexp * -INT_MIN' is smaller or equal
+** to INT_MAX. Next, the use of 'unsigned int' avoids overflows when
+** adding 'i'; the use of '~u' (instead of '-u') avoids problems with
+** INT_MIN.
+*/
+#if !defined(l_hashfloat)
+static int l_hashfloat (hydrogen_Number n) {
+  int i;
+  hydrogen_Integer ni;
+  n = l_mathop(frexp)(n, &i) * -cast_num(INT_MIN);
+  if (!hydrogen_numbertointeger(n, &ni)) {  /* is 'n' inf/-inf/NaN? */
+    hydrogen_assert(hydrogeni_numisnan(n) || l_mathop(fabs)(n) == cast_num(HUGE_VAL));
+    return 0;
+  }
+  else {  /* normal case */
+    unsigned int u = cast_uint(i) + cast_uint(ni);
+    return cast_int(u <= cast_uint(INT_MAX) ? u : ~u);
+  }
+}
+#endif
+
+
+/*
+** returns the hash of a key, which gives its control byte and its
+** probe sequence
+*/
+static unsigned int hashkey (const TValue *key) {
+  switch (ttypetag(key)) {
+    case HYDROGEN_VNUMINT:
+      return hashint(ivalue(key));
+    case HYDROGEN_VNUMFLT:
+      return mixhash(cast_uint(l_hashfloat(fltvalue(key))));
+    case HYDROGEN_VSHRSTR:
+      return tsvalue(key)->hash;
+    case HYDROGEN_VLNGSTR:
+      return hydrogenS_hashlongstr(tsvalue(key));
+    case HYDROGEN_VFALSE:
+      return mixhash(0);
+    case HYDROGEN_VTRUE:
+      return mixhash(1);
+    case HYDROGEN_VLIGHTUSERDATA:
+      return mixhash(point2uint(pvalue(key)));
+    case HYDROGEN_VLCF:
+      return mixhash(point2uint(fvalue(key)));
+    default:
+      return mixhash(point2uint(gcvalue(key)));
+  }
+}
+
+
+/*
+** Check whether key 'k1' is equal to the key in node 'n2'. This
+** equality is raw, so there are no metamethods. Floats with integer
+** values have been normalized, so integers cannot be equal to
+** floats. It is assumed that 'eqshrstr' is simply pointer equality, so
+** that short strings are handled in the default case.
+** A true 'deadok' means to accept dead keys as equal to their original
+** values. All dead keys are compared in the default case, by pointer
+** identity. (Only collectable objects can produce dead keys.) Note that
+** dead long strings are also compared by identity.
+** Once a key is dead, its corresponding value may be collected, and
+** then another value can be created with the same address. If this
+** other value is given to 'next', 'equalkey' will signal a false
+** positive. In a regular traversal, this situation should never happen,
+** as all keys given to 'next' came from the table itself, and therefore
+** could not have been collected. Outside a regular traversal, we
+** have garbage in, garbage out. What is relevant is that this false
+** positive does not break anything.  (In particular, 'next' will return
+** some other valid item on the table or nil.)
+*/
+static int equalkey (const TValue *k1, const Node *n2, int deadok) {
+  if ((rawtt(k1) != keytt(n2)) &&  /* not the same variants? */
+       !(deadok && keyisdead(n2) && iscollectable(k1)))
+   return 0;  /* cannot be same key */
+  switch (keytt(n2)) {
+    case HYDROGEN_VNIL: case HYDROGEN_VFALSE: case HYDROGEN_VTRUE:
+      return 1;
+    case HYDROGEN_VNUMINT:
+      return (ivalue(k1) == keyival(n2));
+    case HYDROGEN_VNUMFLT:
+      return hydrogeni_numeq(fltvalue(k1), fltvalueraw(keyval(n2)));
+    case HYDROGEN_VLIGHTUSERDATA:
+      return pvalue(k1) == pvalueraw(keyval(n2));
+    case HYDROGEN_VLCF:
+      return fvalue(k1) == fvalueraw(keyval(n2));
+    case ctb(HYDROGEN_VLNGSTR):
+      return hydrogenS_eqlngstr(tsvalue(k1), keystrval(n2));
+    default:
+      return gcvalue(k1) == gcvalueraw(keyval(n2));
+  }
+}
+
+
+/*
+** True if value of 'alimit' is equal to the real size of the array
+** part of table 't'. (Otherwise, the array part must be larger than
+** 'alimit'.)
+*/
+#define limitequalsasize(t)	(isrealasize(t) || ispow2((t)->alimit))
+
+
+/*
+** Returns the real size of the 'array' array
+*/
+HYDROGENI_FUNC unsigned int hydrogenH_realasize (const Table *t) {
+  if (limitequalsasize(t))
+    return t->alimit;  /* this is the size */
+  else {
+    unsigned int size = t->alimit;
+    /* compute the smallest power of 2 not smaller than 'n' */
+    size |= (size >> 1);
+    size |= (size >> 2);
+    size |= (size >> 4);
+    size |= (size >> 8);
+    size |= (size >> 16);
+#if (UINT_MAX >> 30) > 3
+    size |= (size >> 32);  /* unsigned int has more than 32 bits */
+#endif
+    size++;
+    hydrogen_assert(ispow2(size) && size/2 < t->alimit && t->alimit < size);
+    return size;
+  }
+}
+
+
+/*
+** Check whether real size of the array is a power of 2.
+** (If it is not, 'alimit' cannot be changed to any other value
+** without changing the real size.)
+*/
+static int ispow2realasize (const Table *t) {
+  return (!isrealasize(t) || ispow2(t->alimit));
+}
+
+
+static unsigned int setlimittosize (Table *t) {
+  t->alimit = hydrogenH_realasize(t);
+  setrealasize(t);
+  return t->alimit;
+}
+
+
+#define limitasasize(t)	check_exp(isrealasize(t), t->alimit)
+
+
+
+/*
+** "Generic" get version. (Not that generic: not valid for integers,
+** which may be in array part, nor for floats with integral values.)
+** See explanation about 'deadok' in function 'equalkey'.
+*/
+static const TValue *getgeneric (Table *t, const TValue *key, int deadok) {
+  unsigned int h = hashkey(key);
+  searchhash(t, h, n, equalkey(key, n, deadok));
+}
+
+
+/*
+** returns the index for 'k' if 'k' is an appropriate key to live in
+** the array part of a table, 0 otherwise.
+*/
+static unsigned int arrayindex (hydrogen_Integer k) {
+  if (l_castS2U(k) - 1u < MAXASIZE)  /* 'k' in [1, MAXASIZE]? */
+    return cast_uint(k);  /* 'key' is an appropriate array index */
+  else
+    return 0;
+}
+
+
+/*
+** returns the index of a 'key' for table traversals. First Hydrogenes all
+** elements in the array part, then elements in the hash part. The
+** beginning of a traversal is signaled by 0.
+** A live key is searched before a dead one: a new object created at
+** the address of a dead key may have been inserted in a node after
+** the one of that dead key (see 'equalkey').
+*/
+static unsigned int findindex (hydrogen_State *L, Table *t, TValue *key,
+                               unsigned int asize) {
+  unsigned int i;
+  if (ttisnil(key)) return 0;  /* first iteration */
+  i = ttisinteger(key) ? arrayindex(ivalue(key)) : 0;
+  if (i - 1u < asize)  /* is 'key' inside array part? */
+    return i;  /* yes; that's the index */
+  else {
+    const TValue *n = getgeneric(t, key, 0);
+    if (isabstkey(n))  /* not a live key? */
+      n = getgeneric(t, key, 1);  /* it may be a dead one */
+    if (l_unlikely(isabstkey(n)))
+      hydrogenG_runerror(L, "invalid key to 'next'");  /* key not found */
+    i = cast_int(nodefromval(n) - gnode(t, 0));  /* key index in hash table */
+    /* hash elements are numbered after array ones */
+    return (i + 1) + asize;
+  }
+}
+
+
+int hydrogenH_next (hydrogen_State *L, Table *t, StkId key) {
+  unsigned int asize, i;
+  hydrogenH_settle(L, t);  /* all entries must be in 'node' */
+  asize = hydrogenH_realasize(t);
+  i = findindex(L, t, s2v(key), asize);  /* find original key */
+  for (; i < asize; i++) {  /* try first array part */
+    if (!arrisempty(t, i)) {  /* a non-empty entry? */
+      setivalue(s2v(key), i + 1);
+      arrgetobj(t, i, s2v(key + 1));
+      return 1;
+    }
+  }
+  for (i -= asize; i < cast_uint(usednodes(t)); i++) {  /* hash part */
+    if (!isempty(gval(gnode(t, i)))) {  /* a non-empty entry? */
+      Node *n = gnode(t, i);
+      getnodekey(L, s2v(key), n);
+      setobj2s(L, key + 1, gval(n));
+      return 1;
+    }
+  }
+  return 0;  /* no more elements */
+}
+
+
+static void freehash (hydrogen_State *L, Table *t) {
+  if (!isdummy(t)) {
+    if (ismigrating(t)) {  /* free also the old hash part */
+      Migration *mg = getmigr(t);
+      hydrogenM_freemem(L, mg->node, mg->blocksize);
+    }
+    hydrogenM_freemem(L, t->node, blocksize(t));
+  }
+}
+
+
+static void freearray (hydrogen_State *L, Table *t, unsigned int size) {
+  if (size > 0)
+    hydrogenM_freemem(L, arrblock(t, size), cast_sizet(size) * arrcellsize);
+}
+
+
+/*
+** {=============================================================
+** Rehash
+** ==============================================================
+*/
+
+/*
+** Compute the optimal size for the array part of table 't'. 'nums' is a
+** "count array" where 'nums[i]' is the number of integers in the table
+** between 2^(i - 1) + 1 and 2^i. 'pna' enters with the total number of
+** integer keys in the table and leaves with the number of keys that
+** will Hydrogen to the array part; return the optimal size.  (The condition
+** 'twotoi > 0' in the for loop stops the loop if 'twotoi' overflows.)
+*/
+static unsigned int computesizes (unsigned int nums[], unsigned int *pna) {
+  int i;
+  unsigned int twotoi;  /* 2^i (candidate for optimal size) */
+  unsigned int a = 0;  /* number of elements smaller than 2^i */
+  unsigned int na = 0;  /* number of elements to Hydrogen to array part */
+  unsigned int optimal = 0;  /* optimal size for array part */
+  /* loop while keys can fill more than half of total size */
+  for (i = 0, twotoi = 1;
+       twotoi > 0 && *pna > twotoi / 2;
+       i++, twotoi *= 2) {
+    a += nums[i];
+    if (a > twotoi/2) {  /* more than half elements present? */
+      optimal = twotoi;  /* optimal size (till now) */
+      na = a;  /* all elements up to 'optimal' will Hydrogen to array part */
+    }
+  }
+  hydrogen_assert((optimal == 0 || optimal / 2 < na) && na <= optimal);
+  *pna = na;
+  return optimal;
+}
+
+
+static int countint (hydrogen_Integer key, unsigned int *nums) {
+  unsigned int k = arrayindex(key);
+  if (k != 0) {  /* is 'key' an appropriate array index? */
+    nums[hydrogenO_ceillog2(k)]++;  /* count as such */
+    return 1;
+  }
+  else
+    return 0;
+}
+
+
+/*
+** Count keys in array part of table 't': Fill 'nums[i]' with
+** number of keys that will Hydrogen into corresponding slice and return
+** total number of non-nil keys.
+*/
+static unsigned int numusearray (const Table *t, unsigned int *nums) {
+  int lg;
+  unsigned int ttlg;  /* 2^lg */
+  unsigned int ause = 0;  /* summation of 'nums' */
+  unsigned int i = 1;  /* count to traverse all array keys */
+  unsigned int asize = limitasasize(t);  /* real array size */
+  /* traverse each slice */
+  for (lg = 0, ttlg = 1; lg <= MAXABITS; lg++, ttlg *= 2) {
+    unsigned int lc = 0;  /* counter */
+    unsigned int lim = ttlg;
+    if (lim > asize) {
+      lim = asize;  /* adjust upper limit */
+      if (i > lim)
+        break;  /* no more elements to count */
+    }
+    /* count elements in range (2^(lg - 1), 2^lg] */
+    for (; i <= lim; i++) {
+      if (!arrisempty(t, i - 1))
+        lc++;
+    }
+    nums[lg] += lc;
+    ause += lc;
+  }
+  return ause;
+}
+
+
+static int numusehash (const Table *t, unsigned int *nums, unsigned int *pna) {
+  int totaluse = 0;  /* total number of elements */
+  int ause = 0;  /* elements added to 'nums' (can Hydrogen to array part) */
+  int i = sizenode(t);
+  while (i--) {
+    Node *n = &t->node[i];
+    if (!isempty(gval(n))) {
+      if (keyisinteger(n))
+        ause += countint(keyival(n), nums);
+      totaluse++;
+    }
+  }
+  *pna += ause;
+  return totaluse;
+}
+
+
+/*
+** Creates an array for the hash part of a table that can hold the
+** given number of entries, or reuses the dummy node if it is zero.
+** The control bytes go in the same block, after the nodes, followed
+** by a migration record if 'migr' is true.
+** The computation for size overflow is in two steps: the first
+** comparison ensures that the shift in the second one does not
+** overflow.
+*/
+static void setnodevector (hydrogen_State *L, Table *t, unsigned int size,
+                                                    int migr) {
+  t->flags &= cast_byte(~BITMIGR);
+  if (size == 0) {  /* no elements to hash part? */
+    t->node = cast(Node *, dummynode);  /* use common 'dummynode' */
+    t->lsizenode = 0;
+    t->growthleft = 0;
+  }
+  else {
+    int i;
+    int lsize = hydrogenO_ceillog2(size);
+    if (lsize <= MAXHBITS && sizegrowth(1u << lsize) < size)
+      lsize++;  /* keep the minimum of free nodes */
+    if (lsize > MAXHBITS || (1u << lsize) > MAXHSIZE)
+      hydrogenG_runerror(L, "table overflow");
+    size = twoto(lsize);
+    t->node = cast(Node *, hydrogenM_malloc_(L, migr
+                ? migroffset(size) + sizeof(Migration)
+                : nodeblocksize(size), 0));
+    if (migr)
+      t->flags |= BITMIGR;
+    for (i = 0; i < (int)size; i++) {
+      Node *n = gnode(t, i);
+      setnilkey(n);
+      setempty(gval(n));
+    }
+    t->lsizenode = cast_byte(lsize);
+    memset(getctrl(t), 0, ctrlsize(size));  /* all free */
+    t->growthleft = sizegrowth(size);  /* all nodes are free */
+  }
+}
+
+
+/*
+** (Re)insert all elements from the hash part of 'ot' into table 't'.
+*/
+static void reinsert (hydrogen_State *L, Table *ot, Table *t) {
+  int j;
+  int size = sizenode(ot);
+  for (j = 0; j < size; j++) {
+    Node *old = gnode(ot, j);
+    if (!isempty(gval(old))) {
+      /* doesn't need barrier/invalidate cache, as entry was
+         already present in the table */
+      TValue k;
+      getnodekey(L, &k, old);
+      hydrogenH_set(L, t, &k, gval(old));
+    }
+  }
+}
+
+
+/*
+** Reallocate the array part of 't' from 'oldasize' to 'newasize'
+** entries, keeping the first ones; new entries are not initialized.
+** Return false, with the array part unchanged, if the allocation fails.
+** Without NaN boxing, the tags go after the values in the new block
+** (see 'arrval'), so the array part cannot be reallocated in place.
+*/
+static int reallocarray (hydrogen_State *L, Table *t, unsigned int oldasize,
+                                                  unsigned int newasize) {
+#if defined(HYDROGEN_NANBOXING)
+  TValue *newarray = hydrogenM_reallocvector(L, t->array, oldasize, newasize,
+                                                              TValue);
+  if (newarray == NULL && newasize > 0)
+    return 0;
+  t->array = newarray;
+#else
+  Value *newarray = NULL;
+  if (newasize > 0) {
+    unsigned int n = (oldasize < newasize) ? oldasize : newasize;
+    void *block = hydrogenM_realloc_(L, NULL, 0,
+                                     cast_sizet(newasize) * arrcellsize);
+    if (block == NULL)
+      return 0;
+    newarray = cast(Value *, block) + newasize;
+    if (n > 0) {  /* copy the values and the tags of kept entries */
+      memcpy(newarray - n, t->array - n, n * sizeof(Value));
+      memcpy(newarray, t->array, n * sizeof(lu_byte));
+    }
+  }
+  freearray(L, t, oldasize);
+  t->array = newarray;
+#endif
+  return 1;
+}
+
+
+/*
+** Exchange the hash part of 't1' and 't2'.
+*/
+static void exchangehashpart (Table *t1, Table *t2) {
+  lu_byte lsizenode = t1->lsizenode;
+  Node *node = t1->node;
+  unsigned int growthleft = t1->growthleft;
+  lu_byte migr = cast_byte(t1->flags & BITMIGR);
+  t1->lsizenode = t2->lsizenode;
+  t1->node = t2->node;
+  t1->growthleft = t2->growthleft;
+  t1->flags = (t1->flags & cast_byte(~BITMIGR)) | (t2->flags & BITMIGR);
+  t2->lsizenode = lsizenode;
+  t2->node = node;
+  t2->growthleft = growthleft;
+  t2->flags = (t2->flags & cast_byte(~BITMIGR)) | migr;
+}
+
+
+/*
+** Resize table 't' for the new given sizes. Both allocations (for
+** the hash part and for the array part) can fail, which creates some
+** subtleties. If the first allocation, for the hash part, fails, an
+** error is raised and that is it. Otherwise, it copies the elements from
+** the shrinking part of the array (if it is shrinking) into the new
+** hash. Then it reallocates the array part.  If that fails, the table
+** is in its original state; the function frees the new hash part and then
+** raises the allocation error. Otherwise, it sets the new hash part
+** into the table, initializes the new part of the array (if any) with
+** nils and reinserts the elements of the old hash back into the new
+** parts of the table.
+*/
+void hydrogenH_resize (hydrogen_State *L, Table *t, unsigned int newasize,
+                                          unsigned int nhsize) {
+  unsigned int i;
+  Table newt;  /* to keep the new hash part */
+  unsigned int oldasize;
+  hydrogenH_settle(L, t);  /* all entries must be in 'node' */
+  oldasize = setlimittosize(t);
+  /* create new hash part with appropriate size into 'newt' */
+  newt.flags = 0;
+  setnodevector(L, &newt, nhsize, 0);
+  if (newasize < oldasize) {  /* will array shrink? */
+    t->alimit = newasize;  /* pretend array has new size... */
+    exchangehashpart(t, &newt);  /* and new hash */
+    /* re-insert into the new hash the elements from vanishing slice */
+    for (i = newasize; i < oldasize; i++) {
+      if (!arrisempty(t, i)) {
+        TValue aux;
+        arrgetobj(t, i, &aux);
+        hydrogenH_setint(L, t, i + 1, &aux);
+      }
+    }
+    t->alimit = oldasize;  /* restore current size... */
+    exchangehashpart(t, &newt);  /* and hash (in case of errors) */
+  }
+  /* allocate new array */
+  if (l_unlikely(!reallocarray(L, t, oldasize, newasize))) {  /* failed? */
+    freehash(L, &newt);  /* release new hash part */
+    hydrogenM_error(L);  /* raise error (with array unchanged) */
+  }
+  /* allocation ok; initialize new part of the array */
+  exchangehashpart(t, &newt);  /* 't' has the new hash ('newt' has the old) */
+  t->alimit = newasize;
+  for (i = oldasize; i < newasize; i++)  /* clear new slice of the array */
+     arrsetempty(t, i);
+  /* re-insert elements from old hash part into new parts */
+  reinsert(L, &newt, t);  /* 'newt' now has the old hash */
+  freehash(L, &newt);  /* free old hash part */
+}
+
+
+/*
+** Start an incremental resize of the hash part of 't' to a new one for
+** 'nhsize' entries, keeping the current one as its old hash part.
+*/
+static void startmigration (hydrogen_State *L, Table *t,
+                                               unsigned int nhsize) {
+  Table newt;
+  Migration *mg;
+  unsigned int used = sizegrowth(sizenode(t)) - t->growthleft;
+  newt.flags = 0;
+  setnodevector(L, &newt, nhsize, 1);
+  exchangehashpart(t, &newt);  /* 't' has the new hash ('newt' has the old) */
+  mg = getmigr(t);
+  mg->node = newt.node;
+  mg->blocksize = blocksize(&newt);
+  mg->next = 0;
+  mg->lsizenode = newt.lsizenode;
+#if !defined(HYDROGEN_COMPACTHASH)
+  mg->reserve = used;  /* each used old node may need a new one */
+#else
+  mg->reserve = 0;
+  t->growthleft -= used;  /* old entries keep their positions */
+#endif
+}
+
+
+void hydrogenH_resizearray (hydrogen_State *L, Table *t, unsigned int nasize) {
+  unsigned int nsize = allocsizenode(t);
+  hydrogenH_resize(L, t, nasize, sizegrowth(nsize));  /* same hash size */
+}
+
+/*
+** nums[i] = number of keys 'k' where 2^(i - 1) < k <= 2^i
+*/
+static void rehash (hydrogen_State *L, Table *t, const TValue *ek) {
+  unsigned int asize;  /* optimal size for array part */
+  unsigned int na;  /* number of keys in the array part */
+  unsigned int nums[MAXABITS + 1];
+  int i;
+  int totaluse;
+  unsigned int nhsize;  /* size for hash part */
+  hydrogen_assert(!ismigrating(t));
+  for (i = 0; i <= MAXABITS; i++) nums[i] = 0;  /* reset counts */
+  setlimittosize(t);
+  na = numusearray(t, nums);  /* count keys in array part */
+  totaluse = na;  /* all those keys are integer keys */
+  totaluse += numusehash(t, nums, &na);  /* count keys in hash part */
+  /* count extra key */
+  if (ttisinteger(ek))
+    na += countint(ivalue(ek), nums);
+  totaluse++;
+  /* compute new size for array part */
+  asize = computesizes(nums, &na);
+  nhsize = totaluse - na;
+#if defined(HYDROGEN_COMPACTHASH)
+  /* removed entries are not reused; leave room for new ones */
+  nhsize += nhsize / 2;
+#endif
+  if (asize == t->alimit &&  /* only the hash part grows? */
+      cast_uint(allocsizenode(t)) >= HYDROGENI_MINMIGRATION &&
+      nhsize > sizegrowth(cast_uint(sizenode(t))))
+    startmigration(L, t, nhsize);
+  else  /* resize the table to new computed sizes */
+    hydrogenH_resize(L, t, asize, nhsize);
+}
+
+
+
+/*
+** }=============================================================
+*/
+
+
+Table *hydrogenH_new (hydrogen_State *L) {
+  GCObject *o = hydrogenC_newobj(L, HYDROGEN_VTABLE, sizeof(Table));
+  Table *t = gco2t(o);
+  t->metatable = NULL;
+  t->flags = cast_byte(maskflags);  /* table has no metamethod fields */
+  t->array = NULL;
+  t->alimit = 0;
+  setnodevector(L, t, 0, 0);
+  return t;
+}
+
+
+void hydrogenH_free (hydrogen_State *L, Table *t) {
+  freehash(L, t);
+  freearray(L, t, hydrogenH_realasize(t));
+  hydrogenM_free(L, t);
+}
+
+
+#if !defined(HYDROGEN_COMPACTHASH)
+
+/*
+** Search the probe sequence that starts at '*pos' for a node whose
+** entry was removed; return a mask whose lowest bit marks it in the
+** group at '*pos', or 0 if there is none.
+*/
+static unsigned int findremoved (Table *t, unsigned int *pos,
+                                           unsigned int mask) {
+  unsigned int step = 0;
+  for (;;) {
+    Group g = loadgroup(getctrl(t) + *pos);
+    unsigned int m = ~matchctrl(g, CTRLEMPTY) & ((1u << GROUPSIZE) - 1);
+    for (; m != 0; m &= m - 1) {  /* for each used node in the group */
+      if (isempty(gval(gnode(t, *pos + firstbit(m)))))
+        return m;
+    }
+    if (!nextgroup(g, pos, &step, mask))
+      return 0;
+  }
+}
+
+
+/*
+** Get a node for a new key with hash 'h': its home node or else the
+** first free node in its probe sequence while there are free nodes to
+** use; otherwise, a node in that sequence whose entry was removed.
+** Return NULL if there is no such node.
+*/
+static Node *getfreepos (Table *t, unsigned int h) {
+  unsigned int mask = sizenode(t) - 1;
+  unsigned int pos = probestart(h, mask);
+  unsigned int m;
+  if (t->growthleft > 0) {
+    unsigned int step = 0;
+    if (getctrl(t)[homepos(h, mask)] == CTRLEMPTY)  /* home node free? */
+      m = 1u << (homepos(h, mask) - pos);
+    else while ((m = matchctrl(loadgroup(getctrl(t) + pos), CTRLEMPTY)) == 0) {
+      step += GROUPSIZE;  /* a free node must be in a later group */
+      pos = (pos + step) & mask;
+    }
+    t->growthleft--;
+  }
+  else if ((m = findremoved(t, &pos, mask)) == 0)
+    return NULL;
+  pos += firstbit(m);
+  getctrl(t)[pos] = ctrlbyte(h);
+  return gnode(t, pos);
+}
+
+#else
+
+/* enter node 'e' of 't', for a key with hash 'h', in the index */
+static void indexnode (Table *t, unsigned int h, unsigned int e) {
+  unsigned int mask = 2 * sizenode(t) - 1;
+  unsigned int i = h & mask;
+  while (getindex(t, i) != 0)  /* find a free slot */
+    i = (i + 1) & mask;
+  setindex(t, i, e + 1);
+}
+
+
+/*
+** Get the first free node for a new key with hash 'h' and enter it in
+** the index. Return NULL if there is no free node.
+*/
+static Node *getfreepos (Table *t, unsigned int h) {
+  unsigned int e;
+  if (t->growthleft == 0)
+    return NULL;
+  e = usednodes(t);  /* first free node */
+  t->growthleft--;
+  indexnode(t, h, e);
+  return gnode(t, e);
+}
+
+#endif
+
+
+/*
+** Move the entry of node 'i' of the old hash part of 't' to its hash
+** part, dropping it if it was removed. In a compact hash part, the
+** old entries keep their positions, which were reserved for them.
+*/
+static void moveentry (Table *t, Migration *mg, unsigned int i) {
+  Node *old = mg->node + i;
+  if (keyisnil(old))  /* never used or already moved? */
+    return;
+#if !defined(HYDROGEN_COMPACTHASH)
+  mg->reserve--;  /* this node no longer needs a free one */
+#endif
+  if (!isempty(gval(old))) {
+    TValue k;
+    Node *n;
+    getnodekey(cast(hydrogen_State *, NULL), &k, old);
+#if !defined(HYDROGEN_COMPACTHASH)
+    n = getfreepos(t, hashkey(&k));
+#else
+    n = gnode(t, i);
+    indexnode(t, hashkey(&k), i);
+#endif
+    hydrogen_assert(n != NULL && isempty(gval(n)));
+    /* no barrier needed, as the entry stays in the same table */
+    setnodekey(cast(hydrogen_State *, NULL), n, &k);
+    setobj2t(cast(hydrogen_State *, NULL), gval(n), gval(old));
+  }
+  setnilkey(old);
+  setempty(gval(old));
+}
+
+
+/*
+** Move the entries of the next 'n' nodes of the old hash part of 't'
+** (or of all of them, if there is no free node left for a new key);
+** free the old hash part after its last node.
+*/
+static void migrate (hydrogen_State *L, Table *t, unsigned int n) {
+  Migration *mg = getmigr(t);
+  unsigned int size = twoto(mg->lsizenode);
+  unsigned int lim = size;
+  if (t->growthleft > mg->reserve && size - mg->next > n)
+    lim = mg->next + n;
+  for (; mg->next < lim; mg->next++)
+    moveentry(t, mg, mg->next);
+  if (mg->next == size) {  /* done? */
+    hydrogenM_freemem(L, mg->node, mg->blocksize);
+    mg->node = NULL;
+  }
+}
+
+
+void hydrogenH_endmigration (hydrogen_State *L, Table *t) {
+  if (ismigrating(t))
+    migrate(L, t, twoto(getmigr(t)->lsizenode));
+}
+
+
+/*
+** Return the old hash part of 't', with its size in '*size', or NULL
+** if there are no entries left to move there.
+*/
+Node *hydrogenH_oldpart (Table *t, unsigned int *size) {
+  if (ismigrating(t)) {
+    Migration *mg = getmigr(t);
+    *size = twoto(mg->lsizenode);
+    return mg->node;
+  }
+  return NULL;
+}
+
+
+/*
+** inserts a new key into a hash table, in the first free node of its
+** probe sequence; if there is none to use, rehash the table. (An integer
+** key inside the array part just fills its empty entry there.) Each new
+** key also goes on with an incremental resize of the table.
+*/
+void hydrogenH_newkey (hydrogen_State *L, Table *t, const TValue *key, TValue *value) {
+  Node *mp;
+  TValue aux;
+  if (l_unlikely(ttisnil(key)))
+    hydrogenG_runerror(L, "table index is nil");
+  else if (ttisfloat(key)) {
+    hydrogen_Number f = fltvalue(key);
+    hydrogen_Integer k;
+    if (hydrogenV_flttointeger(f, &k, F2Ieq)) {  /* does key fit in an integer? */
+      setivalue(&aux, k);
+      key = &aux;  /* insert it as an integer */
+    }
+    else if (l_unlikely(hydrogeni_numisnan(f)))
+      hydrogenG_runerror(L, "table index is NaN");
+  }
+  if (ttisnil(value))
+    return;  /* do not insert nil values */
+  if (ttisinteger(key) &&  /* an empty entry of the array part? */
+      l_castS2U(ivalue(key)) - 1u < hydrogenH_realasize(t)) {
+    arrsetobj(t, ivalue(key) - 1, value);
+    return;
+  }
+  if (l_unlikely(ismigrating(t)))  /* being resized? */
+    migrate(L, t, HYDROGENI_MIGRATESTEP);  /* move a few more entries */
+  mp = getfreepos(t, hashkey(key));  /* get a free place */
+  if (mp == NULL) {  /* cannot find a free place? */
+    rehash(L, t, key);  /* grow table */
+    /* whatever called 'newkey' takes care of TM cache */
+    hydrogenH_set(L, t, key, value);  /* insert key into grown table */
+    return;
+  }
+  hydrogen_assert(!isdummy(t));
+  setnodekey(L, mp, key);
+  hydrogenC_barrierback(L, obj2gco(t), key);
+  hydrogen_assert(isempty(gval(mp)));
+  setobj2t(L, gval(mp), value);
+}
+
+
+/*
+** True if integer 'key' is in the array part of 't'. If integer is
+** inside 'alimit', it is. Otherwise, if 'alimit' is not equal to the
+** real size of the array, key still can be in the array part. In this
+** case, try to avoid a call to 'hydrogenH_realasize' when key is just
+** one more than the limit (so that it can be incremented without
+** changing the real size of the array).
+*/
+static int inarray (Table *t, hydrogen_Integer key) {
+  if (l_castS2U(key) - 1u < t->alimit)  /* 'key' in [1, t->alimit]? */
+    return 1;
+  else if (!limitequalsasize(t) &&  /* key still may be in the array part? */
+           (l_castS2U(key) == t->alimit + 1 ||
+            l_castS2U(key) - 1u < hydrogenH_realasize(t))) {
+    t->alimit = cast_uint(key);  /* probably '#t' is here now */
+    return 1;
+  }
+  else
+    return 0;
+}
+
+
+/*
+** Search function for integers in the hash part.
+*/
+static const TValue *gethashint (Table *t, hydrogen_Integer key) {
+  unsigned int h = hashint(key);
+  searchhash(t, h, n, keyisinteger(n) && keyival(n) == key);
+}
+
+
+/*
+** Copy 't[key]' to 'res' and return true if it is present; otherwise,
+** return false (with 'res' unchanged). As entries of the array part
+** are not TValues (see 'arrval'), integer keys are read by copying.
+*/
+int hydrogenH_getint (Table *t, hydrogen_Integer key, TValue *res) {
+  if (inarray(t, key))
+    return arrtryget(t, key - 1, res);
+  else {
+    const TValue *slot = gethashint(t, key);
+    if (isempty(slot))
+      return 0;
+    setobj(cast(hydrogen_State *, NULL), res, slot);
+    return 1;
+  }
+}
+
+
+/* true if 't[key]' is present */
+static int hasint (Table *t, hydrogen_Integer key) {
+  TValue aux;
+  return hydrogenH_getint(t, key, &aux);
+}
+
+
+/*
+** search function for short strings
+*/
+const TValue *hydrogenH_getshortstr (Table *t, TString *key) {
+  unsigned int h = key->hash;
+  hydrogen_assert(key->tt == HYDROGEN_VSHRSTR);
+  searchhash(t, h, n, keyisshrstr(n) && eqshrstr(keystrval(n), key));
+}
+
+
+/*
+** search function for short strings that also stores in '*hint' the
+** index of the node where 'key' was found (see 'hydrogenH_getcached')
+*/
+const TValue *hydrogenH_getshortstrhint (Table *t, TString *key,
+                                       unsigned int *hint) {
+  const TValue *slot = hydrogenH_getshortstr(t, key);
+  if (!isabstkey(slot) && !ismigrating(t))  /* found in 'node'? */
+    *hint = cast_uint(nodefromval(slot) - gnode(t, 0));
+  return slot;
+}
+
+
+const TValue *hydrogenH_getstr (Table *t, TString *key) {
+  if (key->tt == HYDROGEN_VSHRSTR)
+    return hydrogenH_getshortstr(t, key);
+  else {  /* for long strings, use generic case */
+    TValue ko;
+    setsvalue(cast(hydrogen_State *, NULL), &ko, key);
+    return getgeneric(t, &ko, 0);
+  }
+}
+
+
+/*
+** If 'key' is an integer or a float with an integral value, put it in
+** '*k' and return true.
+*/
+static int keytoint (const TValue *key, hydrogen_Integer *k) {
+  if (ttisinteger(key)) {
+    *k = ivalue(key);
+    return 1;
+  }
+  else  /* integral index? */
+    return (ttisfloat(key) && hydrogenV_flttointeger(fltvalue(key), k, F2Ieq));
+}
+
+
+/*
+** Search function for keys that are not integral numbers (which can
+** only live in the hash part).
+*/
+static const TValue *getnotint (Table *t, const TValue *key) {
+  switch (ttypetag(key)) {
+    case HYDROGEN_VSHRSTR: return hydrogenH_getshortstr(t, tsvalue(key));
+    case HYDROGEN_VNIL: return &hydrogenH_absentkey;
+    default: return getgeneric(t, key, 0);
+  }
+}
+
+
+/*
+** main search function; as 'hydrogenH_getint', it copies 't[key]' to
+** 'res' and returns whether it is present.
+*/
+int hydrogenH_get (Table *t, const TValue *key, TValue *res) {
+  hydrogen_Integer k;
+  const TValue *slot;
+  if (keytoint(key, &k))
+    return hydrogenH_getint(t, k, res);  /* use specialized version */
+  slot = getnotint(t, key);
+  if (isempty(slot))
+    return 0;
+  setobj(cast(hydrogen_State *, NULL), res, slot);
+  return 1;
+}
+
+
+/*
+** Set 't[key]' to 'value' if 't[key]' is present, returning true.
+** Otherwise, return false with '*slot' pointing to where the value
+** should go, for a later 'hydrogenH_finishset' (after the check for
+** a '__newindex' metamethod). An empty entry of the array part has no
+** such place; the absent key stands for it ('hydrogenH_newkey' fills the
+** entry).
+** Beware: when using this function you probably need to check a GC
+** barrier.
+*/
+int hydrogenH_trysetint (Table *t, hydrogen_Integer key, TValue *value,
+                                                 const TValue **slot) {
+  if (inarray(t, key)) {
+    if (arrisempty(t, key - 1)) {
+      *slot = &hydrogenH_absentkey;
+      return 0;
+    }
+    arrsetobj(t, key - 1, value);
+  }
+  else {
+    const TValue *p = gethashint(t, key);
+    if (isempty(p)) {
+      *slot = p;
+      return 0;
+    }
+    setobj2t(cast(hydrogen_State *, NULL), cast(TValue *, p), value);
+  }
+  return 1;
+}
+
+
+/*
+** Generic version of 'hydrogenH_trysetint'.
+*/
+int hydrogenH_tryset (Table *t, const TValue *key, TValue *value,
+                                            const TValue **slot) {
+  hydrogen_Integer k;
+  const TValue *p;
+  if (keytoint(key, &k))
+    return hydrogenH_trysetint(t, k, value, slot);
+  p = getnotint(t, key);
+  if (isempty(p)) {
+    *slot = p;
+    return 0;
+  }
+  setobj2t(cast(hydrogen_State *, NULL), cast(TValue *, p), value);
+  return 1;
+}
+
+
+/*
+** Finish a raw "set table" operation, where 'slot' is where the value
+** should have been (the result of a previous "get table").
+** Beware: when using this function you probably need to check a GC
+** barrier and invalidate the TM cache.
+*/
+void hydrogenH_finishset (hydrogen_State *L, Table *t, const TValue *key,
+                                   const TValue *slot, TValue *value) {
+  if (isabstkey(slot))
+    hydrogenH_newkey(L, t, key, value);
+  else
+    setobj2t(L, cast(TValue *, slot), value);
+}
+
+
+/*
+** beware: when using this function you probably need to check a GC
+** barrier and invalidate the TM cache.
+*/
+void hydrogenH_set (hydrogen_State *L, Table *t, const TValue *key, TValue *value) {
+  const TValue *slot;
+  if (!hydrogenH_tryset(t, key, value, &slot))
+    hydrogenH_finishset(L, t, key, slot, value);
+}
+
+
+/*
+** A raw set needs no metamethod check, so an empty slot of the array
+** part is written in place instead of going through 'hydrogenH_newkey'.
+*/
+void hydrogenH_setint (hydrogen_State *L, Table *t, hydrogen_Integer key, TValue *value) {
+  const TValue *slot;
+  if (inarray(t, key))
+    arrsetobj(t, key - 1, value);
+  else if (!hydrogenH_trysetint(t, key, value, &slot)) {
+    TValue k;
+    setivalue(&k, key);
+    hydrogenH_finishset(L, t, &k, slot, value);
+  }
+}
+
+
+/*
+** Set 't[i + 1]', ..., 't[i + n]' to the unsigned values of bytes
+** 's[0]', ..., 's[n - 1]', writing them straight into the array part
+** of 't', which must hold those keys. Integers need no barrier.
+*/
+void hydrogenH_setbytes (Table *t, unsigned int i, const char *s,
+                                               unsigned int n) {
+  unsigned int k;
+  hydrogen_assert(i + n <= hydrogenH_realasize(t));
+  for (k = 0; k < n; k++) {
+    TValue v;
+    setivalue(&v, cast_uchar(s[k]));
+    arrsetobj(t, i + k, &v);
+  }
+}
+
+
+/*
+** Try to find a boundary in the hash part of table 't'. From the
+** caller, we know that 'j' is zero or present and that 'j + 1' is
+** present. We want to find a larger key that is absent from the
+** table, so that we can do a binary search between the two keys to
+** find a boundary. We keep doubling 'j' until we get an absent index.
+** If the doubling would overflow, we try HYDROGEN_MAXINTEGER. If it is
+** absent, we are ready for the binary search. ('j', being max integer,
+** is larger or equal to 'i', but it cannot be equal because it is
+** absent while 'i' is present; so 'j > i'.) Otherwise, 'j' is a
+** boundary. ('j + 1' cannot be a present integer key because it is
+** not a valid integer in Hydrogen.)
+*/
+static hydrogen_Unsigned hash_search (Table *t, hydrogen_Unsigned j) {
+  hydrogen_Unsigned i;
+  if (j == 0) j++;  /* the caller ensures 'j + 1' is present */
+  do {
+    i = j;  /* 'i' is a present index */
+    if (j <= l_castS2U(HYDROGEN_MAXINTEGER) / 2)
+      j *= 2;
+    else {
+      j = HYDROGEN_MAXINTEGER;
+      if (!hasint(t, j))  /* t[j] not present? */
+        break;  /* 'j' now is an absent index */
+      else  /* weird case */
+        return j;  /* well, max integer is a boundary... */
+    }
+  } while (hasint(t, j));  /* repeat until an absent t[j] */
+  /* i < j  &&  t[i] present  &&  t[j] absent */
+  while (j - i > 1u) {  /* do a binary search between them */
+    hydrogen_Unsigned m = (i + j) / 2;
+    if (!hasint(t, m)) j = m;
+    else i = m;
+  }
+  return i;
+}
+
+
+static unsigned int binsearch (const Table *t, unsigned int i,
+                                               unsigned int j) {
+  while (j - i > 1u) {  /* binary search */
+    unsigned int m = (i + j) / 2;
+    if (arrisempty(t, m - 1)) j = m;
+    else i = m;
+  }
+  return i;
+}
+
+
+/*
+** Try to find a boundary in table 't'. (A 'boundary' is an integer index
+** such that t[i] is present and t[i+1] is absent, or 0 if t[1] is absent
+** and 'maxinteger' if t[maxinteger] is present.)
+** (In the next explanation, we use Hydrogen indices, that is, with base 1.
+** The code itself uses base 0 when indexing the array part of the table.)
+** The code starts with 'limit = t->alimit', a position in the array
+** part that may be a boundary.
+**
+** (1) If 't[limit]' is empty, there must be a boundary before it.
+** As a common case (e.g., after 't[#t]=nil'), check whether 'limit-1'
+** is present. If so, it is a boundary. Otherwise, do a binary search
+** between 0 and limit to find a boundary. In both cases, try to
+** use this boundary as the new 'alimit', as a hint for the next call.
+**
+** (2) If 't[limit]' is not empty and the array has more elements
+** after 'limit', try to find a boundary there. Again, try first
+** the special case (which should be quite frequent) where 'limit+1'
+** is empty, so that 'limit' is a boundary. Otherwise, check the
+** last element of the array part. If it is empty, there must be a
+** boundary between the old limit (present) and the last element
+** (absent), which is found with a binary search. (This boundary always
+** can be a new limit.)
+**
+** (3) The last case is when there are no elements in the array part
+** (limit == 0) or its last element (the new limit) is present.
+** In this case, must check the hash part. If there is no hash part
+** or 'limit+1' is absent, 'limit' is a boundary.  Otherwise, call
+** 'hash_search' to find a boundary in the hash part of the table.
+** (In those cases, the boundary is not inside the array part, and
+** therefore cannot be used as a new limit.)
+*/
+hydrogen_Unsigned hydrogenH_getn (Table *t) {
+  unsigned int limit = t->alimit;
+  if (limit > 0 && arrisempty(t, limit - 1)) {  /* (1)? */
+    /* there must be a boundary before 'limit' */
+    if (limit >= 2 && !arrisempty(t, limit - 2)) {
+      /* 'limit - 1' is a boundary; can it be a new limit? */
+      if (ispow2realasize(t) && !ispow2(limit - 1)) {
+        t->alimit = limit - 1;
+        setnorealasize(t);  /* now 'alimit' is not the real size */
+      }
+      return limit - 1;
+    }
+    else {  /* must search for a boundary in [0, limit] */
+      unsigned int boundary = binsearch(t, 0, limit);
+      /* can this boundary represent the real size of the array? */
+      if (ispow2realasize(t) && boundary > hydrogenH_realasize(t) / 2) {
+        t->alimit = boundary;  /* use it as the new limit */
+        setnorealasize(t);
+      }
+      return boundary;
+    }
+  }
+  /* 'limit' is zero or present in table */
+  if (!limitequalsasize(t)) {  /* (2)? */
+    /* 'limit' > 0 and array has more elements after 'limit' */
+    if (arrisempty(t, limit))  /* 'limit + 1' is empty? */
+      return limit;  /* this is the boundary */
+    /* else, try last element in the array */
+    limit = hydrogenH_realasize(t);
+    if (arrisempty(t, limit - 1)) {  /* empty? */
+      /* there must be a boundary in the array after old limit,
+         and it must be a valid new limit */
+      unsigned int boundary = binsearch(t, t->alimit, limit);
+      t->alimit = boundary;
+      return boundary;
+    }
+    /* else, new limit is present in the table; check the hash part */
+  }
+  /* (3) 'limit' is the last element and either is zero or present in table */
+  hydrogen_assert(limit == hydrogenH_realasize(t) &&
+             (limit == 0 || !arrisempty(t, limit - 1)));
+  if (isdummy(t) || !hasint(t, cast(hydrogen_Integer, limit + 1)))
+    return limit;  /* 'limit + 1' is absent */
+  else  /* 'limit + 1' is also present */
+    return hash_search(t, limit);
+}
+
+
+
+#if defined(HYDROGEN_DEBUG)
+
+/* export these functions for the test library */
+
+Node *hydrogenH_mainposition (const Table *t, const TValue *key) {
+#if !defined(HYDROGEN_COMPACTHASH)
+  return gnode(t, probestart(hashkey(key), sizenode(t) - 1));
+#else
+  unsigned int ix = getindex(t, hashkey(key) & (2 * sizenode(t) - 1));
+  return (ix == 0) ? NULL : gnode(t, ix - 1);
+#endif
+}
+
+int hydrogenH_isdummy (const Table *t) { return isdummy(t); }
+
+#endif
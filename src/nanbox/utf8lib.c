@@ -0,0 +1,462 @@
+/*
+** $Id: utf8lib.c $
+** Standard library for UTF-8 manipulation
+** See Copyright Notice in hydrogen.h
+*/
+
+#define utf8lib_c
+#define HYDROGEN_LIB
+
+#include "prefix.h"
+
+
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "hydrogen.h"
+
+#include "auxlib.h"
+#include "hydrogenlib.h"
+
+
+#define MAXUNICODE	0x10FFFFu
+
+#define MAXUTF		0x7FFFFFFFu
+
+/*
+** Integer type for decoded UTF-8 values; MAXUTF needs 31 bits.
+*/
+#if (UINT_MAX >> 30) >= 1
+typedef unsigned int utfint;
+#else
+typedef unsigned long utfint;
+#endif
+
+
+#define iscont(p)	((*(p) & 0xC0) == 0x80)
+
+
+/* from strlib */
+/* translate a relative string position: negative means back from end */
+static hydrogen_Integer u_posrelat (hydrogen_Integer pos, size_t len) {
+  if (pos >= 0) return pos;
+  else if (0u - (size_t)pos > len) return 0;
+  else return (hydrogen_Integer)len + pos + 1;
+}
+
+
+/*
+** Decode one UTF-8 sequence, returning NULL if byte sequence is
+** invalid.  The array 'limits' stores the minimum value for each
+** sequence length, to check for overlong representations. Its first
+** entry forces an error for non-ascii bytes with no continuation
+** bytes (count == 0).
+*/
+static const char *utf8_decode (const char *s, utfint *val, int strict) {
+  static const utfint limits[] =
+        {~(utfint)0, 0x80, 0x800, 0x10000u, 0x200000u, 0x4000000u};
+  unsigned int c = (unsigned char)s[0];
+  utfint res = 0;  /* final result */
+  if (c < 0x80)  /* ascii? */
+    res = c;
+  else {
+    int count = 0;  /* to count number of continuation bytes */
+    for (; c & 0x40; c <<= 1) {  /* while it needs continuation bytes... */
+      unsigned int cc = (unsigned char)s[++count];  /* read next byte */
+      if ((cc & 0xC0) != 0x80)  /* not a continuation byte? */
+        return NULL;  /* invalid byte sequence */
+      res = (res << 6) | (cc & 0x3F);  /* add lower 6 bits from cont. byte */
+    }
+    res |= ((utfint)(c & 0x7F) << (count * 5));  /* add first byte */
+    if (count > 5 || res > MAXUTF || res < limits[count])
+      return NULL;  /* invalid byte sequence */
+    s += count;  /* skip continuation bytes read */
+  }
+  if (strict) {
+    /* check for invalid code points; too large or surrogates */
+    if (res > MAXUNICODE || (0xD800u <= res && res <= 0xDFFFu))
+      return NULL;
+  }
+  if (val) *val = res;
+  return s + 1;  /* +1 to include first byte */
+}
+
+
+/*
+** {======================================================
+** Validation and counting of whole slices
+** =======================================================
+*/
+
+#if defined(__SSE2__)
+
+/* index of the lowest bit set in 'm' (which is not zero) */
+#if defined(__GNUC__) && !defined(HYDROGEN_NOBUILTIN)
+#define firstbit(m)	((unsigned int)__builtin_ctz(m))
+#else
+static unsigned int firstbit (unsigned int m) {
+  unsigned int i = 0;
+  while (!(m & 1u)) {
+    m >>= 1;
+    i++;
+  }
+  return i;
+}
+#endif
+
+#endif
+
+
+/*
+** Length of the run of ASCII bytes at the start of 's', which has 'l'
+** bytes. With SSE2, checks 16 bytes at a time.
+*/
+static size_t asciispan (const char *s, size_t l) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + 16 <= l; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+    unsigned int m = (unsigned int)_mm_movemask_epi8(v);  /* high bits */
+    if (m != 0)  /* some non-ASCII byte? */
+      return i + firstbit(m);
+  }
+#endif
+  while (i < l && (unsigned char)s[i] < 0x80)
+    i++;
+  return i;
+}
+
+
+#define inrange(c,lo,hi)	((unsigned int)((c) - (lo)) <= (unsigned int)((hi) - (lo)))
+
+
+/*
+** Skip the multi-byte sequence at 's', returning NULL if it is not
+** well formed in strict UTF-8. It accepts the same sequences as
+** 'utf8_decode' with 'strict', but checks the ranges of the first two
+** bytes directly (see table 3-7 in the Unicode Standard) instead of
+** decoding the code point. As the string ends with a '\0', which is
+** not a continuation byte, it never reads past the end.
+*/
+static const char *utf8_skip (const char *s) {
+  const unsigned char *p = (const unsigned char *)s;
+  unsigned int c = p[0];
+  if (c < 0xC2)  /* continuation byte or overlong 2-byte sequence? */
+    return NULL;
+  else if (c < 0xE0)  /* 2 bytes */
+    return inrange(p[1], 0x80, 0xBF) ? s + 2 : NULL;
+  else if (c < 0xF0) {  /* 3 bytes; no overlongs or surrogates */
+    unsigned int lo = (c == 0xE0) ? 0xA0 : 0x80;
+    unsigned int hi = (c == 0xED) ? 0x9F : 0xBF;
+    return (inrange(p[1], lo, hi) && inrange(p[2], 0x80, 0xBF))
+           ? s + 3 : NULL;
+  }
+  else if (c < 0xF5) {  /* 4 bytes; no overlongs or values > MAXUNICODE */
+    unsigned int lo = (c == 0xF0) ? 0x90 : 0x80;
+    unsigned int hi = (c == 0xF4) ? 0x8F : 0xBF;
+    return (inrange(p[1], lo, hi) && inrange(p[2], 0x80, 0xBF) &&
+            inrange(p[3], 0x80, 0xBF)) ? s + 4 : NULL;
+  }
+  else
+    return NULL;
+}
+
+
+/*
+** Count in '*pn' the characters of 's' that start in the range
+** ['*ppos', 'e'). Runs of ASCII bytes are counted in bulk and other
+** characters are only checked, not decoded (unless 'lax'). Returns 0
+** if it finds an invalid sequence, with '*ppos' pointing to it.
+*/
+static int utf8_count (const char *s, size_t *ppos, size_t e, int lax,
+                       hydrogen_Integer *pn) {
+  size_t pos = *ppos;
+  hydrogen_Integer n = 0;
+  while (pos < e) {
+    if ((unsigned char)s[pos] < 0x80) {  /* run of ASCII characters? */
+      size_t k = asciispan(s + pos, e - pos);
+      n += (hydrogen_Integer)k;
+      pos += k;
+    }
+    else {
+      const char *s1 = lax ? utf8_decode(s + pos, NULL, 0)
+                           : utf8_skip(s + pos);
+      if (s1 == NULL) {  /* invalid sequence? */
+        *ppos = pos;
+        *pn = n;
+        return 0;
+      }
+      pos = s1 - s;
+      n++;
+    }
+  }
+  *ppos = pos;
+  *pn = n;
+  return 1;
+}
+
+/* }====================================================== */
+
+
+/*
+** utf8len(s [, i [, j [, lax]]]) --> number of characters that
+** start in the range [i,j], or nil + current position if 's' is not
+** well formed in that interval
+*/
+static int utflen (hydrogen_State *L) {
+  hydrogen_Integer n;  /* counter for the number of characters */
+  size_t len;  /* string length in bytes */
+  size_t pos;
+  const char *s = hydrogenL_checklstring(L, 1, &len);
+  hydrogen_Integer posi = u_posrelat(hydrogenL_optinteger(L, 2, 1), len);
+  hydrogen_Integer posj = u_posrelat(hydrogenL_optinteger(L, 3, -1), len);
+  int lax = hydrogen_toboolean(L, 4);
+  hydrogenL_argcheck(L, 1 <= posi && --posi <= (hydrogen_Integer)len, 2,
+                   "initial position out of bounds");
+  hydrogenL_argcheck(L, --posj < (hydrogen_Integer)len, 3,
+                   "final position out of bounds");
+  pos = (size_t)posi;
+  if (!utf8_count(s, &pos, (size_t)(posj + 1), lax, &n)) {
+    hydrogenL_pushfail(L);  /* return fail ... */
+    hydrogen_pushinteger(L, (hydrogen_Integer)pos + 1);  /* ... and position */
+    return 2;
+  }
+  hydrogen_pushinteger(L, n);
+  return 1;
+}
+
+
+/*
+** valid(s [, lax]) --> true if 's' is well formed, or false plus the
+** position of its first invalid sequence
+*/
+static int utfvalid (hydrogen_State *L) {
+  size_t len;
+  size_t pos = 0;
+  hydrogen_Integer n;
+  const char *s = hydrogenL_checklstring(L, 1, &len);
+  if (utf8_count(s, &pos, len, hydrogen_toboolean(L, 2), &n)) {
+    hydrogen_pushboolean(L, 1);
+    return 1;
+  }
+  hydrogen_pushboolean(L, 0);
+  hydrogen_pushinteger(L, (hydrogen_Integer)pos + 1);
+  return 2;
+}
+
+
+/*
+** codepoint(s, [i, [j [, lax]]]) -> returns codepoints for all
+** characters that start in the range [i,j]
+*/
+static int codepoint (hydrogen_State *L) {
+  size_t len;
+  const char *s = hydrogenL_checklstring(L, 1, &len);
+  hydrogen_Integer posi = u_posrelat(hydrogenL_optinteger(L, 2, 1), len);
+  hydrogen_Integer pose = u_posrelat(hydrogenL_optinteger(L, 3, posi), len);
+  int lax = hydrogen_toboolean(L, 4);
+  int n;
+  const char *se;
+  hydrogenL_argcheck(L, posi >= 1, 2, "out of bounds");
+  hydrogenL_argcheck(L, pose <= (hydrogen_Integer)len, 3, "out of bounds");
+  if (posi > pose) return 0;  /* empty interval; return no values */
+  if (pose - posi >= INT_MAX)  /* (hydrogen_Integer -> int) overflow? */
+    return hydrogenL_error(L, "string slice too long");
+  n = (int)(pose -  posi) + 1;  /* upper bound for number of returns */
+  hydrogenL_checkstack(L, n, "string slice too long");
+  n = 0;  /* count the number of returns */
+  se = s + pose;  /* string end */
+  for (s += posi - 1; s < se;) {
+    utfint code;
+    s = utf8_decode(s, &code, !lax);
+    if (s == NULL)
+      return hydrogenL_error(L, "invalid UTF-8 code");
+    hydrogen_pushinteger(L, code);
+    n++;
+  }
+  return n;
+}
+
+
+/*
+** codepoints(s, [i, [j [, lax]]]) -> array with the codepoints of all
+** characters that start in the range [i,j] (by default, the whole
+** string). A first pass validates and counts the characters, so that
+** the array is created with its final size.
+*/
+static int codepoints (hydrogen_State *L) {
+  size_t len, pos, pose;
+  hydrogen_Integer n, k = 0;
+  const char *s = hydrogenL_checklstring(L, 1, &len);
+  hydrogen_Integer posi = u_posrelat(hydrogenL_optinteger(L, 2, 1), len);
+  hydrogen_Integer posj = u_posrelat(hydrogenL_optinteger(L, 3, -1), len);
+  int lax = hydrogen_toboolean(L, 4);
+  hydrogenL_argcheck(L, posi >= 1, 2, "out of bounds");
+  hydrogenL_argcheck(L, posj <= (hydrogen_Integer)len, 3, "out of bounds");
+  pos = (size_t)posi - 1;
+  pose = (posi <= posj) ? (size_t)posj : pos;  /* slice end */
+  if (!utf8_count(s, &pos, pose, lax, &n))
+    return hydrogenL_error(L, "invalid UTF-8 code");
+  if (n >= INT_MAX)  /* (hydrogen_Integer -> int) overflow? */
+    return hydrogenL_error(L, "string slice too long");
+  hydrogen_createtable(L, (int)n, 0);
+  for (pos = (size_t)posi - 1; pos < pose;) {
+    unsigned int c = (unsigned char)s[pos];
+    if (c < 0x80) {  /* ASCII character */
+      hydrogen_pushinteger(L, c);
+      pos++;
+    }
+    else {
+      utfint code;
+      pos = utf8_decode(s + pos, &code, 0) - s;  /* already checked */
+      hydrogen_pushinteger(L, code);
+    }
+    hydrogen_rawseti(L, -2, ++k);
+  }
+  return 1;
+}
+
+
+static void pushutfchar (hydrogen_State *L, int arg) {
+  hydrogen_Unsigned code = (hydrogen_Unsigned)hydrogenL_checkinteger(L, arg);
+  hydrogenL_argcheck(L, code <= MAXUTF, arg, "value out of range");
+  hydrogen_pushfstring(L, "%U", (long)code);
+}
+
+
+/*
+** utfchar(n1, n2, ...)  -> char(n1)..char(n2)...
+*/
+static int utfchar (hydrogen_State *L) {
+  int n = hydrogen_gettop(L);  /* number of arguments */
+  if (n == 1)  /* optimize common case of single char */
+    pushutfchar(L, 1);
+  else {
+    int i;
+    hydrogenL_Buffer b;
+    hydrogenL_buffinit(L, &b);
+    for (i = 1; i <= n; i++) {
+      pushutfchar(L, i);
+      hydrogenL_addvalue(&b);
+    }
+    hydrogenL_pushresult(&b);
+  }
+  return 1;
+}
+
+
+/*
+** offset(s, n, [i])  -> index where n-th character counting from
+**   position 'i' starts; 0 means character at 'i'.
+*/
+static int byteoffset (hydrogen_State *L) {
+  size_t len;
+  const char *s = hydrogenL_checklstring(L, 1, &len);
+  hydrogen_Integer n  = hydrogenL_checkinteger(L, 2);
+  hydrogen_Integer posi = (n >= 0) ? 1 : len + 1;
+  posi = u_posrelat(hydrogenL_optinteger(L, 3, posi), len);
+  hydrogenL_argcheck(L, 1 <= posi && --posi <= (hydrogen_Integer)len, 3,
+                   "position out of bounds");
+  if (n == 0) {
+    /* find beginning of current byte sequence */
+    while (posi > 0 && iscont(s + posi)) posi--;
+  }
+  else {
+    if (iscont(s + posi))
+      return hydrogenL_error(L, "initial position is a continuation byte");
+    if (n < 0) {
+       while (n < 0 && posi > 0) {  /* move back */
+         do {  /* find beginning of previous character */
+           posi--;
+         } while (posi > 0 && iscont(s + posi));
+         n++;
+       }
+     }
+     else {
+       n--;  /* do not move for 1st character */
+       while (n > 0 && posi < (hydrogen_Integer)len) {
+         do {  /* find beginning of next character */
+           posi++;
+         } while (iscont(s + posi));  /* (cannot pass final '\0') */
+         n--;
+       }
+     }
+  }
+  if (n == 0)  /* did it find given character? */
+    hydrogen_pushinteger(L, posi + 1);
+  else  /* no such character */
+    hydrogenL_pushfail(L);
+  return 1;
+}
+
+
+static int iter_aux (hydrogen_State *L, int strict) {
+  size_t len;
+  const char *s = hydrogenL_checklstring(L, 1, &len);
+  hydrogen_Unsigned n = (hydrogen_Unsigned)hydrogen_tointeger(L, 2);
+  if (n < len) {
+    while (iscont(s + n)) n++;  /* skip continuation bytes */
+  }
+  if (n >= len)  /* (also handles original 'n' being negative) */
+    return 0;  /* no more codepoints */
+  else {
+    utfint code;
+    const char *next = utf8_decode(s + n, &code, strict);
+    if (next == NULL)
+      return hydrogenL_error(L, "invalid UTF-8 code");
+    hydrogen_pushinteger(L, n + 1);
+    hydrogen_pushinteger(L, code);
+    return 2;
+  }
+}
+
+
+static int iter_auxstrict (hydrogen_State *L) {
+  return iter_aux(L, 1);
+}
+
+static int iter_auxlax (hydrogen_State *L) {
+  return iter_aux(L, 0);
+}
+
+
+static int iter_codes (hydrogen_State *L) {
+  int lax = hydrogen_toboolean(L, 2);
+  hydrogenL_checkstring(L, 1);
+  hydrogen_pushcfunction(L, lax ? iter_auxlax : iter_auxstrict);
+  hydrogen_pushvalue(L, 1);
+  hydrogen_pushinteger(L, 0);
+  return 3;
+}
+
+
+/* pattern to match a single UTF-8 character */
+#define UTF8PATT	"[\0-\x7F\xC2-\xFD][\x80-\xBF]*"
+
+
+static const hydrogenL_Reg funcs[] = {
+  {"offset", byteoffset},
+  {"codepoint", codepoint},
+  {"codepoints", codepoints},
+  {"char", utfchar},
+  {"len", utflen},
+  {"valid", utfvalid},
+  {"codes", iter_codes},
+  /* placeholders */
+  {"charpattern", NULL},
+  {NULL, NULL}
+};
+
+
+HYDROGENMOD_API int hydrogenopen_utf8 (hydrogen_State *L) {
+  hydrogenL_newlib(L, funcs);
+  hydrogen_pushlstring(L, UTF8PATT, sizeof(UTF8PATT)/sizeof(char) - 1);
+  hydrogen_setfield(L, -2, "charpattern");
+  return 1;
+}
\ No newline at end of file
@@ -0,0 +1,2147 @@
+/*
+** $Id: virtualMachine.c $
+** Hydrogen virtual machine
+** See Copyright Notice in hydrogen.h
+*/
+
+#define virtualMachine_c
+#define HYDROGEN_CORE
+
+#include "prefix.h"
+
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hydrogen.h"
+
+#include "aot.h"
+#include "ctype.h"
+#include "debug.h"
+#include "do.h"
+#include "execute.h"
+#include "function.h"
+#include "garbageCollection.h"
+#include "jit.h"
+#include "object.h"
+#include "opcodes.h"
+#include "state.h"
+#include "string.h"
+#include "table.h"
+#include "tagMethods.h"
+#include "virtualMachine.h"
+
+
+/*
+** By default, use jump tables in the main interpreter loop on gcc
+** and compatible compilers.
+*/
+#if !defined(HYDROGEN_USE_JUMPTABLE)
+#if defined(__GNUC__)
+#define HYDROGEN_USE_JUMPTABLE	1
+#else
+#define HYDROGEN_USE_JUMPTABLE	0
+#endif
+#endif
+
+
+/*
+** With jump tables, the interpreter loop is also direct threaded by
+** default: it dispatches through a predecoded copy of the code of each
+** function (see 'DecodedInstruction'), which holds where the code for
+** each instruction is and its operands.
+*/
+#if !HYDROGEN_USE_JUMPTABLE
+#undef HYDROGEN_USE_DIRECTTHREADING
+#define HYDROGEN_USE_DIRECTTHREADING	0
+#elif !defined(HYDROGEN_USE_DIRECTTHREADING)
+#define HYDROGEN_USE_DIRECTTHREADING	1
+#endif
+
+
+
+/* limit for table tag-method chains (to avoid infinite loops) */
+#define MAXTAGLOOP	2000
+
+
+/*
+** 'l_intfitsf' checks whether a given integer is in the range that
+** can be converted to a float without rounding. Used in comparisons.
+*/
+
+/* number of bits in the mantissa of a float */
+#define NBM		(l_floatatt(MANT_DIG))
+
+/*
+** Check whether some integers may not fit in a float, testing whether
+** (maxinteger >> NBM) > 0. (That implies (1 << NBM) <= maxinteger.)
+** (The shifts are done in parts, to avoid shifting by more than the size
+** of an integer. In a worst case, NBM == 113 for long double and
+** sizeof(long) == 32.)
+*/
+#if ((((HYDROGEN_MAXINTEGER >> (NBM / 4)) >> (NBM / 4)) >> (NBM / 4)) \
+	>> (NBM - (3 * (NBM / 4))))  >  0
+
+/* limit for integers that fit in a float */
+#define MAXINTFITSF	((hydrogen_Unsigned)1 << NBM)
+
+/* check whether 'i' is in the interval [-MAXINTFITSF, MAXINTFITSF] */
+#define l_intfitsf(i)	((MAXINTFITSF + l_castS2U(i)) <= (2 * MAXINTFITSF))
+
+#else  /* all integers fit in a float precisely */
+
+#define l_intfitsf(i)	1
+
+#endif
+
+
+/* maximum length of a numeral to be converted from a view on the C stack */
+#if !defined (L_MAXLENNUM)
+#define L_MAXLENNUM	200
+#endif
+
+
+/*
+** Try to convert a value from string to a number value.
+** If the value is not a string or is a string not representing
+** a valid numeral (or if coercions from strings to numbers
+** are disabled via macro 'cvt2num'), do not modify 'result'
+** and return 0.
+** The bytes of a view may not be followed by a '\0' (see 'isview')
+** and may be shared with other strings, so they are converted from a
+** copy without their surrounding spaces: in a local buffer, or, for a
+** longer numeral, in a block from the allocator (which may raise a
+** memory error) freed right after the conversion.
+*/
+static int l_strton (hydrogen_State *L, const TValue *obj, TValue *result) {
+  hydrogen_assert(obj != result);
+  if (!cvt2num(obj))  /* is object not a string? */
+    return 0;
+  else {
+    TString *ts = tsvalue(obj);
+    const char *s = getstr(ts);
+    size_t l = tsslen(ts);
+    if (isview(ts)) {
+      char buff[L_MAXLENNUM + 1];
+      char *b = buff;
+      int res;
+      while (l > 0 && lisspace(cast_uchar(*s))) {  /* skip leading spaces */
+        s++; l--;
+      }
+      while (l > 0 && lisspace(cast_uchar(s[l - 1])))  /* and trailing ones */
+        l--;
+      if (l > L_MAXLENNUM)  /* too long for 'buff'? */
+        b = hydrogenM_newvector(L, l + 1, char);
+      memcpy(b, s, l * sizeof(char));
+      b[l] = '\0';
+      res = (hydrogenO_str2num(b, result) == l + 1);
+      if (b != buff)
+        hydrogenM_freearray(L, b, l + 1);
+      return res;
+    }
+    return (hydrogenO_str2num(s, result) == l + 1);
+  }
+}
+
+
+/*
+** Try to convert a value to a float. The float case is already handled
+** by the macro 'tonumber'.
+*/
+int hydrogenV_tonumber_ (hydrogen_State *L, const TValue *obj,
+                                           hydrogen_Number *n) {
+  TValue v;
+  if (ttisinteger(obj)) {
+    *n = cast_num(ivalue(obj));
+    return 1;
+  }
+  else if (l_strton(L, obj, &v)) {  /* string coercible to number? */
+    *n = nvalue(&v);  /* convert result of 'hydrogenO_str2num' to a float */
+    return 1;
+  }
+  else
+    return 0;  /* conversion failed */
+}
+
+
+/*
+** try to convert a float to an integer, rounding according to 'mode'.
+*/
+int hydrogenV_flttointeger (hydrogen_Number n, hydrogen_Integer *p, F2Imod mode) {
+  hydrogen_Number f = l_floor(n);
+  if (n != f) {  /* not an integral value? */
+    if (mode == F2Ieq) return 0;  /* fails if mode demands integral value */
+    else if (mode == F2Iceil)  /* needs ceil? */
+      f += 1;  /* convert floor to ceil (remember: n != f) */
+  }
+  return hydrogen_numbertointeger(f, p);
+}
+
+
+/*
+** try to convert a value to an integer, rounding according to 'mode',
+** without string coercion.
+** ("Fast track" handled by macro 'tointegerns'.)
+*/
+int hydrogenV_tointegerns (const TValue *obj, hydrogen_Integer *p, F2Imod mode) {
+  if (ttisfloat(obj))
+    return hydrogenV_flttointeger(fltvalue(obj), p, mode);
+  else if (ttisinteger(obj)) {
+    *p = ivalue(obj);
+    return 1;
+  }
+  else
+    return 0;
+}
+
+
+/*
+** try to convert a value to an integer.
+*/
+int hydrogenV_tointeger (hydrogen_State *L, const TValue *obj,
+                          hydrogen_Integer *p, F2Imod mode) {
+  TValue v;
+  if (l_strton(L, obj, &v))  /* does 'obj' point to a numerical string? */
+    obj = &v;  /* change it to point to its corresponding number */
+  return hydrogenV_tointegerns(obj, p, mode);
+}
+
+
+/*
+** Try to convert a 'for' limit to an integer, preserving the semantics
+** of the loop. Return true if the loop must not run; otherwise, '*p'
+** gets the integer limit.
+** (The following explanation assumes a positive step; it is valid for
+** negative steps mutatis mutandis.)
+** If the limit is an integer or can be converted to an integer,
+** rounding down, that is the limit.
+** Otherwise, check whether the limit can be converted to a float. If
+** the float is too large, clip it to HYDROGEN_MAXINTEGER.  If the float
+** is too negative, the loop should not run, because any initial
+** integer value is greater than such limit; so, the function returns
+** true to signal that. (For this latter case, no integer limit would be
+** correct; even a limit of HYDROGEN_MININTEGER would run the loop once for
+** an initial value equal to HYDROGEN_MININTEGER.)
+*/
+static int forlimit (hydrogen_State *L, hydrogen_Integer init, const TValue *lim,
+                                   hydrogen_Integer *p, hydrogen_Integer step) {
+  if (!hydrogenV_tointeger(L, lim, p, (step < 0 ? F2Iceil : F2Ifloor))) {
+    /* not coercible to in integer */
+    hydrogen_Number flim;  /* try to convert to float */
+    if (!tonumber(L, lim, &flim)) /* cannot convert to float? */
+      hydrogenG_forerror(L, lim, "limit");
+    /* else 'flim' is a float out of integer bounds */
+    if (hydrogeni_numlt(0, flim)) {  /* if it is positive, it is too large */
+      if (step < 0) return 1;  /* initial value must be less than it */
+      *p = HYDROGEN_MAXINTEGER;  /* truncate */
+    }
+    else {  /* it is less than min integer */
+      if (step > 0) return 1;  /* initial value must be greater than it */
+      *p = HYDROGEN_MININTEGER;  /* truncate */
+    }
+  }
+  return (step > 0 ? init > *p : init < *p);  /* not to run? */
+}
+
+
+/*
+** Prepare a numerical for loop (opcode OP_FORPREP).
+** Return true to skip the loop. Otherwise,
+** after preparation, stack will be as follows:
+**   ra : internal index (safe copy of the control variable)
+**   ra + 1 : loop counter (integer loops) or limit (float loops)
+**   ra + 2 : step
+**   ra + 3 : control variable
+*/
+int hydrogenV_forprep (hydrogen_State *L, StkId ra) {
+  TValue *pinit = s2v(ra);
+  TValue *plimit = s2v(ra + 1);
+  TValue *pstep = s2v(ra + 2);
+  if (ttisinteger(pinit) && ttisinteger(pstep)) { /* integer loop? */
+    hydrogen_Integer init = ivalue(pinit);
+    hydrogen_Integer step = ivalue(pstep);
+    hydrogen_Integer limit;
+    if (step == 0)
+      hydrogenG_runerror(L, "'for' step is zero");
+    setivalue(s2v(ra + 3), init);  /* control variable */
+    if (forlimit(L, init, plimit, &limit, step))
+      return 1;  /* skip the loop */
+    else {  /* prepare loop counter */
+      hydrogen_Unsigned count;
+      if (step > 0) {  /* ascending loop? */
+        count = l_castS2U(limit) - l_castS2U(init);
+        if (step != 1)  /* avoid division in the too common case */
+          count /= l_castS2U(step);
+      }
+      else {  /* step < 0; descending loop */
+        count = l_castS2U(init) - l_castS2U(limit);
+        /* 'step+1' avoids negating 'mininteger' */
+        count /= l_castS2U(-(step + 1)) + 1u;
+      }
+      /* store the counter in place of the limit (which won't be
+         needed anymore) */
+      setivalue(plimit, l_castU2S(count));
+    }
+  }
+  else {  /* try making all values floats */
+    hydrogen_Number init; hydrogen_Number limit; hydrogen_Number step;
+    if (l_unlikely(!tonumber(L, plimit, &limit)))
+      hydrogenG_forerror(L, plimit, "limit");
+    if (l_unlikely(!tonumber(L, pstep, &step)))
+      hydrogenG_forerror(L, pstep, "step");
+    if (l_unlikely(!tonumber(L, pinit, &init)))
+      hydrogenG_forerror(L, pinit, "initial value");
+    if (step == 0)
+      hydrogenG_runerror(L, "'for' step is zero");
+    if (hydrogeni_numlt(0, step) ? hydrogeni_numlt(limit, init)
+                            : hydrogeni_numlt(init, limit))
+      return 1;  /* skip the loop */
+    else {
+      /* make sure internal values are all floats */
+      setfltvalue(plimit, limit);
+      setfltvalue(pstep, step);
+      setfltvalue(s2v(ra), init);  /* internal index */
+      setfltvalue(s2v(ra + 3), init);  /* control variable */
+    }
+  }
+  return 0;
+}
+
+
+/*
+** Execute a step of a float numerical for loop, returning
+** true iff the loop must continue. (The integer case is
+** written online with opcode OP_FORLOOP, for performance.)
+*/
+int hydrogenV_floatforloop (StkId ra) {
+  hydrogen_Number step = fltvalue(s2v(ra + 2));
+  hydrogen_Number limit = fltvalue(s2v(ra + 1));
+  hydrogen_Number idx = fltvalue(s2v(ra));  /* internal index */
+  idx = hydrogeni_numadd(L, idx, step);  /* increment index */
+  if (hydrogeni_numlt(0, step) ? hydrogeni_numle(idx, limit)
+                          : hydrogeni_numle(limit, idx)) {
+    chgfltvalue(s2v(ra), idx);  /* update internal index */
+    setfltvalue(s2v(ra + 3), idx);  /* and control variable */
+    return 1;  /* jump back */
+  }
+  else
+    return 0;  /* finish the loop */
+}
+
+
+/*
+** Finish the table access 'val = t[key]'.
+** if 'slot' is NULL, 't' is not a table; otherwise, 'slot' points to
+** t[k] entry (which must be empty).
+*/
+void hydrogenV_finishget (hydrogen_State *L, const TValue *t, TValue *key, StkId val,
+                      const TValue *slot) {
+  int loop;  /* counter to avoid infinite loops */
+  const TValue *tm;  /* metamethod */
+  for (loop = 0; loop < MAXTAGLOOP; loop++) {
+    if (slot == NULL) {  /* 't' is not a table? */
+      hydrogen_assert(!ttistable(t));
+      tm = hydrogenT_gettmbyobj(L, t, TM_INDEX);
+      if (l_unlikely(notm(tm)))
+        hydrogenG_typeerror(L, t, "index");  /* no metamethod */
+      /* else will try the metamethod */
+    }
+    else {  /* 't' is a table */
+      hydrogen_assert(isempty(slot));
+      tm = fasttm(L, hvalue(t)->metatable, TM_INDEX);  /* table's metamethod */
+      if (tm == NULL) {  /* no metamethod? */
+        setnilvalue(s2v(val));  /* result is nil */
+        return;
+      }
+      /* else will try the metamethod */
+    }
+    if (ttisfunction(tm)) {  /* is metamethod a function? */
+      hydrogenT_caltagMethodsres(L, tm, t, key, val);  /* call it */
+      return;
+    }
+    t = tm;  /* else try to access 'tm[key]' */
+    if (hydrogenV_fastgetv(L, t, key, s2v(val), slot))  /* fast track? */
+      return;  /* done */
+    /* else repeat (tail call 'hydrogenV_finishget') */
+  }
+  hydrogenG_runerror(L, "'__index' chain too long; possible loop");
+}
+
+
+/*
+** Variant of 'hydrogenV_finishget' for a constant short-string key.
+** When 't' is a table whose '__index' is also a table (the usual
+** layout of objects and their classes), the access to that second
+** table goes through the inline-cache hint '*hint'; everything else
+** is handled by the generic function.
+*/
+void hydrogenV_finishgetcached (hydrogen_State *L, const TValue *t,
+                                TValue *key, StkId val, const TValue *slot,
+                                unsigned int *hint) {
+  if (slot != NULL) {  /* 't' is a table? */
+    const TValue *tm = fasttm(L, hvalue(t)->metatable, TM_INDEX);
+    if (tm == NULL) {  /* no metamethod? */
+      setnilvalue(s2v(val));  /* result is nil */
+      return;
+    }
+    if (ttistable(tm)) {  /* '__index' is a table? */
+      slot = hydrogenH_getcached(hvalue(tm), tsvalue(key), hint);
+      if (!isempty(slot)) {
+        setobj2s(L, val, slot);  /* done */
+        return;
+      }
+      t = tm;  /* else continue the chain from 'tm' */
+    }
+  }
+  hydrogenV_finishget(L, t, key, val, slot);
+}
+
+
+/*
+** Finish a table assignment 't[key] = val'.
+** If 'slot' is NULL, 't' is not a table.  Otherwise, 'slot' points
+** to the entry 't[key]', or to a value with an absent key if there
+** is no such entry.  (The value at 'slot' must be empty, otherwise
+** 'hydrogenV_fastset' would have done the job.)
+*/
+void hydrogenV_finishset (hydrogen_State *L, const TValue *t, TValue *key,
+                     TValue *val, const TValue *slot) {
+  int loop;  /* counter to avoid infinite loops */
+  for (loop = 0; loop < MAXTAGLOOP; loop++) {
+    const TValue *tm;  /* '__newindex' metamethod */
+    if (slot != NULL) {  /* is 't' a table? */
+      Table *h = hvalue(t);  /* save 't' table */
+      hydrogen_assert(isempty(slot));  /* slot must be empty */
+      tm = fasttm(L, h->metatable, TM_NEWINDEX);  /* get metamethod */
+      if (tm == NULL) {  /* no metamethod? */
+        hydrogenH_finishset(L, h, key, slot, val);  /* set new value */
+        invalidateTMcache(h);
+        hydrogenC_barrierback(L, obj2gco(h), val);
+        return;
+      }
+      /* else will try the metamethod */
+    }
+    else {  /* not a table; check metamethod */
+      tm = hydrogenT_gettmbyobj(L, t, TM_NEWINDEX);
+      if (l_unlikely(notm(tm)))
+        hydrogenG_typeerror(L, t, "index");
+    }
+    /* try the metamethod */
+    if (ttisfunction(tm)) {
+      hydrogenT_caltagMethods(L, tm, t, key, val);
+      return;
+    }
+    t = tm;  /* else repeat assignment over 'tm' */
+    if (hydrogenV_fastset(L, t, key, val, slot))
+      return;  /* done */
+    /* else 'return hydrogenV_finishset(L, t, key, val, slot)' (loop) */
+  }
+  hydrogenG_runerror(L, "'__newindex' chain too long; possible loop");
+}
+
+
+/*
+** Compare two strings 'l' x 'r' of lengths 'll' and 'lr', both followed
+** by a '\0', returning an integer less-equal-greater than zero if 'l'
+** is less-equal-greater than 'r'.
+** The code is a little tricky because it allows '\0' in the strings
+** and it uses 'strcoll' (to respect locales) for each segments
+** of the strings.
+*/
+static int strsegcmp (const char *l, size_t ll, const char *r, size_t lr) {
+  for (;;) {  /* for each segment */
+    int temp = strcoll(l, r);
+    if (temp != 0)  /* not equal? */
+      return temp;  /* done */
+    else {  /* strings are equal up to a '\0' */
+      size_t len = strlen(l);  /* index of first '\0' in both strings */
+      if (len == lr)  /* 'r' is finished? */
+        return (len == ll) ? 0 : 1;  /* check 'l' */
+      else if (len == ll)  /* 'l' is finished? */
+        return -1;  /* 'l' is less than 'r' ('r' is not finished) */
+      /* both strings longer than 'len'; Hydrogen on comparing after the '\0' */
+      len++;
+      l += len; ll -= len; r += len; lr -= len;
+    }
+  }
+}
+
+
+/* size of the buffer on the C stack for copies of views in 'l_strcmp' */
+#define STRCMPBUFF	(4 * HYDROGENI_MINVIEW)
+
+
+/*
+** Compare two strings 'ls' x 'rs'. A view whose bytes are not followed
+** by a '\0' (see 'hydrogenS_isterminated') is compared through a
+** terminated copy, made in a buffer that is gone after the comparison:
+** one on the C stack if both copies fit there, or else one from the
+** allocator. ('strcoll' raises no errors, so that one is always freed.)
+*/
+static int l_strcmp (hydrogen_State *L, TString *ls, TString *rs) {
+  const char *l = getstr(ls);
+  size_t ll = tsslen(ls);
+  const char *r = getstr(rs);
+  size_t lr = tsslen(rs);
+  int tl = hydrogenS_isterminated(ls);
+  int tr = hydrogenS_isterminated(rs);
+  if (tl && tr)  /* usual case */
+    return strsegcmp(l, ll, r, lr);
+  else {
+    char sbuff[STRCMPBUFF];
+    size_t n = (tl ? 0 : ll + 1) + (tr ? 0 : lr + 1);
+    char *buff = (n <= STRCMPBUFF) ? sbuff : hydrogenM_newvector(L, n, char);
+    char *p = buff;
+    int res;
+    if (!tl) {
+      memcpy(p, l, ll * sizeof(char));
+      p[ll] = '\0';
+      l = p;
+      p += ll + 1;
+    }
+    if (!tr) {
+      memcpy(p, r, lr * sizeof(char));
+      p[lr] = '\0';
+      r = p;
+    }
+    res = strsegcmp(l, ll, r, lr);
+    if (buff != sbuff)
+      hydrogenM_freearray(L, buff, n);
+    return res;
+  }
+}
+
+
+/*
+** Check whether integer 'i' is less than float 'f'. If 'i' has an
+** exact representation as a float ('l_intfitsf'), compare numbers as
+** floats. Otherwise, use the equivalence 'i < f <=> i < ceil(f)'.
+** If 'ceil(f)' is out of integer range, either 'f' is greater than
+** all integers or less than all integers.
+** (The test with 'l_intfitsf' is only for performance; the else
+** case is correct for all values, but it is slow due to the conversion
+** from float to int.)
+** When 'f' is NaN, comparisons must result in false.
+*/
+l_sinline int LTintfloat (hydrogen_Integer i, hydrogen_Number f) {
+  if (l_intfitsf(i))
+    return hydrogeni_numlt(cast_num(i), f);  /* compare them as floats */
+  else {  /* i < f <=> i < ceil(f) */
+    hydrogen_Integer fi;
+    if (hydrogenV_flttointeger(f, &fi, F2Iceil))  /* fi = ceil(f) */
+      return i < fi;   /* compare them as integers */
+    else  /* 'f' is either greater or less than all integers */
+      return f > 0;  /* greater? */
+  }
+}
+
+
+/*
+** Check whether integer 'i' is less than or equal to float 'f'.
+** See comments on previous function.
+*/
+l_sinline int LEintfloat (hydrogen_Integer i, hydrogen_Number f) {
+  if (l_intfitsf(i))
+    return hydrogeni_numle(cast_num(i), f);  /* compare them as floats */
+  else {  /* i <= f <=> i <= floor(f) */
+    hydrogen_Integer fi;
+    if (hydrogenV_flttointeger(f, &fi, F2Ifloor))  /* fi = floor(f) */
+      return i <= fi;   /* compare them as integers */
+    else  /* 'f' is either greater or less than all integers */
+      return f > 0;  /* greater? */
+  }
+}
+
+
+/*
+** Check whether float 'f' is less than integer 'i'.
+** See comments on previous function.
+*/
+l_sinline int LTfloatint (hydrogen_Number f, hydrogen_Integer i) {
+  if (l_intfitsf(i))
+    return hydrogeni_numlt(f, cast_num(i));  /* compare them as floats */
+  else {  /* f < i <=> floor(f) < i */
+    hydrogen_Integer fi;
+    if (hydrogenV_flttointeger(f, &fi, F2Ifloor))  /* fi = floor(f) */
+      return fi < i;   /* compare them as integers */
+    else  /* 'f' is either greater or less than all integers */
+      return f < 0;  /* less? */
+  }
+}
+
+
+/*
+** Check whether float 'f' is less than or equal to integer 'i'.
+** See comments on previous function.
+*/
+l_sinline int LEfloatint (hydrogen_Number f, hydrogen_Integer i) {
+  if (l_intfitsf(i))
+    return hydrogeni_numle(f, cast_num(i));  /* compare them as floats */
+  else {  /* f <= i <=> ceil(f) <= i */
+    hydrogen_Integer fi;
+    if (hydrogenV_flttointeger(f, &fi, F2Iceil))  /* fi = ceil(f) */
+      return fi <= i;   /* compare them as integers */
+    else  /* 'f' is either greater or less than all integers */
+      return f < 0;  /* less? */
+  }
+}
+
+
+/*
+** Return 'l < r', for numbers.
+*/
+l_sinline int LTnum (const TValue *l, const TValue *r) {
+  hydrogen_assert(ttisnumber(l) && ttisnumber(r));
+  if (ttisinteger(l)) {
+    hydrogen_Integer li = ivalue(l);
+    if (ttisinteger(r))
+      return li < ivalue(r);  /* both are integers */
+    else  /* 'l' is int and 'r' is float */
+      return LTintfloat(li, fltvalue(r));  /* l < r ? */
+  }
+  else {
+    hydrogen_Number lf = fltvalue(l);  /* 'l' must be float */
+    if (ttisfloat(r))
+      return hydrogeni_numlt(lf, fltvalue(r));  /* both are float */
+    else  /* 'l' is float and 'r' is int */
+      return LTfloatint(lf, ivalue(r));
+  }
+}
+
+
+/*
+** Return 'l <= r', for numbers.
+*/
+l_sinline int LEnum (const TValue *l, const TValue *r) {
+  hydrogen_assert(ttisnumber(l) && ttisnumber(r));
+  if (ttisinteger(l)) {
+    hydrogen_Integer li = ivalue(l);
+    if (ttisinteger(r))
+      return li <= ivalue(r);  /* both are integers */
+    else  /* 'l' is int and 'r' is float */
+      return LEintfloat(li, fltvalue(r));  /* l <= r ? */
+  }
+  else {
+    hydrogen_Number lf = fltvalue(l);  /* 'l' must be float */
+    if (ttisfloat(r))
+      return hydrogeni_numle(lf, fltvalue(r));  /* both are float */
+    else  /* 'l' is float and 'r' is int */
+      return LEfloatint(lf, ivalue(r));
+  }
+}
+
+
+/*
+** return 'l < r' for non-numbers.
+*/
+static int lessthanothers (hydrogen_State *L, const TValue *l, const TValue *r) {
+  hydrogen_assert(!ttisnumber(l) || !ttisnumber(r));
+  if (ttisstring(l) && ttisstring(r))  /* both are strings? */
+    return l_strcmp(L, tsvalue(l), tsvalue(r)) < 0;
+  else
+    return hydrogenT_callorderTM(L, l, r, TM_LT);
+}
+
+
+/*
+** Main operation less than; return 'l < r'.
+*/
+int hydrogenV_lessthan (hydrogen_State *L, const TValue *l, const TValue *r) {
+  if (ttisnumber(l) && ttisnumber(r))  /* both operands are numbers? */
+    return LTnum(l, r);
+  else return lessthanothers(L, l, r);
+}
+
+
+/*
+** return 'l <= r' for non-numbers.
+*/
+static int lessequalothers (hydrogen_State *L, const TValue *l, const TValue *r) {
+  hydrogen_assert(!ttisnumber(l) || !ttisnumber(r));
+  if (ttisstring(l) && ttisstring(r))  /* both are strings? */
+    return l_strcmp(L, tsvalue(l), tsvalue(r)) <= 0;
+  else
+    return hydrogenT_callorderTM(L, l, r, TM_LE);
+}
+
+
+/*
+** Main operation less than or equal to; return 'l <= r'.
+*/
+int hydrogenV_lessequal (hydrogen_State *L, const TValue *l, const TValue *r) {
+  if (ttisnumber(l) && ttisnumber(r))  /* both operands are numbers? */
+    return LEnum(l, r);
+  else return lessequalothers(L, l, r);
+}
+
+
+/*
+** Main operation for equality of Hydrogen values; return 't1 == t2'.
+** L == NULL means raw equality (no metamethods)
+*/
+int hydrogenV_equalobj (hydrogen_State *L, const TValue *t1, const TValue *t2) {
+  const TValue *tm;
+  if (ttypetag(t1) != ttypetag(t2)) {  /* not the same variant? */
+    if (ttype(t1) != ttype(t2) || ttype(t1) != HYDROGEN_TNUMBER)
+      return 0;  /* only numbers can be equal with different variants */
+    else {  /* two numbers with different variants */
+      /* One of them is an integer. If the other does not have an
+         integer value, they cannot be equal; otherwise, compare their
+         integer values. */
+      hydrogen_Integer i1, i2;
+      return (hydrogenV_tointegerns(t1, &i1, F2Ieq) &&
+              hydrogenV_tointegerns(t2, &i2, F2Ieq) &&
+              i1 == i2);
+    }
+  }
+  /* values have same type and same variant */
+  switch (ttypetag(t1)) {
+    case HYDROGEN_VNIL: case HYDROGEN_VFALSE: case HYDROGEN_VTRUE: return 1;
+    case HYDROGEN_VNUMINT: return (ivalue(t1) == ivalue(t2));
+    case HYDROGEN_VNUMFLT: return hydrogeni_numeq(fltvalue(t1), fltvalue(t2));
+    case HYDROGEN_VLIGHTUSERDATA: return pvalue(t1) == pvalue(t2);
+    case HYDROGEN_VLCF: return fvalue(t1) == fvalue(t2);
+    case HYDROGEN_VSHRSTR: return eqshrstr(tsvalue(t1), tsvalue(t2));
+    case HYDROGEN_VLNGSTR: return hydrogenS_eqlngstr(tsvalue(t1), tsvalue(t2));
+    case HYDROGEN_VUSERDATA: {
+      if (uvalue(t1) == uvalue(t2)) return 1;
+      else if (L == NULL) return 0;
+      tm = fasttm(L, uvalue(t1)->metatable, TM_EQ);
+      if (tm == NULL)
+        tm = fasttm(L, uvalue(t2)->metatable, TM_EQ);
+      break;  /* will try TM */
+    }
+    case HYDROGEN_VTABLE: {
+      if (hvalue(t1) == hvalue(t2)) return 1;
+      else if (L == NULL) return 0;
+      tm = fasttm(L, hvalue(t1)->metatable, TM_EQ);
+      if (tm == NULL)
+        tm = fasttm(L, hvalue(t2)->metatable, TM_EQ);
+      break;  /* will try TM */
+    }
+    default:
+      return gcvalue(t1) == gcvalue(t2);
+  }
+  if (tm == NULL)  /* no TM? */
+    return 0;  /* objects are different */
+  else {
+    hydrogenT_caltagMethodsres(L, tm, t1, t2, L->top);  /* call TM */
+    return !l_isfalse(s2v(L->top));
+  }
+}
+
+
+/* macro used by 'hydrogenV_concat' to ensure that element at 'o' is a string */
+#define tostring(L,o)  \
+	(ttisstring(o) || (cvt2str(o) && (hydrogenO_tostring(L, o), 1)))
+
+#define isemptystr(o)	(ttisshrstring(o) && tsvalue(o)->shrlen == 0)
+
+/* copy strings in stack from top - n up to top - 1 to buffer */
+static void copy2buff (StkId top, int n, char *buff) {
+  size_t tl = 0;  /* size already copied */
+  do {
+    size_t l = vslen(s2v(top - n));  /* length of string being copied */
+    memcpy(buff + tl, svalue(s2v(top - n)), l * sizeof(char));
+    tl += l;
+  } while (--n > 0);
+}
+
+
+/*
+** Main operation for concatenation: concat 'total' values in the stack,
+** from 'L->top - total' up to 'L->top - 1'.
+*/
+void hydrogenV_concat (hydrogen_State *L, int total) {
+  if (total == 1)
+    return;  /* "all" values already concatenated */
+  do {
+    StkId top = L->top;
+    int n = 2;  /* number of elements handled in this pass (at least 2) */
+    if (!(ttisstring(s2v(top - 2)) || cvt2str(s2v(top - 2))) ||
+        !tostring(L, s2v(top - 1)))
+      hydrogenT_tryconcatTM(L);
+    else if (isemptystr(s2v(top - 1)))  /* second operand is empty? */
+      cast_void(tostring(L, s2v(top - 2)));  /* result is first operand */
+    else if (isemptystr(s2v(top - 2))) {  /* first operand is empty string? */
+      setobjs2s(L, top - 2, top - 1);  /* result is second op. */
+    }
+    else {
+      /* at least two non-empty string values; get as many as possible */
+      size_t tl = vslen(s2v(top - 1));
+      TString *ts;
+      /* collect total length and number of strings */
+      for (n = 1; n < total && tostring(L, s2v(top - n - 1)); n++) {
+        size_t l = vslen(s2v(top - n - 1));
+        if (l_unlikely(l >= (MAX_SIZE/sizeof(char)) - tl))
+          hydrogenG_runerror(L, "string length overflow");
+        tl += l;
+      }
+      if (tl <= HYDROGENI_MAXSHORTLEN) {  /* is result a short string? */
+        char buff[HYDROGENI_MAXSHORTLEN];
+        copy2buff(top, n, buff);  /* copy strings to buffer */
+        ts = hydrogenS_newlstr(L, buff, tl);
+      }
+      else {  /* long string; copy strings directly to final result */
+        char *rest;
+        ts = hydrogenS_newcat(L, tsvalue(s2v(top - n)), tl, &rest);
+        copy2buff(top, n - 1, rest);  /* copy the other strings */
+      }
+      setsvalue2s(L, top - n, ts);  /* create result */
+    }
+    total -= n-1;  /* Hydrogent 'n' strings to create 1 new */
+    L->top -= n-1;  /* popped 'n' strings and pushed one */
+  } while (total > 1);  /* repeat until only 1 result left */
+}
+
+
+/*
+** Main operation 'ra = #rb'.
+*/
+void hydrogenV_objlen (hydrogen_State *L, StkId ra, const TValue *rb) {
+  const TValue *tm;
+  switch (ttypetag(rb)) {
+    case HYDROGEN_VTABLE: {
+      Table *h = hvalue(rb);
+      tm = fasttm(L, h->metatable, TM_LEN);
+      if (tm) break;  /* metamethod? break switch to call it */
+      setivalue(s2v(ra), hydrogenH_getn(h));  /* else primitive len */
+      return;
+    }
+    case HYDROGEN_VSHRSTR: {
+      setivalue(s2v(ra), tsvalue(rb)->shrlen);
+      return;
+    }
+    case HYDROGEN_VLNGSTR: {
+      setivalue(s2v(ra), tsvalue(rb)->u.lnglen);
+      return;
+    }
+    default: {  /* try metamethod */
+      tm = hydrogenT_gettmbyobj(L, rb, TM_LEN);
+      if (l_unlikely(notm(tm)))  /* no metamethod? */
+        hydrogenG_typeerror(L, rb, "get length of");
+      break;
+    }
+  }
+  hydrogenT_caltagMethodsres(L, tm, rb, rb, ra);
+}
+
+
+/*
+** Integer division; return 'm // n', that is, floor(m/n).
+** C division truncates its result (rounds towards zero).
+** 'floor(q) == trunc(q)' when 'q >= 0' or when 'q' is integer,
+** otherwise 'floor(q) == trunc(q) - 1'.
+*/
+hydrogen_Integer hydrogenV_idiv (hydrogen_State *L, hydrogen_Integer m, hydrogen_Integer n) {
+  if (l_unlikely(l_castS2U(n) + 1u <= 1u)) {  /* special cases: -1 or 0 */
+    if (n == 0)
+      hydrogenG_runerror(L, "attempt to divide by zero");
+    return intop(-, 0, m);   /* n==-1; avoid overflow with 0x80000...//-1 */
+  }
+  else {
+    hydrogen_Integer q = m / n;  /* perform C division */
+    if ((m ^ n) < 0 && m % n != 0)  /* 'm/n' would be negative non-integer? */
+      q -= 1;  /* correct result for different rounding */
+    return q;
+  }
+}
+
+
+/*
+** Integer modulus; return 'm % n'. (Assume that C '%' with
+** negative operands follows C99 behavior. See previous comment
+** about hydrogenV_idiv.)
+*/
+hydrogen_Integer hydrogenV_mod (hydrogen_State *L, hydrogen_Integer m, hydrogen_Integer n) {
+  if (l_unlikely(l_castS2U(n) + 1u <= 1u)) {  /* special cases: -1 or 0 */
+    if (n == 0)
+      hydrogenG_runerror(L, "attempt to perform 'n%%0'");
+    return 0;   /* m % -1 == 0; avoid overflow with 0x80000...%-1 */
+  }
+  else {
+    hydrogen_Integer r = m % n;
+    if (r != 0 && (r ^ n) < 0)  /* 'm/n' would be non-integer negative? */
+      r += n;  /* correct result for different rounding */
+    return r;
+  }
+}
+
+
+/*
+** Float modulus
+*/
+hydrogen_Number hydrogenV_modf (hydrogen_State *L, hydrogen_Number m, hydrogen_Number n) {
+  hydrogen_Number r;
+  hydrogeni_nummod(L, m, n, r);
+  return r;
+}
+
+
+#if !defined(HYDROGEN_NANBOXING)
+
+/* number of bits in an integer */
+#define NBITS	cast_int(sizeof(hydrogen_Integer) * CHAR_BIT)
+
+/* bits of an integer that a shift right moves */
+#define shiftbits(x)	(x)
+
+#else
+
+/* NaN-boxed integers have fewer bits (see 'object.h') */
+#define NBITS	NBINTBITS
+
+#define shiftbits(x)	l_castU2S(l_castS2U(x) & NBPAYLOAD)
+
+#endif
+
+/*
+** Shift left operation. (Shift right just negates 'y'.)
+*/
+#define hydrogenV_shiftr(x,y)	hydrogenV_shiftl(x,intop(-, 0, y))
+
+
+hydrogen_Integer hydrogenV_shiftl (hydrogen_Integer x, hydrogen_Integer y) {
+  if (y < 0) {  /* shift right? */
+    if (y <= -NBITS) return 0;
+    else return intop(>>, shiftbits(x), -y);
+  }
+  else {  /* shift left */
+    if (y >= NBITS) return 0;
+    else return intop(<<, x, y);
+  }
+}
+
+
+/*
+** create a new Hydrogen closure, push it in the stack, and initialize
+** its upvalues.
+*/
+void hydrogenV_pushclosure (hydrogen_State *L, Proto *p, UpVal **enhydrogen,
+                            StkId base, StkId ra) {
+  int nup = p->sizeupvalues;
+  Upvaldesc *uv = p->upvalues;
+  int i;
+  LClosure *ncl = hydrogenF_newLclosure(L, nup);
+  ncl->p = p;
+  setclLvalue2s(L, ra, ncl);  /* anchor new closure in stack */
+  for (i = 0; i < nup; i++) {  /* fill in its upvalues */
+    if (uv[i].instack)  /* upvalue refers to local variable? */
+      ncl->upvals[i] = hydrogenF_findupval(L, base + uv[i].idx);
+    else  /* get upvalue from enclosing function */
+      ncl->upvals[i] = enhydrogen[uv[i].idx];
+    hydrogenC_objbarrier(L, ncl, ncl->upvals[i]);
+  }
+}
+
+
+/*
+** finish execution of an opcode interrupted by a yield
+*/
+void hydrogenV_finishOp (hydrogen_State *L) {
+  CallInfo *ci = L->ci;
+  StkId base = ci->func + 1;
+  Instruction inst = *(ci->u.l.savedpc - 1);  /* interrupted instruction */
+  OpCode op = GET_GENERICOP(inst);
+  switch (op) {  /* finish its execution */
+    case OP_MMBIN: case OP_MMBINI: case OP_MMBINK: {
+      setobjs2s(L, base + GETARG_A(*(ci->u.l.savedpc - 2)), --L->top);
+      break;
+    }
+    case OP_UNM: case OP_BNOT: case OP_LEN:
+    case OP_GETTABUP: case OP_GETTABLE: case OP_GETI:
+    case OP_GETFIELD: case OP_SELF: {
+      setobjs2s(L, base + GETARG_A(inst), --L->top);
+      break;
+    }
+    case OP_LT: case OP_LE:
+    case OP_LTI: case OP_LEI:
+    case OP_GTI: case OP_GEI:
+    case OP_EQ: {  /* note that 'OP_EQI'/'OP_EQK' cannot yield */
+      int res = !l_isfalse(s2v(L->top - 1));
+      L->top--;
+#if defined(HYDROGEN_COMPAT_LT_LE)
+      if (ci->callstatus & CIST_LEQ) {  /* "<=" using "<" instead? */
+        ci->callstatus ^= CIST_LEQ;  /* clear mark */
+        res = !res;  /* negate result */
+      }
+#endif
+      hydrogen_assert(GET_OPCODE(*ci->u.l.savedpc) == OP_JMP);
+      if (res != GETARG_k(inst))  /* condition failed? */
+        ci->u.l.savedpc++;  /* skip jump instruction */
+      break;
+    }
+    case OP_CONCAT: {
+      StkId top = L->top - 1;  /* top when 'hydrogenT_tryconcatTM' was called */
+      int a = GETARG_A(inst);      /* first element to concatenate */
+      int total = cast_int(top - 1 - (base + a));  /* yet to concatenate */
+      setobjs2s(L, top - 2, top);  /* put TM result in proper position */
+      L->top = top - 1;  /* top is one after last element (at top-2) */
+      hydrogenV_concat(L, total);  /* concat them (may yield again) */
+      break;
+    }
+    case OP_CLOSE: {  /* yielded closing variables */
+      ci->u.l.savedpc--;  /* repeat instruction to close other vars. */
+      break;
+    }
+    case OP_RETURN: {  /* yielded closing variables */
+      StkId ra = base + GETARG_A(inst);
+      /* adjust top to signal correct number of returns, in case the
+         return is "up to top" ('isIT') */
+      L->top = ra + ci->u2.nres;
+      /* repeat instruction to close other vars. and complete the return */
+      ci->u.l.savedpc--;
+      break;
+    }
+    default: {
+      /* only these other opcodes can yield */
+      hydrogen_assert(op == OP_TFORCALL || op == OP_CALL ||
+           op == OP_TAILCALL || op == OP_SETTABUP || op == OP_SETTABLE ||
+           op == OP_SETI || op == OP_SETFIELD);
+      break;
+    }
+  }
+}
+
+
+
+
+/*
+** {==================================================================
+** Macros for quickened arithmetic/comparison opcodes in 'hydrogenV_execute'
+** (macros for the generic ones are in 'execute.h')
+** ===================================================================
+*/
+
+/*
+** Quickened arithmetic operations with register operands: 'II' expects
+** two integers and 'FF' two floats. Other operands deoptimize the
+** instruction to its generic opcode 'g' and do the generic operation.
+*/
+#define op_arithII(L,iop,fop,g) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = vRC(i);  \
+  if (l_likely(ttisinteger(v1) && ttisinteger(v2))) {  \
+    hydrogen_Integer i1 = ivalue(v1); hydrogen_Integer i2 = ivalue(v2);  \
+    pc++; setivalue(s2v(ra), iop(L, i1, i2));  \
+  }  \
+  else {  \
+    deoptimizeop(g);  \
+    op_arith_aux(L, v1, v2, iop, fop);  \
+  }}
+
+#define op_arithFF(L,iop,fop,g) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = vRC(i);  \
+  if (l_likely(ttisfloat(v1) && ttisfloat(v2))) {  \
+    hydrogen_Number n1 = fltvalue(v1); hydrogen_Number n2 = fltvalue(v2);  \
+    pc++; setfltvalue(s2v(ra), fop(L, n1, n2));  \
+  }  \
+  else {  \
+    deoptimizeop(g);  \
+    op_arith_aux(L, v1, v2, iop, fop);  \
+  }}
+
+
+/*
+** Quickened order operations with two integer register operands.
+*/
+#define op_orderII(L,opi,opn,other,g) {  \
+        if (l_likely(ttisinteger(s2v(ra)) && ttisinteger(vRB(i)))) {  \
+          int cond = opi(ivalue(s2v(ra)), ivalue(vRB(i)));  \
+          docondjump();  \
+        }  \
+        else {  \
+          deoptimizeop(g);  \
+          op_order(L, opi, opn, other);  \
+        }}
+
+
+/* }================================================================== */
+
+
+/*
+** {==================================================================
+** Quickening: a generic instruction that keeps running with operands
+** of the same types is rewritten in place to a specialized opcode
+** (see notes in 'opcodes.h'). The state of each instruction lives in
+** its inline cache: 'quick.state' has the candidate opcode and how many
+** times in a row it was seen; 'quick.unstable' counts how many times
+** the instruction proved unstable (changed candidate or was
+** deoptimized).
+** ===================================================================
+*/
+
+/* number of runs with the same candidate before quickening */
+#define QUICKENLIMIT	8
+
+/* unstable instructions are no longer observed after that many times */
+#define MAXUNSTABLE	4
+
+#define qstate(op,n)	(cast_uint(op) | (cast_uint(n) << 8))
+#define qop(s)		cast(OpCode, (s) & 0xff)
+#define qcount(s)	((s) >> 8)
+
+
+/*
+** Generic instruction '*pc' ran with operands that suit opcode 'q'
+** ('q' is the generic opcode itself when no specialization applies).
+** Returns true if it rewrote the instruction.
+*/
+static int observe (ICache *ic, Instruction *pc, OpCode q) {
+  unsigned int n = qcount(ic->quick.state);
+  if (n == 0 || qop(ic->quick.state) != q) {  /* first run or new candidate? */
+    if (n > 0)
+      ic->quick.unstable++;  /* operand types are not stable */
+    ic->quick.state = qstate(q, 1);
+  }
+  else if (n < QUICKENLIMIT)
+    ic->quick.state = qstate(q, n + 1);
+  else if (isquickop(q)) {  /* stable specialized candidate? */
+    SET_OPCODE(*pc, q);  /* quicken it */
+    ic->quick.state = 0;
+    return 1;
+  }
+  else  /* stable, but with nothing to specialize */
+    ic->quick.unstable = MAXUNSTABLE;  /* stop observing it */
+  return 0;
+}
+
+
+/*
+** Quickened instruction '*pc' got unexpected operands: turn it back
+** into generic opcode 'op'.
+*/
+static void deoptimize (ICache *ic, Instruction *pc, OpCode op) {
+  SET_OPCODE(*pc, op);
+  ic->quick.state = 0;
+  ic->quick.unstable++;
+}
+
+/* }================================================================== */
+
+
+/*
+** {==================================================================
+** Function 'hydrogenV_execute': main interpreter loop
+** ===================================================================
+*/
+
+/*
+** some macros for common tasks in 'hydrogenV_execute' (the ones shared
+** with code compiled ahead of time are in 'execute.h')
+*/
+
+/* 'q' is only evaluated while the instruction is being observed */
+#define observeop(q)  \
+	{ ICache *ic_ = IC(pc); \
+	  if (ic_->quick.unstable < MAXUNSTABLE && \
+	      observe(ic_, cast(Instruction *, pc - 1), q)) \
+	    redecode(); }
+
+#define deoptimizeop(op)  \
+	{ deoptimize(IC(pc), cast(Instruction *, pc - 1), op); redecode(); }
+
+/* candidate for arithmetic instructions with register operands */
+#define arithcand(qi,qf,op)  \
+	((ttisinteger(vRB(i)) && ttisinteger(vRC(i))) ? (qi) :  \
+	 (ttisfloat(vRB(i)) && ttisfloat(vRC(i))) ? (qf) : (op))
+
+/* true if integer 'n' is within the array limit of table 't' */
+#define arraycand(t,n)  \
+	(ttistable(t) && l_castS2U(n) - 1u < hvalue(t)->alimit)
+
+/*
+** true if 't' is a table and integer 'n' indexes a non-empty entry of
+** its array part; in that case, the entry is copied to 'res'.
+*/
+#define getarray(t,n,res)  \
+	(arraycand(t,n) && hydrogenH_fastgetint(hvalue(t), n, res))
+
+/*
+** true if 't' is a table and integer 'n' indexes an entry of its array
+** part that can be set without a metamethod (see 'hydrogenV_fastseti');
+** in that case, the entry is set to 'v'.
+*/
+l_sinline int setarray (hydrogen_State *L, const TValue *t, hydrogen_Integer n,
+                        TValue *v) {
+  Table *h;
+  if (!arraycand(t, n))
+    return 0;
+  h = hvalue(t);
+  if (h->metatable != NULL && arrisempty(h, n - 1))
+    return 0;  /* may need '__newindex' */
+  arrsetobj(h, n - 1, v);
+  hydrogenC_barrierback(L, obj2gco(h), v);
+  return 1;
+}
+
+
+#if defined(HYDROGEN_USE_JIT)
+/*
+** Backward jump of loop instruction 'i' ('pc' is already the first
+** instruction of the loop body): run the trace of the loop, or count
+** the iteration towards recording one (recording turns 'trap' on).
+*/
+#define jitloop() {  \
+  const Instruction *lpc = pc + GETARG_Bx(i) - 1;  \
+  if (hydrogenJ_traceable(L, IC(lpc + 1))) {  \
+    pc = hydrogenJ_backedge(L, ci, lpc);  \
+    updatetrap(ci);  \
+  }  \
+}
+#endif
+
+
+/*
+** Body of OP_CALL, which also ends all fused instructions.
+*/
+#define op_call() {  \
+  CallInfo *newci;  \
+  int b = GETARG_B(i);  \
+  int nresults = GETARG_C(i) - 1;  \
+  if (b != 0)  /* fixed number of arguments? */  \
+    L->top = ra + b;  /* top signals number of arguments */  \
+  /* else previous instruction set top */  \
+  savepc(L);  /* in case of errors */  \
+  if ((newci = hydrogenD_precall(L, ra, nresults)) == NULL)  \
+    updatetrap(ci);  /* C call; nothing else to be done */  \
+  else {  /* Hydrogen call: run function in this same C frame */  \
+    ci = newci;  \
+    goto startfunc;  \
+  }}
+
+/*
+** Second half of a fused instruction: run the OP_CALL that follows it
+** without a new dispatch. With 'trap' on (hooks, or a stack that may
+** have moved), leave the call to the normal path.
+*/
+#define fusedcall()  \
+  if (l_likely(!trap)) {  \
+    i = *(pc++);  \
+    ra = RA(i);  \
+    hydrogen_assert(GET_OPCODE(i) == OP_CALL);  \
+    op_call();  \
+  }
+
+
+
+#if HYDROGEN_USE_DIRECTTHREADING
+
+/* predecode instruction 'ins' into 'di' */
+#define setdecoded(di,ins)  \
+	((di)->handler = cast_int(cast(const char *,  \
+	                   disptab[GET_OPCODE(ins)]) - HANDLERBASE),  \
+	 (di)->a = cast_byte(getarg(ins, POS_A, SIZE_A)),  \
+	 (di)->b = cast_byte(getarg(ins, POS_B, SIZE_B)),  \
+	 (di)->c = cast_byte(getarg(ins, POS_C, SIZE_C)),  \
+	 (di)->k = cast_byte(getarg(ins, POS_k, 1)))
+
+/* the interpreter rewrote the current instruction; predecode it again */
+#define redecode()	setdecoded(cast(DecodedInstruction *, d), *(pc - 1))
+
+/* predecode the code of prototype 'p' */
+#define decode(L,p) {  \
+  int n_;  \
+  DecodedInstruction *dc_ = hydrogenM_newvector(L, p->sizecode,  \
+                                                DecodedInstruction);  \
+  for (n_ = 0; n_ < p->sizecode; n_++)  \
+    setdecoded(&dc_[n_], p->code[n_]);  \
+  p->dcode = dc_; }
+
+/*
+** Operands of the current instruction come predecoded. (The argument
+** of these macros must be the current instruction.)
+*/
+#undef RB
+#undef KB
+#undef RC
+#undef KC
+#undef RKC
+#define RB(i)	(base+d->b)
+#define KB(i)	(k+d->b)
+#define RC(i)	(base+d->c)
+#define KC(i)	(k+d->c)
+#define RKC(i)	((d->k) ? k + d->c : s2v(base + d->c))
+
+/*
+** Size of a predecoded instruction in instructions, so that the
+** predecoded copy of '*pc' is at the same (scaled) offset as 'pc'
+*/
+#define DECODEDRATIO	(sizeof(DecodedInstruction) / sizeof(Instruction))
+
+/* fetch an instruction and prepare its execution */
+#define vmfetch()	{ \
+  if (l_unlikely(trap)) {  /* stack reallocation or hooks? */ \
+    trap = hydrogenG_traceexec(L, pc);  /* handle hooks */ \
+    updatebase(ci);  /* correct stack */ \
+  } \
+  d = cast(const DecodedInstruction *, cast_charp(dcode) + \
+        (cast_charp(pc) - cast_charp(code)) * DECODEDRATIO); \
+  i = *(pc++); \
+  ra = base + d->a; /* WARNING: any stack reallocation invalidates 'ra' */ \
+}
+
+#else
+
+#define redecode()	((void)0)
+
+/* fetch an instruction and prepare its execution */
+#define vmfetch()	{ \
+  if (l_unlikely(trap)) {  /* stack reallocation or hooks? */ \
+    trap = hydrogenG_traceexec(L, pc);  /* handle hooks */ \
+    updatebase(ci);  /* correct stack */ \
+  } \
+  i = *(pc++); \
+  ra = RA(i); /* WARNING: any stack reallocation invalidates 'ra' */ \
+}
+
+#endif
+
+#define vmdispatch(o)	switch(o)
+#define vmcase(l)	case l:
+#define vmbreak		break
+
+
+void hydrogenV_execute (hydrogen_State *L, CallInfo *ci) {
+  LClosure *cl;
+  TValue *k;
+  StkId base;
+  const Instruction *pc;
+  int trap;
+#if HYDROGEN_USE_DIRECTTHREADING
+  const Instruction *code;  /* code of the running function */
+  const DecodedInstruction *dcode;  /* its predecoded copy */
+#endif
+#if HYDROGEN_USE_JUMPTABLE
+#include "jumptab.h"
+#endif
+ startfunc:
+  trap = L->hookmask;
+ returning:  /* trap already set */
+  cl = clLvalue(s2v(ci->func));
+  k = cl->p->k;
+  pc = ci->u.l.savedpc;
+#if HYDROGEN_USE_DIRECTTHREADING
+  if (l_unlikely(cl->p->dcode == NULL))  /* first run of the function? */
+    decode(L, cl->p);
+  code = cl->p->code;
+  dcode = cl->p->dcode;
+#endif
+  if (l_unlikely(trap)) {
+    if (pc == cl->p->code) {  /* first instruction (not resuming)? */
+      if (cl->p->is_vararg)
+        trap = 0;  /* hooks will start after VARARGPREP instruction */
+      else  /* check 'call' hook */
+        hydrogenD_hookcall(L, ci);
+    }
+    ci->u.l.trap = 1;  /* assume trap is on, for now */
+  }
+#if defined(HYDROGEN_USE_AOT)
+  else if (cl->p->aot != NULL) {  /* compiled ahead of time? */
+    switch (cl->p->aot(L, ci)) {
+      case AOT_CALL: {  /* call to a Hydrogen function */
+        ci = L->ci;
+        goto startfunc;  /* execute the callee */
+      }
+      case AOT_RETURN: goto ret;
+      default: {  /* hooks were turned on; interpret the rest */
+        pc = ci->u.l.savedpc;
+        trap = ci->u.l.trap = 1;
+        break;
+      }
+    }
+  }
+#endif
+#if defined(HYDROGEN_USE_JIT)
+  else if (hydrogenJ_ready(L, cl->p, ci)) {  /* run it in native code? */
+    switch (hydrogenJ_run(L, ci)) {
+      case JIT_CALL: {  /* call to a Hydrogen function */
+        ci = L->ci;
+        goto startfunc;  /* execute the callee */
+      }
+      case JIT_RETURN: goto ret;
+      default: {  /* hooks were turned on; interpret the rest */
+        pc = ci->u.l.savedpc;
+        trap = ci->u.l.trap = 1;
+        break;
+      }
+    }
+  }
+#endif
+  base = ci->func + 1;
+  /* main loop of interpreter */
+  for (;;) {
+    Instruction i;  /* instruction being executed */
+    StkId ra;  /* instruction's A register */
+#if HYDROGEN_USE_DIRECTTHREADING
+    const DecodedInstruction *d;  /* predecoded 'i' */
+#endif
+    vmfetch();
+    #if 0
+      /* low-level line tracing for debugging Hydrogen */
+      printf("line: %d\n", hydrogenG_getfuncline(cl->p, pcRel(pc, cl->p)));
+    #endif
+    hydrogen_assert(base == ci->func + 1);
+    hydrogen_assert(base <= L->top && L->top < L->stack_last);
+    /* invalidate top for instructions not expecting it */
+    hydrogen_assert(isIT(i) || (cast_void(L->top = base), 1));
+    vmdispatch (GET_OPCODE(i)) {
+      vmcase(OP_MOVE) {
+        setobjs2s(L, ra, RB(i));
+        vmbreak;
+      }
+      vmcase(OP_LOADI) {
+        hydrogen_Integer b = GETARG_sBx(i);
+        setivalue(s2v(ra), b);
+        vmbreak;
+      }
+      vmcase(OP_LOADF) {
+        int b = GETARG_sBx(i);
+        setfltvalue(s2v(ra), cast_num(b));
+        vmbreak;
+      }
+      vmcase(OP_LOADK) {
+        TValue *rb = k + GETARG_Bx(i);
+        setobj2s(L, ra, rb);
+        vmbreak;
+      }
+      vmcase(OP_LOADKX) {
+        TValue *rb;
+        rb = k + GETARG_Ax(*pc); pc++;
+        setobj2s(L, ra, rb);
+        vmbreak;
+      }
+      vmcase(OP_LOADFALSE) {
+        setbfvalue(s2v(ra));
+        vmbreak;
+      }
+      vmcase(OP_LFALSESKIP) {
+        setbfvalue(s2v(ra));
+        pc++;  /* skip next instruction */
+        vmbreak;
+      }
+      vmcase(OP_LOADTRUE) {
+        setbtvalue(s2v(ra));
+        vmbreak;
+      }
+      vmcase(OP_LOADNIL) {
+        int b = GETARG_B(i);
+        do {
+          setnilvalue(s2v(ra++));
+        } while (b--);
+        vmbreak;
+      }
+      vmcase(OP_GETUPVAL) {
+        int b = GETARG_B(i);
+        setobj2s(L, ra, cl->upvals[b]->v);
+        vmbreak;
+      }
+      vmcase(OP_SETUPVAL) {
+        UpVal *uv = cl->upvals[GETARG_B(i)];
+        setobj(L, uv->v, s2v(ra));
+        hydrogenC_barrier(L, uv, s2v(ra));
+        vmbreak;
+      }
+      vmcase(OP_GETTABUP) {
+        op_gettabup();
+        vmbreak;
+      }
+      vmcase(OP_GETTABLE) {
+        const TValue *slot;
+        TValue *rb = vRB(i);
+        TValue *rc = vRC(i);
+        observeop((ttisinteger(rc) && arraycand(rb, ivalue(rc)))
+                  ? OP_GETTABLE_ARRAY : OP_GETTABLE);
+        if (!(ttisinteger(rc)  /* fast track for integers? */
+              ? hydrogenV_fastgeti(L, rb, ivalue(rc), s2v(ra), slot)
+              : hydrogenV_fastgetv(L, rb, rc, s2v(ra), slot)))
+          Protect(hydrogenV_finishget(L, rb, rc, ra, slot));
+        vmbreak;
+      }
+      vmcase(OP_GETI) {
+        const TValue *slot;
+        TValue *rb = vRB(i);
+        int c = GETARG_C(i);
+        observeop(arraycand(rb, c) ? OP_GETI_ARRAY : OP_GETI);
+        if (!hydrogenV_fastgeti(L, rb, c, s2v(ra), slot)) {
+          TValue key;
+          setivalue(&key, c);
+          Protect(hydrogenV_finishget(L, rb, &key, ra, slot));
+        }
+        vmbreak;
+      }
+      vmcase(OP_GETFIELD) {
+        op_getfield();
+        vmbreak;
+      }
+      vmcase(OP_SETTABUP) {
+        const TValue *slot;
+        TValue *upval = cl->upvals[GETARG_A(i)]->v;
+        TValue *rb = KB(i);
+        TValue *rc = RKC(i);
+        TString *key = tsvalue(rb);  /* key must be a string */
+        if (hydrogenV_fastgetcached(L, upval, key, slot, &IC(pc)->field.slot)) {
+          hydrogenV_finishfastset(L, upval, slot, rc);
+        }
+        else
+          Protect(hydrogenV_finishset(L, upval, rb, rc, slot));
+        vmbreak;
+      }
+      vmcase(OP_SETTABLE) {
+        const TValue *slot;
+        TValue *rb = vRB(i);  /* key (table is in 'ra') */
+        TValue *rc = RKC(i);  /* value */
+        hydrogen_Unsigned n;
+        observeop((ttisinteger(rb) && arraycand(s2v(ra), ivalue(rb)))
+                  ? OP_SETTABLE_ARRAY : OP_SETTABLE);
+        if (!(ttisinteger(rb)  /* fast track for integers? */
+              ? (cast_void(n = ivalue(rb)),
+                 hydrogenV_fastseti(L, s2v(ra), n, rc, slot))
+              : hydrogenV_fastset(L, s2v(ra), rb, rc, slot)))
+          Protect(hydrogenV_finishset(L, s2v(ra), rb, rc, slot));
+        vmbreak;
+      }
+      vmcase(OP_SETI) {
+        const TValue *slot;
+        int c = GETARG_B(i);
+        TValue *rc = RKC(i);
+        observeop(arraycand(s2v(ra), c) ? OP_SETI_ARRAY : OP_SETI);
+        if (!hydrogenV_fastseti(L, s2v(ra), c, rc, slot)) {
+          TValue key;
+          setivalue(&key, c);
+          Protect(hydrogenV_finishset(L, s2v(ra), &key, rc, slot));
+        }
+        vmbreak;
+      }
+      vmcase(OP_SETFIELD) {
+        const TValue *slot;
+        TValue *rb = KB(i);
+        TValue *rc = RKC(i);
+        TString *key = tsvalue(rb);  /* key must be a string */
+        if (hydrogenV_fastgetcached(L, s2v(ra), key, slot, &IC(pc)->field.slot)) {
+          hydrogenV_finishfastset(L, s2v(ra), slot, rc);
+        }
+        else
+          Protect(hydrogenV_finishset(L, s2v(ra), rb, rc, slot));
+        vmbreak;
+      }
+      vmcase(OP_NEWTABLE) {
+        int b = GETARG_B(i);  /* log2(hash size) + 1 */
+        int c = GETARG_C(i);  /* array size */
+        Table *t;
+        if (b > 0)
+          b = 1 << (b - 1);  /* size is 2^(b - 1) */
+        hydrogen_assert((!TESTARG_k(i)) == (GETARG_Ax(*pc) == 0));
+        if (TESTARG_k(i))  /* non-zero extra argument? */
+          c += GETARG_Ax(*pc) * (MAXARG_C + 1);  /* add it to size */
+        pc++;  /* skip extra argument */
+        L->top = ra + 1;  /* correct top in case of emergency GC */
+        t = hydrogenH_new(L);  /* memory allocation */
+        sethvalue2s(L, ra, t);
+        if (b != 0 || c != 0)
+          hydrogenH_resize(L, t, c, b);  /* idem */
+        checkGC(L, ra + 1);
+        vmbreak;
+      }
+      vmcase(OP_SELF) {
+        op_self();
+        vmbreak;
+      }
+      vmcase(OP_ADDI) {
+        op_arithI(L, l_addi, hydrogeni_numadd);
+        vmbreak;
+      }
+      vmcase(OP_ADDK) {
+        op_arithK(L, l_addi, hydrogeni_numadd);
+        vmbreak;
+      }
+      vmcase(OP_SUBK) {
+        op_arithK(L, l_subi, hydrogeni_numsub);
+        vmbreak;
+      }
+      vmcase(OP_MULK) {
+        op_arithK(L, l_muli, hydrogeni_nummul);
+        vmbreak;
+      }
+      vmcase(OP_MODK) {
+        op_arithK(L, hydrogenV_mod, hydrogenV_modf);
+        vmbreak;
+      }
+      vmcase(OP_POWK) {
+        op_arithfK(L, hydrogeni_numpow);
+        vmbreak;
+      }
+      vmcase(OP_DIVK) {
+        op_arithfK(L, hydrogeni_numdiv);
+        vmbreak;
+      }
+      vmcase(OP_IDIVK) {
+        op_arithK(L, hydrogenV_idiv, hydrogeni_numidiv);
+        vmbreak;
+      }
+      vmcase(OP_BANDK) {
+        op_bitwiseK(L, l_band);
+        vmbreak;
+      }
+      vmcase(OP_BORK) {
+        op_bitwiseK(L, l_bor);
+        vmbreak;
+      }
+      vmcase(OP_BXORK) {
+        op_bitwiseK(L, l_bxor);
+        vmbreak;
+      }
+      vmcase(OP_SHRI) {
+        TValue *rb = vRB(i);
+        int ic = GETARG_sC(i);
+        hydrogen_Integer ib;
+        if (tointegerns(rb, &ib)) {
+          pc++; setivalue(s2v(ra), hydrogenV_shiftl(ib, -ic));
+        }
+        vmbreak;
+      }
+      vmcase(OP_SHLI) {
+        TValue *rb = vRB(i);
+        int ic = GETARG_sC(i);
+        hydrogen_Integer ib;
+        if (tointegerns(rb, &ib)) {
+          pc++; setivalue(s2v(ra), hydrogenV_shiftl(ic, ib));
+        }
+        vmbreak;
+      }
+      vmcase(OP_ADD) {
+        observeop(arithcand(OP_ADD_II, OP_ADD_FF, OP_ADD));
+        op_arith(L, l_addi, hydrogeni_numadd);
+        vmbreak;
+      }
+      vmcase(OP_SUB) {
+        observeop(arithcand(OP_SUB_II, OP_SUB_FF, OP_SUB));
+        op_arith(L, l_subi, hydrogeni_numsub);
+        vmbreak;
+      }
+      vmcase(OP_MUL) {
+        observeop(arithcand(OP_MUL_II, OP_MUL_FF, OP_MUL));
+        op_arith(L, l_muli, hydrogeni_nummul);
+        vmbreak;
+      }
+      vmcase(OP_MOD) {
+        op_arith(L, hydrogenV_mod, hydrogenV_modf);
+        vmbreak;
+      }
+      vmcase(OP_POW) {
+        op_arithf(L, hydrogeni_numpow);
+        vmbreak;
+      }
+      vmcase(OP_DIV) {  /* float division (always with floats) */
+        op_arithf(L, hydrogeni_numdiv);
+        vmbreak;
+      }
+      vmcase(OP_IDIV) {  /* floor division */
+        op_arith(L, hydrogenV_idiv, hydrogeni_numidiv);
+        vmbreak;
+      }
+      vmcase(OP_BAND) {
+        op_bitwise(L, l_band);
+        vmbreak;
+      }
+      vmcase(OP_BOR) {
+        op_bitwise(L, l_bor);
+        vmbreak;
+      }
+      vmcase(OP_BXOR) {
+        op_bitwise(L, l_bxor);
+        vmbreak;
+      }
+      vmcase(OP_SHR) {
+        op_bitwise(L, hydrogenV_shiftr);
+        vmbreak;
+      }
+      vmcase(OP_SHL) {
+        op_bitwise(L, hydrogenV_shiftl);
+        vmbreak;
+      }
+      vmcase(OP_MMBIN) {
+        Instruction pi = *(pc - 2);  /* original arith. expression */
+        TValue *rb = vRB(i);
+        TMS tm = (TMS)GETARG_C(i);
+        StkId result = RA(pi);
+        hydrogen_assert(OP_ADD <= GET_OPCODE(pi) && GET_OPCODE(pi) <= OP_SHR);
+        Protect(hydrogenT_trybinTM(L, s2v(ra), rb, result, tm));
+        vmbreak;
+      }
+      vmcase(OP_MMBINI) {
+        Instruction pi = *(pc - 2);  /* original arith. expression */
+        int imm = GETARG_sB(i);
+        TMS tm = (TMS)GETARG_C(i);
+        int flip = GETARG_k(i);
+        StkId result = RA(pi);
+        Protect(hydrogenT_trybiniTM(L, s2v(ra), imm, flip, result, tm));
+        vmbreak;
+      }
+      vmcase(OP_MMBINK) {
+        Instruction pi = *(pc - 2);  /* original arith. expression */
+        TValue *imm = KB(i);
+        TMS tm = (TMS)GETARG_C(i);
+        int flip = GETARG_k(i);
+        StkId result = RA(pi);
+        Protect(hydrogenT_trybinassocTM(L, s2v(ra), imm, flip, result, tm));
+        vmbreak;
+      }
+      vmcase(OP_UNM) {
+        TValue *rb = vRB(i);
+        hydrogen_Number nb;
+        if (ttisinteger(rb)) {
+          hydrogen_Integer ib = ivalue(rb);
+          setivalue(s2v(ra), intop(-, 0, ib));
+        }
+        else if (tonumberns(rb, nb)) {
+          setfltvalue(s2v(ra), hydrogeni_numunm(L, nb));
+        }
+        else
+          Protect(hydrogenT_trybinTM(L, rb, rb, ra, TM_UNM));
+        vmbreak;
+      }
+      vmcase(OP_BNOT) {
+        TValue *rb = vRB(i);
+        hydrogen_Integer ib;
+        if (tointegerns(rb, &ib)) {
+          setivalue(s2v(ra), intop(^, ~l_castS2U(0), ib));
+        }
+        else
+          Protect(hydrogenT_trybinTM(L, rb, rb, ra, TM_BNOT));
+        vmbreak;
+      }
+      vmcase(OP_NOT) {
+        TValue *rb = vRB(i);
+        if (l_isfalse(rb))
+          setbtvalue(s2v(ra));
+        else
+          setbfvalue(s2v(ra));
+        vmbreak;
+      }
+      vmcase(OP_LEN) {
+        Protect(hydrogenV_objlen(L, ra, vRB(i)));
+        vmbreak;
+      }
+      vmcase(OP_CONCAT) {
+        int n = GETARG_B(i);  /* number of elements to concatenate */
+        L->top = ra + n;  /* mark the end of concat operands */
+        ProtectNT(hydrogenV_concat(L, n));
+        checkGC(L, L->top); /* 'hydrogenV_concat' ensures correct top */
+        vmbreak;
+      }
+      vmcase(OP_CLOSE) {
+        Protect(hydrogenF_close(L, ra, HYDROGEN_OK, 1));
+        vmbreak;
+      }
+      vmcase(OP_TBC) {
+        /* create new to-be-closed upvalue */
+        halfProtect(hydrogenF_newtbhydrogenval(L, ra));
+        vmbreak;
+      }
+      vmcase(OP_JMP) {
+        dojump(ci, i, 0);
+        vmbreak;
+      }
+      vmcase(OP_EQ) {
+        int cond;
+        TValue *rb = vRB(i);
+        observeop((ttisinteger(s2v(ra)) && ttisinteger(rb)) ? OP_EQ_II : OP_EQ);
+        Protect(cond = hydrogenV_equalobj(L, s2v(ra), rb));
+        docondjump();
+        vmbreak;
+      }
+      vmcase(OP_LT) {
+        observeop((ttisinteger(s2v(ra)) && ttisinteger(vRB(i)))
+                  ? OP_LT_II : OP_LT);
+        op_order(L, l_lti, LTnum, lessthanothers);
+        vmbreak;
+      }
+      vmcase(OP_LE) {
+        observeop((ttisinteger(s2v(ra)) && ttisinteger(vRB(i)))
+                  ? OP_LE_II : OP_LE);
+        op_order(L, l_lei, LEnum, lessequalothers);
+        vmbreak;
+      }
+      vmcase(OP_EQK) {
+        TValue *rb = KB(i);
+        /* basic types do not use '__eq'; we can use raw equality */
+        int cond = hydrogenV_rawequalobj(s2v(ra), rb);
+        docondjump();
+        vmbreak;
+      }
+      vmcase(OP_EQI) {
+        int cond;
+        int im = GETARG_sB(i);
+        if (ttisinteger(s2v(ra)))
+          cond = (ivalue(s2v(ra)) == im);
+        else if (ttisfloat(s2v(ra)))
+          cond = hydrogeni_numeq(fltvalue(s2v(ra)), cast_num(im));
+        else
+          cond = 0;  /* other types cannot be equal to a number */
+        docondjump();
+        vmbreak;
+      }
+      vmcase(OP_LTI) {
+        op_orderI(L, l_lti, hydrogeni_numlt, 0, TM_LT);
+        vmbreak;
+      }
+      vmcase(OP_LEI) {
+        op_orderI(L, l_lei, hydrogeni_numle, 0, TM_LE);
+        vmbreak;
+      }
+      vmcase(OP_GTI) {
+        op_orderI(L, l_gti, hydrogeni_numgt, 1, TM_LT);
+        vmbreak;
+      }
+      vmcase(OP_GEI) {
+        op_orderI(L, l_gei, hydrogeni_numge, 1, TM_LE);
+        vmbreak;
+      }
+      vmcase(OP_TEST) {
+        int cond = !l_isfalse(s2v(ra));
+        docondjump();
+        vmbreak;
+      }
+      vmcase(OP_TESTSET) {
+        TValue *rb = vRB(i);
+        if (l_isfalse(rb) == GETARG_k(i))
+          pc++;
+        else {
+          setobj2s(L, ra, rb);
+          donextjump(ci);
+        }
+        vmbreak;
+      }
+      vmcase(OP_CALL) {
+        op_call();
+        vmbreak;
+      }
+      vmcase(OP_TAILCALL) {
+        int b = GETARG_B(i);  /* number of arguments + 1 (function) */
+        int n;  /* number of results when calling a C function */
+        int nparams1 = GETARG_C(i);
+        /* delta is virtual 'func' - real 'func' (vararg functions) */
+        int delta = (nparams1) ? ci->u.l.nextraargs + nparams1 : 0;
+        if (b != 0)
+          L->top = ra + b;
+        else  /* previous instruction set top */
+          b = cast_int(L->top - ra);
+        savepc(ci);  /* several calls here can raise errors */
+        if (TESTARG_k(i)) {
+          hydrogenF_closeupval(L, base);  /* close upvalues from current call */
+          hydrogen_assert(L->tbclist < base);  /* no pending tbc variables */
+          hydrogen_assert(base == ci->func + 1);
+        }
+        if ((n = hydrogenD_pretailcall(L, ci, ra, b, delta)) < 0)  /* Hydrogen function? */
+          goto startfunc;  /* execute the callee */
+        else {  /* C function? */
+          ci->func -= delta;  /* restore 'func' (if vararg) */
+          hydrogenD_poscall(L, ci, n);  /* finish caller */
+          updatetrap(ci);  /* 'hydrogenD_poscall' can change hooks */
+          goto ret;  /* caller returns after the tail call */
+        }
+      }
+      vmcase(OP_RETURN) {
+        int n = GETARG_B(i) - 1;  /* number of results */
+        int nparams1 = GETARG_C(i);
+        if (n < 0)  /* not fixed? */
+          n = cast_int(L->top - ra);  /* get what is available */
+        savepc(ci);
+        if (TESTARG_k(i)) {  /* may there be open upvalues? */
+          ci->u2.nres = n;  /* save number of returns */
+          if (L->top < ci->top)
+            L->top = ci->top;
+          hydrogenF_close(L, base, CLOSEKTOP, 1);
+          updatetrap(ci);
+          updatestack(ci);
+        }
+        if (nparams1)  /* vararg function? */
+          ci->func -= ci->u.l.nextraargs + nparams1;
+        L->top = ra + n;  /* set call for 'hydrogenD_poscall' */
+        hydrogenD_poscall(L, ci, n);
+        updatetrap(ci);  /* 'hydrogenD_poscall' can change hooks */
+        goto ret;
+      }
+      vmcase(OP_RETURN0) {
+        if (l_unlikely(L->hookmask)) {
+          L->top = ra;
+          savepc(ci);
+          hydrogenD_poscall(L, ci, 0);  /* no hurry... */
+          trap = 1;
+        }
+        else {  /* do the 'poscall' here */
+          int nres;
+          L->ci = ci->previous;  /* back to caller */
+          L->top = base - 1;
+          for (nres = ci->nresults; l_unlikely(nres > 0); nres--)
+            setnilvalue(s2v(L->top++));  /* all results are nil */
+        }
+        goto ret;
+      }
+      vmcase(OP_RETURN1) {
+        if (l_unlikely(L->hookmask)) {
+          L->top = ra + 1;
+          savepc(ci);
+          hydrogenD_poscall(L, ci, 1);  /* no hurry... */
+          trap = 1;
+        }
+        else {  /* do the 'poscall' here */
+          int nres = ci->nresults;
+          L->ci = ci->previous;  /* back to caller */
+          if (nres == 0)
+            L->top = base - 1;  /* asked for no results */
+          else {
+            setobjs2s(L, base - 1, ra);  /* at least this result */
+            L->top = base;
+            for (; l_unlikely(nres > 1); nres--)
+              setnilvalue(s2v(L->top++));  /* complete missing results */
+          }
+        }
+       ret:  /* return from a Hydrogen function */
+        if (ci->callstatus & CIST_FRESH)
+          return;  /* end this frame */
+        else {
+          ci = ci->previous;
+          goto returning;  /* continue running caller in this frame */
+        }
+      }
+      vmcase(OP_FORLOOP) {
+        if (ttisinteger(s2v(ra + 2))) {  /* integer loop? */
+          hydrogen_Unsigned count = l_castS2U(ivalue(s2v(ra + 1)));
+          if (count > 0) {  /* still more iterations? */
+            hydrogen_Integer step = ivalue(s2v(ra + 2));
+            hydrogen_Integer idx = ivalue(s2v(ra));  /* internal index */
+            chgivalue(s2v(ra + 1), count - 1);  /* update counter */
+            idx = intop(+, idx, step);  /* add step to index */
+            chgivalue(s2v(ra), idx);  /* update internal index */
+            setivalue(s2v(ra + 3), idx);  /* and control variable */
+            pc -= GETARG_Bx(i);  /* jump back */
+          }
+        }
+        else if (hydrogenV_floatforloop(ra))  /* float loop */
+          pc -= GETARG_Bx(i);  /* jump back */
+        updatetrap(ci);  /* allows a signal to break the loop */
+#if defined(HYDROGEN_USE_JIT)
+        if (!trap && *(pc - 1) != i)  /* jumped back (after OP_FORPREP)? */
+          jitloop();
+        if (!trap && hydrogenJ_loop(L, cl->p)) {  /* hot loop? */
+          savepc(ci);
+          goto returning;  /* go on in native code */
+        }
+#endif
+        vmbreak;
+      }
+      vmcase(OP_FORPREP) {
+        savestate(L, ci);  /* in case of errors */
+        if (hydrogenV_forprep(L, ra))
+          pc += GETARG_Bx(i) + 1;  /* skip the loop */
+        vmbreak;
+      }
+      vmcase(OP_TFORPREP) {
+        /* create to-be-closed upvalue (if needed) */
+        halfProtect(hydrogenF_newtbhydrogenval(L, ra + 3));
+        pc += GETARG_Bx(i);
+        i = *(pc++);  /* Hydrogen to next instruction */
+        hydrogen_assert(GET_OPCODE(i) == OP_TFORCALL && ra == RA(i));
+        goto l_tforcall;
+      }
+      vmcase(OP_TFORCALL) {
+       l_tforcall:
+        /* 'ra' has the iterator function, 'ra + 1' has the state,
+           'ra + 2' has the control variable, and 'ra + 3' has the
+           to-be-closed variable. The call will use the stack after
+           these values (starting at 'ra + 4')
+        */
+        /* push function, state, and control variable */
+        memcpy(ra + 4, ra, 3 * sizeof(*ra));
+        L->top = ra + 4 + 3;
+        ProtectNT(hydrogenD_call(L, ra + 4, GETARG_C(i)));  /* do the call */
+        updatestack(ci);  /* stack may have changed */
+        i = *(pc++);  /* Hydrogen to next instruction */
+        hydrogen_assert(GET_OPCODE(i) == OP_TFORLOOP && ra == RA(i));
+        goto l_tforloop;
+      }
+      vmcase(OP_TFORLOOP) {
+        l_tforloop:
+        if (!ttisnil(s2v(ra + 4))) {  /* continue loop? */
+          setobjs2s(L, ra + 2, ra + 4);  /* save control variable */
+          pc -= GETARG_Bx(i);  /* jump back */
+#if defined(HYDROGEN_USE_JIT)
+          if (!trap)
+            jitloop();
+          if (!trap && hydrogenJ_loop(L, cl->p)) {  /* hot loop? */
+            savepc(ci);
+            goto returning;  /* go on in native code */
+          }
+#endif
+        }
+        vmbreak;
+      }
+      vmcase(OP_SETLIST) {
+        int n = GETARG_B(i);
+        unsigned int last = GETARG_C(i);
+        Table *h = hvalue(s2v(ra));
+        if (n == 0)
+          n = cast_int(L->top - ra) - 1;  /* get up to the top */
+        else
+          L->top = ci->top;  /* correct top in case of emergency GC */
+        last += n;
+        if (TESTARG_k(i)) {
+          last += GETARG_Ax(*pc) * (MAXARG_C + 1);
+          pc++;
+        }
+        if (last > hydrogenH_realasize(h))  /* needs more space? */
+          hydrogenH_resizearray(L, h, last);  /* preallocate it at once */
+        for (; n > 0; n--) {
+          TValue *val = s2v(ra + n);
+          arrsetobj(h, last - 1, val);
+          last--;
+          hydrogenC_barrierback(L, obj2gco(h), val);
+        }
+        vmbreak;
+      }
+      vmcase(OP_CLOSURE) {
+        Proto *p = cl->p->p[GETARG_Bx(i)];
+        halfProtect(hydrogenV_pushclosure(L, p, cl->upvals, base, ra));
+        checkGC(L, ra + 1);
+        vmbreak;
+      }
+      vmcase(OP_VARARG) {
+        int n = GETARG_C(i) - 1;  /* required results */
+        Protect(hydrogenT_getvarargs(L, ci, ra, n));
+        vmbreak;
+      }
+      vmcase(OP_VARARGPREP) {
+        ProtectNT(hydrogenT_adjustvarargs(L, GETARG_A(i), ci, cl->p));
+        if (l_unlikely(trap)) {  /* previous "Protect" updated trap */
+          hydrogenD_hookcall(L, ci);
+          L->oldpc = 1;  /* next opcode will be seen as a "new" line */
+        }
+        updatebase(ci);  /* function has new base after adjustment */
+        vmbreak;
+      }
+      vmcase(OP_EXTRAARG) {
+        hydrogen_assert(0);
+        vmbreak;
+      }
+      vmcase(OP_GETTABUP_CALL) {
+        op_gettabup();
+        fusedcall();
+        vmbreak;
+      }
+      vmcase(OP_GETFIELD_CALL) {
+        op_getfield();
+        fusedcall();
+        vmbreak;
+      }
+      vmcase(OP_SELF_CALL) {
+        op_self();
+        fusedcall();
+        vmbreak;
+      }
+      vmcase(OP_ADD_II) {
+        op_arithII(L, l_addi, hydrogeni_numadd, OP_ADD);
+        vmbreak;
+      }
+      vmcase(OP_ADD_FF) {
+        op_arithFF(L, l_addi, hydrogeni_numadd, OP_ADD);
+        vmbreak;
+      }
+      vmcase(OP_SUB_II) {
+        op_arithII(L, l_subi, hydrogeni_numsub, OP_SUB);
+        vmbreak;
+      }
+      vmcase(OP_SUB_FF) {
+        op_arithFF(L, l_subi, hydrogeni_numsub, OP_SUB);
+        vmbreak;
+      }
+      vmcase(OP_MUL_II) {
+        op_arithII(L, l_muli, hydrogeni_nummul, OP_MUL);
+        vmbreak;
+      }
+      vmcase(OP_MUL_FF) {
+        op_arithFF(L, l_muli, hydrogeni_nummul, OP_MUL);
+        vmbreak;
+      }
+      vmcase(OP_EQ_II) {
+        int cond;
+        TValue *rb = vRB(i);
+        if (l_likely(ttisinteger(s2v(ra)) && ttisinteger(rb)))
+          cond = (ivalue(s2v(ra)) == ivalue(rb));
+        else {
+          deoptimizeop(OP_EQ);
+          Protect(cond = hydrogenV_equalobj(L, s2v(ra), rb));
+        }
+        docondjump();
+        vmbreak;
+      }
+      vmcase(OP_LT_II) {
+        op_orderII(L, l_lti, LTnum, lessthanothers, OP_LT);
+        vmbreak;
+      }
+      vmcase(OP_LE_II) {
+        op_orderII(L, l_lei, LEnum, lessequalothers, OP_LE);
+        vmbreak;
+      }
+      vmcase(OP_GETTABLE_ARRAY) {
+        const TValue *slot;
+        TValue *rb = vRB(i);
+        TValue *rc = vRC(i);
+        if (l_unlikely(!(ttisinteger(rc) &&
+                         getarray(rb, ivalue(rc), s2v(ra))))) {
+          deoptimizeop(OP_GETTABLE);
+          if (!hydrogenV_fastgetv(L, rb, rc, s2v(ra), slot))
+            Protect(hydrogenV_finishget(L, rb, rc, ra, slot));
+        }
+        vmbreak;
+      }
+      vmcase(OP_GETI_ARRAY) {
+        const TValue *slot;
+        TValue *rb = vRB(i);
+        int c = GETARG_C(i);
+        if (l_unlikely(!getarray(rb, c, s2v(ra)))) {
+          deoptimizeop(OP_GETI);
+          if (!hydrogenV_fastgeti(L, rb, c, s2v(ra), slot)) {
+            TValue key;
+            setivalue(&key, c);
+            Protect(hydrogenV_finishget(L, rb, &key, ra, slot));
+          }
+        }
+        vmbreak;
+      }
+      vmcase(OP_SETTABLE_ARRAY) {
+        const TValue *slot;
+        TValue *rb = vRB(i);  /* key (table is in 'ra') */
+        TValue *rc = RKC(i);  /* value */
+        if (l_unlikely(!(ttisinteger(rb) &&
+                         setarray(L, s2v(ra), ivalue(rb), rc)))) {
+          deoptimizeop(OP_SETTABLE);
+          if (!hydrogenV_fastset(L, s2v(ra), rb, rc, slot))
+            Protect(hydrogenV_finishset(L, s2v(ra), rb, rc, slot));
+        }
+        vmbreak;
+      }
+      vmcase(OP_SETI_ARRAY) {
+        const TValue *slot;
+        int c = GETARG_B(i);
+        TValue *rc = RKC(i);
+        if (l_unlikely(!setarray(L, s2v(ra), c, rc))) {
+          deoptimizeop(OP_SETI);
+          if (!hydrogenV_fastseti(L, s2v(ra), c, rc, slot)) {
+            TValue key;
+            setivalue(&key, c);
+            Protect(hydrogenV_finishset(L, s2v(ra), &key, rc, slot));
+          }
+        }
+        vmbreak;
+      }
+    }
+  }
+}
+
+/* }================================================================== */
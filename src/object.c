@@ -532,7 +532,7 @@ const char *hydrogenO_pushvfstring (hydrogen_State *L, const char *fmt, va_list
   addstr2buff(&buff, fmt, strlen(fmt));  /* rest of 'fmt' */
   clearbuff(&buff);  /* empty buffer into the stack */
   hydrogen_assert(buff.pushed == 1);
-  return svalue(s2v(L->top - 1));
+  return hydrogenS_tocstr(L, s2v(L->top - 1));  /* (may be a view) */
 }
 
 
@@ -590,3 +590,66 @@ void hydrogenO_chunkid (char *out, const char *source, size_t srclen) {
   }
 }
 
+
+
+#if defined(HYDROGEN_NANBOXING)
+
+/*
+** {==================================================================
+** NaN boxing
+** ===================================================================
+*/
+
+/* tags of the variant codes (code 0 stands for floats) */
+HYDROGENI_DDEF const lu_byte hydrogenO_nbtags[16] = {
+  HYDROGEN_VNUMFLT, HYDROGEN_VNIL, HYDROGEN_VEMPTY, HYDROGEN_VABSTKEY,
+  HYDROGEN_VFALSE, HYDROGEN_VTRUE, HYDROGEN_VNUMINT, HYDROGEN_VLIGHTUSERDATA,
+  HYDROGEN_VLCF, ctb(HYDROGEN_VLCL), ctb(HYDROGEN_VCCL),
+  ctb(HYDROGEN_VSHRSTR), ctb(HYDROGEN_VLNGSTR), ctb(HYDROGEN_VTABLE),
+  ctb(HYDROGEN_VUSERDATA), ctb(HYDROGEN_VTHREAD)
+};
+
+
+/*
+** Split value 'o' into a tag and a 'Value', as kept in table keys.
+*/
+void hydrogenO_nbunbox (const TValue *o, lu_byte *tt, Value *v) {
+  *tt = rawtt(o);
+  if (ttisfloat(o))
+    v->n = fltvalue(o);
+  else if (ttisinteger(o))
+    v->i = ivalue(o);
+  else if (ttislcf(o))
+    v->f = fvalue(o);
+  else if (ttislightuserdata(o))
+    v->p = pvalue(o);
+  else if (iscollectable(o))
+    v->gc = gcvalue(o);
+  else  /* nil or boolean */
+    v->p = NULL;
+}
+
+
+/*
+** Join tag 'tt' and 'Value' 'v' into value 'o'.
+*/
+void hydrogenO_nbbox (TValue *o, int tt, const Value *v) {
+  switch (tt) {
+    case HYDROGEN_VNUMFLT: setvaln_(o, v->n); break;
+    case HYDROGEN_VNUMINT: setvali_(o, v->i); break;
+    case HYDROGEN_VLCF: setvalf_(o, v->f); break;
+    case HYDROGEN_VLIGHTUSERDATA: setvalp_(o, v->p); break;
+    default: {
+      if (tt & BIT_ISCOLLECTABLE) {
+        setvalgc_(o, v->gc, tt);
+      }
+      else
+        settt_(o, tt);
+      break;
+    }
+  }
+}
+
+/* }================================================================== */
+
+#endif
@@ -55,6 +55,8 @@ typedef union Value {
 } Value;
 
 
+#if !defined(HYDROGEN_NANBOXING)	/* { */
+
 /*
 ** Tagged Values. This is the basic representation of values in Hydrogen:
 ** an actual value plus a tag with its type.
@@ -74,6 +76,198 @@ typedef struct TValue {
 /* raw type tag of a TValue */
 #define rawtt(o)	((o)->tt_)
 
+
+/* Macros to test type */
+#define checktag(o,t)		(rawtt(o) == (t))
+#define checktype(o,t)		(ttype(o) == (t))
+
+
+/* value of a TValue, by kind */
+#define valgc_(o)	(val_(o).gc)
+#define valp_(o)	(val_(o).p)
+#define valf_(o)	(val_(o).f)
+#define vali_(o)	(val_(o).i)
+#define valn_(o)	(val_(o).n)
+
+
+/* set a value's tag */
+#define settt_(o,t)	((o)->tt_=(t))
+
+/* set the value of a TValue, by kind ('t' is the tag of a collectable) */
+#define setvalgc_(o,x,t)	{ val_(o).gc = (x); settt_(o, t); }
+#define setvalp_(o,x)	{ val_(o).p = (x); settt_(o, HYDROGEN_VLIGHTUSERDATA); }
+#define setvalf_(o,x)	{ val_(o).f = (x); settt_(o, HYDROGEN_VLCF); }
+#define setvali_(o,x)	{ val_(o).i = (x); settt_(o, HYDROGEN_VNUMINT); }
+#define setvaln_(o,x)	{ val_(o).n = (x); settt_(o, HYDROGEN_VNUMFLT); }
+
+/* change the value of a number, keeping its tag */
+#define chgvali_(o,x)	(val_(o).i = (x))
+#define chgvaln_(o,x)	(val_(o).n = (x))
+
+/* copy a TValue */
+#define copyval_(o1,o2)	\
+	{ (o1)->value_ = (o2)->value_; settt_(o1, (o2)->tt_); }
+
+#else					/* }{ */
+
+/*
+** NaN-boxed values (see HYDROGEN_NANBOXING in hydrogenconf.h). A TValue
+** is the bit pattern of a double: floats are stored as themselves, with
+** all NaNs in the single form 'NBNAN', and all other values are
+** negative NaNs above -inf. The high 16 bits of those give their variant
+** ('NB_*' codes, in 0xFFF1-0xFFFF) and their low 48 bits hold a pointer,
+** an integer (in two's complement), or nothing. Collectable variants
+** have the highest codes.
+*/
+
+#define TValuefields	hydrogen_Unsigned nb_
+
+typedef struct TValue {
+  TValuefields;
+} TValue;
+
+
+/* variant codes */
+#define NB_NIL		1
+#define NB_EMPTY	2
+#define NB_ABSTKEY	3
+#define NB_FALSE	4
+#define NB_TRUE		5
+#define NB_INT		6
+#define NB_LIGHTUD	7
+#define NB_LCF		8
+#define NB_LCL		9	/* first collectable variant */
+#define NB_CCL		10
+#define NB_SHRSTR	11
+#define NB_LNGSTR	12
+#define NB_TABLE	13
+#define NB_USERDATA	14
+#define NB_THREAD	15
+
+/* variant code of tag 't' (16 if 't' is not the tag of a value) */
+#define nbcode(t) \
+	((t) == HYDROGEN_VNIL ? NB_NIL : (t) == HYDROGEN_VEMPTY ? NB_EMPTY : \
+	 (t) == HYDROGEN_VABSTKEY ? NB_ABSTKEY : \
+	 (t) == HYDROGEN_VFALSE ? NB_FALSE : (t) == HYDROGEN_VTRUE ? NB_TRUE : \
+	 (t) == HYDROGEN_VNUMINT ? NB_INT : \
+	 (t) == HYDROGEN_VLIGHTUSERDATA ? NB_LIGHTUD : \
+	 (t) == HYDROGEN_VLCF ? NB_LCF : (t) == ctb(HYDROGEN_VLCL) ? NB_LCL : \
+	 (t) == ctb(HYDROGEN_VCCL) ? NB_CCL : \
+	 (t) == ctb(HYDROGEN_VSHRSTR) ? NB_SHRSTR : \
+	 (t) == ctb(HYDROGEN_VLNGSTR) ? NB_LNGSTR : \
+	 (t) == ctb(HYDROGEN_VTABLE) ? NB_TABLE : \
+	 (t) == ctb(HYDROGEN_VUSERDATA) ? NB_USERDATA : \
+	 (t) == ctb(HYDROGEN_VTHREAD) ? NB_THREAD : 16)
+
+/* first and last variant codes of type 't' (other than numbers) */
+#define nbfirst(t) \
+	((t) == HYDROGEN_TNIL ? NB_NIL : (t) == HYDROGEN_TBOOLEAN ? NB_FALSE : \
+	 (t) == HYDROGEN_TLIGHTUSERDATA ? NB_LIGHTUD : \
+	 (t) == HYDROGEN_TFUNCTION ? NB_LCF : (t) == HYDROGEN_TSTRING ? NB_SHRSTR : \
+	 (t) == HYDROGEN_TTABLE ? NB_TABLE : \
+	 (t) == HYDROGEN_TUSERDATA ? NB_USERDATA : NB_THREAD)
+#define nblast(t) \
+	((t) == HYDROGEN_TNIL ? NB_ABSTKEY : (t) == HYDROGEN_TBOOLEAN ? NB_TRUE : \
+	 (t) == HYDROGEN_TFUNCTION ? NB_CCL : (t) == HYDROGEN_TSTRING ? NB_LNGSTR : \
+	 nbfirst(t))
+
+
+/* number of bits of integers and pointers */
+#define NBINTBITS	48
+
+#define NBPAYLOAD	((l_castS2U(1) << NBINTBITS) - 1)
+#define NBSIGN		(l_castS2U(1) << (NBINTBITS - 1))
+
+/* word with variant code 'c' and payload 'p' */
+#define nbbox(c,p)	((l_castS2U(0xFFF0 + (c)) << NBINTBITS) | (p))
+
+/* high 16 bits of a TValue */
+#define nbhigh(o)	cast_int((o)->nb_ >> NBINTBITS)
+
+/* all words below this one are floats */
+#define NBBOXED		nbbox(NB_NIL, 0)
+
+/* the only NaN stored as a float */
+#define NBNAN		(l_castS2U(0x7FF8) << NBINTBITS)
+
+/* payload of a TValue as a pointer */
+#define nbpointer(o)	cast_voidp(cast_sizet((o)->nb_ & NBPAYLOAD))
+
+/* payload for pointer 'p' */
+#define nbfrompointer(p)	l_castS2U(cast_sizet(p))
+
+#define nbfitspointer(p)	((nbfrompointer(p) & ~NBPAYLOAD) == 0)
+
+
+l_sinline hydrogen_Number nbtonum (hydrogen_Unsigned u) {
+  union { hydrogen_Unsigned u; hydrogen_Number n; } c;
+  c.u = u;
+  return c.n;
+}
+
+
+l_sinline hydrogen_Unsigned nbfromnum (hydrogen_Number n) {
+  union { hydrogen_Unsigned u; hydrogen_Number n; } c;
+  if (l_unlikely(n != n))  /* NaN? */
+    return NBNAN;  /* keep it out of the boxed values */
+  c.n = n;
+  return c.u;
+}
+
+
+/* raw type tag of a TValue */
+#define rawtt(o)  \
+	hydrogenO_nbtags[(o)->nb_ < NBBOXED ? 0 : nbhigh(o) & 0xF]
+
+HYDROGENI_DDEC(const lu_byte hydrogenO_nbtags[16];)
+
+
+/* Macros to test type */
+#define checktag(o,t)  \
+	((t) == HYDROGEN_VNUMFLT ? (o)->nb_ < NBBOXED  \
+	                         : nbhigh(o) == 0xFFF0 + nbcode(t))
+#define checktype(o,t)  \
+	((t) == HYDROGEN_TNUMBER  \
+	  ? ((o)->nb_ < NBBOXED || nbhigh(o) == 0xFFF0 + NB_INT)  \
+	  : cast_uint(nbhigh(o) - (0xFFF0 + nbfirst(t))) <=  \
+	    cast_uint(nblast(t) - nbfirst(t)))
+
+
+/* value of a TValue, by kind */
+#define valgc_(o)	cast(struct GCObject *, nbpointer(o))
+#define valp_(o)	nbpointer(o)
+#define valf_(o)	cast(hydrogen_CFunction, cast_sizet((o)->nb_ & NBPAYLOAD))
+#define vali_(o)  \
+	(l_castU2S(((o)->nb_ & NBPAYLOAD) ^ NBSIGN) - l_castU2S(NBSIGN))
+#define valn_(o)	nbtonum((o)->nb_)
+
+
+/* set a value's tag (for values without payload) */
+#define settt_(o,t)	((o)->nb_ = nbbox(nbcode(t), 0))
+
+/* set the value of a TValue, by kind ('t' is the tag of a collectable) */
+#define setvalgc_(o,x,t)  \
+	{ hydrogen_assert(nbfitspointer(x));  \
+	  (o)->nb_ = nbbox(nbcode(t), nbfrompointer(x)); }
+#define setvalp_(o,x)  \
+	{ hydrogen_assert(nbfitspointer(x));  \
+	  (o)->nb_ = nbbox(NB_LIGHTUD, nbfrompointer(x)); }
+#define setvalf_(o,x)  \
+	{ hydrogen_assert(nbfitspointer(x));  \
+	  (o)->nb_ = nbbox(NB_LCF, nbfrompointer(x)); }
+#define setvali_(o,x)	((o)->nb_ = nbbox(NB_INT, l_castS2U(x) & NBPAYLOAD))
+#define setvaln_(o,x)	((o)->nb_ = nbfromnum(x))
+
+/* change the value of a number (which must be set as a whole) */
+#define chgvali_(o,x)	setvali_(o,x)
+#define chgvaln_(o,x)	setvaln_(o,x)
+
+/* copy a TValue */
+#define copyval_(o1,o2)	((o1)->nb_ = (o2)->nb_)
+
+#endif					/* } */
+
+
 /* tag with no variants (bits 0-3) */
 #define novariant(t)	((t) & 0x0F)
 
@@ -85,11 +279,6 @@ typedef struct TValue {
 #define ttype(o)	(novariant(rawtt(o)))
 
 
-/* Macros to test type */
-#define checktag(o,t)		(rawtt(o) == (t))
-#define checktype(o,t)		(ttype(o) == (t))
-
-
 /* Macros for internal tests */
 
 /* collectable object has the same tag as the original value */
@@ -108,14 +297,10 @@ typedef struct TValue {
 
 /* Macros to set values */
 
-/* set a value's tag */
-#define settt_(o,t)	((o)->tt_=(t))
-
-
 /* main macro to copy values (from 'obj2' to 'obj1') */
 #define setobj(L,obj1,obj2) \
 	{ TValue *io1=(obj1); const TValue *io2=(obj2); \
-          io1->value_ = io2->value_; settt_(io1, io2->tt_); \
+          copyval_(io1, io2); \
 	  checkliveness(L,io1); hydrogen_assert(!isnonstrictnil(io1)); }
 
 /*
@@ -141,14 +326,17 @@ typedef struct TValue {
 ** used when the distance between two tbc variables does not fit
 ** in an unsigned short. They are represented by delta==0, and
 ** their real delta is always the maximum value that fits in
-** that field.
+** that field. (With NaN boxing, the deltas are kept apart, in
+** 'tbcdelta'; see 'state.h'.)
 */
 typedef union StackValue {
   TValue val;
+#if !defined(HYDROGEN_NANBOXING)
   struct {
     TValuefields;
     unsigned short delta;
   } tbclist;
+#endif
 } StackValue;
 
 
@@ -204,8 +392,14 @@ typedef StackValue *StkId;
 #define isempty(v)		ttisnil(v)
 
 
-/* macro defining a value corresponding to an absent key */
+/* macros defining a value corresponding to an absent key and an empty slot */
+#if !defined(HYDROGEN_NANBOXING)
 #define ABSTKEYCONSTANT		{NULL}, HYDROGEN_VABSTKEY
+#define EMPTYCONSTANT		{NULL}, HYDROGEN_VEMPTY
+#else
+#define ABSTKEYCONSTANT		nbbox(NB_ABSTKEY, 0)
+#define EMPTYCONSTANT		nbbox(NB_EMPTY, 0)
+#endif
 
 
 /* mark an entry as empty */
@@ -250,11 +444,11 @@ typedef StackValue *StkId;
 
 #define ttisthread(o)		checktag((o), ctb(HYDROGEN_VTHREAD))
 
-#define thvalue(o)	check_exp(ttisthread(o), gco2th(val_(o).gc))
+#define thvalue(o)	check_exp(ttisthread(o), gco2th(valgc_(o)))
 
 #define setthvalue(L,obj,x) \
   { TValue *io = (obj); hydrogen_State *x_ = (x); \
-    val_(io).gc = obj2gco(x_); settt_(io, ctb(HYDROGEN_VTHREAD)); \
+    setvalgc_(io, obj2gco(x_), ctb(HYDROGEN_VTHREAD)); \
     checkliveness(L,io); }
 
 #define setthvalue2s(L,o,t)	setthvalue(L,s2v(o),t)
@@ -284,18 +478,22 @@ typedef struct GCObject {
 /* Bit mark for collectable types */
 #define BIT_ISCOLLECTABLE	(1 << 6)
 
+#if !defined(HYDROGEN_NANBOXING)
 #define iscollectable(o)	(rawtt(o) & BIT_ISCOLLECTABLE)
+#else
+#define iscollectable(o)	((o)->nb_ >= nbbox(NB_LCL, 0))
+#endif
 
 /* mark a tag as collectable */
 #define ctb(t)			((t) | BIT_ISCOLLECTABLE)
 
-#define gcvalue(o)	check_exp(iscollectable(o), val_(o).gc)
+#define gcvalue(o)	check_exp(iscollectable(o), valgc_(o))
 
 #define gcvalueraw(v)	((v).gc)
 
 #define setgcovalue(L,obj,x) \
   { TValue *io = (obj); GCObject *i_g=(x); \
-    val_(io).gc = i_g; settt_(io, ctb(i_g->tt)); }
+    setvalgc_(io, i_g, ctb(i_g->tt)); }
 
 /* }================================================================== */
 
@@ -316,23 +514,23 @@ typedef struct GCObject {
 
 #define nvalue(o)	check_exp(ttisnumber(o), \
 	(ttisinteger(o) ? cast_num(ivalue(o)) : fltvalue(o)))
-#define fltvalue(o)	check_exp(ttisfloat(o), val_(o).n)
-#define ivalue(o)	check_exp(ttisinteger(o), val_(o).i)
+#define fltvalue(o)	check_exp(ttisfloat(o), valn_(o))
+#define ivalue(o)	check_exp(ttisinteger(o), vali_(o))
 
 #define fltvalueraw(v)	((v).n)
 #define ivalueraw(v)	((v).i)
 
 #define setfltvalue(obj,x) \
-  { TValue *io=(obj); val_(io).n=(x); settt_(io, HYDROGEN_VNUMFLT); }
+  { TValue *io=(obj); setvaln_(io, x); }
 
 #define chgfltvalue(obj,x) \
-  { TValue *io=(obj); hydrogen_assert(ttisfloat(io)); val_(io).n=(x); }
+  { TValue *io=(obj); hydrogen_assert(ttisfloat(io)); chgvaln_(io, x); }
 
 #define setivalue(obj,x) \
-  { TValue *io=(obj); val_(io).i=(x); settt_(io, HYDROGEN_VNUMINT); }
+  { TValue *io=(obj); setvali_(io, x); }
 
 #define chgivalue(obj,x) \
-  { TValue *io=(obj); hydrogen_assert(ttisinteger(io)); val_(io).i=(x); }
+  { TValue *io=(obj); hydrogen_assert(ttisinteger(io)); chgvali_(io, x); }
 
 /* }================================================================== */
 
@@ -353,11 +551,11 @@ typedef struct GCObject {
 
 #define tsvalueraw(v)	(gco2ts((v).gc))
 
-#define tsvalue(o)	check_exp(ttisstring(o), gco2ts(val_(o).gc))
+#define tsvalue(o)	check_exp(ttisstring(o), gco2ts(valgc_(o)))
 
 #define setsvalue(L,obj,x) \
   { TValue *io = (obj); TString *x_ = (x); \
-    val_(io).gc = obj2gco(x_); settt_(io, ctb(x_->tt)); \
+    setvalgc_(io, obj2gco(x_), ctb(x_->tt)); \
     checkliveness(L,io); }
 
 /* set a string to the stack */
@@ -373,7 +571,7 @@ typedef struct GCObject {
 typedef struct TString {
   CommonHeader;
   lu_byte extra;  /* reserved words for short strings; "has hash" for longs */
-  lu_byte shrlen;  /* length for short strings */
+  lu_byte shrlen;  /* length for short strings; VIEWMARK for views */
   unsigned int hash;
   union {
     size_t lnglen;  /* length for long strings */
@@ -384,10 +582,35 @@ typedef struct TString {
 
 
 
+/*
+** A long string may be a view: its bytes are not in the object, whose
+** 'contents' hold a 'StrView' instead. The bytes are either a slice of
+** another long string ('parent'), which the view keeps alive, or owned
+** by the view ('parent' == NULL), in a block of 'size' bytes following
+** the 'StrView', where later concatenations may append (see
+** 'hydrogenS_newcat'). The bytes of a view may not be followed by a
+** '\0', so code reading them must use their length; 'hydrogenS_tocstr'
+** gives a C string a temporary terminated copy when needed. The bytes
+** themselves never move, so pointers to them stay valid while the view
+** is alive.
+*/
+typedef struct StrView {
+  char *data;  /* the bytes of the string */
+  struct TString *parent;  /* string holding them (NULL if owned) */
+  size_t size;  /* size of the block after the 'StrView' */
+  size_t used;  /* number of bytes in use in that block */
+} StrView;
+
+#define VIEWMARK	cast_byte(~0)
+
+#define isview(ts)	((ts)->shrlen == VIEWMARK)
+#define getview(ts)	cast(StrView *, (ts)->contents)
+
+
 /*
 ** Get the actual string (array of bytes) from a 'TString'.
 */
-#define getstr(ts)  ((ts)->contents)
+#define getstr(ts)  (isview(ts) ? getview(ts)->data : (ts)->contents)
 
 
 /* get the actual string (array of bytes) from a Hydrogen value */
@@ -420,17 +643,17 @@ typedef struct TString {
 #define ttislightuserdata(o)	checktag((o), HYDROGEN_VLIGHTUSERDATA)
 #define ttisfulluserdata(o)	checktag((o), ctb(HYDROGEN_VUSERDATA))
 
-#define pvalue(o)	check_exp(ttislightuserdata(o), val_(o).p)
-#define uvalue(o)	check_exp(ttisfulluserdata(o), gco2u(val_(o).gc))
+#define pvalue(o)	check_exp(ttislightuserdata(o), valp_(o))
+#define uvalue(o)	check_exp(ttisfulluserdata(o), gco2u(valgc_(o)))
 
 #define pvalueraw(v)	((v).p)
 
 #define setpvalue(obj,x) \
-  { TValue *io=(obj); val_(io).p=(x); settt_(io, HYDROGEN_VLIGHTUSERDATA); }
+  { TValue *io=(obj); setvalp_(io, x); }
 
 #define setuvalue(L,obj,x) \
   { TValue *io = (obj); Udata *x_ = (x); \
-    val_(io).gc = obj2gco(x_); settt_(io, ctb(HYDROGEN_VUSERDATA)); \
+    setvalgc_(io, obj2gco(x_), ctb(HYDROGEN_VUSERDATA)); \
     checkliveness(L,io); }
 
 
@@ -533,6 +756,59 @@ typedef struct AbsLineInfo {
   int line;
 } AbsLineInfo;
 
+/*
+** Inline cache of an instruction; which part is in use depends on the
+** instruction. For an instruction that indexes a table with a constant
+** short-string key (OP_GETTABUP, OP_GETFIELD, OP_SELF, OP_SETTABUP, and
+** OP_SETFIELD), 'field.slot' is the node index where the key was last
+** found in the indexed table; 'field.islot' is the same for the table
+** reached through its '__index' metafield. Both are only hints: they
+** are checked against the current node vector before being used.
+** Instructions that can be quickened keep their quickening state in
+** 'quick' (see 'observe' in virtualMachine.c), and loop instructions
+** keep the state of their traces in 'loop' (see 'jit.h'). All parts
+** start zeroed.
+*/
+typedef union ICache {
+  struct {
+    unsigned int slot;
+    unsigned int islot;
+  } field;
+  struct {
+    unsigned int state;  /* candidate opcode and its runs in a row */
+    unsigned int unstable;  /* times it changed candidate or deoptimized */
+  } quick;
+  struct {
+    unsigned int count;  /* iterations since the loop last got hot */
+    unsigned int flags;  /* state for the trace compiler ('JIT_LOOP*') */
+  } loop;
+} ICache;
+
+
+/*
+** Predecoded instruction for the direct-threaded interpreter loop:
+** 'handler' is the offset of the code for its opcode in
+** 'hydrogenV_execute' (from that of OP_MOVE), and 'a', 'b', 'c', and
+** 'k' are its operands, already extracted. The loop reads the other
+** operands from the instruction in 'code', which is still the source
+** of truth; the predecoded copy is built before the first run of a
+** prototype and kept in sync when the interpreter rewrites an
+** instruction.
+*/
+typedef struct DecodedInstruction {
+  int handler;
+  lu_byte a, b, c, k;
+} DecodedInstruction;
+
+
+#if defined(HYDROGEN_USE_AOT)
+struct CallInfo;
+
+/* function compiled ahead of time by 'hydrogenc -C' (see 'aot.h') */
+typedef int (*AOTFunction) (hydrogen_State *L, struct CallInfo *ci);
+#endif
+
+
 /*
 ** Function Prototypes
 */
@@ -552,6 +828,8 @@ typedef struct Proto {
   int lastlinedefined;  /* debug information  */
   TValue *k;  /* constants used by the function */
   Instruction *code;  /* opcodes */
+  ICache *icache;  /* inline caches (one per instruction, 'sizecode') */
+  DecodedInstruction *dcode;  /* predecoded 'code' (or NULL) */
   struct Proto **p;  /* functions defined inside the function */
   Upvaldesc *upvalues;  /* upvalue information */
   ls_byte *lineinfo;  /* information about source lines (debug information) */
@@ -559,6 +837,14 @@ typedef struct Proto {
   LocVar *locvars;  /* information about local variables (debug information) */
   TString  *source;  /* used for debug information */
   GCObject *gclist;
+#if defined(HYDROGEN_USE_JIT)
+  int hotcount;  /* calls and loop iterations (-1: not compilable) */
+  struct JitCode *jit;  /* native code (see 'jit.c') */
+  struct JitTrace *trace;  /* native code of its hot loops */
+#endif
+#if defined(HYDROGEN_USE_AOT)
+  AOTFunction aot;  /* code compiled ahead of time (or NULL) */
+#endif
 } Proto;
 
 /* }================================================================== */
@@ -587,26 +873,26 @@ typedef struct Proto {
 
 #define isfunctiontion(o)	ttisLclosure(o)
 
-#define clvalue(o)	check_exp(ttisclosure(o), gco2cl(val_(o).gc))
-#define clLvalue(o)	check_exp(ttisLclosure(o), gco2lcl(val_(o).gc))
-#define fvalue(o)	check_exp(ttislcf(o), val_(o).f)
-#define clCvalue(o)	check_exp(ttisCclosure(o), gco2ccl(val_(o).gc))
+#define clvalue(o)	check_exp(ttisclosure(o), gco2cl(valgc_(o)))
+#define clLvalue(o)	check_exp(ttisLclosure(o), gco2lcl(valgc_(o)))
+#define fvalue(o)	check_exp(ttislcf(o), valf_(o))
+#define clCvalue(o)	check_exp(ttisCclosure(o), gco2ccl(valgc_(o)))
 
 #define fvalueraw(v)	((v).f)
 
 #define setclLvalue(L,obj,x) \
   { TValue *io = (obj); LClosure *x_ = (x); \
-    val_(io).gc = obj2gco(x_); settt_(io, ctb(HYDROGEN_VLCL)); \
+    setvalgc_(io, obj2gco(x_), ctb(HYDROGEN_VLCL)); \
     checkliveness(L,io); }
 
 #define setclLvalue2s(L,o,cl)	setclLvalue(L,s2v(o),cl)
 
 #define setfvalue(obj,x) \
-  { TValue *io=(obj); val_(io).f=(x); settt_(io, HYDROGEN_VLCF); }
+  { TValue *io=(obj); setvalf_(io, x); }
 
 #define setclCvalue(L,obj,x) \
   { TValue *io = (obj); CClosure *x_ = (x); \
-    val_(io).gc = obj2gco(x_); settt_(io, ctb(HYDROGEN_VCCL)); \
+    setvalgc_(io, obj2gco(x_), ctb(HYDROGEN_VCCL)); \
     checkliveness(L,io); }
 
 
@@ -666,34 +952,34 @@ typedef union Closure {
 
 #define ttistable(o)		checktag((o), ctb(HYDROGEN_VTABLE))
 
-#define hvalue(o)	check_exp(ttistable(o), gco2t(val_(o).gc))
+#define hvalue(o)	check_exp(ttistable(o), gco2t(valgc_(o)))
 
 #define sethvalue(L,obj,x) \
   { TValue *io = (obj); Table *x_ = (x); \
-    val_(io).gc = obj2gco(x_); settt_(io, ctb(HYDROGEN_VTABLE)); \
+    setvalgc_(io, obj2gco(x_), ctb(HYDROGEN_VTABLE)); \
     checkliveness(L,io); }
 
 #define sethvalue2s(L,o,h)	sethvalue(L,s2v(o),h)
 
 
 /*
-** Nodes for Hash tables: A pack of two TValue's (key-value pairs)
-** plus a 'next' field to link colliding entries. The distribution
-** of the key's fields ('key_tt' and 'key_val') not forming a proper
-** 'TValue' allows for a smaller size for 'Node' both in 4-byte
-** and 8-byte alignments.
+** Nodes for Hash tables: A pack of two TValue's (key-value pairs).
+** The distribution of the key's fields ('key_tt' and 'key_val') not
+** forming a proper 'TValue' allows for a smaller size for 'Node' both
+** in 4-byte and 8-byte alignments.
 */
 typedef union Node {
   struct NodeKey {
     TValuefields;  /* fields for value */
     lu_byte key_tt;  /* key type */
-    int next;  /* for chaining */
     Value key_val;  /* key value */
   } u;
   TValue i_val;  /* direct access to node's value as a proper 'TValue' */
 } Node;
 
 
+#if !defined(HYDROGEN_NANBOXING)
+
 /* copy a value into a key */
 #define setnodekey(L,node,obj) \
 	{ Node *n_=(node); const TValue *io_=(obj); \
@@ -707,6 +993,28 @@ typedef union Node {
 	  io_->value_ = n_->u.key_val; io_->tt_ = n_->u.key_tt; \
 	  checkliveness(L,io_); }
 
+#else
+
+/*
+** With NaN boxing, keys keep their usual tag-and-value form, which
+** costs no space in a 'Node' and keeps the key code unchanged.
+*/
+
+/* copy a value into a key */
+#define setnodekey(L,node,obj) \
+	{ Node *n_=(node); const TValue *io_=(obj); \
+	  hydrogenO_nbunbox(io_, &n_->u.key_tt, &n_->u.key_val); \
+	  checkliveness(L,io_); }
+
+
+/* copy a value from a key */
+#define getnodekey(L,obj,node) \
+	{ TValue *io_=(obj); const Node *n_=(node); \
+	  hydrogenO_nbbox(io_, n_->u.key_tt, &n_->u.key_val); \
+	  checkliveness(L,io_); }
+
+#endif
+
 
 /*
 ** About 'alimit': if 'isrealasize(t)' is true, then 'alimit' is the
@@ -721,14 +1029,25 @@ typedef union Node {
 #define setnorealasize(t)	((t)->flags |= BITRAS)
 
 
+/*
+** 'BITMIGR' means that the block of the hash part of a table ends with
+** the state of an incremental resize (see 'Migration' in 'table.c').
+*/
+#define BITMIGR		(1 << 6)
+
+
 typedef struct Table {
   CommonHeader;
   lu_byte flags;  /* 1<<p means tagmethod(p) is not present */
   lu_byte lsizenode;  /* log2 of size of 'node' array */
   unsigned int alimit;  /* "limit" of 'array' array */
+#if defined(HYDROGEN_NANBOXING)
   TValue *array;  /* array part */
+#else
+  Value *array;  /* array part (values and tags; see 'arrval') */
+#endif
   Node *node;
-  Node *lastfree;  /* any free position is before this position */
+  unsigned int growthleft;  /* number of free nodes that can be used */
   struct Table *metatable;
   GCObject *gclist;
 } Table;
@@ -794,6 +1113,10 @@ HYDROGENI_FUNC const char *hydrogenO_pushvfstring (hydrogen_State *L, const char
                                                        va_list argp);
 HYDROGENI_FUNC const char *hydrogenO_pushfstring (hydrogen_State *L, const char *fmt, ...);
 HYDROGENI_FUNC void hydrogenO_chunkid (char *out, const char *source, size_t srclen);
+#if defined(HYDROGEN_NANBOXING)
+HYDROGENI_FUNC void hydrogenO_nbunbox (const TValue *o, lu_byte *tt, Value *v);
+HYDROGENI_FUNC void hydrogenO_nbbox (TValue *o, int tt, const Value *v);
+#endif
 
 
 #endif
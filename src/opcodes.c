@@ -100,5 +100,41 @@ HYDROGENI_DDEF const lu_byte hydrogenP_opmodes[NUM_OPCODES] = {
  ,opmode(0, 1, 0, 0, 1, iABC)		/* OP_VARARG */
  ,opmode(0, 0, 1, 0, 1, iABC)		/* OP_VARARGPREP */
  ,opmode(0, 0, 0, 0, 0, iAx)		/* OP_EXTRAARG */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_GETTABUP_CALL */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_GETFIELD_CALL */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_SELF_CALL */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_ADD_II */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_ADD_FF */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_SUB_II */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_SUB_FF */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_MUL_II */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_MUL_FF */
+ ,opmode(0, 0, 0, 1, 0, iABC)		/* OP_EQ_II */
+ ,opmode(0, 0, 0, 1, 0, iABC)		/* OP_LT_II */
+ ,opmode(0, 0, 0, 1, 0, iABC)		/* OP_LE_II */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_GETTABLE_ARRAY */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_GETI_ARRAY */
+ ,opmode(0, 0, 0, 0, 0, iABC)		/* OP_SETTABLE_ARRAY */
+ ,opmode(0, 0, 0, 0, 0, iABC)		/* OP_SETI_ARRAY */
+};
+
+
+HYDROGENI_DDEF const lu_byte hydrogenP_genericop[NUM_OPCODES - NUM_GENERICOPS] = {
+  OP_GETTABUP		/* OP_GETTABUP_CALL */
+ ,OP_GETFIELD		/* OP_GETFIELD_CALL */
+ ,OP_SELF		/* OP_SELF_CALL */
+ ,OP_ADD		/* OP_ADD_II */
+ ,OP_ADD		/* OP_ADD_FF */
+ ,OP_SUB		/* OP_SUB_II */
+ ,OP_SUB		/* OP_SUB_FF */
+ ,OP_MUL		/* OP_MUL_II */
+ ,OP_MUL		/* OP_MUL_FF */
+ ,OP_EQ			/* OP_EQ_II */
+ ,OP_LT			/* OP_LT_II */
+ ,OP_LE			/* OP_LE_II */
+ ,OP_GETTABLE		/* OP_GETTABLE_ARRAY */
+ ,OP_GETI		/* OP_GETI_ARRAY */
+ ,OP_SETTABLE		/* OP_SETTABLE_ARRAY */
+ ,OP_SETI		/* OP_SETI_ARRAY */
 };
 
@@ -306,11 +306,41 @@ OP_VARARG,/*	A C	R[A], R[A+1], ..., R[A+C-2] = vararg		*/
 
 OP_VARARGPREP,/*A	(adjust vararg parameters)			*/
 
-OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
+OP_EXTRAARG,/*	Ax	extra (larger) argument for previous opcode	*/
+
+/* fused opcodes (the fused OP_CALL stays as the next instruction) */
+
+OP_GETTABUP_CALL,/* A B C	OP_GETTABUP; OP_CALL				*/
+OP_GETFIELD_CALL,/* A B C	OP_GETFIELD; OP_CALL				*/
+OP_SELF_CALL,/*	A B C	OP_SELF; OP_CALL				*/
+
+/* quickened opcodes (never generated by the compiler; see notes) */
+
+OP_ADD_II,/*	A B C	R[A] := R[B] + R[C]	(integers)		*/
+OP_ADD_FF,/*	A B C	R[A] := R[B] + R[C]	(floats)		*/
+OP_SUB_II,/*	A B C	R[A] := R[B] - R[C]	(integers)		*/
+OP_SUB_FF,/*	A B C	R[A] := R[B] - R[C]	(floats)		*/
+OP_MUL_II,/*	A B C	R[A] := R[B] * R[C]	(integers)		*/
+OP_MUL_FF,/*	A B C	R[A] := R[B] * R[C]	(floats)		*/
+
+OP_EQ_II,/*	A B k	if ((R[A] == R[B]) ~= k) then pc++	(integers)	*/
+OP_LT_II,/*	A B k	if ((R[A] <  R[B]) ~= k) then pc++	(integers)	*/
+OP_LE_II,/*	A B k	if ((R[A] <= R[B]) ~= k) then pc++	(integers)	*/
+
+OP_GETTABLE_ARRAY,/* A B C	R[A] := R[B][R[C]]	(array part)		*/
+OP_GETI_ARRAY,/* A B C	R[A] := R[B][C]		(array part)		*/
+OP_SETTABLE_ARRAY,/* A B C	R[A][R[B]] := RK(C)	(array part)		*/
+OP_SETI_ARRAY/*	A B C	R[A][B] := RK(C)	(array part)		*/
 } OpCode;
 
 
-#define NUM_OPCODES	((int)(OP_EXTRAARG) + 1)
+#define NUM_OPCODES	((int)(OP_SETI_ARRAY) + 1)
+
+/* number of generic opcodes (neither fused nor quickened) */
+#define NUM_GENERICOPS	((int)(OP_EXTRAARG) + 1)
+
+/* first quickened opcode */
+#define FIRST_QUICKOP	OP_ADD_II
 
 
 
@@ -365,6 +395,27 @@ OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
   original operand was a float. (It must be corrected in case of
   metamethods.)
 
+  (*) Fused opcodes are generated by a peephole pass at the end of code
+  generation ('hydrogenK_finish') for an instruction followed by an
+  OP_CALL that uses its result. The fused opcode keeps the arguments of
+  the first instruction and the OP_CALL is left in place, so jumps,
+  line information, and debug information are not affected; the
+  interpreter just runs both instructions with one dispatch (unless
+  hooks are active). An OP_LT/OP_LE/OP_EQK or OP_TEST followed by its
+  OP_JMP, or an OP_ADDI followed by its OP_MMBINI, need no fusion:
+  the interpreter already consumes the second instruction of these
+  pairs without dispatching it.
+
+  (*) Quickened opcodes replace, at run time, a generic opcode that has
+  been executed repeatedly with the same operand types. They have the
+  same arguments as their generic opcode and, when their operands do
+  not have the expected types, they rewrite the instruction back to
+  the generic opcode ('deoptimization') before doing anything that can
+  raise an error, call a metamethod, or yield. They are never dumped.
+
+  (*) Code outside the interpreter loop should use 'GET_GENERICOP' to
+  see fused and quickened instructions as their first generic opcode.
+
 ===========================================================================*/
 
 
@@ -380,6 +431,9 @@ OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
 
 HYDROGENI_DDEC(const lu_byte hydrogenP_opmodes[NUM_OPCODES];)
 
+/* generic opcode of each fused and quickened opcode */
+HYDROGENI_DDEC(const lu_byte hydrogenP_genericop[NUM_OPCODES - NUM_GENERICOPS];)
+
 #define getOpMode(m)	(cast(enum OpMode, hydrogenP_opmodes[m] & 7))
 #define testAMode(m)	(hydrogenP_opmodes[m] & (1 << 3))
 #define testTMode(m)	(hydrogenP_opmodes[m] & (1 << 4))
@@ -387,6 +441,11 @@ HYDROGENI_DDEC(const lu_byte hydrogenP_opmodes[NUM_OPCODES];)
 #define testOTMode(m)	(hydrogenP_opmodes[m] & (1 << 6))
 #define testMMMode(m)	(hydrogenP_opmodes[m] & (1 << 7))
 
+#define isquickop(o)	((int)(o) >= (int)FIRST_QUICKOP)
+#define genericop(o)	((int)(o) >= NUM_GENERICOPS \
+	? cast(OpCode, hydrogenP_genericop[(int)(o) - NUM_GENERICOPS]) : (o))
+#define GET_GENERICOP(i)	genericop(GET_OPCODE(i))
+
 /* "out top" (set top for next instruction) */
 #define isOT(i)  \
 	((testOTMode(GET_OPCODE(i)) && GETARG_C(i) == 0) || \
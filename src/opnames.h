@@ -96,6 +96,22 @@ static const char *const opnames[] = {
   "VARARG",
   "VARARGPREP",
   "EXTRAARG",
+  "GETTABUP_CALL",
+  "GETFIELD_CALL",
+  "SELF_CALL",
+  "ADD_II",
+  "ADD_FF",
+  "SUB_II",
+  "SUB_FF",
+  "MUL_II",
+  "MUL_FF",
+  "EQ_II",
+  "LT_II",
+  "LE_II",
+  "GETTABLE_ARRAY",
+  "GETI_ARRAY",
+  "SETTABLE_ARRAY",
+  "SETI_ARRAY",
   NULL
 };
 
@@ -379,6 +379,15 @@ static int os_difftime (hydrogen_State *L) {
 /* }====================================================== */
 
 
+/* call the function in the registry that flushes cache 'key', if any */
+static void flushcache (hydrogen_State *L, const char *key) {
+  if (hydrogen_getfield(L, HYDROGEN_REGISTRYINDEX, key) == HYDROGEN_TFUNCTION)
+    hydrogen_call(L, 0, 0);
+  else
+    hydrogen_pop(L, 1);
+}
+
+
 static int os_setlocale (hydrogen_State *L) {
   static const int cat[] = {LC_ALL, LC_COLLATE, LC_CTYPE, LC_MONETARY,
                       LC_NUMERIC, LC_TIME};
@@ -386,7 +395,13 @@ static int os_setlocale (hydrogen_State *L) {
      "numeric", "time", NULL};
   const char *l = hydrogenL_optstring(L, 1, NULL);
   int op = hydrogenL_checkoption(L, 2, "all", catnames);
-  hydrogen_pushstring(L, setlocale(cat[op], l));
+  const char *res = setlocale(cat[op], l);
+  if (l != NULL && res != NULL) {  /* locale changed? */
+    /* compiled patterns and regexes depend on the character classes */
+    flushcache(L, HYDROGEN_PATCACHE_KEY);
+    flushcache(L, HYDROGEN_RXCACHE_KEY);
+  }
+  hydrogen_pushstring(L, res);
   return 1;
 }
 
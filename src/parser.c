@@ -761,6 +761,7 @@ static void close_func (LexState *ls) {
   hydrogen_assert(fs->bl == NULL);
   hydrogenK_finish(fs);
   hydrogenM_shrinkvector(L, f->code, f->sizecode, fs->pc, Instruction);
+  hydrogenF_newicache(L, f);
   hydrogenM_shrinkvector(L, f->lineinfo, f->sizelineinfo, fs->pc, ls_byte);
   hydrogenM_shrinkvector(L, f->abslineinfo, f->sizeabslineinfo,
                        fs->nabslineinfo, AbsLineInfo);
@@ -1700,7 +1701,8 @@ static void locafunction (LexState *ls) {
 static int getlocalattribute (LexState *ls) {
   /* ATTRIB -> ['<' Name '>'] */
   if (testnext(ls, '<')) {
-    const char *attr = getstr(str_checkname(ls));
+    TString *name = str_checkname(ls);
+    const char *attr = getstr(name);
     checknext(ls, '>');
     if (strcmp(attr, "const") == 0)
       return RDKCONST;  /* read-only variable */
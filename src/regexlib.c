@@ -0,0 +1,1487 @@
+/*
+** $Id: regexlib.c $
+** Regular expressions matched in linear time
+** See Copyright Notice in hydrogen.h
+*/
+
+#define regexlib_c
+#define HYDROGEN_LIB
+
+#include "prefix.h"
+
+
+#include <ctype.h>
+#include <limits.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "hydrogen.h"
+
+#include "auxlib.h"
+#include "hydrogenlib.h"
+
+
+/*
+** A regular expression is compiled into a program for a small virtual
+** machine that runs all of its threads in lockstep over the subject (a
+** Thompson NFA with captures, or "Pike VM"). Each subject character is
+** read once and each instruction runs at most once per character, so a
+** search takes time proportional to the length of the subject times the
+** size of the program, whatever the expression: there is no
+** backtracking. Threads are kept in priority order, so the match found
+** is the one a backtracking matcher would report (leftmost, honoring
+** greedy and lazy repetitions and the order of alternatives).
+*/
+
+
+/* maximum number of instructions in a compiled regex */
+#if !defined(REGEX_MAXPROG)
+#define REGEX_MAXPROG	20000
+#endif
+
+/* maximum count in a bounded repetition */
+#if !defined(REGEX_MAXREPEAT)
+#define REGEX_MAXREPEAT	1000
+#endif
+
+/* maximum nesting of groups */
+#if !defined(REGEX_MAXDEPTH)
+#define REGEX_MAXDEPTH	200
+#endif
+
+/* maximum number of capture groups */
+#if !defined(REGEX_MAXGROUPS)
+#define REGEX_MAXGROUPS	250
+#endif
+
+/* number of regexes compiled from strings kept by the module functions */
+#if !defined(RXCACHESIZE)
+#define RXCACHESIZE	32
+#endif
+
+
+#define REGEXHANDLE	"REGEX*"
+
+#define uchar(c)	((unsigned char)(c))
+
+/* size of a character-set bitmap */
+#define SETSIZE		(UCHAR_MAX / CHAR_BIT + 1)
+
+#define testset(set,c)	((set)[(c) / CHAR_BIT] & (1u << ((c) % CHAR_BIT)))
+#define addset(set,c)	((set)[(c) / CHAR_BIT] |= uchar(1u << ((c) % CHAR_BIT)))
+
+#define isword(c)	(isalnum(c) || (c) == '_')
+
+
+/* compilation flags */
+#define RF_ICASE	1	/* 'i': ignore case */
+#define RF_MULTILINE	2	/* 'm': '^' and '$' match at line breaks */
+#define RF_DOTALL	4	/* 's': '.' matches '\n' too */
+
+
+/* kinds of assertions */
+#define A_BOT		0	/* start of subject */
+#define A_EOT		1	/* end of subject */
+#define A_BOL		2	/* start of line */
+#define A_EOL		3	/* end of line */
+#define A_WORDB		4	/* word boundary */
+#define A_NWORDB	5	/* not a word boundary */
+
+
+
+/*
+** {======================================================
+** Parser
+** =======================================================
+*/
+
+/* kinds of nodes in the syntax tree */
+#define N_CHAR		0	/* character 'a' */
+#define N_SET		1	/* character in set 'a' */
+#define N_ANY		2	/* any character ('a' true: '\n' included) */
+#define N_ASSERT	3	/* assertion 'a' */
+#define N_CAT		4	/* concatenation of the children */
+#define N_ALT		5	/* alternation of the children */
+#define N_GROUP		6	/* capture group 'a' around the child */
+#define N_REP		7	/* child repeated 'a' to 'b' times (b < 0: no limit) */
+
+
+/*
+** Children of a node form a list linked by 'next', so that only
+** nesting (which is bounded) costs recursion, not the length of a
+** concatenation or the number of alternatives.
+*/
+typedef struct Node {
+  unsigned char kind;
+  unsigned char greedy;  /* for repetitions */
+  int a, b;
+  int child;  /* first child (-1 if none) */
+  int next;  /* next sibling (-1 if none) */
+} Node;
+
+
+typedef struct Parser {
+  hydrogen_State *L;
+  const char *p;  /* current position in the regex */
+  const char *p_end;  /* end ('\0') of the regex */
+  int flags;
+  int depth;  /* current nesting of groups */
+  int ngroups;  /* number of capture groups seen so far */
+  int nnodes;
+  int maxnodes;
+  int nsets;
+  int maxsets;
+  Node *nodes;
+  unsigned char *sets;
+} Parser;
+
+
+static int rxerror (Parser *ps, const char *msg) {
+  return hydrogenL_error(ps->L, "malformed regex (%s)", msg);
+}
+
+
+static int newnode (Parser *ps, int kind, int a) {
+  Node *n;
+  if (ps->nnodes >= ps->maxnodes)  /* cannot happen with a proper bound */
+    rxerror(ps, "too complex");
+  n = &ps->nodes[ps->nnodes];
+  n->kind = (unsigned char)kind;
+  n->greedy = 1;
+  n->a = a;
+  n->b = 0;
+  n->child = n->next = -1;
+  return ps->nnodes++;
+}
+
+
+/* create a new (empty) set; returns its index */
+static int newset (Parser *ps) {
+  if (ps->nsets >= ps->maxsets)  /* cannot happen with a proper bound */
+    rxerror(ps, "too complex");
+  memset(ps->sets + ps->nsets * SETSIZE, 0, SETSIZE);
+  return ps->nsets++;
+}
+
+
+static unsigned char *getset (Parser *ps, int s) {
+  return ps->sets + s * SETSIZE;
+}
+
+
+/* add to 'set' the characters of class '\c' ('d', 'w', 's' or negation) */
+static void addclass (unsigned char *set, int c) {
+  int i;
+  for (i = 0; i <= UCHAR_MAX; i++) {
+    int res;
+    switch (tolower(c)) {
+      case 'd': res = isdigit(i); break;
+      case 'w': res = isword(i); break;
+      default: res = isspace(i); break;  /* 's' */
+    }
+    if (isupper(c)) res = !res;
+    if (res) addset(set, i);
+  }
+}
+
+
+/* add to 'set' the characters of POSIX class 'name'; returns 0 if unknown */
+static int addposix (unsigned char *set, const char *name, size_t l) {
+  static const char *const names[] = {"alnum", "alpha", "blank", "cntrl",
+    "digit", "graph", "lower", "print", "punct", "space", "upper",
+    "xdigit", "word", NULL};
+  int k, i;
+  for (k = 0; names[k] != NULL; k++)
+    if (strlen(names[k]) == l && memcmp(names[k], name, l) == 0)
+      break;
+  if (names[k] == NULL) return 0;
+  for (i = 0; i <= UCHAR_MAX; i++) {
+    int res;
+    switch (k) {
+      case 0: res = isalnum(i); break;
+      case 1: res = isalpha(i); break;
+      case 2: res = (i == ' ' || i == '\t'); break;
+      case 3: res = iscntrl(i); break;
+      case 4: res = isdigit(i); break;
+      case 5: res = isgraph(i); break;
+      case 6: res = islower(i); break;
+      case 7: res = isprint(i); break;
+      case 8: res = ispunct(i); break;
+      case 9: res = isspace(i); break;
+      case 10: res = isupper(i); break;
+      case 11: res = isxdigit(i); break;
+      default: res = isword(i); break;
+    }
+    if (res) addset(set, i);
+  }
+  return 1;
+}
+
+
+static int hexvalue (int c) {
+  if (isdigit(c)) return c - '0';
+  else return (tolower(c) - 'a') + 10;
+}
+
+
+/*
+** Read the character denoted by escape '\e' (already consumed);
+** classes and assertions are handled by the callers.
+*/
+static int escapechar (Parser *ps, int e) {
+  switch (e) {
+    case 'n': return '\n';
+    case 't': return '\t';
+    case 'r': return '\r';
+    case 'f': return '\f';
+    case 'v': return '\v';
+    case 'a': return '\a';
+    case '0': return '\0';
+    case 'x': {
+      int c;
+      if (ps->p_end - ps->p < 2 || !isxdigit(uchar(ps->p[0])) ||
+                                   !isxdigit(uchar(ps->p[1])))
+        rxerror(ps, "invalid escape sequence '\\x'");
+      c = hexvalue(uchar(ps->p[0])) * 16 + hexvalue(uchar(ps->p[1]));
+      ps->p += 2;
+      return c;
+    }
+    default: {
+      if (isdigit(e))
+        rxerror(ps, "backreferences are not supported");
+      else if (isalnum(e))
+        rxerror(ps, "invalid escape sequence");
+      return e;  /* escaped punctuation stands for itself */
+    }
+  }
+}
+
+
+/* add both cases of every letter in 'set' */
+static void foldset (unsigned char *set) {
+  int i;
+  for (i = 0; i <= UCHAR_MAX; i++) {
+    if (testset(set, i)) {
+      addset(set, tolower(i));
+      addset(set, toupper(i));
+    }
+  }
+}
+
+
+/* read one endpoint of a range in a class; returns -1 for a class escape */
+static int classchar (Parser *ps, unsigned char *set) {
+  int c = uchar(*ps->p++);
+  if (c != '\\')
+    return c;
+  if (ps->p >= ps->p_end)
+    rxerror(ps, "missing ']' in character class");
+  c = uchar(*ps->p++);
+  if (strchr("dDwWsS", c) != NULL) {
+    addclass(set, c);
+    return -1;
+  }
+  else if (c == 'b')
+    return '\b';  /* inside a class, '\b' is backspace */
+  else
+    return escapechar(ps, c);
+}
+
+
+/* parse a character class ('[' already consumed) */
+static int parseclass (Parser *ps) {
+  int s = newset(ps);
+  int negate = 0;
+  int first = 1;
+  if (ps->p < ps->p_end && *ps->p == '^') {
+    negate = 1;
+    ps->p++;
+  }
+  for (;;) {
+    int lo, hi;
+    if (ps->p >= ps->p_end)
+      rxerror(ps, "missing ']' in character class");
+    if (*ps->p == ']' && !first) {
+      ps->p++;
+      break;
+    }
+    first = 0;
+    if (*ps->p == '[' && ps->p + 1 < ps->p_end && ps->p[1] == ':') {
+      const char *name = ps->p + 2;
+      const char *e = name;
+      while (e + 1 < ps->p_end && !(e[0] == ':' && e[1] == ']'))
+        e++;
+      if (e + 1 >= ps->p_end ||
+          !addposix(getset(ps, s), name, (size_t)(e - name)))
+        rxerror(ps, "invalid character class name");
+      ps->p = e + 2;
+      continue;
+    }
+    lo = classchar(ps, getset(ps, s));
+    if (lo < 0) continue;  /* class escape */
+    hi = lo;
+    if (ps->p + 1 < ps->p_end && *ps->p == '-' && ps->p[1] != ']') {
+      ps->p++;  /* skip '-' */
+      hi = classchar(ps, getset(ps, s));
+      if (hi < lo)  /* includes a class escape as endpoint */
+        rxerror(ps, "invalid character class range");
+    }
+    for (; lo <= hi; lo++)
+      addset(getset(ps, s), lo);
+  }
+  if (ps->flags & RF_ICASE)
+    foldset(getset(ps, s));
+  if (negate) {
+    int i;
+    unsigned char *set = getset(ps, s);
+    for (i = 0; i < SETSIZE; i++)
+      set[i] = uchar(~set[i]);
+  }
+  return newnode(ps, N_SET, s);
+}
+
+
+/* a literal character, which may match both cases */
+static int literal (Parser *ps, int c) {
+  if ((ps->flags & RF_ICASE) && tolower(c) != toupper(c)) {
+    int s = newset(ps);
+    addset(getset(ps, s), tolower(c));
+    addset(getset(ps, s), toupper(c));
+    return newnode(ps, N_SET, s);
+  }
+  return newnode(ps, N_CHAR, c);
+}
+
+
+/*
+** Check whether 'p' (just after a '{') starts a valid bound; if so,
+** read it into 'min' and 'max' and return the position after the '}'.
+*/
+static const char *getbound (Parser *ps, const char *p, int *min,
+                             int *max) {
+  const char *e = ps->p_end;
+  int n = 0;
+  if (p >= e || !isdigit(uchar(*p))) return NULL;
+  while (p < e && isdigit(uchar(*p))) {
+    if (n <= REGEX_MAXREPEAT) n = n * 10 + (*p - '0');
+    p++;
+  }
+  *min = *max = n;
+  if (p < e && *p == ',') {
+    p++;
+    if (p < e && isdigit(uchar(*p))) {
+      n = 0;
+      while (p < e && isdigit(uchar(*p))) {
+        if (n <= REGEX_MAXREPEAT) n = n * 10 + (*p - '0');
+        p++;
+      }
+      *max = n;
+    }
+    else
+      *max = -1;  /* no upper limit */
+  }
+  if (p >= e || *p != '}') return NULL;
+  if (*min > REGEX_MAXREPEAT || *max > REGEX_MAXREPEAT ||
+      (*max >= 0 && *max < *min))
+    rxerror(ps, "bad repetition count");
+  return p + 1;
+}
+
+
+static int isquantifier (Parser *ps) {
+  int min, max;
+  switch (*ps->p) {
+    case '*': case '+': case '?': return 1;
+    case '{': return (getbound(ps, ps->p + 1, &min, &max) != NULL);
+    default: return 0;
+  }
+}
+
+
+static int parsealt (Parser *ps);
+
+
+static int parseatom (Parser *ps) {
+  int c = uchar(*ps->p++);
+  switch (c) {
+    case '(': {
+      int n;
+      if (++ps->depth > REGEX_MAXDEPTH)
+        rxerror(ps, "groups nested too deeply");
+      if (ps->p < ps->p_end && *ps->p == '?') {
+        if (ps->p + 1 >= ps->p_end || ps->p[1] != ':')
+          rxerror(ps, "unsupported group syntax");
+        ps->p += 2;
+        n = parsealt(ps);
+      }
+      else {
+        int g;
+        if (ps->ngroups >= REGEX_MAXGROUPS)
+          rxerror(ps, "too many capture groups");
+        g = ++ps->ngroups;
+        n = newnode(ps, N_GROUP, g);
+        ps->nodes[n].child = parsealt(ps);
+      }
+      if (ps->p >= ps->p_end)
+        rxerror(ps, "missing ')'");
+      ps->p++;  /* skip ')' */
+      ps->depth--;
+      return n;
+    }
+    case '*': case '+': case '?':
+      rxerror(ps, "missing argument to repetition operator");
+      return -1;  /* to avoid warnings */
+    case '{': {
+      int min, max;
+      if (getbound(ps, ps->p, &min, &max) != NULL)
+        rxerror(ps, "missing argument to repetition operator");
+      return newnode(ps, N_CHAR, c);
+    }
+    case '.':
+      return newnode(ps, N_ANY, (ps->flags & RF_DOTALL) != 0);
+    case '^':
+      return newnode(ps, N_ASSERT,
+                         (ps->flags & RF_MULTILINE) ? A_BOL : A_BOT);
+    case '$':
+      return newnode(ps, N_ASSERT,
+                         (ps->flags & RF_MULTILINE) ? A_EOL : A_EOT);
+    case '[':
+      return parseclass(ps);
+    case '\\': {
+      if (ps->p >= ps->p_end)
+        rxerror(ps, "trailing '\\'");
+      c = uchar(*ps->p++);
+      switch (c) {
+        case 'd': case 'D': case 'w': case 'W': case 's': case 'S': {
+          int s = newset(ps);
+          addclass(getset(ps, s), c);
+          return newnode(ps, N_SET, s);
+        }
+        case 'b': return newnode(ps, N_ASSERT, A_WORDB);
+        case 'B': return newnode(ps, N_ASSERT, A_NWORDB);
+        case 'A': return newnode(ps, N_ASSERT, A_BOT);
+        case 'z': return newnode(ps, N_ASSERT, A_EOT);
+        default: return literal(ps, escapechar(ps, c));
+      }
+    }
+    default:
+      return literal(ps, c);
+  }
+}
+
+
+/* an atom followed by an optional quantifier */
+static int parserep (Parser *ps) {
+  int atom = parseatom(ps);
+  int min, max, n;
+  if (ps->p >= ps->p_end || !isquantifier(ps))
+    return atom;
+  switch (*ps->p++) {
+    case '*': min = 0; max = -1; break;
+    case '+': min = 1; max = -1; break;
+    case '?': min = 0; max = 1; break;
+    default:  /* '{' */
+      ps->p = getbound(ps, ps->p, &min, &max);
+      break;
+  }
+  n = newnode(ps, N_REP, min);
+  ps->nodes[n].b = max;
+  ps->nodes[n].child = atom;
+  if (ps->p < ps->p_end && *ps->p == '?') {  /* lazy? */
+    ps->nodes[n].greedy = 0;
+    ps->p++;
+  }
+  if (ps->p < ps->p_end && isquantifier(ps))
+    rxerror(ps, "bad repetition operator");
+  return n;
+}
+
+
+static int parsecat (Parser *ps) {
+  int n = newnode(ps, N_CAT, 0);
+  int last = -1;
+  while (ps->p < ps->p_end && *ps->p != '|' && *ps->p != ')') {
+    int item = parserep(ps);
+    if (last < 0) ps->nodes[n].child = item;
+    else ps->nodes[last].next = item;
+    last = item;
+  }
+  return n;
+}
+
+
+static int parsealt (Parser *ps) {
+  int first = parsecat(ps);
+  int n, last;
+  if (ps->p >= ps->p_end || *ps->p != '|')
+    return first;
+  n = newnode(ps, N_ALT, 0);
+  ps->nodes[n].child = last = first;
+  while (ps->p < ps->p_end && *ps->p == '|') {
+    int item;
+    ps->p++;  /* skip '|' */
+    item = parsecat(ps);
+    ps->nodes[last].next = item;
+    last = item;
+  }
+  return n;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Code generation
+** =======================================================
+*/
+
+/* instructions */
+#define I_CHAR		0	/* match character 'x' */
+#define I_ANY		1	/* match any character except '\n' */
+#define I_ANYNL		2	/* match any character */
+#define I_SET		3	/* match a character in set 'x' */
+#define I_MATCH		4	/* found a match */
+#define I_JMP		5	/* go to 'x' */
+#define I_SPLIT		6	/* go to 'x' and, with lower priority, to 'y' */
+#define I_SAVE		7	/* store current position in capture slot 'x' */
+#define I_ASSERT	8	/* go on only if assertion 'x' holds */
+
+
+typedef struct Inst {
+  int op;
+  int x, y;
+} Inst;
+
+
+typedef struct Regex {
+  int ninst;  /* number of instructions */
+  int ngroups;  /* number of capture groups */
+  int anchored;  /* can only match at the start of the subject */
+  int nfirst;  /* size of 'first' (0 if it cannot be used) */
+  int firstc;  /* the character in 'first', when 'nfirst' is 1 */
+  unsigned char first[SETSIZE];  /* characters that can start a match */
+  Inst *prog;
+  unsigned char *sets;
+} Regex;
+
+
+/* saturated size of the code for node 'n' */
+static int codesize (const Node *nodes, int n) {
+  const Node *nd = &nodes[n];
+  size_t sz = 0;
+  int c;
+  switch (nd->kind) {
+    case N_CAT: case N_ALT: {
+      for (c = nd->child; c >= 0; c = nodes[c].next)
+        sz += (size_t)codesize(nodes, c) + (nd->kind == N_ALT ? 2 : 0);
+      if (nd->kind == N_ALT) sz -= 2;  /* last alternative needs no jumps */
+      break;
+    }
+    case N_GROUP:
+      sz = (size_t)codesize(nodes, nd->child) + 2;
+      break;
+    case N_REP: {
+      size_t s = (size_t)codesize(nodes, nd->child);
+      if (nd->b < 0)
+        sz = (nd->a == 0) ? s + 2 : (size_t)nd->a * s + 1;
+      else
+        sz = (size_t)nd->a * s + (size_t)(nd->b - nd->a) * (s + 1);
+      break;
+    }
+    default:
+      sz = 1;
+      break;
+  }
+  return (sz > REGEX_MAXPROG) ? REGEX_MAXPROG + 1 : (int)sz;
+}
+
+
+static int emit (Inst *prog, int pc, int op, int x, int y) {
+  prog[pc].op = op;
+  prog[pc].x = x;
+  prog[pc].y = y;
+  return pc + 1;
+}
+
+
+static int gencode (const Node *nodes, int n, Inst *prog, int pc) {
+  const Node *nd = &nodes[n];
+  int c;
+  switch (nd->kind) {
+    case N_CHAR: return emit(prog, pc, I_CHAR, nd->a, 0);
+    case N_SET: return emit(prog, pc, I_SET, nd->a, 0);
+    case N_ANY: return emit(prog, pc, nd->a ? I_ANYNL : I_ANY, 0, 0);
+    case N_ASSERT: return emit(prog, pc, I_ASSERT, nd->a, 0);
+    case N_CAT: {
+      for (c = nd->child; c >= 0; c = nodes[c].next)
+        pc = gencode(nodes, c, prog, pc);
+      return pc;
+    }
+    case N_ALT: {
+      int jumps = -1;  /* list of jumps to the end, linked by 'x' */
+      for (c = nd->child; nodes[c].next >= 0; c = nodes[c].next) {
+        int split = pc;
+        pc = gencode(nodes, c, prog, pc + 1);
+        prog[split].op = I_SPLIT;
+        prog[split].x = split + 1;
+        prog[split].y = pc + 1;
+        pc = emit(prog, pc, I_JMP, jumps, 0);
+        jumps = pc - 1;
+      }
+      pc = gencode(nodes, c, prog, pc);
+      while (jumps >= 0) {  /* patch jumps */
+        int next = prog[jumps].x;
+        prog[jumps].x = pc;
+        jumps = next;
+      }
+      return pc;
+    }
+    case N_GROUP: {
+      pc = emit(prog, pc, I_SAVE, 2 * nd->a, 0);
+      pc = gencode(nodes, nd->child, prog, pc);
+      return emit(prog, pc, I_SAVE, 2 * nd->a + 1, 0);
+    }
+    default: {  /* N_REP */
+      int i, start;
+      if (nd->b < 0 && nd->a == 0) {  /* e* */
+        start = pc;
+        pc = gencode(nodes, nd->child, prog, pc + 1);
+        pc = emit(prog, pc, I_JMP, start, 0);
+        if (nd->greedy) emit(prog, start, I_SPLIT, start + 1, pc);
+        else emit(prog, start, I_SPLIT, pc, start + 1);
+        return pc;
+      }
+      for (i = (nd->b < 0) ? 1 : 0; i < nd->a; i++)  /* mandatory copies */
+        pc = gencode(nodes, nd->child, prog, pc);
+      if (nd->b < 0) {  /* e{min,}: last copy loops */
+        start = pc;
+        pc = gencode(nodes, nd->child, prog, pc);
+        if (nd->greedy) return emit(prog, pc, I_SPLIT, start, pc + 1);
+        else return emit(prog, pc, I_SPLIT, pc + 1, start);
+      }
+      else {  /* e{min,max}: optional copies skip to the end */
+        int splits = -1;  /* list of splits, linked by 'y' */
+        for (; i < nd->b; i++) {
+          start = pc;
+          pc = gencode(nodes, nd->child, prog, pc + 1);
+          emit(prog, start, I_SPLIT, start + 1, splits);
+          splits = start;
+        }
+        while (splits >= 0) {  /* patch splits */
+          int next = prog[splits].y;
+          if (nd->greedy) prog[splits].y = pc;
+          else {
+            prog[splits].y = splits + 1;
+            prog[splits].x = pc;
+          }
+          splits = next;
+        }
+        return pc;
+      }
+    }
+  }
+}
+
+
+/*
+** Compute the set of characters that can start a match, following all
+** paths through the program that consume nothing. If a match can be
+** empty, the set is useless.
+*/
+static void firstset (Regex *re, int *stack, unsigned char *visited) {
+  const Inst *prog = re->prog;
+  int top = 0;
+  int i;
+  memset(visited, 0, (size_t)re->ninst);
+  memset(re->first, 0, SETSIZE);
+  stack[top++] = 0;
+  while (top > 0) {
+    int pc = stack[--top];
+    if (visited[pc]) continue;
+    visited[pc] = 1;
+    switch (prog[pc].op) {
+      case I_CHAR: addset(re->first, prog[pc].x); break;
+      case I_SET: {
+        const unsigned char *set = re->sets + prog[pc].x * SETSIZE;
+        for (i = 0; i < SETSIZE; i++) re->first[i] |= set[i];
+        break;
+      }
+      case I_ANY: case I_ANYNL: case I_MATCH: {
+        re->nfirst = 0;
+        return;
+      }
+      case I_SPLIT:
+        stack[top++] = prog[pc].y;
+        stack[top++] = prog[pc].x;
+        break;
+      case I_JMP:
+        stack[top++] = prog[pc].x;
+        break;
+      default:  /* I_SAVE, I_ASSERT */
+        stack[top++] = pc + 1;
+        break;
+    }
+  }
+  re->nfirst = 0;
+  for (i = 0; i <= UCHAR_MAX; i++) {
+    if (testset(re->first, i)) {
+      re->nfirst++;
+      re->firstc = i;
+    }
+  }
+  if (re->nfirst > UCHAR_MAX)  /* all characters? */
+    re->nfirst = 0;  /* no use */
+}
+
+
+static int getflags (hydrogen_State *L, int arg) {
+  const char *f = hydrogenL_optstring(L, arg, "");
+  int flags = 0;
+  for (; *f; f++) {
+    switch (*f) {
+      case 'i': flags |= RF_ICASE; break;
+      case 'm': flags |= RF_MULTILINE; break;
+      case 's': flags |= RF_DOTALL; break;
+      default:
+        return hydrogenL_argerror(L, arg,
+                 hydrogen_pushfstring(L, "invalid flag '%c'", *f));
+    }
+  }
+  return flags;
+}
+
+
+/*
+** Compile the regex at index 'arg' with the given flags, pushing the
+** new regex object. Its first user value is the source; the second one
+** keeps the matching state of its last search (see 'getvm').
+*/
+static Regex *compile (hydrogen_State *L, int arg, int flags) {
+  size_t lp;
+  const char *p = hydrogenL_checklstring(L, arg, &lp);
+  Parser ps;
+  Regex *re;
+  int root, ninst;
+  void *work;
+  arg = hydrogen_absindex(L, arg);
+  ps.L = L;
+  ps.p = p;
+  ps.p_end = p + lp;
+  ps.flags = flags;
+  ps.depth = ps.ngroups = ps.nnodes = ps.nsets = 0;
+  /* each regex character creates at most two nodes and one set */
+  ps.maxnodes = (int)(2 * lp + 2);
+  ps.maxsets = (int)lp;
+  if (lp >= (size_t)INT_MAX / 4)
+    hydrogenL_error(L, "regex too large");
+  ps.nodes = (Node *)hydrogen_newuserdatauv(L,
+                 ps.maxnodes * sizeof(Node) + ps.maxsets * SETSIZE, 0);
+  ps.sets = (unsigned char *)(ps.nodes + ps.maxnodes);
+  root = parsealt(&ps);
+  if (ps.p < ps.p_end)  /* stopped at a ')'? */
+    rxerror(&ps, "unmatched ')'");
+  ninst = codesize(ps.nodes, root) + 3;  /* plus 'SAVE 0', 'SAVE 1', 'MATCH' */
+  if (ninst > REGEX_MAXPROG)
+    hydrogenL_error(L, "regex too large");
+  re = (Regex *)hydrogen_newuserdatauv(L, sizeof(Regex) +
+                       ninst * sizeof(Inst) + ps.nsets * SETSIZE, 2);
+  re->prog = (Inst *)(re + 1);
+  re->sets = (unsigned char *)(re->prog + ninst);
+  memcpy(re->sets, ps.sets, ps.nsets * SETSIZE);
+  re->ngroups = ps.ngroups;
+  re->ninst = emit(re->prog, 0, I_SAVE, 0, 0);
+  re->ninst = gencode(ps.nodes, root, re->prog, re->ninst);
+  re->ninst = emit(re->prog, re->ninst, I_SAVE, 1, 0);
+  re->ninst = emit(re->prog, re->ninst, I_MATCH, 0, 0);
+  hydrogen_assert(re->ninst == ninst);
+  re->anchored = (re->prog[1].op == I_ASSERT && re->prog[1].x == A_BOT);
+  work = hydrogen_newuserdatauv(L, (2 * ninst + 1) * sizeof(int) + ninst, 0);
+  firstset(re, (int *)work, (unsigned char *)work +
+                            (2 * ninst + 1) * sizeof(int));
+  hydrogen_pop(L, 1);  /* remove work area */
+  hydrogen_pushvalue(L, arg);
+  hydrogen_setiuservalue(L, -2, 1);  /* keep the source */
+  hydrogenL_setmetatable(L, REGEXHANDLE);
+  hydrogen_remove(L, -2);  /* remove parser area */
+  return re;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Matching
+** =======================================================
+*/
+
+/* a list of threads, as a sparse set of program counters */
+typedef struct ThreadList {
+  int n;  /* number of threads */
+  int *dense;  /* program counters, in priority order */
+  int *sparse;  /* position of each program counter in 'dense' */
+  ptrdiff_t *caps;  /* captures of each thread */
+} ThreadList;
+
+
+/* a job in the epsilon closure: follow 'pc' or restore a capture slot */
+typedef struct Job {
+  int pc;
+  int slot;  /* slot to restore with 'old' (-1 to follow 'pc') */
+  ptrdiff_t old;
+} Job;
+
+
+typedef struct VM {
+  const Regex *re;
+  const char *s;  /* subject */
+  size_t len;  /* length of the subject */
+  int ncap;  /* number of capture slots */
+  ThreadList list[2];
+  Job *stack;
+  ptrdiff_t *tmp;  /* captures of the thread being followed */
+  ptrdiff_t *found;  /* captures of the match found */
+  size_t pos;  /* where a 'gmatch' goes on */
+  ptrdiff_t lastmatch;  /* end of the last match of 'gmatch' (-1 if none) */
+} VM;
+
+
+/* create a matching state for regex 're', pushing it on the stack */
+static VM *newvm (hydrogen_State *L, const Regex *re) {
+  int ninst = re->ninst;
+  int ncap = 2 * (re->ngroups + 1);
+  size_t ncaps = (size_t)(2 * ninst + 2) * ncap;
+  size_t njobs = (size_t)(2 * ninst + 2);
+  VM *vm = (VM *)hydrogen_newuserdatauv(L, sizeof(VM) +
+             ncaps * sizeof(ptrdiff_t) + njobs * sizeof(Job) +
+             4 * ninst * sizeof(int), 0);
+  ptrdiff_t *caps = (ptrdiff_t *)(vm + 1);
+  int *ints;
+  int i;
+  vm->re = re;
+  vm->ncap = ncap;
+  for (i = 0; i < 2; i++) {
+    vm->list[i].n = 0;
+    vm->list[i].caps = caps + i * ninst * ncap;
+  }
+  vm->tmp = caps + 2 * ninst * ncap;
+  vm->found = vm->tmp + ncap;
+  vm->stack = (Job *)(vm->found + ncap);
+  ints = (int *)(vm->stack + njobs);
+  for (i = 0; i < 2; i++) {
+    vm->list[i].dense = ints + 2 * i * ninst;
+    vm->list[i].sparse = ints + (2 * i + 1) * ninst;
+  }
+  memset(ints, 0, 4 * ninst * sizeof(int));
+  vm->pos = 0;
+  vm->lastmatch = -1;
+  return vm;
+}
+
+
+static int wordat (const VM *vm, size_t i) {
+  return (i < vm->len && isword(uchar(vm->s[i])));
+}
+
+
+static int assertion (const VM *vm, int a, size_t sp) {
+  switch (a) {
+    case A_BOT: return (sp == 0);
+    case A_EOT: return (sp == vm->len);
+    case A_BOL: return (sp == 0 || vm->s[sp - 1] == '\n');
+    case A_EOL: return (sp == vm->len || vm->s[sp] == '\n');
+    case A_WORDB: return (sp > 0 && wordat(vm, sp - 1)) != wordat(vm, sp);
+    default: return (sp > 0 && wordat(vm, sp - 1)) == wordat(vm, sp);
+  }
+}
+
+
+/*
+** Add to list 'l' the thread at 'pc', at subject position 'sp', with
+** captures 'vm->tmp', following all instructions that consume nothing.
+** Higher priority paths are followed first, so they keep the program
+** counters they reach.
+*/
+static void addthread (VM *vm, ThreadList *l, int pc, size_t sp) {
+  const Inst *prog = vm->re->prog;
+  Job *stack = vm->stack;
+  int top = 0;
+  stack[top].pc = pc;
+  stack[top++].slot = -1;
+  while (top > 0) {
+    Job *j = &stack[--top];
+    if (j->slot >= 0) {  /* restore a capture? */
+      vm->tmp[j->slot] = j->old;
+      continue;
+    }
+    pc = j->pc;
+    for (;;) {
+      int i = l->sparse[pc];
+      const Inst *inst = &prog[pc];
+      if (i < l->n && l->dense[i] == pc)  /* already in the list? */
+        break;
+      l->sparse[pc] = l->n;
+      l->dense[l->n++] = pc;
+      if (inst->op == I_JMP)
+        pc = inst->x;
+      else if (inst->op == I_SPLIT) {
+        stack[top].pc = inst->y;
+        stack[top++].slot = -1;
+        pc = inst->x;
+      }
+      else if (inst->op == I_SAVE) {
+        stack[top].slot = inst->x;
+        stack[top++].old = vm->tmp[inst->x];
+        vm->tmp[inst->x] = (ptrdiff_t)sp;
+        pc++;
+      }
+      else if (inst->op == I_ASSERT) {
+        if (!assertion(vm, inst->x, sp)) break;
+        pc++;
+      }
+      else {  /* instruction that consumes: thread waits for next step */
+        memcpy(l->caps + (l->n - 1) * vm->ncap, vm->tmp,
+               vm->ncap * sizeof(ptrdiff_t));
+        break;
+      }
+    }
+  }
+}
+
+
+/*
+** Search for a match starting at position 'start' or later; if found,
+** store its captures in 'vm->found' and return 1.
+*/
+static int execute (VM *vm, size_t start) {
+  const Regex *re = vm->re;
+  const Inst *prog = re->prog;
+  const char *s = vm->s;
+  size_t len = vm->len;
+  int ncap = vm->ncap;
+  ThreadList *cl = &vm->list[0];
+  ThreadList *nl = &vm->list[1];
+  size_t sp = start;
+  int matched = 0;
+  if (re->anchored && start > 0)
+    return 0;
+  cl->n = 0;
+  for (;;) {
+    int c, i;
+    if (!matched && (!re->anchored || sp == 0)) {  /* start a new thread */
+      if (cl->n == 0 && re->nfirst > 0) {  /* skip to a possible start */
+        if (re->nfirst == 1) {
+          const char *q = (const char *)memchr(s + sp, re->firstc, len - sp);
+          if (q == NULL) break;
+          sp = (size_t)(q - s);
+        }
+        else {
+          while (sp < len && !testset(re->first, uchar(s[sp])))
+            sp++;
+          if (sp == len) break;
+        }
+      }
+      for (i = 0; i < ncap; i++) vm->tmp[i] = -1;
+      addthread(vm, cl, 0, sp);
+    }
+    else if (cl->n == 0)  /* no thread alive? */
+      break;
+    c = (sp < len) ? uchar(s[sp]) : -1;
+    nl->n = 0;
+    for (i = 0; i < cl->n; i++) {
+      const Inst *inst = &prog[cl->dense[i]];
+      const ptrdiff_t *caps = cl->caps + i * ncap;
+      int ok;
+      switch (inst->op) {
+        case I_CHAR: ok = (c == inst->x); break;
+        case I_ANY: ok = (c >= 0 && c != '\n'); break;
+        case I_ANYNL: ok = (c >= 0); break;
+        case I_SET: ok = (c >= 0 && testset(re->sets + inst->x * SETSIZE, c));
+                    break;
+        case I_MATCH: {
+          memcpy(vm->found, caps, ncap * sizeof(ptrdiff_t));
+          matched = 1;
+          goto cut;  /* threads with lower priority are discarded */
+        }
+        default: ok = 0; break;  /* instructions already followed */
+      }
+      if (ok) {
+        memcpy(vm->tmp, caps, ncap * sizeof(ptrdiff_t));
+        addthread(vm, nl, cl->dense[i] + 1, sp + 1);
+      }
+    }
+   cut:
+    if (sp >= len) break;
+    sp++;
+    {  /* swap lists */
+      ThreadList *t = cl;
+      cl = nl;
+      nl = t;
+    }
+  }
+  return matched;
+}
+
+
+/* length of capture 'i' of the match found, or -1 if it did not match */
+static ptrdiff_t caplen (const VM *vm, int i) {
+  if (vm->found[2 * i] < 0 || vm->found[2 * i + 1] < 0)
+    return -1;
+  return vm->found[2 * i + 1] - vm->found[2 * i];
+}
+
+
+/*
+** Push capture 'i' of the match found in the subject at index 'sidx'.
+** A group that did not take part in the match gives false, so that it
+** does not end a 'gmatch' loop.
+*/
+static void pushcapture (hydrogen_State *L, const VM *vm, int sidx, int i) {
+  ptrdiff_t l = caplen(vm, i);
+  if (l < 0)
+    hydrogen_pushboolean(L, 0);
+  else
+    hydrogen_pushsubstring(L, sidx, (size_t)vm->found[2 * i],
+                                    (size_t)l);
+}
+
+
+/* push the groups of the match, or the whole match if there are none */
+static int pushcaptures (hydrogen_State *L, const VM *vm, int sidx,
+                         int wholeifnone) {
+  int n = vm->re->ngroups;
+  int i;
+  if (n == 0 && wholeifnone) {
+    pushcapture(L, vm, sidx, 0);
+    return 1;
+  }
+  hydrogenL_checkstack(L, n, "too many captures");
+  for (i = 1; i <= n; i++)
+    pushcapture(L, vm, sidx, i);
+  return n;
+}
+
+
+/* translate a relative initial position, as strings do */
+static size_t posrelat (hydrogen_Integer pos, size_t len) {
+  if (pos > 0)
+    return (size_t)pos;
+  else if (pos == 0)
+    return 1;
+  else if (pos < -(hydrogen_Integer)len)  /* inverted comparison */
+    return 1;  /* clip to 1 */
+  else return len + (size_t)pos + 1;
+}
+
+
+/*
+** Get a matching state for regex 're' (at index 'rarg'), pushing it on
+** the stack. A regex keeps the state of its last search, which the next
+** one takes out while it runs and gives back when done ('keepvm'); so, a
+** search made meanwhile with the same regex (from a replacement function
+** or a finalizer) gets a new state, and a search ended by an error just
+** loses the one it had.
+*/
+static VM *getvm (hydrogen_State *L, const Regex *re, int rarg) {
+  VM *vm;
+  if (hydrogen_getiuservalue(L, rarg, 2) == HYDROGEN_TUSERDATA) {
+    vm = (VM *)hydrogen_touserdata(L, -1);
+    hydrogen_pushnil(L);
+    hydrogen_setiuservalue(L, rarg, 2);  /* take it out of the regex */
+    vm->pos = 0;
+    vm->lastmatch = -1;
+  }
+  else {
+    hydrogen_pop(L, 1);
+    vm = newvm(L, re);
+  }
+  return vm;
+}
+
+
+/* give the matching state at index 'vidx' back to the regex at 'rarg' */
+static void keepvm (hydrogen_State *L, int rarg, int vidx) {
+  hydrogen_pushvalue(L, vidx);
+  hydrogen_setiuservalue(L, rarg, 2);
+}
+
+
+/*
+** The module functions keep the regexes they compile from strings in a
+** cache, a userdata (their first upvalue) whose user values are the
+** compiled regexes. Entries are keyed by the address of the source
+** string, which the compiled regex keeps alive.
+*/
+#define RXCACHE		hydrogen_upvalueindex(1)
+
+typedef struct RxCache {
+  const void *key[RXCACHESIZE];
+  unsigned long stamp[RXCACHESIZE];  /* time of last use */
+  unsigned long clock;
+} RxCache;
+
+
+/* replace the string at index 'arg' by its compiled form, using the cache */
+static const Regex *cachedregex (hydrogen_State *L, int arg) {
+  const void *key = hydrogen_topointer(L, arg);
+  RxCache *c = (RxCache *)hydrogen_touserdata(L, RXCACHE);
+  int i, slot = 0;
+  for (i = 0; i < RXCACHESIZE; i++) {
+    if (c->key[i] == key) {  /* hit? */
+      c->stamp[i] = ++c->clock;
+      hydrogen_getiuservalue(L, RXCACHE, i + 1);
+      hydrogen_replace(L, arg);
+      return (const Regex *)hydrogen_touserdata(L, arg);
+    }
+  }
+  for (i = 1; i < RXCACHESIZE; i++) {  /* find least recently used entry */
+    if (c->stamp[i] < c->stamp[slot])
+      slot = i;
+  }
+  compile(L, arg, 0);
+  c->key[slot] = key;
+  c->stamp[slot] = ++c->clock;
+  hydrogen_pushvalue(L, -1);
+  hydrogen_setiuservalue(L, RXCACHE, slot + 1);
+  hydrogen_replace(L, arg);
+  return (const Regex *)hydrogen_touserdata(L, arg);
+}
+
+
+/*
+** Empty the cache (when the locale changes, as character classes
+** depend on it).
+*/
+static int flushregexes (hydrogen_State *L) {
+  RxCache *c = (RxCache *)hydrogen_touserdata(L, RXCACHE);
+  int i;
+  for (i = 0; i < RXCACHESIZE; i++) {
+    hydrogen_pushnil(L);
+    hydrogen_setiuservalue(L, RXCACHE, i + 1);
+  }
+  memset(c, 0, sizeof(RxCache));
+  return 0;
+}
+
+
+/*
+** Get the regex at index 'arg': either a compiled object or a string,
+** which is replaced by its compiled form.
+*/
+static const Regex *getregex (hydrogen_State *L, int arg) {
+  const Regex *re = (const Regex *)hydrogenL_testudata(L, arg, REGEXHANDLE);
+  if (re == NULL) {
+    if (hydrogen_type(L, arg) == HYDROGEN_TSTRING)
+      re = cachedregex(L, arg);
+    else {
+      re = compile(L, arg, 0);
+      hydrogen_replace(L, arg);
+    }
+  }
+  return re;
+}
+
+
+static const Regex *checkregex (hydrogen_State *L) {
+  return (const Regex *)hydrogenL_checkudata(L, 1, REGEXHANDLE);
+}
+
+
+/*
+** 'find' and 'match'; the subject is at index 'sarg' and the regex at
+** index '3 - sarg'.
+*/
+static int find_aux (hydrogen_State *L, int find, int sarg) {
+  size_t ls;
+  const char *s = hydrogenL_checkbytes(L, sarg, &ls);
+  const Regex *re = getregex(L, 3 - sarg);
+  size_t init = posrelat(hydrogenL_optinteger(L, 3, 1), ls) - 1;
+  int n = 0;
+  VM *vm;
+  if (init > ls) {  /* start after string's end? */
+    hydrogenL_pushfail(L);  /* cannot find anything */
+    return 1;
+  }
+  vm = getvm(L, re, 3 - sarg);
+  vm->s = s;
+  vm->len = ls;
+  if (execute(vm, init)) {
+    if (find) {
+      hydrogen_pushinteger(L, vm->found[0] + 1);
+      hydrogen_pushinteger(L, vm->found[1]);
+      n = pushcaptures(L, vm, sarg, 0) + 2;
+    }
+    else
+      n = pushcaptures(L, vm, sarg, 1);
+  }
+  keepvm(L, 3 - sarg, -(n + 1));
+  if (n == 0) {
+    hydrogenL_pushfail(L);  /* not found */
+    return 1;
+  }
+  return n;
+}
+
+
+static int gmatch_aux (hydrogen_State *L) {
+  VM *vm = (VM *)hydrogen_touserdata(L, hydrogen_upvalueindex(3));
+  size_t pos = vm->pos;
+  while (pos <= vm->len && execute(vm, pos)) {
+    if (vm->found[1] != vm->lastmatch) {
+      vm->pos = (size_t)vm->found[1];
+      vm->lastmatch = vm->found[1];
+      return pushcaptures(L, vm, hydrogen_upvalueindex(1), 1);
+    }
+    /* empty match right after the previous one: try one position ahead */
+    pos = (size_t)vm->found[0] + 1;
+  }
+  vm->pos = vm->len + 1;  /* no more matches */
+  return 0;  /* not found */
+}
+
+
+static int gmatch (hydrogen_State *L, int sarg) {
+  size_t ls;
+  const char *s = hydrogenL_checkbytes(L, sarg, &ls);
+  const Regex *re = getregex(L, 3 - sarg);
+  size_t init = posrelat(hydrogenL_optinteger(L, 3, 1), ls) - 1;
+  VM *vm;
+  hydrogen_settop(L, 2);  /* keep subject and regex */
+  if (sarg != 1)  /* subject must go first */
+    hydrogen_rotate(L, 1, 1);
+  vm = newvm(L, re);  /* the iterator keeps a state of its own */
+  vm->s = s;
+  vm->len = ls;
+  vm->pos = (init > ls) ? ls + 1 : init;  /* start after end: no matches */
+  hydrogen_pushcclosure(L, gmatch_aux, 3);
+  return 1;
+}
+
+
+/* add to 'b' the replacement string 'news' for the match found */
+static void add_s (hydrogen_State *L, hydrogenL_Buffer *b, const VM *vm,
+                   const char *news, size_t l) {
+  const char *p;
+  while ((p = (const char *)memchr(news, '%', l)) != NULL) {
+    int i;
+    hydrogenL_addlstring(b, news, p - news);
+    p++;  /* skip '%' */
+    if (*p == '%')  /* '%%' */
+      hydrogenL_addchar(b, *p);
+    else if (!isdigit(uchar(*p)))
+      hydrogenL_error(L, "invalid use of '%%' in replacement string");
+    else if ((i = *p - '0') > vm->re->ngroups)
+      hydrogenL_error(L, "invalid capture index %%%d in replacement string", i);
+    else if (caplen(vm, i) > 0)  /* unmatched groups add nothing */
+      hydrogenL_addlstring(b, vm->s + vm->found[2 * i],
+                              (size_t)caplen(vm, i));
+    l -= p + 1 - news;
+    news = p + 1;
+  }
+  hydrogenL_addlstring(b, news, l);
+}
+
+
+/*
+** Add to 'b' the replacement for the match found, according to the
+** value at index 3.
+*/
+static void add_value (hydrogen_State *L, hydrogenL_Buffer *b, const VM *vm,
+                       int sarg, int tr) {
+  size_t l;
+  const char *news;
+  switch (tr) {
+    case HYDROGEN_TFUNCTION: {
+      int n;
+      hydrogen_pushvalue(L, 3);
+      n = pushcaptures(L, vm, sarg, 1);
+      hydrogen_call(L, n, 1);
+      break;
+    }
+    case HYDROGEN_TTABLE: {
+      pushcapture(L, vm, sarg, vm->re->ngroups > 0);
+      hydrogen_gettable(L, 3);
+      break;
+    }
+    default: {  /* HYDROGEN_TNUMBER or HYDROGEN_TSTRING */
+      news = hydrogen_tolstring(L, 3, &l);
+      add_s(L, b, vm, news, l);
+      return;
+    }
+  }
+  if (!hydrogen_toboolean(L, -1)) {  /* nil or false? */
+    hydrogen_pop(L, 1);  /* remove value */
+    hydrogenL_addlstring(b, vm->s + vm->found[0],
+                            (size_t)(vm->found[1] - vm->found[0]));
+  }
+  else if (!hydrogen_isstring(L, -1))
+    hydrogenL_error(L, "invalid replacement value (a %s)",
+                       hydrogenL_typename(L, -1));
+  else
+    hydrogenL_addvalue(b);  /* add result to accumulator */
+}
+
+
+static int gsub (hydrogen_State *L, int sarg) {
+  size_t ls;
+  const char *s = hydrogenL_checkbytes(L, sarg, &ls);
+  const Regex *re = getregex(L, 3 - sarg);
+  int tr = hydrogen_type(L, 3);
+  hydrogen_Integer max_s = hydrogenL_optinteger(L, 4, (hydrogen_Integer)ls + 1);
+  hydrogen_Integer n = 0;  /* replacement count */
+  size_t src = 0;
+  ptrdiff_t lastmatch = -1;
+  int changed = 0;
+  int vidx;
+  hydrogenL_Buffer b;
+  VM *vm;
+  hydrogenL_argexpected(L, tr == HYDROGEN_TNUMBER || tr == HYDROGEN_TSTRING ||
+                   tr == HYDROGEN_TFUNCTION || tr == HYDROGEN_TTABLE, 3,
+                      "string/function/table");
+  vm = getvm(L, re, 3 - sarg);
+  vidx = hydrogen_gettop(L);
+  vm->s = s;
+  vm->len = ls;
+  hydrogenL_buffinit(L, &b);
+  while (n < max_s && src <= ls && execute(vm, src)) {
+    size_t ms = (size_t)vm->found[0];
+    hydrogenL_addlstring(&b, s + src, ms - src);  /* text before the match */
+    if (vm->found[1] == lastmatch) {  /* empty match after the previous one? */
+      if (ms < ls)
+        hydrogenL_addchar(&b, s[ms]);  /* keep one character and go on */
+      src = ms + 1;
+      continue;
+    }
+    n++;
+    changed = 1;
+    add_value(L, &b, vm, sarg, tr);
+    src = (size_t)vm->found[1];
+    lastmatch = vm->found[1];
+  }
+  keepvm(L, 3 - sarg, vidx);
+  if (!changed)  /* no changes? */
+    hydrogen_pushvalue(L, sarg);  /* return original string */
+  else {  /* something changed */
+    if (src < ls)
+      hydrogenL_addlstring(&b, s + src, ls - src);
+    hydrogenL_pushresult(&b);  /* create and return new string */
+  }
+  hydrogen_pushinteger(L, n);  /* number of substitutions */
+  return 2;
+}
+
+/* }====================================================== */
+
+
+
+static int rx_compile (hydrogen_State *L) {
+  compile(L, 1, getflags(L, 2));
+  return 1;
+}
+
+
+static int rx_find (hydrogen_State *L) {
+  return find_aux(L, 1, 1);
+}
+
+
+static int rx_match (hydrogen_State *L) {
+  return find_aux(L, 0, 1);
+}
+
+
+static int rx_gmatch (hydrogen_State *L) {
+  return gmatch(L, 1);
+}
+
+
+static int rx_gsub (hydrogen_State *L) {
+  return gsub(L, 1);
+}
+
+
+static int re_find (hydrogen_State *L) {
+  checkregex(L);
+  return find_aux(L, 1, 2);
+}
+
+
+static int re_match (hydrogen_State *L) {
+  checkregex(L);
+  return find_aux(L, 0, 2);
+}
+
+
+static int re_gmatch (hydrogen_State *L) {
+  checkregex(L);
+  return gmatch(L, 2);
+}
+
+
+static int re_gsub (hydrogen_State *L) {
+  checkregex(L);
+  return gsub(L, 2);
+}
+
+
+static int re_tostring (hydrogen_State *L) {
+  checkregex(L);
+  hydrogen_getiuservalue(L, 1, 1);
+  return 1;
+}
+
+
+/*
+** methods for regex objects
+*/
+static const hydrogenL_Reg methods[] = {
+  {"find", re_find},
+  {"match", re_match},
+  {"gmatch", re_gmatch},
+  {"gsub", re_gsub},
+  {NULL, NULL}
+};
+
+static const hydrogenL_Reg metameth[] = {
+  {"__index", NULL},  /* place holder */
+  {"__tostring", re_tostring},
+  {NULL, NULL}
+};
+
+
+static const hydrogenL_Reg funcs[] = {
+  {"compile", rx_compile},
+  {"find", rx_find},
+  {"match", rx_match},
+  {"gmatch", rx_gmatch},
+  {"gsub", rx_gsub},
+  {NULL, NULL}
+};
+
+
+static void createmeta (hydrogen_State *L) {
+  hydrogenL_newmetatable(L, REGEXHANDLE);  /* metatable for regexes */
+  hydrogenL_setfuncs(L, metameth, 0);  /* add metamethods to new metatable */
+  hydrogenL_newlibtable(L, methods);  /* create method table */
+  hydrogenL_setfuncs(L, methods, 0);  /* add regex methods to method table */
+  hydrogen_setfield(L, -2, "__index");  /* metatable.__index = method table */
+  hydrogen_pop(L, 1);  /* pop metatable */
+}
+
+
+HYDROGENMOD_API int hydrogenopen_regex (hydrogen_State *L) {
+  RxCache *c;
+  hydrogenL_newlibtable(L, funcs);
+  c = (RxCache *)hydrogen_newuserdatauv(L, sizeof(RxCache), RXCACHESIZE);
+  memset(c, 0, sizeof(RxCache));
+  hydrogen_pushvalue(L, -1);
+  hydrogen_pushcclosure(L, flushregexes, 1);
+  hydrogen_setfield(L, HYDROGEN_REGISTRYINDEX, HYDROGEN_RXCACHE_KEY);
+  hydrogenL_setfuncs(L, funcs, 1);  /* functions share the cache */
+  createmeta(L);
+  return 1;
+}
+
@@ -20,6 +20,7 @@
 #include "do.h"
 #include "function.h"
 #include "garbageCollection.h"
+#include "jit.h"
 #include "lexer.h"
 #include "memory.h"
 #include "state.h"
@@ -180,7 +181,8 @@ HYDROGENI_FUNC void hydrogenE_incCstack (hydrogen_State *L) {
 static void stack_init (hydrogen_State *L1, hydrogen_State *L) {
   int i; CallInfo *ci;
   /* initialize stack array */
-  L1->stack = hydrogenM_newvector(L, BASIC_STACK_SIZE + EXTRA_STACK, StackValue);
+  L1->stack = hydrogenM_newvector(L, stackalloc(BASIC_STACK_SIZE + EXTRA_STACK),
+                                  StackValue);
   L1->tbclist = L1->stack;
   for (i = 0; i < BASIC_STACK_SIZE + EXTRA_STACK; i++)
     setnilvalue(s2v(L1->stack + i));  /* erase new stack */
@@ -206,7 +208,7 @@ static void freestack (hydrogen_State *L) {
   L->ci = &L->base_ci;  /* free the entire 'ci' list */
   hydrogenE_freeCI(L);
   hydrogen_assert(L->nci == 0);
-  hydrogenM_freearray(L, L->stack, stacksize(L) + EXTRA_STACK);  /* free stack */
+  hydrogenM_freearray(L, L->stack, stackalloc(stacksize(L) + EXTRA_STACK));
 }
 
 
@@ -216,12 +218,15 @@ static void freestack (hydrogen_State *L) {
 static void init_registry (hydrogen_State *L, global_State *g) {
   /* create registry */
   Table *registry = hydrogenH_new(L);
+  TValue aux;
   sethvalue(L, &g->l_registry, registry);
   hydrogenH_resize(L, registry, HYDROGEN_RIDX_LAST, 0);
   /* registry[HYDROGEN_RIDX_MAINTHREAD] = L */
-  setthvalue(L, &registry->array[HYDROGEN_RIDX_MAINTHREAD - 1], L);
+  setthvalue(L, &aux, L);
+  arrsetobj(registry, HYDROGEN_RIDX_MAINTHREAD - 1, &aux);
   /* registry[HYDROGEN_RIDX_GLOBALS] = new table (table of globals) */
-  sethvalue(L, &registry->array[HYDROGEN_RIDX_GLOBALS - 1], hydrogenH_new(L));
+  sethvalue(L, &aux, hydrogenH_new(L));
+  arrsetobj(registry, HYDROGEN_RIDX_GLOBALS - 1, &aux);
 }
 
 
@@ -375,6 +380,7 @@ HYDROGEN_API hydrogen_State *hydrogen_newstate (hydrogen_Alloc f, void *ud) {
   g->seed = hydrogeni_makeseed(L);
   g->gcstp = GCSTPGC;  /* no GC while building state */
   g->strt.size = g->strt.nuse = 0;
+  g->strt.oldsize = g->strt.nsplit = g->strt.nresize = 0;
   g->strt.hash = NULL;
   setnilvalue(&g->l_registry);
   g->panic = NULL;
@@ -398,6 +404,14 @@ HYDROGEN_API hydrogen_State *hydrogen_newstate (hydrogen_Alloc f, void *ud) {
   g->gcstepsize = HYDROGENI_GCSTEPSIZE;
   setgcparam(g->genmajormul, HYDROGENI_GENMAJORMUL);
   g->genminormul = HYDROGENI_GENMINORMUL;
+#if defined(HYDROGEN_USE_JIT)
+  g->jiton = 1;
+  g->jitthreshold = JITTHRESHOLD;
+  g->jitcount = 0;
+  g->jittraces = 0;
+  g->jitrec = NULL;
+  g->jitaborts = g->jitentries = g->jitexits = 0;
+#endif
   for (i=0; i < HYDROGEN_NUMTAGS; i++) g->mt[i] = NULL;
   if (hydrogenD_rawrunprotected(L, f_hydrogenopen, NULL) != HYDROGEN_OK) {
     /* memory allocation error: free partial state */
@@ -427,14 +441,29 @@ void hydrogenE_warning (hydrogen_State *L, const char *msg, int tocont) {
 */
 void hydrogenE_warnerror (hydrogen_State *L, const char *where) {
   TValue *errobj = s2v(L->top - 1);  /* error object */
-  const char *msg = (ttisstring(errobj))
-                  ? svalue(errobj)
-                  : "error object is not a string";
   /* produce warning "error in %s (%s)" (where, msg) */
   hydrogenE_warning(L, "error in ", 1);
   hydrogenE_warning(L, where, 1);
   hydrogenE_warning(L, " (", 1);
-  hydrogenE_warning(L, msg, 1);
+  if (!ttisstring(errobj))
+    hydrogenE_warning(L, "error object is not a string", 1);
+  else {
+    /* the message may be a view with no final '\0' (see 'isview'), and
+       this must not allocate; so, send it in pieces (up to a '\0') */
+    const char *msg = svalue(errobj);
+    size_t l = vslen(errobj);
+    char buff[64];  /* a piece of the message */
+    while (l > 0 && *msg != '\0') {
+      size_t n = 0;
+      while (n < l && n < sizeof(buff) - 1 && msg[n] != '\0') {
+        buff[n] = msg[n];
+        n++;
+      }
+      buff[n] = '\0';
+      hydrogenE_warning(L, buff, 1);
+      msg += n; l -= n;
+    }
+  }
   hydrogenE_warning(L, ")", 0);
 }
 
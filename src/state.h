@@ -142,15 +142,48 @@ struct hydrogen_longjmp;  /* defined in do.c */
 #define stacksize(th)	cast_int((th)->stack_last - (th)->stack)
 
 
+#if !defined(HYDROGEN_NANBOXING)
+
+/* number of entries allocated for a stack with 'n' entries */
+#define stackalloc(n)	(n)
+
+/* delta of entry 'level' in the list of to-be-closed variables */
+#define tbcdelta(L,level)	((level)->tbclist.delta)
+
+#else
+
+/*
+** With NaN boxing, stack entries have no room for the deltas of the
+** list of to-be-closed variables; they go in an array after the stack
+** (and its extra space), in the same block.
+*/
+#define stackalloc(n)  \
+	((n) + cast_int(((n) * sizeof(unsigned short) + sizeof(StackValue) - 1) /  \
+	                sizeof(StackValue)))
+
+#define tbcdeltas(th)	cast(unsigned short *, (th)->stack_last + EXTRA_STACK)
+#define tbcdelta(L,level)	(tbcdeltas(L)[(level) - (L)->stack])
+
+#endif
+
+
 /* kinds of Garbage Collection */
 #define KGC_INC		0	/* incremental gc */
 #define KGC_GEN		1	/* generational gc */
 
 
+/*
+** While the string table grows (see 'growstrtab'), 'size' is already
+** the new size, but only the first 'nsplit' lists of the old part
+** (the first 'oldsize' ones) were split between it and the new part.
+*/
 typedef struct stringtable {
   TString **hash;
   int nuse;  /* number of elements */
   int size;
+  int oldsize;  /* size before the growth in progress (or 'size') */
+  int nsplit;  /* number of old lists already split */
+  int nresize;  /* number of resizes so far */
 } stringtable;
 
 
@@ -295,6 +328,16 @@ typedef struct global_State {
   TString *strcache[STRCACHE_N][STRCACHE_M];  /* cache for strings in API */
   hydrogen_WarnFunction warnf;  /* warning function */
   void *ud_warn;         /* auxiliary data to 'warnf' */
+#if defined(HYDROGEN_USE_JIT)
+  lu_byte jiton;  /* true if hot functions are compiled */
+  int jitthreshold;  /* calls and loop iterations that make a function hot */
+  int jitcount;  /* number of functions with native code */
+  int jittraces;  /* number of loops with traces */
+  struct TraceRecorder *jitrec;  /* trace being recorded (or NULL) */
+  lu_mem jitaborts;  /* number of failed recordings */
+  lu_mem jitentries;  /* number of runs of traces */
+  lu_mem jitexits;  /* number of runs that left a trace at a guard */
+#endif
 } global_State;
 
 
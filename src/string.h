@@ -25,10 +25,20 @@
 */
 #define sizestring(l)  (offsetof(TString, contents) + ((l) + 1) * sizeof(char))
 
+/* size of a view with a block of 'n' bytes (see 'isview') */
+#define sizeview(n)	(offsetof(TString, contents) + sizeof(StrView) + (n))
+
+/* the block of a view */
+#define viewblock(ts)	cast_charp(getview(ts) + 1)
+
 #define hydrogenS_newliteral(L, s)	(hydrogenS_newlstr(L, "" s, \
                                  (sizeof(s)/sizeof(char))-1))
 
 
+/* true while the string table of 'g' grows (see 'strlist') */
+#define hydrogenS_isgrowing(g)	((g)->strt.oldsize != (g)->strt.size)
+
+
 /*
 ** test whether a string is a reserved word
 */
@@ -45,6 +55,7 @@ HYDROGENI_FUNC unsigned int hydrogenS_hash (const char *str, size_t l, unsigned
 HYDROGENI_FUNC unsigned int hydrogenS_hashlongstr (TString *ts);
 HYDROGENI_FUNC int hydrogenS_eqlngstr (TString *a, TString *b);
 HYDROGENI_FUNC void hydrogenS_resize (hydrogen_State *L, int newsize);
+HYDROGENI_FUNC void hydrogenS_growstep (global_State *g, int n);
 HYDROGENI_FUNC void hydrogenS_clearcache (global_State *g);
 HYDROGENI_FUNC void hydrogenS_init (hydrogen_State *L);
 HYDROGENI_FUNC void hydrogenS_remove (hydrogen_State *L, TString *ts);
@@ -52,6 +63,12 @@ HYDROGENI_FUNC Udata *hydrogenS_newudata (hydrogen_State *L, size_t s, int nuval
 HYDROGENI_FUNC TString *hydrogenS_newlstr (hydrogen_State *L, const char *str, size_t l);
 HYDROGENI_FUNC TString *hydrogenS_new (hydrogen_State *L, const char *str);
 HYDROGENI_FUNC TString *hydrogenS_createlngstrobj (hydrogen_State *L, size_t l);
+HYDROGENI_FUNC TString *hydrogenS_newsub (hydrogen_State *L, TString *ts,
+                                                    size_t i, size_t l);
+HYDROGENI_FUNC int hydrogenS_isterminated (TString *ts);
+HYDROGENI_FUNC const char *hydrogenS_tocstr (hydrogen_State *L, TValue *o);
+HYDROGENI_FUNC TString *hydrogenS_newcat (hydrogen_State *L, TString *a, size_t l,
+                                                    char **rest);
 
 
 #endif
@@ -12,7 +12,6 @@
 
 #define gnode(t,i)	(&(t)->node[i])
 #define gval(n)		(&(n)->i_val)
-#define gnext(n)	((n)->u.next)
 
 
 /*
@@ -24,7 +23,7 @@
 
 
 /* true when 't' is using 'dummynode' as its hash part */
-#define isdummy(t)		((t)->lastfree == NULL)
+#define isdummy(t)		((t)->node == hydrogenH_dummynode)
 
 
 /* allocated size for hash nodes */
@@ -35,12 +34,94 @@
 #define nodefromval(v)	cast(Node *, (v))
 
 
-HYDROGENI_FUNC const TValue *hydrogenH_getint (Table *t, hydrogen_Integer key);
+/*
+** Access to entry 'i' (counting from 0) of the array part of table 't'.
+** With NaN boxing, a TValue already takes 8 bytes and the array part is
+** a plain vector of TValues. Otherwise, each entry is split in its value
+** ('arrval') and its tag ('arrtag'), both kept in one block: 'array'
+** points into the middle of it, with the values stored downwards before
+** that address and the tags stored upwards from it. An entry then takes
+** 'sizeof(Value) + 1' bytes instead of 'sizeof(TValue)', and both parts
+** are found from 'array' without the size of the array. As there is no
+** TValue for an entry, it is read and written by copying ('arrgetobj'
+** and 'arrsetobj').
+*/
+#if defined(HYDROGEN_NANBOXING)
+
+#define arrcellsize		sizeof(TValue)
+#define arrblock(t,n)		cast(void *, (t)->array)
+#define arrisempty(t,i)		isempty(&(t)->array[i])
+#define arrgetobj(t,i,o)	copyval_(o, &(t)->array[i])
+#define arrsetobj(t,i,o)	copyval_(&(t)->array[i], o)
+#define arrsetempty(t,i)	setempty(&(t)->array[i])
+#define arrgcvalue(t,i)  \
+	(iscollectable(&(t)->array[i]) ? gcvalue(&(t)->array[i]) : NULL)
+
+#else
+
+#define arrcellsize		(sizeof(Value) + 1)
+#define arrval(t,i)		((t)->array - 1 - (i))
+#define arrtag(t,i)		(cast(lu_byte *, (t)->array) + (i))
+#define arrblock(t,n)		cast(void *, (t)->array - (n))
+#define arrisempty(t,i)		(novariant(*arrtag(t,i)) == HYDROGEN_TNIL)
+#define arrgetobj(t,i,o)  \
+	(val_(o) = *arrval(t,i), settt_(o, *arrtag(t,i)))
+#define arrsetobj(t,i,o)  \
+	(*arrval(t,i) = val_(o), *arrtag(t,i) = rawtt(o))
+#define arrsetempty(t,i)	(*arrtag(t,i) = HYDROGEN_VEMPTY)
+#define arrgcvalue(t,i)  \
+	((*arrtag(t,i) & BIT_ISCOLLECTABLE) ? gcvalueraw(*arrval(t,i)) : NULL)
+
+#endif
+
+
+/*
+** If entry 'i' of the array part of 't' is present, copy it to 'o'
+** and return true.
+*/
+#define arrtryget(t,i,o)	(!arrisempty(t,i) && (arrgetobj(t,i,o), 1))
+
+
+/*
+** Search short string 'key' in 't' trying first node '*hint', an
+** inline-cache hint. The hint is only trusted after checking that it
+** is inside the current node vector and that its node holds 'key', so
+** a resize or rehash of 't' just makes the next search miss (which
+** refreshes the hint).
+*/
+#define hydrogenH_getcached(t,key,hint) \
+  (l_likely(*(hint) < cast_uint(sizenode(t)) && \
+            keyisshrstr(gnode(t, *(hint))) && \
+            keystrval(gnode(t, *(hint))) == (key)) \
+    ? gval(gnode(t, *(hint))) \
+    : hydrogenH_getshortstrhint(t, key, hint))
+
+
+/*
+** Finish the incremental resize of the hash part of 't', if one is
+** going on, so that all its entries are in 'node'.
+*/
+#define hydrogenH_settle(L,t)  \
+	{ if (l_unlikely((t)->flags & BITMIGR)) hydrogenH_endmigration(L, t); }
+
+
+HYDROGENI_DDEC(const Node hydrogenH_dummynode[2];)
+HYDROGENI_DDEC(const TValue hydrogenH_absentkey;)
+
+HYDROGENI_FUNC int hydrogenH_getint (Table *t, hydrogen_Integer key, TValue *res);
+HYDROGENI_FUNC int hydrogenH_trysetint (Table *t, hydrogen_Integer key,
+                                      TValue *value, const TValue **slot);
 HYDROGENI_FUNC void hydrogenH_setint (hydrogen_State *L, Table *t, hydrogen_Integer key,
                                                     TValue *value);
+HYDROGENI_FUNC void hydrogenH_setbytes (Table *t, unsigned int i, const char *s,
+                                                  unsigned int n);
 HYDROGENI_FUNC const TValue *hydrogenH_getshortstr (Table *t, TString *key);
+HYDROGENI_FUNC const TValue *hydrogenH_getshortstrhint (Table *t, TString *key,
+                                                    unsigned int *hint);
 HYDROGENI_FUNC const TValue *hydrogenH_getstr (Table *t, TString *key);
-HYDROGENI_FUNC const TValue *hydrogenH_get (Table *t, const TValue *key);
+HYDROGENI_FUNC int hydrogenH_get (Table *t, const TValue *key, TValue *res);
+HYDROGENI_FUNC int hydrogenH_tryset (Table *t, const TValue *key, TValue *value,
+                                   const TValue **slot);
 HYDROGENI_FUNC void hydrogenH_newkey (hydrogen_State *L, Table *t, const TValue *key,
                                                     TValue *value);
 HYDROGENI_FUNC void hydrogenH_set (hydrogen_State *L, Table *t, const TValue *key,
@@ -52,11 +133,27 @@ HYDROGENI_FUNC void hydrogenH_resize (hydrogen_State *L, Table *t, unsigned int
                                                     unsigned int nhsize);
 HYDROGENI_FUNC void hydrogenH_resizearray (hydrogen_State *L, Table *t, unsigned int nasize);
 HYDROGENI_FUNC void hydrogenH_free (hydrogen_State *L, Table *t);
+HYDROGENI_FUNC void hydrogenH_endmigration (hydrogen_State *L, Table *t);
+HYDROGENI_FUNC Node *hydrogenH_oldpart (Table *t, unsigned int *size);
 HYDROGENI_FUNC int hydrogenH_next (hydrogen_State *L, Table *t, StkId key);
 HYDROGENI_FUNC hydrogen_Unsigned hydrogenH_getn (Table *t);
 HYDROGENI_FUNC unsigned int hydrogenH_realasize (const Table *t);
 
 
+/*
+** Inlined fast case of 'hydrogenH_getint', for keys inside 'alimit'. (As
+** a function, 't' is evaluated before 'res' is written, which may be
+** the stack slot that held the table.)
+*/
+l_sinline int hydrogenH_fastgetint (Table *t, hydrogen_Integer key,
+                                    TValue *res) {
+  if (l_castS2U(key) - 1u < t->alimit)  /* 'key' in [1, t->alimit]? */
+    return arrtryget(t, key - 1, res);
+  else
+    return hydrogenH_getint(t, key, res);
+}
+
+
 #if defined(HYDROGEN_DEBUG)
 HYDROGENI_FUNC Node *hydrogenH_mainposition (const Table *t, const TValue *key);
 HYDROGENI_FUNC int hydrogenH_isdummy (const Table *t);
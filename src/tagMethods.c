@@ -92,9 +92,14 @@ const char *hydrogenT_objtypename (hydrogen_State *L, const TValue *o) {
   Table *mt;
   if ((ttistable(o) && (mt = hvalue(o)->metatable) != NULL) ||
       (ttisfulluserdata(o) && (mt = uvalue(o)->metatable) != NULL)) {
-    const TValue *name = hydrogenH_getshortstr(mt, hydrogenS_new(L, "__name"));
-    if (ttisstring(name))  /* is '__name' a string? */
-      return getstr(tsvalue(name));  /* use it as type name */
+    TValue *name = cast(TValue *,
+                        hydrogenH_getshortstr(mt, hydrogenS_new(L, "__name")));
+    if (ttisstring(name)) {  /* is '__name' a string? */
+      /* a view lacking a '\0' is replaced by a terminated copy */
+      const char *s = hydrogenS_tocstr(L, name);
+      hydrogenC_barrierback(L, obj2gco(mt), name);
+      return s;  /* use it as type name */
+    }
   }
   return ttypename(ttype(o));  /* else use standard type name */
 }
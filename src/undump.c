@@ -146,6 +146,8 @@ static void loadCode (LoadState *S, Proto *f) {
   f->code = hydrogenM_newvectorchecked(S->L, n, Instruction);
   f->sizecode = n;
   loadVector(S, f->code, n);
+  hydrogenF_fusecode(f->code, n);
+  hydrogenF_newicache(S->L, f);
 }
 
 
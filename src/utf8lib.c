@@ -15,6 +15,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "hydrogen.h"
 
 #include "auxlib.h"
@@ -84,14 +88,131 @@ static const char *utf8_decode (const char *s, utfint *val, int strict) {
 }
 
 
+/*
+** {======================================================
+** Validation and counting of whole slices
+** =======================================================
+*/
+
+#if defined(__SSE2__)
+
+/* index of the lowest bit set in 'm' (which is not zero) */
+#if defined(__GNUC__) && !defined(HYDROGEN_NOBUILTIN)
+#define firstbit(m)	((unsigned int)__builtin_ctz(m))
+#else
+static unsigned int firstbit (unsigned int m) {
+  unsigned int i = 0;
+  while (!(m & 1u)) {
+    m >>= 1;
+    i++;
+  }
+  return i;
+}
+#endif
+
+#endif
+
+
+/*
+** Length of the run of ASCII bytes at the start of 's', which has 'l'
+** bytes. With SSE2, checks 16 bytes at a time.
+*/
+static size_t asciispan (const char *s, size_t l) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + 16 <= l; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+    unsigned int m = (unsigned int)_mm_movemask_epi8(v);  /* high bits */
+    if (m != 0)  /* some non-ASCII byte? */
+      return i + firstbit(m);
+  }
+#endif
+  while (i < l && (unsigned char)s[i] < 0x80)
+    i++;
+  return i;
+}
+
+
+#define inrange(c,lo,hi)	((unsigned int)((c) - (lo)) <= (unsigned int)((hi) - (lo)))
+
+
+/*
+** Skip the multi-byte sequence at 's', returning NULL if it is not
+** well formed in strict UTF-8. It accepts the same sequences as
+** 'utf8_decode' with 'strict', but checks the ranges of the first two
+** bytes directly (see table 3-7 in the Unicode Standard) instead of
+** decoding the code point. As the string ends with a '\0', which is
+** not a continuation byte, it never reads past the end.
+*/
+static const char *utf8_skip (const char *s) {
+  const unsigned char *p = (const unsigned char *)s;
+  unsigned int c = p[0];
+  if (c < 0xC2)  /* continuation byte or overlong 2-byte sequence? */
+    return NULL;
+  else if (c < 0xE0)  /* 2 bytes */
+    return inrange(p[1], 0x80, 0xBF) ? s + 2 : NULL;
+  else if (c < 0xF0) {  /* 3 bytes; no overlongs or surrogates */
+    unsigned int lo = (c == 0xE0) ? 0xA0 : 0x80;
+    unsigned int hi = (c == 0xED) ? 0x9F : 0xBF;
+    return (inrange(p[1], lo, hi) && inrange(p[2], 0x80, 0xBF))
+           ? s + 3 : NULL;
+  }
+  else if (c < 0xF5) {  /* 4 bytes; no overlongs or values > MAXUNICODE */
+    unsigned int lo = (c == 0xF0) ? 0x90 : 0x80;
+    unsigned int hi = (c == 0xF4) ? 0x8F : 0xBF;
+    return (inrange(p[1], lo, hi) && inrange(p[2], 0x80, 0xBF) &&
+            inrange(p[3], 0x80, 0xBF)) ? s + 4 : NULL;
+  }
+  else
+    return NULL;
+}
+
+
+/*
+** Count in '*pn' the characters of 's' that start in the range
+** ['*ppos', 'e'). Runs of ASCII bytes are counted in bulk and other
+** characters are only checked, not decoded (unless 'lax'). Returns 0
+** if it finds an invalid sequence, with '*ppos' pointing to it.
+*/
+static int utf8_count (const char *s, size_t *ppos, size_t e, int lax,
+                       hydrogen_Integer *pn) {
+  size_t pos = *ppos;
+  hydrogen_Integer n = 0;
+  while (pos < e) {
+    if ((unsigned char)s[pos] < 0x80) {  /* run of ASCII characters? */
+      size_t k = asciispan(s + pos, e - pos);
+      n += (hydrogen_Integer)k;
+      pos += k;
+    }
+    else {
+      const char *s1 = lax ? utf8_decode(s + pos, NULL, 0)
+                           : utf8_skip(s + pos);
+      if (s1 == NULL) {  /* invalid sequence? */
+        *ppos = pos;
+        *pn = n;
+        return 0;
+      }
+      pos = s1 - s;
+      n++;
+    }
+  }
+  *ppos = pos;
+  *pn = n;
+  return 1;
+}
+
+/* }====================================================== */
+
+
 /*
 ** utf8len(s [, i [, j [, lax]]]) --> number of characters that
 ** start in the range [i,j], or nil + current position if 's' is not
 ** well formed in that interval
 */
 static int utflen (hydrogen_State *L) {
-  hydrogen_Integer n = 0;  /* counter for the number of characters */
+  hydrogen_Integer n;  /* counter for the number of characters */
   size_t len;  /* string length in bytes */
+  size_t pos;
   const char *s = hydrogenL_checklstring(L, 1, &len);
   hydrogen_Integer posi = u_posrelat(hydrogenL_optinteger(L, 2, 1), len);
   hydrogen_Integer posj = u_posrelat(hydrogenL_optinteger(L, 3, -1), len);
@@ -100,21 +221,36 @@ static int utflen (hydrogen_State *L) {
                    "initial position out of bounds");
   hydrogenL_argcheck(L, --posj < (hydrogen_Integer)len, 3,
                    "final position out of bounds");
-  while (posi <= posj) {
-    const char *s1 = utf8_decode(s + posi, NULL, !lax);
-    if (s1 == NULL) {  /* conversion error? */
-      hydrogenL_pushfail(L);  /* return fail ... */
-      hydrogen_pushinteger(L, posi + 1);  /* ... and current position */
-      return 2;
-    }
-    posi = s1 - s;
-    n++;
+  pos = (size_t)posi;
+  if (!utf8_count(s, &pos, (size_t)(posj + 1), lax, &n)) {
+    hydrogenL_pushfail(L);  /* return fail ... */
+    hydrogen_pushinteger(L, (hydrogen_Integer)pos + 1);  /* ... and position */
+    return 2;
   }
   hydrogen_pushinteger(L, n);
   return 1;
 }
 
 
+/*
+** valid(s [, lax]) --> true if 's' is well formed, or false plus the
+** position of its first invalid sequence
+*/
+static int utfvalid (hydrogen_State *L) {
+  size_t len;
+  size_t pos = 0;
+  hydrogen_Integer n;
+  const char *s = hydrogenL_checklstring(L, 1, &len);
+  if (utf8_count(s, &pos, len, hydrogen_toboolean(L, 2), &n)) {
+    hydrogen_pushboolean(L, 1);
+    return 1;
+  }
+  hydrogen_pushboolean(L, 0);
+  hydrogen_pushinteger(L, (hydrogen_Integer)pos + 1);
+  return 2;
+}
+
+
 /*
 ** codepoint(s, [i, [j [, lax]]]) -> returns codepoints for all
 ** characters that start in the range [i,j]
@@ -148,6 +284,45 @@ static int codepoint (hydrogen_State *L) {
 }
 
 
+/*
+** codepoints(s, [i, [j [, lax]]]) -> array with the codepoints of all
+** characters that start in the range [i,j] (by default, the whole
+** string). A first pass validates and counts the characters, so that
+** the array is created with its final size.
+*/
+static int codepoints (hydrogen_State *L) {
+  size_t len, pos, pose;
+  hydrogen_Integer n, k = 0;
+  const char *s = hydrogenL_checklstring(L, 1, &len);
+  hydrogen_Integer posi = u_posrelat(hydrogenL_optinteger(L, 2, 1), len);
+  hydrogen_Integer posj = u_posrelat(hydrogenL_optinteger(L, 3, -1), len);
+  int lax = hydrogen_toboolean(L, 4);
+  hydrogenL_argcheck(L, posi >= 1, 2, "out of bounds");
+  hydrogenL_argcheck(L, posj <= (hydrogen_Integer)len, 3, "out of bounds");
+  pos = (size_t)posi - 1;
+  pose = (posi <= posj) ? (size_t)posj : pos;  /* slice end */
+  if (!utf8_count(s, &pos, pose, lax, &n))
+    return hydrogenL_error(L, "invalid UTF-8 code");
+  if (n >= INT_MAX)  /* (hydrogen_Integer -> int) overflow? */
+    return hydrogenL_error(L, "string slice too long");
+  hydrogen_createtable(L, (int)n, 0);
+  for (pos = (size_t)posi - 1; pos < pose;) {
+    unsigned int c = (unsigned char)s[pos];
+    if (c < 0x80) {  /* ASCII character */
+      hydrogen_pushinteger(L, c);
+      pos++;
+    }
+    else {
+      utfint code;
+      pos = utf8_decode(s + pos, &code, 0) - s;  /* already checked */
+      hydrogen_pushinteger(L, code);
+    }
+    hydrogen_rawseti(L, -2, ++k);
+  }
+  return 1;
+}
+
+
 static void pushutfchar (hydrogen_State *L, int arg) {
   hydrogen_Unsigned code = (hydrogen_Unsigned)hydrogenL_checkinteger(L, arg);
   hydrogenL_argcheck(L, code <= MAXUTF, arg, "value out of range");
@@ -268,8 +443,10 @@ static int iter_codes (hydrogen_State *L) {
 static const hydrogenL_Reg funcs[] = {
   {"offset", byteoffset},
   {"codepoint", codepoint},
+  {"codepoints", codepoints},
   {"char", utfchar},
   {"len", utflen},
+  {"valid", utfvalid},
   {"codes", iter_codes},
   /* placeholders */
   {"charpattern", NULL},
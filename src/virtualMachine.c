@@ -18,10 +18,14 @@
 
 #include "hydrogen.h"
 
+#include "aot.h"
+#include "ctype.h"
 #include "debug.h"
 #include "do.h"
+#include "execute.h"
 #include "function.h"
 #include "garbageCollection.h"
+#include "jit.h"
 #include "object.h"
 #include "opcodes.h"
 #include "state.h"
@@ -44,6 +48,20 @@
 #endif
 
 
+/*
+** With jump tables, the interpreter loop is also direct threaded by
+** default: it dispatches through a predecoded copy of the code of each
+** function (see 'DecodedInstruction'), which holds where the code for
+** each instruction is and its operands.
+*/
+#if !HYDROGEN_USE_JUMPTABLE
+#undef HYDROGEN_USE_DIRECTTHREADING
+#define HYDROGEN_USE_DIRECTTHREADING	0
+#elif !defined(HYDROGEN_USE_DIRECTTHREADING)
+#define HYDROGEN_USE_DIRECTTHREADING	1
+#endif
+
+
 
 /* limit for table tag-method chains (to avoid infinite loops) */
 #define MAXTAGLOOP	2000
@@ -80,19 +98,52 @@
 #endif
 
 
+/* maximum length of a numeral to be converted from a view on the C stack */
+#if !defined (L_MAXLENNUM)
+#define L_MAXLENNUM	200
+#endif
+
+
 /*
 ** Try to convert a value from string to a number value.
 ** If the value is not a string or is a string not representing
 ** a valid numeral (or if coercions from strings to numbers
 ** are disabled via macro 'cvt2num'), do not modify 'result'
 ** and return 0.
+** The bytes of a view may not be followed by a '\0' (see 'isview')
+** and may be shared with other strings, so they are converted from a
+** copy without their surrounding spaces: in a local buffer, or, for a
+** longer numeral, in a block from the allocator (which may raise a
+** memory error) freed right after the conversion.
 */
-static int l_strton (const TValue *obj, TValue *result) {
+static int l_strton (hydrogen_State *L, const TValue *obj, TValue *result) {
   hydrogen_assert(obj != result);
   if (!cvt2num(obj))  /* is object not a string? */
     return 0;
-  else
-    return (hydrogenO_str2num(svalue(obj), result) == vslen(obj) + 1);
+  else {
+    TString *ts = tsvalue(obj);
+    const char *s = getstr(ts);
+    size_t l = tsslen(ts);
+    if (isview(ts)) {
+      char buff[L_MAXLENNUM + 1];
+      char *b = buff;
+      int res;
+      while (l > 0 && lisspace(cast_uchar(*s))) {  /* skip leading spaces */
+        s++; l--;
+      }
+      while (l > 0 && lisspace(cast_uchar(s[l - 1])))  /* and trailing ones */
+        l--;
+      if (l > L_MAXLENNUM)  /* too long for 'buff'? */
+        b = hydrogenM_newvector(L, l + 1, char);
+      memcpy(b, s, l * sizeof(char));
+      b[l] = '\0';
+      res = (hydrogenO_str2num(b, result) == l + 1);
+      if (b != buff)
+        hydrogenM_freearray(L, b, l + 1);
+      return res;
+    }
+    return (hydrogenO_str2num(s, result) == l + 1);
+  }
 }
 
 
@@ -100,13 +151,14 @@ static int l_strton (const TValue *obj, TValue *result) {
 ** Try to convert a value to a float. The float case is already handled
 ** by the macro 'tonumber'.
 */
-int hydrogenV_tonumber_ (const TValue *obj, hydrogen_Number *n) {
+int hydrogenV_tonumber_ (hydrogen_State *L, const TValue *obj,
+                                           hydrogen_Number *n) {
   TValue v;
   if (ttisinteger(obj)) {
     *n = cast_num(ivalue(obj));
     return 1;
   }
-  else if (l_strton(obj, &v)) {  /* string coercible to number? */
+  else if (l_strton(L, obj, &v)) {  /* string coercible to number? */
     *n = nvalue(&v);  /* convert result of 'hydrogenO_str2num' to a float */
     return 1;
   }
@@ -149,9 +201,10 @@ int hydrogenV_tointegerns (const TValue *obj, hydrogen_Integer *p, F2Imod mode)
 /*
 ** try to convert a value to an integer.
 */
-int hydrogenV_tointeger (const TValue *obj, hydrogen_Integer *p, F2Imod mode) {
+int hydrogenV_tointeger (hydrogen_State *L, const TValue *obj,
+                          hydrogen_Integer *p, F2Imod mode) {
   TValue v;
-  if (l_strton(obj, &v))  /* does 'obj' point to a numerical string? */
+  if (l_strton(L, obj, &v))  /* does 'obj' point to a numerical string? */
     obj = &v;  /* change it to point to its corresponding number */
   return hydrogenV_tointegerns(obj, p, mode);
 }
@@ -175,10 +228,10 @@ int hydrogenV_tointeger (const TValue *obj, hydrogen_Integer *p, F2Imod mode) {
 */
 static int forlimit (hydrogen_State *L, hydrogen_Integer init, const TValue *lim,
                                    hydrogen_Integer *p, hydrogen_Integer step) {
-  if (!hydrogenV_tointeger(lim, p, (step < 0 ? F2Iceil : F2Ifloor))) {
+  if (!hydrogenV_tointeger(L, lim, p, (step < 0 ? F2Iceil : F2Ifloor))) {
     /* not coercible to in integer */
     hydrogen_Number flim;  /* try to convert to float */
-    if (!tonumber(lim, &flim)) /* cannot convert to float? */
+    if (!tonumber(L, lim, &flim)) /* cannot convert to float? */
       hydrogenG_forerror(L, lim, "limit");
     /* else 'flim' is a float out of integer bounds */
     if (hydrogeni_numlt(0, flim)) {  /* if it is positive, it is too large */
@@ -203,7 +256,7 @@ static int forlimit (hydrogen_State *L, hydrogen_Integer init, const TValue *lim
 **   ra + 2 : step
 **   ra + 3 : control variable
 */
-static int forprep (hydrogen_State *L, StkId ra) {
+int hydrogenV_forprep (hydrogen_State *L, StkId ra) {
   TValue *pinit = s2v(ra);
   TValue *plimit = s2v(ra + 1);
   TValue *pstep = s2v(ra + 2);
@@ -235,11 +288,11 @@ static int forprep (hydrogen_State *L, StkId ra) {
   }
   else {  /* try making all values floats */
     hydrogen_Number init; hydrogen_Number limit; hydrogen_Number step;
-    if (l_unlikely(!tonumber(plimit, &limit)))
+    if (l_unlikely(!tonumber(L, plimit, &limit)))
       hydrogenG_forerror(L, plimit, "limit");
-    if (l_unlikely(!tonumber(pstep, &step)))
+    if (l_unlikely(!tonumber(L, pstep, &step)))
       hydrogenG_forerror(L, pstep, "step");
-    if (l_unlikely(!tonumber(pinit, &init)))
+    if (l_unlikely(!tonumber(L, pinit, &init)))
       hydrogenG_forerror(L, pinit, "initial value");
     if (step == 0)
       hydrogenG_runerror(L, "'for' step is zero");
@@ -263,7 +316,7 @@ static int forprep (hydrogen_State *L, StkId ra) {
 ** true iff the loop must continue. (The integer case is
 ** written online with opcode OP_FORLOOP, for performance.)
 */
-static int floatforloop (StkId ra) {
+int hydrogenV_floatforloop (StkId ra) {
   hydrogen_Number step = fltvalue(s2v(ra + 2));
   hydrogen_Number limit = fltvalue(s2v(ra + 1));
   hydrogen_Number idx = fltvalue(s2v(ra));  /* internal index */
@@ -310,22 +363,49 @@ void hydrogenV_finishget (hydrogen_State *L, const TValue *t, TValue *key, StkId
       return;
     }
     t = tm;  /* else try to access 'tm[key]' */
-    if (hydrogenV_fastget(L, t, key, slot, hydrogenH_get)) {  /* fast track? */
-      setobj2s(L, val, slot);  /* done */
-      return;
-    }
+    if (hydrogenV_fastgetv(L, t, key, s2v(val), slot))  /* fast track? */
+      return;  /* done */
     /* else repeat (tail call 'hydrogenV_finishget') */
   }
   hydrogenG_runerror(L, "'__index' chain too long; possible loop");
 }
 
 
+/*
+** Variant of 'hydrogenV_finishget' for a constant short-string key.
+** When 't' is a table whose '__index' is also a table (the usual
+** layout of objects and their classes), the access to that second
+** table goes through the inline-cache hint '*hint'; everything else
+** is handled by the generic function.
+*/
+void hydrogenV_finishgetcached (hydrogen_State *L, const TValue *t,
+                                TValue *key, StkId val, const TValue *slot,
+                                unsigned int *hint) {
+  if (slot != NULL) {  /* 't' is a table? */
+    const TValue *tm = fasttm(L, hvalue(t)->metatable, TM_INDEX);
+    if (tm == NULL) {  /* no metamethod? */
+      setnilvalue(s2v(val));  /* result is nil */
+      return;
+    }
+    if (ttistable(tm)) {  /* '__index' is a table? */
+      slot = hydrogenH_getcached(hvalue(tm), tsvalue(key), hint);
+      if (!isempty(slot)) {
+        setobj2s(L, val, slot);  /* done */
+        return;
+      }
+      t = tm;  /* else continue the chain from 'tm' */
+    }
+  }
+  hydrogenV_finishget(L, t, key, val, slot);
+}
+
+
 /*
 ** Finish a table assignment 't[key] = val'.
 ** If 'slot' is NULL, 't' is not a table.  Otherwise, 'slot' points
 ** to the entry 't[key]', or to a value with an absent key if there
 ** is no such entry.  (The value at 'slot' must be empty, otherwise
-** 'hydrogenV_fastget' would have done the job.)
+** 'hydrogenV_fastset' would have done the job.)
 */
 void hydrogenV_finishset (hydrogen_State *L, const TValue *t, TValue *key,
                      TValue *val, const TValue *slot) {
@@ -355,10 +435,8 @@ void hydrogenV_finishset (hydrogen_State *L, const TValue *t, TValue *key,
       return;
     }
     t = tm;  /* else repeat assignment over 'tm' */
-    if (hydrogenV_fastget(L, t, key, slot, hydrogenH_get)) {
-      hydrogenV_finishfastset(L, t, slot, val);
+    if (hydrogenV_fastset(L, t, key, val, slot))
       return;  /* done */
-    }
     /* else 'return hydrogenV_finishset(L, t, key, val, slot)' (loop) */
   }
   hydrogenG_runerror(L, "'__newindex' chain too long; possible loop");
@@ -366,27 +444,24 @@ void hydrogenV_finishset (hydrogen_State *L, const TValue *t, TValue *key,
 
 
 /*
-** Compare two strings 'ls' x 'rs', returning an integer less-equal-
-** -greater than zero if 'ls' is less-equal-greater than 'rs'.
+** Compare two strings 'l' x 'r' of lengths 'll' and 'lr', both followed
+** by a '\0', returning an integer less-equal-greater than zero if 'l'
+** is less-equal-greater than 'r'.
 ** The code is a little tricky because it allows '\0' in the strings
 ** and it uses 'strcoll' (to respect locales) for each segments
 ** of the strings.
 */
-static int l_strcmp (const TString *ls, const TString *rs) {
-  const char *l = getstr(ls);
-  size_t ll = tsslen(ls);
-  const char *r = getstr(rs);
-  size_t lr = tsslen(rs);
+static int strsegcmp (const char *l, size_t ll, const char *r, size_t lr) {
   for (;;) {  /* for each segment */
     int temp = strcoll(l, r);
     if (temp != 0)  /* not equal? */
       return temp;  /* done */
     else {  /* strings are equal up to a '\0' */
       size_t len = strlen(l);  /* index of first '\0' in both strings */
-      if (len == lr)  /* 'rs' is finished? */
-        return (len == ll) ? 0 : 1;  /* check 'ls' */
-      else if (len == ll)  /* 'ls' is finished? */
-        return -1;  /* 'ls' is less than 'rs' ('rs' is not finished) */
+      if (len == lr)  /* 'r' is finished? */
+        return (len == ll) ? 0 : 1;  /* check 'l' */
+      else if (len == ll)  /* 'l' is finished? */
+        return -1;  /* 'l' is less than 'r' ('r' is not finished) */
       /* both strings longer than 'len'; Hydrogen on comparing after the '\0' */
       len++;
       l += len; ll -= len; r += len; lr -= len;
@@ -395,6 +470,51 @@ static int l_strcmp (const TString *ls, const TString *rs) {
 }
 
 
+/* size of the buffer on the C stack for copies of views in 'l_strcmp' */
+#define STRCMPBUFF	(4 * HYDROGENI_MINVIEW)
+
+
+/*
+** Compare two strings 'ls' x 'rs'. A view whose bytes are not followed
+** by a '\0' (see 'hydrogenS_isterminated') is compared through a
+** terminated copy, made in a buffer that is gone after the comparison:
+** one on the C stack if both copies fit there, or else one from the
+** allocator. ('strcoll' raises no errors, so that one is always freed.)
+*/
+static int l_strcmp (hydrogen_State *L, TString *ls, TString *rs) {
+  const char *l = getstr(ls);
+  size_t ll = tsslen(ls);
+  const char *r = getstr(rs);
+  size_t lr = tsslen(rs);
+  int tl = hydrogenS_isterminated(ls);
+  int tr = hydrogenS_isterminated(rs);
+  if (tl && tr)  /* usual case */
+    return strsegcmp(l, ll, r, lr);
+  else {
+    char sbuff[STRCMPBUFF];
+    size_t n = (tl ? 0 : ll + 1) + (tr ? 0 : lr + 1);
+    char *buff = (n <= STRCMPBUFF) ? sbuff : hydrogenM_newvector(L, n, char);
+    char *p = buff;
+    int res;
+    if (!tl) {
+      memcpy(p, l, ll * sizeof(char));
+      p[ll] = '\0';
+      l = p;
+      p += ll + 1;
+    }
+    if (!tr) {
+      memcpy(p, r, lr * sizeof(char));
+      p[lr] = '\0';
+      r = p;
+    }
+    res = strsegcmp(l, ll, r, lr);
+    if (buff != sbuff)
+      hydrogenM_freearray(L, buff, n);
+    return res;
+  }
+}
+
+
 /*
 ** Check whether integer 'i' is less than float 'f'. If 'i' has an
 ** exact representation as a float ('l_intfitsf'), compare numbers as
@@ -520,7 +640,7 @@ l_sinline int LEnum (const TValue *l, const TValue *r) {
 static int lessthanothers (hydrogen_State *L, const TValue *l, const TValue *r) {
   hydrogen_assert(!ttisnumber(l) || !ttisnumber(r));
   if (ttisstring(l) && ttisstring(r))  /* both are strings? */
-    return l_strcmp(tsvalue(l), tsvalue(r)) < 0;
+    return l_strcmp(L, tsvalue(l), tsvalue(r)) < 0;
   else
     return hydrogenT_callorderTM(L, l, r, TM_LT);
 }
@@ -542,7 +662,7 @@ int hydrogenV_lessthan (hydrogen_State *L, const TValue *l, const TValue *r) {
 static int lessequalothers (hydrogen_State *L, const TValue *l, const TValue *r) {
   hydrogen_assert(!ttisnumber(l) || !ttisnumber(r));
   if (ttisstring(l) && ttisstring(r))  /* both are strings? */
-    return l_strcmp(tsvalue(l), tsvalue(r)) <= 0;
+    return l_strcmp(L, tsvalue(l), tsvalue(r)) <= 0;
   else
     return hydrogenT_callorderTM(L, l, r, TM_LE);
 }
@@ -666,8 +786,9 @@ void hydrogenV_concat (hydrogen_State *L, int total) {
         ts = hydrogenS_newlstr(L, buff, tl);
       }
       else {  /* long string; copy strings directly to final result */
-        ts = hydrogenS_createlngstrobj(L, tl);
-        copy2buff(top, n, getstr(ts));
+        char *rest;
+        ts = hydrogenS_newcat(L, tsvalue(s2v(top - n)), tl, &rest);
+        copy2buff(top, n - 1, rest);  /* copy the other strings */
       }
       setsvalue2s(L, top - n, ts);  /* create result */
     }
@@ -760,9 +881,23 @@ hydrogen_Number hydrogenV_modf (hydrogen_State *L, hydrogen_Number m, hydrogen_N
 }
 
 
+#if !defined(HYDROGEN_NANBOXING)
+
 /* number of bits in an integer */
 #define NBITS	cast_int(sizeof(hydrogen_Integer) * CHAR_BIT)
 
+/* bits of an integer that a shift right moves */
+#define shiftbits(x)	(x)
+
+#else
+
+/* NaN-boxed integers have fewer bits (see 'object.h') */
+#define NBITS	NBINTBITS
+
+#define shiftbits(x)	l_castU2S(l_castS2U(x) & NBPAYLOAD)
+
+#endif
+
 /*
 ** Shift left operation. (Shift right just negates 'y'.)
 */
@@ -772,7 +907,7 @@ hydrogen_Number hydrogenV_modf (hydrogen_State *L, hydrogen_Number m, hydrogen_N
 hydrogen_Integer hydrogenV_shiftl (hydrogen_Integer x, hydrogen_Integer y) {
   if (y < 0) {  /* shift right? */
     if (y <= -NBITS) return 0;
-    else return intop(>>, x, -y);
+    else return intop(>>, shiftbits(x), -y);
   }
   else {  /* shift left */
     if (y >= NBITS) return 0;
@@ -785,8 +920,8 @@ hydrogen_Integer hydrogenV_shiftl (hydrogen_Integer x, hydrogen_Integer y) {
 ** create a new Hydrogen closure, push it in the stack, and initialize
 ** its upvalues.
 */
-static void pushclosure (hydrogen_State *L, Proto *p, UpVal **enhydrogen, StkId base,
-                         StkId ra) {
+void hydrogenV_pushclosure (hydrogen_State *L, Proto *p, UpVal **enhydrogen,
+                            StkId base, StkId ra) {
   int nup = p->sizeupvalues;
   Upvaldesc *uv = p->upvalues;
   int i;
@@ -810,7 +945,7 @@ void hydrogenV_finishOp (hydrogen_State *L) {
   CallInfo *ci = L->ci;
   StkId base = ci->func + 1;
   Instruction inst = *(ci->u.l.savedpc - 1);  /* interrupted instruction */
-  OpCode op = GET_OPCODE(inst);
+  OpCode op = GET_GENERICOP(inst);
   switch (op) {  /* finish its execution */
     case OP_MMBIN: case OP_MMBINI: case OP_MMBINK: {
       setobjs2s(L, base + GETARG_A(*(ci->u.l.savedpc - 2)), --L->top);
@@ -876,163 +1011,115 @@ void hydrogenV_finishOp (hydrogen_State *L) {
 
 /*
 ** {==================================================================
-** Macros for arithmetic/bitwise/comparison opcodes in 'hydrogenV_execute'
+** Macros for quickened arithmetic/comparison opcodes in 'hydrogenV_execute'
+** (macros for the generic ones are in 'execute.h')
 ** ===================================================================
 */
 
-#define l_addi(L,a,b)	intop(+, a, b)
-#define l_subi(L,a,b)	intop(-, a, b)
-#define l_muli(L,a,b)	intop(*, a, b)
-#define l_band(a,b)	intop(&, a, b)
-#define l_bor(a,b)	intop(|, a, b)
-#define l_bxor(a,b)	intop(^, a, b)
-
-#define l_lti(a,b)	(a < b)
-#define l_lei(a,b)	(a <= b)
-#define l_gti(a,b)	(a > b)
-#define l_gei(a,b)	(a >= b)
-
-
 /*
-** Arithmetic operations with immediate operands. 'iop' is the integer
-** operation, 'fop' is the float operation.
+** Quickened arithmetic operations with register operands: 'II' expects
+** two integers and 'FF' two floats. Other operands deoptimize the
+** instruction to its generic opcode 'g' and do the generic operation.
 */
-#define op_arithI(L,iop,fop) {  \
+#define op_arithII(L,iop,fop,g) {  \
   TValue *v1 = vRB(i);  \
-  int imm = GETARG_sC(i);  \
-  if (ttisinteger(v1)) {  \
-    hydrogen_Integer iv1 = ivalue(v1);  \
-    pc++; setivalue(s2v(ra), iop(L, iv1, imm));  \
+  TValue *v2 = vRC(i);  \
+  if (l_likely(ttisinteger(v1) && ttisinteger(v2))) {  \
+    hydrogen_Integer i1 = ivalue(v1); hydrogen_Integer i2 = ivalue(v2);  \
+    pc++; setivalue(s2v(ra), iop(L, i1, i2));  \
   }  \
-  else if (ttisfloat(v1)) {  \
-    hydrogen_Number nb = fltvalue(v1);  \
-    hydrogen_Number fimm = cast_num(imm);  \
-    pc++; setfltvalue(s2v(ra), fop(L, nb, fimm)); \
+  else {  \
+    deoptimizeop(g);  \
+    op_arith_aux(L, v1, v2, iop, fop);  \
   }}
 
-
-/*
-** Auxiliary function for arithmetic operations over floats and others
-** with two register operands.
-*/
-#define op_arithf_aux(L,v1,v2,fop) {  \
-  hydrogen_Number n1; hydrogen_Number n2;  \
-  if (tonumberns(v1, n1) && tonumberns(v2, n2)) {  \
-    pc++; setfltvalue(s2v(ra), fop(L, n1, n2));  \
-  }}
-
-
-/*
-** Arithmetic operations over floats and others with register operands.
-*/
-#define op_arithf(L,fop) {  \
+#define op_arithFF(L,iop,fop,g) {  \
   TValue *v1 = vRB(i);  \
   TValue *v2 = vRC(i);  \
-  op_arithf_aux(L, v1, v2, fop); }
-
-
-/*
-** Arithmetic operations with K operands for floats.
-*/
-#define op_arithfK(L,fop) {  \
-  TValue *v1 = vRB(i);  \
-  TValue *v2 = KC(i); hydrogen_assert(ttisnumber(v2));  \
-  op_arithf_aux(L, v1, v2, fop); }
-
-
-/*
-** Arithmetic operations over integers and floats.
-*/
-#define op_arith_aux(L,v1,v2,iop,fop) {  \
-  if (ttisinteger(v1) && ttisinteger(v2)) {  \
-    hydrogen_Integer i1 = ivalue(v1); hydrogen_Integer i2 = ivalue(v2);  \
-    pc++; setivalue(s2v(ra), iop(L, i1, i2));  \
+  if (l_likely(ttisfloat(v1) && ttisfloat(v2))) {  \
+    hydrogen_Number n1 = fltvalue(v1); hydrogen_Number n2 = fltvalue(v2);  \
+    pc++; setfltvalue(s2v(ra), fop(L, n1, n2));  \
   }  \
-  else op_arithf_aux(L, v1, v2, fop); }
+  else {  \
+    deoptimizeop(g);  \
+    op_arith_aux(L, v1, v2, iop, fop);  \
+  }}
 
 
 /*
-** Arithmetic operations with register operands.
+** Quickened order operations with two integer register operands.
 */
-#define op_arith(L,iop,fop) {  \
-  TValue *v1 = vRB(i);  \
-  TValue *v2 = vRC(i);  \
-  op_arith_aux(L, v1, v2, iop, fop); }
+#define op_orderII(L,opi,opn,other,g) {  \
+        if (l_likely(ttisinteger(s2v(ra)) && ttisinteger(vRB(i)))) {  \
+          int cond = opi(ivalue(s2v(ra)), ivalue(vRB(i)));  \
+          docondjump();  \
+        }  \
+        else {  \
+          deoptimizeop(g);  \
+          op_order(L, opi, opn, other);  \
+        }}
 
 
-/*
-** Arithmetic operations with K operands.
-*/
-#define op_arithK(L,iop,fop) {  \
-  TValue *v1 = vRB(i);  \
-  TValue *v2 = KC(i); hydrogen_assert(ttisnumber(v2));  \
-  op_arith_aux(L, v1, v2, iop, fop); }
+/* }================================================================== */
 
 
 /*
-** Bitwise operations with constant operand.
+** {==================================================================
+** Quickening: a generic instruction that keeps running with operands
+** of the same types is rewritten in place to a specialized opcode
+** (see notes in 'opcodes.h'). The state of each instruction lives in
+** its inline cache: 'quick.state' has the candidate opcode and how many
+** times in a row it was seen; 'quick.unstable' counts how many times
+** the instruction proved unstable (changed candidate or was
+** deoptimized).
+** ===================================================================
 */
-#define op_bitwiseK(L,op) {  \
-  TValue *v1 = vRB(i);  \
-  TValue *v2 = KC(i);  \
-  hydrogen_Integer i1;  \
-  hydrogen_Integer i2 = ivalue(v2);  \
-  if (tointegerns(v1, &i1)) {  \
-    pc++; setivalue(s2v(ra), op(i1, i2));  \
-  }}
 
+/* number of runs with the same candidate before quickening */
+#define QUICKENLIMIT	8
 
-/*
-** Bitwise operations with register operands.
-*/
-#define op_bitwise(L,op) {  \
-  TValue *v1 = vRB(i);  \
-  TValue *v2 = vRC(i);  \
-  hydrogen_Integer i1; hydrogen_Integer i2;  \
-  if (tointegerns(v1, &i1) && tointegerns(v2, &i2)) {  \
-    pc++; setivalue(s2v(ra), op(i1, i2));  \
-  }}
+/* unstable instructions are no longer observed after that many times */
+#define MAXUNSTABLE	4
+
+#define qstate(op,n)	(cast_uint(op) | (cast_uint(n) << 8))
+#define qop(s)		cast(OpCode, (s) & 0xff)
+#define qcount(s)	((s) >> 8)
 
 
 /*
-** Order operations with register operands. 'opn' actually works
-** for all numbers, but the fast track improves performance for
-** integers.
+** Generic instruction '*pc' ran with operands that suit opcode 'q'
+** ('q' is the generic opcode itself when no specialization applies).
+** Returns true if it rewrote the instruction.
 */
-#define op_order(L,opi,opn,other) {  \
-        int cond;  \
-        TValue *rb = vRB(i);  \
-        if (ttisinteger(s2v(ra)) && ttisinteger(rb)) {  \
-          hydrogen_Integer ia = ivalue(s2v(ra));  \
-          hydrogen_Integer ib = ivalue(rb);  \
-          cond = opi(ia, ib);  \
-        }  \
-        else if (ttisnumber(s2v(ra)) && ttisnumber(rb))  \
-          cond = opn(s2v(ra), rb);  \
-        else  \
-          Protect(cond = other(L, s2v(ra), rb));  \
-        docondjump(); }
+static int observe (ICache *ic, Instruction *pc, OpCode q) {
+  unsigned int n = qcount(ic->quick.state);
+  if (n == 0 || qop(ic->quick.state) != q) {  /* first run or new candidate? */
+    if (n > 0)
+      ic->quick.unstable++;  /* operand types are not stable */
+    ic->quick.state = qstate(q, 1);
+  }
+  else if (n < QUICKENLIMIT)
+    ic->quick.state = qstate(q, n + 1);
+  else if (isquickop(q)) {  /* stable specialized candidate? */
+    SET_OPCODE(*pc, q);  /* quicken it */
+    ic->quick.state = 0;
+    return 1;
+  }
+  else  /* stable, but with nothing to specialize */
+    ic->quick.unstable = MAXUNSTABLE;  /* stop observing it */
+  return 0;
+}
 
 
 /*
-** Order operations with immediate operand. (Immediate operand is
-** always small enough to have an exact representation as a float.)
+** Quickened instruction '*pc' got unexpected operands: turn it back
+** into generic opcode 'op'.
 */
-#define op_orderI(L,opi,opf,inv,tm) {  \
-        int cond;  \
-        int im = GETARG_sB(i);  \
-        if (ttisinteger(s2v(ra)))  \
-          cond = opi(ivalue(s2v(ra)), im);  \
-        else if (ttisfloat(s2v(ra))) {  \
-          hydrogen_Number fa = fltvalue(s2v(ra));  \
-          hydrogen_Number fim = cast_num(im);  \
-          cond = opf(fa, fim);  \
-        }  \
-        else {  \
-          int isf = GETARG_C(i);  \
-          Protect(cond = hydrogenT_callorderiTM(L, s2v(ra), im, inv, isf, tm));  \
-        }  \
-        docondjump(); }
+static void deoptimize (ICache *ic, Instruction *pc, OpCode op) {
+  SET_OPCODE(*pc, op);
+  ic->quick.state = 0;
+  ic->quick.unstable++;
+}
 
 /* }================================================================== */
 
@@ -1044,82 +1131,163 @@ void hydrogenV_finishOp (hydrogen_State *L) {
 */
 
 /*
-** some macros for common tasks in 'hydrogenV_execute'
+** some macros for common tasks in 'hydrogenV_execute' (the ones shared
+** with code compiled ahead of time are in 'execute.h')
 */
 
+/* 'q' is only evaluated while the instruction is being observed */
+#define observeop(q)  \
+	{ ICache *ic_ = IC(pc); \
+	  if (ic_->quick.unstable < MAXUNSTABLE && \
+	      observe(ic_, cast(Instruction *, pc - 1), q)) \
+	    redecode(); }
 
-#define RA(i)	(base+GETARG_A(i))
-#define RB(i)	(base+GETARG_B(i))
-#define vRB(i)	s2v(RB(i))
-#define KB(i)	(k+GETARG_B(i))
-#define RC(i)	(base+GETARG_C(i))
-#define vRC(i)	s2v(RC(i))
-#define KC(i)	(k+GETARG_C(i))
-#define RKC(i)	((TESTARG_k(i)) ? k + GETARG_C(i) : s2v(base + GETARG_C(i)))
-
-
-
-#define updatetrap(ci)  (trap = ci->u.l.trap)
-
-#define updatebase(ci)	(base = ci->func + 1)
+#define deoptimizeop(op)  \
+	{ deoptimize(IC(pc), cast(Instruction *, pc - 1), op); redecode(); }
 
+/* candidate for arithmetic instructions with register operands */
+#define arithcand(qi,qf,op)  \
+	((ttisinteger(vRB(i)) && ttisinteger(vRC(i))) ? (qi) :  \
+	 (ttisfloat(vRB(i)) && ttisfloat(vRC(i))) ? (qf) : (op))
 
-#define updatestack(ci)  \
-	{ if (l_unlikely(trap)) { updatebase(ci); ra = RA(i); } }
-
+/* true if integer 'n' is within the array limit of table 't' */
+#define arraycand(t,n)  \
+	(ttistable(t) && l_castS2U(n) - 1u < hvalue(t)->alimit)
 
 /*
-** Execute a jump instruction. The 'updatetrap' allows signals to stop
-** tight loops. (Without it, the local copy of 'trap' could never change.)
+** true if 't' is a table and integer 'n' indexes a non-empty entry of
+** its array part; in that case, the entry is copied to 'res'.
 */
-#define dojump(ci,i,e)	{ pc += GETARG_sJ(i) + e; updatetrap(ci); }
+#define getarray(t,n,res)  \
+	(arraycand(t,n) && hydrogenH_fastgetint(hvalue(t), n, res))
 
+/*
+** true if 't' is a table and integer 'n' indexes an entry of its array
+** part that can be set without a metamethod (see 'hydrogenV_fastseti');
+** in that case, the entry is set to 'v'.
+*/
+l_sinline int setarray (hydrogen_State *L, const TValue *t, hydrogen_Integer n,
+                        TValue *v) {
+  Table *h;
+  if (!arraycand(t, n))
+    return 0;
+  h = hvalue(t);
+  if (h->metatable != NULL && arrisempty(h, n - 1))
+    return 0;  /* may need '__newindex' */
+  arrsetobj(h, n - 1, v);
+  hydrogenC_barrierback(L, obj2gco(h), v);
+  return 1;
+}
 
-/* for test instructions, execute the jump instruction that follows it */
-#define donextjump(ci)	{ Instruction ni = *pc; dojump(ci, ni, 1); }
 
+#if defined(HYDROGEN_USE_JIT)
 /*
-** do a conditional jump: skip next instruction if 'cond' is not what
-** was expected (parameter 'k'), else do next instruction, which must
-** be a jump.
+** Backward jump of loop instruction 'i' ('pc' is already the first
+** instruction of the loop body): run the trace of the loop, or count
+** the iteration towards recording one (recording turns 'trap' on).
 */
-#define docondjump()	if (cond != GETARG_k(i)) pc++; else donextjump(ci);
+#define jitloop() {  \
+  const Instruction *lpc = pc + GETARG_Bx(i) - 1;  \
+  if (hydrogenJ_traceable(L, IC(lpc + 1))) {  \
+    pc = hydrogenJ_backedge(L, ci, lpc);  \
+    updatetrap(ci);  \
+  }  \
+}
+#endif
 
 
 /*
-** Correct global 'pc'.
+** Body of OP_CALL, which also ends all fused instructions.
 */
-#define savepc(L)	(ci->u.l.savedpc = pc)
-
+#define op_call() {  \
+  CallInfo *newci;  \
+  int b = GETARG_B(i);  \
+  int nresults = GETARG_C(i) - 1;  \
+  if (b != 0)  /* fixed number of arguments? */  \
+    L->top = ra + b;  /* top signals number of arguments */  \
+  /* else previous instruction set top */  \
+  savepc(L);  /* in case of errors */  \
+  if ((newci = hydrogenD_precall(L, ra, nresults)) == NULL)  \
+    updatetrap(ci);  /* C call; nothing else to be done */  \
+  else {  /* Hydrogen call: run function in this same C frame */  \
+    ci = newci;  \
+    goto startfunc;  \
+  }}
 
 /*
-** Whenever code can raise errors, the global 'pc' and the global
-** 'top' must be correct to report occasional errors.
+** Second half of a fused instruction: run the OP_CALL that follows it
+** without a new dispatch. With 'trap' on (hooks, or a stack that may
+** have moved), leave the call to the normal path.
 */
-#define savestate(L,ci)		(savepc(L), L->top = ci->top)
+#define fusedcall()  \
+  if (l_likely(!trap)) {  \
+    i = *(pc++);  \
+    ra = RA(i);  \
+    hydrogen_assert(GET_OPCODE(i) == OP_CALL);  \
+    op_call();  \
+  }
+
+
+
+#if HYDROGEN_USE_DIRECTTHREADING
+
+/* predecode instruction 'ins' into 'di' */
+#define setdecoded(di,ins)  \
+	((di)->handler = cast_int(cast(const char *,  \
+	                   disptab[GET_OPCODE(ins)]) - HANDLERBASE),  \
+	 (di)->a = cast_byte(getarg(ins, POS_A, SIZE_A)),  \
+	 (di)->b = cast_byte(getarg(ins, POS_B, SIZE_B)),  \
+	 (di)->c = cast_byte(getarg(ins, POS_C, SIZE_C)),  \
+	 (di)->k = cast_byte(getarg(ins, POS_k, 1)))
 
+/* the interpreter rewrote the current instruction; predecode it again */
+#define redecode()	setdecoded(cast(DecodedInstruction *, d), *(pc - 1))
+
+/* predecode the code of prototype 'p' */
+#define decode(L,p) {  \
+  int n_;  \
+  DecodedInstruction *dc_ = hydrogenM_newvector(L, p->sizecode,  \
+                                                DecodedInstruction);  \
+  for (n_ = 0; n_ < p->sizecode; n_++)  \
+    setdecoded(&dc_[n_], p->code[n_]);  \
+  p->dcode = dc_; }
 
 /*
-** Protect code that, in general, can raise errors, reallocate the
-** stack, and change the hooks.
+** Operands of the current instruction come predecoded. (The argument
+** of these macros must be the current instruction.)
 */
-#define Protect(exp)  (savestate(L,ci), (exp), updatetrap(ci))
-
-/* special version that does not change the top */
-#define ProtectNT(exp)  (savepc(L), (exp), updatetrap(ci))
+#undef RB
+#undef KB
+#undef RC
+#undef KC
+#undef RKC
+#define RB(i)	(base+d->b)
+#define KB(i)	(k+d->b)
+#define RC(i)	(base+d->c)
+#define KC(i)	(k+d->c)
+#define RKC(i)	((d->k) ? k + d->c : s2v(base + d->c))
 
 /*
-** Protect code that can only raise errors. (That is, it cannot change
-** the stack or hooks.)
+** Size of a predecoded instruction in instructions, so that the
+** predecoded copy of '*pc' is at the same (scaled) offset as 'pc'
 */
-#define halfProtect(exp)  (savestate(L,ci), (exp))
+#define DECODEDRATIO	(sizeof(DecodedInstruction) / sizeof(Instruction))
+
+/* fetch an instruction and prepare its execution */
+#define vmfetch()	{ \
+  if (l_unlikely(trap)) {  /* stack reallocation or hooks? */ \
+    trap = hydrogenG_traceexec(L, pc);  /* handle hooks */ \
+    updatebase(ci);  /* correct stack */ \
+  } \
+  d = cast(const DecodedInstruction *, cast_charp(dcode) + \
+        (cast_charp(pc) - cast_charp(code)) * DECODEDRATIO); \
+  i = *(pc++); \
+  ra = base + d->a; /* WARNING: any stack reallocation invalidates 'ra' */ \
+}
 
-/* 'c' is the limit of live values in the stack */
-#define checkGC(L,c)  \
-	{ hydrogenC_condGC(L, (savepc(L), L->top = (c)), \
-                         updatetrap(ci)); \
-           hydrogeni_threadyield(L); }
+#else
 
+#define redecode()	((void)0)
 
 /* fetch an instruction and prepare its execution */
 #define vmfetch()	{ \
@@ -1131,6 +1299,8 @@ void hydrogenV_finishOp (hydrogen_State *L) {
   ra = RA(i); /* WARNING: any stack reallocation invalidates 'ra' */ \
 }
 
+#endif
+
 #define vmdispatch(o)	switch(o)
 #define vmcase(l)	case l:
 #define vmbreak		break
@@ -1142,6 +1312,10 @@ void hydrogenV_execute (hydrogen_State *L, CallInfo *ci) {
   StkId base;
   const Instruction *pc;
   int trap;
+#if HYDROGEN_USE_DIRECTTHREADING
+  const Instruction *code;  /* code of the running function */
+  const DecodedInstruction *dcode;  /* its predecoded copy */
+#endif
 #if HYDROGEN_USE_JUMPTABLE
 #include "jumptab.h"
 #endif
@@ -1151,6 +1325,12 @@ void hydrogenV_execute (hydrogen_State *L, CallInfo *ci) {
   cl = clLvalue(s2v(ci->func));
   k = cl->p->k;
   pc = ci->u.l.savedpc;
+#if HYDROGEN_USE_DIRECTTHREADING
+  if (l_unlikely(cl->p->dcode == NULL))  /* first run of the function? */
+    decode(L, cl->p);
+  code = cl->p->code;
+  dcode = cl->p->dcode;
+#endif
   if (l_unlikely(trap)) {
     if (pc == cl->p->code) {  /* first instruction (not resuming)? */
       if (cl->p->is_vararg)
@@ -1160,11 +1340,46 @@ void hydrogenV_execute (hydrogen_State *L, CallInfo *ci) {
     }
     ci->u.l.trap = 1;  /* assume trap is on, for now */
   }
+#if defined(HYDROGEN_USE_AOT)
+  else if (cl->p->aot != NULL) {  /* compiled ahead of time? */
+    switch (cl->p->aot(L, ci)) {
+      case AOT_CALL: {  /* call to a Hydrogen function */
+        ci = L->ci;
+        goto startfunc;  /* execute the callee */
+      }
+      case AOT_RETURN: goto ret;
+      default: {  /* hooks were turned on; interpret the rest */
+        pc = ci->u.l.savedpc;
+        trap = ci->u.l.trap = 1;
+        break;
+      }
+    }
+  }
+#endif
+#if defined(HYDROGEN_USE_JIT)
+  else if (hydrogenJ_ready(L, cl->p, ci)) {  /* run it in native code? */
+    switch (hydrogenJ_run(L, ci)) {
+      case JIT_CALL: {  /* call to a Hydrogen function */
+        ci = L->ci;
+        goto startfunc;  /* execute the callee */
+      }
+      case JIT_RETURN: goto ret;
+      default: {  /* hooks were turned on; interpret the rest */
+        pc = ci->u.l.savedpc;
+        trap = ci->u.l.trap = 1;
+        break;
+      }
+    }
+  }
+#endif
   base = ci->func + 1;
   /* main loop of interpreter */
   for (;;) {
     Instruction i;  /* instruction being executed */
     StkId ra;  /* instruction's A register */
+#if HYDROGEN_USE_DIRECTTHREADING
+    const DecodedInstruction *d;  /* predecoded 'i' */
+#endif
     vmfetch();
     #if 0
       /* low-level line tracing for debugging Hydrogen */
@@ -1232,28 +1447,18 @@ void hydrogenV_execute (hydrogen_State *L, CallInfo *ci) {
         vmbreak;
       }
       vmcase(OP_GETTABUP) {
-        const TValue *slot;
-        TValue *upval = cl->upvals[GETARG_B(i)]->v;
-        TValue *rc = KC(i);
-        TString *key = tsvalue(rc);  /* key must be a string */
-        if (hydrogenV_fastget(L, upval, key, slot, hydrogenH_getshortstr)) {
-          setobj2s(L, ra, slot);
-        }
-        else
-          Protect(hydrogenV_finishget(L, upval, rc, ra, slot));
+        op_gettabup();
         vmbreak;
       }
       vmcase(OP_GETTABLE) {
         const TValue *slot;
         TValue *rb = vRB(i);
         TValue *rc = vRC(i);
-        hydrogen_Unsigned n;
-        if (ttisinteger(rc)  /* fast track for integers? */
-            ? (cast_void(n = ivalue(rc)), hydrogenV_fastgeti(L, rb, n, slot))
-            : hydrogenV_fastget(L, rb, rc, slot, hydrogenH_get)) {
-          setobj2s(L, ra, slot);
-        }
-        else
+        observeop((ttisinteger(rc) && arraycand(rb, ivalue(rc)))
+                  ? OP_GETTABLE_ARRAY : OP_GETTABLE);
+        if (!(ttisinteger(rc)  /* fast track for integers? */
+              ? hydrogenV_fastgeti(L, rb, ivalue(rc), s2v(ra), slot)
+              : hydrogenV_fastgetv(L, rb, rc, s2v(ra), slot)))
           Protect(hydrogenV_finishget(L, rb, rc, ra, slot));
         vmbreak;
       }
@@ -1261,10 +1466,8 @@ void hydrogenV_execute (hydrogen_State *L, CallInfo *ci) {
         const TValue *slot;
         TValue *rb = vRB(i);
         int c = GETARG_C(i);
-        if (hydrogenV_fastgeti(L, rb, c, slot)) {
-          setobj2s(L, ra, slot);
-        }
-        else {
+        observeop(arraycand(rb, c) ? OP_GETI_ARRAY : OP_GETI);
+        if (!hydrogenV_fastgeti(L, rb, c, s2v(ra), slot)) {
           TValue key;
           setivalue(&key, c);
           Protect(hydrogenV_finishget(L, rb, &key, ra, slot));
@@ -1272,15 +1475,7 @@ void hydrogenV_execute (hydrogen_State *L, CallInfo *ci) {
         vmbreak;
       }
       vmcase(OP_GETFIELD) {
-        const TValue *slot;
-        TValue *rb = vRB(i);
-        TValue *rc = KC(i);
-        TString *key = tsvalue(rc);  /* key must be a string */
-        if (hydrogenV_fastget(L, rb, key, slot, hydrogenH_getshortstr)) {
-          setobj2s(L, ra, slot);
-        }
-        else
-          Protect(hydrogenV_finishget(L, rb, rc, ra, slot));
+        op_getfield();
         vmbreak;
       }
       vmcase(OP_SETTABUP) {
@@ -1289,7 +1484,7 @@ void hydrogenV_execute (hydrogen_State *L, CallInfo *ci) {
         TValue *rb = KB(i);
         TValue *rc = RKC(i);
         TString *key = tsvalue(rb);  /* key must be a string */
-        if (hydrogenV_fastget(L, upval, key, slot, hydrogenH_getshortstr)) {
+        if (hydrogenV_fastgetcached(L, upval, key, slot, &IC(pc)->field.slot)) {
           hydrogenV_finishfastset(L, upval, slot, rc);
         }
         else
@@ -1301,12 +1496,12 @@ void hydrogenV_execute (hydrogen_State *L, CallInfo *ci) {
         TValue *rb = vRB(i);  /* key (table is in 'ra') */
         TValue *rc = RKC(i);  /* value */
         hydrogen_Unsigned n;
-        if (ttisinteger(rb)  /* fast track for integers? */
-            ? (cast_void(n = ivalue(rb)), hydrogenV_fastgeti(L, s2v(ra), n, slot))
-            : hydrogenV_fastget(L, s2v(ra), rb, slot, hydrogenH_get)) {
-          hydrogenV_finishfastset(L, s2v(ra), slot, rc);
-        }
-        else
+        observeop((ttisinteger(rb) && arraycand(s2v(ra), ivalue(rb)))
+                  ? OP_SETTABLE_ARRAY : OP_SETTABLE);
+        if (!(ttisinteger(rb)  /* fast track for integers? */
+              ? (cast_void(n = ivalue(rb)),
+                 hydrogenV_fastseti(L, s2v(ra), n, rc, slot))
+              : hydrogenV_fastset(L, s2v(ra), rb, rc, slot)))
           Protect(hydrogenV_finishset(L, s2v(ra), rb, rc, slot));
         vmbreak;
       }
@@ -1314,10 +1509,8 @@ void hydrogenV_execute (hydrogen_State *L, CallInfo *ci) {
         const TValue *slot;
         int c = GETARG_B(i);
         TValue *rc = RKC(i);
-        if (hydrogenV_fastgeti(L, s2v(ra), c, slot)) {
-          hydrogenV_finishfastset(L, s2v(ra), slot, rc);
-        }
-        else {
+        observeop(arraycand(s2v(ra), c) ? OP_SETI_ARRAY : OP_SETI);
+        if (!hydrogenV_fastseti(L, s2v(ra), c, rc, slot)) {
           TValue key;
           setivalue(&key, c);
           Protect(hydrogenV_finishset(L, s2v(ra), &key, rc, slot));
@@ -1329,7 +1522,7 @@ void hydrogenV_execute (hydrogen_State *L, CallInfo *ci) {
         TValue *rb = KB(i);
         TValue *rc = RKC(i);
         TString *key = tsvalue(rb);  /* key must be a string */
-        if (hydrogenV_fastget(L, s2v(ra), key, slot, hydrogenH_getshortstr)) {
+        if (hydrogenV_fastgetcached(L, s2v(ra), key, slot, &IC(pc)->field.slot)) {
           hydrogenV_finishfastset(L, s2v(ra), slot, rc);
         }
         else
@@ -1355,16 +1548,7 @@ void hydrogenV_execute (hydrogen_State *L, CallInfo *ci) {
         vmbreak;
       }
       vmcase(OP_SELF) {
-        const TValue *slot;
-        TValue *rb = vRB(i);
-        TValue *rc = RKC(i);
-        TString *key = tsvalue(rc);  /* key must be a string */
-        setobj2s(L, ra + 1, rb);
-        if (hydrogenV_fastget(L, rb, key, slot, hydrogenH_getstr)) {
-          setobj2s(L, ra, slot);
-        }
-        else
-          Protect(hydrogenV_finishget(L, rb, rc, ra, slot));
+        op_self();
         vmbreak;
       }
       vmcase(OP_ADDI) {
@@ -1430,14 +1614,17 @@ void hydrogenV_execute (hydrogen_State *L, CallInfo *ci) {
         vmbreak;
       }
       vmcase(OP_ADD) {
+        observeop(arithcand(OP_ADD_II, OP_ADD_FF, OP_ADD));
         op_arith(L, l_addi, hydrogeni_numadd);
         vmbreak;
       }
       vmcase(OP_SUB) {
+        observeop(arithcand(OP_SUB_II, OP_SUB_FF, OP_SUB));
         op_arith(L, l_subi, hydrogeni_numsub);
         vmbreak;
       }
       vmcase(OP_MUL) {
+        observeop(arithcand(OP_MUL_II, OP_MUL_FF, OP_MUL));
         op_arith(L, l_muli, hydrogeni_nummul);
         vmbreak;
       }
@@ -1563,15 +1750,20 @@ void hydrogenV_execute (hydrogen_State *L, CallInfo *ci) {
       vmcase(OP_EQ) {
         int cond;
         TValue *rb = vRB(i);
+        observeop((ttisinteger(s2v(ra)) && ttisinteger(rb)) ? OP_EQ_II : OP_EQ);
         Protect(cond = hydrogenV_equalobj(L, s2v(ra), rb));
         docondjump();
         vmbreak;
       }
       vmcase(OP_LT) {
+        observeop((ttisinteger(s2v(ra)) && ttisinteger(vRB(i)))
+                  ? OP_LT_II : OP_LT);
         op_order(L, l_lti, LTnum, lessthanothers);
         vmbreak;
       }
       vmcase(OP_LE) {
+        observeop((ttisinteger(s2v(ra)) && ttisinteger(vRB(i)))
+                  ? OP_LE_II : OP_LE);
         op_order(L, l_lei, LEnum, lessequalothers);
         vmbreak;
       }
@@ -1626,19 +1818,7 @@ void hydrogenV_execute (hydrogen_State *L, CallInfo *ci) {
         vmbreak;
       }
       vmcase(OP_CALL) {
-        CallInfo *newci;
-        int b = GETARG_B(i);
-        int nresults = GETARG_C(i) - 1;
-        if (b != 0)  /* fixed number of arguments? */
-          L->top = ra + b;  /* top signals number of arguments */
-        /* else previous instruction set top */
-        savepc(L);  /* in case of errors */
-        if ((newci = hydrogenD_precall(L, ra, nresults)) == NULL)
-          updatetrap(ci);  /* C call; nothing else to be done */
-        else {  /* Hydrogen call: run function in this same C frame */
-          ci = newci;
-          goto startfunc;
-        }
+        op_call();
         vmbreak;
       }
       vmcase(OP_TAILCALL) {
@@ -1743,14 +1923,22 @@ void hydrogenV_execute (hydrogen_State *L, CallInfo *ci) {
             pc -= GETARG_Bx(i);  /* jump back */
           }
         }
-        else if (floatforloop(ra))  /* float loop */
+        else if (hydrogenV_floatforloop(ra))  /* float loop */
           pc -= GETARG_Bx(i);  /* jump back */
         updatetrap(ci);  /* allows a signal to break the loop */
+#if defined(HYDROGEN_USE_JIT)
+        if (!trap && *(pc - 1) != i)  /* jumped back (after OP_FORPREP)? */
+          jitloop();
+        if (!trap && hydrogenJ_loop(L, cl->p)) {  /* hot loop? */
+          savepc(ci);
+          goto returning;  /* go on in native code */
+        }
+#endif
         vmbreak;
       }
       vmcase(OP_FORPREP) {
         savestate(L, ci);  /* in case of errors */
-        if (forprep(L, ra))
+        if (hydrogenV_forprep(L, ra))
           pc += GETARG_Bx(i) + 1;  /* skip the loop */
         vmbreak;
       }
@@ -1783,6 +1971,14 @@ void hydrogenV_execute (hydrogen_State *L, CallInfo *ci) {
         if (!ttisnil(s2v(ra + 4))) {  /* continue loop? */
           setobjs2s(L, ra + 2, ra + 4);  /* save control variable */
           pc -= GETARG_Bx(i);  /* jump back */
+#if defined(HYDROGEN_USE_JIT)
+          if (!trap)
+            jitloop();
+          if (!trap && hydrogenJ_loop(L, cl->p)) {  /* hot loop? */
+            savepc(ci);
+            goto returning;  /* go on in native code */
+          }
+#endif
         }
         vmbreak;
       }
@@ -1803,7 +1999,7 @@ void hydrogenV_execute (hydrogen_State *L, CallInfo *ci) {
           hydrogenH_resizearray(L, h, last);  /* preallocate it at once */
         for (; n > 0; n--) {
           TValue *val = s2v(ra + n);
-          setobj2t(L, &h->array[last - 1], val);
+          arrsetobj(h, last - 1, val);
           last--;
           hydrogenC_barrierback(L, obj2gco(h), val);
         }
@@ -1811,7 +2007,7 @@ void hydrogenV_execute (hydrogen_State *L, CallInfo *ci) {
       }
       vmcase(OP_CLOSURE) {
         Proto *p = cl->p->p[GETARG_Bx(i)];
-        halfProtect(pushclosure(L, p, cl->upvals, base, ra));
+        halfProtect(hydrogenV_pushclosure(L, p, cl->upvals, base, ra));
         checkGC(L, ra + 1);
         vmbreak;
       }
@@ -1833,6 +2029,117 @@ void hydrogenV_execute (hydrogen_State *L, CallInfo *ci) {
         hydrogen_assert(0);
         vmbreak;
       }
+      vmcase(OP_GETTABUP_CALL) {
+        op_gettabup();
+        fusedcall();
+        vmbreak;
+      }
+      vmcase(OP_GETFIELD_CALL) {
+        op_getfield();
+        fusedcall();
+        vmbreak;
+      }
+      vmcase(OP_SELF_CALL) {
+        op_self();
+        fusedcall();
+        vmbreak;
+      }
+      vmcase(OP_ADD_II) {
+        op_arithII(L, l_addi, hydrogeni_numadd, OP_ADD);
+        vmbreak;
+      }
+      vmcase(OP_ADD_FF) {
+        op_arithFF(L, l_addi, hydrogeni_numadd, OP_ADD);
+        vmbreak;
+      }
+      vmcase(OP_SUB_II) {
+        op_arithII(L, l_subi, hydrogeni_numsub, OP_SUB);
+        vmbreak;
+      }
+      vmcase(OP_SUB_FF) {
+        op_arithFF(L, l_subi, hydrogeni_numsub, OP_SUB);
+        vmbreak;
+      }
+      vmcase(OP_MUL_II) {
+        op_arithII(L, l_muli, hydrogeni_nummul, OP_MUL);
+        vmbreak;
+      }
+      vmcase(OP_MUL_FF) {
+        op_arithFF(L, l_muli, hydrogeni_nummul, OP_MUL);
+        vmbreak;
+      }
+      vmcase(OP_EQ_II) {
+        int cond;
+        TValue *rb = vRB(i);
+        if (l_likely(ttisinteger(s2v(ra)) && ttisinteger(rb)))
+          cond = (ivalue(s2v(ra)) == ivalue(rb));
+        else {
+          deoptimizeop(OP_EQ);
+          Protect(cond = hydrogenV_equalobj(L, s2v(ra), rb));
+        }
+        docondjump();
+        vmbreak;
+      }
+      vmcase(OP_LT_II) {
+        op_orderII(L, l_lti, LTnum, lessthanothers, OP_LT);
+        vmbreak;
+      }
+      vmcase(OP_LE_II) {
+        op_orderII(L, l_lei, LEnum, lessequalothers, OP_LE);
+        vmbreak;
+      }
+      vmcase(OP_GETTABLE_ARRAY) {
+        const TValue *slot;
+        TValue *rb = vRB(i);
+        TValue *rc = vRC(i);
+        if (l_unlikely(!(ttisinteger(rc) &&
+                         getarray(rb, ivalue(rc), s2v(ra))))) {
+          deoptimizeop(OP_GETTABLE);
+          if (!hydrogenV_fastgetv(L, rb, rc, s2v(ra), slot))
+            Protect(hydrogenV_finishget(L, rb, rc, ra, slot));
+        }
+        vmbreak;
+      }
+      vmcase(OP_GETI_ARRAY) {
+        const TValue *slot;
+        TValue *rb = vRB(i);
+        int c = GETARG_C(i);
+        if (l_unlikely(!getarray(rb, c, s2v(ra)))) {
+          deoptimizeop(OP_GETI);
+          if (!hydrogenV_fastgeti(L, rb, c, s2v(ra), slot)) {
+            TValue key;
+            setivalue(&key, c);
+            Protect(hydrogenV_finishget(L, rb, &key, ra, slot));
+          }
+        }
+        vmbreak;
+      }
+      vmcase(OP_SETTABLE_ARRAY) {
+        const TValue *slot;
+        TValue *rb = vRB(i);  /* key (table is in 'ra') */
+        TValue *rc = RKC(i);  /* value */
+        if (l_unlikely(!(ttisinteger(rb) &&
+                         setarray(L, s2v(ra), ivalue(rb), rc)))) {
+          deoptimizeop(OP_SETTABLE);
+          if (!hydrogenV_fastset(L, s2v(ra), rb, rc, slot))
+            Protect(hydrogenV_finishset(L, s2v(ra), rb, rc, slot));
+        }
+        vmbreak;
+      }
+      vmcase(OP_SETI_ARRAY) {
+        const TValue *slot;
+        int c = GETARG_B(i);
+        TValue *rc = RKC(i);
+        if (l_unlikely(!setarray(L, s2v(ra), c, rc))) {
+          deoptimizeop(OP_SETI);
+          if (!hydrogenV_fastseti(L, s2v(ra), c, rc, slot)) {
+            TValue key;
+            setivalue(&key, c);
+            Protect(hydrogenV_finishset(L, s2v(ra), &key, rc, slot));
+          }
+        }
+        vmbreak;
+      }
     }
   }
 }